@@ -5,7 +5,10 @@ check_include_files(endian.h HAVE_ENDIAN_H)
 check_include_files(inttypes.h HAVE_INTTYPES_H)
 check_include_files(pthread.h HAVE_PTHREAD_H)
 check_include_files(sys/endian.h HAVE_SYS_ENDIAN_H)
+check_include_files(sys/mman.h HAVE_SYS_MMAN_H)
 check_include_files(sys/param.h HAVE_SYS_PARAM_H)
+check_include_files(sys/sdt.h HAVE_SYS_SDT_H)
+check_include_files(sys/uio.h HAVE_SYS_UIO_H)
 check_include_files(sys/utsname.h HAVE_SYS_UTSNAME_H)
 check_include_files(fcntl.h HAVE_FCNTL_H)
 check_include_files(unistd.h HAVE_UNISTD_H)
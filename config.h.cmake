@@ -6,6 +6,9 @@
 /* Define if you have the Berkeley DB library. */
 #cmakedefine HAVE_BDB 1
 
+/* Define if you have the zlib library. */
+#cmakedefine HAVE_ZLIB 1
+
 /* Define to 1 if you have the `backtrace' function. */
 #cmakedefine HAVE_BACKTRACE 1
 
@@ -129,9 +132,15 @@
 /* Define to 1 if you have the `setenv' function. */
 #cmakedefine HAVE_SETENV 1
 
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
 /* Define to 1 if you have the <sys/param.h> header file. */
 #cmakedefine HAVE_SYS_PARAM_H 1
 
+/* Define to 1 if you have the <sys/uio.h> header file. */
+#cmakedefine HAVE_SYS_UIO_H 1
+
 /* Define to 1 if you have the <sys/utsname.h> header file. */
 #cmakedefine HAVE_SYS_UTSNAME_H 1
 
@@ -165,6 +174,9 @@
 /* Define to 1 if you have the <wctype.h> header file. */
 #cmakedefine HAVE_WCTYPE_H 1
 
+/* Define to 1 if you have the <sys/sdt.h> header file. */
+#cmakedefine HAVE_SYS_SDT_H 1
+
 /* Define to make icalerror_* calls abort instead of internally signalling an
    error */
 #define ICAL_ERRORS_ARE_FATAL ${ICAL_ERRORS_ARE_FATAL}
@@ -172,6 +184,9 @@
 /* Define to prevent empty properties from being replaced with X-LIC-ERROR properties */
 #define ICAL_ALLOW_EMPTY_PROPERTIES ${ICAL_ALLOW_EMPTY_PROPERTIES}
 
+/* Define to compile the hot-path tracepoints in */
+#define ICAL_ENABLE_TRACE ${ICAL_ENABLE_TRACE}
+
 /* Define to the address where bug reports for this package should be sent. */
 #define PACKAGE_BUGREPORT "${PROJECT_URL}"
 
@@ -190,6 +205,9 @@
 /* whether we should bring our own TZ-Data */
 #cmakedefine USE_BUILTIN_TZDATA
 
+/* Define if the builtin timezone data is compiled into the library. */
+#cmakedefine ICAL_EMBED_TZDATA
+
 /* Define to empty if `const' does not conform to ANSI C. */
 #cmakedefine const
 
@@ -156,6 +156,9 @@ sub insert_code
 
     #Create the parameter Name map
 
+    my @kind_rows;
+    my $max_kind = $params{'NO'}->{"kindEnum"};
+
     $out   = "";
     $count = 0;
     foreach $param (sort keys %params) {
@@ -168,6 +171,11 @@ sub insert_code
       my $uc = join("", map {uc(lc($_));} split(/-/, $param));
 
       $count++;
+      push(@kind_rows, {name => "ICAL_${uc}_PARAMETER", kind => $params{$param}->{"kindEnum"}});
+      if ($params{$param}->{"kindEnum"} > $max_kind) {
+        $max_kind = $params{$param}->{"kindEnum"};
+      }
+
       $out .= "    {ICAL_${uc}_PARAMETER, \"$param\"},\n";
 
     }
@@ -176,7 +184,29 @@ sub insert_code
     print $out;
     print "    { ICAL_NO_PARAMETER, \"\"}\n};\n\n";
 
+    # The kind enumeration is not dense and is not bounded by
+    # ICAL_NO_PARAMETER, so the direct-index tables are sized by the
+    # largest kind value in the design data.
+    print "#define ICALPARAMETER_KIND_TABLE_SIZE " . ($max_kind + 1) . "\n\n";
+
+    # Dense kind -> 1-based parameter_map row (0 = not in the map), so
+    # the kind lookups are direct indexing instead of a scan. A kind
+    # value shared by several parameters keeps its first row, like the
+    # old scan.
+    my %seen_kind;
+    print
+      "static const unsigned short parameter_kind_index[ICALPARAMETER_KIND_TABLE_SIZE] = {\n";
+    for (my $i = 0 ; $i < scalar(@kind_rows) ; $i++) {
+      next if $seen_kind{$kind_rows[$i]{kind}}++;
+      print "    [" . $kind_rows[$i]{name} . "] = " . ($i + 1) . ",\n";
+    }
+    print "    [ICAL_NO_PARAMETER] = " . (scalar(@kind_rows) + 1) . ",\n";
+    print "};\n\n";
+
     # Create the parameter value map
+    my @enum_rows;
+    my %kind_range;
+
     $out   = "";
     $count = 0;
     foreach $param (sort keys %params) {
@@ -200,6 +230,14 @@ sub insert_code
           my $uce = join("", map {uc(lc($_));} split(/-/, $e));
 
           $count++;
+          # Row 0 of icalparameter_map is the ICAL_ANY_PARAMETER row,
+          # so the row index of this entry is $count.
+          push(@enum_rows,
+            {idx => $count, name => "ICAL_${uc}_${uce}", str => $e});
+          if (!exists($kind_range{$uc})) {
+            $kind_range{$uc} = {start => $count, kind => $params{$param}->{"kindEnum"}};
+          }
+          $kind_range{$uc}{end} = $count + 1;
           $out .= "    {ICAL_${uc}_PARAMETER,ICAL_${uc}_${uce}, \"$e\"},\n";
         }
 
@@ -212,6 +250,54 @@ sub insert_code
     print $out;
     print "    {ICAL_NO_PARAMETER, 0, \"\"}\n};\n\n";
 
+    # Dense enumeration -> icalparameter_map row (0 = no such
+    # enumeration), for O(1) icalparameter_enum_to_string().
+    print "static const unsigned short icalparameter_enum_map_index\n" .
+      "    [ICALPARAMETER_LAST_ENUM - ICALPARAMETER_FIRST_ENUM + 1] = {\n";
+    foreach my $row (@enum_rows) {
+      print "    [" . $row->{name} . " - ICALPARAMETER_FIRST_ENUM] = " . $row->{idx} . ",\n";
+    }
+    print "};\n\n";
+
+    # icalparameter_map rows sorted by their string, for a binary
+    # search in icalparameter_string_to_enum(). A string shared by
+    # several parameters keeps its first row, like the old scan.
+    my %seen_name;
+    my @by_name;
+    foreach my $row (@enum_rows) {
+      next if $seen_name{lc($row->{str})}++;
+      push(@by_name, $row);
+    }
+    @by_name = sort {lc($a->{str}) cmp lc($b->{str})} @by_name;
+
+    print "static const unsigned short icalparameter_enum_name_index[" .
+      scalar(@by_name) . "] = {\n";
+    foreach my $row (@by_name) {
+      print "    " . $row->{idx} . ", /* " . $row->{str} . " */\n";
+    }
+    print "};\n\n";
+
+    # Range of each kind's rows in icalparameter_map (start == 0 means
+    # the kind has no enumerated values), so
+    # icalparameter_new_from_value_string() only scans its own kind.
+    my %seen_range_kind;
+    print
+      "static const unsigned short icalparameter_kind_enum_start[ICALPARAMETER_KIND_TABLE_SIZE] = {\n";
+    foreach my $uc (sort keys %kind_range) {
+      next if $seen_range_kind{$kind_range{$uc}{kind}}++;
+      print "    [ICAL_${uc}_PARAMETER] = " . $kind_range{$uc}{start} . ",\n";
+    }
+    print "};\n\n";
+
+    %seen_range_kind = ();
+    print
+      "static const unsigned short icalparameter_kind_enum_end[ICALPARAMETER_KIND_TABLE_SIZE] = {\n";
+    foreach my $uc (sort keys %kind_range) {
+      next if $seen_range_kind{$kind_range{$uc}{kind}}++;
+      print "    [ICAL_${uc}_PARAMETER] = " . $kind_range{$uc}{end} . ",\n";
+    }
+    print "};\n\n";
+
   }
 
   foreach $param (sort keys %params) {
@@ -236,7 +322,7 @@ sub insert_code
       $charorenum =
         "    icalerror_check_arg_rz((param != 0), \"param\");\n    return param->string;";
 
-      $set_code = "((struct icalparameter_impl *)param)->string = icalmemory_strdup(v);";
+      $set_code = "((struct icalparameter_impl *)param)->string = icalmemory_intern(v);";
 
       $pointer_check   = "    icalerror_check_arg_rz((v != 0), \"v\");";
       $pointer_check_v = "\n    icalerror_check_arg_rv((v != 0), \"v\");";
@@ -301,8 +387,11 @@ void icalparameter_set_${lc}(icalparameter *param, ${type} v)
     icalerror_check_arg_rv((param != 0), "param");
     icalerror_clear_errno();
 
+    icalproperty_cache_invalidate(param->parent);
+    icalparameter_render_cache_invalidate(param);
+
     if (param->string != NULL) {
-        free((void *)param->string);
+        icalmemory_intern_release((char *)param->string);
     }
     $set_code
 }
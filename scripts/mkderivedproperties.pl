@@ -134,6 +134,28 @@ sub insert_code
     print "      { ICAL_NO_VALUE }, 0 }\n}";
     print ";\n\n";
 
+    # Create an index of the property map in name order, so that
+    # icalproperty_string_to_kind() can binary search by name even
+    # though the map itself is ordered by kind
+    my @named;
+    my $row = 0;
+
+    foreach $prop (@props) {
+
+      next if !$prop;
+
+      next if $prop eq 'NO' or $prop eq 'ANY';
+
+      push @named, [$prop, $row];
+      $row++;
+    }
+
+    @named = sort {uc($a->[0]) cmp uc($b->[0])} @named;
+
+    print "static const unsigned short property_map_by_name[" . scalar(@named) . "] = {\n";
+    print "    " . join(",\n    ", map {$_->[1] . " /* " . $_->[0] . " */"} @named);
+    print "\n};\n\n";
+
     $count    = 1;
     $bigcount = 0;
     my %lines;
@@ -274,7 +296,12 @@ $pointer_check
 void icalproperty_set_${lc}(icalproperty *prop, $type v)
 {$set_pointer_check
     icalerror_check_arg_rv((prop != 0), "prop");
-    icalproperty_set_value(prop, icalvalue_new_${lcvalue}(v));
+    if (icalproperty_value_reusable(prop, ICAL_${ucvalue}_VALUE)) {
+        icalvalue_set_${lcvalue}(icalproperty_get_value(prop), v);
+        icalproperty_value_reused(prop);
+    } else {
+        icalproperty_set_value(prop, icalvalue_new_${lcvalue}(v));
+    }
 }
 
 EOM
@@ -187,7 +187,7 @@ sub insert_code
 
     if ($type =~ /char/) {
       $assign =
-"icalmemory_strdup(v);\n\n    if (impl->data.v_string == 0) {\n        errno = ENOMEM;\n    }\n";
+"icalvalue_strdup_value_string(impl, v);\n\n    if (impl->data.v_string == 0) {\n        errno = ENOMEM;\n    }\n";
     } else {
       $assign = "v;";
     }
@@ -225,8 +225,7 @@ $pointer_check_rv\
 
       if ($union_data eq 'string') {
 
-        print
-"    if (impl->data.v_${union_data} != 0) {\n        free((void *)impl->data.v_${union_data});\n    }\n";
+        print "    icalvalue_free_value_string(impl);\n";
       }
 
       print "\
@@ -47,8 +47,7 @@ if ($opt_i) {
 
 sub insert_code
 {
-  # First build the property restriction table
-  print "static const icalrestriction_property_record icalrestriction_property_records[] = {\n";
+  my @records;
 
   while (<F>) {
 
@@ -68,17 +67,70 @@ sub insert_code
     $restr =~ s/\s+$//;
 
     if ($prop ne "NONE") {
-      print(
-"    \{ICAL_METHOD_${method}, ICAL_${targetcomp}_COMPONENT, ICAL_${prop}_PROPERTY, ICAL_RESTRICTION_${restr}, $sub},\n"
-      );
+      push(@records, [$method, $targetcomp, $prop, $restr, $sub]);
     }
 
   }
 
+  # First build the property restriction table
+  print "static const icalrestriction_property_record icalrestriction_property_records[] = {\n";
+
+  foreach my $rec (@records) {
+    my ($method, $targetcomp, $prop, $restr, $sub) = @$rec;
+    print(
+"    \{ICAL_METHOD_${method}, ICAL_${targetcomp}_COMPONENT, ICAL_${prop}_PROPERTY, ICAL_RESTRICTION_${restr}, $sub},\n"
+    );
+  }
+
   # Print the terminating line
   print
     "    {ICAL_METHOD_NONE, ICAL_NO_COMPONENT, ICAL_NO_PROPERTY, ICAL_RESTRICTION_NONE, NULL}\n";
 
+  print "};\n\n";
+
+  # Then build one property-kind-indexed row per (method, component)
+  # pair, holding 1-based indexes into the records array (0 = no
+  # record), and a dense [method][component] table of the rows, so
+  # lookup is direct array indexing instead of a scan of the records.
+
+  my %rows;
+  my @row_order;
+
+  for my $i (0 .. $#records) {
+    my ($method, $targetcomp, $prop) = @{$records[$i]};
+    my $key = "${method}_${targetcomp}";
+
+    if (!exists($rows{$key})) {
+      push(@row_order, $key);
+      $rows{$key} = {};
+    }
+
+    # A duplicated (method, component, property) line keeps its first
+    # record, matching the old first-match scan.
+    if (!exists($rows{$key}{$prop})) {
+      $rows{$key}{$prop} = $i + 1;
+    }
+  }
+
+  foreach my $key (@row_order) {
+    print
+      "static const unsigned short icalrestriction_row_${key}[ICALRESTRICTION_PROPERTY_TABLE_SIZE] = {\n";
+    foreach my $prop (sort(keys(%{$rows{$key}}))) {
+      print "    [ICAL_${prop}_PROPERTY] = $rows{$key}{$prop},\n";
+    }
+    print "};\n\n";
+  }
+
+  print "static const unsigned short *const icalrestriction_property_rows\n" .
+    "    [ICALRESTRICTION_METHOD_COUNT][ICALRESTRICTION_COMPONENT_MAX + 1] = {\n";
+
+  foreach my $key (@row_order) {
+    my ($method, $targetcomp) = split(/_/, $key, 2);
+    print
+"    [ICALRESTRICTION_METHOD_INDEX(ICAL_METHOD_${method})][ICAL_${targetcomp}_COMPONENT] =\n" .
+      "        icalrestriction_row_${key},\n";
+  }
+
   print "};\n";
 
 }
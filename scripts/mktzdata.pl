@@ -0,0 +1,129 @@
+#!/usr/bin/env perl
+################################################################################
+# This library is free software; you can redistribute it and/or modify
+# it under the terms of either:
+#
+#   The LGPL as published by the Free Software Foundation, version
+#   2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.txt
+#
+# Or:
+#
+#   The Mozilla Public License Version 2.0. You may obtain a copy of
+#   the License at https://www.mozilla.org/MPL/
+################################################################################
+
+# Generates a C table embedding zones.tab and the VTIMEZONE data from the
+# given zoneinfo directory, for builds with ICAL_EMBED_TZDATA. The entries
+# are sorted by location so icaltimezone.c can bsearch() them.
+#
+# Usage: mktzdata.pl path/to/zoneinfo > icaltzdata.c
+
+use strict;
+use warnings;
+
+my $zonedir = shift @ARGV
+    or die "usage: mktzdata.pl path/to/zoneinfo > icaltzdata.c\n";
+
+# Mirrors parse_coord() in icaltimezone.c, including its handling of the
+# sign, so the embedded coordinates match the file-parsed ones exactly.
+sub parse_coord {
+    my ($coord) = @_;
+    my ($degrees, $minutes, $seconds) = (0, 0, 0);
+    my $len = length($coord);
+
+    if ($len == 5) {
+        ($degrees, $minutes) = (substr($coord, 1, 2), substr($coord, 3, 2));
+    } elsif ($len == 6) {
+        ($degrees, $minutes) = (substr($coord, 1, 3), substr($coord, 4, 2));
+    } elsif ($len == 7) {
+        ($degrees, $minutes, $seconds) =
+            (substr($coord, 1, 2), substr($coord, 3, 2), substr($coord, 5, 2));
+    } elsif ($len == 8) {
+        ($degrees, $minutes, $seconds) =
+            (substr($coord, 1, 3), substr($coord, 4, 2), substr($coord, 6, 2));
+    } else {
+        die "Invalid coordinate: $coord\n";
+    }
+
+    $degrees = -$degrees if substr($coord, 0, 1) eq '-';
+
+    if ($degrees >= 0) {
+        return $degrees + $minutes / 60 + $seconds / 3600;
+    }
+    return $degrees - $minutes / 60 - $seconds / 3600;
+}
+
+sub c_string_lines {
+    my ($text) = @_;
+    my @out;
+
+    foreach my $line (split(/(?<=\n)/, $text)) {
+        $line =~ s/\\/\\\\/g;
+        $line =~ s/"/\\"/g;
+        $line =~ s/\r/\\r/g;
+        $line =~ s/\n/\\n/g;
+        push @out, "      \"$line\"";
+    }
+
+    return join("\n", @out);
+}
+
+open(my $tab, '<', "$zonedir/zones.tab")
+    or die "Cannot open $zonedir/zones.tab: $!\n";
+
+my @zones;
+while (my $line = <$tab>) {
+    chomp $line;
+    next if $line =~ /^#/ or $line =~ /^\s*$/;
+
+    my ($latitude, $longitude, $location);
+    if ($line =~ /^[+-]/) {
+        my ($lat, $lon, $loc) = split(' ', $line);
+        ($latitude, $longitude, $location) =
+            (parse_coord($lat), parse_coord($lon), $loc);
+    } else {
+        # No coordinates; icaltimezone.c uses 360 degrees as "unknown"
+        ($latitude, $longitude, $location) = (360, 360, (split(' ', $line))[0]);
+    }
+
+    open(my $ics, '<', "$zonedir/$location.ics")
+        or die "Cannot open $zonedir/$location.ics: $!\n";
+    my $vtimezone = do { local $/; <$ics> };
+    close($ics);
+
+    push @zones, {
+        location  => $location,
+        latitude  => $latitude,
+        longitude => $longitude,
+        vtimezone => $vtimezone,
+    };
+}
+close($tab);
+
+@zones = sort { $a->{location} cmp $b->{location} } @zones;
+
+print <<'EOF';
+/*
+ * Embedded builtin timezone data, generated by scripts/mktzdata.pl
+ * from zones.tab and the zoneinfo VTIMEZONE files.
+ *
+ * Do not edit.
+ */
+
+#include "icaltzdata.h"
+
+const struct ical_embedded_zone ical_embedded_zones[] = {
+EOF
+
+foreach my $zone (@zones) {
+    printf("    { \"%s\", %.10g, %.10g,\n%s },\n",
+           $zone->{location}, $zone->{latitude}, $zone->{longitude},
+           c_string_lines($zone->{vtimezone}));
+}
+
+print <<'EOF';
+};
+
+const size_t ical_embedded_zones_count =
+    sizeof(ical_embedded_zones) / sizeof(ical_embedded_zones[0]);
+EOF
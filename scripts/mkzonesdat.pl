@@ -0,0 +1,113 @@
+#!/usr/bin/env perl
+################################################################################
+# This library is free software; you can redistribute it and/or modify
+# it under the terms of either:
+#
+#   The LGPL as published by the Free Software Foundation, version
+#   2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.txt
+#
+# Or:
+#
+#   The Mozilla Public License Version 2.0. You may obtain a copy of
+#   the License at https://www.mozilla.org/MPL/
+################################################################################
+
+# Generates the binary zones.dat sidecar from zones.tab, so that
+# icaltimezone_parse_zone_tab() can mmap the zone table instead of
+# parsing text line by line at process start. The layout must match
+# the icalzonedat_* structs in icaltimezone.c:
+#
+#   header   char magic[4] = "ICZT", uint32 version = 1,
+#            uint32 count, uint32 string pool size
+#   entries  count x { double latitude, double longitude,
+#                      uint32 location offset, uint32 reserved }
+#   pool     NUL-terminated location strings
+#
+# All integers and doubles are in the byte order of the build host; the
+# loader rejects a table whose version field does not read back as 1,
+# so a sidecar from a foreign-endian host falls back to zones.tab.
+#
+# Usage: mkzonesdat.pl path/to/zones.tab path/to/zones.dat
+
+use strict;
+use warnings;
+
+my ($tabfile, $datfile) = @ARGV;
+die "usage: mkzonesdat.pl path/to/zones.tab path/to/zones.dat\n"
+    unless defined $tabfile and defined $datfile;
+
+# Mirrors parse_coord() in icaltimezone.c, including its handling of the
+# sign, so the sidecar coordinates match the file-parsed ones exactly.
+sub parse_coord {
+    my ($coord) = @_;
+    my ($degrees, $minutes, $seconds) = (0, 0, 0);
+    my $len = length($coord);
+
+    if ($len == 5) {
+        ($degrees, $minutes) = (substr($coord, 1, 2), substr($coord, 3, 2));
+    } elsif ($len == 6) {
+        ($degrees, $minutes) = (substr($coord, 1, 3), substr($coord, 4, 2));
+    } elsif ($len == 7) {
+        ($degrees, $minutes, $seconds) =
+            (substr($coord, 1, 2), substr($coord, 3, 2), substr($coord, 5, 2));
+    } elsif ($len == 8) {
+        ($degrees, $minutes, $seconds) =
+            (substr($coord, 1, 3), substr($coord, 4, 2), substr($coord, 6, 2));
+    } else {
+        die "Invalid coordinate: $coord\n";
+    }
+
+    $degrees = -$degrees if substr($coord, 0, 1) eq '-';
+
+    if ($degrees >= 0) {
+        return $degrees + $minutes / 60 + $seconds / 3600;
+    }
+    return $degrees - $minutes / 60 - $seconds / 3600;
+}
+
+open(my $tab, '<', $tabfile)
+    or die "Cannot open $tabfile: $!\n";
+
+my @zones;
+while (my $line = <$tab>) {
+    chomp $line;
+    next if $line =~ /^#/ or $line =~ /^\s*$/;
+
+    my ($latitude, $longitude, $location);
+    if ($line =~ /^[+-]/) {
+        my ($lat, $lon, $loc) = split(' ', $line);
+        ($latitude, $longitude, $location) =
+            (parse_coord($lat), parse_coord($lon), $loc);
+    } else {
+        # No coordinates; icaltimezone.c uses 360 degrees as "unknown"
+        ($latitude, $longitude, $location) = (360, 360, (split(' ', $line))[0]);
+    }
+
+    push @zones, {
+        location  => $location,
+        latitude  => $latitude,
+        longitude => $longitude,
+    };
+}
+close($tab);
+
+# zones.tab is sorted by location already, but the lookup index relies
+# on the order, so do not depend on the input
+@zones = sort { $a->{location} cmp $b->{location} } @zones;
+
+my $pool    = '';
+my $entries = '';
+foreach my $zone (@zones) {
+    $entries .= pack('ddLL',
+                     $zone->{latitude}, $zone->{longitude},
+                     length($pool), 0);
+    $pool .= $zone->{location} . "\0";
+}
+
+open(my $dat, '>', $datfile)
+    or die "Cannot open $datfile: $!\n";
+binmode($dat);
+print $dat pack('a4LLL', 'ICZT', 1, scalar(@zones), length($pool));
+print $dat $entries;
+print $dat $pool;
+close($dat) or die "Cannot write $datfile: $!\n";
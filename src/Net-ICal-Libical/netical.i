@@ -167,6 +167,12 @@ icalcomponent* icallangbind_get_next_component(icalcomponent *c,
    ":" for python */
 const char* icallangbind_property_eval_string(icalproperty* prop, const char* sep);
 
+/* Batch form: every property of the component in one crossing. The
+   hand-written XS companions in netical_wrap.c
+   (icalcomponent_dump_properties and this) must be kept if this file
+   is ever re-run through SWIG. */
+const char* icallangbind_component_eval_string(icalcomponent* c, const char* sep);
+
 /***********************************************************************
  Time routines
 ***********************************************************************/
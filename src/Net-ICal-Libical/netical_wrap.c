@@ -2891,6 +2891,87 @@ XS(_wrap_perl5_Net__ICal__Libical_var_init) {
     swig_setpv("icaltimetype_zone", "icaltimetype::zone");
     XSRETURN(1);
 }
+/* Hand-written batch entry point (not SWIG generated): dumps every
+   property of a component in one XS crossing instead of one call per
+   accessor. Returns a flat list of triplets per property — the kind
+   name, the value as a string, and the property's parameters rendered
+   as "NAME=value" joined with ";" (empty string when there are none).
+   Perl-side code unpacks it three elements at a time. */
+XS(_wrap_icalcomponent_dump_properties) {
+
+    icalcomponent * _arg0;
+    icalproperty *p;
+    int argvi = 0;
+    dXSARGS ;
+
+    cv = cv;
+    if ((items < 1) || (items > 1))
+        croak("Usage: icalcomponent_dump_properties(component);");
+    if (SWIG_GetPtr(ST(0),(void **) &_arg0,"icalcomponentPtr")) {
+        croak("Type error in argument 1 of icalcomponent_dump_properties. Expected icalcomponentPtr.");
+        XSRETURN(1);
+    }
+
+    for (p = icalcomponent_get_first_property(_arg0,ICAL_ANY_PROPERTY);
+         p != 0;
+         p = icalcomponent_get_next_property(_arg0,ICAL_ANY_PROPERTY)) {
+
+        const char *kind_string = icalproperty_kind_to_string(icalproperty_isa(p));
+        const char *value_string = icalproperty_get_value_as_string(p);
+        icalparameter *param;
+        SV *params;
+
+        EXTEND(sp, 3);
+
+        ST(argvi) = sv_newmortal();
+        sv_setpv(ST(argvi++), (char *)(kind_string != 0 ? kind_string : ""));
+
+        ST(argvi) = sv_newmortal();
+        sv_setpv(ST(argvi++), (char *)(value_string != 0 ? value_string : ""));
+
+        params = sv_newmortal();
+        sv_setpv(params, "");
+        for (param = icalproperty_get_first_parameter(p,ICAL_ANY_PARAMETER);
+             param != 0;
+             param = icalproperty_get_next_parameter(p,ICAL_ANY_PARAMETER)) {
+            const char *pstr = icalparameter_as_ical_string(param);
+
+            if (pstr != 0) {
+                if (SvCUR(params) > 0)
+                    sv_catpv(params, ";");
+                sv_catpv(params, (char *)pstr);
+            }
+        }
+        ST(argvi++) = params;
+    }
+
+    XSRETURN(argvi);
+}
+
+/* Hand-written batch entry point: the whole component's properties as
+   one evaluatable string, via the shared icallangbind helper. */
+XS(_wrap_icallangbind_component_eval_string) {
+
+    const char * _result;
+    icalcomponent * _arg0;
+    char * _arg1;
+    int argvi = 0;
+    dXSARGS ;
+
+    cv = cv;
+    if ((items < 2) || (items > 2))
+        croak("Usage: icallangbind_component_eval_string(c,sep);");
+    if (SWIG_GetPtr(ST(0),(void **) &_arg0,"icalcomponentPtr")) {
+        croak("Type error in argument 1 of icallangbind_component_eval_string. Expected icalcomponentPtr.");
+        XSRETURN(1);
+    }
+    _arg1 = (char *) SvPV(ST(1),na);
+    _result = (const char *)icallangbind_component_eval_string(_arg0,_arg1);
+    ST(argvi) = sv_newmortal();
+    sv_setpv((SV*)ST(argvi++),(char *) _result);
+    XSRETURN(argvi);
+}
+
 #ifdef __cplusplus
 extern "C"
 #endif
@@ -2909,6 +2990,8 @@ XS(boot_Net__ICal__Libical) {
 	 newXS("Net::ICal::Libical::icalcomponent_count_errors", _wrap_icalcomponent_count_errors, file);
 	 newXS("Net::ICal::Libical::icalcomponent_strip_errors", _wrap_icalcomponent_strip_errors, file);
 	 newXS("Net::ICal::Libical::icalcomponent_convert_errors", _wrap_icalcomponent_convert_errors, file);
+	 newXS("Net::ICal::Libical::icalcomponent_dump_properties", _wrap_icalcomponent_dump_properties, file);
+	 newXS("Net::ICal::Libical::icallangbind_component_eval_string", _wrap_icallangbind_component_eval_string, file);
 	 newXS("Net::ICal::Libical::icalcomponent_get_current_property", _wrap_icalcomponent_get_current_property, file);
 	 newXS("Net::ICal::Libical::icalcomponent_get_first_property", _wrap_icalcomponent_get_first_property, file);
 	 newXS("Net::ICal::Libical::icalcomponent_get_next_property", _wrap_icalcomponent_get_next_property, file);
@@ -166,6 +166,48 @@ public class VComponent
 	/* For VCOMPONENT: Return a reference to the first VEVENT, VTODO, or VJOURNAL */
 	public native VComponent get_first_real_component();
 
+	/**
+	 * Marshal every property of this component into the given direct
+	 * ByteBuffer in a single JNI crossing. The buffer must use
+	 * ByteOrder.nativeOrder(). One record is appended per property:
+	 *
+	 *     int32  property kind
+	 *     int32  value length, followed by that many value bytes
+	 *     int32  parameter count, then per parameter:
+	 *            int32  parameter kind
+	 *            int32  text length, followed by the rendered
+	 *                   "NAME=value" bytes
+	 *
+	 * Returns the number of bytes written, or -1 if the buffer was too
+	 * small (retry with a larger one) or was not a direct buffer.
+	 */
+	public native long marshal_properties(java.nio.ByteBuffer buf);
+
+	/**
+	 * Convenience wrapper around marshal_properties(): allocates a
+	 * direct buffer, grows it until the component fits, and returns it
+	 * flipped and ready to read.
+	 */
+	public java.nio.ByteBuffer marshal_properties()
+	{
+		for (int capacity = 4096; capacity <= (1 << 26); capacity *= 2)
+		{
+			java.nio.ByteBuffer buf =
+				java.nio.ByteBuffer.allocateDirect(capacity);
+			buf.order(java.nio.ByteOrder.nativeOrder());
+
+			long written = marshal_properties(buf);
+
+			if (written >= 0)
+			{
+				buf.limit((int)written);
+				return buf;
+			}
+		}
+
+		return null;
+	}
+
 	/* For VEVENT, VTODO, VJOURNAL and VTIMEZONE: report the start and end
 	   times of an event in UTC */
 	//public native virtual struct icaltime_span get_span();
@@ -35,6 +35,8 @@
 #include "icalproperty_cxx.h"
 #endif
 
+#include <string.h>
+
 /*
  * Class:     net_cp_jlibical_VComponent
  * Method:    as_ical_string
@@ -964,3 +966,122 @@ JNIEXPORT void JNICALL Java_net_cp_jlibical_VComponent_set_1recurrenceid
                 }
         }
 }
+
+/*
+ * Bulk marshaling support. One record per property is appended to the
+ * caller's direct ByteBuffer, all integers in native byte order:
+ *
+ *      int32   property kind
+ *      int32   value length, followed by that many value bytes
+ *      int32   parameter count, then per parameter:
+ *              int32   parameter kind
+ *              int32   text length, followed by the rendered
+ *                      "NAME=value" bytes
+ *
+ * The whole component is walked in one JNI crossing instead of one
+ * crossing (and handle re-validation) per accessor.
+ */
+
+static bool marshal_put_int(char* base, jlong cap, jlong* pos, jint value)
+{
+        if (*pos + (jlong)sizeof(jint) > cap)
+        {
+                return false;
+        }
+
+        memcpy(base + *pos, &value, sizeof(jint));
+        *pos += (jlong)sizeof(jint);
+        return true;
+}
+
+static bool marshal_put_string(char* base, jlong cap, jlong* pos, const char* str)
+{
+        size_t len = (str != NULL) ? strlen(str) : 0;
+
+        if (!marshal_put_int(base,cap,pos,(jint)len))
+        {
+                return false;
+        }
+
+        if (*pos + (jlong)len > cap)
+        {
+                return false;
+        }
+
+        if (len > 0)
+        {
+                memcpy(base + *pos, str, len);
+                *pos += (jlong)len;
+        }
+
+        return true;
+}
+
+/*
+ * Class:     net_cp_jlibical_VComponent
+ * Method:    marshal_properties
+ * Signature: (Ljava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_net_cp_jlibical_VComponent_marshal_1properties
+  (JNIEnv *env, jobject jobj, jobject buffer)
+{
+        jlong pos = 0;
+
+        // get the VComponent c++ object from jobj
+        VComponent* cObj = getSubjectAsVComponent(env,jobj,JLIBICAL_ERR_CLIENT_INTERNAL);
+
+        if (cObj == NULL)
+        {
+                return(-1);
+        }
+
+        char* base = (char*)env->GetDirectBufferAddress(buffer);
+        jlong cap = env->GetDirectBufferCapacity(buffer);
+
+        if (base == NULL || cap < 0)
+        {
+                // not a direct buffer
+                throwException(env, JLIBICAL_ERR_ILLEGAL_ARGUMENT);
+                return(-1);
+        }
+
+        icalcomponent* comp = (icalcomponent*)*cObj;
+
+        for (icalproperty* prop = icalcomponent_get_first_property(comp,ICAL_ANY_PROPERTY);
+             prop != NULL;
+             prop = icalcomponent_get_next_property(comp,ICAL_ANY_PROPERTY))
+        {
+                if (!marshal_put_int(base,cap,&pos,(jint)icalproperty_isa(prop)))
+                {
+                        return(-1);
+                }
+
+                if (!marshal_put_string(base,cap,&pos,icalproperty_get_value_as_string(prop)))
+                {
+                        return(-1);
+                }
+
+                if (!marshal_put_int(base,cap,&pos,
+                                     (jint)icalproperty_count_parameters(prop)))
+                {
+                        return(-1);
+                }
+
+                for (icalparameter* param = icalproperty_get_first_parameter(prop,ICAL_ANY_PARAMETER);
+                     param != NULL;
+                     param = icalproperty_get_next_parameter(prop,ICAL_ANY_PARAMETER))
+                {
+                        if (!marshal_put_int(base,cap,&pos,(jint)icalparameter_isa(param)))
+                        {
+                                return(-1);
+                        }
+
+                        if (!marshal_put_string(base,cap,&pos,icalparameter_as_ical_string(param)))
+                        {
+                                return(-1);
+                        }
+                }
+        }
+
+        return(pos);
+}
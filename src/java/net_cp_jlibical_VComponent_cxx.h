@@ -362,6 +362,14 @@ JNIEXPORT jobject JNICALL Java_net_cp_jlibical_VComponent_get_1recurrenceid
 JNIEXPORT void JNICALL Java_net_cp_jlibical_VComponent_set_1recurrenceid
   (JNIEnv *, jobject, jobject);
 
+/*
+ * Class:     net_cp_jlibical_VComponent
+ * Method:    marshal_properties
+ * Signature: (Ljava/nio/ByteBuffer;)J
+ */
+JNIEXPORT jlong JNICALL Java_net_cp_jlibical_VComponent_marshal_1properties
+  (JNIEnv *, jobject, jobject);
+
 #ifdef __cplusplus
 }
 #endif
@@ -10,19 +10,21 @@ set(COMBINEDHEADERSICAL
   ${TOPS}/src/libical/icalarray.h
   ${TOPS}/src/libical/icalrecur.h
   ${TOPS}/src/libical/icalattach.h
+  ${TOPS}/src/libical/icalerror.h
   ${TOPB}/src/libical/icalderivedvalue.h
   ${TOPB}/src/libical/icalderivedparameter.h
   ${TOPS}/src/libical/icalvalue.h
   ${TOPS}/src/libical/icalparameter.h
   ${TOPB}/src/libical/icalderivedproperty.h
-  ${TOPS}/src/libical/icalproperty.h
   ${TOPS}/src/libical/pvl.h
+  ${TOPS}/src/libical/icalproperty.h
   ${TOPS}/src/libical/icalcomponent.h
   ${TOPS}/src/libical/icaltimezone.h
   ${TOPS}/src/libical/icaltz-util.h
-  ${TOPS}/src/libical/icalparser.h
   ${TOPS}/src/libical/icalmemory.h
-  ${TOPS}/src/libical/icalerror.h
+  ${TOPS}/src/libical/icalthreadpool.h
+  ${TOPS}/src/libical/icaltrace.h
+  ${TOPS}/src/libical/icalparser.h
   ${TOPS}/src/libical/icalrestriction.h
   ${TOPS}/src/libical/sspm.h
   ${TOPS}/src/libical/icalmime.h
@@ -44,10 +44,21 @@ icalarray *icalarray_new(size_t element_size, size_t increment_size)
     array->num_elements = 0;
     array->space_allocated = 0;
     array->chunks = NULL;
+    array->is_contiguous = 0;
 
     return array;
 }
 
+icalarray *icalarray_new_contiguous(size_t element_size, size_t increment_size)
+{
+    icalarray *array = icalarray_new(element_size, increment_size);
+
+    if (array) {
+        array->is_contiguous = 1;
+    }
+    return array;
+}
+
 static void *icalarray_alloc_chunk(icalarray *array)
 {
     void *chunk = malloc(array->element_size * array->increment_size);
@@ -60,9 +71,30 @@ static void *icalarray_alloc_chunk(icalarray *array)
 
 icalarray *icalarray_copy(icalarray *originalarray)
 {
-    icalarray *array = icalarray_new(originalarray->element_size, originalarray->increment_size);
-    size_t chunks = originalarray->space_allocated / originalarray->increment_size;
-    size_t chunk;
+    icalarray *array;
+    size_t chunks, chunk;
+
+    if (originalarray->is_contiguous) {
+        array = icalarray_new_contiguous(originalarray->element_size,
+                                         originalarray->increment_size);
+        if (!array) {
+            return NULL;
+        }
+
+        if (originalarray->num_elements) {
+            icalarray_reserve(array, originalarray->num_elements);
+            if (array->space_allocated >= originalarray->num_elements) {
+                memcpy(array->chunks[0], originalarray->chunks[0],
+                       originalarray->num_elements * array->element_size);
+                array->num_elements = originalarray->num_elements;
+            }
+        }
+
+        return array;
+    }
+
+    array = icalarray_new(originalarray->element_size, originalarray->increment_size);
+    chunks = originalarray->space_allocated / originalarray->increment_size;
 
     if (!array) {
         return NULL;
@@ -91,7 +123,8 @@ icalarray *icalarray_copy(icalarray *originalarray)
 void icalarray_free(icalarray *array)
 {
     if (array->chunks) {
-        size_t chunks = array->space_allocated / array->increment_size;
+        size_t chunks =
+            array->is_contiguous ? 1 : array->space_allocated / array->increment_size;
         size_t chunk;
 
         for (chunk = 0; chunk < chunks; chunk++) {
@@ -117,14 +150,39 @@ void icalarray_append(icalarray *array, const void *element)
 
 void *icalarray_element_at(icalarray *array, size_t position)
 {
-    size_t chunk = position / array->increment_size;
-    size_t offset = position % array->increment_size;
+    size_t chunk, offset;
+
+    if (array->is_contiguous) {
+        return (char *)(array->chunks[0]) + (position * array->element_size);
+    }
+
+    chunk = position / array->increment_size;
+    offset = position % array->increment_size;
 
     return (char *)(array->chunks[chunk]) + (offset * array->element_size);
 }
 
+void icalarray_reserve(icalarray *array, size_t capacity)
+{
+    if (capacity > array->space_allocated) {
+        icalarray_expand(array, capacity - array->space_allocated);
+    }
+}
+
 void icalarray_remove_element_at(icalarray *array, size_t position)
 {
+    if (array->is_contiguous) {
+        if (position < array->num_elements - 1) {
+            char *base = (char *)array->chunks[0];
+
+            memmove(base + position * array->element_size,
+                    base + (position + 1) * array->element_size,
+                    (array->num_elements - 1 - position) * array->element_size);
+        }
+        array->num_elements--;
+        return;
+    }
+
     while (position < array->num_elements - 1) {
         memmove(icalarray_element_at(array, position),
                 icalarray_element_at(array, position + 1), array->element_size);
@@ -165,16 +223,57 @@ void icalarray_sort(icalarray *array, int (*compare) (const void *, const void *
         return;
     }
 
+    if (array->is_contiguous) {
+        /* The elements form one plain C array, so the libc qsort() can be
+           used directly instead of the indirect swap/compare machinery. */
+        qsort(array->chunks[0], array->num_elements, array->element_size, compare);
+        return;
+    }
+
     qsort_gen(&sort_context, array->num_elements, icalarray_fcompare, icalarray_fswap);
 }
 
 static void icalarray_expand(icalarray *array, size_t space_needed)
 {
-    size_t num_chunks = array->space_allocated / array->increment_size;
+    size_t num_chunks;
     size_t num_new_chunks;
     size_t c;
     void **new_chunks;
 
+    if (array->is_contiguous) {
+        /* Grow geometrically so that N appends cost O(N) copies overall. */
+        size_t new_space = array->space_allocated + space_needed;
+        void *new_data;
+
+        if (new_space < array->space_allocated * 2) {
+            new_space = array->space_allocated * 2;
+        }
+        if (new_space < array->increment_size) {
+            new_space = array->increment_size;
+        }
+
+        if (!array->chunks) {
+            array->chunks = malloc(sizeof(void *));
+            if (!array->chunks) {
+                icalerror_set_errno(ICAL_ALLOCATION_ERROR);
+                return;
+            }
+            array->chunks[0] = NULL;
+        }
+
+        new_data = realloc(array->chunks[0], new_space * array->element_size);
+        if (!new_data) {
+            icalerror_set_errno(ICAL_ALLOCATION_ERROR);
+            return;
+        }
+
+        array->chunks[0] = new_data;
+        array->space_allocated = new_space;
+        return;
+    }
+
+    num_chunks = array->space_allocated / array->increment_size;
+
     num_new_chunks = (space_needed + array->increment_size - 1) / array->increment_size;
     if (!num_new_chunks) {
         num_new_chunks = 1;
@@ -27,6 +27,8 @@
 
 #include "libical_ical_export.h"
 
+#include <stddef.h>
+
 /**
  * @typedef icalarray
  * @brief A struct representing an icalarray object
@@ -39,6 +41,7 @@ struct _icalarray
     size_t num_elements;
     size_t space_allocated;
     void **chunks;
+    int is_contiguous;
 };
 
 /**
@@ -80,6 +83,56 @@ struct _icalarray
  */
 LIBICAL_ICAL_EXPORT icalarray *icalarray_new(size_t element_size, size_t increment_size);
 
+/**
+ * @brief Creates a new ::icalarray object that stores its elements in one
+ * contiguous block of memory.
+ * @param element_size The size of the elements to be held by the array
+ * @param increment_size The initial capacity (in elements) allocated on first use
+ * @return The new ::icalarray object
+ * @sa icalarray_new(), icalarray_reserve()
+ * @since 3.1.0
+ *
+ * Unlike icalarray_new(), which allocates fixed-size chunks and therefore
+ * keeps element addresses stable across appends, a contiguous array grows
+ * geometrically with `realloc()`, so all elements occupy a single block of
+ * memory. icalarray_element_at() reduces to one multiply and add, and the
+ * elements can be traversed, searched and copied with plain pointer
+ * arithmetic or `memcpy()`.
+ *
+ * Do not retain pointers into a contiguous array across a call to
+ * icalarray_append() or icalarray_reserve(); the block may move.
+ *
+ * @par Error handling
+ * As for icalarray_new(): returns `NULL` and sets ::icalerrno to
+ * ::ICAL_NEWFAILED_ERROR on allocation failure.
+ *
+ * @par Ownership
+ * The returned ::icalarray object is owned by the caller and must be
+ * released with icalarray_free().
+ */
+LIBICAL_ICAL_EXPORT icalarray *icalarray_new_contiguous(size_t element_size,
+                                                        size_t increment_size);
+
+/**
+ * @brief Ensures the array has space allocated for at least @a capacity elements.
+ * @param array The array to reserve space in
+ * @param capacity The minimum number of elements the array should be able to
+ * hold without further allocation
+ * @since 3.1.0
+ *
+ * Pre-allocating space avoids repeated expansion when the final number of
+ * elements is known (or can be estimated) up front. For contiguous arrays a
+ * single `realloc()` is performed; for chunked arrays the chunk table is
+ * grown once. If @a capacity is not larger than the currently allocated
+ * space, nothing happens. The number of stored elements is unchanged.
+ *
+ * @par Error handling
+ * If @a array is `NULL`, using this function results in undefined behaviour.
+ * On allocation failure ::icalerrno is set to ::ICAL_ALLOCATION_ERROR and
+ * the array is left as it was.
+ */
+LIBICAL_ICAL_EXPORT void icalarray_reserve(icalarray *array, size_t capacity);
+
 /**
  * @brief Copies an existing ::icalarray and its elements, creating a new one.
  * @param array The array to copy
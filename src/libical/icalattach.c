@@ -22,9 +22,35 @@
 
 #include "icalattachimpl.h"
 #include "icalerror.h"
+#include "icalmemory.h"
 
 #include <errno.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+/* The refcount is adjusted with atomic read-modify-write operations
+   where the compiler provides them, so one attachment can be shared
+   across threads without external locking. The decrement uses
+   acquire-release ordering so that whichever thread drops the last
+   reference sees every other thread's prior use before freeing. */
+#if defined(__GNUC__) || defined(__clang__)
+#define icalattach_refcount_inc(attach) \
+    ((void)__atomic_add_fetch(&(attach)->refcount, 1, __ATOMIC_RELAXED))
+#define icalattach_refcount_dec(attach) \
+    __atomic_sub_fetch(&(attach)->refcount, 1, __ATOMIC_ACQ_REL)
+#define icalattach_refcount_load(attach) \
+    __atomic_load_n(&(attach)->refcount, __ATOMIC_RELAXED)
+#else
+#define icalattach_refcount_inc(attach) ((void)(++(attach)->refcount))
+#define icalattach_refcount_dec(attach) (--(attach)->refcount)
+#define icalattach_refcount_load(attach) ((attach)->refcount)
+#endif
 
 icalattach *icalattach_new_from_url(const char *url)
 {
@@ -46,6 +72,7 @@ icalattach *icalattach_new_from_url(const char *url)
 
     attach->refcount = 1;
     attach->is_url = 1;
+    attach->is_file = 0;
     attach->u.url.url = url_copy;
 
     return attach;
@@ -81,6 +108,7 @@ icalattach *icalattach_new_from_data(const char *data, icalattach_free_fn_t free
 
     attach->refcount = 1;
     attach->is_url = 0;
+    attach->is_file = 0;
     attach->u.data.data = (char *) data;
     attach->u.data.free_fn = free_fn;
     attach->u.data.free_fn_data = free_fn_data;
@@ -91,23 +119,25 @@ icalattach *icalattach_new_from_data(const char *data, icalattach_free_fn_t free
 void icalattach_ref(icalattach *attach)
 {
     icalerror_check_arg_rv((attach != NULL), "attach");
-    icalerror_check_arg_rv((attach->refcount > 0), "attach->refcount > 0");
+    icalerror_check_arg_rv((icalattach_refcount_load(attach) > 0), "attach->refcount > 0");
 
-    attach->refcount++;
+    icalattach_refcount_inc(attach);
 }
 
 void icalattach_unref(icalattach *attach)
 {
     icalerror_check_arg_rv((attach != NULL), "attach");
-    icalerror_check_arg_rv((attach->refcount > 0), "attach->refcount > 0");
+    icalerror_check_arg_rv((icalattach_refcount_load(attach) > 0), "attach->refcount > 0");
 
-    attach->refcount--;
-
-    if (attach->refcount != 0)
+    if (icalattach_refcount_dec(attach) != 0)
         return;
 
     if (attach->is_url) {
         free(attach->u.url.url);
+    } else if (attach->is_file) {
+        if (attach->u.file.owns_file)
+            (void)remove(attach->u.file.path);
+        free(attach->u.file.path);
     } else if (attach->u.data.free_fn) {
         (* attach->u.data.free_fn) (attach->u.data.data, attach->u.data.free_fn_data);
     }
@@ -134,6 +164,176 @@ unsigned char *icalattach_get_data(icalattach *attach)
 {
     icalerror_check_arg_rz((attach != NULL), "attach");
     icalerror_check_arg_rz((!attach->is_url), "!attach->is_url");
+    icalerror_check_arg_rz((!attach->is_file), "!attach->is_file");
 
     return (unsigned char *)attach->u.data.data;
 }
+
+/* File-backed attachments. The encoded content stays on disk until the
+   value is serialized, so a large ATTACH does not have to live in the
+   component tree. */
+
+static size_t attach_spill_threshold = 0;
+
+void icalattach_set_spill_threshold(size_t bytes)
+{
+    attach_spill_threshold = bytes;
+}
+
+size_t icalattach_get_spill_threshold(void)
+{
+    return attach_spill_threshold;
+}
+
+static icalattach *icalattach_new_from_file_internal(char *path, int owns_file)
+{
+    icalattach *attach;
+
+    if ((attach = malloc(sizeof(icalattach))) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    attach->refcount = 1;
+    attach->is_url = 0;
+    attach->is_file = 1;
+    attach->u.file.path = path;
+    attach->u.file.owns_file = owns_file;
+
+    return attach;
+}
+
+icalattach *icalattach_new_from_file(const char *path)
+{
+    char *path_copy;
+    icalattach *attach;
+
+    icalerror_check_arg_rz((path != NULL), "path");
+
+    if ((path_copy = strdup(path)) == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    attach = icalattach_new_from_file_internal(path_copy, 0);
+    if (attach == NULL)
+        free(path_copy);
+    return attach;
+}
+
+icalattach *icalattach_new_spilled_from_data(const char *data, size_t len)
+{
+    const char *tmpdir;
+    char *path;
+    FILE *fp = NULL;
+    icalattach *attach;
+
+#if defined(_WIN32)
+    tmpdir = getenv("TEMP");
+#else
+    tmpdir = getenv("TMPDIR");
+#endif
+    if (tmpdir == NULL || *tmpdir == '\0')
+#if defined(_WIN32)
+        tmpdir = ".";
+#else
+        tmpdir = "/tmp";
+#endif
+
+    path = malloc(strlen(tmpdir) + 32);
+    if (path == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+#if defined(_WIN32)
+    {
+        static int spill_seq = 0;
+
+        snprintf(path, strlen(tmpdir) + 32, "%s\\icalattach-%d-%d.tmp",
+                 tmpdir, (int)_getpid(), spill_seq++);
+        fp = fopen(path, "wb");
+    }
+#else
+    {
+        int fd;
+
+        snprintf(path, strlen(tmpdir) + 32, "%s/icalattach-XXXXXX", tmpdir);
+        fd = mkstemp(path);
+        if (fd >= 0)
+            fp = fdopen(fd, "wb");
+    }
+#endif
+
+    if (fp == NULL) {
+        free(path);
+        return NULL;
+    }
+
+    if (fwrite(data, 1, len, fp) != len) {
+        (void)fclose(fp);
+        (void)remove(path);
+        free(path);
+        return NULL;
+    }
+    if (fclose(fp) != 0) {
+        (void)remove(path);
+        free(path);
+        return NULL;
+    }
+
+    attach = icalattach_new_from_file_internal(path, 1);
+    if (attach == NULL) {
+        (void)remove(path);
+        free(path);
+    }
+    return attach;
+}
+
+int icalattach_get_is_file(icalattach *attach)
+{
+    icalerror_check_arg_rz((attach != NULL), "attach");
+
+    return attach->is_file ? 1 : 0;
+}
+
+const char *icalattach_get_filename(icalattach *attach)
+{
+    icalerror_check_arg_rz((attach != NULL), "attach");
+    icalerror_check_arg_rz((attach->is_file), "attach->is_file");
+
+    return attach->u.file.path;
+}
+
+char *icalattach_read_data_r(icalattach *attach)
+{
+    FILE *fp;
+    long size;
+    char *buf;
+    size_t got;
+
+    icalerror_check_arg_rz((attach != NULL), "attach");
+    icalerror_check_arg_rz((attach->is_file), "attach->is_file");
+
+    fp = fopen(attach->u.file.path, "rb");
+    if (fp == NULL)
+        return NULL;
+
+    if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+        fseek(fp, 0, SEEK_SET) != 0) {
+        (void)fclose(fp);
+        return NULL;
+    }
+
+    buf = icalmemory_new_buffer((size_t)size + 1);
+    if (buf == NULL) {
+        (void)fclose(fp);
+        return NULL;
+    }
+
+    got = fread(buf, 1, (size_t)size, fp);
+    (void)fclose(fp);
+    buf[got] = '\0';
+
+    return buf;
+}
@@ -33,6 +33,8 @@
 
 #include "libical_ical_export.h"
 
+#include <stddef.h>
+
 /**
  * @typedef icalattach
  * @brief An iCal attach object representing a link to a document object.
@@ -121,6 +123,13 @@ LIBICAL_ICAL_EXPORT icalattach *icalattach_new_from_data(const char *data,
  * By increasing the refcount of @a attach, you are signaling that
  * you are using it, and it is the owner's responsibility to call
  * icalattach_unref() after it's no longer used.
+ *
+ * @par Thread safety
+ * The reference count is adjusted atomically, so one ::icalattach may
+ * be shared across threads without external locking: each thread takes
+ * its own reference with icalattach_ref() and drops it with
+ * icalattach_unref() when done. The attachment's URL or data must
+ * still be treated as read-only while it is shared.
  */
 LIBICAL_ICAL_EXPORT void icalattach_ref(icalattach *attach);
 
@@ -226,4 +235,70 @@ LIBICAL_ICAL_EXPORT const char *icalattach_get_url(icalattach *attach);
  */
 LIBICAL_ICAL_EXPORT unsigned char *icalattach_get_data(icalattach *attach);
 
+/**
+ * @brief Creates a new ::icalattach whose encoded content lives in a file.
+ * @param path Path to the file holding the encoded attachment content
+ * @return A file-backed ::icalattach, or `NULL` on allocation failure
+ *
+ * The file's content is not loaded into memory; it is read back only
+ * when the value is serialized. The file must outlive the attachment
+ * and is not removed when the attachment is released. Use
+ * icalattach_get_filename() to retrieve the path.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalattach *icalattach_new_from_file(const char *path);
+
+/**
+ * @brief Determines if the attachment's content is file-backed.
+ * @return 1 for a file-backed attachment, otherwise 0
+ * @sa icalattach_get_filename()
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalattach_get_is_file(icalattach *attach);
+
+/**
+ * @brief Returns the path of a file-backed attachment's content.
+ *
+ * The string is owned by libical and valid while the attachment holds
+ * a reference. Sets ::icalerrno to ::ICAL_BADARG_ERROR and returns
+ * `NULL` if the attachment is not file-backed.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT const char *icalattach_get_filename(icalattach *attach);
+
+/**
+ * @brief Reads a file-backed attachment's encoded content back into memory.
+ * @return A newly allocated, NUL-terminated buffer owned by the caller
+ * (release with icalmemory_free_buffer()), or `NULL` on I/O failure
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT char *icalattach_read_data_r(icalattach *attach);
+
+/**
+ * @brief Sets the size threshold above which parsed inline attachments
+ * spill to disk.
+ *
+ * When set to a non-zero byte count, the value parser stores the
+ * encoded content of any `ATTACH;VALUE=BINARY` at or above the
+ * threshold in a temporary file (removed when the last reference to
+ * the attachment drops) instead of keeping it in the component tree,
+ * so a single huge attachment no longer multiplies a worker's
+ * resident memory. The default of 0 keeps everything in memory.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalattach_set_spill_threshold(size_t bytes);
+
+/**
+ * @brief Returns the current attachment spill threshold in bytes;
+ * 0 means spilling is disabled.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT size_t icalattach_get_spill_threshold(void);
+
 #endif /* !ICALATTACH_H */
@@ -42,10 +42,26 @@ struct icalattach_impl
             icalattach_free_fn_t free_fn;
             void *free_fn_data;
         } data;
+
+        /* File-backed data: the encoded content lives on disk and is
+           only read back when the value is serialized */
+        struct
+        {
+            char *path;
+            int owns_file;      /* remove the file when the last ref drops */
+        } file;
     } u;
 
     /* TRUE if URL, FALSE if inline data */
     unsigned int is_url:1;
+
+    /* TRUE if the data is file-backed (is_url is 0) */
+    unsigned int is_file:1;
 };
 
+/* Spills @data (the encoded ATTACH content) to an owned temp file and
+   returns a file-backed attachment, or NULL if the file cannot be
+   written. Used by the value parser when the spill threshold is set. */
+icalattach *icalattach_new_spilled_from_data(const char *data, size_t len);
+
 #endif
@@ -21,17 +21,45 @@
 #endif
 
 #include "icalcomponent.h"
+#include "icalcomponent_p.h"
 #include "icalerror.h"
 #include "icalmemory.h"
+#include "icalparameterimpl.h"
 #include "icalparser.h"
 #include "icalproperty_p.h"
 #include "icalrestriction.h"
 #include "icaltimezone.h"
+#include "icalvalue.h"
+#include "icalvalueimpl.h"
+#include "icaltrace.h"
 
 #include <assert.h>
+#include <ctype.h>
 #include <stdlib.h>
 #include <limits.h>
 
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
+#if defined(HAVE_SYS_UIO_H)
+#include <sys/uio.h>
+#endif
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#if !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
+/** Slots in the per-component cache of first-list-element per property
+    kind. Direct-mapped by kind. */
+#define ICALCOMPONENT_KIND_CACHE_SIZE 16
+
 struct icalcomponent_impl
 {
     char id[5];
@@ -39,6 +67,44 @@ struct icalcomponent_impl
     char *x_name;
     pvl_list properties;
     pvl_elem property_iterator;
+
+        /** Cache of the first property-list element per kind, so repeated
+           kind-targeted icalcomponent_get_first_property() calls are O(1).
+           An entry is valid only while its generation matches
+           property_generation, which every add/remove bumps; a stale or
+           empty slot just falls back to the list scan. A cached elem of 0
+           records that the kind is absent. */
+    struct icalcomponent_kind_cache_entry
+    {
+        icalproperty_kind kind;
+        pvl_elem elem;
+        unsigned int generation;
+    } kind_cache[ICALCOMPONENT_KIND_CACHE_SIZE];
+    unsigned int property_generation;
+
+        /** Generation-validated caches of per-kind counts, filled by
+           icalcomponent_count_properties()/_count_components() on their
+           first scan and reused until the corresponding list mutates.
+           Restriction checks count the same kinds over and over. */
+    struct icalcomponent_count_cache_entry
+    {
+        int kind;
+        int count;
+        unsigned int generation;
+    } prop_count_cache[ICALCOMPONENT_KIND_CACHE_SIZE],
+      comp_count_cache[ICALCOMPONENT_KIND_CACHE_SIZE];
+    unsigned int component_generation;
+
+        /** Counter covering the whole subtree: any property or child
+           mutation below this component moves it, propagated upward
+           through the parent links. Storage layers compare snapshots of
+           it to skip components that have not changed. */
+    unsigned int content_generation;
+
+        /** Lazily built hash index over the children's UIDs, used by
+           icalcomponent_get_component_by_uid(). Rebuilt when
+           component_generation shows the child list has mutated. */
+    struct icalcomponent_uid_index *uid_index;
     pvl_list components;
     pvl_elem component_iterator;
     struct icalcomponent_impl *parent;
@@ -49,23 +115,100 @@ struct icalcomponent_impl
            array before doing a binary search. */
     icalarray *timezones;
     int timezones_sorted;
+
+        /** Lazily built hash index over the VTIMEZONE children, keyed by
+           TZID and carrying a content digest of each zone (with the TZID
+           itself excluded). icalcomponent_merge_component() consults it so
+           that deduplicating an incoming zone against an existing one of
+           the same name rarely needs a full serialization, and
+           icalcomponent_get_timezone() resolves TZID references through
+           it in one lookup. Rebuilt when component_generation shows the
+           child list has mutated. */
+    struct icalcomponent_tzid_index *tzid_index;
+
+        /** Lazily built hash index over this component's ATTENDEE
+           properties, keyed by calendar address normalized to a
+           case-folded form without the mailto: scheme.
+           icalcomponent_get_attendee() resolves a REPLY sender against
+           a large attendee list through it in one lookup. Rebuilt when
+           property_generation shows the property list has mutated. */
+    struct icalcomponent_attendee_index *attendee_index;
+
+        /** Nonzero once icalcomponent_freeze() has been called. A frozen
+           component refuses structural mutation and its read accessors
+           stop writing to the lazy caches, so a frozen tree can be read
+           from many threads at once (through the external iterators). */
+    int frozen;
+
+        /** Result of the last restriction check of this component,
+           keyed to the method it ran under and to property_generation,
+           so icalrestriction_check_incremental() can skip components
+           that have not changed since they were last validated. */
+    int restriction_checked;
+    icalproperty_method restriction_method;
+    unsigned int restriction_generation;
+
+        /** Cached canonical digest over this component's own properties,
+           keyed to property_generation. icalcomponent_hash() combines it
+           with the children's digests on every call, so a mutation
+           anywhere in the tree is picked up without notifying the
+           ancestors. */
+    unsigned long long prop_hash;
+    unsigned int prop_hash_generation;
+    int prop_hash_valid;
+    int restriction_valid;
+
+        /** Memoized occurrence spans from the last
+           icalcomponent_get_occurrences_cached() expansion, sorted by
+           start, together with the window they cover. Keyed to
+           property_generation, so editing the RRULE/RDATE/EXDATE/DTSTART
+           (or any other) properties invalidates it. */
+    icalarray *occ_cache;
+    time_t occ_cache_start;
+    time_t occ_cache_end;
+    unsigned int occ_cache_generation;
+
+        /** Memoized result of icalcomponent_get_span(). The span is a
+           function of DTSTART/DTEND/DURATION and their TZIDs, which may
+           live in a child when this is a VCALENDAR, so the cache is
+           keyed to content_generation (any mutation in the subtree
+           moves it). */
+    icaltime_span span_cache;
+    unsigned int span_cache_generation;
+    int span_cache_valid;
 };
 
 static void icalcomponent_add_children(icalcomponent *impl, va_list args);
 static icalcomponent *icalcomponent_new_impl(icalcomponent_kind kind);
 
+/** Bumps the subtree content counter here and in every ancestor, so a
+    snapshot taken anywhere above the mutation goes stale. */
+static void icalcomponent_content_changed(icalcomponent *component)
+{
+    for (; component != 0; component = component->parent) {
+        component->content_generation++;
+    }
+}
+
 static void icalcomponent_merge_vtimezone(icalcomponent *comp,
                                           icalcomponent *vtimezone, icalarray *tzids_to_rename);
 static void icalcomponent_handle_conflicting_vtimezones(icalcomponent *comp,
                                                         icalcomponent *vtimezone,
                                                         icalproperty *tzid_prop,
                                                         const char *tzid,
-                                                        icalarray *tzids_to_rename);
+                                                        icalarray *tzids_to_rename,
+                                                        unsigned long long content_hash);
 static size_t icalcomponent_get_tzid_prefix_len(const char *tzid);
 static void icalcomponent_rename_tzids(icalcomponent *comp, icalarray *rename_table);
 static void icalcomponent_rename_tzids_callback(icalparameter *param, void *data);
 static int icalcomponent_compare_vtimezones(icalcomponent *vtimezone1, icalcomponent *vtimezone2);
 static int icalcomponent_compare_timezone_fn(const void *elem1, const void *elem2);
+static void icalcomponent_uid_index_free(struct icalcomponent_uid_index *index);
+static void icalcomponent_attendee_index_free(struct icalcomponent_attendee_index *index);
+static void icalcomponent_tzid_index_free(struct icalcomponent_tzid_index *index);
+static struct icalcomponent_tzid_index *icalcomponent_tzid_index_build(icalcomponent *comp);
+static struct icalcomponent_tzid_index *icalcomponent_tzid_index_get(icalcomponent *comp);
+static unsigned long long comp_hash_own_properties(icalcomponent *comp);
 
 void icalcomponent_add_children(icalcomponent *impl, va_list args)
 {
@@ -91,7 +234,7 @@ static icalcomponent *icalcomponent_new_impl(icalcomponent_kind kind)
     if (!icalcomponent_kind_is_valid(kind))
         return NULL;
 
-    if ((comp = (icalcomponent *) malloc(sizeof(icalcomponent))) == 0) {
+    if ((comp = (icalcomponent *) icalmemory_new_buffer(sizeof(icalcomponent))) == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
@@ -198,6 +341,11 @@ void icalcomponent_free(icalcomponent *c)
             return;
         }
 
+        /* Freezing forbids mutation by outside users, not teardown; the
+           loop below dismantles the tree through
+           icalcomponent_remove_component(). */
+        c->frozen = 0;
+
         if (c->properties != 0) {
             while ((prop = pvl_pop(c->properties)) != 0) {
                 icalproperty_set_parent(prop, 0);
@@ -214,7 +362,7 @@ void icalcomponent_free(icalcomponent *c)
         pvl_free(c->components);
 
         if (c->x_name != 0) {
-            free(c->x_name);
+            icalmemory_free_buffer(c->x_name);
         }
 
         if (c->timezones) {
@@ -222,6 +370,26 @@ void icalcomponent_free(icalcomponent *c)
             c->timezones = 0;
         }
 
+        if (c->uid_index != 0) {
+            icalcomponent_uid_index_free(c->uid_index);
+            c->uid_index = 0;
+        }
+
+        if (c->tzid_index != 0) {
+            icalcomponent_tzid_index_free(c->tzid_index);
+            c->tzid_index = 0;
+        }
+
+        if (c->attendee_index != 0) {
+            icalcomponent_attendee_index_free(c->attendee_index);
+            c->attendee_index = 0;
+        }
+
+        if (c->occ_cache != 0) {
+            icalarray_free(c->occ_cache);
+            c->occ_cache = 0;
+        }
+
         c->kind = ICAL_NO_COMPONENT;
         c->properties = 0;
         c->property_iterator = 0;
@@ -231,7 +399,7 @@ void icalcomponent_free(icalcomponent *c)
         c->id[0] = 'X';
         c->timezones = NULL;
 
-        free(c);
+        icalmemory_free_buffer(c);
     }
 }
 
@@ -244,483 +412,2794 @@ char *icalcomponent_as_ical_string(icalcomponent *impl)
     return buf;
 }
 
-char *icalcomponent_as_ical_string_r(icalcomponent *impl)
+/* The serializer runs in two phases: the first walk renders each
+   property exactly once, saving the fragment and its length here and
+   summing the exact output size; the second walk memcpy()s the
+   fragments into a single allocation of that size. This avoids the
+   repeated strlen/realloc/copy cost of appending piecemeal, which
+   dominates when serializing large VCALENDARs. */
+struct icalcomponent_serialize_frags
 {
-    char *buf;
-    char *tmp_buf;
-    size_t buf_size = 1024;
-    char *buf_ptr = 0;
-    pvl_elem itr;
-
-    /* RFC5545 explicitly says that the newline is *ALWAYS* a \r\n (CRLF)!!!! */
-    const char newline[] = "\r\n";
-
-    icalcomponent *c;
-    icalproperty *p;
-    icalcomponent_kind kind = icalcomponent_isa(impl);
-
-    const char *kind_string;
-
-    icalerror_check_arg_rz((impl != 0), "component");
-    icalerror_check_arg_rz((kind != ICAL_NO_COMPONENT), "component kind is ICAL_NO_COMPONENT");
+    char **strs;
+    size_t *lens;
+    size_t count;
+    size_t capacity;
+};
 
-    if (kind != ICAL_X_COMPONENT) {
-        kind_string = icalcomponent_kind_to_string(kind);
-    } else {
-        kind_string = impl->x_name;
+static const char *component_kind_string(icalcomponent *impl)
+{
+    if (impl->kind != ICAL_X_COMPONENT) {
+        return icalcomponent_kind_to_string(impl->kind);
     }
+    return impl->x_name;
+}
 
-    icalerror_check_arg_rz((kind_string != 0), "Unknown kind of component");
+static void serialize_collect(icalcomponent *impl,
+                              struct icalcomponent_serialize_frags *frags, size_t *size)
+{
+    pvl_elem itr;
+    const char *kind_string = component_kind_string(impl);
 
-    buf = icalmemory_new_buffer(buf_size);
-    buf_ptr = buf;
+    if (kind_string == 0) {
+        /* Nothing is emitted for a component of unknown kind, matching
+           the old appender which skipped the NULL strings */
+        return;
+    }
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, "BEGIN:");
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, kind_string);
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, newline);
+    /* BEGIN:<kind>\r\n ... END:<kind>\r\n */
+    *size += 6 + 4 + 2 * (strlen(kind_string) + 2);
 
     for (itr = pvl_head(impl->properties); itr != 0; itr = pvl_next(itr)) {
-        p = (icalproperty *) pvl_data(itr);
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+        char *tmp_buf;
 
         icalerror_assert((p != 0), "Got a null property");
         tmp_buf = icalproperty_as_ical_string_r(p);
 
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, tmp_buf);
-        free(tmp_buf);
+        /* A NULL rendering still gets a zero-length slot so that the
+           write phase stays in lockstep with the property walk */
+        if (frags->count == frags->capacity) {
+            frags->capacity *= 2;
+            frags->strs = (char **)icalmemory_resize_buffer(
+                frags->strs, frags->capacity * sizeof(char *));
+            frags->lens = (size_t *)icalmemory_resize_buffer(
+                frags->lens, frags->capacity * sizeof(size_t));
+        }
+
+        frags->strs[frags->count] = tmp_buf;
+        frags->lens[frags->count] = (tmp_buf != 0) ? strlen(tmp_buf) : 0;
+        *size += frags->lens[frags->count];
+        frags->count++;
     }
 
     for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
-        c = (icalcomponent *) pvl_data(itr);
+        serialize_collect((icalcomponent *) pvl_data(itr), frags, size);
+    }
+}
 
-        tmp_buf = icalcomponent_as_ical_string_r(c);
+static char *serialize_write(icalcomponent *impl, char *pos,
+                             struct icalcomponent_serialize_frags *frags, size_t *idx)
+{
+    pvl_elem itr;
+    const char *kind_string = component_kind_string(impl);
+    size_t kind_len;
 
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, tmp_buf);
-        free(tmp_buf);
+    if (kind_string == 0) {
+        return pos;
     }
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, "END:");
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, icalcomponent_kind_to_string(kind));
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, newline);
+    kind_len = strlen(kind_string);
 
-    return buf;
-}
+    memcpy(pos, "BEGIN:", 6);
+    pos += 6;
+    memcpy(pos, kind_string, kind_len);
+    pos += kind_len;
+    memcpy(pos, "\r\n", 2);
+    pos += 2;
 
-int icalcomponent_is_valid(icalcomponent *component)
-{
-    if ((strcmp(component->id, "comp") == 0) && component->kind != ICAL_NO_COMPONENT) {
-        return 1;
-    } else {
-        return 0;
+    for (itr = pvl_head(impl->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+
+        if (p == 0) {
+            continue;
+        }
+
+        /* Consume the fragments in the same walk order that collected
+           them */
+        if (*idx < frags->count) {
+            if (frags->strs[*idx] != 0) {
+                memcpy(pos, frags->strs[*idx], frags->lens[*idx]);
+                pos += frags->lens[*idx];
+                icalmemory_free_buffer(frags->strs[*idx]);
+            }
+            (*idx)++;
+        }
     }
-}
 
-icalcomponent_kind icalcomponent_isa(const icalcomponent *component)
-{
-    icalerror_check_arg_rx((component != 0), "component", ICAL_NO_COMPONENT);
+    for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
+        pos = serialize_write((icalcomponent *) pvl_data(itr), pos, frags, idx);
+    }
 
-    return component->kind;
+    memcpy(pos, "END:", 4);
+    pos += 4;
+    memcpy(pos, kind_string, kind_len);
+    pos += kind_len;
+    memcpy(pos, "\r\n", 2);
+    pos += 2;
+
+    return pos;
 }
 
-int icalcomponent_isa_component(void *component)
+char *icalcomponent_as_ical_string_r(icalcomponent *impl)
 {
-    icalcomponent *impl = component;
+    struct icalcomponent_serialize_frags frags;
+    char *buf;
+    char *pos;
+    size_t strs_bytes, lens_bytes;
+    size_t size = 0;
+    size_t idx = 0;
+    icalcomponent_kind kind = icalcomponent_isa(impl);
 
-    icalerror_check_arg_rz((component != 0), "component");
+    const char *kind_string;
+    const char *prev_tag;
+    ical_trace_timer trace_t = ical_trace_timer_start();
 
-    if (strcmp(impl->id, "comp") == 0) {
-        return 1;
-    } else {
-        return 0;
+    icalerror_check_arg_rz((impl != 0), "component");
+    icalerror_check_arg_rz((kind != ICAL_NO_COMPONENT), "component kind is ICAL_NO_COMPONENT");
+
+    kind_string = component_kind_string(impl);
+
+    icalerror_check_arg_rz((kind_string != 0), "Unknown kind of component");
+
+    prev_tag = icalmemory_set_tag("serializer");
+
+    frags.count = 0;
+    frags.capacity = 16;
+    /* The fragment arrays are call-local workspace; rent them from the
+       per-thread scratch pool */
+    strs_bytes = frags.capacity * sizeof(char *);
+    lens_bytes = frags.capacity * sizeof(size_t);
+    frags.strs = (char **)icalmemory_scratch_acquire(&strs_bytes);
+    frags.lens = (size_t *)icalmemory_scratch_acquire(&lens_bytes);
+    frags.capacity = strs_bytes / sizeof(char *);
+    if (lens_bytes / sizeof(size_t) < frags.capacity) {
+        frags.capacity = lens_bytes / sizeof(size_t);
     }
-}
 
-void icalcomponent_add_property(icalcomponent *component, icalproperty *property)
-{
-    icalerror_check_arg_rv((component != 0), "component");
-    icalerror_check_arg_rv((property != 0), "property");
+    serialize_collect(impl, &frags, &size);
 
-    icalerror_assert((!icalproperty_get_parent(property)),
-                     "The property has already been added to a component. "
-                     "Remove the property with icalcomponent_remove_property "
-                     "before calling icalcomponent_add_property");
+    buf = icalmemory_new_buffer(size + 1);
+    pos = serialize_write(impl, buf, &frags, &idx);
+    *pos = '\0';
 
-    icalproperty_set_parent(property, component);
+    icalmemory_scratch_release((char *)frags.strs, frags.capacity * sizeof(char *));
+    icalmemory_scratch_release((char *)frags.lens, frags.capacity * sizeof(size_t));
 
-    pvl_push(component->properties, property);
+    icalmemory_set_tag(prev_tag);
+
+    ical_trace_point_hit(ICAL_TRACE_SERIALIZE_COMPONENT, trace_t);
+
+    return buf;
 }
 
-void icalcomponent_remove_property(icalcomponent *component, icalproperty *property)
-{
-    pvl_elem itr, next_itr;
+#if defined(HAVE_SYS_UIO_H)
 
-    icalerror_check_arg_rv((component != 0), "component");
-    icalerror_check_arg_rv((property != 0), "property");
+static void serialize_iov(icalcomponent *impl,
+                          struct icalcomponent_serialize_frags *frags, size_t *idx,
+                          struct iovec *iov, size_t *iov_count)
+{
+    pvl_elem itr;
+    const char *kind_string = component_kind_string(impl);
 
-#if defined(ICAL_REMOVE_NONMEMBER_COMPONENT_IS_ERROR)
-    icalerror_assert((icalproperty_get_parent(property)),
-                     "The property is not a member of a component");
-#else
-    if (icalproperty_get_parent(property) == 0) {
+    if (kind_string == 0) {
         return;
     }
-#endif
-
-    for (itr = pvl_head(component->properties); itr != 0; itr = next_itr) {
-        next_itr = pvl_next(itr);
 
-        if (pvl_data(itr) == (void *)property) {
+    iov[*iov_count].iov_base = (void *)"BEGIN:";
+    iov[(*iov_count)].iov_len = 6;
+    iov[*iov_count + 1].iov_base = (void *)kind_string;
+    iov[*iov_count + 1].iov_len = strlen(kind_string);
+    iov[*iov_count + 2].iov_base = (void *)"\r\n";
+    iov[*iov_count + 2].iov_len = 2;
+    *iov_count += 3;
 
-            if (component->property_iterator == itr) {
-                component->property_iterator = pvl_next(itr);
+    for (itr = pvl_head(impl->properties); itr != 0; itr = pvl_next(itr)) {
+        if (pvl_data(itr) == 0) {
+            continue;
+        }
+        if (*idx < frags->count) {
+            if (frags->strs[*idx] != 0) {
+                iov[*iov_count].iov_base = frags->strs[*idx];
+                iov[*iov_count].iov_len = frags->lens[*idx];
+                (*iov_count)++;
             }
-
-            (void)pvl_remove(component->properties, itr);
-            icalproperty_set_parent(property, 0);
+            (*idx)++;
         }
     }
+
+    for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
+        serialize_iov((icalcomponent *) pvl_data(itr), frags, idx, iov, iov_count);
+    }
+
+    iov[*iov_count].iov_base = (void *)"END:";
+    iov[(*iov_count)].iov_len = 4;
+    iov[*iov_count + 1].iov_base = (void *)kind_string;
+    iov[*iov_count + 1].iov_len = strlen(kind_string);
+    iov[*iov_count + 2].iov_base = (void *)"\r\n";
+    iov[*iov_count + 2].iov_len = 2;
+    *iov_count += 3;
 }
 
-int icalcomponent_count_properties(icalcomponent *component, icalproperty_kind kind)
+/* Counts the iovec slots serialize_iov() will fill: six per component
+   plus one per rendered property fragment */
+static size_t serialize_iov_slots(icalcomponent *impl)
 {
-    int count = 0;
     pvl_elem itr;
+    size_t slots;
 
-    icalerror_check_arg_rz((component != 0), "component");
+    if (component_kind_string(impl) == 0) {
+        return 0;
+    }
 
-    for (itr = pvl_head(component->properties); itr != 0; itr = pvl_next(itr)) {
-        if (kind == icalproperty_isa((icalproperty *) pvl_data(itr)) || kind == ICAL_ANY_PROPERTY) {
-            count++;
-        }
+    slots = 6 + pvl_count(impl->properties);
+
+    for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
+        slots += serialize_iov_slots((icalcomponent *) pvl_data(itr));
     }
 
-    return count;
+    return slots;
 }
 
-icalproperty *icalcomponent_get_current_property(icalcomponent *component)
+static long write_iov_all(int fd, struct iovec *iov, size_t count)
 {
-    icalerror_check_arg_rz((component != 0), "component");
+    long total = 0;
 
-    if (component->property_iterator == 0) {
-        return 0;
+    while (count > 0) {
+        size_t batch = (count > IOV_MAX) ? (size_t)IOV_MAX : count;
+        ssize_t n = writev(fd, iov, (int)batch);
+
+        if (n < 0) {
+            return -1;
+        }
+        total += (long)n;
+
+        /* Skip the iovecs the kernel consumed, then trim a partially
+           written one before retrying */
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0 && n > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
     }
 
-    return (icalproperty *) pvl_data(component->property_iterator);
+    return total;
 }
 
-icalproperty *icalcomponent_get_first_property(icalcomponent *c, icalproperty_kind kind)
+long icalcomponent_write_fd(icalcomponent *component, int fd)
 {
-    icalerror_check_arg_rz((c != 0), "component");
+    struct icalcomponent_serialize_frags frags;
+    struct iovec *iov;
+    size_t strs_bytes, lens_bytes, iov_bytes;
+    size_t iov_count = 0;
+    size_t idx = 0;
+    size_t size = 0;
+    size_t i;
+    long written;
+    icalcomponent_kind kind = icalcomponent_isa(component);
+
+    icalerror_check_arg_re((component != 0), "component", -1);
+    icalerror_check_arg_re((fd >= 0), "fd", -1);
+    icalerror_check_arg_re((kind != ICAL_NO_COMPONENT), "component kind is ICAL_NO_COMPONENT",
+                           -1);
+    icalerror_check_arg_re((component_kind_string(component) != 0),
+                           "Unknown kind of component", -1);
+
+    frags.count = 0;
+    frags.capacity = 16;
+    /* The fragment arrays are call-local workspace; rent them from the
+       per-thread scratch pool */
+    strs_bytes = frags.capacity * sizeof(char *);
+    lens_bytes = frags.capacity * sizeof(size_t);
+    frags.strs = (char **)icalmemory_scratch_acquire(&strs_bytes);
+    frags.lens = (size_t *)icalmemory_scratch_acquire(&lens_bytes);
+    frags.capacity = strs_bytes / sizeof(char *);
+    if (lens_bytes / sizeof(size_t) < frags.capacity) {
+        frags.capacity = lens_bytes / sizeof(size_t);
+    }
+
+    serialize_collect(component, &frags, &size);
+
+    iov_bytes = serialize_iov_slots(component) * sizeof(struct iovec);
+    iov = (struct iovec *)icalmemory_scratch_acquire(&iov_bytes);
+    serialize_iov(component, &frags, &idx, iov, &iov_count);
+
+    written = write_iov_all(fd, iov, iov_count);
+    if (written < 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+    }
+
+    for (i = 0; i < frags.count; i++) {
+        if (frags.strs[i] != 0) {
+            icalmemory_free_buffer(frags.strs[i]);
+        }
+    }
+    icalmemory_scratch_release((char *)frags.strs, frags.capacity * sizeof(char *));
+    icalmemory_scratch_release((char *)frags.lens, frags.capacity * sizeof(size_t));
+    icalmemory_scratch_release((char *)iov, iov_bytes);
 
-    for (c->property_iterator = pvl_head(c->properties);
-         c->property_iterator != 0; c->property_iterator = pvl_next(c->property_iterator)) {
+    return written;
+}
 
-        icalproperty *p = (icalproperty *) pvl_data(c->property_iterator);
+#else /* !HAVE_SYS_UIO_H */
 
-        if (icalproperty_isa(p) == kind || kind == ICAL_ANY_PROPERTY) {
+long icalcomponent_write_fd(icalcomponent *component, int fd)
+{
+    char *str;
+    size_t len, off = 0;
 
-            return p;
+    icalerror_check_arg_re((component != 0), "component", -1);
+    icalerror_check_arg_re((fd >= 0), "fd", -1);
+
+    str = icalcomponent_as_ical_string_r(component);
+    if (str == 0) {
+        return -1;
+    }
+
+    len = strlen(str);
+    while (off < len) {
+#if defined(_WIN32)
+        int n = _write(fd, str + off, (unsigned int)(len - off));
+#else
+        ssize_t n = write(fd, str + off, len - off);
+#endif
+        if (n < 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            icalmemory_free_buffer(str);
+            return -1;
+        }
+        off += (size_t)n;
+    }
+
+    icalmemory_free_buffer(str);
+
+    return (long)len;
+}
+
+#endif /* HAVE_SYS_UIO_H */
+
+/* Largest piece handed to a serialization sink in one call */
+#define SERIALIZE_CHUNK_SIZE 4096
+
+static int serialize_sink_str(const char *str, size_t len,
+                              icalcomponent_sink_func sink, void *d)
+{
+    while (len > SERIALIZE_CHUNK_SIZE) {
+        if ((*sink) (str, SERIALIZE_CHUNK_SIZE, d) != 0) {
+            return 1;
         }
+        str += SERIALIZE_CHUNK_SIZE;
+        len -= SERIALIZE_CHUNK_SIZE;
+    }
+
+    if (len > 0 && (*sink) (str, len, d) != 0) {
+        return 1;
     }
+
     return 0;
 }
 
-icalproperty *icalcomponent_get_next_property(icalcomponent *c, icalproperty_kind kind)
+static int serialize_stream(icalcomponent *impl, icalcomponent_sink_func sink, void *d)
 {
-    icalerror_check_arg_rz((c != 0), "component");
+    pvl_elem itr;
+    const char *kind_string = component_kind_string(impl);
 
-    if (c->property_iterator == 0) {
+    if (kind_string == 0) {
         return 0;
     }
 
-    for (c->property_iterator = pvl_next(c->property_iterator);
-         c->property_iterator != 0; c->property_iterator = pvl_next(c->property_iterator)) {
+    if (serialize_sink_str("BEGIN:", 6, sink, d) != 0 ||
+        serialize_sink_str(kind_string, strlen(kind_string), sink, d) != 0 ||
+        serialize_sink_str("\r\n", 2, sink, d) != 0) {
+        return 1;
+    }
 
-        icalproperty *p = (icalproperty *) pvl_data(c->property_iterator);
+    for (itr = pvl_head(impl->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+        char *tmp_buf;
+        int aborted;
 
-        if (icalproperty_isa(p) == kind || kind == ICAL_ANY_PROPERTY) {
+        icalerror_assert((p != 0), "Got a null property");
+        tmp_buf = icalproperty_as_ical_string_r(p);
+        if (tmp_buf == 0) {
+            continue;
+        }
 
-            return p;
+        aborted = serialize_sink_str(tmp_buf, strlen(tmp_buf), sink, d);
+        icalmemory_free_buffer(tmp_buf);
+        if (aborted != 0) {
+            return 1;
+        }
+    }
+
+    for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
+        if (serialize_stream((icalcomponent *) pvl_data(itr), sink, d) != 0) {
+            return 1;
         }
     }
 
+    if (serialize_sink_str("END:", 4, sink, d) != 0 ||
+        serialize_sink_str(kind_string, strlen(kind_string), sink, d) != 0 ||
+        serialize_sink_str("\r\n", 2, sink, d) != 0) {
+        return 1;
+    }
+
     return 0;
 }
 
-icalproperty **icalcomponent_get_properties(icalcomponent *component, icalproperty_kind kind);
-
-void icalcomponent_add_component(icalcomponent *parent, icalcomponent *child)
+int icalcomponent_serialize(icalcomponent *component, icalcomponent_sink_func sink, void *d)
 {
-    icalerror_check_arg_rv((parent != 0), "parent");
-    icalerror_check_arg_rv((child != 0), "child");
+    icalcomponent_kind kind = icalcomponent_isa(component);
 
-    if (child->parent != 0) {
-        icalerror_set_errno(ICAL_USAGE_ERROR);
-    }
+    icalerror_check_arg_re((component != 0), "component", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((sink != 0), "sink", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((kind != ICAL_NO_COMPONENT), "component kind is ICAL_NO_COMPONENT",
+                           ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((component_kind_string(component) != 0),
+                           "Unknown kind of component", ICAL_BADARG_ERROR);
 
-    child->parent = parent;
+    return serialize_stream(component, sink, d);
+}
 
-    /* Fix for Mozilla - bug 327602 */
-    if (child->kind != ICAL_VTIMEZONE_COMPONENT) {
-        pvl_push(parent->components, child);
-    } else {
-        /* VTIMEZONES should be first in the resulting VCALENDAR. */
-        pvl_unshift(parent->components, child);
+/*** jCal (RFC 7265) emitter ******************************************/
 
-        /* Add the VTIMEZONE to our array. */
-        /* FIXME: Currently we are also creating this array when loading in
-           a builtin VTIMEZONE, when we don't need it. */
-        if (!parent->timezones)
-            parent->timezones = icaltimezone_array_new();
+static int jcal_sink_cstr(const char *s, icalcomponent_sink_func sink, void *d)
+{
+    return serialize_sink_str(s, strlen(s), sink, d);
+}
 
-        icaltimezone_array_append_from_vtimezone(parent->timezones, child);
+/* Emits @p s lowercased; jCal keeps component, property and parameter
+   names in lowercase. */
+static int jcal_sink_lower(const char *s, icalcomponent_sink_func sink, void *d)
+{
+    char buf[64];
+    size_t n = 0;
 
-        /* Flag that we need to sort it before doing any binary searches. */
-        parent->timezones_sorted = 0;
+    for (; *s != '\0'; s++) {
+        buf[n++] = (char)tolower((int)(unsigned char)*s);
+        if (n == sizeof(buf)) {
+            if (serialize_sink_str(buf, n, sink, d) != 0) {
+                return 1;
+            }
+            n = 0;
+        }
     }
+
+    return serialize_sink_str(buf, n, sink, d);
 }
 
-void icalcomponent_remove_component(icalcomponent *parent, icalcomponent *child)
+/* Emits @p s as a JSON string, quotes included. */
+static int jcal_sink_json_str(const char *s, icalcomponent_sink_func sink, void *d)
 {
-    pvl_elem itr, next_itr;
+    char buf[256];
+    size_t n = 0;
 
-    icalerror_check_arg_rv((parent != 0), "parent");
-    icalerror_check_arg_rv((child != 0), "child");
+    buf[n++] = '"';
 
-    /* If the component is a VTIMEZONE, remove it from our array as well. */
-    if (child->kind == ICAL_VTIMEZONE_COMPONENT) {
-        icaltimezone *zone;
-        size_t i, num_elements;
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
 
-        num_elements = parent->timezones ? parent->timezones->num_elements : 0;
-        for (i = 0; i < num_elements; i++) {
-            zone = icalarray_element_at(parent->timezones, i);
-            if (icaltimezone_get_component(zone) == child) {
-                icaltimezone_free(zone, 0);
-                icalarray_remove_element_at(parent->timezones, i);
-                break;
+        /* Worst case appends 6 bytes (\u00xx) */
+        if (n + 6 > sizeof(buf)) {
+            if (serialize_sink_str(buf, n, sink, d) != 0) {
+                return 1;
             }
+            n = 0;
+        }
+
+        if (c == '"' || c == '\\') {
+            buf[n++] = '\\';
+            buf[n++] = (char)c;
+        } else if (c == '\n') {
+            buf[n++] = '\\';
+            buf[n++] = 'n';
+        } else if (c == '\r') {
+            buf[n++] = '\\';
+            buf[n++] = 'r';
+        } else if (c == '\t') {
+            buf[n++] = '\\';
+            buf[n++] = 't';
+        } else if (c < 0x20) {
+            snprintf(buf + n, 7, "\\u%04x", (unsigned int)c);
+            n += 6;
+        } else {
+            buf[n++] = (char)c;
         }
     }
 
-    for (itr = pvl_head(parent->components); itr != 0; itr = next_itr) {
-        next_itr = pvl_next(itr);
+    buf[n++] = '"';
+    return serialize_sink_str(buf, n, sink, d);
+}
 
-        if (pvl_data(itr) == (void *)child) {
+/* Emits a date or date-time in the extended (jCal) format, quoted. */
+static int jcal_sink_time(struct icaltimetype t, icalcomponent_sink_func sink, void *d)
+{
+    char buf[48];
 
-            if (parent->component_iterator == itr) {
-                /* Don't let the current iterator become invalid */
+    if (t.is_date) {
+        snprintf(buf, sizeof(buf), "\"%04d-%02d-%02d\"", t.year, t.month, t.day);
+    } else {
+        snprintf(buf, sizeof(buf), "\"%04d-%02d-%02dT%02d:%02d:%02d%s\"",
+                 t.year, t.month, t.day, t.hour, t.minute, t.second,
+                 icaltime_is_utc(t) ? "Z" : "");
+    }
 
-                /* HACK. The semantics for this are troubling. */
-                parent->component_iterator = pvl_next(parent->component_iterator);
-            }
-            (void)pvl_remove(parent->components, itr);
-            child->parent = 0;
-            break;
+    return jcal_sink_cstr(buf, sink, d);
+}
+
+static int jcal_is_number(const char *s)
+{
+    if (*s == '-' || *s == '+') {
+        s++;
+    }
+    if (*s == '\0') {
+        return 0;
+    }
+    for (; *s != '\0'; s++) {
+        if (*s < '0' || *s > '9') {
+            return 0;
         }
     }
+    return 1;
 }
 
-int icalcomponent_count_components(icalcomponent *component, icalcomponent_kind kind)
+/* Emits one RECUR part value: a number, a string, or an array of them
+   when the text contains commas. @p val is NUL-terminated and mutable. */
+static int jcal_sink_recur_part(const char *key, char *val,
+                                icalcomponent_sink_func sink, void *d)
 {
-    int count = 0;
-    pvl_elem itr;
+    int multi = (strchr(val, ',') != 0);
 
-    icalerror_check_arg_rz((component != 0), "component");
+    if (strcasecmp(key, "UNTIL") == 0) {
+        return jcal_sink_time(icaltime_from_string(val), sink, d);
+    }
 
-    for (itr = pvl_head(component->components); itr != 0; itr = pvl_next(itr)) {
-        if (kind == icalcomponent_isa((icalcomponent *) pvl_data(itr)) ||
-            kind == ICAL_ANY_COMPONENT) {
-            count++;
+    if (multi && jcal_sink_cstr("[", sink, d) != 0) {
+        return 1;
+    }
+
+    for (;;) {
+        char *comma = strchr(val, ',');
+
+        if (comma != 0) {
+            *comma = '\0';
+        }
+
+        if (jcal_is_number(val)) {
+            if (jcal_sink_cstr(val, sink, d) != 0) {
+                return 1;
+            }
+        } else if (jcal_sink_json_str(val, sink, d) != 0) {
+            return 1;
+        }
+
+        if (comma == 0) {
+            break;
+        }
+        val = comma + 1;
+        if (jcal_sink_cstr(",", sink, d) != 0) {
+            return 1;
         }
     }
 
-    return count;
+    if (multi && jcal_sink_cstr("]", sink, d) != 0) {
+        return 1;
+    }
+
+    return 0;
 }
 
-icalcomponent *icalcomponent_get_current_component(icalcomponent *component)
+/* Emits a RECUR value as the jCal object form, e.g.
+   {"freq":"WEEKLY","count":10,"byday":["SA","SU"]}. */
+static int jcal_sink_recur(icalvalue *value, icalcomponent_sink_func sink, void *d)
 {
-    icalerror_check_arg_rz((component != 0), "component");
+    char *text = icalvalue_as_ical_string_r(value);
+    char *part;
+    int first = 1;
+    int aborted = 0;
 
-    if (component->component_iterator == 0) {
-        return 0;
+    if (text == 0) {
+        return jcal_sink_cstr("{}", sink, d);
     }
 
-    return (icalcomponent *) pvl_data(component->component_iterator);
-}
+    aborted = jcal_sink_cstr("{", sink, d);
 
-icalcomponent *icalcomponent_get_first_component(icalcomponent *c, icalcomponent_kind kind)
-{
-    icalerror_check_arg_rz((c != 0), "component");
+    for (part = text; !aborted && part != 0 && *part != '\0';) {
+        char *semi = strchr(part, ';');
+        char *eq;
 
-    for (c->component_iterator = pvl_head(c->components);
-         c->component_iterator != 0; c->component_iterator = pvl_next(c->component_iterator)) {
+        if (semi != 0) {
+            *semi = '\0';
+        }
 
-        icalcomponent *p = (icalcomponent *) pvl_data(c->component_iterator);
+        eq = strchr(part, '=');
+        if (eq != 0) {
+            *eq = '\0';
 
-        if (icalcomponent_isa(p) == kind || kind == ICAL_ANY_COMPONENT) {
+            if (!first && jcal_sink_cstr(",", sink, d) != 0) {
+                aborted = 1;
+                break;
+            }
+            first = 0;
 
-            return p;
+            if (jcal_sink_cstr("\"", sink, d) != 0 ||
+                jcal_sink_lower(part, sink, d) != 0 ||
+                jcal_sink_cstr("\":", sink, d) != 0 ||
+                jcal_sink_recur_part(part, eq + 1, sink, d) != 0) {
+                aborted = 1;
+                break;
+            }
         }
+
+        part = (semi != 0) ? semi + 1 : 0;
     }
 
-    return 0;
+    if (!aborted) {
+        aborted = jcal_sink_cstr("}", sink, d);
+    }
+
+    icalmemory_free_buffer(text);
+    return aborted;
 }
 
-icalcomponent *icalcomponent_get_next_component(icalcomponent *c, icalcomponent_kind kind)
+/* Emits one parameter as '"name":value' into the property's parameter
+   object, splitting multi-valued parameters into a JSON array and
+   dropping the DQUOTEs iCalendar requires around some values. Works
+   from the stored parameter fields, which hold the value before any
+   RFC 6868 caret-encoding. */
+static int jcal_sink_parameter(icalparameter *param, int *first,
+                               icalcomponent_sink_func sink, void *d)
 {
-    icalerror_check_arg_rz((c != 0), "component");
+    struct icalparameter_impl *pimpl = (struct icalparameter_impl *)param;
+    const char *name;
+    const char *stored;
+    char *val;
+    int multi = 0;
+    int aborted = 0;
+
+    if (pimpl->kind == ICAL_VALUE_PARAMETER) {
+        /* Represented by the value-type element instead */
+        return 0;
+    }
 
-    if (c->component_iterator == 0) {
+    name = pimpl->x_name != 0 ? pimpl->x_name : icalparameter_kind_to_string(pimpl->kind);
+    stored = pimpl->string;
+    if (stored == 0 && pimpl->data != 0) {
+        stored = icalparameter_enum_to_string(pimpl->data);
+    }
+    if (name == 0 || stored == 0) {
         return 0;
     }
 
-    for (c->component_iterator = pvl_next(c->component_iterator);
-         c->component_iterator != 0; c->component_iterator = pvl_next(c->component_iterator)) {
+    /* Mutable copy for in-place splitting */
+    val = icalmemory_strdup(stored);
+    if (val == 0) {
+        return 0;
+    }
 
-        icalcomponent *p = (icalcomponent *) pvl_data(c->component_iterator);
+    if (!*first && jcal_sink_cstr(",", sink, d) != 0) {
+        icalmemory_free_buffer(val);
+        return 1;
+    }
+    *first = 0;
 
-        if (icalcomponent_isa(p) == kind || kind == ICAL_ANY_COMPONENT) {
+    aborted = jcal_sink_cstr("\"", sink, d) != 0 ||
+        jcal_sink_lower(name, sink, d) != 0 || jcal_sink_cstr("\":", sink, d) != 0;
 
-            return p;
+    /* Commas inside DQUOTEs do not separate values */
+    if (!aborted) {
+        char *s;
+        int in_quotes = 0;
+
+        for (s = val; *s != '\0'; s++) {
+            if (*s == '"') {
+                in_quotes = !in_quotes;
+            } else if (*s == ',' && !in_quotes) {
+                multi = 1;
+                break;
+            }
         }
     }
 
-    return 0;
-}
+    if (!aborted && multi) {
+        aborted = jcal_sink_cstr("[", sink, d);
+    }
 
-icalcomponent *icalcomponent_get_first_real_component(icalcomponent *c)
-{
-    icalcomponent *comp;
+    {
+        char *item = val;
 
-    for (comp = icalcomponent_get_first_component(c, ICAL_ANY_COMPONENT);
-         comp != 0; comp = icalcomponent_get_next_component(c, ICAL_ANY_COMPONENT)) {
+        while (!aborted) {
+            char *s = item;
+            char *item_end;
+            int in_quotes = 0;
 
-        icalcomponent_kind kind = icalcomponent_isa(comp);
+            while (*s != '\0' && (*s != ',' || in_quotes)) {
+                if (*s == '"') {
+                    in_quotes = !in_quotes;
+                }
+                s++;
+            }
+            item_end = s;
 
-        if (kind == ICAL_VEVENT_COMPONENT ||
-            kind == ICAL_VTODO_COMPONENT ||
-            kind == ICAL_VJOURNAL_COMPONENT ||
-            kind == ICAL_VFREEBUSY_COMPONENT ||
-            kind == ICAL_VAVAILABILITY_COMPONENT ||
-            kind == ICAL_VPOLL_COMPONENT ||
-            kind == ICAL_VPATCH_COMPONENT ||
-            kind == ICAL_VQUERY_COMPONENT || kind == ICAL_VAGENDA_COMPONENT) {
-            return comp;
+            {
+                char saved = *item_end;
+
+                *item_end = '\0';
+
+                /* Strip one pair of surrounding DQUOTEs */
+                if (*item == '"' && item_end > item + 1 && item_end[-1] == '"') {
+                    item_end[-1] = '\0';
+                    item++;
+                }
+
+                aborted = jcal_sink_json_str(item, sink, d);
+                *s = saved;
+            }
+
+            if (*item_end == '\0') {
+                break;
+            }
+            item = item_end + 1;
+            if (!aborted) {
+                aborted = jcal_sink_cstr(",", sink, d);
+            }
         }
     }
-    return 0;
+
+    if (!aborted && multi) {
+        aborted = jcal_sink_cstr("]", sink, d);
+    }
+
+    icalmemory_free_buffer(val);
+    return aborted;
 }
 
-icaltime_span icalcomponent_get_span(icalcomponent *comp)
+/* Emits the jCal value-type name followed by the value itself. */
+static int jcal_sink_value(icalvalue *value, icalcomponent_sink_func sink, void *d)
 {
-    icalcomponent *inner;
-    icalcomponent_kind kind;
-    icaltime_span span;
-    struct icaltimetype start, end;
+    struct icalvalue_impl *v = (struct icalvalue_impl *)value;
+    icalvalue_kind kind = icalvalue_isa(value);
+    const char *type;
+    char buf[64];
+
+    /* The internal combined kind resolves by what was stored */
+    if (kind == ICAL_DATETIMEDATE_VALUE) {
+        kind = v->data.v_time.is_date ? ICAL_DATE_VALUE : ICAL_DATETIME_VALUE;
+    }
+
+    /* jCal only knows the RFC 5545 value types, so the library-internal
+       kinds must map onto one of those (RFC 7265 section 3.5) */
+    switch (kind) {
+    case ICAL_METHOD_VALUE:
+    case ICAL_STATUS_VALUE:
+    case ICAL_ACTION_VALUE:
+    case ICAL_CLASS_VALUE:
+    case ICAL_TRANSP_VALUE:
+    case ICAL_BUSYTYPE_VALUE:
+    case ICAL_TASKMODE_VALUE:
+    case ICAL_POLLMODE_VALUE:
+    case ICAL_POLLCOMPLETION_VALUE:
+    case ICAL_QUERY_VALUE:
+    case ICAL_STRING_VALUE:
+    case ICAL_REQUESTSTATUS_VALUE:
+        type = "TEXT";
+        break;
+    case ICAL_GEO_VALUE:
+        type = "FLOAT";
+        break;
+    case ICAL_ATTACH_VALUE:
+        type = icalattach_get_is_url(v->data.v_attach) ? "URI" : "BINARY";
+        break;
+    case ICAL_X_VALUE:
+    case ICAL_NO_VALUE:
+        type = 0;
+        break;
+    default:
+        type = icalvalue_kind_to_string(kind);
+        break;
+    }
+
+    if (type == 0) {
+        if (jcal_sink_cstr("\"unknown\",", sink, d) != 0) {
+            return 1;
+        }
+    } else {
+        if (jcal_sink_cstr("\"", sink, d) != 0 ||
+            jcal_sink_lower(type, sink, d) != 0 || jcal_sink_cstr("\",", sink, d) != 0) {
+            return 1;
+        }
+    }
 
-    span.start = 0;
-    span.end = 0;
-    span.is_busy = 1;
+    switch (kind) {
+    case ICAL_DATE_VALUE:
+    case ICAL_DATETIME_VALUE:
+        return jcal_sink_time(v->data.v_time, sink, d);
 
-    /* initial Error checking */
-    if (comp == NULL) {
-        return span;
-    }
+    case ICAL_INTEGER_VALUE:
+        snprintf(buf, sizeof(buf), "%d", v->data.v_int);
+        return jcal_sink_cstr(buf, sink, d);
 
-    /* FIXME this might go away */
-    kind = icalcomponent_isa(comp);
-    if (kind == ICAL_VCALENDAR_COMPONENT) {
-        inner = icalcomponent_get_first_real_component(comp);
+    case ICAL_BOOLEAN_VALUE:
+        return jcal_sink_cstr(v->data.v_int ? "true" : "false", sink, d);
 
-        /* Maybe there is a VTIMEZONE in there */
-        if (inner == 0) {
-            inner = icalcomponent_get_first_component(comp, ICAL_VTIMEZONE_COMPONENT);
+    case ICAL_FLOAT_VALUE:
+        snprintf(buf, sizeof(buf), "%g", (double)v->data.v_float);
+        return jcal_sink_cstr(buf, sink, d);
+
+    case ICAL_GEO_VALUE:
+        snprintf(buf, sizeof(buf), "[%g,%g]", v->data.v_geo.lat, v->data.v_geo.lon);
+        return jcal_sink_cstr(buf, sink, d);
+
+    case ICAL_UTCOFFSET_VALUE:
+        {
+            int off = v->data.v_int;
+            int aoff = off < 0 ? -off : off;
+
+            if (aoff % 60 != 0) {
+                snprintf(buf, sizeof(buf), "\"%c%02d:%02d:%02d\"",
+                         off < 0 ? '-' : '+', aoff / 3600, (aoff % 3600) / 60, aoff % 60);
+            } else {
+                snprintf(buf, sizeof(buf), "\"%c%02d:%02d\"",
+                         off < 0 ? '-' : '+', aoff / 3600, (aoff % 3600) / 60);
+            }
+            return jcal_sink_cstr(buf, sink, d);
         }
 
-    } else {
-        inner = comp;
-    }
+    case ICAL_PERIOD_VALUE:
+        if (jcal_sink_cstr("[", sink, d) != 0 ||
+            jcal_sink_time(v->data.v_period.start, sink, d) != 0 ||
+            jcal_sink_cstr(",", sink, d) != 0) {
+            return 1;
+        }
+        if (!icaltime_is_null_time(v->data.v_period.end)) {
+            if (jcal_sink_time(v->data.v_period.end, sink, d) != 0) {
+                return 1;
+            }
+        } else {
+            char *dur = icaldurationtype_as_ical_string_r(v->data.v_period.duration);
+            int aborted = (dur == 0) || jcal_sink_json_str(dur, sink, d);
 
-    if (inner == 0) {
-        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
-        /*icalerror_warn("icalcomponent_get_span: no component specified, \
-or empty VCALENDAR component"); */
-        return span;
+            if (dur != 0) {
+                icalmemory_free_buffer(dur);
+            }
+            if (aborted) {
+                return 1;
+            }
+        }
+        return jcal_sink_cstr("]", sink, d);
+
+    case ICAL_RECUR_VALUE:
+        return jcal_sink_recur(value, sink, d);
+
+    case ICAL_REQUESTSTATUS_VALUE:
+        {
+            struct icalreqstattype rs = v->data.v_requeststatus;
+            int aborted;
+
+            snprintf(buf, sizeof(buf), "[\"%d.%d\",",
+                     icalenum_reqstat_major(rs.code), icalenum_reqstat_minor(rs.code));
+            aborted = jcal_sink_cstr(buf, sink, d) ||
+                jcal_sink_json_str(rs.desc != 0 ? rs.desc
+                                                : icalenum_reqstat_desc(rs.code), sink, d);
+            if (!aborted && rs.debug != 0) {
+                aborted = jcal_sink_cstr(",", sink, d) ||
+                    jcal_sink_json_str(rs.debug, sink, d);
+            }
+            return aborted || jcal_sink_cstr("]", sink, d);
+        }
+
+    case ICAL_TEXT_VALUE:
+    case ICAL_URI_VALUE:
+    case ICAL_CALADDRESS_VALUE:
+    case ICAL_QUERY_VALUE:
+    case ICAL_STRING_VALUE:
+        return jcal_sink_json_str(v->data.v_string != 0 ? v->data.v_string : "", sink, d);
+
+    default:
+        {
+            /* Durations, attachments, enumerated values, x-values, ...
+               are all strings in jCal; their iCalendar text form is
+               already the right spelling. */
+            char *text = icalvalue_as_ical_string_r(value);
+            int aborted = jcal_sink_json_str(text != 0 ? text : "", sink, d);
+
+            if (text != 0) {
+                icalmemory_free_buffer(text);
+            }
+            return aborted;
+        }
     }
+}
 
-    kind = icalcomponent_isa(inner);
+static int jcal_sink_property(icalproperty *prop, int *first,
+                              icalcomponent_sink_func sink, void *d)
+{
+    const char *name = icalproperty_get_property_name(prop);
+    icalparamiter pit;
+    icalparameter *param;
+    icalvalue *value;
+    int param_first = 1;
 
-    if (!(kind == ICAL_VEVENT_COMPONENT ||
-          kind == ICAL_VJOURNAL_COMPONENT ||
-          kind == ICAL_VTODO_COMPONENT || kind == ICAL_VFREEBUSY_COMPONENT)) {
-        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
-        /*icalerror_warn("icalcomponent_get_span: no component specified, \
-or empty VCALENDAR component"); */
-        return span;
+    if (name == 0 || *name == '\0') {
+        return 0;
     }
 
-    /* Get to work. starting with DTSTART */
-    start = icalcomponent_get_dtstart(comp);
-    if (icaltime_is_null_time(start)) {
-        return span;
+    if (!*first && jcal_sink_cstr(",", sink, d) != 0) {
+        return 1;
     }
-    span.start = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+    *first = 0;
 
-    /* The end time could be specified as either a DTEND or a DURATION */
-    /* icalcomponent_get_dtend takes care of these cases. */
-    end = icalcomponent_get_dtend(comp);
-    if (icaltime_is_null_time(end)) {
-        if (!icaltime_is_date(start)) {
-            /* If dtstart is a DATE-TIME and there is no DTEND nor DURATION
-               it takes no time */
-            span.start = 0;
-            return span;
-        } else {
-            end = start;
+    if (jcal_sink_cstr("[\"", sink, d) != 0 ||
+        jcal_sink_lower(name, sink, d) != 0 || jcal_sink_cstr("\",{", sink, d) != 0) {
+        return 1;
+    }
+
+    for (pit = icalproperty_begin_parameter(prop, ICAL_ANY_PARAMETER);
+         (param = icalparamiter_deref(&pit)) != 0; icalparamiter_next(&pit)) {
+        if (jcal_sink_parameter(param, &param_first, sink, d) != 0) {
+            return 1;
         }
     }
 
-    span.end = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
-    if (icaltime_is_date(start)) {
-        /* Until the end of the day */
-        span.end += 60 * 60 * 24 - 1;
+    if (jcal_sink_cstr("},", sink, d) != 0) {
+        return 1;
     }
 
-    return span;
+    value = icalproperty_get_value(prop);
+    if (value == 0) {
+        if (jcal_sink_cstr("\"unknown\",\"\"", sink, d) != 0) {
+            return 1;
+        }
+    } else if (jcal_sink_value(value, sink, d) != 0) {
+        return 1;
+    }
+
+    return jcal_sink_cstr("]", sink, d);
 }
 
-int icalproperty_recurrence_is_excluded(icalcomponent *comp,
-                                        struct icaltimetype *dtstart,
-                                        struct icaltimetype *recurtime)
+static int jcal_stream(icalcomponent *impl, icalcomponent_sink_func sink, void *d)
 {
-    icalproperty *exdate, *exrule;
-    pvl_elem property_iterator;
+    pvl_elem itr;
+    const char *kind_string = component_kind_string(impl);
+    int first;
 
-    if (comp == NULL || dtstart == NULL || recurtime == NULL || icaltime_is_null_time(*recurtime)) {
-        /* BAD DATA */
-        return 1;
+    if (kind_string == 0) {
+        return 0;
     }
 
-    property_iterator = comp->property_iterator;
-
-  /** first test against the exdate values **/
-    for (exdate = icalcomponent_get_first_property(comp, ICAL_EXDATE_PROPERTY);
-         exdate != NULL; exdate = icalcomponent_get_next_property(comp, ICAL_EXDATE_PROPERTY)) {
+    if (jcal_sink_cstr("[\"", sink, d) != 0 ||
+        jcal_sink_lower(kind_string, sink, d) != 0 || jcal_sink_cstr("\",[", sink, d) != 0) {
+        return 1;
+    }
 
-        struct icaltimetype exdatetime = icalproperty_get_datetime_with_component(exdate, comp);
+    first = 1;
+    for (itr = pvl_head(impl->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
 
-        if ((icaltime_is_date(exdatetime) &&
-             icaltime_compare_date_only(*recurtime, exdatetime) == 0) ||
-            (icaltime_compare(*recurtime, exdatetime) == 0)) {
-            /** MATCHED **/
-            comp->property_iterator = property_iterator;
+        if (p != 0 && jcal_sink_property(p, &first, sink, d) != 0) {
             return 1;
         }
     }
 
-  /** Now test against the EXRULEs **/
-    for (exrule = icalcomponent_get_first_property(comp, ICAL_EXRULE_PROPERTY);
-         exrule != NULL; exrule = icalcomponent_get_next_property(comp, ICAL_EXRULE_PROPERTY)) {
+    if (jcal_sink_cstr("],[", sink, d) != 0) {
+        return 1;
+    }
+
+    first = 1;
+    for (itr = pvl_head(impl->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent *sub = (icalcomponent *) pvl_data(itr);
+
+        if (component_kind_string(sub) == 0) {
+            continue;
+        }
+        if (!first && jcal_sink_cstr(",", sink, d) != 0) {
+            return 1;
+        }
+        first = 0;
+        if (jcal_stream(sub, sink, d) != 0) {
+            return 1;
+        }
+    }
+
+    return jcal_sink_cstr("]]", sink, d);
+}
+
+int icalcomponent_as_jcal(icalcomponent *component, icalcomponent_sink_func sink, void *d)
+{
+    icalcomponent_kind kind = icalcomponent_isa(component);
+
+    icalerror_check_arg_re((component != 0), "component", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((sink != 0), "sink", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((kind != ICAL_NO_COMPONENT), "component kind is ICAL_NO_COMPONENT",
+                           ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((component_kind_string(component) != 0),
+                           "Unknown kind of component", ICAL_BADARG_ERROR);
+
+    return jcal_stream(component, sink, d);
+}
+
+/*** Structural diff and patch ****************************************/
+
+/* Patch records address properties and subcomponents by kind and
+   0-based occurrence index in component order: '#NAME[idx]' selects
+   the idx-th property of kind NAME, '/NAME[idx]' the idx-th
+   subcomponent. */
+static int comp_patch_parse_selector(const char *sel, char *prefix,
+                                     char *name, size_t name_size, int *idx)
+{
+    const char *br;
+    size_t len;
+    int n = 0;
+
+    if (sel == 0 || (sel[0] != '#' && sel[0] != '/')) {
+        return 0;
+    }
+
+    br = strchr(sel, '[');
+    if (br == 0 || br == sel + 1) {
+        return 0;
+    }
+
+    len = (size_t)(br - (sel + 1));
+    if (len >= name_size) {
+        return 0;
+    }
+    memcpy(name, sel + 1, len);
+    name[len] = '\0';
+
+    br++;
+    if (*br < '0' || *br > '9') {
+        return 0;
+    }
+    while (*br >= '0' && *br <= '9') {
+        n = n * 10 + (*br - '0');
+        br++;
+    }
+    if (br[0] != ']' || br[1] != '\0') {
+        return 0;
+    }
+
+    *prefix = sel[0];
+    *idx = n;
+    return 1;
+}
+
+static icalproperty *comp_nth_property_of_kind(icalcomponent *c, icalproperty_kind kind, int idx)
+{
+    pvl_elem itr;
+
+    for (itr = pvl_head(c->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+
+        if (icalproperty_isa(p) == kind && idx-- == 0) {
+            return p;
+        }
+    }
+    return 0;
+}
+
+static icalcomponent *comp_nth_component_of_kind(icalcomponent *c, icalcomponent_kind kind,
+                                                 int idx)
+{
+    pvl_elem itr;
+
+    for (itr = pvl_head(c->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent *sub = (icalcomponent *) pvl_data(itr);
+
+        if (icalcomponent_isa(sub) == kind && idx-- == 0) {
+            return sub;
+        }
+    }
+    return 0;
+}
+
+static int comp_properties_equal(icalproperty *a, icalproperty *b)
+{
+    char *sa = icalproperty_as_ical_string_r(a);
+    char *sb = icalproperty_as_ical_string_r(b);
+    int eq = (sa != 0 && sb != 0 && strcmp(sa, sb) == 0);
+
+    if (sa != 0) {
+        icalmemory_free_buffer(sa);
+    }
+    if (sb != 0) {
+        icalmemory_free_buffer(sb);
+    }
+    return eq;
+}
+
+/* Clones @p prop as a patch record; idx >= 0 marks it as a replacement
+   of the idx-th occurrence via an X-PATCH-INDEX parameter, idx < 0
+   means append. Returns NULL on allocation failure. */
+static icalproperty *comp_patch_record(icalproperty *prop, int idx)
+{
+    icalproperty *clone = icalproperty_clone(prop);
+
+    if (clone == 0) {
+        return 0;
+    }
+
+    if (idx >= 0) {
+        char numbuf[16];
+        icalparameter *param = icalparameter_new(ICAL_X_PARAMETER);
+
+        if (param == 0) {
+            icalproperty_free(clone);
+            return 0;
+        }
+        icalparameter_set_xname(param, "X-PATCH-INDEX");
+        snprintf(numbuf, sizeof(numbuf), "%d", idx);
+        icalparameter_set_xvalue(param, numbuf);
+        icalproperty_add_parameter(clone, param);
+    }
+
+    return clone;
+}
+
+/* Largest number of distinct kinds a component can carry; bounded by
+   the size of the kind enumerations. */
+#define COMP_DIFF_MAX_KINDS 256
+
+struct comp_diff_kinds
+{
+    int kinds[COMP_DIFF_MAX_KINDS];
+    int count;
+};
+
+static void comp_diff_note_kind(struct comp_diff_kinds *set, int kind)
+{
+    int i;
+
+    for (i = 0; i < set->count; i++) {
+        if (set->kinds[i] == kind) {
+            return;
+        }
+    }
+    if (set->count < COMP_DIFF_MAX_KINDS) {
+        set->kinds[set->count++] = kind;
+    }
+}
+
+/* Appends the records describing old->new to @p patch. Returns the
+   number of records added, or -1 on allocation failure. */
+static int comp_diff_into(icalcomponent *oldc, icalcomponent *newc, icalcomponent *patch)
+{
+    struct comp_diff_kinds kinds;
+    pvl_elem itr;
+    char sel[96];
+    int records = 0;
+    int k, i;
+
+    /* Properties, keyed by kind + occurrence index */
+    kinds.count = 0;
+    for (itr = pvl_head(oldc->properties); itr != 0; itr = pvl_next(itr)) {
+        comp_diff_note_kind(&kinds, (int)icalproperty_isa((icalproperty *) pvl_data(itr)));
+    }
+    for (itr = pvl_head(newc->properties); itr != 0; itr = pvl_next(itr)) {
+        comp_diff_note_kind(&kinds, (int)icalproperty_isa((icalproperty *) pvl_data(itr)));
+    }
+
+    for (k = 0; k < kinds.count; k++) {
+        icalproperty_kind pk = (icalproperty_kind) kinds.kinds[k];
+        int co = icalcomponent_count_properties(oldc, pk);
+        int cn = icalcomponent_count_properties(newc, pk);
+        int common = co < cn ? co : cn;
+
+        for (i = 0; i < common; i++) {
+            icalproperty *po = comp_nth_property_of_kind(oldc, pk, i);
+            icalproperty *pn = comp_nth_property_of_kind(newc, pk, i);
+
+            if (!comp_properties_equal(po, pn)) {
+                icalproperty *rec = comp_patch_record(pn, i);
+
+                if (rec == 0) {
+                    return -1;
+                }
+                icalcomponent_add_property(patch, rec);
+                records++;
+            }
+        }
+
+        /* Deletions in descending index order so earlier indexes stay
+           valid while the patch is applied */
+        for (i = co - 1; i >= cn; i--) {
+            snprintf(sel, sizeof(sel), "#%s[%d]", icalproperty_kind_to_string(pk), i);
+            icalcomponent_add_property(patch, icalproperty_new_patchdelete(sel));
+            records++;
+        }
+
+        for (i = co; i < cn; i++) {
+            icalproperty *rec = comp_patch_record(comp_nth_property_of_kind(newc, pk, i), -1);
+
+            if (rec == 0) {
+                return -1;
+            }
+            icalcomponent_add_property(patch, rec);
+            records++;
+        }
+    }
+
+    /* Subcomponents, matched pairwise by kind + occurrence index */
+    kinds.count = 0;
+    for (itr = pvl_head(oldc->components); itr != 0; itr = pvl_next(itr)) {
+        comp_diff_note_kind(&kinds, (int)icalcomponent_isa((icalcomponent *) pvl_data(itr)));
+    }
+    for (itr = pvl_head(newc->components); itr != 0; itr = pvl_next(itr)) {
+        comp_diff_note_kind(&kinds, (int)icalcomponent_isa((icalcomponent *) pvl_data(itr)));
+    }
+
+    for (k = 0; k < kinds.count; k++) {
+        icalcomponent_kind ck = (icalcomponent_kind) kinds.kinds[k];
+        int co = icalcomponent_count_components(oldc, ck);
+        int cn = icalcomponent_count_components(newc, ck);
+        int common = co < cn ? co : cn;
+
+        for (i = 0; i < common; i++) {
+            icalcomponent *so = comp_nth_component_of_kind(oldc, ck, i);
+            icalcomponent *sn = comp_nth_component_of_kind(newc, ck, i);
+            icalcomponent *sub_patch = icalcomponent_new(ICAL_XPATCH_COMPONENT);
+            int sub_records;
+
+            if (sub_patch == 0) {
+                return -1;
+            }
+
+            snprintf(sel, sizeof(sel), "/%s[%d]", icalcomponent_kind_to_string(ck), i);
+            icalcomponent_add_property(sub_patch, icalproperty_new_patchtarget(sel));
+
+            sub_records = comp_diff_into(so, sn, sub_patch);
+            if (sub_records < 0) {
+                icalcomponent_free(sub_patch);
+                return -1;
+            }
+            if (sub_records == 0) {
+                icalcomponent_free(sub_patch);
+            } else {
+                icalcomponent_add_component(patch, sub_patch);
+                records++;
+            }
+        }
+
+        for (i = co - 1; i >= cn; i--) {
+            snprintf(sel, sizeof(sel), "/%s[%d]", icalcomponent_kind_to_string(ck), i);
+            icalcomponent_add_property(patch, icalproperty_new_patchdelete(sel));
+            records++;
+        }
+
+        for (i = co; i < cn; i++) {
+            icalcomponent *clone =
+                icalcomponent_clone(comp_nth_component_of_kind(newc, ck, i));
+
+            if (clone == 0) {
+                return -1;
+            }
+            icalcomponent_add_component(patch, clone);
+            records++;
+        }
+    }
+
+    return records;
+}
+
+icalcomponent *icalcomponent_diff(icalcomponent *oldc, icalcomponent *newc)
+{
+    icalcomponent *patch;
+
+    icalerror_check_arg_rz((oldc != 0), "oldc");
+    icalerror_check_arg_rz((newc != 0), "newc");
+    icalerror_check_arg_rz((icalcomponent_isa(oldc) == icalcomponent_isa(newc)),
+                           "components of the same kind");
+
+    patch = icalcomponent_new(ICAL_XPATCH_COMPONENT);
+    if (patch == 0) {
+        return 0;
+    }
+
+    if (comp_diff_into(oldc, newc, patch) < 0) {
+        icalcomponent_free(patch);
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    return patch;
+}
+
+/* Pulls the X-PATCH-INDEX parameter off a patch record, returning its
+   value or -1 when the record is a plain append. */
+static int comp_patch_take_index(icalproperty *prop)
+{
+    icalparameter *param;
+
+    for (param = icalproperty_get_first_parameter(prop, ICAL_X_PARAMETER);
+         param != 0; param = icalproperty_get_next_parameter(prop, ICAL_X_PARAMETER)) {
+        const char *name = icalparameter_get_xname(param);
+
+        if (name != 0 && strcmp(name, "X-PATCH-INDEX") == 0) {
+            const char *v = icalparameter_get_xvalue(param);
+            int idx = (v != 0) ? atoi(v) : -1;
+
+            icalproperty_remove_parameter_by_ref(prop, param);
+            return idx;
+        }
+    }
+    return -1;
+}
+
+static int comp_apply_patch_records(icalcomponent *component, icalcomponent *patch)
+{
+    pvl_elem itr;
+    char prefix;
+    char name[64];
+    int idx;
+
+    if (component->frozen) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return ICAL_USAGE_ERROR;
+    }
+
+    for (itr = pvl_head(patch->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *rec = (icalproperty *) pvl_data(itr);
+        icalproperty_kind rkind = icalproperty_isa(rec);
+
+        if (rkind == ICAL_PATCHTARGET_PROPERTY) {
+            /* Consumed by the caller when descending */
+            continue;
+        }
+
+        if (rkind == ICAL_PATCHDELETE_PROPERTY) {
+            if (!comp_patch_parse_selector(icalproperty_get_patchdelete(rec),
+                                           &prefix, name, sizeof(name), &idx)) {
+                icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+                return ICAL_MALFORMEDDATA_ERROR;
+            }
+
+            if (prefix == '#') {
+                icalproperty *victim =
+                    comp_nth_property_of_kind(component,
+                                              icalproperty_string_to_kind(name), idx);
+
+                if (victim == 0) {
+                    icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+                    return ICAL_MALFORMEDDATA_ERROR;
+                }
+                icalcomponent_remove_property(component, victim);
+                icalproperty_free(victim);
+            } else {
+                icalcomponent *victim =
+                    comp_nth_component_of_kind(component,
+                                               icalcomponent_string_to_kind(name), idx);
+
+                if (victim == 0) {
+                    icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+                    return ICAL_MALFORMEDDATA_ERROR;
+                }
+                icalcomponent_remove_component(component, victim);
+                icalcomponent_free(victim);
+            }
+            continue;
+        }
+
+        {
+            icalproperty *clone = icalproperty_clone(rec);
+
+            if (clone == 0) {
+                icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+                return ICAL_NEWFAILED_ERROR;
+            }
+
+            idx = comp_patch_take_index(clone);
+            if (idx >= 0) {
+                /* Replace in place so the property keeps its position */
+                pvl_elem e;
+                int n = idx;
+
+                for (e = pvl_head(component->properties); e != 0; e = pvl_next(e)) {
+                    icalproperty *p = (icalproperty *) pvl_data(e);
+
+                    if (icalproperty_isa(p) == icalproperty_isa(clone) && n-- == 0) {
+                        break;
+                    }
+                }
+
+                if (e != 0) {
+                    icalproperty *oldp = (icalproperty *) pvl_data(e);
+
+                    e->d = clone;
+                    icalproperty_set_parent(clone, component);
+                    icalproperty_set_parent(oldp, 0);
+                    icalproperty_free(oldp);
+                    icalcomponent_touch(component);
+                    continue;
+                }
+            }
+
+            icalcomponent_add_property(component, clone);
+        }
+    }
+
+    for (itr = pvl_head(patch->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent *sub = (icalcomponent *) pvl_data(itr);
+
+        if (icalcomponent_isa(sub) == ICAL_XPATCH_COMPONENT) {
+            icalproperty *target =
+                icalcomponent_get_first_property(sub, ICAL_PATCHTARGET_PROPERTY);
+            icalcomponent *victim;
+            int rc;
+
+            if (target == 0 ||
+                !comp_patch_parse_selector(icalproperty_get_patchtarget(target),
+                                           &prefix, name, sizeof(name), &idx) ||
+                prefix != '/') {
+                icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+                return ICAL_MALFORMEDDATA_ERROR;
+            }
+
+            victim = comp_nth_component_of_kind(component,
+                                                icalcomponent_string_to_kind(name), idx);
+            if (victim == 0) {
+                icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+                return ICAL_MALFORMEDDATA_ERROR;
+            }
+
+            rc = comp_apply_patch_records(victim, sub);
+            if (rc != 0) {
+                return rc;
+            }
+        } else {
+            icalcomponent *clone = icalcomponent_clone(sub);
+
+            if (clone == 0) {
+                icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+                return ICAL_NEWFAILED_ERROR;
+            }
+            icalcomponent_add_component(component, clone);
+        }
+    }
+
+    return 0;
+}
+
+int icalcomponent_apply_patch(icalcomponent *component, icalcomponent *patch)
+{
+    icalerror_check_arg_re((component != 0), "component", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((patch != 0), "patch", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((icalcomponent_isa(patch) == ICAL_XPATCH_COMPONENT),
+                           "patch is an XPATCH component", ICAL_BADARG_ERROR);
+
+    return comp_apply_patch_records(component, patch);
+}
+
+/*** Canonical hashing and equality ***********************************/
+
+#define COMP_HASH_FNV_INIT 1469598103934665603ULL
+#define COMP_HASH_FNV_PRIME 1099511628211ULL
+
+static unsigned long long comp_hash_str(unsigned long long h, const char *s)
+{
+    for (; *s != '\0'; s++) {
+        h = (h ^ (unsigned char)*s) * COMP_HASH_FNV_PRIME;
+    }
+    return h;
+}
+
+/* Finalizing mix so that structurally different inputs with equal
+   intermediate digests do not collide when summed commutatively */
+static unsigned long long comp_hash_mix(unsigned long long h)
+{
+    h ^= h >> 30;
+    h *= 13787848793156543929ULL;
+    h ^= h >> 27;
+    h *= 10723151780598845931ULL;
+    h ^= h >> 31;
+    return h;
+}
+
+/* Digest over the component's own properties, order-insensitive: each
+   property hashes to a value independently and the values are summed.
+   Cached against property_generation; every property mutation funnels
+   through add/remove or icalcomponent_touch() and so moves the
+   counter. */
+static unsigned long long comp_hash_own_properties(icalcomponent *comp)
+{
+    pvl_elem itr;
+    unsigned long long sum;
+
+    if (comp->prop_hash_valid && comp->prop_hash_generation == comp->property_generation) {
+        return comp->prop_hash;
+    }
+
+    sum = 0;
+    for (itr = pvl_head(comp->properties); itr != 0; itr = pvl_next(itr)) {
+        char *text = icalproperty_as_ical_string_r((icalproperty *) pvl_data(itr));
+
+        if (text != 0) {
+            sum += comp_hash_mix(comp_hash_str(COMP_HASH_FNV_INIT, text));
+            icalmemory_free_buffer(text);
+        }
+    }
+
+    if (!comp->frozen) {
+        comp->prop_hash = sum;
+        comp->prop_hash_generation = comp->property_generation;
+        comp->prop_hash_valid = 1;
+    }
+
+    return sum;
+}
+
+unsigned long long icalcomponent_hash(icalcomponent *component)
+{
+    pvl_elem itr;
+    unsigned long long h;
+
+    icalerror_check_arg_rz((component != 0), "component");
+
+    h = comp_hash_mix(COMP_HASH_FNV_INIT ^ (unsigned long long)component->kind);
+    h ^= comp_hash_own_properties(component);
+
+    for (itr = pvl_head(component->components); itr != 0; itr = pvl_next(itr)) {
+        h += comp_hash_mix(icalcomponent_hash((icalcomponent *) pvl_data(itr)));
+    }
+
+    return h;
+}
+
+static int comp_equal_impl(icalcomponent *a, icalcomponent *b);
+
+/* Multiset comparison of two pvl lists, where is_prop selects between
+   property-text and recursive component equality. Runs only on pairs
+   the hashes could not separate. */
+static int comp_lists_equal(pvl_list la, pvl_list lb, int is_prop)
+{
+    pvl_elem ia, ib;
+    size_t count = 0, i;
+    unsigned char *used;
+    int equal = 1;
+
+    for (ia = pvl_head(la), ib = pvl_head(lb); ia != 0 && ib != 0;
+         ia = pvl_next(ia), ib = pvl_next(ib)) {
+        count++;
+    }
+    if (ia != 0 || ib != 0) {
+        return 0;
+    }
+    if (count == 0) {
+        return 1;
+    }
+
+    used = (unsigned char *)icalmemory_new_buffer(count);
+    if (used == 0) {
+        return 0;
+    }
+    memset(used, 0, count);
+
+    for (ia = pvl_head(la); ia != 0 && equal; ia = pvl_next(ia)) {
+        int matched = 0;
+
+        for (ib = pvl_head(lb), i = 0; ib != 0; ib = pvl_next(ib), i++) {
+            if (used[i]) {
+                continue;
+            }
+            if (is_prop) {
+                if (comp_properties_equal((icalproperty *) pvl_data(ia),
+                                          (icalproperty *) pvl_data(ib))) {
+                    matched = 1;
+                }
+            } else if (comp_equal_impl((icalcomponent *) pvl_data(ia),
+                                       (icalcomponent *) pvl_data(ib))) {
+                matched = 1;
+            }
+            if (matched) {
+                used[i] = 1;
+                break;
+            }
+        }
+        if (!matched) {
+            equal = 0;
+        }
+    }
+
+    icalmemory_free_buffer(used);
+    return equal;
+}
+
+static int comp_equal_impl(icalcomponent *a, icalcomponent *b)
+{
+    if (a == b) {
+        return 1;
+    }
+    if (a->kind != b->kind) {
+        return 0;
+    }
+    if (icalcomponent_hash(a) != icalcomponent_hash(b)) {
+        return 0;
+    }
+
+    return comp_lists_equal(a->properties, b->properties, 1) &&
+        comp_lists_equal(a->components, b->components, 0);
+}
+
+int icalcomponent_equal(icalcomponent *a, icalcomponent *b)
+{
+    icalerror_check_arg_rz((a != 0), "a");
+    icalerror_check_arg_rz((b != 0), "b");
+
+    return comp_equal_impl(a, b);
+}
+
+int icalcomponent_is_valid(icalcomponent *component)
+{
+    if ((strcmp(component->id, "comp") == 0) && component->kind != ICAL_NO_COMPONENT) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+icalcomponent_kind icalcomponent_isa(const icalcomponent *component)
+{
+    icalerror_check_arg_rx((component != 0), "component", ICAL_NO_COMPONENT);
+
+    return component->kind;
+}
+
+int icalcomponent_isa_component(void *component)
+{
+    icalcomponent *impl = component;
+
+    icalerror_check_arg_rz((component != 0), "component");
+
+    if (strcmp(impl->id, "comp") == 0) {
+        return 1;
+    } else {
+        return 0;
+    }
+}
+
+void icalcomponent_add_property(icalcomponent *component, icalproperty *property)
+{
+    icalerror_check_arg_rv((component != 0), "component");
+    icalerror_check_arg_rv((property != 0), "property");
+
+    icalerror_assert((!icalproperty_get_parent(property)),
+                     "The property has already been added to a component. "
+                     "Remove the property with icalcomponent_remove_property "
+                     "before calling icalcomponent_add_property");
+
+    if (component->frozen) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return;
+    }
+
+    icalproperty_set_parent(property, component);
+
+    pvl_push(component->properties, property);
+    component->property_generation++;
+    icalcomponent_content_changed(component);
+}
+
+void icalcomponent_remove_property(icalcomponent *component, icalproperty *property)
+{
+    pvl_elem itr, next_itr;
+
+    icalerror_check_arg_rv((component != 0), "component");
+    icalerror_check_arg_rv((property != 0), "property");
+
+#if defined(ICAL_REMOVE_NONMEMBER_COMPONENT_IS_ERROR)
+    icalerror_assert((icalproperty_get_parent(property)),
+                     "The property is not a member of a component");
+#else
+    if (icalproperty_get_parent(property) == 0) {
+        return;
+    }
+#endif
+
+    if (component->frozen) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return;
+    }
+
+    for (itr = pvl_head(component->properties); itr != 0; itr = next_itr) {
+        next_itr = pvl_next(itr);
+
+        if (pvl_data(itr) == (void *)property) {
+
+            if (component->property_iterator == itr) {
+                component->property_iterator = pvl_next(itr);
+            }
+
+            (void)pvl_remove(component->properties, itr);
+            icalproperty_set_parent(property, 0);
+            component->property_generation++;
+            icalcomponent_content_changed(component);
+        }
+    }
+}
+
+int icalcomponent_count_properties(icalcomponent *component, icalproperty_kind kind)
+{
+    struct icalcomponent_count_cache_entry *entry;
+    int count = 0;
+    pvl_elem itr;
+
+    icalerror_check_arg_rz((component != 0), "component");
+
+    if (kind == ICAL_ANY_PROPERTY) {
+        return pvl_count(component->properties);
+    }
+
+    entry = &component->prop_count_cache[(size_t)kind % ICALCOMPONENT_KIND_CACHE_SIZE];
+    if (entry->kind == (int)kind && entry->generation == component->property_generation) {
+        return entry->count;
+    }
+
+    for (itr = pvl_head(component->properties); itr != 0; itr = pvl_next(itr)) {
+        if (kind == icalproperty_isa((icalproperty *) pvl_data(itr))) {
+            count++;
+        }
+    }
+
+    if (!component->frozen) {
+        entry->kind = (int)kind;
+        entry->count = count;
+        entry->generation = component->property_generation;
+    }
+
+    return count;
+}
+
+struct icalcomponent_uid_entry
+{
+    icalcomponent *child;
+    struct icalcomponent_uid_entry *next;
+};
+
+struct icalcomponent_uid_index
+{
+    size_t num_buckets;
+    struct icalcomponent_uid_entry **buckets;
+    unsigned int generation;
+};
+
+/**
+ * @private
+ */
+static unsigned int icalcomponent_uid_hash(const char *uid)
+{
+    unsigned int hash = 5381;
+
+    while (*uid) {
+        hash = hash * 33 + (unsigned char)*uid++;
+    }
+
+    return hash;
+}
+
+/**
+ * @private
+ *
+ * Returns the child's own UID property value, without the get_inner()
+ * indirection of icalcomponent_get_uid().
+ */
+static const char *icalcomponent_child_uid(icalcomponent *child)
+{
+    pvl_elem itr;
+
+    /* Scan the list directly rather than through
+       icalcomponent_get_first_property(), so UID lookups do not disturb
+       the child's property iterator and stay safe on frozen trees. */
+    for (itr = pvl_head(child->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+
+        if (icalproperty_isa(p) == ICAL_UID_PROPERTY) {
+            return icalproperty_get_uid(p);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @private
+ */
+static void icalcomponent_uid_index_free(struct icalcomponent_uid_index *index)
+{
+    size_t i;
+
+    if (index == 0) {
+        return;
+    }
+
+    for (i = 0; i < index->num_buckets; i++) {
+        struct icalcomponent_uid_entry *entry = index->buckets[i];
+
+        while (entry != 0) {
+            struct icalcomponent_uid_entry *next = entry->next;
+
+            icalmemory_pool_free(entry, sizeof(struct icalcomponent_uid_entry));
+            entry = next;
+        }
+    }
+    icalmemory_free_buffer(index->buckets);
+    icalmemory_free_buffer(index);
+}
+
+/**
+ * @private
+ *
+ * Builds the UID index over the current child list. Children without a
+ * UID are simply not indexed.
+ */
+static struct icalcomponent_uid_index *icalcomponent_uid_index_build(icalcomponent *comp)
+{
+    struct icalcomponent_uid_index *index;
+    size_t num_buckets = 16;
+    int count = pvl_count(comp->components);
+    pvl_elem itr;
+
+    while (num_buckets < (size_t)count * 2) {
+        num_buckets *= 2;
+    }
+
+    index = (struct icalcomponent_uid_index *)
+        icalmemory_new_buffer(sizeof(struct icalcomponent_uid_index));
+    if (index == 0) {
+        return 0;
+    }
+
+    index->num_buckets = num_buckets;
+    index->buckets = (struct icalcomponent_uid_entry **)
+        icalmemory_new_buffer(num_buckets * sizeof(struct icalcomponent_uid_entry *));
+    if (index->buckets == 0) {
+        icalmemory_free_buffer(index);
+        return 0;
+    }
+    memset(index->buckets, 0, num_buckets * sizeof(struct icalcomponent_uid_entry *));
+    index->generation = comp->component_generation;
+
+    for (itr = pvl_head(comp->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent *child = (icalcomponent *) pvl_data(itr);
+        const char *uid = icalcomponent_child_uid(child);
+        struct icalcomponent_uid_entry *entry;
+        size_t bucket;
+
+        if (uid == 0) {
+            continue;
+        }
+
+        entry = (struct icalcomponent_uid_entry *)
+            icalmemory_pool_alloc(sizeof(struct icalcomponent_uid_entry));
+        if (entry == 0) {
+            icalcomponent_uid_index_free(index);
+            return 0;
+        }
+
+        bucket = icalcomponent_uid_hash(uid) % num_buckets;
+        entry->child = child;
+        entry->next = index->buckets[bucket];
+        index->buckets[bucket] = entry;
+    }
+
+    return index;
+}
+
+icalcomponent *icalcomponent_get_component_by_uid(icalcomponent *comp, const char *uid)
+{
+    struct icalcomponent_uid_entry *entry;
+    size_t bucket;
+
+    icalerror_check_arg_rz((comp != 0), "comp");
+    icalerror_check_arg_rz((uid != 0), "uid");
+
+    if (comp->uid_index != 0 && comp->uid_index->generation != comp->component_generation) {
+        icalcomponent_uid_index_free(comp->uid_index);
+        comp->uid_index = 0;
+    }
+
+    if (comp->uid_index == 0) {
+        /* A frozen component must not grow an index behind the backs of
+           concurrent readers; icalcomponent_freeze() builds it up front,
+           so this only happens if that build failed. */
+        if (!comp->frozen) {
+            comp->uid_index = icalcomponent_uid_index_build(comp);
+        }
+
+        if (comp->uid_index == 0) {
+            /* Answer with a plain scan. */
+            pvl_elem itr;
+
+            for (itr = pvl_head(comp->components); itr != 0; itr = pvl_next(itr)) {
+                icalcomponent *child = (icalcomponent *) pvl_data(itr);
+                const char *child_uid = icalcomponent_child_uid(child);
+
+                if (child_uid != 0 && strcmp(child_uid, uid) == 0) {
+                    return child;
+                }
+            }
+            return 0;
+        }
+    }
+
+    bucket = icalcomponent_uid_hash(uid) % comp->uid_index->num_buckets;
+    for (entry = comp->uid_index->buckets[bucket]; entry != 0; entry = entry->next) {
+        /* Compare against the child's live UID, so a match is always
+           genuine even if a UID was rewritten since the index was
+           built (a rewrite can cause a miss, never a wrong hit). */
+        const char *child_uid = icalcomponent_child_uid(entry->child);
+
+        if (child_uid != 0 && strcmp(child_uid, uid) == 0) {
+            return entry->child;
+        }
+    }
+
+    return 0;
+}
+
+struct icalcomponent_attendee_entry
+{
+    icalproperty *prop;
+    struct icalcomponent_attendee_entry *next;
+};
+
+struct icalcomponent_attendee_index
+{
+    size_t num_buckets;
+    struct icalcomponent_attendee_entry **buckets;
+    unsigned int generation;
+};
+
+/**
+ * @private
+ *
+ * Steps a calendar address past its mailto: scheme, if present. The
+ * rest of the address is compared case-insensitively, so
+ * "mailto:A@example.com" and "a@example.com" name the same attendee.
+ */
+static const char *icalcomponent_attendee_addr(const char *caladdress)
+{
+    if (strncasecmp(caladdress, "mailto:", 7) == 0) {
+        return caladdress + 7;
+    }
+
+    return caladdress;
+}
+
+/**
+ * @private
+ */
+static unsigned int icalcomponent_attendee_hash(const char *caladdress)
+{
+    unsigned int hash = 5381;
+    const char *p = icalcomponent_attendee_addr(caladdress);
+
+    while (*p) {
+        hash = hash * 33 + (unsigned char)tolower((unsigned char)*p);
+        p++;
+    }
+
+    return hash;
+}
+
+/**
+ * @private
+ */
+static void icalcomponent_attendee_index_free(struct icalcomponent_attendee_index *index)
+{
+    size_t i;
+
+    if (index == 0) {
+        return;
+    }
+
+    for (i = 0; i < index->num_buckets; i++) {
+        struct icalcomponent_attendee_entry *entry = index->buckets[i];
+
+        while (entry != 0) {
+            struct icalcomponent_attendee_entry *next = entry->next;
+
+            icalmemory_pool_free(entry, sizeof(struct icalcomponent_attendee_entry));
+            entry = next;
+        }
+    }
+    icalmemory_free_buffer(index->buckets);
+    icalmemory_free_buffer(index);
+}
+
+/**
+ * @private
+ *
+ * Builds the attendee index over the component's own ATTENDEE
+ * properties.
+ */
+static struct icalcomponent_attendee_index *icalcomponent_attendee_index_build(icalcomponent *comp)
+{
+    struct icalcomponent_attendee_index *index;
+    size_t num_buckets = 16;
+    int count = pvl_count(comp->properties);
+    pvl_elem itr;
+
+    while (num_buckets < (size_t)count * 2) {
+        num_buckets *= 2;
+    }
+
+    index = (struct icalcomponent_attendee_index *)
+        icalmemory_new_buffer(sizeof(struct icalcomponent_attendee_index));
+    if (index == 0) {
+        return 0;
+    }
+
+    index->num_buckets = num_buckets;
+    index->buckets = (struct icalcomponent_attendee_entry **)
+        icalmemory_new_buffer(num_buckets * sizeof(struct icalcomponent_attendee_entry *));
+    if (index->buckets == 0) {
+        icalmemory_free_buffer(index);
+        return 0;
+    }
+    memset(index->buckets, 0, num_buckets * sizeof(struct icalcomponent_attendee_entry *));
+    index->generation = comp->property_generation;
+
+    for (itr = pvl_head(comp->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+        const char *addr;
+        struct icalcomponent_attendee_entry *entry;
+        size_t bucket;
+
+        if (icalproperty_isa(p) != ICAL_ATTENDEE_PROPERTY) {
+            continue;
+        }
+
+        addr = icalproperty_get_attendee(p);
+        if (addr == 0) {
+            continue;
+        }
+
+        entry = (struct icalcomponent_attendee_entry *)
+            icalmemory_pool_alloc(sizeof(struct icalcomponent_attendee_entry));
+        if (entry == 0) {
+            icalcomponent_attendee_index_free(index);
+            return 0;
+        }
+
+        bucket = icalcomponent_attendee_hash(addr) % num_buckets;
+        entry->prop = p;
+        entry->next = index->buckets[bucket];
+        index->buckets[bucket] = entry;
+    }
+
+    return index;
+}
+
+/**
+ * @private
+ */
+static int icalcomponent_attendee_match(icalproperty *p, const char *caladdress)
+{
+    const char *addr = icalproperty_get_attendee(p);
+
+    return addr != 0 &&
+        strcasecmp(icalcomponent_attendee_addr(addr),
+                   icalcomponent_attendee_addr(caladdress)) == 0;
+}
+
+icalproperty *icalcomponent_get_attendee(icalcomponent *comp, const char *caladdress)
+{
+    icalcomponent *inner;
+    struct icalcomponent_attendee_entry *entry;
+    size_t bucket;
+
+    icalerror_check_arg_rz((comp != 0), "comp");
+    icalerror_check_arg_rz((caladdress != 0), "caladdress");
+
+    inner = icalcomponent_get_inner(comp);
+    if (inner == 0) {
+        icalerror_set_errno(ICAL_BADARG_ERROR);
+        return 0;
+    }
+
+    if (inner->attendee_index != 0 &&
+        inner->attendee_index->generation != inner->property_generation) {
+        icalcomponent_attendee_index_free(inner->attendee_index);
+        inner->attendee_index = 0;
+    }
+
+    if (inner->attendee_index == 0) {
+        /* A frozen component must not grow an index behind the backs
+           of concurrent readers. */
+        if (!inner->frozen) {
+            inner->attendee_index = icalcomponent_attendee_index_build(inner);
+        }
+
+        if (inner->attendee_index == 0) {
+            /* Answer with a plain scan. */
+            pvl_elem itr;
+
+            for (itr = pvl_head(inner->properties); itr != 0; itr = pvl_next(itr)) {
+                icalproperty *p = (icalproperty *) pvl_data(itr);
+
+                if (icalproperty_isa(p) == ICAL_ATTENDEE_PROPERTY &&
+                    icalcomponent_attendee_match(p, caladdress)) {
+                    return p;
+                }
+            }
+            return 0;
+        }
+    }
+
+    bucket = icalcomponent_attendee_hash(caladdress) % inner->attendee_index->num_buckets;
+    for (entry = inner->attendee_index->buckets[bucket]; entry != 0; entry = entry->next) {
+        /* Compare against the property's live value, so a match is
+           always genuine even if an address was rewritten since the
+           index was built (a rewrite can cause a miss, never a wrong
+           hit). */
+        if (icalcomponent_attendee_match(entry->prop, caladdress)) {
+            return entry->prop;
+        }
+    }
+
+    return 0;
+}
+
+icalproperty *icalcomponent_get_current_property(icalcomponent *component)
+{
+    icalerror_check_arg_rz((component != 0), "component");
+
+    if (component->property_iterator == 0) {
+        return 0;
+    }
+
+    return (icalproperty *) pvl_data(component->property_iterator);
+}
+
+icalproperty *icalcomponent_get_first_property(icalcomponent *c, icalproperty_kind kind)
+{
+    struct icalcomponent_kind_cache_entry *entry = 0;
+
+    icalerror_check_arg_rz((c != 0), "component");
+
+    if (kind != ICAL_ANY_PROPERTY) {
+        entry = &c->kind_cache[(size_t)kind % ICALCOMPONENT_KIND_CACHE_SIZE];
+
+        if (entry->kind == kind && entry->generation == c->property_generation) {
+            c->property_iterator = entry->elem;
+            return c->property_iterator ? (icalproperty *) pvl_data(c->property_iterator) : 0;
+        }
+    }
+
+    for (c->property_iterator = pvl_head(c->properties);
+         c->property_iterator != 0; c->property_iterator = pvl_next(c->property_iterator)) {
+
+        icalproperty *p = (icalproperty *) pvl_data(c->property_iterator);
+
+        if (icalproperty_isa(p) == kind || kind == ICAL_ANY_PROPERTY) {
+            if (entry && !c->frozen) {
+                entry->kind = kind;
+                entry->elem = c->property_iterator;
+                entry->generation = c->property_generation;
+            }
+            return p;
+        }
+    }
+
+    /* Remember the absence too; probing for properties a component does
+       not have is the common case in restriction checks. */
+    if (entry && !c->frozen) {
+        entry->kind = kind;
+        entry->elem = 0;
+        entry->generation = c->property_generation;
+    }
+    return 0;
+}
+
+icalproperty *icalcomponent_get_next_property(icalcomponent *c, icalproperty_kind kind)
+{
+    icalerror_check_arg_rz((c != 0), "component");
+
+    if (c->property_iterator == 0) {
+        return 0;
+    }
+
+    for (c->property_iterator = pvl_next(c->property_iterator);
+         c->property_iterator != 0; c->property_iterator = pvl_next(c->property_iterator)) {
+
+        icalproperty *p = (icalproperty *) pvl_data(c->property_iterator);
+
+        if (icalproperty_isa(p) == kind || kind == ICAL_ANY_PROPERTY) {
+
+            return p;
+        }
+    }
+
+    return 0;
+}
+
+icalproperty **icalcomponent_get_properties(icalcomponent *component, icalproperty_kind kind);
+
+void icalcomponent_add_component(icalcomponent *parent, icalcomponent *child)
+{
+    icalerror_check_arg_rv((parent != 0), "parent");
+    icalerror_check_arg_rv((child != 0), "child");
+
+    if (parent->frozen) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return;
+    }
+
+    if (child->parent != 0) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+    }
+
+    child->parent = parent;
+
+    /* Fix for Mozilla - bug 327602 */
+    if (child->kind != ICAL_VTIMEZONE_COMPONENT) {
+        pvl_push(parent->components, child);
+    } else {
+        /* VTIMEZONES should be first in the resulting VCALENDAR. */
+        pvl_unshift(parent->components, child);
+
+        /* Add the VTIMEZONE to our array. */
+        /* FIXME: Currently we are also creating this array when loading in
+           a builtin VTIMEZONE, when we don't need it. */
+        if (!parent->timezones)
+            parent->timezones = icaltimezone_array_new();
+
+        icaltimezone_array_append_from_vtimezone(parent->timezones, child);
+
+        /* Flag that we need to sort it before doing any binary searches. */
+        parent->timezones_sorted = 0;
+    }
+
+    parent->component_generation++;
+    icalcomponent_content_changed(parent);
+}
+
+void icalcomponent_remove_component(icalcomponent *parent, icalcomponent *child)
+{
+    pvl_elem itr, next_itr;
+
+    icalerror_check_arg_rv((parent != 0), "parent");
+    icalerror_check_arg_rv((child != 0), "child");
+
+    if (parent->frozen) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return;
+    }
+
+    /* If the component is a VTIMEZONE, remove it from our array as well. */
+    if (child->kind == ICAL_VTIMEZONE_COMPONENT) {
+        icaltimezone *zone;
+        size_t i, num_elements;
+
+        num_elements = parent->timezones ? parent->timezones->num_elements : 0;
+        for (i = 0; i < num_elements; i++) {
+            zone = icalarray_element_at(parent->timezones, i);
+            if (icaltimezone_get_component(zone) == child) {
+                icaltimezone_free(zone, 0);
+                icalarray_remove_element_at(parent->timezones, i);
+                break;
+            }
+        }
+    }
+
+    for (itr = pvl_head(parent->components); itr != 0; itr = next_itr) {
+        next_itr = pvl_next(itr);
+
+        if (pvl_data(itr) == (void *)child) {
+
+            if (parent->component_iterator == itr) {
+                /* Don't let the current iterator become invalid */
+
+                /* HACK. The semantics for this are troubling. */
+                parent->component_iterator = pvl_next(parent->component_iterator);
+            }
+            (void)pvl_remove(parent->components, itr);
+            child->parent = 0;
+            parent->component_generation++;
+            icalcomponent_content_changed(parent);
+            break;
+        }
+    }
+}
+
+int icalcomponent_count_components(icalcomponent *component, icalcomponent_kind kind)
+{
+    struct icalcomponent_count_cache_entry *entry;
+    int count = 0;
+    pvl_elem itr;
+
+    icalerror_check_arg_rz((component != 0), "component");
+
+    if (kind == ICAL_ANY_COMPONENT) {
+        return pvl_count(component->components);
+    }
+
+    entry = &component->comp_count_cache[(size_t)kind % ICALCOMPONENT_KIND_CACHE_SIZE];
+    if (entry->kind == (int)kind && entry->generation == component->component_generation) {
+        return entry->count;
+    }
+
+    for (itr = pvl_head(component->components); itr != 0; itr = pvl_next(itr)) {
+        if (kind == icalcomponent_isa((icalcomponent *) pvl_data(itr))) {
+            count++;
+        }
+    }
+
+    if (!component->frozen) {
+        entry->kind = (int)kind;
+        entry->count = count;
+        entry->generation = component->component_generation;
+    }
+
+    return count;
+}
+
+icalcomponent *icalcomponent_get_current_component(icalcomponent *component)
+{
+    icalerror_check_arg_rz((component != 0), "component");
+
+    if (component->component_iterator == 0) {
+        return 0;
+    }
+
+    return (icalcomponent *) pvl_data(component->component_iterator);
+}
+
+icalcomponent *icalcomponent_get_first_component(icalcomponent *c, icalcomponent_kind kind)
+{
+    icalerror_check_arg_rz((c != 0), "component");
+
+    for (c->component_iterator = pvl_head(c->components);
+         c->component_iterator != 0; c->component_iterator = pvl_next(c->component_iterator)) {
+
+        icalcomponent *p = (icalcomponent *) pvl_data(c->component_iterator);
+
+        if (icalcomponent_isa(p) == kind || kind == ICAL_ANY_COMPONENT) {
+
+            return p;
+        }
+    }
+
+    return 0;
+}
+
+icalcomponent *icalcomponent_get_next_component(icalcomponent *c, icalcomponent_kind kind)
+{
+    icalerror_check_arg_rz((c != 0), "component");
+
+    if (c->component_iterator == 0) {
+        return 0;
+    }
+
+    for (c->component_iterator = pvl_next(c->component_iterator);
+         c->component_iterator != 0; c->component_iterator = pvl_next(c->component_iterator)) {
+
+        icalcomponent *p = (icalcomponent *) pvl_data(c->component_iterator);
+
+        if (icalcomponent_isa(p) == kind || kind == ICAL_ANY_COMPONENT) {
+
+            return p;
+        }
+    }
+
+    return 0;
+}
+
+icalcomponent *icalcomponent_get_first_real_component(icalcomponent *c)
+{
+    icalcomponent *comp;
+
+    for (comp = icalcomponent_get_first_component(c, ICAL_ANY_COMPONENT);
+         comp != 0; comp = icalcomponent_get_next_component(c, ICAL_ANY_COMPONENT)) {
+
+        icalcomponent_kind kind = icalcomponent_isa(comp);
+
+        if (kind == ICAL_VEVENT_COMPONENT ||
+            kind == ICAL_VTODO_COMPONENT ||
+            kind == ICAL_VJOURNAL_COMPONENT ||
+            kind == ICAL_VFREEBUSY_COMPONENT ||
+            kind == ICAL_VAVAILABILITY_COMPONENT ||
+            kind == ICAL_VPOLL_COMPONENT ||
+            kind == ICAL_VPATCH_COMPONENT ||
+            kind == ICAL_VQUERY_COMPONENT || kind == ICAL_VAGENDA_COMPONENT) {
+            return comp;
+        }
+    }
+    return 0;
+}
+
+static icaltime_span icalcomponent_compute_span(icalcomponent *comp)
+{
+    icalcomponent *inner;
+    icalcomponent_kind kind;
+    icaltime_span span;
+    struct icaltimetype start, end;
+
+    span.start = 0;
+    span.end = 0;
+    span.is_busy = 1;
+
+    /* FIXME this might go away */
+    kind = icalcomponent_isa(comp);
+    if (kind == ICAL_VCALENDAR_COMPONENT) {
+        inner = icalcomponent_get_first_real_component(comp);
+
+        /* Maybe there is a VTIMEZONE in there */
+        if (inner == 0) {
+            inner = icalcomponent_get_first_component(comp, ICAL_VTIMEZONE_COMPONENT);
+        }
+
+    } else {
+        inner = comp;
+    }
+
+    if (inner == 0) {
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        /*icalerror_warn("icalcomponent_get_span: no component specified, \
+or empty VCALENDAR component"); */
+        return span;
+    }
+
+    kind = icalcomponent_isa(inner);
+
+    if (!(kind == ICAL_VEVENT_COMPONENT ||
+          kind == ICAL_VJOURNAL_COMPONENT ||
+          kind == ICAL_VTODO_COMPONENT || kind == ICAL_VFREEBUSY_COMPONENT)) {
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        /*icalerror_warn("icalcomponent_get_span: no component specified, \
+or empty VCALENDAR component"); */
+        return span;
+    }
+
+    /* Get to work. starting with DTSTART */
+    start = icalcomponent_get_dtstart(comp);
+    if (icaltime_is_null_time(start)) {
+        return span;
+    }
+    span.start = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+
+    /* The end time could be specified as either a DTEND or a DURATION */
+    /* icalcomponent_get_dtend takes care of these cases. */
+    end = icalcomponent_get_dtend(comp);
+    if (icaltime_is_null_time(end)) {
+        if (!icaltime_is_date(start)) {
+            /* If dtstart is a DATE-TIME and there is no DTEND nor DURATION
+               it takes no time */
+            span.start = 0;
+            return span;
+        } else {
+            end = start;
+        }
+    }
+
+    span.end = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
+    if (icaltime_is_date(start)) {
+        /* Until the end of the day */
+        span.end += 60 * 60 * 24 - 1;
+    }
+
+    return span;
+}
+
+icaltime_span icalcomponent_get_span(icalcomponent *comp)
+{
+    icaltime_span span;
+
+    if (comp == NULL) {
+        span.start = 0;
+        span.end = 0;
+        span.is_busy = 1;
+        return span;
+    }
+
+    /* The timezone resolution and mktime-style math below are costly
+       enough to show up when an indexer asks for the span of every
+       event on every pass, so memoize per component */
+    if (comp->span_cache_valid &&
+        comp->span_cache_generation == comp->content_generation) {
+        return comp->span_cache;
+    }
+
+    span = icalcomponent_compute_span(comp);
+
+    if (!comp->frozen) {
+        comp->span_cache = span;
+        comp->span_cache_generation = comp->content_generation;
+        comp->span_cache_valid = 1;
+    }
+
+    return span;
+}
+
+icaltime_span *icalcomponent_get_spans_array(icalcomponent *comp, int *count)
+{
+    icaltime_span *spans;
+    icalcomponent *child;
+    int n = 0;
+
+    if (count != 0) {
+        *count = 0;
+    }
+
+    icalerror_check_arg_rz((comp != 0), "comp");
+    icalerror_check_arg_rz((count != 0), "count");
+
+    for (child = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         child != 0;
+         child = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        n++;
+    }
+
+    if (n == 0) {
+        return 0;
+    }
+
+    spans = (icaltime_span *)icalmemory_new_buffer((size_t)n * sizeof(icaltime_span));
+    if (spans == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    n = 0;
+    for (child = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         child != 0;
+         child = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        icalcomponent_kind kind = icalcomponent_isa(child);
+
+        if (kind == ICAL_VEVENT_COMPONENT ||
+            kind == ICAL_VJOURNAL_COMPONENT ||
+            kind == ICAL_VTODO_COMPONENT || kind == ICAL_VFREEBUSY_COMPONENT) {
+            spans[n++] = icalcomponent_get_span(child);
+        }
+    }
+
+    *count = n;
+
+    if (n == 0) {
+        icalmemory_free_buffer(spans);
+        return 0;
+    }
+
+    return spans;
+}
+
+int icalproperty_recurrence_is_excluded(icalcomponent *comp,
+                                        struct icaltimetype *dtstart,
+                                        struct icaltimetype *recurtime)
+{
+    icalproperty *exdate, *exrule;
+    pvl_elem property_iterator;
+
+    if (comp == NULL || dtstart == NULL || recurtime == NULL || icaltime_is_null_time(*recurtime)) {
+        /* BAD DATA */
+        return 1;
+    }
+
+    property_iterator = comp->property_iterator;
+
+  /** first test against the exdate values **/
+    for (exdate = icalcomponent_get_first_property(comp, ICAL_EXDATE_PROPERTY);
+         exdate != NULL; exdate = icalcomponent_get_next_property(comp, ICAL_EXDATE_PROPERTY)) {
+
+        struct icaltimetype exdatetime = icalproperty_get_datetime_with_component(exdate, comp);
+
+        if ((icaltime_is_date(exdatetime) &&
+             icaltime_compare_date_only(*recurtime, exdatetime) == 0) ||
+            (icaltime_compare(*recurtime, exdatetime) == 0)) {
+            /** MATCHED **/
+            comp->property_iterator = property_iterator;
+            return 1;
+        }
+    }
+
+  /** Now test against the EXRULEs **/
+    for (exrule = icalcomponent_get_first_property(comp, ICAL_EXRULE_PROPERTY);
+         exrule != NULL; exrule = icalcomponent_get_next_property(comp, ICAL_EXRULE_PROPERTY)) {
+
+        struct icalrecurrencetype recur = icalproperty_get_exrule(exrule);
+        icalrecur_iterator *exrule_itr = icalrecur_iterator_new(recur, *dtstart);
+        struct icaltimetype exrule_time;
+
+        while (exrule_itr) {
+            int result;
+
+            exrule_time = icalrecur_iterator_next(exrule_itr);
+
+            if (icaltime_is_null_time(exrule_time))
+                break;
+
+            result = icaltime_compare(*recurtime, exrule_time);
+            if (result == 0) {
+                icalrecur_iterator_free(exrule_itr);
+                comp->property_iterator = property_iterator;
+                return 1;
+                  /** MATCH **/
+            }
+            if (result == 1)
+                break;
+                  /** exrule_time > recurtime **/
+        }
+
+        icalrecur_iterator_free(exrule_itr);
+    }
+    comp->property_iterator = property_iterator;
+
+    return 0; /* no matches */
+}
+
+/**
+ * @brief Returns the busy status based on the TRANSP property.
+ *
+ * @param comp   A valid icalcomponent.
+ *
+ * @return 1 if the event is a busy item, 0 if it is not.
+ */
+static int icalcomponent_is_busy(icalcomponent *comp)
+{
+    icalproperty *transp;
+    enum icalproperty_status status;
+    int ret = 1;
+
+  /** @todo check access control here, converting busy->free if the
+     permissions do not allow access... */
+
+    /* Is this a busy time?  Check the TRANSP property */
+    transp = icalcomponent_get_first_property(comp, ICAL_TRANSP_PROPERTY);
+
+    if (transp) {
+        icalvalue *transp_val = icalproperty_get_value(transp);
+
+        switch (icalvalue_get_transp(transp_val)) {
+        case ICAL_TRANSP_OPAQUE:
+        case ICAL_TRANSP_OPAQUENOCONFLICT:
+        case ICAL_TRANSP_NONE:
+            ret = 1;
+            break;
+        case ICAL_TRANSP_TRANSPARENT:
+        case ICAL_TRANSP_TRANSPARENTNOCONFLICT:
+            ret = 0;
+            break;
+        default:
+            ret = 0;
+            break;
+        }
+    }
+    status = icalcomponent_get_status(comp);
+    if (ret && status) {
+        switch (status) {
+        case ICAL_STATUS_CANCELLED:
+        case ICAL_STATUS_TENTATIVE:
+            ret = 0;
+            break;
+        default:
+            break;
+        }
+    }
+    return (ret);
+}
+
+/* One candidate occurrence in the merged RRULE/RDATE stream */
+struct icalcomponent_occurrence
+{
+    time_t start;
+    struct icaltimetype time;
+};
+
+static int occurrence_compare(const void *a, const void *b)
+{
+    time_t sa = ((const struct icalcomponent_occurrence *)a)->start;
+    time_t sb = ((const struct icalcomponent_occurrence *)b)->start;
+
+    return (sa > sb) - (sa < sb);
+}
+
+static int timet_compare(const void *a, const void *b)
+{
+    time_t ta = *(const time_t *)a;
+    time_t tb = *(const time_t *)b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+static int long_compare(const void *a, const void *b)
+{
+    long la = *(const long *)a;
+    long lb = *(const long *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+/* EXDATEs of a component, collected once and sorted so each candidate
+   occurrence is checked by binary search instead of a property scan */
+struct icalcomponent_exdates
+{
+    time_t *times;  /* DATE-TIME exclusions as instants */
+    long *dates;    /* DATE exclusions as UTC yyyymmdd keys */
+    size_t time_count;
+    size_t date_count;
+    int have_exrule;
+};
+
+static long utc_date_key(struct icaltimetype tt)
+{
+    tt = icaltime_convert_to_zone(tt, icaltimezone_get_utc_timezone());
+    return (long)tt.year * 10000L + tt.month * 100L + tt.day;
+}
+
+static void exdates_collect(icalcomponent *comp, struct icalcomponent_exdates *ex)
+{
+    icalproperty *exdate;
+    size_t capacity = 0;
+
+    memset(ex, 0, sizeof(*ex));
+
+    for (exdate = icalcomponent_get_first_property(comp, ICAL_EXDATE_PROPERTY);
+         exdate != NULL; exdate = icalcomponent_get_next_property(comp, ICAL_EXDATE_PROPERTY)) {
+        capacity++;
+    }
+
+    ex->have_exrule =
+        (icalcomponent_get_first_property(comp, ICAL_EXRULE_PROPERTY) != NULL);
+
+    if (capacity == 0) {
+        return;
+    }
+
+    ex->times = (time_t *) icalmemory_new_buffer(capacity * sizeof(time_t));
+    ex->dates = (long *)icalmemory_new_buffer(capacity * sizeof(long));
+
+    for (exdate = icalcomponent_get_first_property(comp, ICAL_EXDATE_PROPERTY);
+         exdate != NULL; exdate = icalcomponent_get_next_property(comp, ICAL_EXDATE_PROPERTY)) {
+
+        struct icaltimetype exdatetime =
+            icalproperty_get_datetime_with_component(exdate, comp);
+
+        if (icaltime_is_null_time(exdatetime)) {
+            continue;
+        }
+
+        if (icaltime_is_date(exdatetime)) {
+            ex->dates[ex->date_count++] = utc_date_key(exdatetime);
+        } else {
+            ex->times[ex->time_count++] =
+                icaltime_as_timet_with_zone(exdatetime,
+                                            exdatetime.zone ? exdatetime.zone :
+                                            icaltimezone_get_utc_timezone());
+        }
+    }
+
+    qsort(ex->times, ex->time_count, sizeof(time_t), timet_compare);
+    qsort(ex->dates, ex->date_count, sizeof(long), long_compare);
+}
+
+static void exdates_free(struct icalcomponent_exdates *ex)
+{
+    icalmemory_free_buffer(ex->times);
+    icalmemory_free_buffer(ex->dates);
+}
+
+/* Walks the EXRULEs the way icalproperty_recurrence_is_excluded() does;
+   only called when the component actually carries EXRULE properties */
+static int exrule_excludes(icalcomponent *comp, struct icaltimetype *dtstart,
+                           struct icaltimetype recurtime)
+{
+    icalproperty *exrule;
+    pvl_elem property_iterator = comp->property_iterator;
+
+    for (exrule = icalcomponent_get_first_property(comp, ICAL_EXRULE_PROPERTY);
+         exrule != NULL; exrule = icalcomponent_get_next_property(comp, ICAL_EXRULE_PROPERTY)) {
 
         struct icalrecurrencetype recur = icalproperty_get_exrule(exrule);
         icalrecur_iterator *exrule_itr = icalrecur_iterator_new(recur, *dtstart);
@@ -734,74 +3213,45 @@ int icalproperty_recurrence_is_excluded(icalcomponent *comp,
             if (icaltime_is_null_time(exrule_time))
                 break;
 
-            result = icaltime_compare(*recurtime, exrule_time);
+            result = icaltime_compare(recurtime, exrule_time);
             if (result == 0) {
                 icalrecur_iterator_free(exrule_itr);
                 comp->property_iterator = property_iterator;
                 return 1;
-                  /** MATCH **/
             }
             if (result == 1)
                 break;
-                  /** exrule_time > recurtime **/
         }
 
         icalrecur_iterator_free(exrule_itr);
     }
     comp->property_iterator = property_iterator;
 
-    return 0; /* no matches */
+    return 0;
 }
 
-/**
- * @brief Returns the busy status based on the TRANSP property.
- *
- * @param comp   A valid icalcomponent.
- *
- * @return 1 if the event is a busy item, 0 if it is not.
- */
-static int icalcomponent_is_busy(icalcomponent *comp)
+static int occurrence_is_excluded(icalcomponent *comp, struct icaltimetype *dtstart,
+                                  const struct icalcomponent_exdates *ex,
+                                  struct icaltimetype recurtime, time_t start)
 {
-    icalproperty *transp;
-    enum icalproperty_status status;
-    int ret = 1;
-
-  /** @todo check access control here, converting busy->free if the
-     permissions do not allow access... */
-
-    /* Is this a busy time?  Check the TRANSP property */
-    transp = icalcomponent_get_first_property(comp, ICAL_TRANSP_PROPERTY);
+    if (ex->time_count > 0 &&
+        bsearch(&start, ex->times, ex->time_count, sizeof(time_t), timet_compare) != NULL) {
+        return 1;
+    }
 
-    if (transp) {
-        icalvalue *transp_val = icalproperty_get_value(transp);
+    if (ex->date_count > 0) {
+        long key = utc_date_key(recurtime);
 
-        switch (icalvalue_get_transp(transp_val)) {
-        case ICAL_TRANSP_OPAQUE:
-        case ICAL_TRANSP_OPAQUENOCONFLICT:
-        case ICAL_TRANSP_NONE:
-            ret = 1;
-            break;
-        case ICAL_TRANSP_TRANSPARENT:
-        case ICAL_TRANSP_TRANSPARENTNOCONFLICT:
-            ret = 0;
-            break;
-        default:
-            ret = 0;
-            break;
+        if (bsearch(&key, ex->dates, ex->date_count, sizeof(long), long_compare) != NULL) {
+            return 1;
         }
     }
-    status = icalcomponent_get_status(comp);
-    if (ret && status) {
-        switch (status) {
-        case ICAL_STATUS_CANCELLED:
-        case ICAL_STATUS_TENTATIVE:
-            ret = 0;
-            break;
-        default:
-            break;
-        }
+
+    if (ex->have_exrule) {
+        return exrule_excludes(comp, dtstart, recurtime);
     }
-    return (ret);
+
+    return 0;
 }
 
 void icalcomponent_foreach_recurrence(icalcomponent *comp,
@@ -816,7 +3266,10 @@ void icalcomponent_foreach_recurrence(icalcomponent *comp,
     time_t limit_start, limit_end;
     time_t dtduration;
     icalproperty *rrule, *rdate;
-    pvl_elem property_iterator; /* for saving the iterator */
+    struct icalcomponent_exdates exdates;
+    struct icalcomponent_occurrence *occurrences;
+    size_t occurrence_count = 0, occurrence_capacity = 16;
+    size_t i;
 
     if (comp == NULL || callback == NULL)
         return;
@@ -838,127 +3291,583 @@ void icalcomponent_foreach_recurrence(icalcomponent *comp,
         /* No DTEND or DURATION and DTSTART is DATE - duration is 1 day */
         struct icaldurationtype dur = icaldurationtype_null_duration();
 
-        dur.days = 1;
-        dtend = icaltime_add(dtstart, dur);
+        dur.days = 1;
+        dtend = icaltime_add(dtstart, dur);
+    }
+
+    /* Now set up the base span for this item, corresponding to the
+       base DTSTART and DTEND */
+    basespan = icaltime_span_new(dtstart, dtend, 1);
+
+    basespan.is_busy = icalcomponent_is_busy(comp);
+
+    /* Calculate the ceiling and floor values.. */
+    limit_start = icaltime_as_timet_with_zone(start,
+                                              icaltimezone_get_utc_timezone());
+    if (!icaltime_is_null_time(end)) {
+        limit_end = icaltime_as_timet_with_zone(end,
+                                                icaltimezone_get_utc_timezone());
+    } else {
+#if (SIZEOF_TIME_T > 4)
+        limit_end = (time_t) LONG_MAX;
+#else
+        limit_end = (time_t) INT_MAX;
+#endif
+    }
+    limit_span.start = limit_start;
+    limit_span.end = limit_end;
+
+    recurspan = basespan;
+    dtduration = basespan.end - basespan.start;
+
+    /* Collect the candidate occurrences from DTSTART, the RRULEs and
+       the RDATEs into one array, then sort and deliver them as a single
+       chronological stream with the sorted EXDATE set subtracted by
+       binary search */
+    occurrences = (struct icalcomponent_occurrence *)
+        icalmemory_new_buffer(occurrence_capacity * sizeof(struct icalcomponent_occurrence));
+
+#define ADD_OCCURRENCE(_tt, _start)                                           \
+    do {                                                                      \
+        if (occurrence_count == occurrence_capacity) {                        \
+            occurrence_capacity *= 2;                                         \
+            occurrences = (struct icalcomponent_occurrence *)                 \
+                icalmemory_resize_buffer(occurrences,                         \
+                    occurrence_capacity * sizeof(struct icalcomponent_occurrence)); \
+        }                                                                     \
+        occurrences[occurrence_count].time = (_tt);                           \
+        occurrences[occurrence_count].start = (_start);                       \
+        occurrence_count++;                                                   \
+    } while (0)
+
+    /* Take the DTSTART entry ONLY if there is no RRULE.  Otherwise, the
+       initial occurrence will be generated by the RRULE. */
+    rrule = icalcomponent_get_first_property(comp, ICAL_RRULE_PROPERTY);
+    if (rrule == NULL) {
+        ADD_OCCURRENCE(dtstart, basespan.start);
+    }
+
+    /* Now cycle through the rrule entries */
+    for (; rrule != NULL;
+         rrule = icalcomponent_get_next_property(comp, ICAL_RRULE_PROPERTY)) {
+
+        struct icalrecurrencetype recur = icalproperty_get_rrule(rrule);
+        icalrecur_iterator *rrule_itr = icalrecur_iterator_new(recur, dtstart);
+        struct icaltimetype rrule_time;
+
+        if (!rrule_itr) continue;
+
+        if (recur.count == 0) {
+            icaltimetype mystart = start;
+
+            /* make sure we include any recurrence that ends in timespan */
+            icaltime_adjust(&mystart, 0, 0, 0, -(int)dtduration);
+            icalrecur_iterator_set_start(rrule_itr, mystart);
+        }
+
+        for (rrule_time = icalrecur_iterator_next(rrule_itr);
+             !icaltime_is_null_time(rrule_time);
+             rrule_time = icalrecur_iterator_next(rrule_itr)) {
+
+            /* if we have iterated past end time,
+               then no need to check any further */
+            if (icaltime_compare(rrule_time, end) > 0)
+                break;
+
+            ADD_OCCURRENCE(rrule_time,
+                           icaltime_as_timet_with_zone(rrule_time,
+                                                       rrule_time.zone ? rrule_time.zone :
+                                                       icaltimezone_get_utc_timezone()));
+        }   /* end of iteration over a specific RRULE */
+
+        icalrecur_iterator_free(rrule_itr);
+    }   /* end of RRULE loop */
+
+    /* Now collect the RDATE entries */
+    for (rdate = icalcomponent_get_first_property(comp, ICAL_RDATE_PROPERTY);
+         rdate != NULL;
+         rdate = icalcomponent_get_next_property(comp, ICAL_RDATE_PROPERTY)) {
+
+        struct icaldatetimeperiodtype rdate_period =
+            icalproperty_get_rdate(rdate);
+
+        /* RDATES can specify raw datetimes, periods, or dates.
+            we only support raw datetimes for now..
+
+            @todo Add support for other types */
+
+        if (icaltime_is_null_time(rdate_period.time))
+            continue;
+
+        ADD_OCCURRENCE(rdate_period.time,
+                       icaltime_as_timet_with_zone(rdate_period.time,
+                                                   rdate_period.time.zone ?
+                                                   rdate_period.time.zone :
+                                                   icaltimezone_get_utc_timezone()));
+    }
+
+#undef ADD_OCCURRENCE
+
+    qsort(occurrences, occurrence_count,
+          sizeof(struct icalcomponent_occurrence), occurrence_compare);
+
+    exdates_collect(comp, &exdates);
+
+    for (i = 0; i < occurrence_count; i++) {
+        /* An RDATE that duplicates a generated occurrence denotes the
+           same instance; deliver it once */
+        if (i > 0 && occurrences[i].start == occurrences[i - 1].start) {
+            continue;
+        }
+
+        if (occurrence_is_excluded(comp, &dtstart, &exdates,
+                                   occurrences[i].time, occurrences[i].start)) {
+            continue;
+        }
+
+        recurspan.start = occurrences[i].start;
+        recurspan.end = recurspan.start + dtduration;
+
+        /* call callback action */
+        if (icaltime_span_overlaps(&recurspan, &limit_span))
+            (*callback) (comp, &recurspan, callback_data);
+    }
+
+    exdates_free(&exdates);
+    icalmemory_free_buffer(occurrences);
+}
+
+#if defined(HAVE_PTHREAD)
+
+struct foreach_recurrence_batch_data
+{
+    icalcomponent *const *comps;
+    struct icaltimetype start;
+    struct icaltimetype end;
+    void (*callback) (icalcomponent *comp, struct icaltime_span *span, void *data);
+    void *const *callback_data;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+};
+
+static void *foreach_recurrence_batch_worker(void *d)
+{
+    struct foreach_recurrence_batch_data *data = (struct foreach_recurrence_batch_data *)d;
+
+    for (;;) {
+        size_t i;
+
+        pthread_mutex_lock(&data->lock);
+        i = data->next++;
+        pthread_mutex_unlock(&data->lock);
+
+        if (i >= data->count) {
+            break;
+        }
+
+        icalcomponent_foreach_recurrence(data->comps[i], data->start, data->end,
+                                         data->callback, data->callback_data[i]);
+    }
+
+    return 0;
+}
+
+#endif
+
+void icalcomponent_foreach_recurrence_batch(icalcomponent *const *comps, size_t count,
+                                            struct icaltimetype start,
+                                            struct icaltimetype end,
+                                            void (*callback) (icalcomponent *comp,
+                                                              struct icaltime_span *span,
+                                                              void *data),
+                                            void *const *callback_data, int num_threads)
+{
+    size_t i;
+
+    icalerror_check_arg_rv((comps != 0), "comps");
+    icalerror_check_arg_rv((callback != 0), "callback");
+    icalerror_check_arg_rv((callback_data != 0), "callback_data");
+
+    /* Initialize the builtin timezone data before any workers exist;
+       its first use is a lazy, unsynchronized setup */
+    (void)icaltimezone_get_utc_timezone();
+
+#if defined(HAVE_PTHREAD)
+    if (num_threads > 1 && count > 1) {
+        struct foreach_recurrence_batch_data data;
+        pthread_t *threads;
+        int started = 0;
+        int t;
+
+        if ((size_t) num_threads > count) {
+            num_threads = (int)count;
+        }
+
+        data.comps = comps;
+        data.start = start;
+        data.end = end;
+        data.callback = callback;
+        data.callback_data = callback_data;
+        data.count = count;
+        data.next = 0;
+        pthread_mutex_init(&data.lock, 0);
+
+        threads = (pthread_t *) malloc((size_t) num_threads * sizeof(pthread_t));
+
+        if (threads == 0) {
+            pthread_mutex_destroy(&data.lock);
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return;
+        }
+
+        for (t = 0; t < num_threads; t++) {
+            if (pthread_create(&threads[t], 0, foreach_recurrence_batch_worker, &data) != 0) {
+                break;
+            }
+            started++;
+        }
+
+        if (started > 0) {
+            /* The calling thread pitches in too rather than blocking */
+            (void)foreach_recurrence_batch_worker(&data);
+
+            for (t = 0; t < started; t++) {
+                pthread_join(threads[t], 0);
+            }
+        }
+
+        free(threads);
+        pthread_mutex_destroy(&data.lock);
+
+        if (started > 0) {
+            return;
+        }
+
+        /* Could not start any workers; fall through to the serial path */
+    }
+#else
+    _unused(num_threads);
+#endif
+
+    for (i = 0; i < count; i++) {
+        icalcomponent_foreach_recurrence(comps[i], start, end, callback, callback_data[i]);
+    }
+}
+
+/**
+ * @private
+ */
+static void occ_cache_collect(icalcomponent *comp, struct icaltime_span *span, void *data)
+{
+    icalarray *spans = (icalarray *) data;
+
+    _unused(comp);
+
+    icalarray_append(spans, span);
+}
+
+/**
+ * @private
+ */
+static int occ_span_compare(const void *elem1, const void *elem2)
+{
+    const struct icaltime_span *a = (const struct icaltime_span *)elem1;
+    const struct icaltime_span *b = (const struct icaltime_span *)elem2;
+
+    if (a->start != b->start) {
+        return a->start < b->start ? -1 : 1;
+    }
+    if (a->end != b->end) {
+        return a->end < b->end ? -1 : 1;
+    }
+    return 0;
+}
+
+icalarray *icalcomponent_get_occurrences_cached(icalcomponent *comp,
+                                                struct icaltimetype start,
+                                                struct icaltimetype end)
+{
+    icalarray *result;
+    icaltime_span limit;
+    time_t qstart, qend;
+    size_t i;
+
+    icalerror_check_arg_rz((comp != 0), "comp");
+
+    qstart = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+    if (!icaltime_is_null_time(end)) {
+        qend = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
+    } else {
+#if (SIZEOF_TIME_T > 4)
+        qend = (time_t) LONG_MAX;
+#else
+        qend = (time_t) INT_MAX;
+#endif
+    }
+
+    if (comp->occ_cache == 0 ||
+        comp->occ_cache_generation != comp->property_generation ||
+        comp->occ_cache_start > qstart || comp->occ_cache_end < qend) {
+        /* Expand the requested window and memoize it. */
+        icalarray *spans = icalarray_new(sizeof(struct icaltime_span), 64);
+
+        if (spans == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+
+        icalcomponent_foreach_recurrence(comp, start, end, occ_cache_collect, spans);
+        icalarray_sort(spans, occ_span_compare);
+
+        if (comp->frozen) {
+            /* A frozen component keeps no cache behind its readers;
+               hand the expansion straight back. */
+            return spans;
+        }
+
+        if (comp->occ_cache != 0) {
+            icalarray_free(comp->occ_cache);
+        }
+        comp->occ_cache = spans;
+        comp->occ_cache_start = qstart;
+        comp->occ_cache_end = qend;
+        comp->occ_cache_generation = comp->property_generation;
+    }
+
+    /* Copy out the spans overlapping the requested window, using the
+       same predicate icalcomponent_foreach_recurrence() delivers by,
+       so a cache hit answers exactly like a fresh expansion. */
+    result = icalarray_new(sizeof(struct icaltime_span), 64);
+    if (result == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    limit.start = qstart;
+    limit.end = qend;
+    limit.is_busy = 0;
+    for (i = 0; i < comp->occ_cache->num_elements; i++) {
+        struct icaltime_span *span =
+            (struct icaltime_span *)icalarray_element_at(comp->occ_cache, i);
+
+        if (icaltime_span_overlaps(span, &limit)) {
+            icalarray_append(result, span);
+        }
+    }
+
+    return result;
+}
+
+/**
+ * @private
+ *
+ * A relative VALARM trigger, decoded once per alarm instead of once
+ * per occurrence.
+ */
+struct alarm_desc
+{
+    icalcomponent *alarm;
+    int related_end;            /**< TRIGGER;RELATED=END: offset from the occurrence end */
+    time_t offset;              /**< trigger offset in seconds, negative for "before" */
+    int repeat;                 /**< additional fires after the first (REPEAT) */
+    time_t interval;            /**< seconds between repeated fires (DURATION) */
+};
+
+/**
+ * @private
+ */
+static int alarm_time_compare(const void *elem1, const void *elem2)
+{
+    const struct icalcomponent_alarm_time *a = (const struct icalcomponent_alarm_time *)elem1;
+    const struct icalcomponent_alarm_time *b = (const struct icalcomponent_alarm_time *)elem2;
+
+    if (a->trigger != b->trigger) {
+        return a->trigger < b->trigger ? -1 : 1;
     }
+    return 0;
+}
 
-    /* Now set up the base span for this item, corresponding to the
-       base DTSTART and DTEND */
-    basespan = icaltime_span_new(dtstart, dtend, 1);
+/**
+ * @private
+ *
+ * Appends the fires of one alarm resolved to @p fire (and its REPEATs)
+ * that land inside [qstart, qend).
+ */
+static void alarm_emit(icalarray *result, icalcomponent *comp, icalcomponent *alarm,
+                       time_t fire, int repeat, time_t interval, time_t qstart, time_t qend)
+{
+    int r;
 
-    basespan.is_busy = icalcomponent_is_busy(comp);
+    for (r = 0; r <= repeat; r++) {
+        time_t t = fire + (time_t)r * interval;
 
-    /* Calculate the ceiling and floor values.. */
-    limit_start = icaltime_as_timet_with_zone(start,
-                                              icaltimezone_get_utc_timezone());
-    if (!icaltime_is_null_time(end)) {
-        limit_end = icaltime_as_timet_with_zone(end,
-                                                icaltimezone_get_utc_timezone());
-    } else {
-#if (SIZEOF_TIME_T > 4)
-        limit_end = (time_t) LONG_MAX;
-#else
-        limit_end = (time_t) INT_MAX;
-#endif
-    }
-    limit_span.start = limit_start;
-    limit_span.end = limit_end;
+        if (t >= qstart && t < qend) {
+            struct icalcomponent_alarm_time entry;
 
-    /* Do the callback for the DTSTART entry, ONLY if there is no RRULE.
-       Otherwise, the initial occurrence will be handled by the RRULE. */
-    rrule = icalcomponent_get_first_property(comp, ICAL_RRULE_PROPERTY);
-    if ((rrule == NULL) &&
-        !icalproperty_recurrence_is_excluded(comp, &dtstart, &dtstart)) {
-        /* call callback action */
-        if (icaltime_span_overlaps(&basespan, &limit_span))
-            (*callback) (comp, &basespan, callback_data);
+            entry.trigger = t;
+            entry.comp = comp;
+            entry.alarm = alarm;
+
+            icalarray_append(result, &entry);
+        }
     }
+}
 
-    recurspan = basespan;
-    dtduration = basespan.end - basespan.start;
+/**
+ * @private
+ *
+ * Collects the alarm fires of one event or todo. Absolute triggers are
+ * emitted directly; relative triggers are resolved against the
+ * component's occurrences, expanded once through the occurrence span
+ * cache over a window wide enough for every offset (and REPEAT chain)
+ * at hand.
+ */
+static void icalcomponent_collect_alarm_times(icalcomponent *comp,
+                                              time_t qstart, time_t qend, icalarray *result)
+{
+    icalcomponent *alarm;
+    icalarray *relative = 0;
+    time_t min_reach = 0, max_reach = 0;
+
+    for (alarm = icalcomponent_get_first_component(comp, ICAL_VALARM_COMPONENT);
+         alarm != 0;
+         alarm = icalcomponent_get_next_component(comp, ICAL_VALARM_COMPONENT)) {
+
+        icalproperty *trig_prop =
+            icalcomponent_get_first_property(alarm, ICAL_TRIGGER_PROPERTY);
+        icalproperty *rep_prop, *dur_prop;
+        struct icaltriggertype trig;
+        int repeat = 0;
+        time_t interval = 0;
+
+        if (trig_prop == 0) {
+            continue;
+        }
 
-    /* Now cycle through the rrule entries */
-    for (; rrule != NULL;
-         rrule = icalcomponent_get_next_property(comp, ICAL_RRULE_PROPERTY)) {
+        trig = icalproperty_get_trigger(trig_prop);
 
-        struct icalrecurrencetype recur = icalproperty_get_rrule(rrule);
-        icalrecur_iterator *rrule_itr = icalrecur_iterator_new(recur, dtstart);
-        struct icaltimetype rrule_time;
+        rep_prop = icalcomponent_get_first_property(alarm, ICAL_REPEAT_PROPERTY);
+        dur_prop = icalcomponent_get_first_property(alarm, ICAL_DURATION_PROPERTY);
+        if (rep_prop != 0 && dur_prop != 0) {
+            repeat = icalproperty_get_repeat(rep_prop);
+            interval = (time_t)icaldurationtype_as_int(icalproperty_get_duration(dur_prop));
+            if (repeat < 0 || interval <= 0) {
+                repeat = 0;
+                interval = 0;
+            }
+        }
 
-        if (!rrule_itr) continue;
+        if (!icaltime_is_null_time(trig.time)) {
+            time_t fire = icaltime_as_timet_with_zone(trig.time,
+                                                      icaltimezone_get_utc_timezone());
 
-        if (recur.count == 0) {
-            icaltimetype mystart = start;
+            alarm_emit(result, comp, alarm, fire, repeat, interval, qstart, qend);
+        } else {
+            struct alarm_desc desc;
+            icalparameter *rel =
+                icalproperty_get_first_parameter(trig_prop, ICAL_RELATED_PARAMETER);
+
+            desc.alarm = alarm;
+            desc.related_end = (rel != 0 &&
+                                icalparameter_get_related(rel) == ICAL_RELATED_END);
+            desc.offset = (time_t)icaldurationtype_as_int(trig.duration);
+            desc.repeat = repeat;
+            desc.interval = interval;
+
+            if (relative == 0) {
+                relative = icalarray_new(sizeof(struct alarm_desc), 4);
+                if (relative == 0) {
+                    icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+                    return;
+                }
+            }
+            icalarray_append(relative, &desc);
 
-            /* make sure we include any recurrence that ends in timespan */
-            icaltime_adjust(&mystart, 0, 0, 0, -(int)dtduration);
-            icalrecur_iterator_set_start(rrule_itr, mystart);
+            /* An alarm at offset o (with repeats up to o + repeat *
+               interval) fires in the window exactly when its occurrence
+               lands in the window shifted back by that reach */
+            if (desc.offset < min_reach) {
+                min_reach = desc.offset;
+            }
+            if (desc.offset + (time_t)desc.repeat * desc.interval > max_reach) {
+                max_reach = desc.offset + (time_t)desc.repeat * desc.interval;
+            }
         }
+    }
 
-        for (rrule_time = icalrecur_iterator_next(rrule_itr);
-             !icaltime_is_null_time(rrule_time);
-             rrule_time = icalrecur_iterator_next(rrule_itr)) {
-
-            /* if we have iterated past end time,
-               then no need to check any further */
-            if (icaltime_compare(rrule_time, end) > 0)
-                break;
+    if (relative != 0 && relative->num_elements > 0) {
+        icaltimezone *utc = icaltimezone_get_utc_timezone();
+        struct icaltimetype wstart =
+            icaltime_from_timet_with_zone(qstart - max_reach, 0, utc);
+        struct icaltimetype wend =
+            icaltime_from_timet_with_zone(qend - min_reach, 0, utc);
+        icalarray *occs = icalcomponent_get_occurrences_cached(comp, wstart, wend);
+        size_t i, j;
 
-            recurspan.start =
-                icaltime_as_timet_with_zone(rrule_time,
-                                            rrule_time.zone ? rrule_time.zone :
-                                            icaltimezone_get_utc_timezone());
-            recurspan.end = recurspan.start + dtduration;
+        if (occs != 0) {
+            for (i = 0; i < occs->num_elements; i++) {
+                struct icaltime_span *span =
+                    (struct icaltime_span *)icalarray_element_at(occs, i);
 
-            /* save the iterator ICK! */
-            property_iterator = comp->property_iterator;
+                for (j = 0; j < relative->num_elements; j++) {
+                    struct alarm_desc *d =
+                        (struct alarm_desc *)icalarray_element_at(relative, j);
+                    time_t base = d->related_end ? span->end : span->start;
 
-            if (!icalproperty_recurrence_is_excluded(comp,
-                                                     &dtstart, &rrule_time)) {
-                /* call callback action */
-                if (icaltime_span_overlaps(&recurspan, &limit_span))
-                    (*callback) (comp, &recurspan, callback_data);
+                    alarm_emit(result, comp, d->alarm, base + d->offset,
+                               d->repeat, d->interval, qstart, qend);
+                }
             }
-            comp->property_iterator = property_iterator;
-        }   /* end of iteration over a specific RRULE */
+            icalarray_free(occs);
+        }
+    }
 
-        icalrecur_iterator_free(rrule_itr);
-    }   /* end of RRULE loop */
+    if (relative != 0) {
+        icalarray_free(relative);
+    }
+}
 
-    /* Now process RDATE entries */
-    for (rdate = icalcomponent_get_first_property(comp, ICAL_RDATE_PROPERTY);
-         rdate != NULL;
-         rdate = icalcomponent_get_next_property(comp, ICAL_RDATE_PROPERTY)) {
+icalarray *icalcomponent_get_alarm_times(icalcomponent *comp,
+                                         struct icaltimetype start, struct icaltimetype end)
+{
+    icalarray *result;
+    icalcomponent_kind kind;
+    time_t qstart, qend;
 
-        struct icaldatetimeperiodtype rdate_period =
-            icalproperty_get_rdate(rdate);
+    icalerror_check_arg_rz((comp != 0), "comp");
+    icalerror_check_arg_rz((!icaltime_is_null_time(end)), "end");
 
-        /* RDATES can specify raw datetimes, periods, or dates.
-            we only support raw datetimes for now..
+    qstart = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+    qend = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
 
-            @todo Add support for other types */
+    result = icalarray_new(sizeof(struct icalcomponent_alarm_time), 16);
+    if (result == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
 
-        if (icaltime_is_null_time(rdate_period.time))
-            continue;
+    kind = icalcomponent_isa(comp);
 
-        recurspan.start =
-            icaltime_as_timet_with_zone(rdate_period.time,
-                                        rdate_period.time.zone ?
-                                        rdate_period.time.zone :
-                                        icaltimezone_get_utc_timezone());
-        recurspan.end = recurspan.start + dtduration;
+    if (kind == ICAL_VCALENDAR_COMPONENT || kind == ICAL_XROOT_COMPONENT) {
+        icalcomponent *child;
 
-        /* save the iterator ICK! */
-        property_iterator = comp->property_iterator;
+        for (child = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+             child != 0;
+             child = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+            icalcomponent_kind ck = icalcomponent_isa(child);
 
-        if (!icalproperty_recurrence_is_excluded(comp,
-                                                 &dtstart, &rdate_period.time)) {
-            /* call callback action */
-            if (icaltime_span_overlaps(&recurspan, &limit_span))
-                (*callback) (comp, &recurspan, callback_data);
+            if (ck == ICAL_VEVENT_COMPONENT || ck == ICAL_VTODO_COMPONENT) {
+                icalcomponent_collect_alarm_times(child, qstart, qend, result);
+            }
         }
-        comp->property_iterator = property_iterator;
+    } else {
+        icalcomponent_collect_alarm_times(comp, qstart, qend, result);
     }
+
+    icalarray_sort(result, alarm_time_compare);
+
+    return result;
 }
 
 int icalcomponent_check_restrictions(icalcomponent *comp)
@@ -1207,81 +4116,347 @@ icalcompiter icalcomponent_begin_component(icalcomponent *component, icalcompone
             return itr;
         }
     }
-
-    return icalcompiter_null;
+
+    return icalcompiter_null;
+}
+
+icalcompiter icalcomponent_end_component(icalcomponent *component, icalcomponent_kind kind)
+{
+    icalcompiter itr;
+    pvl_elem i;
+
+    itr.kind = kind;
+
+    icalerror_check_arg_re(component != 0, "component", icalcompiter_null);
+
+    for (i = pvl_tail(component->components); i != 0; i = pvl_prior(i)) {
+
+        icalcomponent *c = (icalcomponent *) pvl_data(i);
+
+        if (icalcomponent_isa(c) == kind || kind == ICAL_ANY_COMPONENT) {
+
+            itr.iter = pvl_next(i);
+
+            return itr;
+        }
+    }
+
+    return icalcompiter_null;
+}
+
+icalcomponent *icalcompiter_next(icalcompiter *i)
+{
+    if (i->iter == 0) {
+        return 0;
+    }
+
+    icalerror_check_arg_rz((i != 0), "i");
+
+    for (i->iter = pvl_next(i->iter); i->iter != 0; i->iter = pvl_next(i->iter)) {
+
+        icalcomponent *c = (icalcomponent *) pvl_data(i->iter);
+
+        if (icalcomponent_isa(c) == i->kind || i->kind == ICAL_ANY_COMPONENT) {
+
+            return icalcompiter_deref(i);
+        }
+    }
+
+    return 0;
+}
+
+icalcomponent *icalcompiter_prior(icalcompiter *i)
+{
+    if (i->iter == 0) {
+        return 0;
+    }
+
+    for (i->iter = pvl_prior(i->iter); i->iter != 0; i->iter = pvl_prior(i->iter)) {
+
+        icalcomponent *c = (icalcomponent *) pvl_data(i->iter);
+
+        if (icalcomponent_isa(c) == i->kind || i->kind == ICAL_ANY_COMPONENT) {
+
+            return icalcompiter_deref(i);
+        }
+    }
+
+    return 0;
+}
+
+icalcomponent *icalcompiter_deref(icalcompiter *i)
+{
+    if (i->iter == 0) {
+        return 0;
+    }
+
+    return pvl_data(i->iter);
+}
+
+static icalpropiter icalpropiter_null = { ICAL_NO_PROPERTY, 0 };
+
+icalpropiter icalcomponent_begin_property(icalcomponent *component, icalproperty_kind kind)
+{
+    icalpropiter itr;
+    pvl_elem i;
+
+    itr.kind = kind;
+    itr.iter = NULL;
+
+    icalerror_check_arg_re(component != 0, "component", icalpropiter_null);
+
+    for (i = pvl_head(component->properties); i != 0; i = pvl_next(i)) {
+
+        icalproperty *p = (icalproperty *) pvl_data(i);
+
+        if (icalproperty_isa(p) == kind || kind == ICAL_ANY_PROPERTY) {
+
+            itr.iter = i;
+
+            return itr;
+        }
+    }
+
+    return icalpropiter_null;
+}
+
+icalproperty *icalpropiter_next(icalpropiter *i)
+{
+    if (i->iter == 0) {
+        return 0;
+    }
+
+    for (i->iter = pvl_next(i->iter); i->iter != 0; i->iter = pvl_next(i->iter)) {
+
+        icalproperty *p = (icalproperty *) pvl_data(i->iter);
+
+        if (icalproperty_isa(p) == i->kind || i->kind == ICAL_ANY_PROPERTY) {
+
+            return icalpropiter_deref(i);
+        }
+    }
+
+    return 0;
+}
+
+icalproperty *icalpropiter_deref(icalpropiter *i)
+{
+    if (i->iter == 0) {
+        return 0;
+    }
+
+    return pvl_data(i->iter);
+}
+
+/** Decodes @p prop (or the column's null value when @p prop is 0)
+   into the column's array at @p row. */
+static void icalextract_fill_cell(const icalextract_column *col, size_t row, icalproperty *prop)
+{
+    icalvalue *value = 0;
+
+    if (prop != 0) {
+        value = icalproperty_get_value(prop);
+    }
+
+    switch (col->value_kind) {
+    case ICAL_DATE_VALUE:
+    case ICAL_DATETIME_VALUE:{
+            struct icaltimetype *out = (struct icaltimetype *)col->values;
+
+            if (value == 0) {
+                out[row] = icaltime_null_time();
+            } else if (icalvalue_isa(value) == ICAL_DATE_VALUE) {
+                out[row] = icalvalue_get_date(value);
+            } else {
+                out[row] = icalvalue_get_datetime(value);
+            }
+            break;
+        }
+
+    case ICAL_DURATION_VALUE:{
+            struct icaldurationtype *out = (struct icaldurationtype *)col->values;
+
+            if (value == 0) {
+                out[row] = icaldurationtype_null_duration();
+            } else {
+                out[row] = icalvalue_get_duration(value);
+            }
+            break;
+        }
+
+    case ICAL_INTEGER_VALUE:{
+            int *out = (int *)col->values;
+
+            out[row] = (value == 0) ? 0 : icalvalue_get_integer(value);
+            break;
+        }
+
+    default:{
+            /* Everything else is extracted as a non-owning pointer to
+               the string the value already holds. */
+            const char **out = (const char **)col->values;
+
+            out[row] = 0;
+
+            if (value != 0) {
+                switch (icalvalue_isa(value)) {
+                case ICAL_TEXT_VALUE:
+                    out[row] = icalvalue_get_text(value);
+                    break;
+                case ICAL_URI_VALUE:
+                    out[row] = icalvalue_get_uri(value);
+                    break;
+                case ICAL_CALADDRESS_VALUE:
+                    out[row] = icalvalue_get_caladdress(value);
+                    break;
+                case ICAL_QUERY_VALUE:
+                    out[row] = icalvalue_get_query(value);
+                    break;
+                case ICAL_STRING_VALUE:
+                    out[row] = icalvalue_get_string(value);
+                    break;
+                default:
+                    break;
+                }
+            }
+            break;
+        }
+    }
 }
 
-icalcompiter icalcomponent_end_component(icalcomponent *component, icalcomponent_kind kind)
+int icalcomponent_extract_columns(icalcomponent *component, icalcomponent_kind kind,
+                                  icalextract_column *columns, size_t columns_count,
+                                  size_t max_rows)
 {
-    icalcompiter itr;
-    pvl_elem i;
+    size_t row = 0;
+    icalcompiter ci;
 
-    itr.kind = kind;
+    icalerror_check_arg_re(component != 0, "component", -1);
+    icalerror_check_arg_re(columns != 0, "columns", -1);
 
-    icalerror_check_arg_re(component != 0, "component", icalcompiter_null);
+    for (ci = icalcomponent_begin_component(component, kind);
+         icalcompiter_deref(&ci) != 0 && row < max_rows; (void)icalcompiter_next(&ci)) {
 
-    for (i = pvl_tail(component->components); i != 0; i = pvl_prior(i)) {
+        icalcomponent *child = icalcompiter_deref(&ci);
+        icalpropiter pi;
+        size_t c;
 
-        icalcomponent *c = (icalcomponent *) pvl_data(i);
+        /* Null out the row, then let the single pass over the child's
+           properties overwrite the cells it finds. */
+        for (c = 0; c < columns_count; c++) {
+            icalextract_fill_cell(&columns[c], row, 0);
+        }
 
-        if (icalcomponent_isa(c) == kind || kind == ICAL_ANY_COMPONENT) {
+        for (pi = icalcomponent_begin_property(child, ICAL_ANY_PROPERTY);
+             icalpropiter_deref(&pi) != 0; (void)icalpropiter_next(&pi)) {
 
-            itr.iter = pvl_next(i);
+            icalproperty *prop = icalpropiter_deref(&pi);
+            icalproperty_kind pk = icalproperty_isa(prop);
 
-            return itr;
+            for (c = 0; c < columns_count; c++) {
+                if (columns[c].prop_kind == pk) {
+                    icalextract_fill_cell(&columns[c], row, prop);
+                }
+            }
         }
+
+        row++;
     }
 
-    return icalcompiter_null;
+    return (int)row;
 }
 
-icalcomponent *icalcompiter_next(icalcompiter *i)
+void icalcomponent_freeze(icalcomponent *component)
 {
-    if (i->iter == 0) {
-        return 0;
-    }
+    pvl_elem itr;
 
-    icalerror_check_arg_rz((i != 0), "i");
+    icalerror_check_arg_rv((component != 0), "component");
 
-    for (i->iter = pvl_next(i->iter); i->iter != 0; i->iter = pvl_next(i->iter)) {
+    if (component->frozen) {
+        return;
+    }
 
-        icalcomponent *c = (icalcomponent *) pvl_data(i->iter);
+    /* Resolve everything lazy now, while we are still the only user:
+       readers of the frozen tree will not build these on demand. */
+    if (component->timezones && !component->timezones_sorted) {
+        icalarray_sort(component->timezones, icalcomponent_compare_timezone_fn);
+        component->timezones_sorted = 1;
+    }
 
-        if (icalcomponent_isa(c) == i->kind || i->kind == ICAL_ANY_COMPONENT) {
+    if (component->uid_index != 0 &&
+        component->uid_index->generation != component->component_generation) {
+        icalcomponent_uid_index_free(component->uid_index);
+        component->uid_index = 0;
+    }
 
-            return icalcompiter_deref(i);
-        }
+    if (component->uid_index == 0 && pvl_head(component->components) != 0) {
+        component->uid_index = icalcomponent_uid_index_build(component);
     }
 
-    return 0;
+    if (component->timezones != 0 && component->timezones->num_elements != 0) {
+        (void)icalcomponent_tzid_index_get(component);
+    }
+
+    /* Warm the hash cache too; writes are skipped once frozen */
+    (void)comp_hash_own_properties(component);
+
+    component->frozen = 1;
+
+    for (itr = pvl_head(component->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent_freeze((icalcomponent *) pvl_data(itr));
+    }
 }
 
-icalcomponent *icalcompiter_prior(icalcompiter *i)
+int icalcomponent_is_frozen(icalcomponent *component)
 {
-    if (i->iter == 0) {
-        return 0;
-    }
+    icalerror_check_arg_rz((component != 0), "component");
 
-    for (i->iter = pvl_prior(i->iter); i->iter != 0; i->iter = pvl_prior(i->iter)) {
+    return component->frozen;
+}
 
-        icalcomponent *c = (icalcomponent *) pvl_data(i->iter);
+unsigned int icalcomponent_content_generation(icalcomponent *component)
+{
+    icalerror_check_arg_rz((component != 0), "component");
 
-        if (icalcomponent_isa(c) == i->kind || i->kind == ICAL_ANY_COMPONENT) {
+    return component->content_generation;
+}
 
-            return icalcompiter_deref(i);
-        }
+void icalcomponent_touch(icalcomponent *component)
+{
+    if (component == 0) {
+        return;
     }
 
-    return 0;
+    /* The generation counter otherwise only moves on add/remove; an
+       in-place mutation of an attached property has to move it too so
+       that generation-keyed caches (and the restriction check cache)
+       notice the change. The kind caches just fall back to a scan. */
+    component->property_generation++;
+    icalcomponent_content_changed(component);
 }
 
-icalcomponent *icalcompiter_deref(icalcompiter *i)
+int icalcomponent_restriction_cache_get(icalcomponent *component, icalproperty_method method,
+                                        int *valid)
 {
-    if (i->iter == 0) {
-        return 0;
+    if (component->restriction_checked &&
+        component->restriction_method == method &&
+        component->restriction_generation == component->property_generation) {
+        *valid = component->restriction_valid;
+        return 1;
     }
 
-    return pvl_data(i->iter);
+    return 0;
+}
+
+void icalcomponent_restriction_cache_set(icalcomponent *component, icalproperty_method method,
+                                         int valid)
+{
+    component->restriction_checked = 1;
+    component->restriction_method = method;
+    /* Read after the check: a failed check appends X-LIC-ERROR
+       properties, which bumps the generation. */
+    component->restriction_generation = component->property_generation;
+    component->restriction_valid = valid;
 }
 
 icalcomponent *icalcomponent_get_inner(icalcomponent *comp)
@@ -1471,6 +4646,24 @@ void icalcomponent_set_dtstamp(icalcomponent *comp, struct icaltimetype v)
     icalproperty_set_dtstamp(prop, v);
 }
 
+void icalcomponent_set_dtstamp_now(icalcomponent **comps, size_t count)
+{
+    struct icaltimetype now;
+    size_t i;
+
+    icalerror_check_arg_rv((comps != 0), "comps");
+
+    /* One clock read and conversion for the whole batch; DTSTAMP is
+       specified as UTC */
+    now = icaltime_current_time_with_zone(icaltimezone_get_utc_timezone());
+
+    for (i = 0; i < count; i++) {
+        if (comps[i] != 0) {
+            icalcomponent_set_dtstamp(comps[i], now);
+        }
+    }
+}
+
 struct icaltimetype icalcomponent_get_dtstamp(icalcomponent *comp)
 {
     icalcomponent *inner = icalcomponent_get_inner(comp);
@@ -1626,6 +4819,105 @@ struct icaltimetype icalcomponent_get_recurrenceid(icalcomponent *comp)
     return icalproperty_get_recurrenceid(prop);
 }
 
+icalerrorenum icalcomponent_get_schedule_info(icalcomponent *comp,
+                                              struct icalcomponent_schedule_info *info)
+{
+    icalcomponent *inner;
+    pvl_elem itr;
+    icalproperty *dtstart_prop = 0;
+    icalproperty *dtend_prop = 0;
+    icalproperty *dur_prop = 0;
+    icalproperty *uid_prop = 0;
+    icalproperty *rid_prop = 0;
+    int is_recurring = 0;
+
+    icalerror_check_arg_re((comp != 0), "comp", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((info != 0), "info", ICAL_BADARG_ERROR);
+
+    inner = icalcomponent_get_inner(comp);
+    if (inner == 0) {
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        return ICAL_MALFORMEDDATA_ERROR;
+    }
+
+    /* One walk, keeping the first property of each interesting kind;
+       the per-field getters would each scan the list from the head.
+       Walking the pvl list directly also leaves property_iterator
+       alone, so this can be called mid-iteration. */
+    for (itr = pvl_head(inner->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+
+        switch (icalproperty_isa(p)) {
+        case ICAL_DTSTART_PROPERTY:
+            if (dtstart_prop == 0) {
+                dtstart_prop = p;
+            }
+            break;
+        case ICAL_DTEND_PROPERTY:
+            if (dtend_prop == 0) {
+                dtend_prop = p;
+            }
+            break;
+        case ICAL_DURATION_PROPERTY:
+            if (dur_prop == 0) {
+                dur_prop = p;
+            }
+            break;
+        case ICAL_UID_PROPERTY:
+            if (uid_prop == 0) {
+                uid_prop = p;
+            }
+            break;
+        case ICAL_RECURRENCEID_PROPERTY:
+            if (rid_prop == 0) {
+                rid_prop = p;
+            }
+            break;
+        case ICAL_RRULE_PROPERTY:
+        case ICAL_RDATE_PROPERTY:
+            is_recurring = 1;
+            break;
+        default:
+            break;
+        }
+    }
+
+    info->dtstart = (dtstart_prop != 0)
+        ? icalproperty_get_datetime_with_component(dtstart_prop, comp)
+        : icaltime_null_time();
+
+    info->dtend = icaltime_null_time();
+    info->duration = icaldurationtype_null_duration();
+
+    if (dtend_prop != 0) {
+        info->dtend = icalproperty_get_datetime_with_component(dtend_prop, comp);
+        if (dur_prop == 0) {
+            info->duration = icaltime_subtract(info->dtend, info->dtstart);
+        }
+    } else if (dur_prop != 0) {
+        struct icaldurationtype duration;
+
+        /* extra check to prevent empty durations from crashing */
+        if (icalproperty_get_value(dur_prop)) {
+            duration = icalproperty_get_duration(dur_prop);
+        } else {
+            duration = icaldurationtype_null_duration();
+        }
+
+        info->duration = duration;
+        info->dtend = icaltime_add(info->dtstart, duration);
+    }
+
+    info->recurrenceid = (rid_prop != 0)
+        ? icalproperty_get_recurrenceid(rid_prop)
+        : icaltime_null_time();
+
+    info->uid = (uid_prop != 0) ? icalproperty_get_uid(uid_prop) : 0;
+    info->is_recurring = is_recurring;
+
+    return ICAL_NO_ERROR;
+}
+
 void icalcomponent_set_description(icalcomponent *comp, const char *v)
 {
     ICALSETUPSET(ICAL_DESCRIPTION_PROPERTY);
@@ -1865,6 +5157,234 @@ icalcomponent *icalcomponent_new_xpatch(void)
  * Timezone stuff.
  */
 
+struct icalcomponent_tzid_entry
+{
+    icalcomponent *vtimezone;
+
+        /** The zone's element in comp->timezones, so
+           icalcomponent_get_timezone() can answer from the index. Valid
+           for the index's lifetime: appending invalidates the index
+           through component_generation, and sorting the array (which
+           moves elements) drops the index explicitly. */
+    icaltimezone *zone;
+    unsigned long long content_hash;
+    struct icalcomponent_tzid_entry *next;
+};
+
+struct icalcomponent_tzid_index
+{
+    size_t num_buckets;
+    struct icalcomponent_tzid_entry **buckets;
+    unsigned int generation;
+};
+
+/**
+ * @private
+ *
+ * Returns the child's own TZID property value without disturbing its
+ * property iterator, mirroring icalcomponent_child_uid().
+ */
+static const char *icalcomponent_child_tzid(icalcomponent *child)
+{
+    pvl_elem itr;
+
+    for (itr = pvl_head(child->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+
+        if (icalproperty_isa(p) == ICAL_TZID_PROPERTY) {
+            return icalproperty_get_tzid(p);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @private
+ *
+ * Digest over a VTIMEZONE's content with its top-level TZID property
+ * excluded, matching the comparison icalcomponent_compare_vtimezones()
+ * performs (it neutralizes the TZIDs before serializing). Two zones
+ * with different digests are certainly different; equal digests are
+ * confirmed with the full comparison before being trusted.
+ */
+static unsigned long long icalcomponent_vtimezone_content_hash(icalcomponent *zone)
+{
+    pvl_elem itr;
+    unsigned long long h;
+
+    h = comp_hash_mix(COMP_HASH_FNV_INIT ^ (unsigned long long)zone->kind);
+
+    for (itr = pvl_head(zone->properties); itr != 0; itr = pvl_next(itr)) {
+        icalproperty *p = (icalproperty *) pvl_data(itr);
+        char *text;
+
+        if (icalproperty_isa(p) == ICAL_TZID_PROPERTY) {
+            continue;
+        }
+
+        text = icalproperty_as_ical_string_r(p);
+        if (text != 0) {
+            h += comp_hash_mix(comp_hash_str(COMP_HASH_FNV_INIT, text));
+            icalmemory_free_buffer(text);
+        }
+    }
+
+    /* The STANDARD/DAYLIGHT children carry no TZID, so their cached
+       full digests can be reused as-is. */
+    for (itr = pvl_head(zone->components); itr != 0; itr = pvl_next(itr)) {
+        h += comp_hash_mix(icalcomponent_hash((icalcomponent *) pvl_data(itr)));
+    }
+
+    return h;
+}
+
+/**
+ * @private
+ */
+static void icalcomponent_tzid_index_free(struct icalcomponent_tzid_index *index)
+{
+    size_t i;
+
+    if (index == 0) {
+        return;
+    }
+
+    for (i = 0; i < index->num_buckets; i++) {
+        struct icalcomponent_tzid_entry *entry = index->buckets[i];
+
+        while (entry != 0) {
+            struct icalcomponent_tzid_entry *next = entry->next;
+
+            icalmemory_pool_free(entry, sizeof(struct icalcomponent_tzid_entry));
+            entry = next;
+        }
+    }
+    icalmemory_free_buffer(index->buckets);
+    icalmemory_free_buffer(index);
+}
+
+/**
+ * @private
+ *
+ * Builds the TZID index over the current VTIMEZONE children, computing
+ * each zone's content digest once up front.
+ */
+static struct icalcomponent_tzid_index *icalcomponent_tzid_index_build(icalcomponent *comp)
+{
+    struct icalcomponent_tzid_index *index;
+    size_t num_buckets = 16;
+    size_t count = comp->timezones ? comp->timezones->num_elements : 0;
+    pvl_elem itr;
+
+    while (num_buckets < count * 2) {
+        num_buckets *= 2;
+    }
+
+    index = (struct icalcomponent_tzid_index *)
+        icalmemory_new_buffer(sizeof(struct icalcomponent_tzid_index));
+    if (index == 0) {
+        return 0;
+    }
+
+    index->num_buckets = num_buckets;
+    index->buckets = (struct icalcomponent_tzid_entry **)
+        icalmemory_new_buffer(num_buckets * sizeof(struct icalcomponent_tzid_entry *));
+    if (index->buckets == 0) {
+        icalmemory_free_buffer(index);
+        return 0;
+    }
+    memset(index->buckets, 0, num_buckets * sizeof(struct icalcomponent_tzid_entry *));
+    index->generation = comp->component_generation;
+
+    for (itr = pvl_head(comp->components); itr != 0; itr = pvl_next(itr)) {
+        icalcomponent *child = (icalcomponent *) pvl_data(itr);
+        const char *tzid;
+        struct icalcomponent_tzid_entry *entry;
+        size_t bucket;
+
+        if (icalcomponent_isa(child) != ICAL_VTIMEZONE_COMPONENT) {
+            continue;
+        }
+
+        tzid = icalcomponent_child_tzid(child);
+        if (tzid == 0) {
+            continue;
+        }
+
+        entry = (struct icalcomponent_tzid_entry *)
+            icalmemory_pool_alloc(sizeof(struct icalcomponent_tzid_entry));
+        if (entry == 0) {
+            icalcomponent_tzid_index_free(index);
+            return 0;
+        }
+
+        bucket = icalcomponent_uid_hash(tzid) % num_buckets;
+        entry->vtimezone = child;
+        entry->zone = 0;
+        entry->content_hash = icalcomponent_vtimezone_content_hash(child);
+        entry->next = index->buckets[bucket];
+        index->buckets[bucket] = entry;
+
+        if (comp->timezones) {
+            size_t i;
+
+            for (i = 0; i < comp->timezones->num_elements; i++) {
+                icaltimezone *zone = icalarray_element_at(comp->timezones, i);
+
+                if (icaltimezone_get_component(zone) == child) {
+                    entry->zone = zone;
+                    break;
+                }
+            }
+        }
+    }
+
+    return index;
+}
+
+/**
+ * @private
+ *
+ * Returns the TZID index, rebuilding it if the child list has mutated
+ * since it was last built. May return 0 (allocation failure or frozen
+ * component); callers fall back to a plain scan in that case.
+ */
+static struct icalcomponent_tzid_index *icalcomponent_tzid_index_get(icalcomponent *comp)
+{
+    if (comp->tzid_index != 0 && comp->tzid_index->generation != comp->component_generation) {
+        icalcomponent_tzid_index_free(comp->tzid_index);
+        comp->tzid_index = 0;
+    }
+
+    if (comp->tzid_index == 0 && !comp->frozen) {
+        comp->tzid_index = icalcomponent_tzid_index_build(comp);
+    }
+
+    return comp->tzid_index;
+}
+
+/**
+ * @private
+ */
+static struct icalcomponent_tzid_entry *icalcomponent_tzid_index_lookup(
+    struct icalcomponent_tzid_index *index, const char *tzid)
+{
+    struct icalcomponent_tzid_entry *entry;
+    size_t bucket;
+
+    bucket = icalcomponent_uid_hash(tzid) % index->num_buckets;
+    for (entry = index->buckets[bucket]; entry != 0; entry = entry->next) {
+        const char *child_tzid = icalcomponent_child_tzid(entry->vtimezone);
+
+        if (child_tzid != 0 && strcmp(child_tzid, tzid) == 0) {
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
 void icalcomponent_merge_component(icalcomponent *comp, icalcomponent *comp_to_merge)
 {
     icalcomponent *subcomp, *next_subcomp;
@@ -1896,7 +5416,7 @@ void icalcomponent_merge_component(icalcomponent *comp, icalcomponent *comp_to_m
 
         /* Now free the tzids_to_rename array. */
         for (i = 0; i < tzids_to_rename->num_elements; i++) {
-            free(icalarray_element_at(tzids_to_rename, i));
+            icalmemory_free_buffer(*(char **)icalarray_element_at(tzids_to_rename, i));
         }
     }
     icalarray_free(tzids_to_rename);
@@ -1924,7 +5444,11 @@ static void icalcomponent_merge_vtimezone(icalcomponent *comp,
     icalproperty *tzid_prop;
     const char *tzid;
     char *tzid_copy;
-    icaltimezone *existing_vtimezone;
+    icalcomponent *existing_vtimezone = 0;
+    struct icalcomponent_tzid_index *index;
+    struct icalcomponent_tzid_entry *entry = 0;
+    unsigned long long content_hash;
+    int same;
 
     /* Get the TZID of the VTIMEZONE. */
     tzid_prop = icalcomponent_get_first_property(vtimezone, ICAL_TZID_PROPERTY);
@@ -1936,7 +5460,17 @@ static void icalcomponent_merge_vtimezone(icalcomponent *comp,
         return;
 
     /* See if there is already a VTIMEZONE in comp with the same TZID. */
-    existing_vtimezone = icalcomponent_get_timezone(comp, tzid);
+    index = icalcomponent_tzid_index_get(comp);
+    if (index) {
+        entry = icalcomponent_tzid_index_lookup(index, tzid);
+        if (entry)
+            existing_vtimezone = entry->vtimezone;
+    } else {
+        icaltimezone *zone = icalcomponent_get_timezone(comp, tzid);
+
+        if (zone)
+            existing_vtimezone = icaltimezone_get_component(zone);
+    }
 
     /* If there is no existing VTIMEZONE with the same TZID, we can just move
        the VTIMEZONE to comp and return. */
@@ -1953,35 +5487,47 @@ static void icalcomponent_merge_vtimezone(icalcomponent *comp,
 
     /* Now we have two VTIMEZONEs with the same TZID (which isn't a globally
        unique one), so we compare the VTIMEZONE components to see if they are
-       the same. If they are, we don't need to do anything. We make a copy of
-       the tzid, since the parameter may get modified in these calls. */
-    tzid_copy = strdup(tzid);
+       the same. If they are, we don't need to do anything. The content
+       digests decide most cases; only a digest match falls through to the
+       full serializing comparison. We make a copy of the tzid, since the
+       parameter may get modified in these calls. */
+    tzid_copy = icalmemory_strdup(tzid);
     if (!tzid_copy) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return;
     }
 
-    if (!icalcomponent_compare_vtimezones(comp, vtimezone)) {
+    content_hash = icalcomponent_vtimezone_content_hash(vtimezone);
+    same = 0;
+    if (entry == 0 || entry->content_hash == content_hash) {
+        same = (icalcomponent_compare_vtimezones(existing_vtimezone, vtimezone) > 0);
+    }
+
+    if (!same) {
         /* FIXME: Handle possible NEWFAILED error. */
 
         /* Now we have two different VTIMEZONEs with the same TZID. */
         icalcomponent_handle_conflicting_vtimezones(comp, vtimezone, tzid_prop,
-                                                    tzid_copy, tzids_to_rename);
+                                                    tzid_copy, tzids_to_rename, content_hash);
     }
-    free(tzid_copy);
+    icalmemory_free_buffer(tzid_copy);
 }
 
 static void icalcomponent_handle_conflicting_vtimezones(icalcomponent *comp,
                                                         icalcomponent *vtimezone,
                                                         icalproperty *tzid_prop,
                                                         const char *tzid,
-                                                        icalarray *tzids_to_rename)
+                                                        icalarray *tzids_to_rename,
+                                                        unsigned long long content_hash)
 {
     int suffix, max_suffix = 0;
     size_t i, num_elements, tzid_len;
     char *tzid_copy, *new_tzid, suffix_buf[32];
+    struct icalcomponent_tzid_index *index;
 
-    _unused(tzid_prop);
+    /* No components were added since icalcomponent_merge_vtimezone() built
+       the index, so this just fetches it again. */
+    index = icalcomponent_tzid_index_get(comp);
 
     /* Find the length of the TZID without any trailing digits. */
     tzid_len = icalcomponent_get_tzid_prefix_len(tzid);
@@ -2008,24 +5554,37 @@ static void icalcomponent_handle_conflicting_vtimezones(icalcomponent *comp,
 
         /* Check if we have the same prefix. */
         if (tzid_len == existing_tzid_len && !strncmp(tzid, existing_tzid, tzid_len)) {
+            int hashes_differ = 0;
+
+            /* When the content digests disagree, the zones cannot match
+               and the serializing comparison can be skipped. */
+            if (index && existing_tzid) {
+                struct icalcomponent_tzid_entry *entry =
+                    icalcomponent_tzid_index_lookup(index, existing_tzid);
+
+                if (entry != 0 && entry->content_hash != content_hash)
+                    hashes_differ = 1;
+            }
+
             /* Compare the VTIMEZONEs. */
-            if (icalcomponent_compare_vtimezones(icaltimezone_get_component(zone), vtimezone)) {
+            if (!hashes_differ &&
+                icalcomponent_compare_vtimezones(icaltimezone_get_component(zone), vtimezone)) {
                 /* The VTIMEZONEs match, so we can use the existing VTIMEZONE. But
                    we have to rename TZIDs to this TZID. */
-                tzid_copy = strdup(tzid);
+                tzid_copy = icalmemory_strdup(tzid);
                 if (!tzid_copy) {
                     icalerror_set_errno(ICAL_NEWFAILED_ERROR);
                     return;
                 }
-                existing_tzid_copy = strdup(existing_tzid);
+                existing_tzid_copy = icalmemory_strdup(existing_tzid);
                 if (!existing_tzid_copy) {
                     icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-                    free(tzid_copy);
+                    icalmemory_free_buffer(tzid_copy);
                 } else {
-                    icalarray_append(tzids_to_rename, tzid_copy);
-                    free(tzid_copy);
-                    icalarray_append(tzids_to_rename, existing_tzid_copy);
-                    free(existing_tzid_copy);
+                    /* The array stores the pointers; it takes ownership of
+                       both copies, which the caller frees after renaming. */
+                    icalarray_append(tzids_to_rename, &tzid_copy);
+                    icalarray_append(tzids_to_rename, &existing_tzid_copy);
                 }
                 return;
             } else {
@@ -2042,26 +5601,32 @@ static void icalcomponent_handle_conflicting_vtimezones(icalcomponent *comp,
 
     /* We didn't find a VTIMEZONE that matched, so we have to rename the TZID,
        using the maximum numerical suffix found + 1. */
-    tzid_copy = strdup(tzid);
+    tzid_copy = icalmemory_strdup(tzid);
     if (!tzid_copy) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return;
     }
 
     snprintf(suffix_buf, sizeof(suffix_buf), "%i", max_suffix + 1);
-    new_tzid = malloc(tzid_len + strlen(suffix_buf) + 1);
+    new_tzid = icalmemory_new_buffer(tzid_len + strlen(suffix_buf) + 1);
     if (!new_tzid) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-        free(tzid_copy);
+        icalmemory_free_buffer(tzid_copy);
         return;
     }
 
     strncpy(new_tzid, tzid, tzid_len);
     strcpy(new_tzid + tzid_len, suffix_buf);
-    icalarray_append(tzids_to_rename, tzid_copy);
-    icalarray_append(tzids_to_rename, new_tzid);
-    free(tzid_copy);
-    free(new_tzid);
+
+    /* Rename the VTIMEZONE itself and move it over to comp; the rename
+       table then takes care of the TZID references left behind. The
+       array takes ownership of both string copies. */
+    icalproperty_set_tzid(tzid_prop, new_tzid);
+    icalcomponent_remove_component(icalcomponent_get_parent(vtimezone), vtimezone);
+    icalcomponent_add_component(comp, vtimezone);
+
+    icalarray_append(tzids_to_rename, &tzid_copy);
+    icalarray_append(tzids_to_rename, &new_tzid);
 }
 
 /* Returns the length of the TZID, without any trailing digits. */
@@ -2103,8 +5668,8 @@ static void icalcomponent_rename_tzids_callback(icalparameter *param, void *data
     /* Step through the rename table to see if the current TZID matches
        any of the ones we want to rename. */
     for (i = 0; i < rename_table->num_elements - 1; i += 2) {
-        if (!strcmp(tzid, icalarray_element_at(rename_table, i))) {
-            icalparameter_set_tzid(param, icalarray_element_at(rename_table, i + 1));
+        if (!strcmp(tzid, *(char **)icalarray_element_at(rename_table, i))) {
+            icalparameter_set_tzid(param, *(char **)icalarray_element_at(rename_table, i + 1));
             break;
         }
     }
@@ -2157,10 +5722,37 @@ icaltimezone *icalcomponent_get_timezone(icalcomponent *comp, const char *tzid)
     if (!comp->timezones)
         return NULL;
 
+    /* Answer from the TZID index when we have one, so resolving zone
+       references during and after parse costs one hash lookup instead
+       of a sort and a binary search. */
+    {
+        struct icalcomponent_tzid_index *index = icalcomponent_tzid_index_get(comp);
+
+        if (index) {
+            struct icalcomponent_tzid_entry *entry =
+                icalcomponent_tzid_index_lookup(index, tzid);
+
+            if (entry == 0) {
+                return NULL;
+            }
+            if (entry->zone != 0) {
+                return entry->zone;
+            }
+            /* A zone missing from the array; fall through to the scan. */
+        }
+    }
+
     /* Sort the array if necessary (by the TZID string). */
     if (!comp->timezones_sorted) {
         icalarray_sort(comp->timezones, icalcomponent_compare_timezone_fn);
         comp->timezones_sorted = 1;
+
+        /* Sorting moved the elements, so any indexed zone pointers are
+           stale now. */
+        if (comp->tzid_index != 0) {
+            icalcomponent_tzid_index_free(comp->tzid_index);
+            comp->tzid_index = 0;
+        }
     }
 
     /* Do a simple binary search. */
@@ -2234,7 +5826,7 @@ static int icalcomponent_compare_vtimezones(icalcomponent *vtimezone1, icalcompo
 
     /* Copy the second TZID, and set the property to the same as the first
        TZID, since we don't care if these match of not. */
-    tzid2_copy = strdup(tzid2);
+    tzid2_copy = icalmemory_strdup(tzid2);
     if (!tzid2_copy) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
@@ -2245,25 +5837,25 @@ static int icalcomponent_compare_vtimezones(icalcomponent *vtimezone1, icalcompo
     /* Now convert both VTIMEZONEs to strings and compare them. */
     string1 = icalcomponent_as_ical_string_r(vtimezone1);
     if (!string1) {
-        free(tzid2_copy);
+        icalmemory_free_buffer(tzid2_copy);
         return -1;
     }
 
     string2 = icalcomponent_as_ical_string_r(vtimezone2);
     if (!string2) {
-        free(string1);
-        free(tzid2_copy);
+        icalmemory_free_buffer(string1);
+        icalmemory_free_buffer(tzid2_copy);
         return -1;
     }
 
     cmp = strcmp(string1, string2);
 
-    free(string1);
-    free(string2);
+    icalmemory_free_buffer(string1);
+    icalmemory_free_buffer(string2);
 
     /* Now reset the second TZID. */
     icalproperty_set_tzid(prop2, tzid2_copy);
-    free(tzid2_copy);
+    icalmemory_free_buffer(tzid2_copy);
 
     return (cmp == 0) ? 1 : 0;
 }
@@ -2560,6 +6152,7 @@ void icalcomponent_normalize(icalcomponent *comp)
 
     pvl_free(comp->properties);
     comp->properties = sorted_props;
+    comp->property_generation++;
 
     /* Normalize sub-components into sorted list */
     while ((sub = pvl_pop(comp->components)) != 0) {
@@ -2569,4 +6162,6 @@ void icalcomponent_normalize(icalcomponent *comp)
 
     pvl_free(comp->components);
     comp->components = sorted_comps;
+    comp->component_generation++;
+    icalcomponent_content_changed(comp);
 }
@@ -25,7 +25,9 @@
 
 #include "libical_deprecated.h"
 #include "libical_ical_export.h"
+#include "icalarray.h"
 #include "icalenums.h"  /* Defines icalcomponent_kind */
+#include "icalerror.h"  /* Defines icalerrorenum */
 #include "icalproperty.h"
 #include "pvl.h"
 
@@ -40,6 +42,17 @@ typedef struct icalcompiter
 
 } icalcompiter;
 
+/** External property iterator; same deal as ::icalcompiter. Unlike
+   icalcomponent_get_first_property(), iterating with one of these keeps
+   no state in the component, so several threads may walk a frozen
+   component at once. */
+typedef struct icalpropiter
+{
+    icalproperty_kind kind;
+    pvl_elem iter;
+
+} icalpropiter;
+
 /**
  * @brief Constructor
  * Deeply clone an icalcomponent.
@@ -70,6 +83,73 @@ LIBICAL_ICAL_EXPORT char *icalcomponent_as_ical_string(icalcomponent *component)
 
 LIBICAL_ICAL_EXPORT char *icalcomponent_as_ical_string_r(icalcomponent *component);
 
+/**
+ * @brief Writes a component to a file descriptor.
+ * @param component The component to serialize
+ * @param fd An open, writable file descriptor
+ * @return The number of bytes written, or -1 on error
+ * @since 3.1.0
+ *
+ * Emits the same bytes as icalcomponent_as_ical_string() but hands the
+ * rendered property fragments straight to the descriptor (gathered with
+ * writev() where available), so no monolithic output string is
+ * assembled first. Short writes are retried until the whole component
+ * is written.
+ *
+ * @par Error handling
+ * Returns -1 and sets ::icalerrno to ::ICAL_BADARG_ERROR for invalid
+ * arguments, or to ::ICAL_FILE_ERROR when the descriptor write fails.
+ */
+LIBICAL_ICAL_EXPORT long icalcomponent_write_fd(icalcomponent *component, int fd);
+
+/**
+ * @typedef icalcomponent_sink_func
+ * @brief Receives one chunk of serialized iCalendar data.
+ * @param data The chunk; not NUL-terminated
+ * @param size Number of bytes in @a data
+ * @param d The user data pointer passed to icalcomponent_serialize()
+ * @return 0 to continue serializing, nonzero to abort
+ * @since 3.1.0
+ */
+typedef int (*icalcomponent_sink_func) (const char *data, size_t size, void *d);
+
+/**
+ * @brief Serializes a component through a callback with bounded memory.
+ * @param component The component to serialize
+ * @param sink Called with successive chunks of folded output
+ * @param d Opaque user data handed to every @a sink call
+ * @return 0 when the whole component was emitted, 1 when the sink
+ *  aborted, or an ::icalerrorenum for invalid arguments
+ * @since 3.1.0
+ *
+ * Produces the same bytes as icalcomponent_as_ical_string() but pushes
+ * them to @a sink as they are rendered, one property at a time and at
+ * most a few kilobytes per call, instead of building the whole output
+ * in one allocation. Peak memory is bounded by the largest single
+ * property rather than by the component size, which matters for
+ * components like a VFREEBUSY carrying many thousands of periods.
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_serialize(icalcomponent *component,
+                                                icalcomponent_sink_func sink, void *d);
+
+/**
+ * @brief Emits the component as jCal (RFC 7265 JSON) through a callback.
+ * @param component The component to convert
+ * @param sink Called with successive chunks of JSON output
+ * @param d Opaque user data handed to every @a sink call
+ * @return 0 when the whole component was emitted, 1 when the sink
+ *  aborted, or an ::icalerrorenum for invalid arguments
+ * @since 3.1.0
+ *
+ * Walks the tree once and renders each property directly from its
+ * parsed form — no intermediate iCalendar text is produced. The
+ * chunked-sink contract is the same as icalcomponent_serialize():
+ * bounded memory, a few kilobytes per call at most, and a nonzero
+ * sink return aborts the walk.
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_as_jcal(icalcomponent *component,
+                                              icalcomponent_sink_func sink, void *d);
+
 LIBICAL_ICAL_EXPORT int icalcomponent_is_valid(icalcomponent *component);
 
 LIBICAL_ICAL_EXPORT icalcomponent_kind icalcomponent_isa(const icalcomponent *component);
@@ -149,6 +229,36 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_get_first_component(icalcompone
 LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_get_next_component(icalcomponent *component,
                                                                     icalcomponent_kind kind);
 
+/**
+ * @brief Returns the child component carrying the given UID, or `NULL`.
+ *
+ * The container builds a hash index over its children's UIDs on the
+ * first lookup and reuses it until the child list changes, so resolving
+ * a UID in a large VCALENDAR is constant-time instead of a scan over
+ * every child. Children without a UID property are not indexed.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_get_component_by_uid(icalcomponent *comp,
+                                                                      const char *uid);
+
+/**
+ * @brief Returns the ATTENDEE property whose calendar address matches
+ * @p caladdress, or NULL if there is none.
+ *
+ * Addresses are compared case-insensitively and an optional mailto:
+ * scheme on either side is ignored, so "mailto:A@example.com" finds
+ * "attendee a@example.com". The lookup goes through a hash index over
+ * the (inner) component's attendees, built on the first call and
+ * reused until the property list changes, so matching a REPLY sender
+ * against a large attendee list is constant-time instead of a string
+ * compare per attendee.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalproperty *icalcomponent_get_attendee(icalcomponent *comp,
+                                                             const char *caladdress);
+
 /* Using external iterators */
 LIBICAL_ICAL_EXPORT icalcompiter icalcomponent_begin_component(icalcomponent *component,
                                                                icalcomponent_kind kind);
@@ -162,6 +272,213 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalcompiter_prior(icalcompiter * i);
 
 LIBICAL_ICAL_EXPORT icalcomponent *icalcompiter_deref(icalcompiter * i);
 
+/**
+ * @brief Returns an external iterator positioned on the first property
+ * of the given kind.
+ * @since 3.1.0
+ *
+ * The internal iteration functions, icalcomponent_get_first_property()
+ * and icalcomponent_get_next_property(), store their cursor inside the
+ * component, so only one such loop can run over a component at a time.
+ * The external iterator keeps the cursor in the caller's ::icalpropiter
+ * instead and never writes to the component, which makes it the way to
+ * read properties of a component shared between threads (see
+ * icalcomponent_freeze()).
+ */
+LIBICAL_ICAL_EXPORT icalpropiter icalcomponent_begin_property(icalcomponent *component,
+                                                              icalproperty_kind kind);
+
+LIBICAL_ICAL_EXPORT icalproperty *icalpropiter_next(icalpropiter *i);
+
+LIBICAL_ICAL_EXPORT icalproperty *icalpropiter_deref(icalpropiter *i);
+
+/** @brief One output column for icalcomponent_extract_columns().
+ * @since 3.1.0
+ */
+typedef struct icalextract_column
+{
+    icalproperty_kind prop_kind; /**< property to read from each subcomponent */
+    icalvalue_kind value_kind;   /**< how to decode it; selects the element type of values */
+    void *values;                /**< caller-provided array of at least max_rows elements */
+} icalextract_column;
+
+/**
+ * @brief Columnar extraction: fills parallel typed arrays from the
+ * subcomponents of @p component in one pass.
+ * @since 3.1.0
+ *
+ * Visits each subcomponent of kind @p kind (in order) and, for every
+ * column, decodes that subcomponent's property of the column's
+ * prop_kind into values[row]. The element type of a column's array
+ * follows its value_kind:
+ *
+ * - ::ICAL_DATE_VALUE or ::ICAL_DATETIME_VALUE: struct icaltimetype,
+ *   missing property yields icaltime_null_time()
+ * - ::ICAL_DURATION_VALUE: struct icaldurationtype, missing property
+ *   yields icaldurationtype_null_duration()
+ * - ::ICAL_INTEGER_VALUE: int, missing property yields 0
+ * - any other kind: const char *, a non-owning pointer into the
+ *   property's storage (valid until the component is modified or
+ *   freed), NULL when missing
+ *
+ * If a subcomponent has several properties of a column's kind, the
+ * last one wins. Stops after @p max_rows subcomponents.
+ *
+ * The single traversal replaces one lookup chain per component and
+ * per property, and the struct-of-arrays layout suits batch
+ * processing of the results.
+ *
+ * @return the number of rows filled, or -1 on bad arguments.
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_extract_columns(icalcomponent *component,
+                                                      icalcomponent_kind kind,
+                                                      icalextract_column *columns,
+                                                      size_t columns_count, size_t max_rows);
+
+/**
+ * @brief Marks the component and all of its children immutable.
+ * @since 3.1.0
+ *
+ * After freezing, any attempt to add or remove properties or
+ * subcomponents fails and sets ::icalerrno to ::ICAL_USAGE_ERROR, and
+ * the read accessors stop writing to the component's internal caches.
+ * Anything computed lazily — the timezone sort order and the child UID
+ * index — is resolved up front, so a frozen tree can be read from many
+ * threads at once with no synchronization. A typical use is parsing a
+ * template component once, freezing it, and sharing it across request
+ * threads.
+ *
+ * Two caveats: icalcomponent_get_first_property() and the other
+ * internal iteration functions still keep their cursor inside the
+ * component, so concurrent readers must use the external iterators
+ * (::icalpropiter, ::icalcompiter) instead; and freezing is permanent —
+ * to modify the data, take an icalcomponent_clone(), which is unfrozen.
+ */
+LIBICAL_ICAL_EXPORT void icalcomponent_freeze(icalcomponent *component);
+
+/** @brief Returns nonzero if the component has been frozen with
+ * icalcomponent_freeze().
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_is_frozen(icalcomponent *component);
+
+/**
+ * @brief Returns the component's subtree mutation counter.
+ * @since 3.1.0
+ *
+ * The counter moves whenever a property or subcomponent anywhere below
+ * the component is added, removed or edited in place; mutations
+ * propagate up through the parent links. Comparing a saved value
+ * against the current one therefore answers "has this subtree changed
+ * since the snapshot" in constant time, without walking or hashing the
+ * tree. The absolute value carries no meaning and is not stable across
+ * processes.
+ */
+LIBICAL_ICAL_EXPORT unsigned int icalcomponent_content_generation(icalcomponent *component);
+
+/**
+ * @brief Returns a canonical 64-bit digest of the component.
+ * @since 3.1.0
+ *
+ * The digest covers the component's kind and every property (name,
+ * parameters and value) plus all subcomponents, and is insensitive to
+ * the order of properties and of subcomponents, so two components
+ * that icalcomponent_equal() considers equal always hash alike.
+ * Per-component results are cached and revalidated against the
+ * mutation counters, making repeated hashing of a large, mostly
+ * unchanged tree cheap; this is the building block for hash-table
+ * deduplication instead of pairwise text comparison.
+ */
+LIBICAL_ICAL_EXPORT unsigned long long icalcomponent_hash(icalcomponent *component);
+
+/**
+ * @brief Compares two components for structural equality.
+ * @since 3.1.0
+ *
+ * Returns nonzero when both trees carry the same properties and
+ * subcomponents, in any order. The cached hashes short-circuit the
+ * common unequal case; only components the digests cannot separate
+ * are compared precisely.
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_equal(icalcomponent *a, icalcomponent *b);
+
+/**
+ * @brief Computes a structural diff between two components of the
+ * same kind.
+ * @since 3.1.0
+ *
+ * Returns a newly allocated XPATCH component describing how to turn
+ * @p oldc into @p newc, which the caller owns. Properties and
+ * subcomponents are matched pairwise by kind and 0-based occurrence
+ * index in component order; the patch carries one record per changed,
+ * removed or added property, deletions addressed by '#NAME[idx]'
+ * selectors in PATCH-DELETE properties and replacements marked with
+ * an X-PATCH-INDEX parameter. Differing subcomponent pairs become
+ * nested XPATCH components with a '/NAME[idx]' PATCH-TARGET. An
+ * empty patch (no properties, no subcomponents) means the two
+ * components already serialize identically. For the dominant
+ * touched-one-field synchronization case the patch is a single
+ * property instead of the whole component.
+ *
+ * Returns NULL and sets ::icalerrno on bad arguments (including
+ * components of different kinds) or allocation failure.
+ *
+ * @sa icalcomponent_apply_patch()
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_diff(icalcomponent *oldc, icalcomponent *newc);
+
+/**
+ * @brief Applies a patch produced by icalcomponent_diff() to
+ * @p component in place.
+ * @since 3.1.0
+ *
+ * Replacement records keep the property's position in the component;
+ * appends go to the end, matching where icalcomponent_diff() computed
+ * them. The patch itself is not modified and can be applied to any
+ * component with the same shape as the diff's old side.
+ *
+ * @return 0 on success, or an ::icalerrorenum: ::ICAL_BADARG_ERROR
+ *  for invalid arguments, ::ICAL_MALFORMEDDATA_ERROR when a patch
+ *  selector does not resolve against @p component.
+ */
+LIBICAL_ICAL_EXPORT int icalcomponent_apply_patch(icalcomponent *component, icalcomponent *patch);
+
+/**
+ * @brief Encodes @p component, with all of its properties, parameters
+ * and subcomponents, into a compact binary buffer.
+ * @since 3.1.0
+ *
+ * The encoding is a versioned, position-independent record stream with
+ * an interned string table, so it is safe to write to disk or ship
+ * between processes of the same libical version; component, property,
+ * parameter and value kinds are stored as their numeric enum values.
+ * Times, durations, periods and numeric values are stored in their
+ * decoded binary form, which makes reloading them much cheaper than
+ * reparsing the iCalendar text.
+ *
+ * On success, stores the buffer size in @p size and returns the
+ * buffer, which the caller must release with icalmemory_free_buffer().
+ * Returns NULL on bad arguments or allocation failure.
+ *
+ * @sa icalcomponent_from_binary()
+ */
+LIBICAL_ICAL_EXPORT char *icalcomponent_to_binary(icalcomponent *component, size_t *size);
+
+/**
+ * @brief Rebuilds a component tree from a buffer produced by
+ * icalcomponent_to_binary().
+ * @since 3.1.0
+ *
+ * The buffer is decoded in a single bounds-checked pass and may live
+ * anywhere — a heap copy, a static blob, or an mmap'ed file; it is
+ * only read, never modified, and is not referenced by the returned
+ * component. Returns a newly allocated component that the caller owns,
+ * or NULL with ::icalerrno set to ::ICAL_MALFORMEDDATA_ERROR if the
+ * buffer is truncated, of a different format version, or otherwise
+ * corrupt.
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_from_binary(const char *data, size_t size);
+
 /***** Working with embedded error properties *****/
 
 /* Check the component against itip rules and insert error properties*/
@@ -224,6 +541,21 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalcomponent_get_first_real_component(icalco
  */
 LIBICAL_ICAL_EXPORT struct icaltime_span icalcomponent_get_span(icalcomponent *comp);
 
+/**     @brief Gets the spans of every real child of @p comp in one
+ *      traversal.
+ *
+ *      Fills a packed array with the icalcomponent_get_span() result
+ *      of each VEVENT, VTODO, VJOURNAL and VFREEBUSY child, in
+ *      traversal order, and stores the number of entries in @p count.
+ *      Returns NULL (with @p count set to 0) when there are no such
+ *      children. The caller owns the returned array and must free it
+ *      with icalmemory_free_buffer().
+ *
+ *      @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT struct icaltime_span *icalcomponent_get_spans_array(icalcomponent *comp,
+                                                                        int *count);
+
 /******************** Convenience routines **********************/
 
 /**     @brief Sets the DTSTART property to the given icaltime,
@@ -357,6 +689,15 @@ LIBICAL_ICAL_EXPORT struct icaltimetype icalcomponent_get_dtstamp(icalcomponent
 
 LIBICAL_ICAL_EXPORT void icalcomponent_set_dtstamp(icalcomponent *comp, struct icaltimetype v);
 
+/**
+ * @brief Sets the DTSTAMP of each of @p count components to the
+ * current UTC time, reading the clock once for the whole batch.
+ * @since 3.1.0
+ *
+ * NULL entries in @p comps are skipped.
+ */
+LIBICAL_ICAL_EXPORT void icalcomponent_set_dtstamp_now(icalcomponent **comps, size_t count);
+
 LIBICAL_ICAL_EXPORT void icalcomponent_set_summary(icalcomponent *comp, const char *v);
 
 LIBICAL_ICAL_EXPORT const char *icalcomponent_get_summary(icalcomponent *comp);
@@ -378,6 +719,40 @@ LIBICAL_ICAL_EXPORT void icalcomponent_set_recurrenceid(icalcomponent *comp,
 
 LIBICAL_ICAL_EXPORT struct icaltimetype icalcomponent_get_recurrenceid(icalcomponent *comp);
 
+/** The scheduling-relevant fields of a component, filled by
+ *  icalcomponent_get_schedule_info() in a single property traversal.
+ *  @since 3.1.0
+ */
+struct icalcomponent_schedule_info
+{
+    struct icaltimetype dtstart;      /**< DTSTART, or null time */
+    struct icaltimetype dtend;        /**< DTEND, or DTSTART+DURATION, or null time */
+    struct icaldurationtype duration; /**< DURATION, or DTEND-DTSTART, or null duration */
+    struct icaltimetype recurrenceid; /**< RECURRENCE-ID, or null time */
+    const char *uid;                  /**< UID, borrowed from the component, or NULL */
+    int is_recurring;                 /**< true if an RRULE or RDATE is present */
+};
+
+/** @brief Fills @p info with the component's scheduling fields in one
+ *  pass over its property list.
+ *
+ *  @return ICAL_NO_ERROR on success, ICAL_BADARG_ERROR or
+ *          ICAL_MALFORMEDDATA_ERROR on bad input.
+ *  @since 3.1.0
+ *
+ *  Equivalent to calling icalcomponent_get_dtstart(), _get_dtend(),
+ *  _get_duration(), _get_uid() and _get_recurrenceid() individually —
+ *  including the derivation of DTEND from DTSTART+DURATION and vice
+ *  versa — but walks the property list once instead of once per field,
+ *  and leaves the component's property iterator untouched. When both
+ *  DTEND and DURATION are present the duration field is left null, as
+ *  icalcomponent_get_duration() reports for that malformed case. The
+ *  uid pointer borrows from the component and is valid only while the
+ *  property is unchanged.
+ */
+LIBICAL_ICAL_EXPORT icalerrorenum icalcomponent_get_schedule_info(
+    icalcomponent *comp, struct icalcomponent_schedule_info *info);
+
 LIBICAL_ICAL_EXPORT void icalcomponent_set_description(icalcomponent *comp, const char *v);
 
 LIBICAL_ICAL_EXPORT const char *icalcomponent_get_description(icalcomponent *comp);
@@ -460,6 +835,81 @@ LIBICAL_ICAL_EXPORT void icalcomponent_foreach_recurrence(icalcomponent *comp,
                                                                             span, void *data),
                                                           void *callback_data);
 
+/**
+ * @brief Expands the recurrences of several components on multiple threads.
+ *
+ * Runs icalcomponent_foreach_recurrence() over each of the @p count
+ * components in @p comps for the range [@p start, @p end], dispatching
+ * components to up to @p num_threads threads (the calling thread
+ * counts as one).  @p callback_data holds one entry per component, so
+ * each component's callbacks write into their own result buffer and the
+ * callback itself needs no locking as long as it only touches its own
+ * entry.  Components must not share structure.  With @p num_threads of
+ * 1, or where pthreads are unavailable, the components are expanded
+ * serially on the calling thread.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalcomponent_foreach_recurrence_batch(
+    icalcomponent *const *comps, size_t count,
+    struct icaltimetype start,
+    struct icaltimetype end,
+    void (*callback) (icalcomponent *comp,
+                      struct icaltime_span *span, void *data),
+    void *const *callback_data, int num_threads);
+
+/**
+ * @brief Returns the occurrence spans of @p comp between @p start and
+ * @p end, served from a per-component cache when possible.
+ *
+ * The first call expands the component with
+ * icalcomponent_foreach_recurrence() and memoizes the spans on the
+ * component; later calls whose window lies within an already expanded
+ * one are answered from the cache without re-expanding the rules. The
+ * cache is invalidated by any property edit (RRULE, RDATE, EXDATE,
+ * DTSTART, ...), so the answer always reflects the current rules.
+ *
+ * @return A new icalarray of struct icaltime_span elements sorted by
+ * start time, owned by the caller and released with icalarray_free(),
+ * or NULL on error.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalarray *icalcomponent_get_occurrences_cached(icalcomponent *comp,
+                                                                    struct icaltimetype start,
+                                                                    struct icaltimetype end);
+
+/**
+ * @brief One alarm fire produced by icalcomponent_get_alarm_times().
+ * @since 3.1.0
+ */
+struct icalcomponent_alarm_time
+{
+    time_t trigger;      /**< when the alarm fires, in UTC */
+    icalcomponent *comp; /**< the event or todo the alarm belongs to */
+    icalcomponent *alarm; /**< the VALARM subcomponent */
+};
+
+/**
+ * @brief Computes every alarm fire between @p start and @p end.
+ *
+ * Sweeps the VALARM subcomponents of @p comp — or, when @p comp is a
+ * VCALENDAR, of each VEVENT and VTODO child — and resolves each TRIGGER
+ * to concrete fire times.  Absolute triggers are used as-is; relative
+ * triggers (including TRIGGER;RELATED=END) are resolved against the
+ * parent's occurrences, which are expanded once per component through
+ * the occurrence span cache.  REPEAT/DURATION chains are expanded too.
+ *
+ * @return A new icalarray of struct icalcomponent_alarm_time elements
+ * sorted by fire time, owned by the caller and released with
+ * icalarray_free(), or NULL on error.  The component pointers are
+ * borrowed from @p comp and remain valid as long as it does.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalarray *icalcomponent_get_alarm_times(icalcomponent *comp,
+                                                             struct icaltimetype start,
+                                                             struct icaltimetype end);
+
 /**
  * @brief Normalizes (reorders and sorts the properties) the specified icalcomponent @p comp.
  * @since 3.0
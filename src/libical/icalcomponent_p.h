@@ -0,0 +1,39 @@
+/*======================================================================
+ FILE: icalcomponent_p.h
+
+ (C) COPYRIGHT 2000, Eric Busboom <eric@civicknowledge.com>
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+======================================================================*/
+
+#ifndef ICALCOMPONENT_P_H
+#define ICALCOMPONENT_P_H
+
+#include "icalcomponent.h"
+
+/* Bumps the component's property generation counter. Called when an
+   attached property is mutated in place, so the generation-keyed
+   caches notice changes that do not go through add/remove. */
+LIBICAL_ICAL_NO_EXPORT void icalcomponent_touch(icalcomponent *component);
+
+/* Cache of the last restriction check result, keyed to the method and
+   to the property generation; used by
+   icalrestriction_check_incremental(). The getter returns nonzero and
+   fills *valid when the cached result is still usable. */
+LIBICAL_ICAL_NO_EXPORT int icalcomponent_restriction_cache_get(icalcomponent *component,
+                                                               icalproperty_method method,
+                                                               int *valid);
+LIBICAL_ICAL_NO_EXPORT void icalcomponent_restriction_cache_set(icalcomponent *component,
+                                                                icalproperty_method method,
+                                                                int valid);
+
+#endif /* ICALCOMPONENT_P_H */
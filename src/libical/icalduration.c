@@ -66,14 +66,12 @@ struct icaldurationtype icaldurationtype_from_string(const char *str)
     int time_flag = 0;
     int date_flag = 0;
     int digits = -1;
-    int scan_size = -1;
-    int size = (int)strlen(str);
     char p;
     struct icaldurationtype d;
 
     memset(&d, 0, sizeof(struct icaldurationtype));
 
-    for (i = 0; i != size; i++) {
+    for (i = 0; str[i] != '\0'; i++) {
         p = str[i];
 
         switch (p) {
@@ -128,11 +126,18 @@ struct icaldurationtype icaldurationtype_from_string(const char *str)
                 if (begin_flag == 0) {
                     goto error;
                 }
-                /* Get all of the digits, not one at a time */
-                scan_size = sscanf(&str[i], "%10d", &digits);   /*limit to 10digits.
-                                                                  increase as needed */
-                if (scan_size == 0) {
-                    goto error;
+                /* Accumulate the whole digit run here, limited to 10
+                   digits as before; this used to be an sscanf call,
+                   which dominated FREEBUSY ingestion profiles */
+                {
+                    int n = 0;
+                    int nd = 0;
+
+                    while (nd < 10 && (unsigned int)(str[i + nd] - '0') <= 9) {
+                        n = n * 10 + (str[i + nd] - '0');
+                        nd++;
+                    }
+                    digits = n;
                 }
                 break;
             }
@@ -77,17 +77,31 @@ static const struct
     {ICAL_UNKNOWN_STATUS, 0, 0, "Error: Unknown request status"}
 };
 
+/* The map rows are in the same order as enum icalrequeststatus, which
+   starts at ICAL_UNKNOWN_STATUS = 0, so the row for a status is found
+   by direct indexing rather than a scan. */
+static int icalenum_reqstat_index(icalrequeststatus stat)
+{
+    int i = (int)stat - 1;
+
+    if (i < 0 ||
+        i >= (int)(sizeof(request_status_map) / sizeof(request_status_map[0])) - 1 ||
+        request_status_map[i].kind != stat) {
+        return -1;
+    }
+
+    return i;
+}
+
 const char *icalenum_reqstat_desc(icalrequeststatus stat)
 {
-    int i;
+    int i = icalenum_reqstat_index(stat);
 
-    for (i = 0; request_status_map[i].kind != ICAL_UNKNOWN_STATUS; i++) {
-        if (request_status_map[i].kind == stat) {
-            return request_status_map[i].str;
-        }
+    if (i < 0) {
+        return 0;
     }
 
-    return 0;
+    return request_status_map[i].str;
 }
 
 char *icalenum_reqstat_code(icalrequeststatus stat)
@@ -101,42 +115,40 @@ char *icalenum_reqstat_code(icalrequeststatus stat)
 
 char *icalenum_reqstat_code_r(icalrequeststatus stat)
 {
-    int i, major, minor;
+    int major, minor;
     char tmpbuf[36];
+    int i = icalenum_reqstat_index(stat);
 
-    for (i = 0; request_status_map[i].kind != ICAL_UNKNOWN_STATUS; i++) {
-        if (request_status_map[i].kind == stat) {
-            major = request_status_map[i].major;
-            minor = request_status_map[i].minor;
-            snprintf(tmpbuf, sizeof(tmpbuf), "%i.%i", major, minor);
-            return icalmemory_strdup(tmpbuf);
-        }
+    if (i < 0) {
+        return NULL;
     }
-    return NULL;
+
+    major = request_status_map[i].major;
+    minor = request_status_map[i].minor;
+    snprintf(tmpbuf, sizeof(tmpbuf), "%i.%i", major, minor);
+    return icalmemory_strdup(tmpbuf);
 }
 
 short icalenum_reqstat_major(icalrequeststatus stat)
 {
-    int i;
+    int i = icalenum_reqstat_index(stat);
 
-    for (i = 0; request_status_map[i].kind != ICAL_UNKNOWN_STATUS; i++) {
-        if (request_status_map[i].kind == stat) {
-            return request_status_map[i].major;
-        }
+    if (i < 0) {
+        return -1;
     }
-    return -1;
+
+    return request_status_map[i].major;
 }
 
 short icalenum_reqstat_minor(icalrequeststatus stat)
 {
-    int i;
+    int i = icalenum_reqstat_index(stat);
 
-    for (i = 0; request_status_map[i].kind != ICAL_UNKNOWN_STATUS; i++) {
-        if (request_status_map[i].kind == stat) {
-            return request_status_map[i].minor;
-        }
+    if (i < 0) {
+        return -1;
     }
-    return -1;
+
+    return request_status_map[i].minor;
 }
 
 icalrequeststatus icalenum_num_to_reqstat(short major, short minor)
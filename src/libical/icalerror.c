@@ -30,7 +30,51 @@
 #include <execinfo.h>
 #endif
 
-#if defined(HAVE_PTHREAD)
+/* Compiler-supported thread-local storage beats a pthread key: every
+   icalerrno access through the key costs pthread_once +
+   pthread_getspecific and the first one on each thread allocates,
+   while a TLS variable is a plain load. The key-based path stays for
+   threaded toolchains without TLS support. */
+#if defined(__GNUC__) || defined(__clang__)
+#define ICAL_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && \
+    !defined(__STDC_NO_THREADS__)
+#define ICAL_THREAD_LOCAL _Thread_local
+#endif
+
+/** How many collected errors the deferred buffer retains; further ones
+    are counted but dropped */
+#define ICALERROR_DEFERRED_MAX 16
+
+/** The per-thread state of deferred error collection. While @c active,
+    icalerror_set_errno() appends to @c errors instead of running the
+    error-state lookup and fatal dispatch. */
+struct icalerror_deferred
+{
+    int active;                 /**< collecting rather than dispatching */
+    int count;                  /**< errors retained in @c errors */
+    int head;                   /**< next error to drain */
+    int overflow;               /**< collected errors that did not fit */
+    icalerrorenum errors[ICALERROR_DEFERRED_MAX];
+};
+
+#if defined(ICAL_THREAD_LOCAL)
+
+static ICAL_THREAD_LOCAL icalerrorenum icalerrno_storage = ICAL_NO_ERROR;
+
+icalerrorenum *icalerrno_return(void)
+{
+    return &icalerrno_storage;
+}
+
+static ICAL_THREAD_LOCAL struct icalerror_deferred icalerror_deferred_storage;
+
+static struct icalerror_deferred *icalerror_deferred_return(void)
+{
+    return &icalerror_deferred_storage;
+}
+
+#elif defined(HAVE_PTHREAD)
 #include <pthread.h>
 
 static pthread_key_t icalerrno_key;
@@ -63,6 +107,35 @@ icalerrorenum *icalerrno_return(void)
     return _errno;
 }
 
+static pthread_key_t icalerror_deferred_key;
+static pthread_once_t icalerror_deferred_key_once = PTHREAD_ONCE_INIT;
+
+static void icalerror_deferred_destroy(void *buf)
+{
+    free(buf);
+    pthread_setspecific(icalerror_deferred_key, NULL);
+}
+
+static void icalerror_deferred_key_alloc(void)
+{
+    pthread_key_create(&icalerror_deferred_key, icalerror_deferred_destroy);
+}
+
+static struct icalerror_deferred *icalerror_deferred_return(void)
+{
+    struct icalerror_deferred *d;
+
+    pthread_once(&icalerror_deferred_key_once, icalerror_deferred_key_alloc);
+
+    d = (struct icalerror_deferred *)pthread_getspecific(icalerror_deferred_key);
+
+    if (!d) {
+        d = calloc(1, sizeof(struct icalerror_deferred));
+        pthread_setspecific(icalerror_deferred_key, d);
+    }
+    return d;
+}
+
 #else
 
 static icalerrorenum icalerrno_storage = ICAL_NO_ERROR;
@@ -72,6 +145,13 @@ icalerrorenum *icalerrno_return(void)
     return &icalerrno_storage;
 }
 
+static struct icalerror_deferred icalerror_deferred_storage;
+
+static struct icalerror_deferred *icalerror_deferred_return(void)
+{
+    return &icalerror_deferred_storage;
+}
+
 #endif
 
 static int foo;
@@ -115,12 +195,70 @@ int icalerror_get_errors_are_fatal()
     return icalerror_errors_are_fatal;
 }
 
+void icalerror_set_deferred(int deferred)
+{
+    struct icalerror_deferred *d = icalerror_deferred_return();
+
+    d->active = (deferred != 0);
+
+    /* Entering starts a fresh batch; leaving keeps the buffer so the
+       caller can drain what the batch collected */
+    if (d->active) {
+        d->count = 0;
+        d->head = 0;
+        d->overflow = 0;
+    }
+}
+
+int icalerror_get_deferred(void)
+{
+    return icalerror_deferred_return()->active;
+}
+
+int icalerror_deferred_count(void)
+{
+    struct icalerror_deferred *d = icalerror_deferred_return();
+
+    return (d->count - d->head) + d->overflow;
+}
+
+icalerrorenum icalerror_deferred_pop(void)
+{
+    struct icalerror_deferred *d = icalerror_deferred_return();
+
+    if (d->head == d->count) {
+        return ICAL_NO_ERROR;
+    }
+
+    return d->errors[d->head++];
+}
+
 #if defined(ICAL_SETERROR_ISFUNC)
 void icalerror_set_errno(icalerrorenum x)
 {
+    icalerrorstate state;
+    struct icalerror_deferred *d = icalerror_deferred_return();
+
     icalerrno = x;
-    if (icalerror_get_error_state(x) == ICAL_ERROR_FATAL ||
-        (icalerror_get_error_state(x) == ICAL_ERROR_DEFAULT && icalerror_errors_are_fatal == 1)) {
+
+    if (d->active) {
+        /* Batch mode: just record the error. The state lookup and
+           fatal dispatch wait until the caller drains the buffer. */
+        if (x != ICAL_NO_ERROR) {
+            if (d->count < ICALERROR_DEFERRED_MAX) {
+                d->errors[d->count++] = x;
+            } else {
+                d->overflow++;
+            }
+        }
+        return;
+    }
+
+    /* Look the state up once; this runs on every error-check in the
+       parse path. */
+    state = icalerror_get_error_state(x);
+    if (state == ICAL_ERROR_FATAL ||
+        (state == ICAL_ERROR_DEFAULT && icalerror_errors_are_fatal == 1)) {
         icalerror_warn(icalerror_strerror(x));
         ical_bt();
         assert(0);
@@ -172,6 +172,56 @@ LIBICAL_ICAL_EXPORT void icalerror_set_errors_are_fatal(int fatal);
  */
 LIBICAL_ICAL_EXPORT int icalerror_get_errors_are_fatal(void);
 
+/**
+ * @brief Enters or leaves deferred error collection on the calling
+ * thread.
+ * @param deferred If true, start collecting; if false, stop.
+ * @since 3.1.0
+ *
+ * While deferred, icalerror_set_errno() records each error in a small
+ * per-thread buffer and returns immediately, skipping the error-state
+ * lookup and fatal-error dispatch. This takes that machinery off hot
+ * paths — a parse sets and clears benign errors on nearly every line —
+ * at the price of fatal-error handling being postponed until the
+ * caller drains the buffer. Entering discards anything previously
+ * collected; the mode is per-thread and has no effect on others.
+ *
+ * ### Usage
+ * ```c
+ * icalerror_set_deferred(1);
+ * // ... batch of parse calls ...
+ * icalerror_set_deferred(0);
+ * while ((e = icalerror_deferred_pop()) != ICAL_NO_ERROR) {
+ *     // inspect each collected error
+ * }
+ * ```
+ */
+LIBICAL_ICAL_EXPORT void icalerror_set_deferred(int deferred);
+
+/**
+ * @brief Returns true while the calling thread is collecting errors
+ * rather than dispatching them.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalerror_get_deferred(void);
+
+/**
+ * @brief Returns how many errors have been collected on the calling
+ * thread since deferral began.
+ * @since 3.1.0
+ *
+ * The count includes errors that no longer fit in the buffer; only the
+ * oldest ones are retained for icalerror_deferred_pop().
+ */
+LIBICAL_ICAL_EXPORT int icalerror_deferred_count(void);
+
+/**
+ * @brief Drains one collected error, oldest first.
+ * @return The error, or ::ICAL_NO_ERROR when the buffer is empty.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalerrorenum icalerror_deferred_pop(void);
+
 /* Warning messages */
 
 /**
@@ -136,50 +136,179 @@ icalcomponent *icallangbind_get_next_component(icalcomponent *c, const char *com
     return icalcomponent_get_next_component(c, kind);
 }
 
+/* Bulk variants of the iterators above: one call returns every match
+   as a NULL-terminated handle array, so a binding crosses the FFI
+   boundary once per component instead of once per element. */
+
+icalproperty **icallangbind_get_properties_array(icalcomponent *c, const char *prop)
+{
+    size_t cap = 16;
+    size_t n = 0;
+    icalproperty **array;
+    icalproperty *p;
+
+    if (c == 0 || prop == 0) {
+        return 0;
+    }
+
+    array = icalmemory_new_buffer(cap * sizeof(icalproperty *));
+
+    for (p = icallangbind_get_first_property(c, prop);
+         p != 0; p = icallangbind_get_next_property(c, prop)) {
+
+        if (n + 1 >= cap) {
+            cap *= 2;
+            array = icalmemory_resize_buffer(array, cap * sizeof(icalproperty *));
+        }
+        array[n++] = p;
+    }
+
+    array[n] = 0;
+    return array;
+}
+
+icalcomponent **icallangbind_get_components_array(icalcomponent *c, const char *comp)
+{
+    size_t cap = 16;
+    size_t n = 0;
+    icalcomponent **array;
+    icalcomponent *sub;
+
+    if (c == 0 || comp == 0) {
+        return 0;
+    }
+
+    array = icalmemory_new_buffer(cap * sizeof(icalcomponent *));
+
+    for (sub = icallangbind_get_first_component(c, comp);
+         sub != 0; sub = icallangbind_get_next_component(c, comp)) {
+
+        if (n + 1 >= cap) {
+            cap *= 2;
+            array = icalmemory_resize_buffer(array, cap * sizeof(icalcomponent *));
+        }
+        array[n++] = sub;
+    }
+
+    array[n] = 0;
+    return array;
+}
+
+struct icallangbind_event_columns *icallangbind_extract_event_columns(icalcomponent *c,
+                                                                      const char *comp)
+{
+    struct icallangbind_event_columns *cols;
+    icalcomponent **array;
+    int n, i;
+
+    if (c == 0 || comp == 0) {
+        return 0;
+    }
+
+    array = icallangbind_get_components_array(c, comp);
+
+    if (array == 0) {
+        return 0;
+    }
+
+    for (n = 0; array[n] != 0; n++) {
+    }
+
+    cols = icalmemory_new_buffer(sizeof(struct icallangbind_event_columns));
+    cols->count = n;
+    cols->dtstart = icalmemory_new_buffer((size_t)(n + 1) * sizeof(long long));
+    cols->dtend = icalmemory_new_buffer((size_t)(n + 1) * sizeof(long long));
+    cols->uid = icalmemory_new_buffer((size_t)(n + 1) * sizeof(const char *));
+    cols->summary = icalmemory_new_buffer((size_t)(n + 1) * sizeof(const char *));
+
+    for (i = 0; i < n; i++) {
+        struct icaltimetype t;
+
+        t = icalcomponent_get_dtstart(array[i]);
+        cols->dtstart[i] = icaltime_is_null_time(t) ?
+            0 : (long long)icaltime_as_timet_with_zone(t, (icaltimezone *)t.zone);
+
+        t = icalcomponent_get_dtend(array[i]);
+        cols->dtend[i] = icaltime_is_null_time(t) ?
+            0 : (long long)icaltime_as_timet_with_zone(t, (icaltimezone *)t.zone);
+
+        cols->uid[i] = icalcomponent_get_uid(array[i]);
+        cols->summary[i] = icalcomponent_get_summary(array[i]);
+    }
+
+    /* Terminators, so the string columns can also be walked without
+       the count */
+    cols->dtstart[n] = 0;
+    cols->dtend[n] = 0;
+    cols->uid[n] = 0;
+    cols->summary[n] = 0;
+
+    icalmemory_free_buffer(array);
+
+    return cols;
+}
+
+void icallangbind_event_columns_free(struct icallangbind_event_columns *cols)
+{
+    if (cols == 0) {
+        return;
+    }
+
+    icalmemory_free_buffer(cols->dtstart);
+    icalmemory_free_buffer(cols->dtend);
+    icalmemory_free_buffer((void *)cols->uid);
+    icalmemory_free_buffer((void *)cols->summary);
+    icalmemory_free_buffer(cols);
+}
+
 #define APPENDS(x) icalmemory_append_string(&buf, &buf_ptr, &buf_size, x);
 
 #define APPENDC(x) icalmemory_append_char(&buf, &buf_ptr, &buf_size, x);
 
-char *icallangbind_property_eval_string_r(icalproperty *prop, const char *sep)
+/* Appends with a length the caller already knows; APPENDL is for
+   string literals. Most of the pieces of the eval string are literals
+   or the same separator over and over, so the usual append_string
+   strlen is wasted work here. */
+#define APPENDN(x, n) icalmemory_append_string_n(&buf, &buf_ptr, &buf_size, x, n);
+#define APPENDL(x) APPENDN(x, sizeof(x) - 1)
+
+static void icallangbind_property_eval_append(icalproperty *prop, const char *sep,
+                                              size_t sep_len, char **buf_p, char **buf_ptr_p,
+                                              size_t *buf_size_p)
 {
     char tmp[25];
-    size_t buf_size = 1024;
-    char *buf;
-    char *buf_ptr;
+    char *buf = *buf_p;
+    char *buf_ptr = *buf_ptr_p;
+    size_t buf_size = *buf_size_p;
+    const char *kind_str;
     icalparameter *param;
 
     icalvalue *value;
 
-    if (prop == 0) {
-        return 0;
-    }
-
-    buf = icalmemory_new_buffer(buf_size);
-    buf_ptr = buf;
-
-    APPENDS("{ ");
+    APPENDL("{ ");
 
     value = icalproperty_get_value(prop);
 
-    APPENDS(" 'name' ");
-    APPENDS(sep);
+    APPENDL(" 'name' ");
+    APPENDN(sep, sep_len);
     APPENDC('\'');
-    APPENDS(icalproperty_kind_to_string(icalproperty_isa(prop)));
+    kind_str = icalproperty_kind_to_string(icalproperty_isa(prop));
+    APPENDN(kind_str, strlen(kind_str));
     APPENDC('\'');
 
     if (value) {
-        APPENDS(", 'value_type' ");
-        APPENDS(sep);
+        APPENDL(", 'value_type' ");
+        APPENDN(sep, sep_len);
         APPENDC('\'');
-        APPENDS(icalvalue_kind_to_string(icalvalue_isa(value)));
+        kind_str = icalvalue_kind_to_string(icalvalue_isa(value));
+        APPENDN(kind_str, strlen(kind_str));
         APPENDC('\'');
     }
 
-    APPENDS(", 'pid' ");
-    APPENDS(sep);
+    APPENDL(", 'pid' ");
+    APPENDN(sep, sep_len);
     APPENDC('\'');
-    snprintf(tmp, 25, "%p", (void *)prop);
-    APPENDS(tmp);
+    APPENDN(tmp, (size_t)snprintf(tmp, 25, "%p", (void *)prop));
     APPENDC('\'');
 
     if (value) {
@@ -215,10 +344,10 @@ char *icallangbind_property_eval_string_r(icalproperty *prop, const char *sep)
 
                 *j = 0;
 
-                APPENDS(", 'value'");
-                APPENDS(sep);
+                APPENDL(", 'value'");
+                APPENDN(sep, sep_len);
                 APPENDC('\'');
-                APPENDS(copy);
+                APPENDN(copy, (size_t)(j - copy));
                 APPENDC('\'');
 
                 free(copy);
@@ -252,19 +381,40 @@ char *icallangbind_property_eval_string_r(icalproperty *prop, const char *sep)
 
         v++;
 
-        APPENDS(", ");
+        APPENDL(", ");
         APPENDC('\'');
-        APPENDS(copy);
+        APPENDN(copy, (size_t)(v - 1 - copy));
         APPENDC('\'');
-        APPENDS(sep);
+        APPENDN(sep, sep_len);
         APPENDC('\'');
-        APPENDS(v);
+        APPENDN(v, strlen(v));
         APPENDC('\'');
         free(copy);
     }
 
     APPENDC('}');
 
+    *buf_p = buf;
+    *buf_ptr_p = buf_ptr;
+    *buf_size_p = buf_size;
+}
+
+char *icallangbind_property_eval_string_r(icalproperty *prop, const char *sep)
+{
+    size_t buf_size = 1024;
+    char *buf;
+    char *buf_ptr;
+
+    if (prop == 0) {
+        return 0;
+    }
+
+    buf = icalmemory_new_buffer(buf_size);
+    buf_ptr = buf;
+    *buf = '\0';
+
+    icallangbind_property_eval_append(prop, sep, strlen(sep), &buf, &buf_ptr, &buf_size);
+
     return buf;
 }
 
@@ -277,6 +427,51 @@ const char *icallangbind_property_eval_string(icalproperty *prop, const char *se
     return buf;
 }
 
+char *icallangbind_component_eval_string_r(icalcomponent *c, const char *sep)
+{
+    size_t buf_size = 4096;
+    char *buf;
+    char *buf_ptr;
+    size_t sep_len;
+    icalproperty *prop;
+    int first = 1;
+
+    if (c == 0) {
+        return 0;
+    }
+
+    sep_len = strlen(sep);
+    buf = icalmemory_new_buffer(buf_size);
+    buf_ptr = buf;
+    *buf = '\0';
+
+    APPENDC('[');
+
+    for (prop = icalcomponent_get_first_property(c, ICAL_ANY_PROPERTY);
+         prop != 0; prop = icalcomponent_get_next_property(c, ICAL_ANY_PROPERTY)) {
+
+        if (!first) {
+            APPENDL(", ");
+        }
+        first = 0;
+
+        icallangbind_property_eval_append(prop, sep, sep_len, &buf, &buf_ptr, &buf_size);
+    }
+
+    APPENDC(']');
+
+    return buf;
+}
+
+const char *icallangbind_component_eval_string(icalcomponent *c, const char *sep)
+{
+    char *buf;
+
+    buf = icallangbind_component_eval_string_r(c, sep);
+    icalmemory_add_tmp_buffer(buf);
+    return buf;
+}
+
 int icallangbind_string_to_open_flag(const char *str)
 {
     if (strcmp(str, "r") == 0) {
@@ -41,6 +41,66 @@ LIBICAL_ICAL_EXPORT icalcomponent *icallangbind_get_first_component(icalcomponen
 LIBICAL_ICAL_EXPORT icalcomponent *icallangbind_get_next_component(icalcomponent *c,
                                                                    const char *comp);
 
+/**
+ * Returns every property of @p c matching the kind string @p prop (as
+ * understood by icallangbind_get_first_property(), including X names)
+ * in one NULL-terminated array, so a binding makes one FFI call per
+ * component instead of one per property. The array is owned by the
+ * caller and released with icalmemory_free_buffer(); the properties in
+ * it remain owned by the component. Uses the component's internal
+ * iterator, like the first/next pair it replaces.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalproperty **icallangbind_get_properties_array(icalcomponent *c,
+                                                                     const char *prop);
+
+/**
+ * Bulk form of icallangbind_get_first_component()/get_next_component():
+ * every matching subcomponent in one NULL-terminated, caller-owned
+ * array (release with icalmemory_free_buffer()).
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalcomponent **icallangbind_get_components_array(icalcomponent *c,
+                                                                      const char *comp);
+
+/**
+ * Columnar view of the matching subcomponents: parallel contiguous
+ * arrays with one entry per component, in document order, so a binding
+ * can hand each column to an array library (or memcpy it) instead of
+ * converting one property per call. Times are epoch seconds (0 when
+ * the property is absent); the string entries point into the
+ * components and stay valid as long as the component tree does. Every
+ * column carries one terminator entry (0/NULL) past @c count.
+ */
+struct icallangbind_event_columns
+{
+    int count;
+    long long *dtstart;
+    long long *dtend;
+    const char **uid;
+    const char **summary;
+};
+
+/**
+ * Extracts DTSTART, DTEND, UID and SUMMARY for every subcomponent of
+ * @p c matching the kind string @p comp, in one C pass. Release the
+ * result with icallangbind_event_columns_free(); the strings inside
+ * remain owned by the component tree.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT struct icallangbind_event_columns *icallangbind_extract_event_columns(
+    icalcomponent *c, const char *comp);
+
+/**
+ * Frees a column set from icallangbind_extract_event_columns().
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icallangbind_event_columns_free(struct icallangbind_event_columns *cols);
+
 LIBICAL_ICAL_EXPORT icalparameter *icallangbind_get_first_parameter(icalproperty *prop);
 
 LIBICAL_ICAL_EXPORT icalparameter *icallangbind_get_next_parameter(icalproperty *prop);
@@ -51,6 +111,21 @@ LIBICAL_ICAL_EXPORT const char *icallangbind_property_eval_string(icalproperty *
 LIBICAL_ICAL_EXPORT char *icallangbind_property_eval_string_r(icalproperty *prop,
                                                               const char *sep);
 
+/**
+ * Evaluates every property of @p c into one bracketed, comma-separated
+ * list of the per-property dict strings, in a single buffer. Bindings
+ * that walk a component property-by-property through
+ * icallangbind_property_eval_string() can make one call (and one
+ * allocation) per component instead.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT const char *icallangbind_component_eval_string(icalcomponent *c,
+                                                                   const char *sep);
+
+LIBICAL_ICAL_EXPORT char *icallangbind_component_eval_string_r(icalcomponent *c,
+                                                               const char *sep);
+
 LIBICAL_ICAL_EXPORT int icallangbind_string_to_open_flag(const char *str);
 
 LIBICAL_ICAL_EXPORT const char *icallangbind_quote_as_ical(const char *str);
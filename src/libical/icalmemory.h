@@ -223,6 +223,37 @@ LIBICAL_ICAL_EXPORT void *icalmemory_resize_buffer(void *buf, size_t size);
  */
 LIBICAL_ICAL_EXPORT void icalmemory_free_buffer(void *buf);
 
+/**
+ * @brief Allocates a small fixed-size block through the per-thread
+ *  size-class pool.
+ * @param size The size of the block to allocate
+ * @return The new, zeroed block
+ * @sa icalmemory_pool_free()
+ *
+ * Blocks released with icalmemory_pool_free() are recycled through a
+ * thread-local free list, so workloads that create and free many small
+ * structs (properties, parameters, values) avoid a round trip through
+ * the system allocator per struct. Oversized requests, and all requests
+ * while an arena is installed, fall back to icalmemory_new_buffer().
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void *icalmemory_pool_alloc(size_t size);
+
+/**
+ * @brief Releases a block allocated with icalmemory_pool_alloc().
+ * @param buf The block to release
+ * @param size The size that was passed to icalmemory_pool_alloc()
+ * @sa icalmemory_pool_alloc()
+ *
+ * The block is cached on the calling thread's free list for reuse when
+ * the per-class cache has room, and released to the allocator
+ * otherwise.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_pool_free(void *buf, size_t size);
+
 /* THESE ROUTINES CAN NOT BE USED ON TMP BUFFERS. Only use them on
    normally allocated memory, or on buffers created from
    icalmemory_new_buffer, never with buffers created by
@@ -271,6 +302,19 @@ LIBICAL_ICAL_EXPORT void icalmemory_free_buffer(void *buf);
 LIBICAL_ICAL_EXPORT void icalmemory_append_string(char **buf, char **pos, size_t *buf_size,
                                                   const char *string);
 
+/**
+ * @brief Appends @a string_length bytes of @a string to a buffer.
+ *
+ * Behaves like icalmemory_append_string() but takes the length instead
+ * of calling `strlen()`, for callers that already know it (literals,
+ * repeated separators). The buffer stays NUL-terminated. @a string
+ * needs no terminator of its own.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_append_string_n(char **buf, char **pos, size_t *buf_size,
+                                                    const char *string, size_t string_length);
+
 /**
  * @brief Appends a character to a buffer.
  * @param buf The buffer to append the character to.
@@ -338,4 +382,326 @@ LIBICAL_ICAL_EXPORT void icalmemory_append_char(char **buf, char **pos, size_t *
  */
 LIBICAL_ICAL_EXPORT char *icalmemory_strdup(const char *s);
 
+/***********************************************************************
+ * Arena (region) allocation
+ ***********************************************************************/
+
+/**
+ * @struct icalmemory_arena_impl
+ * @typedef icalmemory_arena
+ * @brief An allocation arena that carves many small allocations out of
+ * large slabs and releases them all at once.
+ *
+ * Arenas are useful for parse-and-discard workloads where a parsed
+ * component tree is built from dozens of small allocations that are all
+ * freed together. Install an arena for the current thread with
+ * icalmemory_set_arena() (or per-parser with icalparser_set_arena()) and
+ * icalmemory_new_buffer() will bump-allocate from the arena's slabs,
+ * while icalmemory_free_buffer() becomes a no-op for arena-owned memory.
+ * The whole region is then released in O(1) with icalmemory_arena_free().
+ *
+ * Memory allocated while an arena is installed must not outlive the
+ * arena, and must not be released with a plain `free()`.
+ *
+ * @since 3.1.0
+ */
+typedef struct icalmemory_arena_impl icalmemory_arena;
+
+/**
+ * @brief Creates a new allocation arena.
+ * @param slab_size The size in bytes of each slab, or 0 for the default
+ * @return The new arena, or `NULL` on allocation failure
+ *
+ * Allocations larger than @a slab_size are given a dedicated slab.
+ *
+ * @par Error handling
+ * If there is a problem allocating memory, sets ::icalerrno to
+ * ::ICAL_NEWFAILED_ERROR and returns `NULL`.
+ *
+ * @par Ownership
+ * The returned arena is owned by the caller and must be released with
+ * icalmemory_arena_free().
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalmemory_arena *icalmemory_arena_new(size_t slab_size);
+
+/**
+ * @brief Allocates @a size bytes out of the arena's current slab.
+ * @return A pointer to the allocated memory, or `NULL` on failure
+ *
+ * The returned memory stays valid until icalmemory_arena_clear() or
+ * icalmemory_arena_free() is called; there is no way to release an
+ * individual allocation.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void *icalmemory_arena_alloc(icalmemory_arena *arena, size_t size);
+
+/**
+ * @brief Duplicates a string into the arena.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT char *icalmemory_arena_strdup(icalmemory_arena *arena, const char *s);
+
+/**
+ * @brief Releases every allocation made from the arena, keeping the
+ * first slab around for reuse.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_arena_clear(icalmemory_arena *arena);
+
+/**
+ * @brief Releases the arena and every allocation made from it, in O(1)
+ * per slab.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_arena_free(icalmemory_arena *arena);
+
+/**
+ * @brief Installs @a arena as the allocation arena for the current
+ * thread, or uninstalls it when @a arena is `NULL`.
+ *
+ * While an arena is installed, icalmemory_new_buffer() draws from the
+ * arena, icalmemory_free_buffer() ignores arena-owned pointers, and
+ * icalmemory_resize_buffer() relocates arena-owned buffers inside the
+ * arena. Pointers that were on the heap before the arena was installed
+ * are still recognized and handled normally.
+ *
+ * Callers are expected to save the previous arena with
+ * icalmemory_get_arena() and restore it when done, so that arena scopes
+ * nest.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_set_arena(icalmemory_arena *arena);
+
+/**
+ * @brief Returns the allocation arena installed for the current thread,
+ * or `NULL` if none is installed.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalmemory_arena *icalmemory_get_arena(void);
+
+/**
+ * @brief Enables or disables the interned string pool.
+ * @param enable Nonzero to enable interning, zero to disable it
+ * @since 3.1.0
+ *
+ * When interning is enabled, icalmemory_intern() hands out one shared,
+ * reference-counted allocation per distinct string instead of a fresh copy
+ * for every caller. libical routes `X-` property names and string parameter
+ * values (such as `TZID`) through the pool, so datasets that repeat the same
+ * names and time zone ids millions of times share a handful of allocations.
+ *
+ * Interning is off by default. The setting is global; strings interned
+ * while the pool was enabled remain valid and correctly reference-counted
+ * after it is disabled.
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_set_interning(int enable);
+
+/**
+ * @brief Returns nonzero if the interned string pool is enabled.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalmemory_get_interning(void);
+
+/**
+ * @brief Returns a shared copy of @a str from the interned string pool.
+ * @param str The string to copy, must not be `NULL`
+ * @return A NUL-terminated copy of @a str, or `NULL` on error
+ * @since 3.1.0
+ *
+ * If interning is enabled (see icalmemory_set_interning()), repeated calls
+ * with equal strings return the same reference-counted allocation; each call
+ * must be balanced by one icalmemory_intern_release(). If interning is
+ * disabled, this is equivalent to icalmemory_strdup().
+ *
+ * The pool is thread-safe on platforms with pthread support.
+ */
+LIBICAL_ICAL_EXPORT char *icalmemory_intern(const char *str);
+
+/**
+ * @brief Releases a string obtained from icalmemory_intern().
+ * @param str The string to release, may be `NULL`
+ * @since 3.1.0
+ *
+ * Drops one reference from an interned string, freeing it when the last
+ * reference is gone. Strings that are not in the pool (for example because
+ * interning was disabled when they were created) are passed on to
+ * icalmemory_free_buffer(), so this is always the correct way to dispose of
+ * a string that came from icalmemory_intern().
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_intern_release(char *str);
+
+/**
+ * @brief Counters for the icalmemory buffer routines.
+ * @since 3.1.0
+ *
+ * Counts calls to icalmemory_new_buffer(), icalmemory_resize_buffer()
+ * and icalmemory_free_buffer(). Maintained without synchronization, so
+ * the numbers are exact for single-threaded measurement runs and
+ * approximate when several threads allocate concurrently.
+ */
+struct icalmemory_stats
+{
+    size_t allocs;
+    size_t reallocs;
+    size_t frees;
+
+    size_t bytes_allocated;
+    /**< Cumulative bytes requested from icalmemory_new_buffer(). */
+
+    size_t live_blocks;
+    /**< Blocks currently outstanding (allocs minus frees). */
+
+    size_t max_live_blocks;
+    /**< High-water mark of live_blocks since start-up or the last
+       icalmemory_reset_stats(). */
+};
+
+/**
+ * @brief Callbacks invoked on every icalmemory buffer operation.
+ * @since 3.1.0
+ *
+ * Each callback receives the tag installed on the calling thread with
+ * icalmemory_set_tag() (or `NULL` when none is set), so a profiler can
+ * attribute allocations to the subsystem — parser, serializer, recur —
+ * that made them without rebuilding with an allocator shim. Any of the
+ * pointers may be `NULL` to skip that event.
+ */
+struct icalmemory_hooks
+{
+    void (*on_alloc)(size_t size, const char *tag);
+    void (*on_realloc)(size_t size, const char *tag);
+    void (*on_free)(const char *tag);
+};
+
+/**
+ * @brief Installs profiling hooks for the buffer routines.
+ * @param hooks The callbacks to install, or `NULL` to remove them
+ * @since 3.1.0
+ *
+ * The structure is copied; the caller may discard it after the call.
+ * Install hooks before other threads start allocating — the pointer
+ * swap is not synchronized against concurrent allocation.
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_set_hooks(const struct icalmemory_hooks *hooks);
+
+/**
+ * @brief Sets the allocation-site tag for the calling thread.
+ * @param tag A string naming the subsystem doing the allocating; the
+ *  pointer must stay valid while the tag is installed (string literals
+ *  are the expected usage)
+ * @return The previously installed tag, so call sites can restore it
+ * @since 3.1.0
+ * @sa icalmemory_set_hooks()
+ */
+LIBICAL_ICAL_EXPORT const char *icalmemory_set_tag(const char *tag);
+
+/**
+ * @brief Fetches the current allocation counters.
+ * @param stats Filled in with the counts accumulated since start-up or
+ *  the last icalmemory_reset_stats()
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_get_stats(struct icalmemory_stats *stats);
+
+/**
+ * @brief Resets the allocation counters to zero.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_reset_stats(void);
+
+/**
+ * @brief Rents a transient buffer from the per-thread scratch pool.
+ * @param size On input, the minimum capacity needed; on output, the
+ *  actual capacity of the returned buffer
+ * @return A writable buffer of at least the requested capacity, or
+ *  `NULL` on allocation failure
+ * @since 3.1.0
+ *
+ * The pool keeps a handful of grow-only heap buffers per thread for
+ * workspace that is acquired and released within a single call, such as
+ * the serializers' assembly buffers. This avoids one malloc/free pair
+ * per call in tight serialize-and-discard loops. Unlike
+ * icalmemory_tmp_buffer(), the buffer must be given back with
+ * icalmemory_scratch_release(); it may be grown in the meantime with
+ * icalmemory_resize_buffer() as long as the released size is accurate.
+ */
+LIBICAL_ICAL_EXPORT char *icalmemory_scratch_acquire(size_t *size);
+
+/**
+ * @brief Returns a buffer rented with icalmemory_scratch_acquire() to the pool.
+ * @param buf The buffer to return, may be `NULL`
+ * @param size The buffer's current capacity in bytes
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_scratch_release(char *buf, size_t size);
+
+/**
+ * @brief An append-only string builder.
+ * @since 3.1.0
+ *
+ * A thin wrapper over the buf/pos/buf_size triple that
+ * icalmemory_append_string() makes every caller thread by hand. The
+ * builder grows exponentially, supports known-length appends that skip
+ * the `strlen()` of the source, and keeps its contents NUL-terminated
+ * after every append. Storage is rented from the per-thread scratch
+ * pool, so a build-and-detach cycle usually costs no allocator calls
+ * beyond the detached result.
+ */
+typedef struct icalmemory_strbuf
+{
+    char *buf;
+    char *pos;
+    size_t size;
+} icalmemory_strbuf;
+
+/**
+ * @brief Initializes a builder with at least @a capacity bytes of storage.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_init(icalmemory_strbuf *sb, size_t capacity);
+
+/**
+ * @brief Ensures the builder can take @a len more bytes without growing.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_reserve(icalmemory_strbuf *sb, size_t len);
+
+/**
+ * @brief Appends @a len bytes of @a data, which need not be NUL-terminated.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_append(icalmemory_strbuf *sb,
+                                                  const char *data, size_t len);
+
+/**
+ * @brief Appends the NUL-terminated string @a string.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_append_string(icalmemory_strbuf *sb,
+                                                         const char *string);
+
+/**
+ * @brief Appends the single character @a ch.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_append_char(icalmemory_strbuf *sb, char ch);
+
+/**
+ * @brief Hands the built string to the caller and empties the builder.
+ * @return A NUL-terminated heap buffer that the caller must release with
+ *  icalmemory_free_buffer()
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT char *icalmemory_strbuf_detach(icalmemory_strbuf *sb);
+
+/**
+ * @brief Releases a builder's storage without detaching it.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalmemory_strbuf_free(icalmemory_strbuf *sb);
+
 #endif /* !ICALMEMORY_H */
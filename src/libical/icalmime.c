@@ -29,6 +29,7 @@
 #include "sspm.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #define TMP_BUF_SIZE 1024
 #define TMP_ERR_SIZE 256
@@ -152,6 +153,15 @@ static const struct sspm_action_map icalmime_local_action_map[] = {
     {SSPM_UNKNOWN_MAJOR_TYPE, SSPM_UNKNOWN_MINOR_TYPE, NULL, NULL, NULL, NULL}
 };
 
+/* Streaming intake map: only text/calendar has consumers. Every other
+   part type falls through to sspm's default no-op actions, so their
+   bodies are scanned for boundaries but never buffered or decoded. */
+static const struct sspm_action_map icalmime_streaming_action_map[] = {
+    {SSPM_TEXT_MAJOR_TYPE, SSPM_CALENDAR_MINOR_TYPE, icalmime_text_new_part, icalmime_text_add_line,
+     icalmime_textcalendar_end_part, icalmime_text_free_part},
+    {SSPM_UNKNOWN_MAJOR_TYPE, SSPM_UNKNOWN_MINOR_TYPE, NULL, NULL, NULL, NULL}
+};
+
 #define NUM_PARTS 100   /* HACK. Hard Limit */
 
 struct sspm_part *icalmime_make_part(icalcomponent *comp)
@@ -160,6 +170,113 @@ struct sspm_part *icalmime_make_part(icalcomponent *comp)
     return 0;
 }
 
+/* Line generator over a caller-owned buffer. Each line is handed to
+   sspm in place: the byte after the line's newline is saved,
+   overwritten with a NUL, and restored on the next call, so the only
+   copy a line ever sees is the one sspm's add_line action makes. The
+   final line has no following byte to patch, so it alone goes through
+   the supplied line buffer. */
+struct icalmime_buffer_cursor
+{
+    char *pos;
+    char *end;
+    char *patched;      /* byte we NUL'd, restored on the next call */
+    char saved;
+};
+
+static char *icalmime_buffer_line_generator(char *s, size_t size, void *d)
+{
+    struct icalmime_buffer_cursor *cursor = (struct icalmime_buffer_cursor *)d;
+    char *line, *eol;
+    size_t len;
+
+    if (cursor->patched != 0) {
+        *cursor->patched = cursor->saved;
+        cursor->patched = 0;
+    }
+
+    if (cursor->pos >= cursor->end) {
+        return 0;
+    }
+
+    line = cursor->pos;
+    eol = memchr(line, '\n', (size_t)(cursor->end - line));
+
+    if (eol != 0 && eol + 1 < cursor->end) {
+        cursor->pos = eol + 1;
+        cursor->patched = eol + 1;
+        cursor->saved = *(eol + 1);
+        *(eol + 1) = '\0';
+        return line;
+    }
+
+    /* Final line: nothing after it inside the buffer to patch */
+    len = (size_t)(cursor->end - line);
+    cursor->pos = cursor->end;
+    if (len >= size) {
+        len = size - 1;
+    }
+    memcpy(s, line, len);
+    s[len] = '\0';
+    return s;
+}
+
+icalcomponent *icalmime_parse_buffer(char *data, size_t len)
+{
+    struct icalmime_buffer_cursor cursor;
+    icalcomponent *c;
+
+    icalerror_check_arg_rz((data != 0), "data");
+
+    cursor.pos = data;
+    cursor.end = data + len;
+    cursor.patched = 0;
+    cursor.saved = '\0';
+
+    c = icalmime_parse_calendar(icalmime_buffer_line_generator, &cursor);
+
+    /* The parse may stop before the generator runs dry */
+    if (cursor.patched != 0) {
+        *cursor.patched = cursor.saved;
+    }
+
+    return c;
+}
+
+icalcomponent *icalmime_parse_calendar(char *(*get_string) (char *s, size_t size, void *d),
+                                       void *data)
+{
+    struct sspm_part *parts;
+    icalcomponent *root = 0;
+    int i;
+
+    if ((parts = (struct sspm_part *)malloc(NUM_PARTS * sizeof(struct sspm_part))) == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    memset(parts, 0, NUM_PARTS * sizeof(struct sspm_part));
+
+    sspm_parse_mime(parts, NUM_PARTS, /* Max parts */
+                    icalmime_streaming_action_map, /* Actions */
+                    get_string, data, /* data for get_string */
+                    0/* First header */);
+
+    for (i = 0; i < NUM_PARTS && parts[i].header.major != SSPM_NO_MAJOR_TYPE; i++) {
+        if (parts[i].header.major == SSPM_TEXT_MAJOR_TYPE &&
+            parts[i].header.minor == SSPM_CALENDAR_MINOR_TYPE && parts[i].data != 0) {
+            root = (icalcomponent *) parts[i].data;
+            parts[i].data = 0;
+            break;
+        }
+    }
+
+    sspm_free_parts(parts, NUM_PARTS);
+    free(parts);
+
+    return root;
+}
+
 icalcomponent *icalmime_parse(char *(*get_string) (char *s, size_t size, void *d), void *data)
 {
     struct sspm_part *parts;
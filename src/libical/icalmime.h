@@ -26,4 +26,44 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalmime_parse(char *(*line_gen_func) (char *
                                                                           size_t size,
                                                                           void *d), void *data);
 
+/**
+ * @brief Streaming variant of icalmime_parse() for mail intake.
+ *
+ * Scans the message incrementally and hands only text/calendar part
+ * content to the iCalendar parser; the bodies of all other parts
+ * (attachments, text alternatives) are skipped without being buffered
+ * or decoded, so memory use is bounded by the calendar part rather
+ * than the message.
+ *
+ * @return the component parsed from the first text/calendar part, or
+ * NULL if the message has none. The caller owns the returned
+ * component. Unlike icalmime_parse(), no X-LIC-MIMEPART envelope is
+ * built around it.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalmime_parse_calendar(char *(*line_gen_func) (char *s,
+                                                                                   size_t size,
+                                                                                   void *d),
+                                                           void *data);
+
+/**
+ * @brief Zero-copy form of icalmime_parse_calendar() over a pre-read
+ * buffer.
+ *
+ * Parses the MIME message held in the @p len bytes at @p data, for
+ * example a message already sitting in a socket or mmap buffer. Lines
+ * are handed to the MIME parser in place rather than copied out one by
+ * one, so the calendar-part bytes are copied exactly once, into the
+ * buffer the iCalendar parser consumes. The buffer is modified during
+ * the parse (line ends are temporarily NUL-terminated) but is restored
+ * before returning; it does not need to be NUL-terminated.
+ *
+ * @return as icalmime_parse_calendar(): the component parsed from the
+ * first text/calendar part, or NULL if the message has none.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalmime_parse_buffer(char *data, size_t len);
+
 #endif /* !ICALMIME_H */
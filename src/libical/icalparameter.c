@@ -26,17 +26,24 @@
 
 #include "icalparameter.h"
 #include "icalparameterimpl.h"
+#include "icalproperty_p.h"
 #include "icalerror.h"
 #include "icalmemory.h"
 
 #include <errno.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 LIBICAL_ICAL_EXPORT struct icalparameter_impl *icalparameter_new_impl(icalparameter_kind kind)
 {
     struct icalparameter_impl *v;
 
-    if ((v = (struct icalparameter_impl *)malloc(sizeof(struct icalparameter_impl))) == 0) {
+    if ((v = (struct icalparameter_impl *)icalmemory_pool_alloc(sizeof(struct icalparameter_impl))) == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
@@ -57,6 +64,147 @@ icalparameter *icalparameter_new(icalparameter_kind kind)
     return (icalparameter *) v;
 }
 
+/*
+ * Classifies a parameter value once, at first render. PLAIN means
+ * every byte is an unquoted SAFE-CHAR, so the serializer can copy the
+ * value straight through; anything else — CTLs, DQUOTE, ";", ":", ","
+ * or bytes past the NON-US-ASCII range — forces the quoting/encoding
+ * walk in icalparameter_append_encoded_value(). The byte class test is
+ * vectorized where the compiler advertises SSE2 or NEON, mirroring the
+ * line scanner in icalparser.c; the scalar loop is the portable
+ * fallback and handles the tail.
+ */
+static int icalparameter_quote_state_for(const char *value)
+{
+    const unsigned char *p = (const unsigned char *)value;
+
+    if (*p == '\0') {
+        /* The empty value renders as "" */
+        return ICALPARAMETER_QUOTE_ENCODED;
+    }
+
+#if defined(__SSE2__)
+    {
+        const __m128i vtab = _mm_set1_epi8('\t');
+        const __m128i vctl = _mm_set1_epi8(0x1f);
+        const __m128i vhi = _mm_set1_epi8((char)0xf8);
+        const __m128i vdq = _mm_set1_epi8('"');
+        const __m128i vcm = _mm_set1_epi8(',');
+        const __m128i vco = _mm_set1_epi8(':');
+        const __m128i vsc = _mm_set1_epi8(';');
+        const __m128i vdel = _mm_set1_epi8(0x7f);
+        const __m128i zero = _mm_setzero_si128();
+
+        while (1) {
+            __m128i chunk, low, high, bad;
+            const unsigned char *q;
+            int has_nul;
+
+            /* Stop vectorizing before the terminator; strlen would
+               touch the same bytes twice. */
+            for (q = p; q < p + 16; q++) {
+                if (*q == '\0') {
+                    break;
+                }
+            }
+            has_nul = (q < p + 16);
+            if (has_nul) {
+                break;
+            }
+
+            chunk = _mm_loadu_si128((const __m128i *)p);
+
+            /* CTLs other than HTAB: (c <= 0x1f) && (c != '\t') */
+            low = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, vtab),
+                                   _mm_cmpeq_epi8(_mm_subs_epu8(chunk, vctl), zero));
+
+            /* Bytes above NON-US-ASCII: c > 0xf8 */
+            high = _mm_andnot_si128(_mm_cmpeq_epi8(chunk, vhi),
+                                    _mm_cmpeq_epi8(_mm_max_epu8(chunk, vhi), chunk));
+
+            bad = _mm_or_si128(low, high);
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, vdq));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, vcm));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, vco));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, vsc));
+            bad = _mm_or_si128(bad, _mm_cmpeq_epi8(chunk, vdel));
+
+            if (_mm_movemask_epi8(bad) != 0) {
+                return ICALPARAMETER_QUOTE_ENCODED;
+            }
+
+            p += 16;
+        }
+    }
+#elif defined(__aarch64__)
+    {
+        const uint8x16_t vtab = vdupq_n_u8('\t');
+        const uint8x16_t vctl = vdupq_n_u8(0x1f);
+        const uint8x16_t vhi = vdupq_n_u8(0xf8);
+        const uint8x16_t vdq = vdupq_n_u8('"');
+        const uint8x16_t vcm = vdupq_n_u8(',');
+        const uint8x16_t vco = vdupq_n_u8(':');
+        const uint8x16_t vsc = vdupq_n_u8(';');
+        const uint8x16_t vdel = vdupq_n_u8(0x7f);
+
+        while (1) {
+            uint8x16_t chunk, bad;
+            const unsigned char *q;
+
+            for (q = p; q < p + 16; q++) {
+                if (*q == '\0') {
+                    break;
+                }
+            }
+            if (q < p + 16) {
+                break;
+            }
+
+            chunk = vld1q_u8(p);
+
+            bad = vbicq_u8(vcleq_u8(chunk, vctl), vceqq_u8(chunk, vtab));
+            bad = vorrq_u8(bad, vcgtq_u8(chunk, vhi));
+            bad = vorrq_u8(bad, vceqq_u8(chunk, vdq));
+            bad = vorrq_u8(bad, vceqq_u8(chunk, vcm));
+            bad = vorrq_u8(bad, vceqq_u8(chunk, vco));
+            bad = vorrq_u8(bad, vceqq_u8(chunk, vsc));
+            bad = vorrq_u8(bad, vceqq_u8(chunk, vdel));
+
+            if (vmaxvq_u8(bad) != 0) {
+                return ICALPARAMETER_QUOTE_ENCODED;
+            }
+
+            p += 16;
+        }
+    }
+#endif
+
+    for (; *p != '\0'; p++) {
+        unsigned char c = *p;
+
+        if ((c <= 0x1f && c != '\t') || c == '"' || c == ',' ||
+            c == ':' || c == ';' || c == 0x7f || c > 0xf8) {
+            return ICALPARAMETER_QUOTE_ENCODED;
+        }
+    }
+
+    return ICALPARAMETER_QUOTE_PLAIN;
+}
+
+void icalparameter_render_cache_invalidate(icalparameter *param)
+{
+    if (param == 0) {
+        return;
+    }
+
+    if (param->rendered != 0) {
+        icalmemory_free_buffer((void *)param->rendered);
+        param->rendered = 0;
+    }
+
+    param->quote_state = ICALPARAMETER_QUOTE_UNKNOWN;
+}
+
 void icalparameter_free(icalparameter *param)
 {
 /*  Comment out the following as it always triggers, even when parameter is non-zero
@@ -67,18 +215,22 @@ void icalparameter_free(icalparameter *param)
     }
 
     if (param->string != 0) {
-        free((void *)param->string);
+        icalmemory_intern_release((char *)param->string);
     }
 
     if (param->x_name != 0) {
-        free((void *)param->x_name);
+        icalmemory_free_buffer((void *)param->x_name);
+    }
+
+    if (param->rendered != 0) {
+        icalmemory_free_buffer((void *)param->rendered);
     }
 
     memset(param, 0, sizeof(icalparameter));
 
     param->parent = 0;
     param->id[0] = 'X';
-    free(param);
+    icalmemory_pool_free(param, sizeof(struct icalparameter_impl));
 }
 
 icalparameter *icalparameter_clone(const icalparameter *old)
@@ -95,8 +247,12 @@ icalparameter *icalparameter_clone(const icalparameter *old)
 
     memcpy(new, old, sizeof(struct icalparameter_impl));
 
+    /* The clone re-renders on demand; quote_state carries over since
+       it describes the shared value string. */
+    new->rendered = 0;
+
     if (old->string != 0) {
-        new->string = icalmemory_strdup(old->string);
+        new->string = icalmemory_intern(old->string);
         if (new->string == 0) {
             new->parent = 0;
             icalparameter_free(new);
@@ -141,7 +297,7 @@ icalparameter *icalparameter_new_from_string(const char *str)
 
     if (eq == 0) {
         icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
-        free(cpy);
+        icalmemory_free_buffer(cpy);
         return 0;
     }
 
@@ -153,7 +309,7 @@ icalparameter *icalparameter_new_from_string(const char *str)
 
     if (kind == ICAL_NO_PARAMETER) {
         icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
-        free(cpy);
+        icalmemory_free_buffer(cpy);
         return 0;
     }
 
@@ -165,7 +321,7 @@ icalparameter *icalparameter_new_from_string(const char *str)
         icalparameter_set_iana_name(param, cpy);
     }
 
-    free(cpy);
+    icalmemory_free_buffer(cpy);
 
     return param;
 }
@@ -279,6 +435,12 @@ char *icalparameter_as_ical_string_r(icalparameter *param)
 
     icalerror_check_arg_rz((param != 0), "parameter");
 
+    /* Unchanged since the last serialization: hand back a copy of the
+       cached form instead of rebuilding it. */
+    if (param->rendered != 0) {
+        return icalmemory_strdup(param->rendered);
+    }
+
     /* Create new buffer that we can append names, parameters and a
      * value to, and reallocate as needed.
      */
@@ -297,7 +459,7 @@ char *icalparameter_as_ical_string_r(icalparameter *param)
         if (param->kind == ICAL_NO_PARAMETER ||
             param->kind == ICAL_ANY_PARAMETER || kind_string == 0) {
             icalerror_set_errno(ICAL_BADARG_ERROR);
-            free(buf);
+            icalmemory_free_buffer(buf);
             return 0;
         }
 
@@ -308,17 +470,31 @@ char *icalparameter_as_ical_string_r(icalparameter *param)
     icalmemory_append_string(&buf, &buf_ptr, &buf_size, "=");
 
     if (param->string != 0) {
-        icalparameter_append_encoded_value(&buf, &buf_ptr, &buf_size, param->string);
+        if (param->quote_state == ICALPARAMETER_QUOTE_UNKNOWN) {
+            param->quote_state = icalparameter_quote_state_for(param->string);
+        }
+
+        if (param->quote_state == ICALPARAMETER_QUOTE_PLAIN) {
+            /* Every byte is an unquoted SAFE-CHAR; skip the
+               per-character quoting walk. */
+            icalmemory_append_string(&buf, &buf_ptr, &buf_size, param->string);
+        } else {
+            icalparameter_append_encoded_value(&buf, &buf_ptr, &buf_size, param->string);
+        }
     } else if (param->data != 0) {
         const char *str = icalparameter_enum_to_string(param->data);
 
         icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
     } else {
         icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
-        free(buf);
+        icalmemory_free_buffer(buf);
         return 0;
     }
 
+    /* Keep the result for the next serialization; a failed copy just
+       means the cache stays cold. */
+    param->rendered = icalmemory_strdup(buf);
+
     return buf;
 }
 
@@ -351,8 +527,10 @@ void icalparameter_set_xname(icalparameter *param, const char *v)
     icalerror_check_arg_rv((param != 0), "param");
     icalerror_check_arg_rv((v != 0), "v");
 
+    icalparameter_render_cache_invalidate(param);
+
     if (param->x_name != 0) {
-        free((void *)param->x_name);
+        icalmemory_free_buffer((void *)param->x_name);
     }
 
     param->x_name = icalmemory_strdup(v);
@@ -374,11 +552,14 @@ void icalparameter_set_xvalue(icalparameter *param, const char *v)
     icalerror_check_arg_rv((param != 0), "param");
     icalerror_check_arg_rv((v != 0), "v");
 
+    icalproperty_cache_invalidate(param->parent);
+    icalparameter_render_cache_invalidate(param);
+
     if (param->string != 0) {
-        free((void *)param->string);
+        icalmemory_intern_release((char *)param->string);
     }
 
-    param->string = icalmemory_strdup(v);
+    param->string = icalmemory_intern(v);
 
     if (param->string == 0) {
         errno = ENOMEM;
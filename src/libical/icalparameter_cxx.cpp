@@ -48,6 +48,26 @@ ICalParameter &ICalParameter::operator=(const ICalParameter &v)
     return *this;
 }
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+ICalParameter::ICalParameter(ICalParameter &&v) noexcept : imp(v.imp)
+{
+    v.imp = NULL;
+}
+
+ICalParameter &ICalParameter::operator=(ICalParameter &&v) noexcept
+{
+    if (this != &v) {
+        if (imp != NULL) {
+            icalparameter_free(imp);
+        }
+        imp = v.imp;
+        v.imp = NULL;
+    }
+
+    return *this;
+}
+#endif
+
 void ICalParameter::detach()
 {
     imp = NULL;
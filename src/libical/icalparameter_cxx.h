@@ -40,6 +40,12 @@ public:
     ICalParameter();
     ICalParameter(const ICalParameter &);
     ICalParameter &operator=(const ICalParameter &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    /* Moves steal the underlying icalparameter instead of cloning it,
+       leaving the source detached (as after detach()). */
+    ICalParameter(ICalParameter &&) noexcept;
+    ICalParameter &operator=(ICalParameter &&) noexcept;
+#endif
     ~ICalParameter();
 
     explicit ICalParameter(icalparameter *v);
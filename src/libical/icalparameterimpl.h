@@ -36,6 +36,21 @@ struct icalparameter_impl
     icalproperty *parent;
 
     int data;
+
+    /* Serialization cache. quote_state classifies ->string once so the
+       serializer can skip the per-character quoting scan; rendered is
+       the last full "NAME=value" form. Both are dropped whenever the
+       parameter changes. */
+    int quote_state;
+    const char *rendered;
 };
 
+#define ICALPARAMETER_QUOTE_UNKNOWN 0
+#define ICALPARAMETER_QUOTE_PLAIN 1
+#define ICALPARAMETER_QUOTE_ENCODED 2
+
+/* Drops the cached rendering after a mutation; also used by the
+   generated setters in icalderivedparameter.c. */
+LIBICAL_ICAL_NO_EXPORT void icalparameter_render_cache_invalidate(icalparameter *param);
+
 #endif /*ICALPARAMETER_IMPL */
@@ -36,6 +36,8 @@
 #include "icalparser.h"
 #include "icalerror.h"
 #include "icalmemory.h"
+#include "icalthreadpool.h"
+#include "icaltrace.h"
 #include "icalvalue.h"
 #include "icalproperty_p.h"
 
@@ -43,6 +45,26 @@
 #include <stddef.h>     /* for ptrdiff_t */
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include <stdio.h>
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 #define TMP_BUF_SIZE 80
 #define MAXIMUM_ALLOWED_PARAMETERS 100
 #define MAXIMUM_ALLOWED_MULTIPLE_VALUES 500
@@ -62,8 +84,11 @@ struct icalparser_impl
     int error_count;
     icalparser_state state;
     pvl_list components;
+    icalparser_error_policy error_policy;
+    int validate_input; /* opt-in UTF-8/control-character validation */
 
     void *line_gen_data;
+    icalmemory_arena *arena;
 };
 
 /*
@@ -98,6 +123,174 @@ static void strstriplt(char *buf)
     }
 }
 
+/*
+ * Returns a pointer to the first '\r' or '\n' in [s,end), or end if the
+ * range contains neither. This is the inner loop of line framing, so it
+ * is vectorized where the compiler advertises SSE2 or NEON; the scalar
+ * loop at the bottom is the portable fallback.
+ */
+static const char *parser_scan_eol(const char *s, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i vcr = _mm_set1_epi8('\r');
+    const __m128i vlf = _mm_set1_epi8('\n');
+
+    while (s + 16 <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+        __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, vcr),
+                                    _mm_cmpeq_epi8(chunk, vlf));
+        int mask = _mm_movemask_epi8(hits);
+
+        if (mask != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+            return s + __builtin_ctz((unsigned int)mask);
+#else
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                s++;
+            }
+            return s;
+#endif
+        }
+        s += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t vcr = vdupq_n_u8('\r');
+    const uint8x16_t vlf = vdupq_n_u8('\n');
+
+    while (s + 16 <= end) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)s);
+        uint8x16_t hits = vorrq_u8(vceqq_u8(chunk, vcr), vceqq_u8(chunk, vlf));
+
+        if (vmaxvq_u8(hits) != 0) {
+            break;      /* the scalar loop below pins down the exact byte */
+        }
+        s += 16;
+    }
+#endif
+
+    while (s < end && *s != '\r' && *s != '\n') {
+        s++;
+    }
+
+    return s;
+}
+
+/* Returns the length of the valid UTF-8 sequence starting at p, or 0
+   when the bytes are not well-formed UTF-8 (overlong forms, surrogates
+   and values past U+10FFFF included) */
+static size_t parser_utf8_sequence_length(const unsigned char *p, const unsigned char *end)
+{
+    unsigned char c = p[0];
+
+    if (c < 0x80) {
+        return 1;
+    }
+
+    if (c >= 0xC2 && c <= 0xDF) {
+        if (end - p >= 2 && (p[1] & 0xC0) == 0x80) {
+            return 2;
+        }
+    } else if (c == 0xE0) {
+        if (end - p >= 3 && p[1] >= 0xA0 && p[1] <= 0xBF && (p[2] & 0xC0) == 0x80) {
+            return 3;
+        }
+    } else if ((c >= 0xE1 && c <= 0xEC) || c == 0xEE || c == 0xEF) {
+        if (end - p >= 3 && (p[1] & 0xC0) == 0x80 && (p[2] & 0xC0) == 0x80) {
+            return 3;
+        }
+    } else if (c == 0xED) {
+        /* excludes the UTF-16 surrogate range U+D800..U+DFFF */
+        if (end - p >= 3 && p[1] >= 0x80 && p[1] <= 0x9F && (p[2] & 0xC0) == 0x80) {
+            return 3;
+        }
+    } else if (c == 0xF0) {
+        if (end - p >= 4 && p[1] >= 0x90 && p[1] <= 0xBF &&
+            (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+            return 4;
+        }
+    } else if (c >= 0xF1 && c <= 0xF3) {
+        if (end - p >= 4 && (p[1] & 0xC0) == 0x80 &&
+            (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+            return 4;
+        }
+    } else if (c == 0xF4) {
+        /* caps the range at U+10FFFF */
+        if (end - p >= 4 && p[1] >= 0x80 && p[1] <= 0x8F &&
+            (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) {
+            return 4;
+        }
+    }
+
+    return 0;
+}
+
+int icalparser_validate_line(const char *line, size_t len, size_t *offset)
+{
+    const unsigned char *p = (const unsigned char *)line;
+    const unsigned char *end = p + len;
+
+    icalerror_check_arg_rz((line != 0), "line");
+
+    /* Plain printable ASCII is the overwhelmingly common case, so skip
+       whole chunks that hold nothing but it; a chunk with a control or
+       high byte drops to the scalar classification below */
+#if defined(__SSE2__)
+    while (p + 16 <= end) {
+        const __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        /* Signed compare: anything below 0x20 (controls) or at/above
+           0x80 (sign bit set) compares below the space character */
+        const __m128i suspect = _mm_or_si128(_mm_cmplt_epi8(chunk, _mm_set1_epi8(' ')),
+                                             _mm_cmpeq_epi8(chunk, _mm_set1_epi8(0x7F)));
+
+        if (_mm_movemask_epi8(suspect) != 0) {
+            break;
+        }
+        p += 16;
+    }
+#elif defined(__aarch64__)
+    while (p + 16 <= end) {
+        const uint8x16_t chunk = vld1q_u8(p);
+        const uint8x16_t suspect = vorrq_u8(vcltq_u8(chunk, vdupq_n_u8(' ')),
+                                            vcgeq_u8(chunk, vdupq_n_u8(0x7F)));
+
+        if (vmaxvq_u8(suspect) != 0) {
+            break;
+        }
+        p += 16;
+    }
+#endif
+
+    while (p < end) {
+        unsigned char c = *p;
+        size_t seqlen;
+
+        if (c < 0x80) {
+            /* HTAB and the line terminators are the only legal
+               controls; DEL is forbidden outright */
+            if ((c < 0x20 && c != '\t' && c != '\r' && c != '\n') || c == 0x7F) {
+                if (offset != 0) {
+                    *offset = (size_t)(p - (const unsigned char *)line);
+                }
+                return 0;
+            }
+            p++;
+            continue;
+        }
+
+        seqlen = parser_utf8_sequence_length(p, end);
+        if (seqlen == 0) {
+            if (offset != 0) {
+                *offset = (size_t)(p - (const unsigned char *)line);
+            }
+            return 0;
+        }
+        p += seqlen;
+    }
+
+    return 1;
+}
+
 icalparser *icalparser_new(void)
 {
     struct icalparser_impl *impl = 0;
@@ -116,6 +309,9 @@ icalparser *icalparser_new(void)
     impl->continuation_line = 0;
     impl->lineno = 0;
     impl->error_count = 0;
+    impl->error_policy = ICALPARSER_ERROR_POLICY_DEFAULT;
+    impl->validate_input = 0;
+    impl->arena = 0;
     memset(impl->temp, 0, TMP_BUF_SIZE);
 
     return (icalparser *) impl;
@@ -124,6 +320,15 @@ icalparser *icalparser_new(void)
 void icalparser_free(icalparser *parser)
 {
     icalcomponent *c;
+    icalmemory_arena *prev_arena = 0;
+
+    /* Partially parsed components may live in the parser's arena; make
+       it current so that freeing them does the right thing for both
+       arena and heap nodes */
+    if (parser->arena != 0) {
+        prev_arena = icalmemory_get_arena();
+        icalmemory_set_arena(parser->arena);
+    }
 
     if (parser->root_component != 0) {
         icalcomponent_free(parser->root_component);
@@ -133,18 +338,184 @@ void icalparser_free(icalparser *parser)
         icalcomponent_free(c);
     }
 
+    if (parser->arena != 0) {
+        icalmemory_set_arena(prev_arena);
+    }
+
     pvl_free(parser->components);
 
     free(parser);
 }
 
+/* A snapshot records everything icalparser_add_line() needs to resume:
+   the partially built components (the stack entries are disjoint trees
+   until their END lines arrive, so each can be cloned independently),
+   the fold-continuation buffer and the scalar line state. */
+struct icalparser_snapshot_impl
+{
+    int buffer_full;
+    int continuation_line;
+    char temp[TMP_BUF_SIZE];
+    icalcomponent *root_component;
+    int level;
+    int lineno;
+    int error_count;
+    icalparser_state state;
+    pvl_list components;
+};
+
+icalparser_snapshot *icalparser_save_state(icalparser *parser)
+{
+    struct icalparser_snapshot_impl *snapshot;
+    pvl_elem itr;
+
+    icalerror_check_arg_rz((parser != 0), "parser");
+
+    snapshot =
+        (struct icalparser_snapshot_impl *)malloc(sizeof(struct icalparser_snapshot_impl));
+    if (snapshot == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    snapshot->buffer_full = parser->buffer_full;
+    snapshot->continuation_line = parser->continuation_line;
+    memcpy(snapshot->temp, parser->temp, TMP_BUF_SIZE);
+    snapshot->level = parser->level;
+    snapshot->lineno = parser->lineno;
+    snapshot->error_count = parser->error_count;
+    snapshot->state = parser->state;
+
+    snapshot->root_component = 0;
+    if (parser->root_component != 0) {
+        snapshot->root_component = icalcomponent_clone(parser->root_component);
+    }
+
+    snapshot->components = pvl_newlist();
+    for (itr = pvl_head(parser->components); itr != 0; itr = pvl_next(itr)) {
+        pvl_push(snapshot->components, icalcomponent_clone((icalcomponent *) pvl_data(itr)));
+    }
+
+    return snapshot;
+}
+
+int icalparser_restore_state(icalparser *parser, const icalparser_snapshot *snapshot)
+{
+    icalcomponent *c;
+    icalmemory_arena *prev_arena = 0;
+    pvl_elem itr;
+
+    icalerror_check_arg_re((parser != 0), "parser", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((snapshot != 0), "snapshot", ICAL_BADARG_ERROR);
+
+    /* Discard whatever the parser currently holds, as icalparser_free
+       does: the partial components may live in the parser's arena */
+    if (parser->arena != 0) {
+        prev_arena = icalmemory_get_arena();
+        icalmemory_set_arena(parser->arena);
+    }
+
+    if (parser->root_component != 0) {
+        icalcomponent_free(parser->root_component);
+    }
+
+    while ((c = pvl_pop(parser->components)) != 0) {
+        icalcomponent_free(c);
+    }
+
+    if (parser->arena != 0) {
+        icalmemory_set_arena(prev_arena);
+    }
+
+    parser->buffer_full = snapshot->buffer_full;
+    parser->continuation_line = snapshot->continuation_line;
+    memcpy(parser->temp, snapshot->temp, TMP_BUF_SIZE);
+    parser->level = snapshot->level;
+    parser->lineno = snapshot->lineno;
+    parser->error_count = snapshot->error_count;
+    parser->state = snapshot->state;
+
+    /* Clone again so the snapshot stays valid and can be restored more
+       than once */
+    parser->root_component = 0;
+    if (snapshot->root_component != 0) {
+        parser->root_component = icalcomponent_clone(snapshot->root_component);
+    }
+
+    for (itr = pvl_head(snapshot->components); itr != 0; itr = pvl_next(itr)) {
+        pvl_push(parser->components, icalcomponent_clone((icalcomponent *) pvl_data(itr)));
+    }
+
+    return 0;
+}
+
+void icalparser_snapshot_free(icalparser_snapshot *snapshot)
+{
+    icalcomponent *c;
+
+    if (snapshot == 0) {
+        return;
+    }
+
+    if (snapshot->root_component != 0) {
+        icalcomponent_free(snapshot->root_component);
+    }
+
+    while ((c = pvl_pop(snapshot->components)) != 0) {
+        icalcomponent_free(c);
+    }
+
+    pvl_free(snapshot->components);
+
+    free(snapshot);
+}
+
 void icalparser_set_gen_data(icalparser *parser, void *data)
 {
     parser->line_gen_data = data;
 }
 
-icalvalue *icalvalue_new_From_string_with_error(icalvalue_kind kind,
-                                                char *str, icalproperty ** error);
+void icalparser_set_arena(icalparser *parser, icalmemory_arena *arena)
+{
+    icalerror_check_arg_rv((parser != 0), "parser");
+
+    parser->arena = arena;
+}
+
+void icalparser_set_error_policy(icalparser *parser, icalparser_error_policy policy)
+{
+    icalerror_check_arg_rv((parser != 0), "parser");
+
+    parser->error_policy = policy;
+}
+
+icalparser_error_policy icalparser_get_error_policy(icalparser *parser)
+{
+    icalerror_check_arg_re((parser != 0), "parser", ICALPARSER_ERROR_POLICY_DEFAULT);
+
+    return parser->error_policy;
+}
+
+int icalparser_get_error_count(icalparser *parser)
+{
+    icalerror_check_arg_rz((parser != 0), "parser");
+
+    return parser->error_count;
+}
+
+void icalparser_set_input_validation(icalparser *parser, int enable)
+{
+    icalerror_check_arg_rv((parser != 0), "parser");
+
+    parser->validate_input = enable;
+}
+
+int icalparser_get_input_validation(icalparser *parser)
+{
+    icalerror_check_arg_rz((parser != 0), "parser");
+
+    return parser->validate_input;
+}
 
 static char *parser_get_next_char(char c, char *str, int qm)
 {
@@ -385,12 +756,13 @@ static char *icalparser_get_value(char *line, char **end, icalvalue_kind kind)
    comma after line and will set the next place to start searching in
    end. */
 
-static char *parser_get_next_value(char *line, char **end, icalvalue_kind kind)
+static char *parser_get_next_value_to(char *line, char *line_end, char **end,
+                                      icalvalue_kind kind)
 {
     char *next = 0;
     char *p;
     char *str;
-    size_t length = strlen(line);
+    size_t length = (size_t)(line_end - line);
     int quoted = 0;
 
     if (line[0] == '\"' && line[length - 1] == '\"') {
@@ -410,7 +782,7 @@ static char *parser_get_next_value(char *line, char **end, icalvalue_kind kind)
            weirdness tries to distinguish the two uses. It is probably a HACK */
 
         if (kind == ICAL_RECUR_VALUE) {
-            if (next != 0 && (*end + length) > next + 5 && strncmp(next, "FREQ", 4) == 0) {
+            if (next != 0 && line_end > next + 5 && strncmp(next, "FREQ", 4) == 0) {
                 /* The COMMA was followed by 'FREQ', is it a real separator */
                 /* Fall through */
             } else if (next != 0) {
@@ -444,7 +816,7 @@ static char *parser_get_next_value(char *line, char **end, icalvalue_kind kind)
     }
 
     if (next == 0) {
-        next = (char *)(size_t) line + length;
+        next = line_end;
         *end = next;
     } else {
         *end = next + 1;
@@ -458,6 +830,11 @@ static char *parser_get_next_value(char *line, char **end, icalvalue_kind kind)
     return str;
 }
 
+static char *parser_get_next_value(char *line, char **end, icalvalue_kind kind)
+{
+    return parser_get_next_value_to(line, line + strlen(line), end, kind);
+}
+
 static char *parser_get_next_parameter(char *line, char **end)
 {
     char *next;
@@ -607,6 +984,17 @@ static void insert_error(icalparser *parser, icalcomponent *comp, const char *te
 {
     char temp[1024];
 
+    parser->error_count++;
+
+    if (parser->error_policy != ICALPARSER_ERROR_POLICY_DEFAULT) {
+        /* The counting and fail-fast policies only record that an error
+           happened; they never build X-LIC-ERROR properties */
+        if (parser->error_policy == ICALPARSER_ERROR_POLICY_ABORT) {
+            parser->state = ICALPARSER_ERROR;
+        }
+        return;
+    }
+
     if (parser->error_count > MAXIMUM_ALLOWED_ERRORS) {
         return;
     }
@@ -620,8 +1008,6 @@ static void insert_error(icalparser *parser, icalcomponent *comp, const char *te
     icalcomponent_add_property(
         comp,
         icalproperty_vanew_xlicerror(temp, icalparameter_new_xlicerrortype(type), 0));
-
-    parser->error_count++;
 }
 
 static int line_is_blank(char *line)
@@ -647,9 +1033,12 @@ icalcomponent *icalparser_parse(icalparser *parser,
     icalcomponent *root = 0;
     icalerrorstate es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
     int cont;
+    const char *prev_tag;
+    ical_trace_timer trace_t = ical_trace_timer_start();
 
     icalerror_check_arg_rz((parser != 0), "parser");
 
+    prev_tag = icalmemory_set_tag("parser");
     icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
 
     do {
@@ -695,14 +1084,18 @@ icalcomponent *icalparser_parse(icalparser *parser,
     } while (cont);
 
     icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, es);
+    icalmemory_set_tag(prev_tag);
+
+    ical_trace_point_hit(ICAL_TRACE_PARSE_COMPONENT, trace_t);
 
     return root;
 }
 
-icalcomponent *icalparser_add_line(icalparser *parser, char *line)
+static icalcomponent *parser_add_line(icalparser *parser, char *line)
 {
     char *str;
     char *end;
+    char *value_end;
     int pcount = 0;
     int vcount = 0;
     icalproperty *prop;
@@ -712,6 +1105,12 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
 
     icalerror_check_arg_rz((parser != 0), "parser");
 
+    if (parser->error_policy == ICALPARSER_ERROR_POLICY_ABORT && parser->error_count > 0) {
+        /* Fail-fast: the first error already put the parser in
+           ICALPARSER_ERROR, ignore the rest of the input */
+        return 0;
+    }
+
     if (line == 0) {
         parser->state = ICALPARSER_ERROR;
         return 0;
@@ -721,6 +1120,31 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
         return 0;
     }
 
+    /* Opt-in validation stage: runs over the unfolded line the parser
+       is already touching, so rejecting broken UTF-8 and stray control
+       characters does not cost a second pass over the feed */
+    if (parser->validate_input) {
+        size_t voffset = 0;
+
+        if (!icalparser_validate_line(line, strlen(line), &voffset)) {
+            icalcomponent *tail = pvl_data(pvl_tail(parser->components));
+            char vmsg[80];
+
+            snprintf(vmsg, sizeof(vmsg),
+                     "Invalid UTF-8 or control character at offset %lu",
+                     (unsigned long)voffset);
+
+            if (tail) {
+                insert_error(parser, tail, line, vmsg,
+                             ICAL_XLICERRORTYPE_VALUEPARSEERROR);
+            } else {
+                parser->error_count++;
+            }
+            parser->state = ICALPARSER_ERROR;
+            return 0;
+        }
+    }
+
     /* Begin by getting the property name at the start of the line. The
        property name may end up being "BEGIN" or "END" in which case it
        is not really a property, but the marker for the start or end of
@@ -1137,6 +1561,11 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
        then there are multiple values, so clone the current
        parameter and add one part of the value to each clone */
 
+    /* The value splitter takes the end of the remaining text, measured
+       once here; re-running strlen for every value made splitting the
+       multi-hundred-EXDATE lines quadratic */
+    value_end = end + strlen(end);
+
     vcount = 0;
     while (vcount < MAXIMUM_ALLOWED_MULTIPLE_VALUES) {
         /* Only some properties can have multiple values. This list was taken
@@ -1148,13 +1577,17 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
         str = NULL;
 
         if (icalproperty_value_kind_is_multivalued(prop_kind, &value_kind)) {
-            str = parser_get_next_value(end, &end, value_kind);
+            str = parser_get_next_value_to(end, value_end, &end, value_kind);
         } else {
             str = icalparser_get_value(end, &end, value_kind);
         }
         strstriplt(str);
 
         if (str != 0) {
+            /* Filled with static data on failure; rejecting a
+               malformed line allocates nothing until the error
+               property is built below */
+            icalvalue_parse_error vdesc;
 
             if (vcount > 0) {
                 /* Actually, only clone after the second value */
@@ -1166,7 +1599,7 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
                 tail = 0;
             }
 
-            value = icalvalue_new_from_string(value_kind, str);
+            value = icalvalue_new_from_string_with_desc(value_kind, str, &vdesc);
 
             /* Don't add properties without value */
             if (value == 0) {
@@ -1176,9 +1609,11 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
                 icalcomponent *tail = pvl_data(pvl_tail(parser->components));
 
                 snprintf(temp, sizeof(temp),
-                         "Can't parse as %s value in %s property. Removing entire property",
+                         "Can't parse as %s value in %s property (%s). "
+                         "Removing entire property",
                          icalvalue_kind_to_string(value_kind),
-                         icalproperty_kind_to_string(prop_kind));
+                         icalproperty_kind_to_string(prop_kind),
+                         vdesc.message != 0 ? vdesc.message : "unknown error");
 
                 insert_error(parser, tail, str, temp, ICAL_XLICERRORTYPE_VALUEPARSEERROR);
 
@@ -1251,6 +1686,30 @@ icalcomponent *icalparser_add_line(icalparser *parser, char *line)
     }
 }
 
+icalcomponent *icalparser_add_line(icalparser *parser, char *line)
+{
+    icalcomponent *c;
+    icalmemory_arena *prev_arena = 0;
+
+    icalerror_check_arg_rz((parser != 0), "parser");
+
+    /* With an arena set, everything the line turns into -- components,
+       properties, parameters, values and their list nodes -- is carved
+       out of the arena for the duration of this call */
+    if (parser->arena != 0) {
+        prev_arena = icalmemory_get_arena();
+        icalmemory_set_arena(parser->arena);
+    }
+
+    c = parser_add_line(parser, line);
+
+    if (parser->arena != 0) {
+        icalmemory_set_arena(prev_arena);
+    }
+
+    return c;
+}
+
 icalparser_state icalparser_get_state(icalparser *parser)
 {
     return parser->state;
@@ -1291,17 +1750,19 @@ struct slg_data
 {
     const char *pos;
     const char *str;
+    const char *end;
 };
 
 char *icalparser_string_line_generator(char *out, size_t buf_size, void *d)
 {
     int replace_cr = 0;
-    char *n;
+    const char *n;
     size_t size;
     struct slg_data *data = (struct slg_data *)d;
 
     if (data->pos == 0) {
         data->pos = data->str;
+        data->end = data->str + strlen(data->str);
 
         /* Skip the UTF-8 marker at the beginning of the string */
         if (((unsigned char) data->pos[0]) == 0xEF &&
@@ -1316,21 +1777,24 @@ char *icalparser_string_line_generator(char *out, size_t buf_size, void *d)
         return 0;
     }
 
-    n = strchr(data->pos, '\n');
+    /* Find the next line break in a single vectorized sweep, rather than
+       scanning the rest of the string once for '\n' and again for '\r' */
+    n = parser_scan_eol(data->pos, data->end);
 
-    if (n == 0) {
-        n = strchr(data->pos, '\r'); /* support malformed input with only CR and no LF
-                                        (e.g. from Kerio Connect Server) */
-        if(n == 0) {
-            size = strlen(data->pos);
-        } else {
-            n++; /* include CR in output - will be replaced by LF later on */
-            replace_cr = 1;
-            size = (size_t) (ptrdiff_t) (n - data->pos);
-        }
-    } else {
+    if (n == data->end) {
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else if (*n == '\n') {
         n++;    /* include newline in output */
         size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else if ((n + 1) < data->end && *(n + 1) == '\n') {
+        n += 2; /* include CRLF in output */
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else {
+        /* support malformed input with only CR and no LF
+           (e.g. from Kerio Connect Server) */
+        n++;    /* include CR in output - will be replaced by LF later on */
+        replace_cr = 1;
+        size = (size_t) (ptrdiff_t) (n - data->pos);
     }
 
     if (size > buf_size - 1) {
@@ -1349,6 +1813,173 @@ char *icalparser_string_line_generator(char *out, size_t buf_size, void *d)
     return out;
 }
 
+/* Appends [start,end) to the scratch buffer used for unfolding
+   continuation lines in icalparser_parse_stream(). */
+static void stream_append_bytes(char **buf, size_t *pos, size_t *buf_size,
+                                const char *start, const char *end)
+{
+    size_t length = (size_t) (ptrdiff_t) (end - start);
+
+    if (*pos + length > *buf_size) {
+        while (*pos + length > *buf_size) {
+            *buf_size *= 2;
+        }
+        *buf = icalmemory_resize_buffer(*buf, *buf_size);
+    }
+
+    memcpy(*buf + *pos, start, length);
+    *pos += length;
+}
+
+/* Finds the end of the line beginning at pos. On return *line_end points
+   one past the last content byte and *next points to the start of the
+   following line, past any CR/LF/CRLF terminator. */
+static void stream_next_line(const char *pos, const char *end,
+                             const char **line_end, const char **next)
+{
+    const char *eol = parser_scan_eol(pos, end);
+
+    *line_end = eol;
+
+    if (eol < end && *eol == '\r') {
+        eol++;
+    }
+    if (eol < end && *eol == '\n') {
+        eol++;
+    }
+
+    *next = eol;
+}
+
+/* Emits one unfolded content line as an icalparser_event. Returns the
+   callback's return value. */
+static int stream_emit_line(const char *line, size_t length,
+                            icalparser_event_func event_func, void *d)
+{
+    icalparser_event event;
+    const char *end = line + length;
+    const char *p;
+    const char *name_end = 0;
+    const char *value_start = 0;
+    int quote_mode = 0;
+
+    /* Find the end of the name (first ';' or ':') and the start of the
+       value (first ':' outside of quotes) in a single pass. */
+    for (p = line; p < end; p++) {
+        if (*p == '"') {
+            quote_mode = !quote_mode;
+        } else if (quote_mode == 0) {
+            if ((*p == ';' || *p == ':') && name_end == 0) {
+                name_end = p;
+            }
+            if (*p == ':') {
+                value_start = p + 1;
+                break;
+            }
+        }
+    }
+
+    if (name_end == 0) {
+        /* Not a content line; ignore it, as icalparser_add_line() would
+           flag it without aborting the parse. */
+        return 0;
+    }
+
+    memset(&event, 0, sizeof(event));
+
+    event.name = line;
+    event.name_length = (size_t) (ptrdiff_t) (name_end - line);
+
+    if (value_start != 0) {
+        event.value = value_start;
+        event.value_length = (size_t) (ptrdiff_t) (end - value_start);
+        if (*name_end == ';') {
+            event.params = name_end + 1;
+            event.params_length = (size_t) (ptrdiff_t) (value_start - 1 - (name_end + 1));
+        }
+    }
+
+    if (event.name_length == 5 && strncasecmp(line, "BEGIN", 5) == 0 && value_start != 0) {
+        event.type = ICALPARSER_EVENT_BEGIN_COMPONENT;
+        event.name = event.value;
+        event.name_length = event.value_length;
+        event.value = 0;
+        event.value_length = 0;
+    } else if (event.name_length == 3 && strncasecmp(line, "END", 3) == 0 && value_start != 0) {
+        event.type = ICALPARSER_EVENT_END_COMPONENT;
+        event.name = event.value;
+        event.name_length = event.value_length;
+        event.value = 0;
+        event.value_length = 0;
+    } else {
+        event.type = ICALPARSER_EVENT_PROPERTY;
+    }
+
+    return (*event_func) (&event, d);
+}
+
+int icalparser_parse_stream(const char *str, size_t size,
+                            icalparser_event_func event_func, void *d)
+{
+    const char *pos;
+    const char *end;
+    char *fold_buf;
+    size_t fold_buf_size = TMP_BUF_SIZE;
+    int rtrn = 0;
+
+    icalerror_check_arg_re((str != 0), "str", 1);
+    icalerror_check_arg_re((event_func != 0), "event_func", 1);
+
+    pos = str;
+    end = str + size;
+
+    /* Skip the UTF-8 marker at the beginning of the buffer */
+    if (size >= 3 &&
+        ((unsigned char) pos[0]) == 0xEF &&
+        ((unsigned char) pos[1]) == 0xBB &&
+        ((unsigned char) pos[2]) == 0xBF) {
+        pos += 3;
+    }
+
+    fold_buf = icalmemory_new_buffer(fold_buf_size);
+
+    while (pos < end && rtrn == 0) {
+        const char *line_end;
+        const char *next;
+
+        stream_next_line(pos, end, &line_end, &next);
+
+        if (next < end && (*next == ' ' || *next == '\t')) {
+            /* A folded line; unfold it into the scratch buffer so the
+               callback still sees one contiguous slice. RFC 5545,
+               section 3.1 */
+            size_t fold_pos = 0;
+
+            stream_append_bytes(&fold_buf, &fold_pos, &fold_buf_size, pos, line_end);
+
+            while (next < end && (*next == ' ' || *next == '\t')) {
+                pos = next + 1;     /* eliminate the leading space */
+                stream_next_line(pos, end, &line_end, &next);
+
+                stream_append_bytes(&fold_buf, &fold_pos, &fold_buf_size, pos, line_end);
+            }
+
+            if (fold_pos > 0) {
+                rtrn = stream_emit_line(fold_buf, fold_pos, event_func, d);
+            }
+        } else if (line_end > pos) {
+            rtrn = stream_emit_line(pos, (size_t) (ptrdiff_t) (line_end - pos),
+                                    event_func, d);
+        }
+
+        pos = next;
+    }
+
+    icalmemory_free_buffer(fold_buf);
+
+    return rtrn;
+}
+
 icalcomponent *icalparser_parse_string(const char *str)
 {
     icalcomponent *c;
@@ -1373,3 +2004,307 @@ icalcomponent *icalparser_parse_string(const char *str)
 
     return c;
 }
+
+/* Line generator over a bounded, not necessarily zero-terminated,
+   memory range; used for parsing memory-mapped files in place. */
+struct blg_data
+{
+    const char *pos;
+    const char *end;
+};
+
+static char *parser_buffer_line_generator(char *out, size_t buf_size, void *d)
+{
+    int replace_cr = 0;
+    const char *n;
+    size_t size;
+    struct blg_data *data = (struct blg_data *)d;
+
+    if (data->pos == data->end) {
+        return 0;
+    }
+
+    n = parser_scan_eol(data->pos, data->end);
+
+    if (n == data->end) {
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else if (*n == '\n') {
+        n++;    /* include newline in output */
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else if ((n + 1) < data->end && *(n + 1) == '\n') {
+        n += 2; /* include CRLF in output */
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    } else {
+        n++;    /* include CR in output - will be replaced by LF later on */
+        replace_cr = 1;
+        size = (size_t) (ptrdiff_t) (n - data->pos);
+    }
+
+    if (size > buf_size - 1) {
+        size = buf_size - 1;
+    }
+
+    memcpy(out, data->pos, size);
+
+    if (replace_cr) {
+        *(out + size - 1) = '\n';
+    }
+    *(out + size) = '\0';
+
+    data->pos += size;
+
+    return out;
+}
+
+/**
+ * @private
+ *
+ * Parses the given memory range with a fresh parser, the same way
+ * icalparser_parse_string() does for a zero-terminated string.
+ */
+static icalcomponent *parser_parse_buffer(const char *str, size_t size)
+{
+    icalcomponent *c;
+    struct blg_data d;
+    icalparser *p;
+
+    icalerrorstate es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
+
+    /* Skip the UTF-8 marker at the beginning of the buffer */
+    if (size >= 3 &&
+        ((unsigned char) str[0]) == 0xEF &&
+        ((unsigned char) str[1]) == 0xBB &&
+        ((unsigned char) str[2]) == 0xBF) {
+        str += 3;
+        size -= 3;
+    }
+
+    d.pos = str;
+    d.end = str + size;
+
+    p = icalparser_new();
+    icalparser_set_gen_data(p, &d);
+
+    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
+
+    c = icalparser_parse(p, parser_buffer_line_generator);
+
+    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, es);
+
+    icalparser_free(p);
+
+    return c;
+}
+
+#if !defined(HAVE_SYS_MMAN_H)
+static char *parser_file_line_generator(char *out, size_t buf_size, void *d)
+{
+    return fgets(out, (int)buf_size, (FILE *) d);
+}
+#endif
+
+icalcomponent *icalparser_parse_file_mmap(const char *fname)
+{
+    icalcomponent *c;
+
+    icalerror_check_arg_rz((fname != 0), "fname");
+
+#if defined(HAVE_SYS_MMAN_H)
+    {
+        int fd;
+        struct stat sbuf;
+        void *map;
+        size_t size;
+
+        fd = open(fname, O_RDONLY);
+
+        if (fd < 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return 0;
+        }
+
+        if (fstat(fd, &sbuf) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            close(fd);
+            return 0;
+        }
+
+        size = (size_t) sbuf.st_size;
+
+        if (size == 0) {
+            /* Nothing to map; an empty file parses to nothing */
+            close(fd);
+            return 0;
+        }
+
+        map = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map == MAP_FAILED) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            close(fd);
+            return 0;
+        }
+
+        c = parser_parse_buffer((const char *)map, size);
+
+        (void)munmap(map, size);
+        close(fd);
+    }
+#else
+    {
+        /* No memory mapping on this platform; parse with buffered
+           stdio reads instead */
+        FILE *stream = fopen(fname, "r");
+        icalparser *p;
+
+        icalerrorstate es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
+
+        if (stream == 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return 0;
+        }
+
+        p = icalparser_new();
+        icalparser_set_gen_data(p, stream);
+
+        icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
+
+        c = icalparser_parse(p, parser_file_line_generator);
+
+        icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, es);
+
+        icalparser_free(p);
+        fclose(stream);
+    }
+#endif
+
+    return c;
+}
+
+struct parse_batch_pool_data
+{
+    const char *const *strings;
+    icalcomponent **components;
+};
+
+static void parser_parse_batch_task(void *ctx, size_t i)
+{
+    struct parse_batch_pool_data *data = (struct parse_batch_pool_data *)ctx;
+
+    data->components[i] = icalparser_parse_string(data->strings[i]);
+}
+
+#if defined(HAVE_PTHREAD)
+
+struct parse_batch_data
+{
+    const char *const *strings;
+    icalcomponent **components;
+    size_t count;
+    size_t next;
+    pthread_mutex_t lock;
+};
+
+static void *parser_parse_batch_worker(void *d)
+{
+    struct parse_batch_data *data = (struct parse_batch_data *)d;
+
+    for (;;) {
+        size_t i;
+
+        pthread_mutex_lock(&data->lock);
+        i = data->next++;
+        pthread_mutex_unlock(&data->lock);
+
+        if (i >= data->count) {
+            break;
+        }
+
+        data->components[i] = icalparser_parse_string(data->strings[i]);
+    }
+
+    return 0;
+}
+
+#endif
+
+int icalparser_parse_batch(const char *const *strings, size_t count,
+                           int num_threads, icalcomponent **components)
+{
+    size_t i;
+
+    icalerror_check_arg_re((strings != 0), "strings", 1);
+    icalerror_check_arg_re((components != 0), "components", 1);
+
+    /* Run on the shared pool when the application installed one, so
+       batch parsing does not add threads of its own. */
+    if (num_threads > 1 && count > 1 && ical_threadpool_get_default() != 0) {
+        struct parse_batch_pool_data data;
+
+        data.strings = strings;
+        data.components = components;
+
+        return ical_threadpool_run_batch(ical_threadpool_get_default(),
+                                         parser_parse_batch_task, &data, count);
+    }
+
+#if defined(HAVE_PTHREAD)
+    if (num_threads > 1 && count > 1) {
+        struct parse_batch_data data;
+        pthread_t *threads;
+        int started = 0;
+        int t;
+
+        if ((size_t) num_threads > count) {
+            num_threads = (int)count;
+        }
+
+        data.strings = strings;
+        data.components = components;
+        data.count = count;
+        data.next = 0;
+        pthread_mutex_init(&data.lock, 0);
+
+        threads = (pthread_t *) malloc((size_t) num_threads * sizeof(pthread_t));
+
+        if (threads == 0) {
+            pthread_mutex_destroy(&data.lock);
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 1;
+        }
+
+        for (t = 0; t < num_threads; t++) {
+            if (pthread_create(&threads[t], 0, parser_parse_batch_worker, &data) != 0) {
+                break;
+            }
+            started++;
+        }
+
+        if (started > 0) {
+            /* The calling thread pitches in too rather than blocking */
+            (void)parser_parse_batch_worker(&data);
+
+            for (t = 0; t < started; t++) {
+                pthread_join(threads[t], 0);
+            }
+        }
+
+        free(threads);
+        pthread_mutex_destroy(&data.lock);
+
+        if (started > 0) {
+            return 0;
+        }
+
+        /* Could not start any workers; fall through to the serial path */
+    }
+#else
+    _unused(num_threads);
+#endif
+
+    for (i = 0; i < count; i++) {
+        components[i] = icalparser_parse_string(strings[i]);
+    }
+
+    return 0;
+}
@@ -23,6 +23,7 @@
 
 #include "libical_ical_export.h"
 #include "icalcomponent.h"
+#include "icalmemory.h"
 
 /**
  * @file  icalparser.h
@@ -70,6 +71,38 @@ typedef enum icalparser_state
     ICALPARSER_IN_PROGRESS
 } icalparser_state;
 
+/**
+ * @enum icalparser_error_policy
+ * @typedef icalparser_error_policy
+ * @brief Controls what the parser does when it encounters malformed input
+ * @since 3.1.0
+ */
+typedef enum icalparser_error_policy
+{
+    /** Annotate the affected component with `X-LIC-ERROR` properties
+        describing each error. This is the historical behavior. */
+    ICALPARSER_ERROR_POLICY_DEFAULT,
+
+    /** Count errors (see icalparser_get_error_count()) but do not build
+        the `X-LIC-ERROR` properties. Useful for validation passes that
+        only need to know whether and how often input is malformed. */
+    ICALPARSER_ERROR_POLICY_COUNT,
+
+    /** Stop at the first error: the parser state becomes
+        ::ICALPARSER_ERROR and all further input is ignored. */
+    ICALPARSER_ERROR_POLICY_ABORT
+} icalparser_error_policy;
+
+/**
+ * @struct icalparser_snapshot_impl
+ * @typedef icalparser_snapshot
+ * @private
+ *
+ * A saved copy of an ::icalparser's intermediate state, created with
+ * icalparser_save_state().
+ */
+typedef struct icalparser_snapshot_impl icalparser_snapshot;
+
 typedef char *(*icalparser_line_gen_func) (char *s, size_t size, void *d);
 
 /**
@@ -201,6 +234,76 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalparser_clean(icalparser *parser);
  */
 LIBICAL_ICAL_EXPORT icalparser_state icalparser_get_state(icalparser *parser);
 
+/**
+ * @brief Sets the error policy of an ::icalparser.
+ * @param parser The (valid, non-`NULL`) parser object
+ * @param policy The ::icalparser_error_policy to apply
+ * @since 3.1.0
+ *
+ * The default policy materializes an `X-LIC-ERROR` property for every
+ * parse error, which allocates formatted strings the caller may never
+ * look at. The counting policy skips that work and only tallies errors;
+ * the abort policy additionally discards all input after the first
+ * error. Set the policy before feeding any lines to the parser.
+ */
+LIBICAL_ICAL_EXPORT void icalparser_set_error_policy(icalparser *parser,
+                                                     icalparser_error_policy policy);
+
+/**
+ * @brief Returns the error policy of an ::icalparser.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalparser_error_policy icalparser_get_error_policy(icalparser *parser);
+
+/**
+ * @brief Returns the number of parse errors seen so far.
+ * @param parser The (valid, non-`NULL`) parser object
+ * @since 3.1.0
+ *
+ * Counts every error regardless of the error policy, so a validation
+ * pre-pass can run with ::ICALPARSER_ERROR_POLICY_COUNT and check this
+ * after parsing. The count accumulates until the parser is freed.
+ */
+LIBICAL_ICAL_EXPORT int icalparser_get_error_count(icalparser *parser);
+
+/**
+ * @brief Enables or disables input validation on an ::icalparser.
+ * @param parser The (valid, non-`NULL`) parser object
+ * @param enable Nonzero to validate, 0 (the default) to skip
+ * @since 3.1.0
+ *
+ * When enabled, every unfolded line is checked for well-formed UTF-8
+ * and illegal control characters (anything below 0x20 other than HTAB,
+ * plus DEL) before it is parsed. The check rides along with the parse
+ * scan, so feeds no longer need a separate validation pass before
+ * storage. A violation is reported like any other parse error — an
+ * `X-LIC-ERROR` property naming the byte offset under the default
+ * error policy — and the offending line is not parsed.
+ */
+LIBICAL_ICAL_EXPORT void icalparser_set_input_validation(icalparser *parser, int enable);
+
+/**
+ * @brief Returns whether input validation is enabled on an ::icalparser.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalparser_get_input_validation(icalparser *parser);
+
+/**
+ * @brief Checks one line for well-formed UTF-8 and legal characters.
+ * @param line The bytes to check (not necessarily NUL-terminated)
+ * @param len The number of bytes to check
+ * @param offset If non-`NULL`, receives the byte offset of the first
+ *        violation when the line is rejected
+ * @return 1 when the line is clean, 0 on the first violation
+ * @since 3.1.0
+ *
+ * This is the check icalparser_set_input_validation() applies per
+ * unfolded line, exported for callers that frame lines themselves. The
+ * common all-printable-ASCII case is scanned a vector register at a
+ * time where SSE2 or NEON is available.
+ */
+LIBICAL_ICAL_EXPORT int icalparser_validate_line(const char *line, size_t len, size_t *offset);
+
 /**
  * @brief Frees an ::icalparser object.
  * @param parser The ::icalparser to be freed.
@@ -216,6 +319,52 @@ LIBICAL_ICAL_EXPORT icalparser_state icalparser_get_state(icalparser *parser);
  */
 LIBICAL_ICAL_EXPORT void icalparser_free(icalparser *parser);
 
+/**
+ * @brief Saves the intermediate state of an ::icalparser.
+ * @param parser The ::icalparser to checkpoint
+ * @return A newly allocated ::icalparser_snapshot, or `NULL` on error
+ * @since 3.1.0
+ *
+ * Deep-copies the parser's partially parsed components and line state so
+ * that parsing can later be resumed from this exact point with
+ * icalparser_restore_state(). This is useful for incrementally ingesting
+ * append-only files: checkpoint after the last fully processed line, and
+ * on the next read restore and feed only the new lines instead of
+ * re-parsing from the top.
+ *
+ * The snapshot is independent of the parser: it remains valid after the
+ * parser is freed, can be restored any number of times, and must be freed
+ * with icalparser_snapshot_free() after use. The line generator data set
+ * with icalparser_set_gen_data() is not part of the snapshot.
+ *
+ * @par Error handling
+ * If @a parser is `NULL`, returns `NULL` and sets ::icalerrno to
+ * ::ICAL_BADARG_ERROR.
+ */
+LIBICAL_ICAL_EXPORT icalparser_snapshot *icalparser_save_state(icalparser *parser);
+
+/**
+ * @brief Resets an ::icalparser to a previously saved state.
+ * @param parser The ::icalparser to reset
+ * @param snapshot A snapshot created with icalparser_save_state()
+ * @return 0 on success, an ::icalerrorenum on failure
+ * @since 3.1.0
+ *
+ * Discards whatever the parser currently holds and replaces it with a
+ * deep copy of the snapshot, as if every line processed up to the
+ * checkpoint had just been fed to icalparser_add_line(). The snapshot is
+ * not consumed and may be restored again.
+ */
+LIBICAL_ICAL_EXPORT int icalparser_restore_state(icalparser *parser,
+                                                 const icalparser_snapshot *snapshot);
+
+/**
+ * @brief Frees an ::icalparser_snapshot.
+ * @param snapshot The snapshot to free, may be `NULL`
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalparser_snapshot_free(icalparser_snapshot *snapshot);
+
 /**
  * @brief Message oriented parsing.
  * @param parser The parser to use
@@ -283,6 +432,27 @@ LIBICAL_ICAL_EXPORT icalcomponent *icalparser_parse(icalparser *parser,
  */
 LIBICAL_ICAL_EXPORT void icalparser_set_gen_data(icalparser *parser, void *data);
 
+/**
+ * @brief Makes the parser build its component trees inside an arena.
+ * @param parser The parser for which to set the arena
+ * @param arena The arena to allocate from, or `NULL` to return to
+ *  ordinary heap allocation
+ *
+ * While an arena is set, every component, property, parameter and value
+ * created by icalparser_add_line() (and therefore by icalparser_parse())
+ * is carved out of the arena's slabs. The resulting trees must not be
+ * handed to icalcomponent_free(); instead the whole region is released
+ * in O(1) with icalmemory_arena_free() (or recycled with
+ * icalmemory_arena_clear()). This suits parse-and-discard workloads
+ * where malloc/free of many small tree nodes dominates.
+ *
+ * The arena remains owned by the caller and must outlive both the
+ * parser and any component trees parsed into it.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalparser_set_arena(icalparser *parser, icalmemory_arena *arena);
+
 /**
  * @brief Parses a string and returns the parsed ::icalcomponent.
  * @param str The iCal formatted data to be parsed
@@ -312,6 +482,143 @@ LIBICAL_ICAL_EXPORT void icalparser_set_gen_data(icalparser *parser, void *data)
  */
 LIBICAL_ICAL_EXPORT icalcomponent *icalparser_parse_string(const char *str);
 
+/**
+ * @brief Parses an iCalendar file and returns the parsed ::icalcomponent.
+ * @param fname The name of the file to parse
+ * @return An ::icalcomponent representing the iCalendar
+ *
+ * On platforms that support it, the file is mapped into memory read-only
+ * and parsed in place, instead of being pulled through a line generator
+ * one buffered read at a time. This avoids the per-line read-and-copy
+ * overhead for large archive files. Where memory mapping is unavailable
+ * the function transparently falls back to buffered stdio reads.
+ *
+ * @par Error handling
+ * On error, returns `NULL` and sets ::icalerrno; ::ICAL_FILE_ERROR
+ * indicates the file could not be opened or mapped.
+ *
+ * @par Ownership
+ * The returned ::icalcomponent is owned by the caller of the function,
+ * and needs to be free'd with icalcomponent_free() after use.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalcomponent *icalparser_parse_file_mmap(const char *fname);
+
+/**
+ * @brief Parses many independent iCalendar strings, optionally in parallel.
+ * @param strings An array of @a count zero-terminated iCalendar strings
+ * @param count The number of entries in @a strings
+ * @param num_threads The number of worker threads to parse with; values
+ *  less than 2 parse serially on the calling thread
+ * @param components Output array of @a count entries; entry @p i receives
+ *  the parse result of `strings[i]`, or `NULL` if it did not parse
+ * @return 0 on success, non-zero if the workers could not be started
+ *
+ * Each string is parsed exactly as icalparser_parse_string() would parse
+ * it, and results are delivered in input order regardless of how the
+ * work is scheduled. On builds without thread support the batch is
+ * always parsed serially.
+ *
+ * @par Error handling
+ * If @a strings or @a components is `NULL`, returns non-zero and sets
+ * ::icalerrno to ::ICAL_BADARG_ERROR.
+ *
+ * @par Ownership
+ * Every returned ::icalcomponent is owned by the caller and needs to be
+ * free'd with icalcomponent_free() after use.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalparser_parse_batch(const char *const *strings, size_t count,
+                                               int num_threads, icalcomponent **components);
+
+/***********************************************************************
+ * Streaming (SAX-style) parser
+ ***********************************************************************/
+
+/**
+ * @enum icalparser_event_type
+ * @typedef icalparser_event_type
+ * @brief The kind of event reported by the streaming parser.
+ * @since 3.1.0
+ */
+typedef enum icalparser_event_type
+{
+    /** A `BEGIN:` line was seen; the event name is the component name. */
+    ICALPARSER_EVENT_BEGIN_COMPONENT,
+
+    /** A content line that is neither `BEGIN:` nor `END:` was seen. */
+    ICALPARSER_EVENT_PROPERTY,
+
+    /** An `END:` line was seen; the event name is the component name. */
+    ICALPARSER_EVENT_END_COMPONENT
+} icalparser_event_type;
+
+/**
+ * @struct icalparser_event
+ * @typedef icalparser_event
+ * @brief A single event emitted by icalparser_parse_stream().
+ *
+ * The string slices are NOT zero-terminated and are borrowed: they point
+ * either into the caller's input buffer or into a scratch buffer owned by
+ * the parser, and are only valid for the duration of the callback. Copy
+ * them if they are needed afterwards.
+ *
+ * For ::ICALPARSER_EVENT_PROPERTY events, @a name covers the property
+ * name, @a params covers the raw parameter section between the first `;`
+ * and the value separator (zero length if there are no parameters), and
+ * @a value covers the raw, unescaped value. For component events only
+ * @a name is set.
+ *
+ * @since 3.1.0
+ */
+typedef struct icalparser_event
+{
+    icalparser_event_type type;
+
+    const char *name;
+    size_t name_length;
+
+    const char *params;
+    size_t params_length;
+
+    const char *value;
+    size_t value_length;
+} icalparser_event;
+
+/**
+ * @brief Callback invoked by icalparser_parse_stream() for each event.
+ * @return 0 to continue parsing, any other value to stop
+ * @since 3.1.0
+ */
+typedef int (*icalparser_event_func) (const icalparser_event *event, void *d);
+
+/**
+ * @brief Parses iCalendar data from a buffer, reporting events to a callback.
+ * @param str The iCal formatted data to be parsed; need not be zero-terminated
+ * @param size The number of bytes of data in @a str
+ * @param event_func The callback to invoke for each content line
+ * @param d Arbitrary data to pass to @a event_func
+ * @return 0 on success, non-zero if @a event_func requested a stop
+ *
+ * This is a lower-level alternative to icalparser_parse_string() that does
+ * not build an ::icalcomponent tree. Content lines are unfolded and
+ * reported to @a event_func one at a time as ::icalparser_event structs
+ * whose string slices borrow from the input wherever possible, so large
+ * feeds can be skimmed without per-component allocation. No validation
+ * beyond line framing is performed; values and parameters are reported
+ * in raw wire form.
+ *
+ * @par Error handling
+ * If @a str or @a event_func is `NULL`, returns non-zero and sets
+ * ::icalerrno to ::ICAL_BADARG_ERROR.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalparser_parse_stream(const char *str, size_t size,
+                                                icalparser_event_func event_func, void *d);
+
 /***********************************************************************
  * Parser support functions
  ***********************************************************************/
@@ -30,8 +30,9 @@
 struct icalperiodtype icalperiodtype_from_string(const char *str)
 {
     struct icalperiodtype p, null_p;
-    char *s = icalmemory_strdup(str);
-    char *start, *end;
+    char start_buf[32];
+    const char *slash, *end;
+    size_t start_len;
     icalerrorstate es;
 
     /* Errors are normally generated in the following code, so save
@@ -44,50 +45,63 @@ struct icalperiodtype icalperiodtype_from_string(const char *str)
 
     null_p = p;
 
-    if (s == 0)
+    if (str == 0)
         goto error;
 
-    start = s;
-    end = strchr(s, '/');
+    slash = strchr(str, '/');
 
-    if (end == 0)
+    if (slash == 0)
         goto error;
 
-    *end = 0;
-    end++;
-
-    p.start = icaltime_from_string(start);
-
-    if (icaltime_is_null_time(p.start))
+    /* Copy the start portion to the stack rather than duplicating the
+       whole string on the heap; FREEBUSY lines carry thousands of
+       periods, so the per-period allocation added up. Anything too
+       long for the buffer cannot be a valid date-time anyway. */
+    start_len = (size_t)(slash - str);
+    if (start_len >= sizeof(start_buf))
         goto error;
 
-    es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
-    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
+    memcpy(start_buf, str, start_len);
+    start_buf[start_len] = '\0';
+    end = slash + 1;
 
-    p.end = icaltime_from_string(end);
+    p.start = icaltime_from_string(start_buf);
 
-    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, es);
+    if (icaltime_is_null_time(p.start))
+        goto error;
 
-    if (icaltime_is_null_time(p.end)) {
+    if (end[0] == 'P' || end[0] == '+' || end[0] == '-') {
 
+        /* Only a duration can start this way, so skip the doomed
+           date-time attempt and its error-state juggling */
         p.duration = icaldurationtype_from_string(end);
 
         if (icaldurationtype_as_int(p.duration) == 0)
             goto error;
+    } else {
+        es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
+        icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
+
+        p.end = icaltime_from_string(end);
+
+        icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, es);
+
+        if (icaltime_is_null_time(p.end)) {
+
+            p.duration = icaldurationtype_from_string(end);
+
+            if (icaldurationtype_as_int(p.duration) == 0)
+                goto error;
+        }
     }
 
     icalerrno = e;
 
-    icalmemory_free_buffer(s);
-
     return p;
 
   error:
     icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
 
-    if (s) {
-        icalmemory_free_buffer(s);
-    }
     return null_p;
 }
 
@@ -160,3 +174,13 @@ int icalperiodtype_is_valid_period(struct icalperiodtype p)
 
     return 0;
 }
+
+struct icalperiodarraytype icalperiodarraytype_null_array(void)
+{
+    struct icalperiodarraytype pa;
+
+    pa.periods = 0;
+    pa.num_periods = 0;
+
+    return pa;
+}
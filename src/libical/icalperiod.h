@@ -179,4 +179,25 @@ LIBICAL_ICAL_EXPORT int icalperiodtype_is_null_period(struct icalperiodtype p);
  */
 LIBICAL_ICAL_EXPORT int icalperiodtype_is_valid_period(struct icalperiodtype p);
 
+/**
+ * @brief A packed array of periods, as carried by a single multi-valued
+ * property (RFC 5545 comma syntax), e.g. one FREEBUSY property holding
+ * every busy interval of a response.
+ * @since 3.1.0
+ *
+ * When held by an ::icalvalue the periods block is owned by the value;
+ * see icalvalue_get_periodarray().
+ */
+struct icalperiodarraytype
+{
+    struct icalperiodtype *periods;
+    size_t num_periods;
+};
+
+/**
+ * @brief Returns an ::icalperiodarraytype with no periods.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT struct icalperiodarraytype icalperiodarraytype_null_array(void);
+
 #endif /* !ICALTIME_H */
@@ -24,8 +24,10 @@
 
 #include "icalproperty_p.h"
 #include "icalcomponent.h"
+#include "icalcomponent_p.h"
 #include "icalerror.h"
 #include "icalmemory.h"
+#include "icalparameterimpl.h"
 #include "icalparser.h"
 #include "icaltimezone.h"
 #include "icalvalue.h"
@@ -33,17 +35,81 @@
 
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/* Number of parameter slots stored inside the property itself. Most
+   properties have no parameters at all, and an ATTENDEE with
+   CN/ROLE/PARTSTAT/RSVP is about as heavy as real data gets, so the
+   spill to a heap array is rare. */
+#define ICALPROPERTY_INLINE_PARAMETERS 4
+
+/* Fields are ordered pointers-first and the parameter counters kept to
+   16 bits, so the struct packs without padding holes; parsed calendars
+   hold one of these per property. */
 struct icalproperty_impl
 {
-    char id[5];
-    icalproperty_kind kind;
     char *x_name;
-    pvl_list parameters;
-    pvl_elem parameter_iterator;
+    icalparameter **parameters; /* packed array; aliases parameters_inline
+                                   until the count outgrows it */
     icalvalue *value;
     icalcomponent *parent;
+    char *cached_string;        /* last rendering, dropped on mutation */
+    icalparameter *parameters_inline[ICALPROPERTY_INLINE_PARAMETERS];
+    icalproperty_kind kind;
+    short parameter_count;
+    short parameter_capacity;
+    short parameter_iterator;   /* cursor for get_first/get_next, -1 when idle */
+    char id[5];
 };
 
+/* Appends to the packed parameter array, growing it (or spilling the
+   inline slots to the heap) when full. Returns 0 on allocation
+   failure, in which case the property is unchanged. */
+static int icalproperty_append_parameter(icalproperty *p, icalparameter *parameter)
+{
+    if (p->parameter_count == p->parameter_capacity) {
+        int new_capacity = p->parameter_capacity * 2;
+        icalparameter **resized;
+
+        if (p->parameters == p->parameters_inline) {
+            resized = icalmemory_new_buffer(sizeof(icalparameter *) * (size_t)new_capacity);
+            if (resized == 0) {
+                return 0;
+            }
+            memcpy(resized, p->parameters_inline,
+                   sizeof(icalparameter *) * (size_t)p->parameter_count);
+        } else {
+            resized = icalmemory_resize_buffer(p->parameters,
+                                               sizeof(icalparameter *) * (size_t)new_capacity);
+            if (resized == 0) {
+                return 0;
+            }
+        }
+
+        p->parameters = resized;
+        p->parameter_capacity = (short)new_capacity;
+    }
+
+    p->parameters[p->parameter_count++] = parameter;
+    return 1;
+}
+
+/* Removes (and frees) the parameter at the given array position. */
+static void icalproperty_remove_parameter_at(icalproperty *p, int position)
+{
+    icalparameter *param = p->parameters[position];
+
+    memmove(p->parameters + position, p->parameters + position + 1,
+            sizeof(icalparameter *) * (size_t)(p->parameter_count - position - 1));
+    p->parameter_count--;
+
+    icalparameter_free(param);
+}
+
 void icalproperty_add_parameters(icalproperty *prop, va_list args)
 {
     void *vp;
@@ -67,7 +133,7 @@ icalproperty *icalproperty_new_impl(icalproperty_kind kind)
     if (!icalproperty_kind_is_valid(kind))
         return NULL;
 
-    if ((prop = (icalproperty *) malloc(sizeof(icalproperty))) == 0) {
+    if ((prop = (icalproperty *) icalmemory_pool_alloc(sizeof(icalproperty))) == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
@@ -77,7 +143,9 @@ icalproperty *icalproperty_new_impl(icalproperty_kind kind)
     strcpy(prop->id, "prop");
 
     prop->kind = kind;
-    prop->parameters = pvl_newlist();
+    prop->parameters = prop->parameters_inline;
+    prop->parameter_capacity = ICALPROPERTY_INLINE_PARAMETERS;
+    prop->parameter_iterator = -1;
 
     return prop;
 }
@@ -94,7 +162,7 @@ icalproperty *icalproperty_new(icalproperty_kind kind)
 icalproperty *icalproperty_clone(const icalproperty *old)
 {
     icalproperty *new;
-    pvl_elem p;
+    int i;
 
     icalerror_check_arg_rz((old != 0), "old");
     new = icalproperty_new_impl(old->kind);
@@ -106,7 +174,7 @@ icalproperty *icalproperty_clone(const icalproperty *old)
 
     if (old->x_name != 0) {
 
-        new->x_name = icalmemory_strdup(old->x_name);
+        new->x_name = icalmemory_intern(old->x_name);
 
         if (new->x_name == 0) {
             icalproperty_free(new);
@@ -115,16 +183,17 @@ icalproperty *icalproperty_clone(const icalproperty *old)
         }
     }
 
-    for (p = pvl_head(old->parameters); p != 0; p = pvl_next(p)) {
-        icalparameter *param = icalparameter_clone(pvl_data(p));
+    for (i = 0; i < old->parameter_count; i++) {
+        icalparameter *param = icalparameter_clone(old->parameters[i]);
 
-        if (param == 0) {
+        if (param == 0 || !icalproperty_append_parameter(new, param)) {
+            if (param != 0) {
+                icalparameter_free(param);
+            }
             icalproperty_free(new);
             icalerror_set_errno(ICAL_NEWFAILED_ERROR);
             return 0;
         }
-
-        pvl_push(new->parameters, param);
     }
 
     return new;
@@ -137,30 +206,26 @@ icalproperty *icalproperty_new_clone(icalproperty *old)
 
 icalproperty *icalproperty_new_from_string(const char *str)
 {
-    size_t buf_size = 1024;
-    char *buf;
-    char *buf_ptr;
+    icalmemory_strbuf sb;
     icalproperty *prop;
     icalcomponent *comp;
     int errors = 0;
 
     icalerror_check_arg_rz((str != 0), "str");
 
-    buf = icalmemory_new_buffer(buf_size);
-    buf_ptr = buf;
-
     /* Is this a HACK or a crafty reuse of code? */
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, "BEGIN:VCALENDAR\r\n");
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, "\r\n");
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, "END:VCALENDAR\r\n");
+    icalmemory_strbuf_init(&sb, 1024);
+    icalmemory_strbuf_append(&sb, "BEGIN:VCALENDAR\r\n", 17);
+    icalmemory_strbuf_append_string(&sb, str);
+    icalmemory_strbuf_append(&sb, "\r\n", 2);
+    icalmemory_strbuf_append(&sb, "END:VCALENDAR\r\n", 15);
 
-    comp = icalparser_parse_string(buf);
+    comp = icalparser_parse_string(sb.buf);
 
     if (comp == 0) {
         icalerror_set_errno(ICAL_PARSE_ERROR);
-        free(buf);
+        icalmemory_strbuf_free(&sb);
         return 0;
     }
 
@@ -171,7 +236,7 @@ icalproperty *icalproperty_new_from_string(const char *str)
     icalcomponent_remove_property(comp, prop);
 
     icalcomponent_free(comp);
-    free(buf);
+    icalmemory_strbuf_free(&sb);
 
     if (errors > 0) {
         icalproperty_free(prop);
@@ -181,9 +246,36 @@ icalproperty *icalproperty_new_from_string(const char *str)
     }
 }
 
+/* Drops the cached rendering after any mutation. Called from the
+   property mutators below and, via icalvalue_reset_kind() and the
+   parameter setters, when a contained value or parameter changes. */
+void icalproperty_cache_invalidate(icalproperty *prop)
+{
+    if (prop == 0) {
+        return;
+    }
+
+    if (prop->cached_string != 0) {
+        icalmemory_free_buffer(prop->cached_string);
+        prop->cached_string = 0;
+    }
+
+    /* A parameter change can alter the TZID, so the value's resolved
+       time is no longer trustworthy either. */
+    if (prop->value != 0) {
+        icalvalue_datetime_cache_clear(prop->value);
+    }
+
+    /* Every in-place mutation funnels through here, so this is where
+       the owning component learns that its contents changed. */
+    if (prop->parent != 0) {
+        icalcomponent_touch(prop->parent);
+    }
+}
+
 void icalproperty_free(icalproperty *p)
 {
-    icalparameter *param;
+    int i;
 
     icalerror_check_arg_rv((p != 0), "prop");
 
@@ -196,30 +288,170 @@ void icalproperty_free(icalproperty *p)
         icalvalue_free(p->value);
     }
 
-    while ((param = pvl_pop(p->parameters)) != 0) {
-        icalparameter_free(param);
+    for (i = 0; i < p->parameter_count; i++) {
+        icalparameter_free(p->parameters[i]);
     }
 
-    pvl_free(p->parameters);
+    if (p->parameters != p->parameters_inline) {
+        icalmemory_free_buffer(p->parameters);
+    }
 
     if (p->x_name != 0) {
-        free(p->x_name);
+        icalmemory_intern_release(p->x_name);
+    }
+
+    if (p->cached_string != 0) {
+        icalmemory_free_buffer(p->cached_string);
     }
 
     p->kind = ICAL_NO_PROPERTY;
     p->parameters = 0;
-    p->parameter_iterator = 0;
+    p->parameter_count = 0;
+    p->parameter_iterator = -1;
     p->value = 0;
     p->x_name = 0;
     p->id[0] = 'X';
 
-    free(p);
+    icalmemory_pool_free(p, sizeof(icalproperty));
 }
 
 /* This returns where the start of the next line should be. chars_left does
    not include the trailing '\0'. */
 static size_t MAX_LINE_LEN = 75;
 
+/* Returns the last byte in [lo,hi] equal to ';', ':' or ' ', or NULL.
+   The fold pass runs this over every 75-octet window, so the scan is
+   vectorized where the compiler advertises SSE2 or NEON; the scalar
+   loop at the bottom finishes the unaligned tail (and is the portable
+   fallback). */
+static char *scan_last_break_char(char *lo, char *hi)
+{
+    char *last = 0;
+
+#if defined(__SSE2__)
+    const __m128i vsc = _mm_set1_epi8(';');
+    const __m128i vco = _mm_set1_epi8(':');
+    const __m128i vsp = _mm_set1_epi8(' ');
+
+    while (lo + 16 <= hi + 1) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)lo);
+        int mask = _mm_movemask_epi8(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, vsc),
+                                      _mm_cmpeq_epi8(chunk, vco)),
+                         _mm_cmpeq_epi8(chunk, vsp)));
+
+        if (mask != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+            last = lo + (31 - __builtin_clz((unsigned int)mask));
+#else
+            int bit;
+
+            for (bit = 15; bit >= 0; bit--) {
+                if ((mask >> bit) & 1) {
+                    last = lo + bit;
+                    break;
+                }
+            }
+#endif
+        }
+        lo += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t vsc = vdupq_n_u8(';');
+    const uint8x16_t vco = vdupq_n_u8(':');
+    const uint8x16_t vsp = vdupq_n_u8(' ');
+
+    while (lo + 16 <= hi + 1) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)lo);
+        uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(chunk, vsc), vceqq_u8(chunk, vco)),
+                                   vceqq_u8(chunk, vsp));
+
+        if (vmaxvq_u8(hits) != 0) {
+            int i;
+
+            for (i = 15; i >= 0; i--) {
+                if (lo[i] == ';' || lo[i] == ':' || lo[i] == ' ') {
+                    last = lo + i;
+                    break;
+                }
+            }
+        }
+        lo += 16;
+    }
+#endif
+
+    for (; lo <= hi; lo++) {
+        if (*lo == ';' || *lo == ':' || *lo == ' ') {
+            last = lo;
+        }
+    }
+
+    return last;
+}
+
+/* Returns the last byte in [lo,hi] that is a legal UTF-8 split point -
+   plain ASCII (0xxxxxxx) or a sequence lead byte (11xxxxxx) - or NULL
+   if the whole range is continuation bytes. */
+static char *scan_last_utf8_boundary(char *lo, char *hi)
+{
+    char *last = 0;
+
+#if defined(__SSE2__)
+    const __m128i vmask = _mm_set1_epi8((char)0xC0);
+    const __m128i vcont = _mm_set1_epi8((char)0x80);
+
+    while (lo + 16 <= hi + 1) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)lo);
+        /* continuation bytes are 10xxxxxx; everything else is a boundary */
+        int mask = 0xFFFF ^ _mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_and_si128(chunk, vmask), vcont));
+
+        if (mask != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+            last = lo + (31 - __builtin_clz((unsigned int)mask));
+#else
+            int bit;
+
+            for (bit = 15; bit >= 0; bit--) {
+                if ((mask >> bit) & 1) {
+                    last = lo + bit;
+                    break;
+                }
+            }
+#endif
+        }
+        lo += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t vmask = vdupq_n_u8(0xC0);
+    const uint8x16_t vcont = vdupq_n_u8(0x80);
+
+    while (lo + 16 <= hi + 1) {
+        uint8x16_t cont = vceqq_u8(vandq_u8(vld1q_u8((const uint8_t *)lo), vmask), vcont);
+
+        if (vminvq_u8(cont) != 0xFF) {
+            int i;
+
+            for (i = 15; i >= 0; i--) {
+                if ((lo[i] & 0xC0) != 0x80) {
+                    last = lo + i;
+                    break;
+                }
+            }
+        }
+        lo += 16;
+    }
+#endif
+
+    for (; lo <= hi; lo++) {
+        if ((*lo & 128) == 0 || (*lo & 192) == 192) {
+            last = lo;
+        }
+    }
+
+    return last;
+}
+
 static char *get_next_line_start(char *line_start, size_t chars_left)
 {
     char *pos;
@@ -230,31 +462,20 @@ static char *get_next_line_start(char *line_start, size_t chars_left)
         return line_start + chars_left;
     }
 
-    /* Now we jump to the last possible character of the line, and step back
-       trying to find a ';' ':' or ' '. If we find one, we return the character
-       after it. */
-    pos = line_start + MAX_LINE_LEN - 2;
-    while (pos > line_start) {
-        if (*pos == ';' || *pos == ':' || *pos == ' ') {
-            return pos + 1;
-        }
-        pos--;
+    /* Look for the last ';' ':' or ' ' in the line. If we find one, we
+       return the character after it. */
+    pos = scan_last_break_char(line_start + 1, line_start + MAX_LINE_LEN - 2);
+    if (pos != 0) {
+        return pos + 1;
     }
+
     /* Now try to split on a UTF-8 boundary defined as a 7-bit
        value or as a byte with the two high-most bits set:
        11xxxxxx.  See https://czyborra.com/utf/ */
 
-    pos = line_start + MAX_LINE_LEN - 1;
-    while (pos > line_start) {
-        /* plain ascii */
-        if ((*pos & 128) == 0)
-            return pos;
-
-        /* utf8 escape byte */
-        if ((*pos & 192) == 192)
-            return pos;
-
-        pos--;
+    pos = scan_last_utf8_boundary(line_start + 1, line_start + MAX_LINE_LEN - 1);
+    if (pos != 0) {
+        return pos;
     }
 
     /* Give up, just break at 74 chars (the 75th char is the space at
@@ -271,17 +492,22 @@ static char *get_next_line_start(char *line_start, size_t chars_left)
  */
 static char *fold_property_line(char *text)
 {
-    size_t buf_size, len, chars_left;
-    char *buf, *buf_ptr, *line_start, *next_line_start;
+    icalmemory_strbuf sb;
+    size_t len, chars_left;
+    char *line_start, *next_line_start;
     int first_line;
-    char ch;
 
-    /* Start with a buffer twice the size of our property line, so we almost
-       certainly won't overflow it. */
     len = strlen(text);
-    buf_size = len * 2;
-    buf = icalmemory_new_buffer(buf_size);
-    buf_ptr = buf;
+
+    /* Most property lines are already shorter than the fold limit and
+       pass through unchanged */
+    if (len < MAX_LINE_LEN) {
+        return icalmemory_strdup(text);
+    }
+
+    /* Reserve for the text plus one fold sequence per 72 octets, so the
+       common case never grows the builder. */
+    icalmemory_strbuf_init(&sb, len + (len / 72 + 1) * 3 + 1);
 
     /* Step through the text, finding each line to add to the output. */
     line_start = text;
@@ -297,23 +523,20 @@ static char *fold_property_line(char *text)
         /* If this isn't the first line, we need to output a newline and space
            first. */
         if (!first_line) {
-            icalmemory_append_string(&buf, &buf_ptr, &buf_size, "\r\n ");
+            icalmemory_strbuf_append(&sb, "\r\n ", 3);
         }
         first_line = 0;
 
-        /* This adds the line to our tmp buffer. We temporarily place a '\0'
-           in text, so we can copy the line in one go. */
-        ch = *next_line_start;
-        *next_line_start = '\0';
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, line_start);
-        *next_line_start = ch;
+        /* The line's length is known, so it can be copied in one go
+           without patching a temporary '\0' into the source. */
+        icalmemory_strbuf_append(&sb, line_start, (size_t)(next_line_start - line_start));
 
         /* Now we move on to the next line. */
         chars_left -= (next_line_start - line_start);
         line_start = next_line_start;
     }
 
-    return buf;
+    return icalmemory_strbuf_detach(&sb);
 }
 
 /* Determine what VALUE parameter to include. The VALUE parameters
@@ -339,6 +562,10 @@ static const char *icalproperty_get_value_kind(icalproperty *prop)
             icalattach *a = icalvalue_get_attach(value);
 
             kind = icalattach_get_is_url(a) ? ICAL_URI_VALUE : ICAL_BINARY_VALUE;
+        } else if (kind == ICAL_PERIODARRAY_VALUE) {
+            /* A packed period array renders as the standard comma-separated
+               PERIOD list, so on the wire it is plain PERIOD content */
+            kind = ICAL_PERIOD_VALUE;
         }
     }
 
@@ -371,18 +598,18 @@ char *icalproperty_as_ical_string_r(icalproperty *prop)
      */
 
     const char *property_name = 0;
-    size_t buf_size = 1024;
-    char *buf;
-    char *buf_ptr;
+    icalmemory_strbuf sb;
     icalvalue *value;
     char *out_buf;
     const char *kind_string = 0;
-    const char newline[] = "\r\n";
 
     icalerror_check_arg_rz((prop != 0), "prop");
 
-    buf = icalmemory_new_buffer(buf_size);
-    buf_ptr = buf;
+    /* Most properties never change after parse, so a repeated
+       serialization can reuse the previous rendering */
+    if (prop->cached_string != 0) {
+        return icalmemory_strdup(prop->cached_string);
+    }
 
     /* Append property name */
 
@@ -394,16 +621,19 @@ char *icalproperty_as_ical_string_r(icalproperty *prop)
 
     if (property_name == 0) {
         icalerror_warn("Got a property of an unknown kind.");
-        icalmemory_free_buffer(buf);
         return 0;
     }
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, property_name);
+    /* The assembled line is discarded after folding, so the builder's
+       scratch-pool storage never leaves this call */
+    icalmemory_strbuf_init(&sb, 1024);
+
+    icalmemory_strbuf_append_string(&sb, property_name);
 
     kind_string = icalproperty_get_value_kind(prop);
     if (kind_string != 0) {
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, ";VALUE=");
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, kind_string);
+        icalmemory_strbuf_append(&sb, ";VALUE=", 7);
+        icalmemory_strbuf_append_string(&sb, kind_string);
     }
 
     /* Append parameters */
@@ -422,18 +652,18 @@ char *icalproperty_as_ical_string_r(icalproperty *prop)
         }
 
         if (kind == ICAL_VALUE_PARAMETER) {
-            free((char *)kind_string);
+            icalmemory_free_buffer((char *)kind_string);
             continue;
         }
 
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, ";");
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, kind_string);
-        free((char *)kind_string);
+        icalmemory_strbuf_append_char(&sb, ';');
+        icalmemory_strbuf_append_string(&sb, kind_string);
+        icalmemory_free_buffer((char *)kind_string);
     }
 
     /* Append value */
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, ":");
+    icalmemory_strbuf_append_char(&sb, ':');
 
     value = icalproperty_get_value(prop);
 
@@ -441,26 +671,28 @@ char *icalproperty_as_ical_string_r(icalproperty *prop)
         char *str = icalvalue_as_ical_string_r(value);
 
         if (str != 0) {
-            icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
+            icalmemory_strbuf_append_string(&sb, str);
 #if ICAL_ALLOW_EMPTY_PROPERTIES == 0
         } else {
-            icalmemory_append_string(&buf, &buf_ptr, &buf_size, "ERROR: No Value");
+            icalmemory_strbuf_append(&sb, "ERROR: No Value", 15);
 #endif
         }
-        free(str);
+        icalmemory_free_buffer(str);
     } else {
 #if ICAL_ALLOW_EMPTY_PROPERTIES == 0
-        icalmemory_append_string(&buf, &buf_ptr, &buf_size, "ERROR: No Value");
+        icalmemory_strbuf_append(&sb, "ERROR: No Value", 15);
 #endif
     }
 
-    icalmemory_append_string(&buf, &buf_ptr, &buf_size, newline);
+    icalmemory_strbuf_append(&sb, "\r\n", 2);
 
     /* We now use a function to fold the line properly every 75 characters.
        That function also adds the newline for us. */
-    out_buf = fold_property_line(buf);
+    out_buf = fold_property_line(sb.buf);
+
+    icalmemory_strbuf_free(&sb);
 
-    icalmemory_free_buffer(buf);
+    prop->cached_string = icalmemory_strdup(out_buf);
 
     return out_buf;
 }
@@ -491,7 +723,12 @@ void icalproperty_add_parameter(icalproperty *p, icalparameter *parameter)
     icalerror_check_arg_rv((p != 0), "prop");
     icalerror_check_arg_rv((parameter != 0), "parameter");
 
-    pvl_push(p->parameters, parameter);
+    icalproperty_cache_invalidate(p);
+
+    if (!icalproperty_append_parameter(p, parameter)) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        icalparameter_free(parameter);
+    }
 }
 
 void icalproperty_set_parameter(icalproperty *prop, icalparameter *parameter)
@@ -600,13 +837,13 @@ char *icalproperty_get_parameter_as_string_r(icalproperty *prop, const char *nam
 
     if (t == 0) {
         icalerror_set_errno(ICAL_INTERNAL_ERROR);
-        free(str);
+        icalmemory_free_buffer(str);
         return 0;
     }
 
     /* Strip the property name and the equal sign */
     pv = icalmemory_strdup(t + 1);
-    free(str);
+    icalmemory_free_buffer(str);
 
     /* Is the string quoted? */
     pvql = strchr(pv, '"');
@@ -616,13 +853,13 @@ char *icalproperty_get_parameter_as_string_r(icalproperty *prop, const char *nam
 
     /* Strip everything up to the first quote */
     str = icalmemory_strdup(pvql + 1);
-    free(pv);
+    icalmemory_free_buffer(pv);
 
     /* Search for the end quote */
     pvqr = strrchr(str, '"');
     if (pvqr == 0) {
         icalerror_set_errno(ICAL_INTERNAL_ERROR);
-        free(str);
+        icalmemory_free_buffer(str);
         return 0;
     }
 
@@ -630,18 +867,47 @@ char *icalproperty_get_parameter_as_string_r(icalproperty *prop, const char *nam
     return str;
 }
 
+const char *icalproperty_get_parameter_value(icalproperty *prop, icalparameter_kind kind)
+{
+    int i;
+
+    icalerror_check_arg_rz((prop != 0), "prop");
+    icalerror_check_arg_rz((kind != ICAL_ANY_PARAMETER && kind != ICAL_NO_PARAMETER), "kind");
+
+    for (i = 0; i < prop->parameter_count; i++) {
+        struct icalparameter_impl *param = prop->parameters[i];
+
+        if (param->kind != kind) {
+            continue;
+        }
+
+        /* Hand back the stored form directly: the string for
+           string-valued (and X/IANA) parameters, the static name of
+           the enumeration value otherwise. Nothing is rendered,
+           un-quoted or copied. */
+        if (param->string != 0) {
+            return param->string;
+        }
+        if (param->data != 0) {
+            return icalparameter_enum_to_string(param->data);
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
 void icalproperty_remove_parameter_by_kind(icalproperty *prop, icalparameter_kind kind)
 {
-    pvl_elem p;
+    int i;
 
     icalerror_check_arg_rv((prop != 0), "prop");
 
-    for (p = pvl_head(prop->parameters); p != 0; p = pvl_next(p)) {
-        icalparameter *param = (icalparameter *) pvl_data(p);
+    icalproperty_cache_invalidate(prop);
 
-        if (icalparameter_isa(param) == kind) {
-            (void)pvl_remove(prop->parameters, p);
-            icalparameter_free(param);
+    for (i = 0; i < prop->parameter_count; i++) {
+        if (icalparameter_isa(prop->parameters[i]) == kind) {
+            icalproperty_remove_parameter_at(prop, i);
             break;
         }
     }
@@ -649,12 +915,14 @@ void icalproperty_remove_parameter_by_kind(icalproperty *prop, icalparameter_kin
 
 void icalproperty_remove_parameter_by_name(icalproperty *prop, const char *name)
 {
-    pvl_elem p;
+    int i;
 
     icalerror_check_arg_rv((prop != 0), "prop");
 
-    for (p = pvl_head(prop->parameters); p != 0; p = pvl_next(p)) {
-        icalparameter *param = (icalparameter *) pvl_data(p);
+    icalproperty_cache_invalidate(prop);
+
+    for (i = 0; i < prop->parameter_count; i++) {
+        icalparameter *param = prop->parameters[i];
         const char *kind_string;
 
         if (icalparameter_isa(param) == ICAL_X_PARAMETER) {
@@ -669,8 +937,7 @@ void icalproperty_remove_parameter_by_name(icalproperty *prop, const char *name)
             continue;
 
         if (0 == strcmp(kind_string, name)) {
-            (void)pvl_remove(prop->parameters, p);
-            icalparameter_free(param);
+            icalproperty_remove_parameter_at(prop, i);
             break;
         }
     }
@@ -678,17 +945,16 @@ void icalproperty_remove_parameter_by_name(icalproperty *prop, const char *name)
 
 void icalproperty_remove_parameter_by_ref(icalproperty *prop, icalparameter *parameter)
 {
-    pvl_elem p;
+    int i;
 
     icalerror_check_arg_rv((prop != 0), "prop");
     icalerror_check_arg_rv((parameter != 0), "parameter");
 
-    for (p = pvl_head(prop->parameters); p != 0; p = pvl_next(p)) {
-        icalparameter *p_param = (icalparameter *) pvl_data(p);
+    icalproperty_cache_invalidate(prop);
 
-        if (icalparameter_has_same_name(parameter, p_param)) {
-            (void)pvl_remove(prop->parameters, p);
-            icalparameter_free(p_param);
+    for (i = 0; i < prop->parameter_count; i++) {
+        if (icalparameter_has_same_name(parameter, prop->parameters[i])) {
+            icalproperty_remove_parameter_at(prop, i);
             break;
         }
     }
@@ -697,7 +963,7 @@ void icalproperty_remove_parameter_by_ref(icalproperty *prop, icalparameter *par
 int icalproperty_count_parameters(const icalproperty *prop)
 {
     if (prop != 0) {
-        return pvl_count(prop->parameters);
+        return prop->parameter_count;
     }
 
     icalerror_set_errno(ICAL_USAGE_ERROR);
@@ -708,46 +974,98 @@ icalparameter *icalproperty_get_first_parameter(icalproperty *p, icalparameter_k
 {
     icalerror_check_arg_rz((p != 0), "prop");
 
-    p->parameter_iterator = pvl_head(p->parameters);
+    for (p->parameter_iterator = 0;
+         p->parameter_iterator < p->parameter_count; p->parameter_iterator++) {
+
+        icalparameter *param = p->parameters[p->parameter_iterator];
+
+        if (icalparameter_isa(param) == kind || kind == ICAL_ANY_PARAMETER) {
+            return param;
+        }
+    }
 
-    if (p->parameter_iterator == 0) {
+    p->parameter_iterator = -1;
+    return 0;
+}
+
+icalparameter *icalproperty_get_next_parameter(icalproperty *p, icalparameter_kind kind)
+{
+    icalerror_check_arg_rz((p != 0), "prop");
+
+    if (p->parameter_iterator < 0) {
         return 0;
     }
 
-    for (p->parameter_iterator = pvl_head(p->parameters);
-         p->parameter_iterator != 0; p->parameter_iterator = pvl_next(p->parameter_iterator)) {
+    for (p->parameter_iterator++;
+         p->parameter_iterator < p->parameter_count; p->parameter_iterator++) {
 
-        icalparameter *param = (icalparameter *) pvl_data(p->parameter_iterator);
+        icalparameter *param = p->parameters[p->parameter_iterator];
 
         if (icalparameter_isa(param) == kind || kind == ICAL_ANY_PARAMETER) {
             return param;
         }
     }
 
+    p->parameter_iterator = -1;
     return 0;
 }
 
-icalparameter *icalproperty_get_next_parameter(icalproperty *p, icalparameter_kind kind)
+static icalparamiter icalparamiter_null = { ICAL_NO_PARAMETER, 0, 0 };
+
+icalparamiter icalproperty_begin_parameter(icalproperty *prop, icalparameter_kind kind)
 {
-    icalerror_check_arg_rz((p != 0), "prop");
+    icalparamiter itr;
+
+    itr.kind = kind;
+    itr.prop = 0;
+    itr.pos = 0;
+
+    icalerror_check_arg_re(prop != 0, "prop", icalparamiter_null);
+
+    for (itr.pos = 0; itr.pos < prop->parameter_count; itr.pos++) {
+
+        icalparameter *param = prop->parameters[itr.pos];
+
+        if (icalparameter_isa(param) == kind || kind == ICAL_ANY_PARAMETER) {
+
+            itr.prop = prop;
+
+            return itr;
+        }
+    }
+
+    return icalparamiter_null;
+}
 
-    if (p->parameter_iterator == 0) {
+icalparameter *icalparamiter_next(icalparamiter *i)
+{
+    if (i->prop == 0) {
         return 0;
     }
 
-    for (p->parameter_iterator = pvl_next(p->parameter_iterator);
-         p->parameter_iterator != 0; p->parameter_iterator = pvl_next(p->parameter_iterator)) {
+    for (i->pos++; i->pos < i->prop->parameter_count; i->pos++) {
 
-        icalparameter *param = (icalparameter *) pvl_data(p->parameter_iterator);
+        icalparameter *param = i->prop->parameters[i->pos];
+
+        if (icalparameter_isa(param) == i->kind || i->kind == ICAL_ANY_PARAMETER) {
 
-        if (icalparameter_isa(param) == kind || kind == ICAL_ANY_PARAMETER) {
             return param;
         }
     }
 
+    i->prop = 0;
     return 0;
 }
 
+icalparameter *icalparamiter_deref(icalparamiter *i)
+{
+    if (i->prop == 0 || i->pos >= i->prop->parameter_count) {
+        return 0;
+    }
+
+    return i->prop->parameters[i->pos];
+}
+
 void icalproperty_set_value(icalproperty *p, icalvalue *value)
 {
     icalvalue_kind kind;
@@ -755,6 +1073,8 @@ void icalproperty_set_value(icalproperty *p, icalvalue *value)
     icalerror_check_arg_rv((p != 0), "prop");
     icalerror_check_arg_rv((value != 0), "value");
 
+    icalproperty_cache_invalidate(p);
+
     if (p->value != 0) {
         icalvalue_set_parent(p->value, 0);
         icalvalue_free(p->value);
@@ -778,6 +1098,75 @@ void icalproperty_set_value(icalproperty *p, icalvalue *value)
     }
 }
 
+/** @private
+ *
+ * True for value kinds whose data lives wholly inside the value impl,
+ * so a setter can overwrite it without freeing anything.
+ */
+static int icalvalue_kind_is_fixed_size(icalvalue_kind kind)
+{
+    switch (kind) {
+    case ICAL_DATE_VALUE:
+    case ICAL_DATETIME_VALUE:
+    case ICAL_DATETIMEDATE_VALUE:
+    case ICAL_DURATION_VALUE:
+    case ICAL_INTEGER_VALUE:
+    case ICAL_BOOLEAN_VALUE:
+    case ICAL_UTCOFFSET_VALUE:
+    case ICAL_FLOAT_VALUE:
+    case ICAL_PERIOD_VALUE:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+int icalproperty_value_reusable(icalproperty *prop, icalvalue_kind vkind)
+{
+    icalvalue_kind have;
+
+    if (prop == 0 || prop->value == 0) {
+        return 0;
+    }
+
+    have = icalvalue_isa(prop->value);
+
+    if (vkind == ICAL_DATETIMEDATE_VALUE || vkind == ICAL_DATETIME_VALUE ||
+        vkind == ICAL_DATE_VALUE) {
+        /* The DATE/DATE-TIME setters accept either kind, and
+           icalvalue_reset_kind() keeps the stored kind honest after
+           the overwrite */
+        return have == ICAL_DATETIME_VALUE || have == ICAL_DATE_VALUE;
+    }
+
+    return have == vkind && icalvalue_kind_is_fixed_size(vkind);
+}
+
+void icalproperty_value_reused(icalproperty *prop)
+{
+    icalvalue_kind kind;
+
+    if (prop == 0 || prop->value == 0) {
+        return;
+    }
+
+    /* Same invariant icalproperty_set_value() maintains: a VALUE
+       parameter contradicting the (possibly flipped) DATE/DATE-TIME
+       kind is dropped. The caches were already invalidated by the
+       value setter through icalvalue_reset_kind(). */
+    kind = icalvalue_isa(prop->value);
+    if (kind == ICAL_DATE_VALUE || kind == ICAL_DATETIME_VALUE) {
+        icalparameter *val_param;
+
+        val_param = icalproperty_get_first_parameter(prop, ICAL_VALUE_PARAMETER);
+
+        if (val_param &&
+            icalparameter_value_to_value_kind(icalparameter_get_value(val_param)) != kind) {
+            icalproperty_remove_parameter_by_kind(prop, ICAL_VALUE_PARAMETER);
+        }
+    }
+}
+
 void icalproperty_set_value_from_string(icalproperty *prop, const char *str, const char *type)
 {
     icalvalue *oval, *nval;
@@ -851,11 +1240,13 @@ void icalproperty_set_x_name(icalproperty *prop, const char *name)
     icalerror_check_arg_rv((name != 0), "name");
     icalerror_check_arg_rv((prop != 0), "prop");
 
+    icalproperty_cache_invalidate(prop);
+
     if (prop->x_name != 0) {
-        free(prop->x_name);
+        icalmemory_intern_release(prop->x_name);
     }
 
-    prop->x_name = icalmemory_strdup(name);
+    prop->x_name = icalmemory_intern(name);
 
     if (prop->x_name == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
@@ -914,6 +1305,12 @@ void icalproperty_set_parent(icalproperty *property, icalcomponent *component)
 {
     icalerror_check_arg_rv((property != 0), "property");
 
+    /* A different enclosing component may resolve a TZID to a
+       different zone. */
+    if (property->parent != component && property->value != 0) {
+        icalvalue_datetime_cache_clear(property->value);
+    }
+
     property->parent = component;
 }
 
@@ -934,11 +1331,13 @@ static int param_compare(void *a, void *b)
 void icalproperty_normalize(icalproperty *prop)
 {
     icalproperty_kind prop_kind = icalproperty_isa(prop);
-    pvl_list sorted_params = pvl_newlist();
-    icalparameter *param;
+    int i, j, kept = 0;
+
+    icalproperty_cache_invalidate(prop);
 
-    /* Normalize parameters into sorted list */
-    while ((param = pvl_pop(prop->parameters)) != 0) {
+    /* Drop parameters having default values, compacting the survivors */
+    for (i = 0; i < prop->parameter_count; i++) {
+        icalparameter *param = prop->parameters[i];
         int remove = 0;
 
         /* Remove parameters having default values */
@@ -1036,12 +1435,21 @@ void icalproperty_normalize(icalproperty *prop)
             icalparameter_set_parent(param, 0); // MUST NOT have a parent to free
             icalparameter_free(param);
         } else {
-            pvl_insert_ordered(sorted_params, param_compare, param);
+            prop->parameters[kept++] = param;
         }
     }
+    prop->parameter_count = (short)kept;
+
+    /* Sort the remaining parameters; insertion sort, as the lists are
+       only a handful of entries long */
+    for (i = 1; i < prop->parameter_count; i++) {
+        icalparameter *param = prop->parameters[i];
 
-    pvl_free(prop->parameters);
-    prop->parameters = sorted_params;
+        for (j = i; j > 0 && param_compare(prop->parameters[j - 1], param) > 0; j--) {
+            prop->parameters[j] = prop->parameters[j - 1];
+        }
+        prop->parameters[j] = param;
+    }
 }
 
 /**     @brief Gets a DATE or DATE-TIME property as an icaltime
@@ -1059,12 +1467,32 @@ struct icaltimetype icalproperty_get_datetime_with_component(icalproperty *prop,
 {
     icalcomponent *c;
     icalparameter *param;
+    icalvalue *value;
     struct icaltimetype ret;
+    int cacheable;
 
-    ret = icalvalue_get_datetime(icalproperty_get_value(prop));
+    value = icalproperty_get_value(prop);
 
-    if (icaltime_is_utc(ret))
+    /* The resolved time is a property of the value alone only when the
+       zone is looked up through the property's own enclosing
+       components, which is how every caller uses this; a foreign comp
+       bypasses the cache. Frozen components promise read-only
+       traversal, so no cache is written for them either. */
+    cacheable = (comp == 0 || comp == prop->parent) &&
+        (prop->parent == 0 || !icalcomponent_is_frozen(prop->parent));
+
+    if (cacheable && icalvalue_datetime_cache_get(value, &ret)) {
         return ret;
+    }
+
+    ret = icalvalue_get_datetime(value);
+
+    if (icaltime_is_utc(ret)) {
+        if (cacheable) {
+            icalvalue_datetime_cache_set(value, ret);
+        }
+        return ret;
+    }
 
     if ((param = icalproperty_get_first_parameter(prop, ICAL_TZID_PARAMETER)) != NULL) {
         const char *tzid = icalparameter_get_tzid(param);
@@ -1089,5 +1517,9 @@ struct icaltimetype icalproperty_get_datetime_with_component(icalproperty *prop,
             ret = icaltime_set_timezone(&ret, tz);
     }
 
+    if (cacheable) {
+        icalvalue_datetime_cache_set(value, ret);
+    }
+
     return ret;
 }
@@ -22,6 +22,7 @@
 #include "libical_deprecated.h"
 #include "libical_ical_export.h"
 #include "icalderivedproperty.h"        /* To get icalproperty_kind enumerations */
+#include "pvl.h"
 
 #include <stdarg.h>     /* for va_... */
 
@@ -65,6 +66,21 @@ LIBICAL_ICAL_EXPORT const char *icalproperty_get_parameter_as_string(icalpropert
 LIBICAL_ICAL_EXPORT char *icalproperty_get_parameter_as_string_r(icalproperty *prop,
                                                                  const char *name);
 
+/** @brief Returns the value of the first parameter of the given kind
+ *  as a borrowed string, or NULL when the property has no such
+ *  parameter.
+ *  @since 3.1.0
+ *
+ *  Unlike icalproperty_get_parameter_as_string(), nothing is rendered,
+ *  un-quoted or copied: string-valued parameters (TZID, X-*, ...) hand
+ *  back their stored string, enumerated ones (PARTSTAT, RELATED, ...)
+ *  the static name of their value.  The string stays valid until the
+ *  parameter is changed or freed, and the lookup does not disturb the
+ *  property's parameter iterator.
+ */
+LIBICAL_ICAL_EXPORT const char *icalproperty_get_parameter_value(icalproperty *prop,
+                                                                 icalparameter_kind kind);
+
 /** @brief Removes all parameters with the specified kind.
  *
  *  @param prop   A valid icalproperty.
@@ -111,6 +127,36 @@ LIBICAL_ICAL_EXPORT icalparameter *icalproperty_get_first_parameter(icalproperty
                                                                     icalparameter_kind kind);
 LIBICAL_ICAL_EXPORT icalparameter *icalproperty_get_next_parameter(icalproperty *prop,
                                                                    icalparameter_kind kind);
+
+/** External parameter iterator; the parameter-level counterpart of
+   ::icalcompiter and ::icalpropiter. The cursor lives in the caller's
+   struct rather than in the property, so nested or concurrent loops
+   over one property do not corrupt each other. */
+typedef struct icalparamiter
+{
+    icalparameter_kind kind;
+    icalproperty *prop;
+    int pos;
+
+} icalparamiter;
+
+/**
+ * @brief Returns an external iterator positioned on the property's
+ * first parameter of the given kind.
+ * @since 3.1.0
+ *
+ * Unlike icalproperty_get_first_parameter(), which stores its cursor
+ * inside the property, the external iterator never writes to the
+ * property, so it is safe for nested loops and for reading properties
+ * shared between threads (see icalcomponent_freeze()).
+ */
+LIBICAL_ICAL_EXPORT icalparamiter icalproperty_begin_parameter(icalproperty *prop,
+                                                               icalparameter_kind kind);
+
+LIBICAL_ICAL_EXPORT icalparameter *icalparamiter_next(icalparamiter *i);
+
+LIBICAL_ICAL_EXPORT icalparameter *icalparamiter_deref(icalparamiter *i);
+
 /* Access the value of the property */
 LIBICAL_ICAL_EXPORT void icalproperty_set_value(icalproperty *prop, icalvalue *value);
 LIBICAL_ICAL_EXPORT void icalproperty_set_value_from_string(icalproperty *prop, const char *value,
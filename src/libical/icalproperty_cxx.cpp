@@ -50,6 +50,26 @@ ICalProperty &ICalProperty::operator=(const ICalProperty &v)
     return *this;
 }
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+ICalProperty::ICalProperty(ICalProperty &&v) noexcept : imp(v.imp)
+{
+    v.imp = NULL;
+}
+
+ICalProperty &ICalProperty::operator=(ICalProperty &&v) noexcept
+{
+    if (this != &v) {
+        if (imp != NULL) {
+            icalproperty_free(imp);
+        }
+        imp = v.imp;
+        v.imp = NULL;
+    }
+
+    return *this;
+}
+#endif
+
 void ICalProperty::detach()
 {
     imp = NULL;
@@ -175,6 +195,17 @@ std::string ICalProperty::get_name() const
     return static_cast<std::string>(icalproperty_get_property_name(imp));
 }
 
+const char *ICalProperty::get_name_c_str() const
+{
+    /* Unlike icalproperty_get_property_name() this never touches the
+       temporary buffer ring: both branches return storage owned by the
+       property or the static kind table. */
+    if (icalproperty_isa(imp) == ICAL_X_PROPERTY) {
+        return icalproperty_get_x_name(imp);
+    }
+    return icalproperty_kind_to_string(icalproperty_isa(imp));
+}
+
 /* Deal with X properties */
 void ICalProperty::set_x_name(ICalProperty &prop, const std::string &name)
 {
@@ -280,6 +311,11 @@ std::string ICalProperty::get_attendee() const
     return static_cast<std::string>(icalproperty_get_attendee(imp));
 }
 
+const char *ICalProperty::get_attendee_c_str() const
+{
+    return icalproperty_get_attendee(imp);
+}
+
 /* CALSCALE */
 void ICalProperty::set_calscale(const std::string &val)
 {
@@ -291,6 +327,11 @@ std::string ICalProperty::get_calscale() const
     return static_cast<std::string>(icalproperty_get_calscale(imp));
 }
 
+const char *ICalProperty::get_calscale_c_str() const
+{
+    return icalproperty_get_calscale(imp);
+}
+
 /* CATEGORIES */
 void ICalProperty::set_categories(const std::string &val)
 {
@@ -302,6 +343,11 @@ std::string ICalProperty::get_categories() const
     return static_cast<std::string>(icalproperty_get_categories(imp));
 }
 
+const char *ICalProperty::get_categories_c_str() const
+{
+    return icalproperty_get_categories(imp);
+}
+
 /* CLASS */
 void ICalProperty::set_class(const enum icalproperty_class &val)
 {
@@ -324,6 +370,11 @@ std::string ICalProperty::get_comment() const
     return static_cast<std::string>(icalproperty_get_comment(imp));
 }
 
+const char *ICalProperty::get_comment_c_str() const
+{
+    return icalproperty_get_comment(imp);
+}
+
 /* COMPLETED */
 void ICalProperty::set_completed(const struct icaltimetype &val)
 {
@@ -345,6 +396,11 @@ std::string ICalProperty::get_contact() const
     return static_cast<std::string>(icalproperty_get_contact(imp));
 }
 
+const char *ICalProperty::get_contact_c_str() const
+{
+    return icalproperty_get_contact(imp);
+}
+
 /* CREATED */
 void ICalProperty::set_created(const struct icaltimetype &val)
 {
@@ -366,6 +422,11 @@ std::string ICalProperty::get_description() const
     return static_cast<std::string>(icalproperty_get_description(imp));
 }
 
+const char *ICalProperty::get_description_c_str() const
+{
+    return icalproperty_get_description(imp);
+}
+
 /* DTEND */
 void ICalProperty::set_dtend(const struct icaltimetype &val)
 {
@@ -488,6 +549,11 @@ std::string ICalProperty::get_location() const
     return static_cast<std::string>(icalproperty_get_location(imp));
 }
 
+const char *ICalProperty::get_location_c_str() const
+{
+    return icalproperty_get_location(imp);
+}
+
 /* MAXRESULTS */
 void ICalProperty::set_maxresults(const int &val)
 {
@@ -532,6 +598,11 @@ std::string ICalProperty::get_organizer() const
     return static_cast<std::string>(icalproperty_get_organizer(imp));
 }
 
+const char *ICalProperty::get_organizer_c_str() const
+{
+    return icalproperty_get_organizer(imp);
+}
+
 /* OWNER */
 void ICalProperty::set_owner(const std::string &val)
 {
@@ -543,6 +614,11 @@ std::string ICalProperty::get_owner() const
     return static_cast<std::string>(icalproperty_get_owner(imp));
 }
 
+const char *ICalProperty::get_owner_c_str() const
+{
+    return icalproperty_get_owner(imp);
+}
+
 /* PERCENT-COMPLETE */
 void ICalProperty::set_percentcomplete(const int &val)
 {
@@ -576,6 +652,11 @@ std::string ICalProperty::get_prodid() const
     return static_cast<std::string>(icalproperty_get_prodid(imp));
 }
 
+const char *ICalProperty::get_prodid_c_str() const
+{
+    return icalproperty_get_prodid(imp);
+}
+
 /* QUERY */
 void ICalProperty::set_query(const std::string &val)
 {
@@ -587,6 +668,11 @@ std::string ICalProperty::get_query() const
     return static_cast<std::string>(icalproperty_get_query(imp));
 }
 
+const char *ICalProperty::get_query_c_str() const
+{
+    return icalproperty_get_query(imp);
+}
+
 /* QUERYNAME */
 void ICalProperty::set_queryname(const std::string &val)
 {
@@ -598,6 +684,11 @@ std::string ICalProperty::get_queryname() const
     return static_cast<std::string>(icalproperty_get_queryname(imp));
 }
 
+const char *ICalProperty::get_queryname_c_str() const
+{
+    return icalproperty_get_queryname(imp);
+}
+
 /* RDATE */
 void ICalProperty::set_rdate(const struct icaldatetimeperiodtype &val)
 {
@@ -629,6 +720,11 @@ std::string ICalProperty::get_relatedto() const
     return static_cast<std::string>(icalproperty_get_relatedto(imp));
 }
 
+const char *ICalProperty::get_relatedto_c_str() const
+{
+    return icalproperty_get_relatedto(imp);
+}
+
 /* RELCALID */
 void ICalProperty::set_relcalid(const std::string &val)
 {
@@ -640,6 +736,11 @@ std::string ICalProperty::get_relcalid() const
     return static_cast<std::string>(icalproperty_get_relcalid(imp));
 }
 
+const char *ICalProperty::get_relcalid_c_str() const
+{
+    return icalproperty_get_relcalid(imp);
+}
+
 /* REPEAT */
 void ICalProperty::set_repeat(const int &val)
 {
@@ -676,6 +777,11 @@ std::string ICalProperty::get_resources() const
     return static_cast<std::string>(icalproperty_get_resources(imp));
 }
 
+const char *ICalProperty::get_resources_c_str() const
+{
+    return icalproperty_get_resources(imp);
+}
+
 /* RRULE */
 void ICalProperty::set_rrule(const struct icalrecurrencetype &val)
 {
@@ -697,6 +803,11 @@ std::string ICalProperty::get_scope() const
     return static_cast<std::string>(icalproperty_get_scope(imp));
 }
 
+const char *ICalProperty::get_scope_c_str() const
+{
+    return icalproperty_get_scope(imp);
+}
+
 /* SEQUENCE */
 void ICalProperty::set_sequence(const int &val)
 {
@@ -730,6 +841,11 @@ std::string ICalProperty::get_summary() const
     return static_cast<std::string>(icalproperty_get_summary(imp));
 }
 
+const char *ICalProperty::get_summary_c_str() const
+{
+    return icalproperty_get_summary(imp);
+}
+
 /* TARGET */
 void ICalProperty::set_target(const std::string &val)
 {
@@ -741,6 +857,11 @@ std::string ICalProperty::get_target() const
     return static_cast<std::string>(icalproperty_get_target(imp));
 }
 
+const char *ICalProperty::get_target_c_str() const
+{
+    return icalproperty_get_target(imp);
+}
+
 /* TRANSP */
 void ICalProperty::set_transp(const enum icalproperty_transp &val)
 {
@@ -773,6 +894,11 @@ std::string ICalProperty::get_tzid() const
     return static_cast<std::string>(icalproperty_get_tzid(imp));
 }
 
+const char *ICalProperty::get_tzid_c_str() const
+{
+    return icalproperty_get_tzid(imp);
+}
+
 /* TZNAME */
 void ICalProperty::set_tzname(const std::string &val)
 {
@@ -784,6 +910,11 @@ std::string ICalProperty::get_tzname() const
     return static_cast<std::string>(icalproperty_get_tzname(imp));
 }
 
+const char *ICalProperty::get_tzname_c_str() const
+{
+    return icalproperty_get_tzname(imp);
+}
+
 /* TZOFFSETFROM */
 void ICalProperty::set_tzoffsetfrom(const int &val)
 {
@@ -817,6 +948,11 @@ std::string ICalProperty::get_tzurl() const
     return static_cast<std::string>(icalproperty_get_tzurl(imp));
 }
 
+const char *ICalProperty::get_tzurl_c_str() const
+{
+    return icalproperty_get_tzurl(imp);
+}
+
 /* UID */
 void ICalProperty::set_uid(const std::string &val)
 {
@@ -828,6 +964,11 @@ std::string ICalProperty::get_uid() const
     return static_cast<std::string>(icalproperty_get_uid(imp));
 }
 
+const char *ICalProperty::get_uid_c_str() const
+{
+    return icalproperty_get_uid(imp);
+}
+
 /* URL */
 void ICalProperty::set_url(const std::string &val)
 {
@@ -839,6 +980,11 @@ std::string ICalProperty::get_url() const
     return static_cast<std::string>(icalproperty_get_url(imp));
 }
 
+const char *ICalProperty::get_url_c_str() const
+{
+    return icalproperty_get_url(imp);
+}
+
 /* VERSION */
 void ICalProperty::set_version(const std::string &val)
 {
@@ -850,6 +996,11 @@ std::string ICalProperty::get_version() const
     return static_cast<std::string>(icalproperty_get_version(imp));
 }
 
+const char *ICalProperty::get_version_c_str() const
+{
+    return icalproperty_get_version(imp);
+}
+
 /* X */
 void ICalProperty::set_x(const std::string &val)
 {
@@ -861,6 +1012,11 @@ std::string ICalProperty::get_x() const
     return static_cast<std::string>(icalproperty_get_x(imp));
 }
 
+const char *ICalProperty::get_x_c_str() const
+{
+    return icalproperty_get_x(imp);
+}
+
 /* X-LIC-CLUSTERCOUNT */
 void ICalProperty::set_xlicclustercount(const std::string &val)
 {
@@ -872,6 +1028,11 @@ std::string ICalProperty::get_xlicclustercount() const
     return static_cast<std::string>(icalproperty_get_xlicclustercount(imp));
 }
 
+const char *ICalProperty::get_xlicclustercount_c_str() const
+{
+    return icalproperty_get_xlicclustercount(imp);
+}
+
 /* X-LIC-ERROR */
 void ICalProperty::set_xlicerror(const std::string &val)
 {
@@ -883,6 +1044,11 @@ std::string ICalProperty::get_xlicerror() const
     return static_cast<std::string>(icalproperty_get_xlicerror(imp));
 }
 
+const char *ICalProperty::get_xlicerror_c_str() const
+{
+    return icalproperty_get_xlicerror(imp);
+}
+
 /* X-LIC-MIMECHARSET */
 void ICalProperty::set_xlicmimecharset(const std::string &val)
 {
@@ -894,6 +1060,11 @@ std::string ICalProperty::get_xlicmimecharset() const
     return static_cast<std::string>(icalproperty_get_xlicmimecharset(imp));
 }
 
+const char *ICalProperty::get_xlicmimecharset_c_str() const
+{
+    return icalproperty_get_xlicmimecharset(imp);
+}
+
 /* X-LIC-MIMECID */
 void ICalProperty::set_xlicmimecid(const std::string &val)
 {
@@ -905,6 +1076,11 @@ std::string ICalProperty::get_xlicmimecid() const
     return static_cast<std::string>(icalproperty_get_xlicmimecid(imp));
 }
 
+const char *ICalProperty::get_xlicmimecid_c_str() const
+{
+    return icalproperty_get_xlicmimecid(imp);
+}
+
 /* X-LIC-MIMECONTENTTYPE */
 void ICalProperty::set_xlicmimecontenttype(const std::string &val)
 {
@@ -916,6 +1092,11 @@ std::string ICalProperty::get_xlicmimecontenttype() const
     return static_cast<std::string>(icalproperty_get_xlicmimecontenttype(imp));
 }
 
+const char *ICalProperty::get_xlicmimecontenttype_c_str() const
+{
+    return icalproperty_get_xlicmimecontenttype(imp);
+}
+
 /* X-LIC-MIMEENCODING */
 void ICalProperty::set_xlicmimeencoding(const std::string &val)
 {
@@ -927,6 +1108,11 @@ std::string ICalProperty::get_xlicmimeencoding() const
     return static_cast<std::string>(icalproperty_get_xlicmimeencoding(imp));
 }
 
+const char *ICalProperty::get_xlicmimeencoding_c_str() const
+{
+    return icalproperty_get_xlicmimeencoding(imp);
+}
+
 /* X-LIC-MIMEFILENAME */
 void ICalProperty::set_xlicmimefilename(const std::string &val)
 {
@@ -938,6 +1124,11 @@ std::string ICalProperty::get_xlicmimefilename() const
     return static_cast<std::string>(icalproperty_get_xlicmimefilename(imp));
 }
 
+const char *ICalProperty::get_xlicmimefilename_c_str() const
+{
+    return icalproperty_get_xlicmimefilename(imp);
+}
+
 /* X-LIC-MIMEOPTINFO */
 void ICalProperty::set_xlicmimeoptinfo(const std::string &val)
 {
@@ -948,3 +1139,8 @@ std::string ICalProperty::get_xlicmimeoptinfo() const
 {
     return static_cast<std::string>(icalproperty_get_xlicmimeoptinfo(imp));
 }
+
+const char *ICalProperty::get_xlicmimeoptinfo_c_str() const
+{
+    return icalproperty_get_xlicmimeoptinfo(imp);
+}
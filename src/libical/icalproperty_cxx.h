@@ -43,6 +43,12 @@ public:
     ICalProperty();
     ICalProperty(const ICalProperty &);
     ICalProperty &operator=(const ICalProperty &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    /* Moves steal the underlying icalproperty instead of cloning it,
+       leaving the source detached (as after detach()). */
+    ICalProperty(ICalProperty &&) noexcept;
+    ICalProperty &operator=(ICalProperty &&) noexcept;
+#endif
     ~ICalProperty();
 
     explicit ICalProperty(icalproperty *v);
@@ -87,6 +93,17 @@ public:
      */
     std::string get_name() const;
 
+    /**
+     * The get_*_c_str() accessors mirror the std::string getters but
+     * return a non-owning pointer into the property's own storage (or
+     * the static kind tables) instead of copying: no heap allocation
+     * and no temporary buffer ring traffic per read. The pointer is
+     * only valid until the property is modified or freed.
+     *
+     * @since 3.1.0
+     */
+    const char *get_name_c_str() const;
+
 public:
     /* Deal with X properties */
     static void set_x_name(ICalProperty &prop, const std::string &name);
@@ -123,14 +140,17 @@ public:
     /* ATTENDEE */
     void set_attendee(const std::string &val);
     std::string get_attendee() const;
+    const char *get_attendee_c_str() const;
 
     /* CALSCALE */
     void set_calscale(const std::string &val);
     std::string get_calscale() const;
+    const char *get_calscale_c_str() const;
 
     /* CATEGORIES */
     void set_categories(const std::string &val);
     std::string get_categories() const;
+    const char *get_categories_c_str() const;
 
     /* CLASS */
     void set_class(const enum icalproperty_class &val);
@@ -139,6 +159,7 @@ public:
     /* COMMENT */
     void set_comment(const std::string &val);
     std::string get_comment() const;
+    const char *get_comment_c_str() const;
 
     /* COMPLETED */
     void set_completed(const struct icaltimetype &val);
@@ -147,6 +168,7 @@ public:
     /* CONTACT */
     void set_contact(const std::string &val);
     std::string get_contact() const;
+    const char *get_contact_c_str() const;
 
     /* CREATED */
     void set_created(const struct icaltimetype &val);
@@ -155,6 +177,7 @@ public:
     /* DESCRIPTION */
     void set_description(const std::string &val);
     std::string get_description() const;
+    const char *get_description_c_str() const;
 
     /* DTEND */
     void set_dtend(const struct icaltimetype &val);
@@ -207,6 +230,7 @@ public:
     /* LOCATION */
     void set_location(const std::string &val);
     std::string get_location() const;
+    const char *get_location_c_str() const;
 
     /* MAXRESULTS */
     void set_maxresults(const int &val);
@@ -223,10 +247,12 @@ public:
     /* OWNER */
     void set_owner(const std::string &val);
     std::string get_owner() const;
+    const char *get_owner_c_str() const;
 
     /* ORGANIZER */
     void set_organizer(const std::string &val);
     std::string get_organizer() const;
+    const char *get_organizer_c_str() const;
 
     /* PERCENT-COMPLETE */
     void set_percentcomplete(const int &val);
@@ -239,14 +265,17 @@ public:
     /* PRODID */
     void set_prodid(const std::string &val);
     std::string get_prodid() const;
+    const char *get_prodid_c_str() const;
 
     /* QUERY */
     void set_query(const std::string &val);
     std::string get_query() const;
+    const char *get_query_c_str() const;
 
     /* QUERYNAME */
     void set_queryname(const std::string &val);
     std::string get_queryname() const;
+    const char *get_queryname_c_str() const;
 
     /* RDATE */
     void set_rdate(const struct icaldatetimeperiodtype &val);
@@ -259,10 +288,12 @@ public:
     /* RELATED-TO */
     void set_relatedto(const std::string &val);
     std::string get_relatedto() const;
+    const char *get_relatedto_c_str() const;
 
     /* RELCALID */
     void set_relcalid(const std::string &val);
     std::string get_relcalid() const;
+    const char *get_relcalid_c_str() const;
 
     /* REPEAT */
     void set_repeat(const int &val);
@@ -275,6 +306,7 @@ public:
     /* RESOURCES */
     void set_resources(const std::string &val);
     std::string get_resources() const;
+    const char *get_resources_c_str() const;
 
     /* RRULE */
     void set_rrule(const struct icalrecurrencetype &val);
@@ -283,6 +315,7 @@ public:
     /* SCOPE */
     void set_scope(const std::string &val);
     std::string get_scope() const;
+    const char *get_scope_c_str() const;
 
     /* SEQUENCE */
     void set_sequence(const int &val);
@@ -295,10 +328,12 @@ public:
     /* SUMMARY */
     void set_summary(const std::string &val);
     std::string get_summary() const;
+    const char *get_summary_c_str() const;
 
     /* TARGET */
     void set_target(const std::string &val);
     std::string get_target() const;
+    const char *get_target_c_str() const;
 
     /* TRANSP */
     void set_transp(const enum icalproperty_transp &val);
@@ -311,10 +346,12 @@ public:
     /* TZID */
     void set_tzid(const std::string &val);
     std::string get_tzid() const;
+    const char *get_tzid_c_str() const;
 
     /* TZNAME */
     void set_tzname(const std::string &val);
     std::string get_tzname() const;
+    const char *get_tzname_c_str() const;
 
     /* TZOFFSETFROM */
     void set_tzoffsetfrom(const int &val);
@@ -327,54 +364,67 @@ public:
     /* TZURL */
     void set_tzurl(const std::string &val);
     std::string get_tzurl() const;
+    const char *get_tzurl_c_str() const;
 
     /* UID */
     void set_uid(const std::string &val);
     std::string get_uid() const;
+    const char *get_uid_c_str() const;
 
     /* URL */
     void set_url(const std::string &val);
     std::string get_url() const;
+    const char *get_url_c_str() const;
 
     /* VERSION */
     void set_version(const std::string &val);
     std::string get_version() const;
+    const char *get_version_c_str() const;
 
     /* X */
     void set_x(const std::string &val);
     std::string get_x() const;
+    const char *get_x_c_str() const;
 
     /* X-LIC-CLUSTERCOUNT */
     void set_xlicclustercount(const std::string &val);
     std::string get_xlicclustercount() const;
+    const char *get_xlicclustercount_c_str() const;
 
     /* X-LIC-ERROR */
     void set_xlicerror(const std::string &val);
     std::string get_xlicerror() const;
+    const char *get_xlicerror_c_str() const;
 
     /* X-LIC-MIMECHARSET */
     void set_xlicmimecharset(const std::string &val);
     std::string get_xlicmimecharset() const;
+    const char *get_xlicmimecharset_c_str() const;
 
     /* X-LIC-MIMECID */
     void set_xlicmimecid(const std::string &val);
     std::string get_xlicmimecid() const;
+    const char *get_xlicmimecid_c_str() const;
 
     /* X-LIC-MIMECONTENTTYPE */
     void set_xlicmimecontenttype(const std::string &val);
     std::string get_xlicmimecontenttype() const;
+    const char *get_xlicmimecontenttype_c_str() const;
 
     /* X-LIC-MIMEENCODING */
     void set_xlicmimeencoding(const std::string &val);
     std::string get_xlicmimeencoding() const;
+    const char *get_xlicmimeencoding_c_str() const;
 
     /* X-LIC-MIMEFILENAME */
     void set_xlicmimefilename(const std::string &val);
     std::string get_xlicmimefilename() const;
+    const char *get_xlicmimefilename_c_str() const;
 
     /* X-LIC-MIMEOPTINFO */
     void set_xlicmimeoptinfo(const std::string &val);
     std::string get_xlicmimeoptinfo() const;
+    const char *get_xlicmimeoptinfo_c_str() const;
 
 private:
     icalproperty *imp;
@@ -29,4 +29,16 @@ LIBICAL_ICAL_NO_EXPORT int icalproperty_value_kind_is_multivalued(icalproperty_k
 LIBICAL_ICAL_NO_EXPORT int icalproperty_value_kind_is_default(icalproperty_kind pkind,
                                                               icalvalue_kind vkind);
 
+/* Drops the property's cached rendering; called after any mutation */
+LIBICAL_ICAL_NO_EXPORT void icalproperty_cache_invalidate(icalproperty *prop);
+
+/* In-place value mutation for the generated icalproperty_set_*()
+   functions: _reusable says whether the existing value can be
+   overwritten by a value setter for vkind instead of being freed and
+   reallocated, and _reused restores the VALUE parameter invariant
+   afterwards */
+LIBICAL_ICAL_NO_EXPORT int icalproperty_value_reusable(icalproperty *prop,
+                                                       icalvalue_kind vkind);
+LIBICAL_ICAL_NO_EXPORT void icalproperty_value_reused(icalproperty *prop);
+
 #endif /* ICALPROPERTY_P_H */
@@ -136,8 +136,13 @@
 #include "icalerror.h"
 #include "icalmemory.h"
 #include "icaltimezone.h"
+#include "icaltrace.h"
 #include "icalvalue.h"  /* for print_date[time]_to_string() */
 
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 #include <ctype.h>
 #include <stddef.h>     /* For offsetof() macro */
 #include <stdlib.h>
@@ -207,14 +212,40 @@ static struct freq_map
 
 icalrecurrencetype_frequency icalrecur_string_to_freq(const char *str)
 {
-    int i;
+    /* The first letter is unique for every frequency except the
+       MINUTELY/MONTHLY pair, so dispatch on it and confirm the rest of
+       the token with a single comparison instead of scanning the map */
+    icalrecurrencetype_frequency kind;
 
-    for (i = 0; freq_map[i].kind != ICAL_NO_RECURRENCE; i++) {
-        if (strcasecmp(str, freq_map[i].str) == 0) {
-            return freq_map[i].kind;
-        }
+    switch (*str & ~0x20) {      /* fold lower case to upper */
+    case 'S':
+        kind = ICAL_SECONDLY_RECURRENCE;
+        break;
+    case 'M':
+        kind = ((str[1] & ~0x20) == 'I') ?
+            ICAL_MINUTELY_RECURRENCE : ICAL_MONTHLY_RECURRENCE;
+        break;
+    case 'H':
+        kind = ICAL_HOURLY_RECURRENCE;
+        break;
+    case 'D':
+        kind = ICAL_DAILY_RECURRENCE;
+        break;
+    case 'W':
+        kind = ICAL_WEEKLY_RECURRENCE;
+        break;
+    case 'Y':
+        kind = ICAL_YEARLY_RECURRENCE;
+        break;
+    default:
+        return ICAL_NO_RECURRENCE;
     }
-    return ICAL_NO_RECURRENCE;
+
+    if (strcasecmp(str, freq_map[kind].str) != 0) {
+        return ICAL_NO_RECURRENCE;
+    }
+
+    return kind;
 }
 
 const char *icalrecur_freq_to_string(icalrecurrencetype_frequency kind)
@@ -294,11 +325,25 @@ const char *icalrecur_weekday_to_string(icalrecurrencetype_weekday kind)
 
 icalrecurrencetype_weekday icalrecur_string_to_weekday(const char *str)
 {
-    int i;
-
-    for (i = 0; wd_map[i].wd != ICAL_NO_WEEKDAY; i++) {
-        if (strcasecmp(str, wd_map[i].str) == 0) {
-            return wd_map[i].wd;
+    /* Pack the two-letter code into 16 bits (case folded) and switch on
+       it, rather than running up to seven string comparisons per BYDAY
+       entry */
+    if (str[0] && str[1] && !str[2]) {
+        switch (((str[0] & ~0x20) << 8) | (str[1] & ~0x20)) {
+        case ('S' << 8) | 'U':
+            return ICAL_SUNDAY_WEEKDAY;
+        case ('M' << 8) | 'O':
+            return ICAL_MONDAY_WEEKDAY;
+        case ('T' << 8) | 'U':
+            return ICAL_TUESDAY_WEEKDAY;
+        case ('W' << 8) | 'E':
+            return ICAL_WEDNESDAY_WEEKDAY;
+        case ('T' << 8) | 'H':
+            return ICAL_THURSDAY_WEEKDAY;
+        case ('F' << 8) | 'R':
+            return ICAL_FRIDAY_WEEKDAY;
+        case ('S' << 8) | 'A':
+            return ICAL_SATURDAY_WEEKDAY;
         }
     }
 
@@ -546,15 +591,13 @@ static int icalrecur_add_bydayrules(struct icalrecur_parser *parser,
     return 0;
 }
 
-struct icalrecurrencetype icalrecurrencetype_from_string(const char *str)
+static struct icalrecurrencetype icalrecur_parse_rule(const char *str)
 {
     struct icalrecur_parser parser;
 
     memset(&parser, 0, sizeof(parser));
     icalrecurrencetype_clear(&parser.rt);
 
-    icalerror_check_arg_re(str != 0, "str", parser.rt);
-
     /* Set up the parser struct */
     parser.rule = str;
     parser.copy = icalmemory_strdup(parser.rule);
@@ -733,7 +776,7 @@ struct icalrecurrencetype icalrecurrencetype_from_string(const char *str)
                 icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
             }
             if (parser.rt.rscale) {
-                free(parser.rt.rscale);
+                icalmemory_free_buffer(parser.rt.rscale);
             }
             icalrecurrencetype_clear(&parser.rt);
             break;
@@ -745,6 +788,110 @@ struct icalrecurrencetype icalrecurrencetype_from_string(const char *str)
     return parser.rt;
 }
 
+/* Parsed-rule cache.  Calendar stores tend to reuse a small set of
+   distinct RRULE strings across a large number of events, so a
+   direct-mapped cache of recently parsed rules turns most calls into a
+   hash plus one string comparison.  Entries own their key and rscale
+   strings; hits hand the caller a fresh rscale copy, matching the
+   uncached contract. */
+
+#define RECUR_CACHE_SIZE 64
+
+struct icalrecur_cache_entry
+{
+    char *key;
+    struct icalrecurrencetype rt;
+};
+
+static struct icalrecur_cache_entry recur_cache[RECUR_CACHE_SIZE];
+
+#if defined(HAVE_PTHREAD)
+static pthread_mutex_t recur_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned int recur_cache_hash(const char *str)
+{
+    unsigned int hash = 5381;
+
+    for (; *str; str++) {
+        hash = hash * 33 + (unsigned char)*str;
+    }
+
+    return hash % RECUR_CACHE_SIZE;
+}
+
+struct icalrecurrencetype icalrecurrencetype_from_string(const char *str)
+{
+    struct icalrecur_cache_entry *entry;
+    struct icalrecurrencetype rt;
+    int cached = 0;
+
+    icalrecurrencetype_clear(&rt);
+
+    icalerror_check_arg_re(str != 0, "str", rt);
+
+    entry = &recur_cache[recur_cache_hash(str)];
+
+#if defined(HAVE_PTHREAD)
+    pthread_mutex_lock(&recur_cache_mutex);
+#endif
+    if (entry->key && strcmp(entry->key, str) == 0) {
+        rt = entry->rt;
+        if (rt.rscale) {
+            rt.rscale = icalmemory_strdup(rt.rscale);
+        }
+        cached = 1;
+    }
+#if defined(HAVE_PTHREAD)
+    pthread_mutex_unlock(&recur_cache_mutex);
+#endif
+
+    if (cached) {
+        return rt;
+    }
+
+    {
+        const char *prev_tag = icalmemory_set_tag("recur");
+
+        rt = icalrecur_parse_rule(str);
+        icalmemory_set_tag(prev_tag);
+    }
+
+    /* Cache successful parses only; failures must keep setting
+       icalerrno on every call */
+    if (rt.freq != ICAL_NO_RECURRENCE) {
+        char *key = icalmemory_strdup(str);
+        char *rscale = rt.rscale ? icalmemory_strdup(rt.rscale) : 0;
+
+#if defined(HAVE_PTHREAD)
+        pthread_mutex_lock(&recur_cache_mutex);
+#endif
+        if (key && (rt.rscale == 0 || rscale != 0)) {
+            if (entry->key) {
+                icalmemory_free_buffer(entry->key);
+            }
+            if (entry->rt.rscale) {
+                icalmemory_free_buffer(entry->rt.rscale);
+            }
+            entry->key = key;
+            entry->rt = rt;
+            entry->rt.rscale = rscale;
+        } else {
+            if (key) {
+                icalmemory_free_buffer(key);
+            }
+            if (rscale) {
+                icalmemory_free_buffer(rscale);
+            }
+        }
+#if defined(HAVE_PTHREAD)
+        pthread_mutex_unlock(&recur_cache_mutex);
+#endif
+    }
+
+    return rt;
+}
+
 static struct recur_map
 {
     const char *str;
@@ -952,6 +1099,33 @@ struct icalrecur_iterator_impl
     short by_indices[9];
     short orig_data[9]; /**< 1 if there was data in the byrule */
 
+    /* Per-year calendar facts, refreshed when the iterator crosses a
+       year boundary so the candidate loops do table lookups instead of
+       Julian-date math per day */
+    int cached_year;
+    int cached_year_is_leap;
+    int cached_jan1_dow;
+
+    /* Specialized kernel for the common simple rules (plain DAILY,
+       WEEKLY with at most a BYDAY list); 0 keeps the general engine.
+       The kernels step impl->last directly and carry no other state,
+       so a weekly kernel only needs the 7-bit weekday mask. See
+       icalrecur_select_kernel(). */
+    int kernel;
+    unsigned char week_daymask; /* bit (dow - 1) per icaltime_day_of_week value */
+
+    /* Resource budgets for untrusted rules, set by
+       icalrecur_iterator_set_limits(); 0 means unlimited. Once any
+       budget trips, limit_exceeded latches and every further next/prev
+       call returns the null time. The wall-clock deadline is only
+       consulted every 256 candidates to keep the in-loop cost at an
+       increment and compare. */
+    int limit_max_occurrences;
+    long limit_max_candidates;
+    time_t limit_deadline;
+    long candidate_count;
+    int limit_exceeded;
+
     short *by_ptrs[9]; /**< Pointers into the by_* array elements of the rule */
 
 };
@@ -978,6 +1152,39 @@ static unsigned long daysmask_getbit(unsigned long mask[], short n)
     return (mask[n / BITS_PER_LONG] >> (n % BITS_PER_LONG)) & 1;
 }
 
+static int daysmask_popcount_word(unsigned long v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountl(v);
+#else
+    int count = 0;
+
+    while (v) {
+        v &= v - 1;
+        count++;
+    }
+
+    return count;
+#endif
+}
+
+/* Index of the lowest set bit; v must be non-zero */
+static int daysmask_lowest_bit(unsigned long v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzl(v);
+#else
+    int bit = 0;
+
+    while ((v & 1) == 0) {
+        v >>= 1;
+        bit++;
+    }
+
+    return bit;
+#endif
+}
+
 int icalrecur_iterator_sizeof_byarray(short *byarray)
 {
     int array_itr;
@@ -1729,18 +1936,37 @@ static int get_days_in_month(icalrecur_iterator *impl, int month, int year)
     return icaltime_days_in_month(month, year);
 }
 
+/* Cumulative days of the year before each month, non-leap and leap */
+static const short days_before_month[2][13] = {
+    {0, 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334},
+    {0, 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335}
+};
+
+static void cache_year_facts(icalrecur_iterator *impl, int year)
+{
+    if (impl->cached_year != year) {
+        struct icaltimetype jan1 = icaltime_null_date();
+
+        jan1.year = year;
+        jan1.month = 1;
+        jan1.day = 1;
+
+        impl->cached_year = year;
+        impl->cached_year_is_leap = icaltime_is_leap_year(year);
+        impl->cached_jan1_dow = icaltime_day_of_week(jan1);
+    }
+}
+
 static int get_day_of_year(icalrecur_iterator *impl,
                            int year, int month, int day, int *dow)
 {
-    struct icaltimetype t = impl->dtstart;
+    int doy;
 
-    t.is_date = 1;
-    t.year = year;
+    cache_year_facts(impl, year);
 
     if (!month) {
         month = impl->dtstart.month;
     }
-    t.month = month;
 
     if (!day) {
         day = impl->dtstart.day;
@@ -1748,13 +1974,21 @@ static int get_day_of_year(icalrecur_iterator *impl,
     else if (day < 0) {
         day += icaltime_days_in_month(month, year) + 1;
     }
-    t.day = day;
+
+    if (month < 1 || month > 12) {
+        /* GIGO, same as icaltime_days_in_month() */
+        month = 1;
+    }
+
+    doy = days_before_month[impl->cached_year_is_leap][month] + day;
 
     if (dow) {
-        *dow = icaltime_day_of_week(t);
+        /* Step the weekday forward from January 1st instead of running
+           the Julian-date conversion for every candidate day */
+        *dow = (impl->cached_jan1_dow - 1 + doy - 1) % 7 + 1;
     }
 
-    return icaltime_day_of_year(t);
+    return doy;
 }
 
 static struct icaltimetype occurrence_as_icaltime(icalrecur_iterator *impl,
@@ -1917,8 +2151,225 @@ static void adjust_to_byday(icalrecur_iterator *impl)
     }
 }
 
-icalrecur_iterator *icalrecur_iterator_new(struct icalrecurrencetype rule,
-                                           struct icaltimetype dtstart)
+/* Charges one candidate evaluation against the iterator's budgets.
+   Returns 1 (and latches limit_exceeded) when a budget is spent. */
+static int icalrecur_iterator_budget_spent(icalrecur_iterator *impl)
+{
+    impl->candidate_count++;
+
+    if (impl->limit_max_candidates != 0 &&
+        impl->candidate_count > impl->limit_max_candidates) {
+        impl->limit_exceeded = 1;
+        return 1;
+    }
+
+    if (impl->limit_deadline != (time_t)0 &&
+        (impl->candidate_count & 0xFF) == 0 && time(0) >= impl->limit_deadline) {
+        impl->limit_exceeded = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Shared head check for next/prev: a latched budget violation, or the
+   occurrence budget running out, ends the expansion */
+static int icalrecur_iterator_budget_blocked(icalrecur_iterator *impl)
+{
+    if (impl->limit_exceeded) {
+        return 1;
+    }
+
+    if (impl->limit_max_occurrences != 0 &&
+        impl->occurrence_no >= impl->limit_max_occurrences) {
+        impl->limit_exceeded = 1;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Specialized iterator kernels.
+
+   The general engine re-derives year-day bitmasks, week numbers and
+   contracting-rule checks on every step, which is wasted work for the
+   rules that dominate real calendar data: plain DAILY, and WEEKLY with
+   at most a simple BYDAY list.  For those, stepping is pure date
+   arithmetic on impl->last, so icalrecur_select_kernel() picks a
+   specialized kernel at iterator creation and next/prev dispatch to it.
+
+   The kernels are only legal when the iterator state is impl->last
+   itself; under ICU the position also lives in the UCalendar objects,
+   which the kernels would desync, so selection is compiled out there. */
+
+#define ICALRECUR_KERNEL_GENERAL 0
+#define ICALRECUR_KERNEL_DAILY   1
+#define ICALRECUR_KERNEL_WEEKLY  2
+
+static void icalrecur_select_kernel(icalrecur_iterator *impl)
+{
+#if defined(HAVE_LIBICU)
+    _unused(impl);
+#else
+    enum byrule byrule;
+    icalrecurrencetype_frequency freq = impl->rule.freq;
+
+    if (freq != ICAL_DAILY_RECURRENCE && freq != ICAL_WEEKLY_RECURRENCE) {
+        return;
+    }
+
+    /* Any BY rule other than a WEEKLY BYDAY needs the general engine.
+       (The expand defaults filled in by setup_defaults() just restate
+       the start time for these frequencies, so orig_data is what
+       matters.) */
+    for (byrule = BY_SECOND; byrule <= BY_SET_POS; byrule++) {
+        if (impl->orig_data[byrule] != 0 &&
+            !(byrule == BY_DAY && freq == ICAL_WEEKLY_RECURRENCE)) {
+            return;
+        }
+    }
+
+    if (freq == ICAL_DAILY_RECURRENCE) {
+        impl->kernel = ICALRECUR_KERNEL_DAILY;
+    } else {
+        /* __iterator_set_start() has already seeded BY_DAY with the
+           start weekday when the rule had none, so the mask can be
+           built uniformly from by_ptrs */
+        unsigned char mask = 0;
+        int i;
+
+        for (i = 0; impl->by_ptrs[BY_DAY][i] != ICAL_RECURRENCE_ARRAY_MAX;
+             i++) {
+            short byday = impl->by_ptrs[BY_DAY][i];
+
+            if (icalrecurrencetype_day_position(byday) != 0) {
+                /* Positional BYDAY (e.g. 2MO) needs the general engine */
+                return;
+            }
+            mask |= (unsigned char)
+                (1 << (icalrecurrencetype_day_day_of_week(byday) - 1));
+        }
+
+        impl->week_daymask = mask;
+        impl->kernel = ICALRECUR_KERNEL_WEEKLY;
+    }
+#endif
+}
+
+/* Advances (dir == 1) or rewinds (dir == -1) impl->last by one
+   occurrence of a specialized kernel, without the COUNT/UNTIL/range
+   bookkeeping (the callers below supply that) */
+static void icalrecur_kernel_step(icalrecur_iterator *impl, int dir)
+{
+    int interval = impl->rule.interval;
+    int wkst, dow;
+
+    if (impl->kernel == ICALRECUR_KERNEL_DAILY) {
+        icaltime_adjust(&impl->last, dir * interval, 0, 0, 0);
+        return;
+    }
+
+    /* WEEKLY: walk day by day, skipping (interval - 1) weeks whenever
+       the walk crosses the week start, until a masked weekday is hit */
+    wkst = (int)impl->rule.week_start;
+    if (wkst < (int)ICAL_SUNDAY_WEEKDAY || wkst > (int)ICAL_SATURDAY_WEEKDAY) {
+        wkst = (int)ICAL_MONDAY_WEEKDAY;
+    }
+    dow = icaltime_day_of_week(impl->last);
+
+    do {
+        if (dir > 0) {
+            icaltime_adjust(&impl->last, 1, 0, 0, 0);
+            dow = (dow % 7) + 1;
+            if (dow == wkst && interval > 1) {
+                icaltime_adjust(&impl->last, 7 * (interval - 1), 0, 0, 0);
+            }
+        } else {
+            if (dow == wkst && interval > 1) {
+                icaltime_adjust(&impl->last, -7 * (interval - 1), 0, 0, 0);
+            }
+            icaltime_adjust(&impl->last, -1, 0, 0, 0);
+            dow = (dow == 1) ? 7 : dow - 1;
+        }
+    } while ((impl->week_daymask & (1 << (dow - 1))) == 0);
+}
+
+/* Kernel analogue of icalrecur_iterator_next_impl().  The eligible
+   rules have no contracting BY parts, so the contracting-rule checks
+   of the general path are vacuously true and omitted. */
+static struct icaltimetype icalrecur_kernel_next(icalrecur_iterator *impl)
+{
+    if (icalrecur_iterator_budget_blocked(impl)) {
+        return icaltime_null_time();
+    }
+
+    if ((impl->rule.count != 0 && impl->occurrence_no >= impl->rule.count) ||
+        (!icaltime_is_null_time(impl->rule.until) &&
+         icaltime_compare(impl->last, impl->rule.until) > 0)) {
+        return icaltime_null_time();
+    }
+
+    if ((impl->occurrence_no == 0) &&
+        (icaltime_compare(impl->last, impl->istart) >= 0)) {
+        impl->occurrence_no++;
+        return impl->last;
+    }
+
+    do {
+        if (icalrecur_iterator_budget_spent(impl)) {
+            return icaltime_null_time();
+        }
+
+        icalrecur_kernel_step(impl, 1);
+
+        if (impl->last.year > MAX_TIME_T_YEAR ||
+            (!icaltime_is_null_time(impl->rule.until) &&
+             icaltime_compare(impl->last, impl->rule.until) > 0) ||
+            (!icaltime_is_null_time(impl->iend) &&
+             icaltime_compare(impl->last, impl->iend) >= 0)) {
+            return icaltime_null_time();
+        }
+
+    } while (icaltime_compare(impl->last, impl->istart) < 0);
+
+    impl->occurrence_no++;
+
+    return impl->last;
+}
+
+/* Kernel analogue of icalrecur_iterator_prev() */
+static struct icaltimetype icalrecur_kernel_prev(icalrecur_iterator *impl)
+{
+    if (impl->limit_exceeded || icaltime_compare(impl->last, impl->dtstart) < 0) {
+        return icaltime_null_time();
+    }
+
+    do {
+        if (icalrecur_iterator_budget_spent(impl)) {
+            return icaltime_null_time();
+        }
+
+        icalrecur_kernel_step(impl, -1);
+
+        if (icaltime_compare(impl->last, impl->dtstart) < 0 ||
+            (!icaltime_is_null_time(impl->istart) &&
+             icaltime_compare(impl->last, impl->istart) < 0)) {
+            return icaltime_null_time();
+        }
+
+    } while (impl->last.year > MAX_TIME_T_YEAR ||
+             (!icaltime_is_null_time(impl->rule.until) &&
+              icaltime_compare(impl->last, impl->rule.until) > 0) ||
+             (!icaltime_is_null_time(impl->iend) &&
+              icaltime_compare(impl->last, impl->iend) > 0));
+
+    impl->occurrence_no--;
+
+    return impl->last;
+}
+
+static icalrecur_iterator *icalrecur_iterator_new_impl(struct icalrecurrencetype rule,
+                                                       struct icaltimetype dtstart)
 {
     icalrecur_iterator *impl;
     icalrecurrencetype_frequency freq = rule.freq;
@@ -2028,6 +2479,21 @@ icalrecur_iterator *icalrecur_iterator_new(struct icalrecurrencetype rule,
         return 0;
     }
 
+    icalrecur_select_kernel(impl);
+
+    return impl;
+}
+
+icalrecur_iterator *icalrecur_iterator_new(struct icalrecurrencetype rule,
+                                           struct icaltimetype dtstart)
+{
+    icalrecur_iterator *impl;
+    ical_trace_timer trace_t = ical_trace_timer_start();
+
+    impl = icalrecur_iterator_new_impl(rule, dtstart);
+
+    ical_trace_point_hit(ICAL_TRACE_RECUR_ITERATOR_NEW, trace_t);
+
     return impl;
 }
 
@@ -2431,24 +2897,37 @@ static int expand_by_day(icalrecur_iterator *impl, int year,
         } while (!pos && ((day += 7) <= last_day) && ++this_weekno);
     }
 
-    /* Apply bydays map to the year days bitmask */
-    for (doy = doy_offset+1; doy <= doy_offset + last_day; doy++) {
-        int valid;
+    /* Apply bydays map to the year days bitmask a word at a time:
+       within the period the year days become exactly the bydays bits
+       (ANDed with the existing bits when a limiting BY rule is present),
+       and bits outside the period are left untouched */
+    {
+        const int bpl = (int)BITS_PER_LONG;
+        int lo = doy_offset + 1 + ICAL_YEARDAYS_MASK_OFFSET;
+        int hi = doy_offset + last_day + ICAL_YEARDAYS_MASK_OFFSET;
+        int w;
+
+        for (w = lo / bpl; w <= hi / bpl; w++) {
+            int first_bit = (w == lo / bpl) ? lo % bpl : 0;
+            int last_bit = (w == hi / bpl) ? hi % bpl : bpl - 1;
+            unsigned long range_mask =
+                (~0UL << first_bit) & (~0UL >> (bpl - 1 - last_bit));
+            unsigned long bits = bydays[w] & range_mask;
+
+            if (is_limiting) {
+                /* "Filter" the year days bitmask with the bydays bitmask */
+                bits &= impl->days[w];
+            }
 
-        if (is_limiting) {
-            /* "Filter" the year days bitmask with the bydays bitmask */
-            valid = (int)(daysmask_getbit(impl->days, doy) &
-                          daysmask_getbit(bydays, doy));
-        } else {
-            /* Add each BYDAY to the year days bitmask */
-            valid = (int)daysmask_getbit(bydays, doy);
-        }
+            impl->days[w] = (impl->days[w] & ~range_mask) | bits;
 
-        daysmask_setbit(impl->days, doy, valid);
+            if (bits) {
+                set_pos_total += daysmask_popcount_word(bits);
 
-        if (valid) {
-            set_pos_total++;
-            if (doy < impl->days_index) impl->days_index = doy;
+                doy = (short)(w * bpl + daysmask_lowest_bit(bits) -
+                              ICAL_YEARDAYS_MASK_OFFSET);
+                if (doy < impl->days_index) impl->days_index = doy;
+            }
         }
     }
 
@@ -3091,8 +3570,16 @@ static int check_contracting_rules(icalrecur_iterator *impl)
     }
 }
 
-struct icaltimetype icalrecur_iterator_next(icalrecur_iterator *impl)
+static struct icaltimetype icalrecur_iterator_next_impl(icalrecur_iterator *impl)
 {
+    if (impl && impl->kernel != ICALRECUR_KERNEL_GENERAL) {
+        return icalrecur_kernel_next(impl);
+    }
+
+    if (impl && icalrecur_iterator_budget_blocked(impl)) {
+        return icaltime_null_time();
+    }
+
     /* Quit if we reached COUNT or if last time is after the UNTIL time */
     if (!impl ||
         (impl->rule.count != 0 && impl->occurrence_no >= impl->rule.count) ||
@@ -3112,6 +3599,10 @@ struct icaltimetype icalrecur_iterator_next(icalrecur_iterator *impl)
 
     /* Iterate until we get the next valid time */
     do {
+        if (icalrecur_iterator_budget_spent(impl)) {
+            return icaltime_null_time();
+        }
+
         switch (impl->rule.freq) {
 
         case ICAL_SECONDLY_RECURRENCE:
@@ -3167,6 +3658,18 @@ struct icaltimetype icalrecur_iterator_next(icalrecur_iterator *impl)
     return impl->last;
 }
 
+struct icaltimetype icalrecur_iterator_next(icalrecur_iterator *impl)
+{
+    struct icaltimetype next;
+    ical_trace_timer trace_t = ical_trace_timer_start();
+
+    next = icalrecur_iterator_next_impl(impl);
+
+    ical_trace_point_hit(ICAL_TRACE_RECUR_ITERATOR_NEXT, trace_t);
+
+    return next;
+}
+
 struct icaltimetype icalrecur_iterator_prev(icalrecur_iterator *impl)
 {
     /* Quit if last time is before the DTSTART time */
@@ -3174,6 +3677,14 @@ struct icaltimetype icalrecur_iterator_prev(icalrecur_iterator *impl)
         return icaltime_null_time();
     }
 
+    if (impl->kernel != ICALRECUR_KERNEL_GENERAL) {
+        return icalrecur_kernel_prev(impl);
+    }
+
+    if (impl->limit_exceeded) {
+        return icaltime_null_time();
+    }
+
 #if 0  //  Mostly for testing -- users probably don't want/expect this
     /* If last time is valid, return it */
     if (impl->rule.count != 0 && impl->occurrence_no == impl->rule.count &&
@@ -3188,6 +3699,10 @@ struct icaltimetype icalrecur_iterator_prev(icalrecur_iterator *impl)
 
     /* Iterate until we get the next valid time */
     do {
+        if (icalrecur_iterator_budget_spent(impl)) {
+            return icaltime_null_time();
+        }
+
         switch (impl->rule.freq) {
 
         case ICAL_SECONDLY_RECURRENCE:
@@ -3375,6 +3890,126 @@ static int __iterator_set_start(icalrecur_iterator *impl, icaltimetype start)
     return 1;
 }
 
+icalrecur_iterator *icalrecur_iterator_clone(icalrecur_iterator *impl)
+{
+    icalrecur_iterator *clone;
+    int i;
+
+    icalerror_check_arg_rz((impl != 0), "impl");
+
+    if (!(clone = (icalrecur_iterator *)malloc(sizeof(icalrecur_iterator)))) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    memcpy(clone, impl, sizeof(icalrecur_iterator));
+
+    /* by_ptrs point into the embedded rule copy; re-aim them at the
+       clone's copy */
+    for (i = 0; i < 9; i++) {
+        if (impl->by_ptrs[i] != 0) {
+            clone->by_ptrs[i] =
+                (short *)((char *)clone + ((char *)impl->by_ptrs[i] - (char *)impl));
+        }
+    }
+
+#if defined(HAVE_LIBICU)
+    if (impl->greg) {
+        UErrorCode status = U_ZERO_ERROR;
+
+        clone->greg = ucal_clone(impl->greg, &status);
+        if (impl->rscale == impl->greg) {
+            clone->rscale = clone->greg;
+        } else if (impl->rscale) {
+            clone->rscale = ucal_clone(impl->rscale, &status);
+        }
+
+        if (U_FAILURE(status)) {
+            icalrecur_iterator_free(clone);
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+    }
+#endif
+
+    return clone;
+}
+
+void icalrecur_iterator_set_limits(icalrecur_iterator *impl,
+                                   int max_occurrences, long max_candidates, int max_seconds)
+{
+    icalerror_check_arg_rv((impl != 0), "impl");
+
+    impl->limit_max_occurrences = max_occurrences;
+    impl->limit_max_candidates = max_candidates;
+    impl->limit_deadline = (max_seconds > 0) ? time(0) + max_seconds : (time_t)0;
+    impl->candidate_count = 0;
+    impl->limit_exceeded = 0;
+}
+
+int icalrecur_iterator_limit_exceeded(icalrecur_iterator *impl)
+{
+    icalerror_check_arg_rz((impl != 0), "impl");
+
+    return impl->limit_exceeded;
+}
+
+icalrecur_iterator_position icalrecur_iterator_get_position(icalrecur_iterator *impl)
+{
+    icalrecur_iterator_position pos;
+
+    memset(&pos, 0, sizeof(pos));
+
+    if (impl != 0) {
+        pos.last = impl->last;
+        pos.occurrence_no = impl->occurrence_no;
+    } else {
+        icalerror_set_errno(ICAL_BADARG_ERROR);
+        pos.last = icaltime_null_time();
+    }
+
+    return pos;
+}
+
+int icalrecur_iterator_set_position(icalrecur_iterator *impl,
+                                    icalrecur_iterator_position pos)
+{
+    int count, rv;
+    struct icaltimetype next;
+
+    icalerror_check_arg_rz((impl != 0), "impl");
+
+    if (icaltime_is_null_time(pos.last)) {
+        /* A token taken before the first occurrence rewinds to DTSTART */
+        return icalrecur_iterator_set_start(impl, impl->dtstart);
+    }
+
+    /* set_start() refuses COUNT rules because it cannot know how many
+       occurrences precede the start point -- but the token carries that
+       number, so lift the restriction for the seek and restore it */
+    count = impl->rule.count;
+    impl->rule.count = 0;
+    rv = icalrecur_iterator_set_start(impl, pos.last);
+    impl->rule.count = count;
+
+    if (!rv) {
+        return 0;
+    }
+
+    /* The seek lands on pos.last itself; consume it so the next call
+       returns the following occurrence */
+    next = icalrecur_iterator_next(impl);
+    if (!icaltime_is_null_time(next) && icaltime_compare(next, pos.last) != 0) {
+        /* pos.last is not an occurrence of this rule */
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        return 0;
+    }
+
+    impl->occurrence_no = pos.occurrence_no;
+
+    return 1;
+}
+
 int icalrecur_iterator_set_start(icalrecur_iterator *impl,
                                  struct icaltimetype start)
 {
@@ -3546,6 +4181,229 @@ short icalrecurrencetype_encode_month(int month, int is_leap)
  * back into local time before using them.
  */
 
+struct icaltimetype icalrecur_last_occurrence_before(struct icalrecurrencetype rule,
+                                                     struct icaltimetype dtstart,
+                                                     struct icaltimetype t)
+{
+    icalrecur_iterator *impl;
+    struct icaltimetype occ, best = icaltime_null_time();
+
+    if (icaltime_is_null_time(t) || icaltime_compare(t, dtstart) <= 0) {
+        return icaltime_null_time();
+    }
+
+    if (rule.count == 0) {
+        /* Bound the rule at the query point so the reverse iterator can
+           seek straight to it, then step backwards past any occurrence
+           that is not strictly before t */
+        if (icaltime_is_null_time(rule.until) || icaltime_compare(t, rule.until) < 0) {
+            rule.until = t;
+        }
+
+        impl = icalrecur_iterator_new(rule, dtstart);
+        if (impl == 0) {
+            return icaltime_null_time();
+        }
+
+        if (icalrecur_iterator_set_range(impl, t, dtstart)) {
+            for (occ = icalrecur_iterator_prev(impl);
+                 !icaltime_is_null_time(occ); occ = icalrecur_iterator_prev(impl)) {
+
+                if (icaltime_compare(occ, t) < 0) {
+                    best = occ;
+                    break;
+                }
+            }
+        }
+
+        icalrecur_iterator_free(impl);
+
+        return best;
+    }
+
+    /* COUNT rules cannot seek; walk forward and keep the last
+       occurrence seen before t */
+    impl = icalrecur_iterator_new(rule, dtstart);
+    if (impl == 0) {
+        return icaltime_null_time();
+    }
+
+    for (occ = icalrecur_iterator_next(impl);
+         !icaltime_is_null_time(occ); occ = icalrecur_iterator_next(impl)) {
+
+        if (icaltime_compare(occ, t) >= 0) {
+            break;
+        }
+        best = occ;
+    }
+
+    icalrecur_iterator_free(impl);
+
+    return best;
+}
+
+size_t icalrecurrencetype_estimate_count(struct icalrecurrencetype rule,
+                                         struct icaltimetype dtstart,
+                                         struct icaltimetype start,
+                                         struct icaltimetype end)
+{
+    /* Minimum seconds per base period, indexed by frequency; months and
+       years use their shortest lengths so the estimate stays an upper
+       bound */
+    static const double min_period_seconds[7] = {
+        1.0, 60.0, 3600.0, 86400.0, 7.0 * 86400.0, 28.0 * 86400.0, 365.0 * 86400.0
+    };
+    const size_t unbounded = (size_t)-1;
+    double span_seconds, periods;
+    size_t per_period = 1, estimate;
+    int interval = (rule.interval > 0) ? rule.interval : 1;
+    int n;
+
+    if (rule.freq == ICAL_NO_RECURRENCE) {
+        return 0;
+    }
+
+    if (icaltime_is_null_time(start) || icaltime_compare(start, dtstart) < 0) {
+        start = dtstart;
+    }
+    if (!icaltime_is_null_time(rule.until) &&
+        (icaltime_is_null_time(end) || icaltime_compare(rule.until, end) < 0)) {
+        end = rule.until;
+    }
+
+    if (icaltime_is_null_time(end)) {
+        /* No UNTIL and no window: only COUNT can bound the rule */
+        return (rule.count > 0) ? (size_t)rule.count : unbounded;
+    }
+
+    if (icaltime_compare(end, start) <= 0) {
+        return 0;
+    }
+
+    span_seconds = (double)(icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone()) -
+                            icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone()));
+
+    /* Multiply in the BY parts that expand (rather than limit) the
+       frequency, per the RFC 5545 expansion table */
+    if (rule.freq == ICAL_YEARLY_RECURRENCE) {
+        if (rule.by_month[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+            per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_month);
+        }
+        if (rule.by_week_no[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+            per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_week_no);
+        }
+    }
+
+    if (rule.by_year_day[0] != ICAL_RECURRENCE_ARRAY_MAX &&
+        rule.freq == ICAL_YEARLY_RECURRENCE) {
+        per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_year_day);
+    } else if (rule.by_month_day[0] != ICAL_RECURRENCE_ARRAY_MAX &&
+               rule.freq >= ICAL_MONTHLY_RECURRENCE) {
+        per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_month_day);
+    } else if (rule.by_day[0] != ICAL_RECURRENCE_ARRAY_MAX &&
+               rule.freq >= ICAL_WEEKLY_RECURRENCE) {
+        if (rule.freq == ICAL_WEEKLY_RECURRENCE) {
+            per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_day);
+        } else {
+            /* A non-positional weekday recurs up to 5 times per month
+               and 53 times per year */
+            int per_entry;
+            size_t total = 0;
+
+            if (rule.freq == ICAL_MONTHLY_RECURRENCE ||
+                rule.by_month[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+                per_entry = 5;
+            } else if (rule.by_week_no[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+                per_entry = 1;
+            } else {
+                per_entry = 53;
+            }
+
+            for (n = 0; rule.by_day[n] != ICAL_RECURRENCE_ARRAY_MAX; n++) {
+                total += (icalrecurrencetype_day_position(rule.by_day[n]) != 0) ?
+                    1 : (size_t)per_entry;
+            }
+            per_period *= total;
+        }
+    }
+
+    if (rule.freq >= ICAL_DAILY_RECURRENCE &&
+        rule.by_hour[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+        per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_hour);
+    }
+    if (rule.freq >= ICAL_HOURLY_RECURRENCE &&
+        rule.by_minute[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+        per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_minute);
+    }
+    if (rule.freq >= ICAL_MINUTELY_RECURRENCE &&
+        rule.by_second[0] != ICAL_RECURRENCE_ARRAY_MAX) {
+        per_period *= (size_t)icalrecur_iterator_sizeof_byarray(rule.by_second);
+    }
+
+    periods = span_seconds / (min_period_seconds[rule.freq] * (double)interval) + 1.0;
+
+    if (periods * (double)per_period >= (double)unbounded) {
+        estimate = unbounded;
+    } else {
+        estimate = (size_t)periods * per_period;
+    }
+
+    if (rule.count > 0 && (size_t)rule.count < estimate) {
+        estimate = (size_t)rule.count;
+    }
+
+    return estimate;
+}
+
+size_t icalrecur_expand_range(struct icalrecurrencetype rule,
+                              struct icaltimetype dtstart,
+                              struct icaltimetype start,
+                              struct icaltimetype end,
+                              struct icaltimetype *out, size_t max)
+{
+    icalrecur_iterator *impl;
+    struct icaltimetype next;
+    size_t n = 0;
+
+    icalerror_check_arg_rz((out != 0), "out");
+
+    if (max == 0) {
+        return 0;
+    }
+
+    impl = icalrecur_iterator_new(rule, dtstart);
+    if (impl == 0) {
+        return 0;
+    }
+
+    /* set_range() jumps the iterator straight to the window, but is not
+       usable with COUNT rules; those skip forward occurrence by
+       occurrence in the loop below instead */
+    if (rule.count == 0 && !icaltime_is_null_time(start)) {
+        if (!icalrecur_iterator_set_range(impl, start, end)) {
+            icalrecur_iterator_free(impl);
+            return 0;
+        }
+    }
+
+    for (next = icalrecur_iterator_next(impl);
+         !icaltime_is_null_time(next) && n < max; next = icalrecur_iterator_next(impl)) {
+
+        if (!icaltime_is_null_time(start) && icaltime_compare(next, start) < 0) {
+            continue;
+        }
+        if (!icaltime_is_null_time(end) && icaltime_compare(next, end) >= 0) {
+            break;
+        }
+
+        out[n++] = next;
+    }
+
+    icalrecur_iterator_free(impl);
+
+    return n;
+}
+
 int icalrecur_expand_recurrence(const char *rule,
                                 time_t start, int count, time_t *array)
 {
@@ -3575,7 +4433,7 @@ int icalrecur_expand_recurrence(const char *rule,
         icalrecur_iterator_free(ritr);
     }
     if(recur.rscale)
-        free(recur.rscale);
+        icalmemory_free_buffer(recur.rscale);
 
     return 1;
 }
@@ -333,6 +333,68 @@ LIBICAL_ICAL_EXPORT struct icaltimetype icalrecur_iterator_prev(icalrecur_iterat
 /** Frees the iterator. */
 LIBICAL_ICAL_EXPORT void icalrecur_iterator_free(icalrecur_iterator *);
 
+/**
+ * Makes an independent copy of an iterator, preserving its exact
+ * position, so one expansion pass can fork without re-deriving the
+ * by-rule expansion state.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icalrecur_iterator *icalrecur_iterator_clone(icalrecur_iterator *impl);
+
+/**
+ * A compact, serializable position token for a recurrence iterator.
+ * The fields are plain values, so callers can store the token between
+ * requests (e.g. across pages of a time-range query) and resume with
+ * icalrecur_iterator_set_position().
+ * @since 3.1.0
+ */
+typedef struct icalrecur_iterator_position
+{
+    struct icaltimetype last; /**< last occurrence returned */
+    int occurrence_no;        /**< number of occurrences returned so far */
+} icalrecur_iterator_position;
+
+/** Captures the current position of an iterator. @since 3.1.0 */
+LIBICAL_ICAL_EXPORT icalrecur_iterator_position
+icalrecur_iterator_get_position(icalrecur_iterator *impl);
+
+/**
+ * Resumes an iterator from a token captured on an iterator built from
+ * the same rule and DTSTART; the next icalrecur_iterator_next() call
+ * returns the occurrence that follows the token. Unlike
+ * icalrecur_iterator_set_start(), this also works for rules with COUNT,
+ * since the token carries the occurrence number. Returns 1 on success.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalrecur_iterator_set_position(icalrecur_iterator *impl,
+                                                        icalrecur_iterator_position pos);
+
+/**
+ * Puts hard resource budgets on an iterator, so expanding a hostile or
+ * buggy rule (e.g. FREQ=SECONDLY with no COUNT) has bounded cost
+ * without external supervision. @p max_occurrences caps the number of
+ * occurrences returned, @p max_candidates caps the number of candidate
+ * times the iterator may evaluate (including ones rejected by
+ * contracting rules), and @p max_seconds caps wall-clock time from
+ * this call. A value of 0 leaves that budget unlimited.
+ *
+ * Once any budget is spent, the iterator latches: next/prev return the
+ * null time from then on, and icalrecur_iterator_limit_exceeded()
+ * reports it, so an exhausted budget is distinguishable from a rule
+ * that simply ended. Calling this again resets the spent counters.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icalrecur_iterator_set_limits(icalrecur_iterator *impl,
+                                                       int max_occurrences,
+                                                       long max_candidates, int max_seconds);
+
+/**
+ * Returns nonzero when a budget set with icalrecur_iterator_set_limits()
+ * has been spent on this iterator.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icalrecur_iterator_limit_exceeded(icalrecur_iterator *impl);
+
 /** @brief Fills an array with the 'count' number of occurrences generated by
  * the rrule.
  *
@@ -346,4 +408,57 @@ LIBICAL_ICAL_EXPORT void icalrecur_iterator_free(icalrecur_iterator *);
 LIBICAL_ICAL_EXPORT int icalrecur_expand_recurrence(const char *rule, time_t start,
                                                     int count, time_t *array);
 
+/** @brief Expands the occurrences of @p rule that fall in [@p start, @p end)
+ * into a caller-provided contiguous array in a single call.
+ *
+ * Fills @p out with at most @p max occurrences and returns the number
+ * written. @p dtstart anchors the rule exactly as for
+ * icalrecur_iterator_new(). A null @p start begins at DTSTART; a null
+ * @p end runs to UNTIL (if present) or the supported horizon. Batch
+ * expansion amortizes the iterator set-up over the whole window, which
+ * matters when many rules are expanded per request.
+ *
+ * NOTE: rules that contain COUNT are expanded from DTSTART and filtered
+ * against the window, since the iterator cannot seek within them.
+ * @since 3.1.0
+ */
+/** @brief Returns the most recent occurrence of @p rule strictly before @p t,
+ * or null time if there is none.
+ *
+ * For rules without COUNT, this seeks directly to @p t with the reverse
+ * iterator rather than stepping forward from @p dtstart, so asking for
+ * "the last occurrence before now" of a decade-old weekly rule costs a
+ * handful of steps instead of hundreds. COUNT rules cannot seek and are
+ * walked forward.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT struct icaltimetype
+icalrecur_last_occurrence_before(struct icalrecurrencetype rule,
+                                 struct icaltimetype dtstart,
+                                 struct icaltimetype t);
+
+/** @brief Estimates how many occurrences of @p rule fall in [@p start, @p end)
+ * without expanding the rule.
+ *
+ * Returns an exact count for plain frequency/interval rules and a tight
+ * upper bound when BY parts are present, computed analytically from the
+ * rule struct: base periods in the window (months and years taken at
+ * their shortest) times the expansion factor of the BY parts, capped by
+ * COUNT and UNTIL. A null @p start begins at @p dtstart. Returns
+ * `(size_t)-1` when the rule is unbounded (no COUNT, no UNTIL and a
+ * null @p end). Useful for sizing result buffers before
+ * icalrecur_expand_range() and for rejecting pathological rules cheaply.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT size_t icalrecurrencetype_estimate_count(struct icalrecurrencetype rule,
+                                                             struct icaltimetype dtstart,
+                                                             struct icaltimetype start,
+                                                             struct icaltimetype end);
+
+LIBICAL_ICAL_EXPORT size_t icalrecur_expand_range(struct icalrecurrencetype rule,
+                                                  struct icaltimetype dtstart,
+                                                  struct icaltimetype start,
+                                                  struct icaltimetype end,
+                                                  struct icaltimetype *out, size_t max);
+
 #endif
@@ -104,4 +104,23 @@ LIBICAL_ICAL_EXPORT int icalrestriction_compare(icalrestriction_kind restr, int
  */
 LIBICAL_ICAL_EXPORT int icalrestriction_check(icalcomponent *comp);
 
+/**
+ * @brief Like icalrestriction_check(), but only re-validates components
+ *  that changed since their last check.
+ * @param comp The `VCALENDAR` component to check
+ * @return 1 if the restrictions are met, 0 if not
+ * @since 3.1.0
+ *
+ * Each component caches the result of its last check together with a
+ * change counter; a repeated call over a mostly unchanged calendar
+ * revisits only the components whose properties were added, removed or
+ * mutated in the meantime. Useful when the same message tree is
+ * validated repeatedly as it is assembled or patched.
+ *
+ * Like icalrestriction_check(), a failed check annotates the offending
+ * component with X-LIC-ERROR properties; on a cache hit no new
+ * annotations are added.
+ */
+LIBICAL_ICAL_EXPORT int icalrestriction_check_incremental(icalcomponent *comp);
+
 #endif /* !ICALRESTRICTION_H */
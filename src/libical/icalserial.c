@@ -0,0 +1,918 @@
+/*======================================================================
+ FILE: icalserial.c
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+======================================================================*/
+
+/**
+ * @file icalserial.c
+ * @brief Compact binary interchange format for component trees.
+ *
+ * icalcomponent_to_binary() flattens a component tree into a single
+ * relocatable buffer: a fixed header, a stream of tagged records (one
+ * per component, property, parameter or value), and an interned string
+ * table at the end. All multi-byte fields are stored little-endian
+ * through explicit byte shifts, and strings are referenced by offset
+ * into the table, so the buffer contains no pointers and can be
+ * written to disk, mapped back in, and decoded from any address.
+ *
+ * icalcomponent_from_binary() rebuilds the tree in one bounds-checked
+ * pass over the records. Values that the library stores in decoded
+ * form (times, durations, periods, integers, enumerations, floats,
+ * geo) are copied field-by-field, skipping the text parser entirely;
+ * the remaining kinds (recurrences, attachments, ...) round-trip
+ * through their iCalendar text representation.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "icalcomponent.h"
+#include "icalerror.h"
+#include "icalmemory.h"
+#include "icalparameterimpl.h"
+#include "icalvalue.h"
+#include "icalvalueimpl.h"
+#include "icaltimezone.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Defined in icalvalue.c */
+struct icalvalue_impl *icalvalue_new_impl(icalvalue_kind kind);
+
+#define ICALSERIAL_VERSION 1
+#define ICALSERIAL_HEADER_SIZE 20
+
+/* Record tags. A component is bracketed by TAG_COMP_BEGIN and
+   TAG_COMP_END; its property, parameter and value records appear in
+   between, each value or parameter applying to the most recent
+   property record. */
+enum icalserial_tag
+{
+    ICALSERIAL_TAG_COMP_BEGIN = 'C', /* u32 component kind */
+    ICALSERIAL_TAG_COMP_END = 'c',
+    ICALSERIAL_TAG_PROPERTY = 'P',   /* u32 kind, strref x-name */
+    ICALSERIAL_TAG_PARAMETER = 'A',  /* u32 kind, i32 data, strref string, strref x-name */
+    ICALSERIAL_TAG_TIME = 'T',       /* u32 value kind, time */
+    ICALSERIAL_TAG_DURATION = 'D',   /* duration */
+    ICALSERIAL_TAG_INT = 'I',        /* u32 value kind, i32 */
+    ICALSERIAL_TAG_ENUM = 'E',       /* u32 value kind, i32 */
+    ICALSERIAL_TAG_FLOAT = 'F',      /* u32 bit pattern */
+    ICALSERIAL_TAG_GEO = 'G',        /* 2 x f64 bit pattern */
+    ICALSERIAL_TAG_PERIOD = 'p',     /* time, time, duration */
+    ICALSERIAL_TAG_STRING = 'S',     /* u32 value kind, strref */
+    ICALSERIAL_TAG_TEXTVAL = 'X'     /* u32 value kind, strref of iCalendar text */
+};
+
+/* Time records: i32 year, u8 month, day, hour, minute, second, flags */
+#define ICALSERIAL_TIME_IS_DATE 0x01
+#define ICALSERIAL_TIME_IS_DAYLIGHT 0x02
+#define ICALSERIAL_TIME_IS_UTC 0x04
+
+/*** Writer ***********************************************************/
+
+struct icalserial_buf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int oom;
+};
+
+static int icalserial_buf_reserve(struct icalserial_buf *b, size_t extra)
+{
+    char *p;
+    size_t cap;
+
+    if (b->oom)
+        return 0;
+
+    if (b->len + extra <= b->cap)
+        return 1;
+
+    cap = b->cap == 0 ? 256 : b->cap;
+    while (cap < b->len + extra)
+        cap *= 2;
+
+    if (b->data == 0)
+        p = (char *)icalmemory_new_buffer(cap);
+    else
+        p = (char *)icalmemory_resize_buffer(b->data, cap);
+
+    if (p == 0) {
+        b->oom = 1;
+        return 0;
+    }
+
+    b->data = p;
+    b->cap = cap;
+    return 1;
+}
+
+static void icalserial_put_u8(struct icalserial_buf *b, unsigned int v)
+{
+    if (!icalserial_buf_reserve(b, 1))
+        return;
+    b->data[b->len++] = (char)(v & 0xff);
+}
+
+static void icalserial_put_u32(struct icalserial_buf *b, unsigned long v)
+{
+    if (!icalserial_buf_reserve(b, 4))
+        return;
+    b->data[b->len++] = (char)(v & 0xff);
+    b->data[b->len++] = (char)((v >> 8) & 0xff);
+    b->data[b->len++] = (char)((v >> 16) & 0xff);
+    b->data[b->len++] = (char)((v >> 24) & 0xff);
+}
+
+static void icalserial_put_i32(struct icalserial_buf *b, long v)
+{
+    icalserial_put_u32(b, (unsigned long)v & 0xffffffffUL);
+}
+
+/* The string table is the concatenation of the distinct NUL-terminated
+   strings written so far. A reference is the string's offset plus one,
+   so 0 can mean "no string". The open-addressed offset table keeps
+   interning linear in the number of strings. */
+struct icalserial_strtab
+{
+    struct icalserial_buf data;
+    unsigned long *slots;       /* string offset + 1, 0 = empty slot */
+    size_t slot_count;
+    size_t used;
+    int oom;
+};
+
+static unsigned long icalserial_hash(const char *s)
+{
+    unsigned long h = 5381;
+
+    while (*s)
+        h = h * 33 + (unsigned char)*s++;
+
+    return h;
+}
+
+static int icalserial_strtab_rehash(struct icalserial_strtab *st)
+{
+    size_t new_count = st->slot_count == 0 ? 64 : st->slot_count * 2;
+    unsigned long *new_slots;
+    size_t i;
+
+    new_slots = (unsigned long *)icalmemory_new_buffer(new_count * sizeof(unsigned long));
+    if (new_slots == 0) {
+        st->oom = 1;
+        return 0;
+    }
+    memset(new_slots, 0, new_count * sizeof(unsigned long));
+
+    for (i = 0; i < st->slot_count; i++) {
+        if (st->slots[i] != 0) {
+            size_t j = (size_t)(icalserial_hash(st->data.data + (st->slots[i] - 1)) &
+                                (new_count - 1));
+
+            while (new_slots[j] != 0)
+                j = (j + 1) & (new_count - 1);
+            new_slots[j] = st->slots[i];
+        }
+    }
+
+    if (st->slots)
+        icalmemory_free_buffer(st->slots);
+    st->slots = new_slots;
+    st->slot_count = new_count;
+    return 1;
+}
+
+static unsigned long icalserial_strtab_add(struct icalserial_strtab *st, const char *s)
+{
+    size_t i, len;
+    unsigned long off;
+
+    if (s == 0)
+        return 0;
+
+    if (st->oom || st->data.oom)
+        return 0;
+
+    if (st->used * 4 >= st->slot_count * 3) {
+        if (!icalserial_strtab_rehash(st))
+            return 0;
+    }
+
+    i = (size_t)(icalserial_hash(s) & (st->slot_count - 1));
+    while (st->slots[i] != 0) {
+        if (strcmp(st->data.data + (st->slots[i] - 1), s) == 0)
+            return st->slots[i];
+        i = (i + 1) & (st->slot_count - 1);
+    }
+
+    len = strlen(s) + 1;
+    off = (unsigned long)st->data.len;
+    if (!icalserial_buf_reserve(&st->data, len))
+        return 0;
+    memcpy(st->data.data + st->data.len, s, len);
+    st->data.len += len;
+
+    st->slots[i] = off + 1;
+    st->used++;
+    return off + 1;
+}
+
+struct icalserial_writer
+{
+    struct icalserial_buf records;
+    struct icalserial_strtab strtab;
+};
+
+static void icalserial_write_strref(struct icalserial_writer *w, const char *s)
+{
+    icalserial_put_u32(&w->records, icalserial_strtab_add(&w->strtab, s));
+}
+
+static void icalserial_write_time(struct icalserial_writer *w, struct icaltimetype t)
+{
+    unsigned int flags = 0;
+
+    if (t.is_date)
+        flags |= ICALSERIAL_TIME_IS_DATE;
+    if (t.is_daylight)
+        flags |= ICALSERIAL_TIME_IS_DAYLIGHT;
+    if (icaltime_is_utc(t))
+        flags |= ICALSERIAL_TIME_IS_UTC;
+
+    icalserial_put_i32(&w->records, t.year);
+    icalserial_put_u8(&w->records, (unsigned int)t.month);
+    icalserial_put_u8(&w->records, (unsigned int)t.day);
+    icalserial_put_u8(&w->records, (unsigned int)t.hour);
+    icalserial_put_u8(&w->records, (unsigned int)t.minute);
+    icalserial_put_u8(&w->records, (unsigned int)t.second);
+    icalserial_put_u8(&w->records, flags);
+}
+
+static void icalserial_write_duration(struct icalserial_writer *w, struct icaldurationtype d)
+{
+    icalserial_put_i32(&w->records, d.is_neg);
+    icalserial_put_u32(&w->records, d.days);
+    icalserial_put_u32(&w->records, d.weeks);
+    icalserial_put_u32(&w->records, d.hours);
+    icalserial_put_u32(&w->records, d.minutes);
+    icalserial_put_u32(&w->records, d.seconds);
+}
+
+static void icalserial_write_value(struct icalserial_writer *w, icalvalue *value)
+{
+    struct icalvalue_impl *v = (struct icalvalue_impl *)value;
+    icalvalue_kind kind = icalvalue_isa(value);
+
+    switch (kind) {
+    case ICAL_DATE_VALUE:
+    case ICAL_DATETIME_VALUE:
+    case ICAL_DATETIMEDATE_VALUE:
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_TIME);
+        icalserial_put_u32(&w->records, (unsigned long)kind);
+        icalserial_write_time(w, v->data.v_time);
+        break;
+
+    case ICAL_DURATION_VALUE:
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_DURATION);
+        icalserial_write_duration(w, v->data.v_duration);
+        break;
+
+    case ICAL_INTEGER_VALUE:
+    case ICAL_BOOLEAN_VALUE:
+    case ICAL_UTCOFFSET_VALUE:
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_INT);
+        icalserial_put_u32(&w->records, (unsigned long)kind);
+        icalserial_put_i32(&w->records, v->data.v_int);
+        break;
+
+    case ICAL_METHOD_VALUE:
+    case ICAL_STATUS_VALUE:
+    case ICAL_ACTION_VALUE:
+    case ICAL_CLASS_VALUE:
+    case ICAL_TRANSP_VALUE:
+    case ICAL_BUSYTYPE_VALUE:
+    case ICAL_TASKMODE_VALUE:
+    case ICAL_POLLMODE_VALUE:
+    case ICAL_POLLCOMPLETION_VALUE:
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_ENUM);
+        icalserial_put_u32(&w->records, (unsigned long)kind);
+        icalserial_put_i32(&w->records, v->data.v_enum);
+        break;
+
+    case ICAL_FLOAT_VALUE:
+        {
+            unsigned long bits = 0;
+
+            memcpy(&bits, &v->data.v_float, sizeof(float));
+            icalserial_put_u8(&w->records, ICALSERIAL_TAG_FLOAT);
+            icalserial_put_u32(&w->records, bits);
+            break;
+        }
+
+    case ICAL_GEO_VALUE:
+        {
+            unsigned char raw[2 * sizeof(double)];
+            size_t i;
+
+            memcpy(raw, &v->data.v_geo.lat, sizeof(double));
+            memcpy(raw + sizeof(double), &v->data.v_geo.lon, sizeof(double));
+            icalserial_put_u8(&w->records, ICALSERIAL_TAG_GEO);
+            for (i = 0; i < sizeof(raw); i++)
+                icalserial_put_u8(&w->records, raw[i]);
+            break;
+        }
+
+    case ICAL_PERIOD_VALUE:
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_PERIOD);
+        icalserial_write_time(w, v->data.v_period.start);
+        icalserial_write_time(w, v->data.v_period.end);
+        icalserial_write_duration(w, v->data.v_period.duration);
+        break;
+
+    case ICAL_TEXT_VALUE:
+    case ICAL_URI_VALUE:
+    case ICAL_CALADDRESS_VALUE:
+    case ICAL_QUERY_VALUE:
+    case ICAL_STRING_VALUE:
+        if (v->data.v_string != 0) {
+            icalserial_put_u8(&w->records, ICALSERIAL_TAG_STRING);
+            icalserial_put_u32(&w->records, (unsigned long)kind);
+            icalserial_write_strref(w, v->data.v_string);
+        }
+        break;
+
+    default:
+        {
+            /* Everything else (recurrences, attachments, request
+               status, triggers, x-values, ...) goes through its text
+               form and is reparsed on load. */
+            char *str = icalvalue_as_ical_string_r(value);
+
+            if (str != 0) {
+                icalserial_put_u8(&w->records, ICALSERIAL_TAG_TEXTVAL);
+                icalserial_put_u32(&w->records, (unsigned long)kind);
+                icalserial_write_strref(w, str);
+                icalmemory_free_buffer(str);
+            }
+            break;
+        }
+    }
+}
+
+static void icalserial_write_component(struct icalserial_writer *w, icalcomponent *comp)
+{
+    icalpropiter pi;
+    icalcompiter ci;
+    icalproperty *prop;
+    icalcomponent *sub;
+
+    icalserial_put_u8(&w->records, ICALSERIAL_TAG_COMP_BEGIN);
+    icalserial_put_u32(&w->records, (unsigned long)icalcomponent_isa(comp));
+
+    for (pi = icalcomponent_begin_property(comp, ICAL_ANY_PROPERTY);
+         (prop = icalpropiter_deref(&pi)) != 0; icalpropiter_next(&pi)) {
+        icalparamiter ai;
+        icalparameter *param;
+        icalvalue *value;
+
+        icalserial_put_u8(&w->records, ICALSERIAL_TAG_PROPERTY);
+        icalserial_put_u32(&w->records, (unsigned long)icalproperty_isa(prop));
+        icalserial_write_strref(w, icalproperty_get_x_name(prop));
+
+        for (ai = icalproperty_begin_parameter(prop, ICAL_ANY_PARAMETER);
+             (param = icalparamiter_deref(&ai)) != 0; icalparamiter_next(&ai)) {
+            struct icalparameter_impl *p = (struct icalparameter_impl *)param;
+
+            icalserial_put_u8(&w->records, ICALSERIAL_TAG_PARAMETER);
+            icalserial_put_u32(&w->records, (unsigned long)p->kind);
+            icalserial_put_i32(&w->records, p->data);
+            icalserial_write_strref(w, p->string);
+            icalserial_write_strref(w, p->x_name);
+        }
+
+        value = icalproperty_get_value(prop);
+        if (value != 0)
+            icalserial_write_value(w, value);
+    }
+
+    for (ci = icalcomponent_begin_component(comp, ICAL_ANY_COMPONENT);
+         (sub = icalcompiter_deref(&ci)) != 0; icalcompiter_next(&ci)) {
+        icalserial_write_component(w, sub);
+    }
+
+    icalserial_put_u8(&w->records, ICALSERIAL_TAG_COMP_END);
+}
+
+char *icalcomponent_to_binary(icalcomponent *component, size_t *size)
+{
+    struct icalserial_writer w;
+    char *out = 0;
+    size_t total;
+
+    icalerror_check_arg_rz(component != 0, "component");
+    icalerror_check_arg_rz(size != 0, "size");
+
+    memset(&w, 0, sizeof(w));
+
+    icalserial_write_component(&w, component);
+
+    if (w.records.oom || w.strtab.oom || w.strtab.data.oom) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        goto cleanup;
+    }
+
+    total = ICALSERIAL_HEADER_SIZE + w.records.len + w.strtab.data.len;
+    out = (char *)icalmemory_new_buffer(total);
+    if (out == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        goto cleanup;
+    }
+
+    out[0] = 'I';
+    out[1] = 'C';
+    out[2] = 'B';
+    out[3] = 'F';
+    {
+        struct icalserial_buf hdr;
+
+        hdr.data = out;
+        hdr.len = 4;
+        hdr.cap = ICALSERIAL_HEADER_SIZE;
+        hdr.oom = 0;
+        icalserial_put_u32(&hdr, ICALSERIAL_VERSION);
+        icalserial_put_u32(&hdr, (unsigned long)total);
+        icalserial_put_u32(&hdr, (unsigned long)(ICALSERIAL_HEADER_SIZE + w.records.len));
+        icalserial_put_u32(&hdr, (unsigned long)w.strtab.data.len);
+    }
+
+    if (w.records.len)
+        memcpy(out + ICALSERIAL_HEADER_SIZE, w.records.data, w.records.len);
+    if (w.strtab.data.len)
+        memcpy(out + ICALSERIAL_HEADER_SIZE + w.records.len, w.strtab.data.data,
+               w.strtab.data.len);
+
+    *size = total;
+
+  cleanup:
+    if (w.records.data)
+        icalmemory_free_buffer(w.records.data);
+    if (w.strtab.data.data)
+        icalmemory_free_buffer(w.strtab.data.data);
+    if (w.strtab.slots)
+        icalmemory_free_buffer(w.strtab.slots);
+
+    return out;
+}
+
+/*** Reader ***********************************************************/
+
+struct icalserial_reader
+{
+    const unsigned char *data;
+    size_t pos;
+    size_t end;                 /* end of the record area */
+    const char *strtab;
+    size_t strtab_len;
+    int error;
+};
+
+static unsigned int icalserial_get_u8(struct icalserial_reader *r)
+{
+    if (r->pos + 1 > r->end) {
+        r->error = 1;
+        return 0;
+    }
+    return r->data[r->pos++];
+}
+
+static unsigned long icalserial_get_u32(struct icalserial_reader *r)
+{
+    unsigned long v;
+
+    if (r->pos + 4 > r->end) {
+        r->error = 1;
+        return 0;
+    }
+    v = (unsigned long)r->data[r->pos] |
+        ((unsigned long)r->data[r->pos + 1] << 8) |
+        ((unsigned long)r->data[r->pos + 2] << 16) |
+        ((unsigned long)r->data[r->pos + 3] << 24);
+    r->pos += 4;
+    return v;
+}
+
+static int icalserial_get_i32(struct icalserial_reader *r)
+{
+    unsigned long v = icalserial_get_u32(r);
+
+    if (v >= 0x80000000UL)
+        return (int)(long)((long)v - 0x100000000L);
+    return (int)v;
+}
+
+static const char *icalserial_get_str(struct icalserial_reader *r)
+{
+    unsigned long ref = icalserial_get_u32(r);
+
+    if (r->error || ref == 0)
+        return 0;
+
+    if (ref - 1 >= r->strtab_len) {
+        r->error = 1;
+        return 0;
+    }
+
+    /* The whole table was validated to end in NUL, so any in-range
+       offset yields a terminated string. */
+    return r->strtab + (ref - 1);
+}
+
+static struct icaltimetype icalserial_read_time(struct icalserial_reader *r)
+{
+    struct icaltimetype t = icaltime_null_time();
+    unsigned int flags;
+
+    t.year = icalserial_get_i32(r);
+    t.month = (int)icalserial_get_u8(r);
+    t.day = (int)icalserial_get_u8(r);
+    t.hour = (int)icalserial_get_u8(r);
+    t.minute = (int)icalserial_get_u8(r);
+    t.second = (int)icalserial_get_u8(r);
+    flags = icalserial_get_u8(r);
+
+    if (flags & ICALSERIAL_TIME_IS_DATE)
+        t.is_date = 1;
+    if (flags & ICALSERIAL_TIME_IS_DAYLIGHT)
+        t.is_daylight = 1;
+    if (flags & ICALSERIAL_TIME_IS_UTC)
+        t.zone = icaltimezone_get_utc_timezone();
+
+    return t;
+}
+
+static struct icaldurationtype icalserial_read_duration(struct icalserial_reader *r)
+{
+    struct icaldurationtype d;
+
+    memset(&d, 0, sizeof(d));
+    d.is_neg = icalserial_get_i32(r);
+    d.days = (unsigned int)icalserial_get_u32(r);
+    d.weeks = (unsigned int)icalserial_get_u32(r);
+    d.hours = (unsigned int)icalserial_get_u32(r);
+    d.minutes = (unsigned int)icalserial_get_u32(r);
+    d.seconds = (unsigned int)icalserial_get_u32(r);
+
+    return d;
+}
+
+/* Creates the value for one value record, or NULL with r->error set. */
+static icalvalue *icalserial_read_value(struct icalserial_reader *r, unsigned int tag)
+{
+    struct icalvalue_impl *v = 0;
+    icalvalue_kind kind;
+
+    switch (tag) {
+    case ICALSERIAL_TAG_TIME:
+        kind = (icalvalue_kind)icalserial_get_u32(r);
+        if (r->error ||
+            (kind != ICAL_DATE_VALUE && kind != ICAL_DATETIME_VALUE &&
+             kind != ICAL_DATETIMEDATE_VALUE)) {
+            r->error = 1;
+            return 0;
+        }
+        v = icalvalue_new_impl(kind);
+        if (v)
+            v->data.v_time = icalserial_read_time(r);
+        break;
+
+    case ICALSERIAL_TAG_DURATION:
+        v = icalvalue_new_impl(ICAL_DURATION_VALUE);
+        if (v)
+            v->data.v_duration = icalserial_read_duration(r);
+        else
+            (void)icalserial_read_duration(r);
+        break;
+
+    case ICALSERIAL_TAG_INT:
+        kind = (icalvalue_kind)icalserial_get_u32(r);
+        if (r->error ||
+            (kind != ICAL_INTEGER_VALUE && kind != ICAL_BOOLEAN_VALUE &&
+             kind != ICAL_UTCOFFSET_VALUE)) {
+            r->error = 1;
+            return 0;
+        }
+        v = icalvalue_new_impl(kind);
+        if (v)
+            v->data.v_int = icalserial_get_i32(r);
+        break;
+
+    case ICALSERIAL_TAG_ENUM:
+        kind = (icalvalue_kind)icalserial_get_u32(r);
+        switch (kind) {
+        case ICAL_METHOD_VALUE:
+        case ICAL_STATUS_VALUE:
+        case ICAL_ACTION_VALUE:
+        case ICAL_CLASS_VALUE:
+        case ICAL_TRANSP_VALUE:
+        case ICAL_BUSYTYPE_VALUE:
+        case ICAL_TASKMODE_VALUE:
+        case ICAL_POLLMODE_VALUE:
+        case ICAL_POLLCOMPLETION_VALUE:
+            break;
+        default:
+            r->error = 1;
+            return 0;
+        }
+        v = icalvalue_new_impl(kind);
+        if (v)
+            v->data.v_enum = icalserial_get_i32(r);
+        break;
+
+    case ICALSERIAL_TAG_FLOAT:
+        {
+            unsigned long bits = icalserial_get_u32(r);
+            float f;
+
+            if (r->error)
+                return 0;
+            {
+                unsigned char raw[4];
+
+                raw[0] = (unsigned char)(bits & 0xff);
+                raw[1] = (unsigned char)((bits >> 8) & 0xff);
+                raw[2] = (unsigned char)((bits >> 16) & 0xff);
+                raw[3] = (unsigned char)((bits >> 24) & 0xff);
+                memcpy(&f, raw, sizeof(float));
+            }
+            v = icalvalue_new_impl(ICAL_FLOAT_VALUE);
+            if (v)
+                v->data.v_float = f;
+            break;
+        }
+
+    case ICALSERIAL_TAG_GEO:
+        {
+            unsigned char raw[2 * sizeof(double)];
+            size_t i;
+
+            for (i = 0; i < sizeof(raw); i++)
+                raw[i] = (unsigned char)icalserial_get_u8(r);
+            if (r->error)
+                return 0;
+            v = icalvalue_new_impl(ICAL_GEO_VALUE);
+            if (v) {
+                memcpy(&v->data.v_geo.lat, raw, sizeof(double));
+                memcpy(&v->data.v_geo.lon, raw + sizeof(double), sizeof(double));
+            }
+            break;
+        }
+
+    case ICALSERIAL_TAG_PERIOD:
+        {
+            struct icalperiodtype p;
+
+            p.start = icalserial_read_time(r);
+            p.end = icalserial_read_time(r);
+            p.duration = icalserial_read_duration(r);
+            if (r->error)
+                return 0;
+            v = icalvalue_new_impl(ICAL_PERIOD_VALUE);
+            if (v)
+                v->data.v_period = p;
+            break;
+        }
+
+    case ICALSERIAL_TAG_STRING:
+        {
+            const char *str;
+
+            kind = (icalvalue_kind)icalserial_get_u32(r);
+            if (r->error ||
+                (kind != ICAL_TEXT_VALUE && kind != ICAL_URI_VALUE &&
+                 kind != ICAL_CALADDRESS_VALUE && kind != ICAL_QUERY_VALUE &&
+                 kind != ICAL_STRING_VALUE)) {
+                r->error = 1;
+                return 0;
+            }
+            str = icalserial_get_str(r);
+            if (r->error || str == 0) {
+                r->error = 1;
+                return 0;
+            }
+            v = icalvalue_new_impl(kind);
+            if (v) {
+                v->data.v_string = icalvalue_strdup_value_string(v, str);
+                if (v->data.v_string == 0) {
+                    icalvalue_free((icalvalue *)v);
+                    v = 0;
+                }
+            }
+            break;
+        }
+
+    case ICALSERIAL_TAG_TEXTVAL:
+        {
+            const char *str;
+
+            kind = (icalvalue_kind)icalserial_get_u32(r);
+            if (r->error || !icalvalue_kind_is_valid(kind)) {
+                r->error = 1;
+                return 0;
+            }
+            str = icalserial_get_str(r);
+            if (r->error || str == 0) {
+                r->error = 1;
+                return 0;
+            }
+            return icalvalue_new_from_string(kind, str);
+        }
+
+    default:
+        r->error = 1;
+        return 0;
+    }
+
+    if (r->error) {
+        if (v)
+            icalvalue_free((icalvalue *)v);
+        return 0;
+    }
+
+    return (icalvalue *)v;
+}
+
+icalcomponent *icalcomponent_from_binary(const char *data, size_t size)
+{
+    struct icalserial_reader r;
+    icalcomponent *root = 0;
+    icalcomponent *cur_comp = 0;
+    icalproperty *cur_prop = 0;
+    unsigned long version, total, strtab_off, strtab_len;
+
+    icalerror_check_arg_rz(data != 0, "data");
+
+    if (size < ICALSERIAL_HEADER_SIZE ||
+        data[0] != 'I' || data[1] != 'C' || data[2] != 'B' || data[3] != 'F')
+        goto malformed;
+
+    memset(&r, 0, sizeof(r));
+    r.data = (const unsigned char *)data;
+    r.pos = 4;
+    r.end = ICALSERIAL_HEADER_SIZE;
+
+    version = icalserial_get_u32(&r);
+    total = icalserial_get_u32(&r);
+    strtab_off = icalserial_get_u32(&r);
+    strtab_len = icalserial_get_u32(&r);
+
+    if (version != ICALSERIAL_VERSION ||
+        total != (unsigned long)size ||
+        strtab_off < ICALSERIAL_HEADER_SIZE ||
+        strtab_off > size || strtab_len != size - strtab_off)
+        goto malformed;
+
+    if (strtab_len != 0 && data[size - 1] != '\0')
+        goto malformed;
+
+    r.end = (size_t)strtab_off;
+    r.strtab = data + strtab_off;
+    r.strtab_len = (size_t)strtab_len;
+
+    while (r.pos < r.end && !r.error) {
+        unsigned int tag = icalserial_get_u8(&r);
+
+        switch (tag) {
+        case ICALSERIAL_TAG_COMP_BEGIN:
+            {
+                icalcomponent_kind kind = (icalcomponent_kind)icalserial_get_u32(&r);
+                icalcomponent *comp;
+
+                if (r.error || !icalcomponent_kind_is_valid(kind) ||
+                    (root != 0 && cur_comp == 0))
+                    goto malformed;
+
+                comp = icalcomponent_new(kind);
+                if (comp == 0)
+                    goto malformed;
+
+                if (cur_comp != 0)
+                    icalcomponent_add_component(cur_comp, comp);
+                else
+                    root = comp;
+
+                cur_comp = comp;
+                cur_prop = 0;
+                break;
+            }
+
+        case ICALSERIAL_TAG_COMP_END:
+            if (cur_comp == 0)
+                goto malformed;
+            cur_comp = icalcomponent_get_parent(cur_comp);
+            cur_prop = 0;
+            break;
+
+        case ICALSERIAL_TAG_PROPERTY:
+            {
+                icalproperty_kind kind = (icalproperty_kind)icalserial_get_u32(&r);
+                const char *x_name = icalserial_get_str(&r);
+                icalproperty *prop;
+
+                if (r.error || cur_comp == 0 || !icalproperty_kind_is_valid(kind) ||
+                    kind == ICAL_NO_PROPERTY)
+                    goto malformed;
+
+                prop = icalproperty_new(kind);
+                if (prop == 0)
+                    goto malformed;
+
+                if (x_name != 0)
+                    icalproperty_set_x_name(prop, x_name);
+
+                icalcomponent_add_property(cur_comp, prop);
+                cur_prop = prop;
+                break;
+            }
+
+        case ICALSERIAL_TAG_PARAMETER:
+            {
+                icalparameter_kind kind = (icalparameter_kind)icalserial_get_u32(&r);
+                int pdata = icalserial_get_i32(&r);
+                const char *string = icalserial_get_str(&r);
+                const char *x_name = icalserial_get_str(&r);
+                icalparameter *param;
+                struct icalparameter_impl *p;
+
+                if (r.error || cur_prop == 0 || !icalparameter_kind_is_valid(kind))
+                    goto malformed;
+
+                param = icalparameter_new(kind);
+                if (param == 0)
+                    goto malformed;
+
+                p = (struct icalparameter_impl *)param;
+                p->data = pdata;
+                if (string != 0) {
+                    p->string = icalmemory_intern(string);
+                    if (p->string == 0) {
+                        icalparameter_free(param);
+                        goto malformed;
+                    }
+                }
+                if (x_name != 0) {
+                    p->x_name = icalmemory_strdup(x_name);
+                    if (p->x_name == 0) {
+                        icalparameter_free(param);
+                        goto malformed;
+                    }
+                }
+
+                icalproperty_add_parameter(cur_prop, param);
+                break;
+            }
+
+        default:
+            {
+                icalvalue *value;
+
+                if (cur_prop == 0)
+                    goto malformed;
+
+                value = icalserial_read_value(&r, tag);
+                if (value == 0 || r.error) {
+                    if (value)
+                        icalvalue_free(value);
+                    goto malformed;
+                }
+
+                icalproperty_set_value(cur_prop, value);
+                break;
+            }
+        }
+    }
+
+    if (r.error || cur_comp != 0 || root == 0)
+        goto malformed;
+
+    return root;
+
+  malformed:
+    if (root)
+        icalcomponent_free(root);
+    icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+    return 0;
+}
@@ -0,0 +1,233 @@
+/*======================================================================
+ FILE: icalthreadpool.c
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+======================================================================*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "icalthreadpool.h"
+#include "icalerror.h"
+#include "icalmemory.h"
+
+#include <string.h>
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
+struct ical_threadpool_impl
+{
+    int n_threads;
+#if defined(HAVE_PTHREAD)
+    pthread_t *threads;
+    pthread_mutex_t batch_lock;  /* serializes whole batches */
+    pthread_mutex_t lock;        /* protects the fields below */
+    pthread_cond_t work_cond;    /* a batch was published, or shutdown */
+    pthread_cond_t done_cond;    /* the last task of a batch finished */
+    int shutdown;
+    ical_threadpool_task_fn fn;
+    void *ctx;
+    size_t count;
+    size_t next;                 /* the shared cursor workers pull from */
+    size_t done;
+#endif
+};
+
+static ical_threadpool *ical_threadpool_default_pool = 0;
+
+#if defined(HAVE_PTHREAD)
+
+static void *ical_threadpool_worker(void *arg)
+{
+    ical_threadpool *pool = (ical_threadpool *) arg;
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        size_t i;
+
+        while (pool->shutdown == 0 && pool->next >= pool->count) {
+            pthread_cond_wait(&pool->work_cond, &pool->lock);
+        }
+
+        if (pool->shutdown != 0) {
+            break;
+        }
+
+        i = pool->next++;
+        pthread_mutex_unlock(&pool->lock);
+
+        (*pool->fn) (pool->ctx, i);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->done++;
+        if (pool->done == pool->count) {
+            pthread_cond_signal(&pool->done_cond);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return 0;
+}
+
+#endif
+
+ical_threadpool *ical_threadpool_new(int n_threads)
+{
+    ical_threadpool *pool;
+
+    icalerror_check_arg_rz((n_threads > 0), "n_threads");
+
+    pool = (ical_threadpool *) icalmemory_new_buffer(sizeof(ical_threadpool));
+    if (pool == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    memset(pool, 0, sizeof(ical_threadpool));
+
+#if defined(HAVE_PTHREAD)
+    pool->threads = (pthread_t *) icalmemory_new_buffer((size_t) n_threads * sizeof(pthread_t));
+    if (pool->threads == 0) {
+        icalmemory_free_buffer(pool);
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    pthread_mutex_init(&pool->batch_lock, 0);
+    pthread_mutex_init(&pool->lock, 0);
+    pthread_cond_init(&pool->work_cond, 0);
+    pthread_cond_init(&pool->done_cond, 0);
+
+    while (pool->n_threads < n_threads) {
+        if (pthread_create(&pool->threads[pool->n_threads], 0,
+                           ical_threadpool_worker, pool) != 0) {
+            break;
+        }
+        pool->n_threads++;
+    }
+#else
+    _unused(n_threads);
+#endif
+
+    return pool;
+}
+
+void ical_threadpool_free(ical_threadpool *pool)
+{
+    if (pool == 0) {
+        return;
+    }
+
+    if (pool == ical_threadpool_default_pool) {
+        ical_threadpool_default_pool = 0;
+    }
+
+#if defined(HAVE_PTHREAD)
+    {
+        int t;
+
+        pthread_mutex_lock(&pool->lock);
+        pool->shutdown = 1;
+        pthread_cond_broadcast(&pool->work_cond);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (t = 0; t < pool->n_threads; t++) {
+            pthread_join(pool->threads[t], 0);
+        }
+
+        pthread_cond_destroy(&pool->done_cond);
+        pthread_cond_destroy(&pool->work_cond);
+        pthread_mutex_destroy(&pool->lock);
+        pthread_mutex_destroy(&pool->batch_lock);
+        icalmemory_free_buffer(pool->threads);
+    }
+#endif
+
+    icalmemory_free_buffer(pool);
+}
+
+int ical_threadpool_get_num_threads(ical_threadpool *pool)
+{
+    icalerror_check_arg_rz((pool != 0), "pool");
+
+    return pool->n_threads;
+}
+
+int ical_threadpool_run_batch(ical_threadpool *pool, ical_threadpool_task_fn fn,
+                              void *ctx, size_t count)
+{
+    size_t i;
+
+    icalerror_check_arg_re((pool != 0), "pool", 1);
+    icalerror_check_arg_re((fn != 0), "fn", 1);
+
+    if (count == 0) {
+        return 0;
+    }
+
+#if defined(HAVE_PTHREAD)
+    if (pool->n_threads > 0) {
+        pthread_mutex_lock(&pool->batch_lock);
+
+        pthread_mutex_lock(&pool->lock);
+        pool->fn = fn;
+        pool->ctx = ctx;
+        pool->count = count;
+        pool->next = 0;
+        pool->done = 0;
+        pthread_cond_broadcast(&pool->work_cond);
+
+        /* The submitting thread pulls from the cursor too rather than
+           blocking for the workers. */
+        while (pool->next < pool->count) {
+            i = pool->next++;
+            pthread_mutex_unlock(&pool->lock);
+
+            (*fn) (ctx, i);
+
+            pthread_mutex_lock(&pool->lock);
+            pool->done++;
+        }
+
+        while (pool->done < pool->count) {
+            pthread_cond_wait(&pool->done_cond, &pool->lock);
+        }
+
+        /* Leave nothing for the workers to grab between batches */
+        pool->count = 0;
+        pool->next = 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        pthread_mutex_unlock(&pool->batch_lock);
+        return 0;
+    }
+#endif
+
+    for (i = 0; i < count; i++) {
+        (*fn) (ctx, i);
+    }
+
+    return 0;
+}
+
+void ical_threadpool_set_default(ical_threadpool *pool)
+{
+    ical_threadpool_default_pool = pool;
+}
+
+ical_threadpool *ical_threadpool_get_default(void)
+{
+    return ical_threadpool_default_pool;
+}
@@ -0,0 +1,118 @@
+/*======================================================================
+ FILE: icalthreadpool.h
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+======================================================================*/
+
+/**
+ * @file icalthreadpool.h
+ * @brief A shared worker pool for the library's parallel features.
+ *
+ * Several parts of the library can fan work out over threads — batch
+ * parsing, parallel set queries, recurrence expansion. Left to
+ * themselves, each would start its own threads per call and together
+ * they would oversubscribe the machine. The pool gives them one shared,
+ * explicitly sized set of workers instead.
+ *
+ * The pool is strictly opt-in: the library never creates one on its
+ * own, and without one every parallel feature keeps its existing
+ * behavior. Create a pool with ical_threadpool_new(), install it with
+ * ical_threadpool_set_default(), and the pooled code paths take over.
+ *
+ * @since 3.1.0
+ */
+
+#ifndef ICALTHREADPOOL_H
+#define ICALTHREADPOOL_H
+
+#include "libical_ical_export.h"
+
+#include <stddef.h>
+
+typedef struct ical_threadpool_impl ical_threadpool;
+
+/**
+ * @typedef ical_threadpool_task_fn
+ * @brief One task of a batch; called with the submitter's context
+ * pointer and the task's index within the batch.
+ */
+typedef void (*ical_threadpool_task_fn) (void *ctx, size_t index);
+
+/**
+ * @brief Creates a pool with the given number of worker threads.
+ * @param n_threads How many workers to start; must be positive
+ * @return The new pool, or `NULL` on error
+ * @since 3.1.0
+ *
+ * The submitting thread always works through the batch alongside the
+ * workers, so a pool of @a n_threads runs batches on @a n_threads + 1
+ * threads. On builds without thread support (or if no worker could be
+ * started) the pool still works: batches simply run on the submitting
+ * thread.
+ */
+LIBICAL_ICAL_EXPORT ical_threadpool *ical_threadpool_new(int n_threads);
+
+/**
+ * @brief Shuts the workers down and frees the pool.
+ * @since 3.1.0
+ *
+ * Must not be called while a batch is running. If the pool is installed
+ * as the default, unset it first.
+ */
+LIBICAL_ICAL_EXPORT void ical_threadpool_free(ical_threadpool *pool);
+
+/**
+ * @brief Returns the number of worker threads the pool actually
+ * started, not counting the submitting thread.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int ical_threadpool_get_num_threads(ical_threadpool *pool);
+
+/**
+ * @brief Runs @a count tasks on the pool and returns when all of them
+ * have finished.
+ * @param pool The pool to run on
+ * @param fn Called once per task as fn(ctx, index)
+ * @param ctx Opaque context handed to every task
+ * @param count The number of tasks in the batch
+ * @return 0 on success, 1 on error
+ * @since 3.1.0
+ *
+ * Workers pull task indices from a shared cursor, so a thread that
+ * finishes a cheap task immediately takes over work that would
+ * otherwise queue behind an expensive one. The submitting thread pulls
+ * tasks too rather than blocking. Batches from different threads are
+ * serialized against each other; a task must not submit a batch to its
+ * own pool.
+ */
+LIBICAL_ICAL_EXPORT int ical_threadpool_run_batch(ical_threadpool *pool,
+                                                  ical_threadpool_task_fn fn,
+                                                  void *ctx, size_t count);
+
+/**
+ * @brief Installs @a pool as the default pool used by the library's
+ * parallel code paths; pass `NULL` to uninstall it.
+ * @since 3.1.0
+ *
+ * The caller keeps ownership of the pool. Install it once at startup,
+ * before parallel calls are made from multiple threads; the library
+ * never installs one by itself.
+ */
+LIBICAL_ICAL_EXPORT void ical_threadpool_set_default(ical_threadpool *pool);
+
+/**
+ * @brief Returns the default pool, or `NULL` if none is installed.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT ical_threadpool *ical_threadpool_get_default(void);
+
+#endif /* !ICALTHREADPOOL_H */
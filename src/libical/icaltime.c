@@ -56,9 +56,16 @@
 #include "icalerror.h"
 #include "icalmemory.h"
 #include "icaltimezone.h"
+#include "icalvalue.h"
 
 #include <ctype.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
 
 /* The first array is for non-leap years, the second for leap years*/
 static const int days_in_year_passed_month[2][13] = {
@@ -74,110 +81,134 @@ static int icaltime_leap_days(int y1, int y2)
     return (y2 / 4 - y1 / 4) - (y2 / 100 - y1 / 100) + (y2 / 400 - y1 / 400);
 }
 
-/*
- * Code adapted from Python 2.4.1 sources (Lib/calendar.py).
- */
-static time_t icaltime_timegm(const struct tm *tm)
+/* Per-thread cache of (year, month) -> seconds at the start of that
+   month in UTC. The year/month terms dominate the calendar-to-epoch
+   math and repeat heavily when span computations convert long runs of
+   nearby times, so a hit reduces the conversion to day/hour/minute/
+   second arithmetic. */
+
+#define MONTH_EPOCH_CACHE_SIZE 16
+
+struct icaltime_month_epoch_entry
 {
     int year;
-    time_t days;
-    time_t hours;
-    time_t minutes;
-    time_t seconds;
-
-    year = 1900 + tm->tm_year;
-    days = (time_t)(365 * (year - 1970) + icaltime_leap_days(1970, year));
-    days += days_in_year_passed_month[0][tm->tm_mon];
+    int month;  /* 1-12; 0 marks an empty slot. */
+    time_t start;
+};
 
-    if (tm->tm_mon > 1 && icaltime_is_leap_year(year))
-        ++days;
+#if defined(HAVE_PTHREAD)
 
-    days += tm->tm_mday - 1;
-    hours = days * 24 + tm->tm_hour;
-    minutes = hours * 60 + tm->tm_min;
-    seconds = minutes * 60 + tm->tm_sec;
+static pthread_key_t month_epoch_tls_key;
+static pthread_once_t month_epoch_tls_once = PTHREAD_ONCE_INIT;
 
-    return seconds;
+static void month_epoch_tls_destroy(void *cache)
+{
+    free(cache);
 }
 
-/*
- *  Function to convert a struct tm time specification
- *  to an ANSI time_t using the specified time zone.
- *  This is different from the standard mktime() function
- *  in that we don't want the automatic adjustments for
- *  local daylight savings time applied to the result.
- *  This function expects well-formed input.
- */
-static time_t make_time(struct tm *tm, int tzm)
+static void month_epoch_tls_init(void)
 {
-    time_t tim;
-
-    static int days[] = { -1, 30, 58, 89, 119, 150, 180, 211, 242, 272, 303, 333, 364 };
-
-    /* check that month specification within range */
-
-    if (tm->tm_mon < 0 || tm->tm_mon > 11)
-        return ((time_t) - 1);
-
-#if (SIZEOF_TIME_T == 4)
-    /* check that year specification within range */
+    (void)pthread_key_create(&month_epoch_tls_key, month_epoch_tls_destroy);
+}
 
-    if (tm->tm_year < 70 || tm->tm_year > 138)
-        return ((time_t) - 1);
+static struct icaltime_month_epoch_entry *get_month_epoch_cache(void)
+{
+    struct icaltime_month_epoch_entry *cache;
 
-    /* check for upper bound of Jan 17, 2038 (to avoid possibility of
-       32-bit arithmetic overflow) */
+    (void)pthread_once(&month_epoch_tls_once, month_epoch_tls_init);
 
-    if (tm->tm_year == 138) {
-        if (tm->tm_mon > 0) {
-            return ((time_t) - 1);
-        } else if (tm->tm_mday > 17) {
-            return ((time_t) - 1);
+    cache = pthread_getspecific(month_epoch_tls_key);
+    if (!cache) {
+        cache = calloc(MONTH_EPOCH_CACHE_SIZE, sizeof(struct icaltime_month_epoch_entry));
+        if (cache) {
+            pthread_setspecific(month_epoch_tls_key, cache);
         }
     }
-#endif /* SIZEOF_TIME_T */
-
-    /*
-     *  calculate elapsed days since start of the epoch (midnight Jan
-     *  1st, 1970 UTC) 17 = number of leap years between 1900 and 1970
-     *  (number of leap days to subtract)
-     */
-
-    tim = (time_t) ((tm->tm_year - 70) * 365 + ((tm->tm_year - 1) / 4) - 17);
-
-    /* add number of days elapsed in the current year */
-
-    tim += days[tm->tm_mon];
-
-    /* check and adjust for leap years (the leap year check only valid
-       during the 32-bit era */
 
-    if ((tm->tm_year & 3) == 0 && tm->tm_mon > 1)
-        tim += 1;
-
-    /* elapsed days to current date */
+    return cache;
+}
 
-    tim += tm->tm_mday;
+#else
 
-    /* calculate elapsed hours since start of the epoch */
+static struct icaltime_month_epoch_entry month_epoch_cache[MONTH_EPOCH_CACHE_SIZE];
 
-    tim = tim * 24 + tm->tm_hour;
+static struct icaltime_month_epoch_entry *get_month_epoch_cache(void)
+{
+    return month_epoch_cache;
+}
 
-    /* calculate elapsed minutes since start of the epoch */
+#endif
 
-    tim = tim * 60 + tm->tm_min;
+/** @brief Returns the seconds past the UNIX epoch at the start of the
+ * given month, caching the result per thread.
+ *
+ * The month must be in the range 1-12.
+ *
+ * Code adapted from Python 2.4.1 sources (Lib/calendar.py).
+ */
+static time_t icaltime_month_epoch(int year, int month)
+{
+    struct icaltime_month_epoch_entry *cache = get_month_epoch_cache();
+    struct icaltime_month_epoch_entry *entry = NULL;
+    time_t days;
 
-    /* adjust per time zone specification */
+    if (cache) {
+        entry = &cache[(unsigned int)(year * 12 + month) % MONTH_EPOCH_CACHE_SIZE];
+        if (entry->month == month && entry->year == year) {
+            return entry->start;
+        }
+    }
 
-    tim -= tzm;
+    days = (time_t)(365 * (year - 1970) + icaltime_leap_days(1970, year));
+    days += days_in_year_passed_month[icaltime_is_leap_year(year) ? 1 : 0][month - 1];
 
-    /* calculate elapsed seconds since start of the epoch */
+    if (entry) {
+        entry->year = year;
+        entry->month = month;
+        entry->start = days * 24 * 60 * 60;
+    }
 
-    tim = tim * 60 + tm->tm_sec;
+    return days * 24 * 60 * 60;
+}
 
-    /* return number of seconds since start of the epoch */
+long icaltime_date_to_daynum(int year, int month, int day)
+{
+    long y = year;
+    long era, yoe, doy, doe;
+
+    /* Shift the year so it starts in March; the leap day then falls at
+       the end of the shifted year and the month lengths repeat in a
+       fixed 153-days-per-5-months pattern. */
+    y -= month <= 2;
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153L * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    /* 719468 = days from 0000-03-01 to 1970-01-01 */
+    return era * 146097 + doe - 719468;
+}
 
-    return (tim);
+void icaltime_daynum_to_date(long daynum, int *year, int *month, int *day)
+{
+    long z = daynum + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long y = yoe + era * 400;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    long d = doy - (153 * mp + 2) / 5 + 1;
+    long m = mp + (mp < 10 ? 3 : -9);
+
+    y += (m <= 2);
+
+    if (year)
+        *year = (int)y;
+    if (month)
+        *month = (int)m;
+    if (day)
+        *day = (int)d;
 }
 
 struct icaltimetype icaltime_from_timet_with_zone(const time_t tm, const int is_date,
@@ -218,9 +249,40 @@ struct icaltimetype icaltime_from_timet_with_zone(const time_t tm, const int is_
     return tt;
 }
 
+/* A coarse per-thread clock cache. Stamping generated replies calls
+   icaltime_current_time_with_zone() at message rates, and the gmtime
+   plus timezone conversion behind it dwarfs the time() read. Within
+   one wall-clock second a repeat call for the same zone returns the
+   cached broken-down time. The zone is compared by pointer, which is
+   how callers hold zones; a zone freed and reallocated at the same
+   address within the same second could in principle alias, but the
+   cache lives at most one second. */
+#if defined(__GNUC__) || defined(__clang__)
+#define ICAL_COARSE_CLOCK 1
+static __thread time_t coarse_clock_sec;
+static __thread const icaltimezone *coarse_clock_zone;
+static __thread struct icaltimetype coarse_clock_time;
+static __thread int coarse_clock_valid = 0;
+#endif
+
 struct icaltimetype icaltime_current_time_with_zone(const icaltimezone *zone)
 {
+#if defined(ICAL_COARSE_CLOCK)
+    time_t now = time(NULL);
+
+    if (coarse_clock_valid && now == coarse_clock_sec && zone == coarse_clock_zone) {
+        return coarse_clock_time;
+    }
+
+    coarse_clock_time = icaltime_from_timet_with_zone(now, 0, zone);
+    coarse_clock_sec = now;
+    coarse_clock_zone = zone;
+    coarse_clock_valid = 1;
+
+    return coarse_clock_time;
+#else
     return icaltime_from_timet_with_zone(time(NULL), 0, zone);
+#endif
 }
 
 struct icaltimetype icaltime_today(void)
@@ -230,7 +292,6 @@ struct icaltimetype icaltime_today(void)
 
 time_t icaltime_as_timet(const struct icaltimetype tt)
 {
-    struct tm stm;
     time_t t;
 
     /* If the time is the special null time, return 0. */
@@ -238,23 +299,29 @@ time_t icaltime_as_timet(const struct icaltimetype tt)
         return 0;
     }
 
-    /* Copy the icaltimetype to a struct tm. */
-    memset(&stm, 0, sizeof(struct tm));
+    /* check that month specification within range */
+    if (tt.month < 1 || tt.month > 12)
+        return ((time_t) - 1);
 
-    if (icaltime_is_date(tt)) {
-        stm.tm_sec = stm.tm_min = stm.tm_hour = 0;
-    } else {
-        stm.tm_sec = tt.second;
-        stm.tm_min = tt.minute;
-        stm.tm_hour = tt.hour;
+#if (SIZEOF_TIME_T == 4)
+    /* check that year specification within range */
+
+    if (tt.year < 1970 || tt.year > 2038)
+        return ((time_t) - 1);
+
+    /* check for upper bound of Jan 17, 2038 (to avoid possibility of
+       32-bit arithmetic overflow) */
+
+    if (tt.year == 2038 && (tt.month > 1 || tt.day > 17)) {
+        return ((time_t) - 1);
     }
+#endif /* SIZEOF_TIME_T */
 
-    stm.tm_mday = tt.day;
-    stm.tm_mon = tt.month - 1;
-    stm.tm_year = tt.year - 1900;
-    stm.tm_isdst = -1;
+    t = (time_t) icaltime_date_to_daynum(tt.year, tt.month, tt.day) * 24 * 60 * 60;
 
-    t = make_time(&stm, 0);
+    if (!icaltime_is_date(tt)) {
+        t += tt.hour * 3600 + tt.minute * 60 + tt.second;
+    }
 
     return t;
 }
@@ -262,7 +329,6 @@ time_t icaltime_as_timet(const struct icaltimetype tt)
 time_t icaltime_as_timet_with_zone(const struct icaltimetype tt, const icaltimezone *zone)
 {
     icaltimezone *utc_zone;
-    struct tm stm;
     time_t t;
     struct icaltimetype local_tt;
 
@@ -281,20 +347,26 @@ time_t icaltime_as_timet_with_zone(const struct icaltimetype tt, const icaltimez
     /* Use our timezone functions to convert to UTC. */
     icaltimezone_convert_time(&local_tt, (icaltimezone *) zone, utc_zone);
 
-    /* Copy the icaltimetype to a struct tm. */
-    memset(&stm, 0, sizeof(struct tm));
+    /* The month start comes from the per-thread cache; only the
+       day/hour/minute/second arithmetic is done per call. */
+    t = icaltime_month_epoch(local_tt.year, local_tt.month) +
+        ((time_t)(local_tt.day - 1) * 24 + local_tt.hour) * 60 * 60 +
+        (time_t)local_tt.minute * 60 + local_tt.second;
+
+    return t;
+}
 
-    stm.tm_sec = local_tt.second;
-    stm.tm_min = local_tt.minute;
-    stm.tm_hour = local_tt.hour;
-    stm.tm_mday = local_tt.day;
-    stm.tm_mon = local_tt.month - 1;
-    stm.tm_year = local_tt.year - 1900;
-    stm.tm_isdst = -1;
+void icaltime_as_timet_bulk(const struct icaltimetype *times, size_t num_times,
+                            const icaltimezone *zone, time_t *results)
+{
+    size_t i;
 
-    t = icaltime_timegm(&stm);
+    icalerror_check_arg_rv(times != 0, "times");
+    icalerror_check_arg_rv(results != 0, "results");
 
-    return t;
+    for (i = 0; i < num_times; i++) {
+        results[i] = icaltime_as_timet_with_zone(times[i], zone);
+    }
 }
 
 const char *icaltime_as_ical_string(const struct icaltimetype tt)
@@ -311,18 +383,10 @@ char *icaltime_as_ical_string_r(const struct icaltimetype tt)
     size_t size = 17;
     char *buf = icalmemory_new_buffer(size);
 
-    if (tt.is_date) {
-        snprintf(buf, size, "%04d%02d%02d", tt.year, tt.month, tt.day);
-    } else {
-        const char *fmt;
-
-        if (icaltime_is_utc(tt)) {
-            fmt = "%04d%02d%02dT%02d%02d%02dZ";
-        } else {
-            fmt = "%04d%02d%02dT%02d%02d%02d";
-        }
-        snprintf(buf, size, fmt, tt.year, tt.month, tt.day, tt.hour, tt.minute, tt.second);
-    }
+    /* print_datetime_to_string() renders the fixed-width digit fields
+       through a pair table, which is much cheaper than snprintf on the
+       DTSTART/DTEND/DTSTAMP-heavy serialization path */
+    print_datetime_to_string(buf, &tt);
 
     return buf;
 }
@@ -336,6 +400,23 @@ struct icaltimetype icaltime_normalize(const struct icaltimetype tt)
     return ret;
 }
 
+/** @brief Checks that the eight bytes at @p s are all ASCII digits.
+ *
+ * SWAR test over a single 64-bit load: XORing with '0's maps digits to
+ * 0..9, and a byte is in that range exactly when neither it nor it
+ * plus 6 has a bit set in the high nibble.
+ */
+static int icaltime_is_eight_digits(const char *s)
+{
+    uint64_t chunk;
+
+    memcpy(&chunk, s, sizeof(chunk));
+    chunk ^= UINT64_C(0x3030303030303030);
+
+    return ((chunk | (chunk + UINT64_C(0x0606060606060606))) &
+            UINT64_C(0xf0f0f0f0f0f0f0f0)) == 0;
+}
+
 struct icaltimetype icaltime_from_string(const char *str)
 {
     struct icaltimetype tt = icaltime_null_time();
@@ -345,6 +426,47 @@ struct icaltimetype icaltime_from_string(const char *str)
 
     size = strlen(str);
 
+    /* Fast path for the common fixed-width layouts without separators:
+       YYYYMMDD, YYYYMMDDTHHMMSS and YYYYMMDDTHHMMSSZ. Anything that
+       doesn't match exactly falls through to the flexible path below. */
+    if ((size == 8 || size == 15 || size == 16) && icaltime_is_eight_digits(str)) {
+        int ok = 1;
+
+        if (size == 8) {
+            tt.is_date = 1;
+        } else if (str[8] == 'T' &&
+                   (size == 15 || str[15] == 'Z')) {
+            int i;
+
+            for (i = 9; i < 15; i++) {
+                if ((unsigned int)(str[i] - '0') > 9) {
+                    ok = 0;
+                    break;
+                }
+            }
+            if (ok) {
+                tt.hour = (str[9] - '0') * 10 + (str[10] - '0');
+                tt.minute = (str[11] - '0') * 10 + (str[12] - '0');
+                tt.second = (str[13] - '0') * 10 + (str[14] - '0');
+                if (size == 16)
+                    tt.zone = icaltimezone_get_utc_timezone();
+            }
+        } else {
+            ok = 0;
+        }
+
+        if (ok) {
+            tt.year =
+                (str[0] - '0') * 1000 + (str[1] - '0') * 100 +
+                (str[2] - '0') * 10 + (str[3] - '0');
+            tt.month = (str[4] - '0') * 10 + (str[5] - '0');
+            tt.day = (str[6] - '0') * 10 + (str[7] - '0');
+            return tt;
+        }
+
+        tt = icaltime_null_time();
+    }
+
     if ((size == 15) || (size == 19)) { /* floating time with/without separators */
         tt.is_date = 0;
     } else if ((size == 16) || (size == 20)) {  /* UTC time, ends in 'Z' */
@@ -456,56 +578,98 @@ int icaltime_days_in_month(const int month, const int year)
 }
 
 /* 1-> Sunday, 7->Saturday */
+/* Before the Gregorian reform completed (15 Oct 1582) the Julian
+   calendar applies, with a ten-day gap at the switchover; the juldat
+   machinery models that. From 1583 on the proleptic-Gregorian day
+   numbers agree with it, so the common case runs on plain integer
+   arithmetic with no Julian-date struct round-trip.
+
+   One more wrinkle: caldat computes its day-of-year with the plain
+   every-fourth-year leap rule, so in century years that are not leap
+   years (1700, 1900, 2100, ...) it is one higher than the Gregorian
+   day-of-year from March onwards. That behaviour is part of the tested
+   output of the *_doy_* functions, so those years stay on the legacy
+   path too. */
+
+static int icaltime_legacy_doy_year(int year)
+{
+    return year <= 1582 || (year % 100 == 0 && year % 400 != 0);
+}
+
 int icaltime_day_of_week(const struct icaltimetype t)
 {
-    UTinstantInt jt;
+    long dow;
 
-    memset(&jt, 0, sizeof(UTinstantInt));
+    if (t.year <= 1582) {
+        UTinstantInt jt;
 
-    jt.year = t.year;
-    jt.month = t.month;
-    jt.day = t.day;
+        memset(&jt, 0, sizeof(UTinstantInt));
+
+        jt.year = t.year;
+        jt.month = t.month;
+        jt.day = t.day;
+
+        juldat_int(&jt);
+
+        return jt.weekday + 1;
+    }
 
-    juldat_int(&jt);
+    /* Day 0 (1970-01-01) was a Thursday; with Sunday as 1 that is 5. */
+    dow = (icaltime_date_to_daynum(t.year, t.month, t.day) + 4) % 7;
+    if (dow < 0)
+        dow += 7;
 
-    return jt.weekday + 1;
+    return (int)dow + 1;
 }
 
 int icaltime_start_doy_week(const struct icaltimetype t, int fdow)
 {
-    UTinstantInt jt;
     int delta;
 
-    memset(&jt, 0, sizeof(UTinstantInt));
+    if (icaltime_legacy_doy_year(t.year)) {
+        UTinstantInt jt;
 
-    jt.year = t.year;
-    jt.month = t.month;
-    jt.day = t.day;
+        memset(&jt, 0, sizeof(UTinstantInt));
 
-    juldat_int(&jt);
-    caldat_int(&jt);
+        jt.year = t.year;
+        jt.month = t.month;
+        jt.day = t.day;
 
-    delta = jt.weekday - (fdow - 1);
+        juldat_int(&jt);
+        caldat_int(&jt);
+
+        delta = jt.weekday - (fdow - 1);
+        if (delta < 0) {
+            delta += 7;
+        }
+        return jt.day_of_year - delta;
+    }
+
+    delta = (icaltime_day_of_week(t) - 1) - (fdow - 1);
     if (delta < 0) {
         delta += 7;
     }
-    return jt.day_of_year - delta;
+    return icaltime_day_of_year(t) - delta;
 }
 
 int icaltime_week_number(const struct icaltimetype ictt)
 {
-    UTinstantInt jt;
+    if (icaltime_legacy_doy_year(ictt.year)) {
+        UTinstantInt jt;
 
-    memset(&jt, 0, sizeof(UTinstantInt));
+        memset(&jt, 0, sizeof(UTinstantInt));
 
-    jt.year = ictt.year;
-    jt.month = ictt.month;
-    jt.day = ictt.day;
+        jt.year = ictt.year;
+        jt.month = ictt.month;
+        jt.day = ictt.day;
 
-    juldat_int(&jt);
-    caldat_int(&jt);
+        juldat_int(&jt);
+        caldat_int(&jt);
 
-    return (jt.day_of_year - jt.weekday) / 7;
+        return (jt.day_of_year - jt.weekday) / 7;
+    }
+
+    return (icaltime_day_of_year(ictt) - (icaltime_day_of_week(ictt) - 1)) / 7;
 }
 
 int icaltime_day_of_year(const struct icaltimetype t)
@@ -661,6 +825,96 @@ int icaltime_compare(const struct icaltimetype a_in, const struct icaltimetype b
     return 0;
 }
 
+int64_t icaltime_as_sortkey(const struct icaltimetype tt)
+{
+    struct icaltimetype t = tt;
+    int64_t key;
+
+    /* Normalize to UTC once, so keys from times in different zones
+       compare consistently. Floating times are keyed on their own
+       field values, matching icaltime_compare(). */
+    if (t.zone != NULL) {
+        t = icaltime_convert_to_zone(t, icaltimezone_get_utc_timezone());
+    }
+
+    /* Pack the fields most-significant first, with each multiplier
+       larger than its field's range so the integer ordering matches
+       the field-by-field ordering. The bit between the date and time
+       fields makes a DATE sort just before a DATE-TIME at midnight of
+       the same day, as icaltime_compare() orders them. */
+    key = (int64_t)t.year * 13 + t.month;
+    key = key * 32 + t.day;
+
+    if (t.is_date) {
+        key = key * 2 * 24 * 60 * 60;
+    } else {
+        key = key * 2 + 1;
+        key = (key * 24 + t.hour) * 60 + t.minute;
+        key = key * 60 + t.second;
+    }
+
+    return key;
+}
+
+struct icaltime_sort_pair
+{
+    int64_t key;
+    struct icaltimetype tt;
+};
+
+/** @brief qsort() comparator over the packed keys of an
+ * icaltime_sort_pair array.
+ */
+static int icaltime_sort_pair_compare(const void *a, const void *b)
+{
+    int64_t ka = ((const struct icaltime_sort_pair *)a)->key;
+    int64_t kb = ((const struct icaltime_sort_pair *)b)->key;
+
+    return (ka > kb) - (ka < kb);
+}
+
+/** @brief qsort() comparator falling back to the field-by-field
+ * comparison.
+ */
+static int icaltime_qsort_compare(const void *a, const void *b)
+{
+    return icaltime_compare(*(const struct icaltimetype *)a,
+                            *(const struct icaltimetype *)b);
+}
+
+void icaltime_sort_array(struct icaltimetype *times, size_t num_times)
+{
+    struct icaltime_sort_pair *pairs;
+    size_t i;
+
+    icalerror_check_arg_rv(times != 0, "times");
+
+    if (num_times < 2) {
+        return;
+    }
+
+    pairs = malloc(num_times * sizeof(struct icaltime_sort_pair));
+    if (!pairs) {
+        /* Sort in place on the slower comparator rather than failing. */
+        qsort(times, num_times, sizeof(struct icaltimetype), icaltime_qsort_compare);
+        return;
+    }
+
+    /* Compute each key once, sort on plain integers, then copy back. */
+    for (i = 0; i < num_times; i++) {
+        pairs[i].key = icaltime_as_sortkey(times[i]);
+        pairs[i].tt = times[i];
+    }
+
+    qsort(pairs, num_times, sizeof(struct icaltime_sort_pair), icaltime_sort_pair_compare);
+
+    for (i = 0; i < num_times; i++) {
+        times[i] = pairs[i].tt;
+    }
+
+    free(pairs);
+}
+
 int icaltime_compare_date_only(const struct icaltimetype a_in,
                                const struct icaltimetype b_in)
 {
@@ -937,3 +1191,275 @@ int icaltime_span_contains(icaltime_span *s, icaltime_span *container)
 
     return 0;
 }
+
+/* A span set keeps its members in packed parallel arrays, sorted by
+   start time, with a running maximum of the end times alongside. A
+   candidate then overlaps some member exactly when a span starting
+   before the candidate ends reaches past the candidate's start, which
+   one binary search plus one prefix-maximum probe decides. */
+struct icaltime_span_set
+{
+    time_t *starts;     /* ascending once sorted is set */
+    time_t *ends;       /* ends[i] belongs to starts[i] */
+    time_t *max_ends;   /* running maximum of ends[0..i] */
+    size_t num_spans;
+    size_t capacity;
+    int sorted;
+};
+
+icaltime_span_set *icaltime_span_set_new(void)
+{
+    icaltime_span_set *set;
+
+    set = (icaltime_span_set *) icalmemory_new_buffer(sizeof(struct icaltime_span_set));
+    if (set == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    memset(set, 0, sizeof(struct icaltime_span_set));
+    return set;
+}
+
+void icaltime_span_set_free(icaltime_span_set *set)
+{
+    if (set == 0) {
+        return;
+    }
+
+    if (set->starts != 0) {
+        icalmemory_free_buffer(set->starts);
+    }
+    if (set->ends != 0) {
+        icalmemory_free_buffer(set->ends);
+    }
+    if (set->max_ends != 0) {
+        icalmemory_free_buffer(set->max_ends);
+    }
+    icalmemory_free_buffer(set);
+}
+
+int icaltime_span_set_add(icaltime_span_set *set, const icaltime_span *span)
+{
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((span != 0), "span");
+
+    if (set->num_spans == set->capacity) {
+        size_t new_capacity = set->capacity == 0 ? 16 : set->capacity * 2;
+        time_t *starts, *ends, *max_ends;
+
+        starts = set->starts == 0 ?
+            icalmemory_new_buffer(new_capacity * sizeof(time_t)) :
+            icalmemory_resize_buffer(set->starts, new_capacity * sizeof(time_t));
+        if (starts == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+        set->starts = starts;
+
+        ends = set->ends == 0 ?
+            icalmemory_new_buffer(new_capacity * sizeof(time_t)) :
+            icalmemory_resize_buffer(set->ends, new_capacity * sizeof(time_t));
+        if (ends == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+        set->ends = ends;
+
+        max_ends = set->max_ends == 0 ?
+            icalmemory_new_buffer(new_capacity * sizeof(time_t)) :
+            icalmemory_resize_buffer(set->max_ends, new_capacity * sizeof(time_t));
+        if (max_ends == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+        set->max_ends = max_ends;
+
+        set->capacity = new_capacity;
+    }
+
+    set->starts[set->num_spans] = span->start;
+    set->ends[set->num_spans] = span->end;
+    set->num_spans++;
+    set->sorted = 0;
+
+    return 1;
+}
+
+size_t icaltime_span_set_size(const icaltime_span_set *set)
+{
+    icalerror_check_arg_rz((set != 0), "set");
+
+    return set->num_spans;
+}
+
+static int icaltime_span_set_compare_fn(const void *elem1, const void *elem2)
+{
+    const time_t *pair1 = elem1;
+    const time_t *pair2 = elem2;
+
+    if (pair1[0] != pair2[0]) {
+        return pair1[0] < pair2[0] ? -1 : 1;
+    }
+    if (pair1[1] != pair2[1]) {
+        return pair1[1] < pair2[1] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* Sorts the packed arrays by start time and recomputes the prefix
+   maxima. Returns 0 on allocation failure, leaving the set usable but
+   unsorted. */
+static int icaltime_span_set_sort(icaltime_span_set *set)
+{
+    time_t *pairs;
+    size_t i;
+
+    if (set->sorted || set->num_spans == 0) {
+        set->sorted = 1;
+        return 1;
+    }
+
+    pairs = icalmemory_new_buffer(set->num_spans * 2 * sizeof(time_t));
+    if (pairs == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    for (i = 0; i < set->num_spans; i++) {
+        pairs[2 * i] = set->starts[i];
+        pairs[2 * i + 1] = set->ends[i];
+    }
+
+    qsort(pairs, set->num_spans, 2 * sizeof(time_t), icaltime_span_set_compare_fn);
+
+    for (i = 0; i < set->num_spans; i++) {
+        set->starts[i] = pairs[2 * i];
+        set->ends[i] = pairs[2 * i + 1];
+        set->max_ends[i] = i == 0 || set->ends[i] > set->max_ends[i - 1] ?
+            set->ends[i] : set->max_ends[i - 1];
+    }
+
+    icalmemory_free_buffer(pairs);
+    set->sorted = 1;
+    return 1;
+}
+
+/* First index whose start is >= t (all of 0..result-1 start before t). */
+static size_t icaltime_span_set_lower_bound(const icaltime_span_set *set, time_t t)
+{
+    size_t lower = 0, upper = set->num_spans;
+
+    while (lower < upper) {
+        size_t middle = lower + (upper - lower) / 2;
+
+        if (set->starts[middle] < t) {
+            lower = middle + 1;
+        } else {
+            upper = middle;
+        }
+    }
+    return lower;
+}
+
+/* First index whose start is > t. */
+static size_t icaltime_span_set_upper_bound(const icaltime_span_set *set, time_t t)
+{
+    size_t lower = 0, upper = set->num_spans;
+
+    while (lower < upper) {
+        size_t middle = lower + (upper - lower) / 2;
+
+        if (set->starts[middle] <= t) {
+            lower = middle + 1;
+        } else {
+            upper = middle;
+        }
+    }
+    return lower;
+}
+
+int icaltime_span_set_overlaps(icaltime_span_set *set, const icaltime_span *span)
+{
+    size_t i, k;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((span != 0), "span");
+
+    if (set->num_spans == 0) {
+        return 0;
+    }
+
+    if (!icaltime_span_set_sort(set)) {
+        /* Could not sort; answer with a plain scan. */
+        for (i = 0; i < set->num_spans; i++) {
+            icaltime_span member;
+
+            member.start = set->starts[i];
+            member.end = set->ends[i];
+            member.is_busy = 0;
+            if (icaltime_span_overlaps(&member, (icaltime_span *) span)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* Some member starting before the candidate ends must reach past
+       the candidate's start. */
+    k = icaltime_span_set_lower_bound(set, span->end);
+    if (k > 0 && set->max_ends[k - 1] > span->start) {
+        return 1;
+    }
+
+    /* Equal zero-length spans overlap, matching icaltime_span_overlaps();
+       the interior test above cannot see them. */
+    if (span->start == span->end) {
+        for (i = icaltime_span_set_lower_bound(set, span->start);
+             i < set->num_spans && set->starts[i] == span->start; i++) {
+            if (set->ends[i] == span->end) {
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int icaltime_span_set_contains(icaltime_span_set *set, const icaltime_span *span)
+{
+    size_t i, k;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((span != 0), "span");
+
+    if (set->num_spans == 0) {
+        return 0;
+    }
+
+    if (!icaltime_span_set_sort(set)) {
+        for (i = 0; i < set->num_spans; i++) {
+            icaltime_span member;
+
+            member.start = set->starts[i];
+            member.end = set->ends[i];
+            member.is_busy = 0;
+            if (icaltime_span_contains((icaltime_span *) span, &member)) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    /* A container must start at or before the candidate and end at or
+       after it; the prefix maximum names one such span if any exists.
+       A zero-length candidate needs strict bounds on both sides, as in
+       icaltime_span_contains(). */
+    if (span->start == span->end) {
+        k = icaltime_span_set_lower_bound(set, span->start);
+        return k > 0 && set->max_ends[k - 1] > span->end;
+    }
+
+    k = icaltime_span_set_upper_bound(set, span->start);
+    return k > 0 && set->max_ends[k - 1] >= span->end;
+}
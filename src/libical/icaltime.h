@@ -82,6 +82,8 @@
 
 #include "libical_ical_export.h"
 
+#include <stdint.h>
+
 #include <time.h>
 
 /* An opaque struct representing a timezone. We declare this here to avoid
@@ -210,6 +212,21 @@ LIBICAL_ICAL_EXPORT time_t icaltime_as_timet(const struct icaltimetype);
 LIBICAL_ICAL_EXPORT time_t icaltime_as_timet_with_zone(const struct icaltimetype tt,
                                                        const icaltimezone *zone);
 
+/**     @brief Converts an array of times to seconds past the UNIX epoch,
+ *      using the given timezone.
+ *
+ *      Equivalent to calling icaltime_as_timet_with_zone() on each of the
+ *      @p num_times entries of @p times, writing the results to the
+ *      caller-supplied @p results array. Batching the conversions lets
+ *      consecutive times in the same month share the cached
+ *      calendar-to-epoch math.
+ *
+ *      @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icaltime_as_timet_bulk(const struct icaltimetype *times,
+                                                size_t num_times,
+                                                const icaltimezone *zone, time_t *results);
+
 /**
  * @brief Returns a string represention of the time, in RFC5545 format.
  *
@@ -246,6 +263,29 @@ LIBICAL_ICAL_EXPORT struct icaltimetype icaltime_set_timezone(struct icaltimetyp
  */
 LIBICAL_ICAL_EXPORT int icaltime_day_of_year(const struct icaltimetype t);
 
+/** @brief Converts a Gregorian calendar date to a day number, counted
+ *  in days from 1970-01-01 (which is day 0; earlier dates are
+ *  negative).
+ *
+ *  Pure integer arithmetic, proleptic Gregorian, exact for any year —
+ *  unlike naive year*365 counting this handles the 100/400-year leap
+ *  rules. Consecutive dates map to consecutive day numbers, so date
+ *  differences and weekday math reduce to subtraction and modulo.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT long icaltime_date_to_daynum(int year, int month, int day);
+
+/** @brief Converts a day number as returned by icaltime_date_to_daynum()
+ *  back to a Gregorian calendar date.
+ *
+ *  Any of @p year, @p month and @p day may be NULL if the caller does
+ *  not need that field.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icaltime_daynum_to_date(long daynum, int *year, int *month, int *day);
+
 /** @brief Returns the day of the week of the given time.
  *
  * Sunday is 1, and Saturday is 7.
@@ -301,6 +341,34 @@ LIBICAL_ICAL_EXPORT int icaltime_is_utc(const struct icaltimetype t);
  */
 LIBICAL_ICAL_EXPORT int icaltime_compare(const struct icaltimetype a, const struct icaltimetype b);
 
+/**
+ *      @brief Returns a 64-bit key that orders the same way as
+ *      icaltime_compare().
+ *
+ *      The time is normalized to UTC once and its fields are packed into
+ *      a single integer, so comparing two keys with ordinary integer
+ *      comparison matches icaltime_compare() on the corresponding times.
+ *      Computing the key once per time turns sorting large occurrence
+ *      lists into integer sorting. Floating times are keyed on their own
+ *      field values, as icaltime_compare() compares them when the zones
+ *      match.
+ *
+ *      @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int64_t icaltime_as_sortkey(const struct icaltimetype tt);
+
+/**
+ *      @brief Sorts an array of times into ascending icaltime_compare()
+ *      order.
+ *
+ *      Computes the icaltime_as_sortkey() key of each of the
+ *      @p num_times entries once and sorts on the packed keys instead of
+ *      comparing struct fields per pair.
+ *
+ *      @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icaltime_sort_array(struct icaltimetype *times, size_t num_times);
+
 /** @brief Like icaltime_compare, but only use the date parts.
  *
  * This converts both times to the UTC timezone and compares their date
@@ -407,4 +475,61 @@ LIBICAL_ICAL_EXPORT int icaltime_span_overlaps(icaltime_span *s1, icaltime_span
  */
 LIBICAL_ICAL_EXPORT int icaltime_span_contains(icaltime_span *s, icaltime_span *container);
 
+/** An append-only collection of spans answering overlap queries against
+ *  all of its members at once. The spans are kept in packed, sorted
+ *  arrays, so testing a candidate against thousands of busy spans costs
+ *  a binary search instead of one icaltime_span_overlaps() call per
+ *  member. Typically filled from icalcomponent_get_span() results.
+ *
+ *  @since 3.1.0
+ */
+typedef struct icaltime_span_set icaltime_span_set;
+
+/** @brief Creates an empty span set.
+ *
+ *  @return  The new set, to be released with icaltime_span_set_free(),
+ *           or NULL on allocation failure.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT icaltime_span_set *icaltime_span_set_new(void);
+
+/** @brief Frees a span set. */
+LIBICAL_ICAL_EXPORT void icaltime_span_set_free(icaltime_span_set *set);
+
+/** @brief Adds a span to the set.
+ *
+ *  @param set   The set to add to
+ *  @param span  The span to add; its is_busy flag is ignored
+ *  @return      1 on success, 0 on allocation failure (the set is
+ *               unchanged).
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icaltime_span_set_add(icaltime_span_set *set, const icaltime_span *span);
+
+/** @brief Returns the number of spans in the set.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT size_t icaltime_span_set_size(const icaltime_span_set *set);
+
+/** @brief Returns true if @p span overlaps any span in the set.
+ *
+ *  Matches icaltime_span_overlaps() member for member: adjacent spans
+ *  do not overlap, equal spans do.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icaltime_span_set_overlaps(icaltime_span_set *set,
+                                                   const icaltime_span *span);
+
+/** @brief Returns true if @p span lies totally within some single span
+ *  of the set, under the same rules as icaltime_span_contains().
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icaltime_span_set_contains(icaltime_span_set *set,
+                                                   const icaltime_span *span);
+
 #endif /* !ICALTIME_H */
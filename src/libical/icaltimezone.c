@@ -27,10 +27,16 @@
 #include "icalerror.h"
 #include "icalparser.h"
 #include "icalmemory.h"
+#include "icaltrace.h"
 #include "icaltz-util.h"
 
+#if defined(ICAL_EMBED_TZDATA)
+#include "icaltzdata.h"
+#endif
+
 #include <ctype.h>
 #include <stddef.h>     /* for ptrdiff_t */
+#include <stdint.h>
 #include <stdlib.h>
 #include <limits.h>
 
@@ -54,6 +60,13 @@ static pthread_mutex_t changes_mutex = PTHREAD_MUTEX_INITIALIZER;
 #include <windows.h>
 #endif
 
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 /** This is the toplevel directory where the timezone data is installed in. */
 #define ZONEINFO_DIRECTORY      PACKAGE_DATA_DIR "/zoneinfo"
 
@@ -70,6 +83,11 @@ static char s_ical_tzid_prefix[BUILTIN_TZID_PREFIX_LEN] = {0};
     coordinates of all the builtin timezones. */
 #define ZONES_TAB_FILENAME      "zones.tab"
 
+/** This is the filename of the binary sidecar holding the same table,
+    generated at build time by scripts/mkzonesdat.pl. When present it is
+    mmap'ed instead of parsing ZONES_TAB_FILENAME line by line. */
+#define ZONES_DAT_FILENAME      "zones.dat"
+
 /** This is the number of years of extra coverage we do when expanding
     the timezone changes. */
 #define ICALTIMEZONE_EXTRA_COVERAGE     5
@@ -111,8 +129,22 @@ struct _icaltimezonechange
 /** An array of icaltimezones for the builtin timezones. */
 static icalarray *builtin_timezones = NULL;
 
+/** Hash index over builtin_timezones keyed by location, so TZID
+   resolution doesn't do a linear scan of ~400 zones per lookup.
+   Entries point into builtin_timezones, whose chunked storage keeps
+   element addresses stable across appends. */
+#define BUILTIN_TZ_INDEX_SIZE 512
+
+struct builtin_tz_bucket
+{
+    icaltimezone *zone;
+    struct builtin_tz_bucket *next;
+};
+
+static struct builtin_tz_bucket *builtin_tz_index[BUILTIN_TZ_INDEX_SIZE];
+
 /** This is the special UTC timezone, which isn't in builtin_timezones. */
-static icaltimezone utc_timezone = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+static icaltimezone utc_timezone = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
 
 static char *zone_files_directory = NULL;
 
@@ -123,7 +155,7 @@ static int use_builtin_tzdata = 0;
 #endif
 
 static void icaltimezone_reset(icaltimezone *zone);
-static void icaltimezone_expand_changes(icaltimezone *zone, int end_year);
+static void icaltimezone_expand_changes(icaltimezone *zone, int start_year, int end_year);
 static int icaltimezone_compare_change_fn(const void *elem1, const void *elem2);
 
 static size_t icaltimezone_find_nearby_change(icaltimezone *zone, icaltimezonechange *change);
@@ -131,6 +163,8 @@ static size_t icaltimezone_find_nearby_change(icaltimezone *zone, icaltimezonech
 static void icaltimezone_adjust_change(icaltimezonechange *tt,
                                        int days, int hours, int minutes, int seconds);
 
+static void icaltimezone_change_to_local(icaltimezonechange *change);
+
 static void icaltimezone_init(icaltimezone *zone);
 
 /** @brief Gets the TZID, LOCATION/X-LIC-LOCATION, and TZNAME properties from
@@ -229,6 +263,18 @@ icaltimezone *icaltimezone_copy(icaltimezone *originalzone)
     if (zone->changes != NULL) {
         zone->changes = icalarray_copy(zone->changes);
     }
+    if (zone->change_keys != NULL) {
+        size_t num_keys = zone->changes ? zone->changes->num_elements : 0;
+        int64_t *keys = NULL;
+
+        if (num_keys > 0) {
+            keys = (int64_t *) malloc(num_keys * sizeof(int64_t));
+            if (keys) {
+                memcpy(keys, originalzone->change_keys, num_keys * sizeof(int64_t));
+            }
+        }
+        zone->change_keys = keys;
+    }
     icaltimezone_changes_unlock();
 
     /* Let the caller set the component because then they will
@@ -267,6 +313,10 @@ static void icaltimezone_reset(icaltimezone *zone)
         icalarray_free(zone->changes);
         zone->changes = NULL;
     }
+    if (zone->change_keys) {
+        free(zone->change_keys);
+        zone->change_keys = NULL;
+    }
     //    icaltimezone_changes_unlock();
 
     icaltimezone_init(zone);
@@ -282,8 +332,12 @@ static void icaltimezone_init(icaltimezone *zone)
     zone->longitude = 0.0;
     zone->component = NULL;
     zone->builtin_timezone = NULL;
+    zone->start_year = 0;
     zone->end_year = 0;
     zone->changes = NULL;
+    zone->change_keys = NULL;
+    zone->last_local_change = 0;
+    zone->last_utc_change = 0;
 }
 
 /** @brief Gets the TZID, LOCATION/X-LIC-LOCATION and TZNAME properties of
@@ -468,7 +522,7 @@ static void icaltimezone_ensure_coverage(icaltimezone *zone, int end_year)
        year, plus ICALTIMEZONE_EXTRA_COVERAGE. */
     static int icaltimezone_minimum_expansion_year = -1;
 
-    int changes_end_year;
+    int changes_start_year, changes_end_year;
 
     icaltimezone_load_builtin_timezone(zone);
 
@@ -487,42 +541,346 @@ static void icaltimezone_ensure_coverage(icaltimezone *zone, int end_year)
     if (changes_end_year > ICALTIMEZONE_MAX_YEAR)
         changes_end_year = ICALTIMEZONE_MAX_YEAR;
 
-    if (!zone->changes || zone->end_year < end_year)
-        icaltimezone_expand_changes(zone, changes_end_year);
+    /* Expand on demand around the requested year rather than across the
+       whole history of the zone; a later query outside the covered
+       window re-expands with the union of both windows, so alternating
+       queries can't thrash. */
+    changes_start_year = end_year;
+    if (changes_start_year > icaltimezone_minimum_expansion_year)
+        changes_start_year = icaltimezone_minimum_expansion_year;
+
+    changes_start_year -= ICALTIMEZONE_EXTRA_COVERAGE;
+
+    if (changes_start_year < 1)
+        changes_start_year = 1;
+
+    if (zone->changes) {
+        if (changes_start_year > zone->start_year)
+            changes_start_year = zone->start_year;
+        if (changes_end_year < zone->end_year)
+            changes_end_year = zone->end_year;
+    }
+
+    if (!zone->changes || zone->end_year < end_year || zone->start_year > end_year)
+        icaltimezone_expand_changes(zone, changes_start_year, changes_end_year);
 }
 
 /* Hold the icaltimezone_changes_lock(); before calling this function */
-static void icaltimezone_expand_changes(icaltimezone *zone, int end_year)
+/** @brief Packs the date fields of a change into one sortable 64-bit
+ * key, ordered the same way as icaltimezone_compare_change_fn().
+ */
+static int64_t icaltimezone_change_key(const icaltimezonechange *change)
+{
+    return ((((((int64_t) change->year * 16 + change->month) * 32 +
+               change->day) * 32 + change->hour) * 64 + change->minute) * 64 +
+            change->second);
+}
+
+/** @brief Fills @p changes straight from the binary TZif transition
+ * table, skipping the VTIMEZONE round-trip.
+ *
+ * Only applies to builtin zones served from system tzdata, and only
+ * when the file's explicit transitions reach @p end_year; zones whose
+ * future rules live solely in the TZif footer string fall back to the
+ * VTIMEZONE expansion. Returns 1 when the array was filled.
+ */
+static int icaltimezone_expand_changes_from_tzif(icaltimezone *zone,
+                                                 int start_year, int end_year,
+                                                 icalarray *changes)
+{
+    struct icaltzutil_change *tzif_changes = NULL;
+    size_t num_tzif_changes = 0;
+    size_t i;
+    const char *tzid_prefix;
+    struct tm t;
+    icaltimezonechange change, baseline;
+    int have_baseline = 0;
+
+    if (use_builtin_tzdata || !zone->location || !zone->location[0] || !zone->tzid)
+        return 0;
+
+    /* Zones parsed from arbitrary VTIMEZONE data may carry rules that
+       differ from the system file of the same location, so only trust
+       the TZif file for zones we loaded from it ourselves. */
+    tzid_prefix = icaltimezone_tzid_prefix();
+    if (strncmp(zone->tzid, tzid_prefix, strlen(tzid_prefix)) != 0)
+        return 0;
+
+    if (!icaltzutil_fetch_changes(zone->location, &tzif_changes, &num_tzif_changes))
+        return 0;
+
+    if (!gmtime_r(&tzif_changes[num_tzif_changes - 1].transition, &t) ||
+        t.tm_year + 1900 < end_year) {
+        free(tzif_changes);
+        return 0;
+    }
+
+    for (i = 0; i < num_tzif_changes; i++) {
+        if (!gmtime_r(&tzif_changes[i].transition, &t))
+            continue;
+
+        change.utc_offset = tzif_changes[i].utc_offset;
+        change.prev_utc_offset = tzif_changes[i].prev_utc_offset;
+        change.year = t.tm_year + 1900;
+        change.month = t.tm_mon + 1;
+        change.day = t.tm_mday;
+        change.hour = t.tm_hour;
+        change.minute = t.tm_min;
+        change.second = t.tm_sec;
+        change.is_daylight = tzif_changes[i].is_daylight;
+
+        /* Collapse everything before the covered window into the single
+           change in effect at its start; queries for earlier years
+           re-expand with a wider window. */
+        if (change.year < start_year) {
+            baseline = change;
+            have_baseline = 1;
+            continue;
+        }
+
+        if (have_baseline) {
+            icalarray_append(changes, &baseline);
+            have_baseline = 0;
+        }
+        icalarray_append(changes, &change);
+
+        if (change.year > end_year)
+            break;
+    }
+
+    if (have_baseline)
+        icalarray_append(changes, &baseline);
+
+    free(tzif_changes);
+
+    return changes->num_elements != 0;
+}
+
+static void icaltimezone_expand_changes(icaltimezone *zone, int start_year, int end_year)
 {
     icalarray *changes;
     icalcomponent *comp;
+    int64_t *keys;
+    size_t i;
 
 #if 0
-    printf("\nExpanding changes for: %s to year: %i\n", zone->tzid, end_year);
+    printf("\nExpanding changes for: %s years: %i-%i\n", zone->tzid, start_year, end_year);
 #endif
 
-    changes = icalarray_new(sizeof(icaltimezonechange), 32);
+    /* The array is built and sorted here under the changes lock and only
+       read afterwards, so no caller relies on element addresses staying
+       stable across appends; contiguous storage lets the binary search
+       and the scans below walk flat memory instead of chasing the chunk
+       table on every probe. */
+    changes = icalarray_new_contiguous(sizeof(icaltimezonechange), 32);
     if (!changes)
         return;
 
-    /* Scan the STANDARD and DAYLIGHT subcomponents. */
-    comp = icalcomponent_get_first_component(zone->component, ICAL_ANY_COMPONENT);
-    while (comp) {
-        icaltimezone_expand_vtimezone(comp, end_year, changes);
-        comp = icalcomponent_get_next_component(zone->component, ICAL_ANY_COMPONENT);
+    if (!icaltimezone_expand_changes_from_tzif(zone, start_year, end_year, changes)) {
+        /* Scan the STANDARD and DAYLIGHT subcomponents. */
+        comp = icalcomponent_get_first_component(zone->component, ICAL_ANY_COMPONENT);
+        while (comp) {
+            icaltimezone_expand_vtimezone(comp, end_year, changes);
+            comp = icalcomponent_get_next_component(zone->component, ICAL_ANY_COMPONENT);
+        }
     }
 
     /* Sort the changes. We may have duplicates but I don't think it will
        matter. */
     icalarray_sort(changes, icaltimezone_compare_change_fn);
 
+    /* Drop everything before the covered window except the change in
+       effect at its start (the contiguous array keeps the elements in
+       one block, so this is a single move). */
+    if (changes->num_elements > 1) {
+        size_t drop = 0;
+
+        while (drop + 1 < changes->num_elements &&
+               ((icaltimezonechange *)icalarray_element_at(changes, drop + 1))->year < start_year)
+            drop++;
+
+        if (drop > 0) {
+            memmove(icalarray_element_at(changes, 0),
+                    icalarray_element_at(changes, drop),
+                    (changes->num_elements - drop) * sizeof(icaltimezonechange));
+            changes->num_elements -= drop;
+        }
+    }
+
     if (zone->changes) {
         icalarray_free(zone->changes);
         zone->changes = 0;
     }
 
     zone->changes = changes;
+    zone->start_year = start_year;
     zone->end_year = end_year;
+
+    /* Rebuild the packed key array the binary search probes instead of
+       the full structs. On allocation failure the search falls back to
+       comparing the structs. */
+    if (zone->change_keys) {
+        free(zone->change_keys);
+        zone->change_keys = NULL;
+    }
+    keys = (int64_t *) malloc(changes->num_elements * sizeof(int64_t));
+    if (keys) {
+        for (i = 0; i < changes->num_elements; i++) {
+            keys[i] = icaltimezone_change_key(icalarray_element_at(changes, i));
+        }
+        zone->change_keys = keys;
+    }
+}
+
+/* Per-thread cache of resolved offset intervals. Converting a batch of
+   events mostly hits the same handful of zones and DST intervals, and a
+   hit here answers with two key comparisons and no locking at all. Each
+   entry holds the UTC offset that applies to a zone between two packed
+   time keys; for local-time lookups the window is shrunk to exclude the
+   ambiguous clocks-going-back overlap, so cached answers never need the
+   disambiguation logic. */
+
+#define OFFSET_CACHE_SIZE 16    /* per thread and direction, direct-mapped */
+
+struct icaltimezone_offset_cache_entry
+{
+    const icaltimezone *zone;
+    int64_t start;
+    int64_t end;
+    int utc_offset;
+    int is_daylight;
+    int valid;
+};
+
+struct icaltimezone_offset_cache
+{
+    struct icaltimezone_offset_cache_entry local[OFFSET_CACHE_SIZE];
+    struct icaltimezone_offset_cache_entry utc[OFFSET_CACHE_SIZE];
+};
+
+#if defined(HAVE_PTHREAD)
+
+static pthread_key_t offset_cache_tls_key;
+static pthread_once_t offset_cache_tls_once = PTHREAD_ONCE_INIT;
+
+static void offset_cache_destroy(void *cache)
+{
+    free(cache);
+}
+
+static void offset_cache_tls_alloc(void)
+{
+    (void)pthread_key_create(&offset_cache_tls_key, offset_cache_destroy);
+}
+
+static struct icaltimezone_offset_cache *get_offset_cache(void)
+{
+    struct icaltimezone_offset_cache *cache;
+
+    (void)pthread_once(&offset_cache_tls_once, offset_cache_tls_alloc);
+
+    cache = pthread_getspecific(offset_cache_tls_key);
+    if (!cache) {
+        cache = calloc(1, sizeof(struct icaltimezone_offset_cache));
+        if (cache) {
+            pthread_setspecific(offset_cache_tls_key, cache);
+        }
+    }
+
+    return cache;
+}
+
+#else
+
+static struct icaltimezone_offset_cache offset_cache_static;
+
+static struct icaltimezone_offset_cache *get_offset_cache(void)
+{
+    return &offset_cache_static;
+}
+
+#endif
+
+static struct icaltimezone_offset_cache_entry *offset_cache_slot(
+    struct icaltimezone_offset_cache_entry *entries, const icaltimezone *zone)
+{
+    return &entries[((uintptr_t) zone >> 4) % OFFSET_CACHE_SIZE];
+}
+
+static int offset_cache_lookup(const struct icaltimezone_offset_cache_entry *entry,
+                               const icaltimezone *zone, int64_t key,
+                               int *utc_offset, int *is_daylight)
+{
+    if (!entry->valid || entry->zone != zone ||
+        key < entry->start || key >= entry->end) {
+        return 0;
+    }
+
+    *utc_offset = entry->utc_offset;
+    if (is_daylight) {
+        *is_daylight = entry->is_daylight;
+    }
+
+    return 1;
+}
+
+/** @brief Stores the interval in which the change at @p change_num
+ * applies unambiguously.
+ *
+ * For local-time windows (@p to_local set) the start is adjusted by the
+ * larger of the two offsets and the end by the smaller, so times inside
+ * the clocks-going-back overlap never hit the cache.
+ *
+ * Hold icaltimezone_changes_lock(); before calling this function.
+ */
+static void offset_cache_store(struct icaltimezone_offset_cache_entry *entry,
+                               const icaltimezone *zone, size_t change_num,
+                               int to_local)
+{
+    icaltimezonechange tmp_change;
+    int64_t start, end;
+
+    tmp_change = *(icaltimezonechange *)
+        icalarray_element_at(zone->changes, change_num);
+    entry->utc_offset = tmp_change.utc_offset;
+    entry->is_daylight = tmp_change.is_daylight;
+
+    if (to_local) {
+        if (tmp_change.utc_offset > tmp_change.prev_utc_offset) {
+            icaltimezone_adjust_change(&tmp_change, 0, 0, 0, tmp_change.utc_offset);
+        } else {
+            icaltimezone_adjust_change(&tmp_change, 0, 0, 0, tmp_change.prev_utc_offset);
+        }
+    }
+    start = icaltimezone_change_key(&tmp_change);
+
+    if (change_num + 1 < zone->changes->num_elements) {
+        tmp_change = *(icaltimezonechange *)
+            icalarray_element_at(zone->changes, change_num + 1);
+        if (to_local) {
+            icaltimezone_change_to_local(&tmp_change);
+        }
+        end = icaltimezone_change_key(&tmp_change);
+    } else {
+        /* The last known change: clamp the window to the expanded
+           coverage, so times past it still trigger a re-expansion
+           instead of being answered from the cache. */
+        memset(&tmp_change, 0, sizeof(tmp_change));
+        tmp_change.year = zone->end_year;
+        tmp_change.month = 1;
+        tmp_change.day = 1;
+        end = icaltimezone_change_key(&tmp_change);
+    }
+
+    if (start >= end) {
+        entry->valid = 0;
+        return;
+    }
+
+    entry->zone = zone;
+    entry->start = start;
+    entry->end = end;
+    entry->valid = 1;
 }
 
 void icaltimezone_expand_vtimezone(icalcomponent *comp, int end_year, icalarray *changes)
@@ -796,9 +1154,62 @@ void icaltimezone_convert_time(struct icaltimetype *tt,
     icaltime_adjust(tt, 0, 0, 0, utc_offset);
 }
 
+/** @brief Adjusts a copy of a change to local time, using the same
+ * offset choice as the search loops in the offset lookups below.
+ */
+static void icaltimezone_change_to_local(icaltimezonechange *change)
+{
+    if (change->utc_offset < change->prev_utc_offset) {
+        icaltimezone_adjust_change(change, 0, 0, 0, change->utc_offset);
+    } else {
+        icaltimezone_adjust_change(change, 0, 0, 0, change->prev_utc_offset);
+    }
+}
+
+/** @brief Checks whether the change at index @p memo still brackets the
+ * given time, i.e. change[memo] <= tt_change < change[memo + 1].
+ *
+ * Because the changes array is sorted, a successful check proves that
+ * @p memo is the change to use, so the binary search and the stepping
+ * loop can be skipped entirely. If @p to_local is set the changes are
+ * adjusted to local time before comparing, matching the local-time
+ * lookup; otherwise they are compared as stored (UTC).
+ *
+ * Hold icaltimezone_changes_lock(); before calling this function.
+ */
+static int icaltimezone_check_cached_change(icaltimezone *zone,
+                                            icaltimezonechange *tt_change,
+                                            size_t memo, int to_local)
+{
+    icaltimezonechange tmp_change;
+    size_t num_changes = zone->changes->num_elements;
+
+    if (memo >= num_changes)
+        return 0;
+
+    tmp_change = *(icaltimezonechange *) icalarray_element_at(zone->changes, memo);
+    if (to_local)
+        icaltimezone_change_to_local(&tmp_change);
+
+    if (icaltimezone_compare_change_fn(tt_change, &tmp_change) < 0)
+        return 0;
+
+    if (memo + 1 < num_changes) {
+        tmp_change = *(icaltimezonechange *) icalarray_element_at(zone->changes, memo + 1);
+        if (to_local)
+            icaltimezone_change_to_local(&tmp_change);
+
+        if (icaltimezone_compare_change_fn(tt_change, &tmp_change) >= 0)
+            return 0;
+    }
+
+    return 1;
+}
+
 int icaltimezone_get_utc_offset(icaltimezone *zone, struct icaltimetype *tt, int *is_daylight)
 {
     icaltimezonechange *zone_change, *prev_zone_change, tt_change, tmp_change;
+    struct icaltimezone_offset_cache *cache;
     size_t change_num, change_num_to_use;
     int found_change;
     int step, utc_offset_change, cmp;
@@ -818,6 +1229,25 @@ int icaltimezone_get_utc_offset(icaltimezone *zone, struct icaltimetype *tt, int
     if (zone->builtin_timezone)
         zone = zone->builtin_timezone;
 
+    /* Copy the time parts of the icaltimetype to an icaltimezonechange so we
+       can use our comparison function on it. */
+    tt_change.year = tt->year;
+    tt_change.month = tt->month;
+    tt_change.day = tt->day;
+    tt_change.hour = tt->hour;
+    tt_change.minute = tt->minute;
+    tt_change.second = tt->second;
+
+    /* Answer from the per-thread cache when the time falls inside the
+       interval that served a previous lookup of this zone. */
+    cache = get_offset_cache();
+    if (cache &&
+        offset_cache_lookup(offset_cache_slot(cache->local, zone), zone,
+                            icaltimezone_change_key(&tt_change),
+                            &utc_offset_change, is_daylight)) {
+        return utc_offset_change;
+    }
+
     icaltimezone_changes_lock();
 
     /* Make sure the changes array is expanded up to the given time. */
@@ -828,83 +1258,82 @@ int icaltimezone_get_utc_offset(icaltimezone *zone, struct icaltimetype *tt, int
         return 0;
     }
 
-    /* Copy the time parts of the icaltimetype to an icaltimezonechange so we
-       can use our comparison function on it. */
-    tt_change.year = tt->year;
-    tt_change.month = tt->month;
-    tt_change.day = tt->day;
-    tt_change.hour = tt->hour;
-    tt_change.minute = tt->minute;
-    tt_change.second = tt->second;
-
-    /* This should find a change close to the time, either the change before
-       it or the change after it. */
-    change_num = icaltimezone_find_nearby_change(zone, &tt_change);
-
-    /* Now move backwards or forwards to find the timezone change that applies
-       to tt. It should only have to do 1 or 2 steps. */
-    zone_change = icalarray_element_at(zone->changes, change_num);
-    step = 1;
-    found_change = 0;
-    change_num_to_use = -1;
-    for (;;) {
-        /* Copy the change, so we can adjust it. */
-        tmp_change = *zone_change;
+    /* Most conversions in a batch fall within the same DST interval, so
+       first check the change that answered the previous lookup. */
+    if (icaltimezone_check_cached_change(zone, &tt_change, zone->last_local_change, 1)) {
+        change_num_to_use = zone->last_local_change;
+    } else {
+        /* This should find a change close to the time, either the change
+           before it or the change after it. */
+        change_num = icaltimezone_find_nearby_change(zone, &tt_change);
 
-        /* If the clock is going backward, check if it is in the region of time
-           that is used twice. If it is, use the change with the daylight
-           setting which matches tt, or use standard if we don't know. */
-        if (tmp_change.utc_offset < tmp_change.prev_utc_offset) {
-            /* If the time change is at 2:00AM local time and the clock is
-               going back to 1:00AM we adjust the change to 1:00AM. We may
-               have the wrong change but we'll figure that out later. */
-            icaltimezone_adjust_change(&tmp_change, 0, 0, 0, tmp_change.utc_offset);
-        } else {
-            icaltimezone_adjust_change(&tmp_change, 0, 0, 0, tmp_change.prev_utc_offset);
-        }
+        /* Now move backwards or forwards to find the timezone change that
+           applies to tt. It should only have to do 1 or 2 steps. */
+        zone_change = icalarray_element_at(zone->changes, change_num);
+        step = 1;
+        found_change = 0;
+        change_num_to_use = -1;
+        for (;;) {
+            /* Copy the change, so we can adjust it.
+
+               If the clock is going backward and the time change is at
+               2:00AM local time with the clock going back to 1:00AM, the
+               change is adjusted to 1:00AM, i.e. into the region of time
+               that is used twice. We may have the wrong change but we'll
+               figure that out later. */
+            tmp_change = *zone_change;
+            icaltimezone_change_to_local(&tmp_change);
+
+            cmp = icaltimezone_compare_change_fn(&tt_change, &tmp_change);
+
+            /* If the given time is on or after this change, then this change
+               may apply, but we continue as a later change may be the right
+               one. If the given time is before this change, then if we have
+               already found a change which applies we can use that, else we
+               need to step backwards. */
+            if (cmp >= 0) {
+                found_change = 1;
+                change_num_to_use = change_num;
+            } else {
+                step = -1;
+            }
 
-        cmp = icaltimezone_compare_change_fn(&tt_change, &tmp_change);
+            /* If we are stepping backwards through the changes and we have
+               found a change that applies, then we know this is the change
+               to use so we exit the loop. */
+            if (step == -1 && found_change == 1)
+                break;
 
-        /* If the given time is on or after this change, then this change may
-           apply, but we continue as a later change may be the right one.
-           If the given time is before this change, then if we have already
-           found a change which applies we can use that, else we need to step
-           backwards. */
-        if (cmp >= 0) {
-            found_change = 1;
-            change_num_to_use = change_num;
-        } else {
-            step = -1;
-        }
+            /* If we go past the start of the changes array, then we have no
+               data for this time so we return the prev UTC offset. */
+            if (change_num == 0 && step < 0) {
+                if (is_daylight) {
+                    *is_daylight = ! tmp_change.is_daylight;
+                }
 
-        /* If we are stepping backwards through the changes and we have found
-           a change that applies, then we know this is the change to use so
-           we exit the loop. */
-        if (step == -1 && found_change == 1)
-            break;
+                icaltimezone_changes_unlock();
 
-        /* If we go past the start of the changes array, then we have no data
-           for this time so we return the prev UTC offset. */
-        if (change_num == 0 && step < 0) {
-            if (is_daylight) {
-                *is_daylight = ! tmp_change.is_daylight;
+                return tmp_change.prev_utc_offset;
             }
 
-            icaltimezone_changes_unlock();
+            change_num += step;
 
-            return tmp_change.prev_utc_offset;
-        }
+            if (change_num >= zone->changes->num_elements)
+                break;
 
-        change_num += step;
+            zone_change = icalarray_element_at(zone->changes, change_num);
+        }
 
-        if (change_num >= zone->changes->num_elements)
-            break;
+        /* If we didn't find a change to use, then we have a bug! */
+        icalerror_assert(found_change == 1, "No applicable timezone change found");
 
-        zone_change = icalarray_element_at(zone->changes, change_num);
+        zone->last_local_change = change_num_to_use;
     }
 
-    /* If we didn't find a change to use, then we have a bug! */
-    icalerror_assert(found_change == 1, "No applicable timezone change found");
+    if (cache) {
+        offset_cache_store(offset_cache_slot(cache->local, zone), zone,
+                           change_num_to_use, 1);
+    }
 
     /* Now we just need to check if the time is in the overlapped region of
        time when clocks go back. */
@@ -957,6 +1386,7 @@ int icaltimezone_get_utc_offset_of_utc_time(icaltimezone *zone,
                                             struct icaltimetype *tt, int *is_daylight)
 {
     icaltimezonechange *zone_change, tt_change, tmp_change;
+    struct icaltimezone_offset_cache *cache;
     size_t change_num, change_num_to_use;
     int found_change = 1;
     int step, utc_offset;
@@ -972,6 +1402,25 @@ int icaltimezone_get_utc_offset_of_utc_time(icaltimezone *zone,
     if (zone->builtin_timezone)
         zone = zone->builtin_timezone;
 
+    /* Copy the time parts of the icaltimetype to an icaltimezonechange so we
+       can use our comparison function on it. */
+    tt_change.year = tt->year;
+    tt_change.month = tt->month;
+    tt_change.day = tt->day;
+    tt_change.hour = tt->hour;
+    tt_change.minute = tt->minute;
+    tt_change.second = tt->second;
+
+    /* Answer from the per-thread cache when the time falls inside the
+       interval that served a previous lookup of this zone. */
+    cache = get_offset_cache();
+    if (cache &&
+        offset_cache_lookup(offset_cache_slot(cache->utc, zone), zone,
+                            icaltimezone_change_key(&tt_change),
+                            &utc_offset, is_daylight)) {
+        return utc_offset;
+    }
+
     icaltimezone_changes_lock();
 
     /* Make sure the changes array is expanded up to the given time. */
@@ -982,69 +1431,73 @@ int icaltimezone_get_utc_offset_of_utc_time(icaltimezone *zone,
         return 0;
     }
 
-    /* Copy the time parts of the icaltimetype to an icaltimezonechange so we
-       can use our comparison function on it. */
-    tt_change.year = tt->year;
-    tt_change.month = tt->month;
-    tt_change.day = tt->day;
-    tt_change.hour = tt->hour;
-    tt_change.minute = tt->minute;
-    tt_change.second = tt->second;
+    /* Most conversions in a batch fall within the same DST interval, so
+       first check the change that answered the previous lookup. */
+    if (icaltimezone_check_cached_change(zone, &tt_change, zone->last_utc_change, 0)) {
+        change_num_to_use = zone->last_utc_change;
+    } else {
+        /* This should find a change close to the time, either the change
+           before it or the change after it. */
+        change_num = icaltimezone_find_nearby_change(zone, &tt_change);
 
-    /* This should find a change close to the time, either the change before
-       it or the change after it. */
-    change_num = icaltimezone_find_nearby_change(zone, &tt_change);
-
-    /* Now move backwards or forwards to find the timezone change that applies
-       to tt. It should only have to do 1 or 2 steps. */
-    zone_change = icalarray_element_at(zone->changes, change_num);
-    step = 1;
-    found_change = 0;
-    change_num_to_use = -1;
-    for (;;) {
-        /* Copy the change and adjust it to UTC. */
-        tmp_change = *zone_change;
+        /* Now move backwards or forwards to find the timezone change that
+           applies to tt. It should only have to do 1 or 2 steps. */
+        zone_change = icalarray_element_at(zone->changes, change_num);
+        step = 1;
+        found_change = 0;
+        change_num_to_use = -1;
+        for (;;) {
+            /* Copy the change and adjust it to UTC. */
+            tmp_change = *zone_change;
+
+            /* If the given time is on or after this change, then this change
+               may apply, but we continue as a later change may be the right
+               one. If the given time is before this change, then if we have
+               already found a change which applies we can use that, else we
+               need to step backwards. */
+            if (icaltimezone_compare_change_fn(&tt_change, &tmp_change) >= 0) {
+                found_change = 1;
+                change_num_to_use = change_num;
+            } else {
+                step = -1;
+            }
 
-        /* If the given time is on or after this change, then this change may
-           apply, but we continue as a later change may be the right one.
-           If the given time is before this change, then if we have already
-           found a change which applies we can use that, else we need to step
-           backwards. */
-        if (icaltimezone_compare_change_fn(&tt_change, &tmp_change) >= 0) {
-            found_change = 1;
-            change_num_to_use = change_num;
-        } else {
-            step = -1;
-        }
+            /* If we are stepping backwards through the changes and we have
+               found a change that applies, then we know this is the change
+               to use so we exit the loop. */
+            if (step == -1 && found_change == 1)
+                break;
 
-        /* If we are stepping backwards through the changes and we have found
-           a change that applies, then we know this is the change to use so
-           we exit the loop. */
-        if (step == -1 && found_change == 1)
-            break;
+            /* If we go past the start of the changes array, then we have no
+               data for this time so we return the prev UTC offset. */
+            if (change_num == 0 && step < 0) {
+                if (is_daylight) {
+                    *is_daylight = ! tmp_change.is_daylight;
+                }
+
+                icaltimezone_changes_unlock();
 
-        /* If we go past the start of the changes array, then we have no data
-           for this time so we return the prev UTC offset. */
-        if (change_num == 0 && step < 0) {
-            if (is_daylight) {
-                *is_daylight = ! tmp_change.is_daylight;
+                return tmp_change.prev_utc_offset;
             }
 
-            icaltimezone_changes_unlock();
+            change_num += step;
 
-            return tmp_change.prev_utc_offset;
-        }
+            if (change_num >= zone->changes->num_elements)
+                break;
 
-        change_num += step;
+            zone_change = icalarray_element_at(zone->changes, change_num);
+        }
 
-        if (change_num >= zone->changes->num_elements)
-            break;
+        /* If we didn't find a change to use, then we have a bug! */
+        icalerror_assert(found_change == 1, "No applicable timezone change found");
 
-        zone_change = icalarray_element_at(zone->changes, change_num);
+        zone->last_utc_change = change_num_to_use;
     }
 
-    /* If we didn't find a change to use, then we have a bug! */
-    icalerror_assert(found_change == 1, "No applicable timezone change found");
+    if (cache) {
+        offset_cache_store(offset_cache_slot(cache->utc, zone), zone,
+                           change_num_to_use, 0);
+    }
 
     /* Now we know exactly which timezone change applies to the time, so
        we can return the UTC offset and whether it is a daylight time. */
@@ -1074,6 +1527,26 @@ static size_t icaltimezone_find_nearby_change(icaltimezone *zone, icaltimezonech
     lower = middle = 0;
     upper = zone->changes->num_elements;
 
+    /* Probe the packed key array when we have one - the search only
+       looks at the date fields, so there is no need to pull the full
+       structs through the cache. */
+    if (zone->change_keys) {
+        const int64_t key = icaltimezone_change_key(change);
+
+        while (lower < upper) {
+            middle = (lower + upper) / 2;
+            if (key == zone->change_keys[middle]) {
+                break;
+            } else if (key < zone->change_keys[middle]) {
+                upper = middle;
+            } else {
+                lower = middle + 1;
+            }
+        }
+
+        return middle;
+    }
+
     while (lower < upper) {
         middle = (lower + upper) / 2;
         zone_change = icalarray_element_at(zone->changes, middle);
@@ -1307,6 +1780,65 @@ void icaltimezone_array_free(icalarray *timezones)
  * BUILTIN TIMEZONE HANDLING
  */
 
+static unsigned int builtin_tz_index_hash(const char *location)
+{
+    unsigned int hash = 5381;
+
+    for (; *location; location++) {
+        hash = hash * 33 + (unsigned char)*location;
+    }
+
+    return hash % BUILTIN_TZ_INDEX_SIZE;
+}
+
+static void builtin_tz_index_add(icaltimezone *zone)
+{
+    const char *location = icaltimezone_get_location(zone);
+    struct builtin_tz_bucket *bucket;
+    unsigned int hash;
+
+    if (!location)
+        return;
+
+    bucket = (struct builtin_tz_bucket *)malloc(sizeof(struct builtin_tz_bucket));
+    if (!bucket)
+        return;
+
+    /* Fill in the bucket before hooking it into the chain, so unlocked
+       readers walking the chain only ever see complete entries. */
+    hash = builtin_tz_index_hash(location);
+    bucket->zone = zone;
+    bucket->next = builtin_tz_index[hash];
+    builtin_tz_index[hash] = bucket;
+}
+
+static icaltimezone *builtin_tz_index_find(const char *location)
+{
+    struct builtin_tz_bucket *bucket;
+
+    for (bucket = builtin_tz_index[builtin_tz_index_hash(location)];
+         bucket; bucket = bucket->next) {
+        if (strcmp(location, icaltimezone_get_location(bucket->zone)) == 0)
+            return bucket->zone;
+    }
+
+    return NULL;
+}
+
+static void builtin_tz_index_clear(void)
+{
+    int i;
+
+    for (i = 0; i < BUILTIN_TZ_INDEX_SIZE; i++) {
+        while (builtin_tz_index[i]) {
+            struct builtin_tz_bucket *bucket = builtin_tz_index[i];
+
+            builtin_tz_index[i] = bucket->next;
+            free(bucket);
+        }
+    }
+}
+
 icalarray *icaltimezone_get_builtin_timezones(void)
 {
     if (!builtin_timezones)
@@ -1317,6 +1849,7 @@ icalarray *icaltimezone_get_builtin_timezones(void)
 
 void icaltimezone_free_builtin_timezones(void)
 {
+    builtin_tz_index_clear();
     icaltimezone_array_free(builtin_timezones);
     builtin_timezones = 0;
 }
@@ -1325,8 +1858,6 @@ icaltimezone *icaltimezone_get_builtin_timezone(const char *location)
 {
     icalcomponent *comp;
     icaltimezone *zone;
-    size_t lower;
-    const char *zone_location;
 
     if (!location || !location[0])
         return NULL;
@@ -1337,34 +1868,11 @@ icaltimezone *icaltimezone_get_builtin_timezone(const char *location)
     if (strcmp(location, "UTC") == 0 || strcmp(location, "GMT") == 0)
         return &utc_timezone;
 
-#if 0
-    /* Do a simple binary search. */
-    lower = middle = 0;
-    upper = builtin_timezones->num_elements;
-
-    while (lower < upper) {
-        middle = (lower + upper) / 2;
-        zone = icalarray_element_at(builtin_timezones, middle);
-        zone_location = icaltimezone_get_location(zone);
-        cmp = strcmp(location, zone_location);
-        if (cmp == 0) {
-            return zone;
-        } else if (cmp < 0) {
-            upper = middle;
-        } else {
-            lower = middle + 1;
-        }
-    }
-#endif
-
     /* The zones from the system are not stored in alphabetical order,
-       so we just do a sequential search */
-    for (lower = 0; lower < builtin_timezones->num_elements; lower++) {
-        zone = icalarray_element_at(builtin_timezones, lower);
-        zone_location = icaltimezone_get_location(zone);
-        if (strcmp(location, zone_location) == 0)
-            return zone;
-    }
+       so we look them up in the hash index built at init time */
+    zone = builtin_tz_index_find(location);
+    if (zone)
+        return zone;
 
     /* Check whether file exists, but is not mentioned in zone.tab.
        It means it's a deprecated timezone, but still available. */
@@ -1374,8 +1882,20 @@ icaltimezone *icaltimezone_get_builtin_timezone(const char *location)
 
         icaltimezone_init(&tz);
         if (icaltimezone_set_component(&tz, comp)) {
-            icalarray_append(builtin_timezones, &tz);
-            return icalarray_element_at(builtin_timezones, builtin_timezones->num_elements - 1);
+            /* Append and index under the lock; another thread may have
+               fetched the same deprecated zone in the meantime. */
+            icaltimezone_builtin_lock();
+            zone = builtin_tz_index_find(location);
+            if (zone) {
+                icaltimezone_free(&tz, 0);
+            } else {
+                icalarray_append(builtin_timezones, &tz);
+                zone = icalarray_element_at(builtin_timezones,
+                                            builtin_timezones->num_elements - 1);
+                builtin_tz_index_add(zone);
+            }
+            icaltimezone_builtin_unlock();
+            return zone;
         } else {
             icalcomponent_free(comp);
         }
@@ -1624,9 +2144,114 @@ static int fetch_lat_long_from_string(const char *str,
     return 0;
 }
 
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+
+/* On-disk layout of the zones.dat sidecar; scripts/mkzonesdat.pl must
+   stay in sync. The table is written in the build host's byte order,
+   so a foreign-endian file fails the version check and we fall back
+   to parsing zones.tab. */
+#define ICALZONEDAT_MAGIC   "ICZT"
+#define ICALZONEDAT_VERSION 1
+
+struct icalzonedat_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t pool_size;
+};
+
+struct icalzonedat_entry
+{
+    double latitude;
+    double longitude;
+    uint32_t location;  /* offset into the string pool */
+    uint32_t reserved;
+};
+
+/** @brief Loads the builtin zone table from the binary zones.dat
+ * sidecar next to zones.tab, appending one icaltimezone per entry
+ * to @p zones.
+ *
+ * Returns 1 when the table was loaded, 0 when there is no usable
+ * sidecar and the caller should parse zones.tab instead. The location
+ * strings are copied out of the mapping, since each icaltimezone owns
+ * (and eventually frees) its location string.
+ */
+static int icaltimezone_parse_zone_dat(icalarray *zones, const char *zonedir)
+{
+    char *filename;
+    size_t filename_len, i;
+    int fd, ret = 0;
+    struct stat st;
+    const struct icalzonedat_header *header;
+    const struct icalzonedat_entry *entries;
+    const char *pool, *data;
+
+    filename_len = strlen(zonedir) + strlen(ZONES_DAT_FILENAME) + 2;
+    filename = (char *)malloc(filename_len);
+    if (!filename)
+        return 0;
+    snprintf(filename, filename_len, "%s/%s", zonedir, ZONES_DAT_FILENAME);
+
+    fd = open(filename, O_RDONLY);
+    free(filename);
+    if (fd < 0)
+        return 0;
+
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct icalzonedat_header)) {
+        close(fd);
+        return 0;
+    }
+
+    data = (const char *)mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return 0;
+
+    header = (const struct icalzonedat_header *)data;
+    if (memcmp(header->magic, ICALZONEDAT_MAGIC, 4) == 0 &&
+        header->version == ICALZONEDAT_VERSION &&
+        header->pool_size > 0 &&
+        header->count <= ((size_t)st.st_size) / sizeof(struct icalzonedat_entry) &&
+        (size_t)st.st_size == sizeof(*header) +
+            header->count * sizeof(struct icalzonedat_entry) + header->pool_size) {
+        entries = (const struct icalzonedat_entry *)(data + sizeof(*header));
+        pool = data + sizeof(*header) + header->count * sizeof(struct icalzonedat_entry);
+
+        /* A terminated pool guarantees every in-range offset yields a
+           terminated string. */
+        if (pool[header->pool_size - 1] == '\0') {
+            for (i = 0; i < header->count; i++) {
+                icaltimezone zone;
+
+                if (entries[i].location >= header->pool_size)
+                    continue;
+
+                icaltimezone_init(&zone);
+                zone.location = strdup(pool + entries[i].location);
+                zone.latitude = entries[i].latitude;
+                zone.longitude = entries[i].longitude;
+                icalarray_append(zones, &zone);
+            }
+            ret = 1;
+        }
+    }
+
+    (void)munmap((void *)data, (size_t)st.st_size);
+
+    return ret;
+}
+
+#endif
+
 /** @brief Parses the zones.tab file containing the names and locations
  * of the builtin timezones.
  *
+ * When the builtin zoneinfo directory carries the binary zones.dat
+ * sidecar, the table is bulk-loaded from it instead and no text is
+ * parsed at all.
+ *
  * It creates the builtin_timezones array
  * which is an icalarray of icaltimezone structs. It only fills in the
  * location, latitude and longtude fields; the rest are left
@@ -1641,14 +2266,41 @@ static void icaltimezone_parse_zone_tab(void)
     FILE *fp;
     char buf[1024];     /* Used to store each line of zones.tab as it is read. */
     char location[1024];        /* Stores the city name when parsing buf. */
-    size_t filename_len;
+    size_t filename_len, i;
     int latitude_degrees = 0, latitude_minutes = 0, latitude_seconds = 0;
     int longitude_degrees = 0, longitude_minutes = 0, longitude_seconds = 0;
     icaltimezone zone;
+    icalarray *zones;
 
     icalerror_assert(builtin_timezones == NULL, "Parsing zones.tab file multiple times");
 
-    builtin_timezones = icalarray_new(sizeof(icaltimezone), 1024);
+    /* Build into a local array and assign the global pointer only once
+       the array is fully populated and indexed, so threads that check
+       builtin_timezones without the lock never see a half-built table.
+       Error paths still publish the (empty) array, since callers treat
+       a non-NULL pointer as "initialization done". */
+    zones = icalarray_new(sizeof(icaltimezone), 1024);
+
+#if defined(ICAL_EMBED_TZDATA)
+    if (use_builtin_tzdata) {
+        /* The zones.tab data is compiled into the library; no file to
+           read or parse. */
+        for (i = 0; i < ical_embedded_zones_count; i++) {
+            icaltimezone_init(&zone);
+            zone.location = strdup(ical_embedded_zones[i].location);
+            zone.latitude = ical_embedded_zones[i].latitude;
+            zone.longitude = ical_embedded_zones[i].longitude;
+            icalarray_append(zones, &zone);
+        }
+
+        for (i = 0; i < zones->num_elements; i++) {
+            builtin_tz_index_add(icalarray_element_at(zones, i));
+        }
+
+        builtin_timezones = zones;
+        return;
+    }
+#endif
 
     if (!use_builtin_tzdata) {
         zonedir = icaltzutil_get_zone_directory();
@@ -1658,6 +2310,19 @@ static void icaltimezone_parse_zone_tab(void)
         zonetab = ZONES_TAB_FILENAME;
     }
 
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+    /* Prefer the binary sidecar generated from zones.tab at build time:
+       one mmap and a bulk copy instead of a line-by-line text parse. */
+    if (use_builtin_tzdata && zonedir && icaltimezone_parse_zone_dat(zones, zonedir)) {
+        for (i = 0; i < zones->num_elements; i++) {
+            builtin_tz_index_add(icalarray_element_at(zones, i));
+        }
+
+        builtin_timezones = zones;
+        return;
+    }
+#endif
+
     filename_len = 0;
     if (zonedir) {
         filename_len = strlen(zonedir);
@@ -1666,6 +2331,7 @@ static void icaltimezone_parse_zone_tab(void)
     icalerror_assert(filename_len > 0, "Unable to locate a zoneinfo dir");
     if (filename_len == 0) {
         icalerror_set_errno(ICAL_INTERNAL_ERROR);\
+        builtin_timezones = zones;
         return;
     }
 
@@ -1675,6 +2341,7 @@ static void icaltimezone_parse_zone_tab(void)
     filename = (char *)malloc(filename_len);
     if (!filename) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        builtin_timezones = zones;
         return;
     }
     snprintf(filename, filename_len, "%s/%s", zonedir, zonetab);
@@ -1684,6 +2351,7 @@ static void icaltimezone_parse_zone_tab(void)
     icalerror_assert(fp, "Cannot open the zonetab file for reading");
     if (!fp) {
         icalerror_set_errno(ICAL_INTERNAL_ERROR);
+        builtin_timezones = zones;
         return;
     }
 
@@ -1751,7 +2419,7 @@ static void icaltimezone_parse_zone_tab(void)
                 (double)longitude_seconds / 3600;
         }
 
-        icalarray_append(builtin_timezones, &zone);
+        icalarray_append(zones, &zone);
 
 #if 0
         printf("Found zone: %s %f %f\n", location, zone.latitude, zone.longitude);
@@ -1759,6 +2427,13 @@ static void icaltimezone_parse_zone_tab(void)
     }
 
     fclose(fp);
+
+    /* Index the zones by location for icaltimezone_get_builtin_timezone() */
+    for (i = 0; i < zones->num_elements; i++) {
+        builtin_tz_index_add(icalarray_element_at(zones, i));
+    }
+
+    builtin_timezones = zones;
 }
 
 void icaltimezone_release_zone_tab(void)
@@ -1769,6 +2444,7 @@ void icaltimezone_release_zone_tab(void)
     if (builtin_timezones == NULL)
         return;
 
+    builtin_tz_index_clear();
     builtin_timezones = NULL;
     for (i = 0; i < mybuiltin_timezones->num_elements; i++) {
         free(((icaltimezone *) icalarray_element_at(mybuiltin_timezones, i))->location);
@@ -1776,79 +2452,176 @@ void icaltimezone_release_zone_tab(void)
     icalarray_free(mybuiltin_timezones);
 }
 
+#if defined(ICAL_EMBED_TZDATA)
+/** @brief bsearch() comparator for the embedded zone table. */
+static int icaltimezone_embedded_zone_compare(const void *key, const void *elem)
+{
+    return strcmp((const char *)key,
+                  ((const struct ical_embedded_zone *)elem)->location);
+}
+#endif
+
+/** @brief Parses a VTIMEZONE .ics file into a component.
+ *
+ * Where possible the file is mapped into memory and handed to the
+ * parser in one piece rather than read line by line, which roughly
+ * halves first-touch latency for a zone.
+ */
+static icalcomponent *icaltimezone_parse_zone_file(const char *filename)
+{
+    icalcomponent *comp = NULL;
+    FILE *fp;
+    icalparser *parser;
+
+#if defined(HAVE_UNISTD_H) && !defined(_WIN32)
+    struct stat st;
+    long pagesize = sysconf(_SC_PAGESIZE);
+    int fd = open(filename, O_RDONLY);
+
+    if (fd >= 0) {
+        /* The parser needs a NUL terminator, which the mapping only
+           provides when the file does not end exactly on a page
+           boundary; the rare zone file that does falls through to the
+           stdio path below. */
+        if (fstat(fd, &st) == 0 && st.st_size > 0 &&
+            pagesize > 0 && (st.st_size % pagesize) != 0) {
+            void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+            if (data != MAP_FAILED) {
+                comp = icalparser_parse_string((const char *)data);
+                (void)munmap(data, (size_t)st.st_size);
+                close(fd);
+                return comp;
+            }
+        }
+        close(fd);
+    }
+#endif
+
+    fp = fopen(filename, "r");
+    if (!fp) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return NULL;
+    }
+
+    parser = icalparser_new();
+    icalparser_set_gen_data(parser, fp);
+    comp = icalparser_parse(parser, icaltimezone_load_get_line_fn);
+    icalparser_free(parser);
+    fclose(fp);
+
+    return comp;
+}
+
 /** @brief Loads the builtin VTIMEZONE data for the given timezone. */
-static void icaltimezone_load_builtin_timezone(icaltimezone *zone)
+static void icaltimezone_load_builtin_timezone_body(icaltimezone *zone)
 {
     icalcomponent *comp = 0, *subcomp;
+    char *location;
 
-    /* Prevent blocking on mutex lock caused by recursive calls */
-    if (zone->component)
-        return;
-
+    /* Take a private copy of the location: the zone's own string is
+       replaced when a loader publishes its result. */
     icaltimezone_builtin_lock();
-
-    /* If the location isn't set, it isn't a builtin timezone. */
-    if (!zone->location || !zone->location[0]) {
+    if (zone->component || !zone->location || !zone->location[0]) {
+        /* Already loaded by another thread, or not a builtin timezone. */
         icaltimezone_builtin_unlock();
         return;
     }
+    location = strdup(zone->location);
+    icaltimezone_builtin_unlock();
 
+    if (!location) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return;
+    }
+
+    /* Parse the VTIMEZONE data without holding the lock, so different
+       zones can be loaded concurrently. */
     if (use_builtin_tzdata) {
-        char *filename;
-        size_t filename_len;
-        FILE *fp;
-        icalparser *parser;
+#if defined(ICAL_EMBED_TZDATA)
+        /* The VTIMEZONE data is compiled into the library; parse it
+           straight from the embedded table. */
+        const struct ical_embedded_zone *embedded =
+            bsearch(location, ical_embedded_zones, ical_embedded_zones_count,
+                    sizeof(struct ical_embedded_zone), icaltimezone_embedded_zone_compare);
+
+        if (embedded) {
+            comp = icalparser_parse_string(embedded->vtimezone);
+        }
+#endif
 
-        filename_len = strlen(get_zone_directory()) + strlen(zone->location) + 6;
+        if (!comp) {
+            char *filename;
+            size_t filename_len;
 
-        filename = (char *)malloc(filename_len);
-        if (!filename) {
-            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-            goto out;
-        }
+            filename_len = strlen(get_zone_directory()) + strlen(location) + 6;
 
-        snprintf(filename, filename_len, "%s/%s.ics", get_zone_directory(), zone->location);
+            filename = (char *)malloc(filename_len);
+            if (!filename) {
+                icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+                free(location);
+                return;
+            }
 
-        fp = fopen(filename, "r");
-        free(filename);
-        if (!fp) {
-            icalerror_set_errno(ICAL_FILE_ERROR);
-            goto out;
-        }
+            snprintf(filename, filename_len, "%s/%s.ics", get_zone_directory(), location);
 
-        /* ##### B.# Sun, 11 Nov 2001 04:04:29 +1100
-           this is where the MALFORMEDDATA error is being set, after the call to 'icalparser_parse'
-           fprintf(stderr, "** WARNING ** %s: %d %s\n",
-                   __FILE__, __LINE__, icalerror_strerror(icalerrno));
-         */
+            /* ##### B.# Sun, 11 Nov 2001 04:04:29 +1100
+               this is where the MALFORMEDDATA error is being set, after the call to 'icalparser_parse'
+               fprintf(stderr, "** WARNING ** %s: %d %s\n",
+                       __FILE__, __LINE__, icalerror_strerror(icalerrno));
+             */
 
-        parser = icalparser_new();
-        icalparser_set_gen_data(parser, fp);
-        comp = icalparser_parse(parser, icaltimezone_load_get_line_fn);
-        icalparser_free(parser);
-        fclose(fp);
+            comp = icaltimezone_parse_zone_file(filename);
+            free(filename);
+        }
 
         /* Find the VTIMEZONE component inside the VCALENDAR. There should be 1. */
         subcomp = icalcomponent_get_first_component(comp, ICAL_VTIMEZONE_COMPONENT);
     } else {
-        subcomp = icaltzutil_fetch_timezone(zone->location);
+        subcomp = icaltzutil_fetch_timezone(location);
     }
 
+    free(location);
+
     if (!subcomp) {
         icalerror_set_errno(ICAL_PARSE_ERROR);
-        goto out;
+        if (comp) {
+            icalcomponent_free(comp);
+        }
+        return;
     }
 
-    icaltimezone_get_vtimezone_properties(zone, subcomp);
-
     if (use_builtin_tzdata) {
         icalcomponent_remove_component(comp, subcomp);
         icalcomponent_free(comp);
     }
 
-  out:
+    /* Publish under the lock; if another loader won the race in the
+       meantime, discard our copy. */
+    icaltimezone_builtin_lock();
+    if (zone->component ||
+        !icaltimezone_get_vtimezone_properties(zone, subcomp)) {
+        icalcomponent_free(subcomp);
+    }
     icaltimezone_builtin_unlock();
-    return;
+}
+
+static void icaltimezone_load_builtin_timezone(icaltimezone *zone)
+{
+    ical_trace_timer trace_t;
+
+    /* Once the component pointer is published the zone is fully
+       initialized, so loaded zones never touch the lock. This also
+       prevents blocking on the mutex lock caused by recursive calls. */
+    if (zone->component)
+        return;
+
+    /* Time actual loads only, not the already-loaded fast path above */
+    trace_t = ical_trace_timer_start();
+
+    icaltimezone_load_builtin_timezone_body(zone);
+
+    ical_trace_point_hit(ICAL_TRACE_TIMEZONE_LOAD, trace_t);
 }
 
 /** @brief Callback used from icalparser_parse() */
@@ -1857,6 +2630,87 @@ static char *icaltimezone_load_get_line_fn(char *s, size_t size, void *data)
     return fgets(s, (int)size, (FILE *) data);
 }
 
+#if defined(HAVE_PTHREAD)
+
+struct icaltimezone_prefetch_data
+{
+    icaltimezone **zones;
+    size_t count;
+};
+
+static void *icaltimezone_prefetch_worker(void *data)
+{
+    struct icaltimezone_prefetch_data *prefetch = (struct icaltimezone_prefetch_data *)data;
+    size_t i;
+
+    for (i = 0; i < prefetch->count; i++) {
+        icaltimezone_load_builtin_timezone(prefetch->zones[i]);
+    }
+
+    free(prefetch->zones);
+    free(prefetch);
+
+    return NULL;
+}
+
+#endif
+
+void icaltimezone_prefetch_builtin_timezones(const char *const *locations, size_t count)
+{
+    icaltimezone **zones;
+    size_t i, num_zones = 0;
+
+    icalerror_check_arg_rv(locations != 0, "locations");
+
+    zones = (icaltimezone **) malloc(count * sizeof(icaltimezone *));
+    if (!zones) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return;
+    }
+
+    /* Resolve the locations here so the lookup index and the builtin
+       zone array are fully initialized before any thread is spawned. */
+    for (i = 0; i < count; i++) {
+        icaltimezone *zone = icaltimezone_get_builtin_timezone(locations[i]);
+
+        if (zone && zone != &utc_timezone && !zone->component) {
+            zones[num_zones++] = zone;
+        }
+    }
+
+    if (num_zones == 0) {
+        free(zones);
+        return;
+    }
+
+#if defined(HAVE_PTHREAD)
+    {
+        struct icaltimezone_prefetch_data *prefetch;
+        pthread_t thread;
+
+        prefetch = (struct icaltimezone_prefetch_data *)
+            malloc(sizeof(struct icaltimezone_prefetch_data));
+        if (prefetch) {
+            prefetch->zones = zones;
+            prefetch->count = num_zones;
+
+            if (pthread_create(&thread, NULL, icaltimezone_prefetch_worker, prefetch) == 0) {
+                pthread_detach(thread);
+                return;
+            }
+
+            free(prefetch);
+        }
+    }
+#endif
+
+    /* No threads available; load the zones before returning. */
+    for (i = 0; i < num_zones; i++) {
+        icaltimezone_load_builtin_timezone(zones[i]);
+    }
+    free(zones);
+}
+
 /*
  * DEBUGGING
  */
@@ -77,6 +77,24 @@ LIBICAL_ICAL_EXPORT icalarray *icaltimezone_get_builtin_timezones(void);
 /** @brief Returns a single builtin timezone, given its Olson city name. */
 LIBICAL_ICAL_EXPORT icaltimezone *icaltimezone_get_builtin_timezone(const char *location);
 
+/** @brief Loads the VTIMEZONE data of the given builtin timezones in
+ * the background.
+ *
+ * @param locations an array of Olson city names, e.g. "Europe/Berlin"
+ * @param count the number of entries in @p locations
+ *
+ * Loading and parsing a zone's VTIMEZONE data on first use can stall
+ * the first request touching it. Applications that know which zones
+ * they are about to use can call this up front; the zones are loaded
+ * on a background thread (or synchronously when the library is built
+ * without thread support) and later lookups find them ready. Unknown
+ * locations and already-loaded zones are skipped.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void icaltimezone_prefetch_builtin_timezones(const char *const *locations,
+                                                                 size_t count);
+
 /** @brief Returns a single builtin timezone, given its offset from UTC. */
 LIBICAL_ICAL_EXPORT icaltimezone *icaltimezone_get_builtin_timezone_from_offset(int offset,
                                                                                 const char *tzname);
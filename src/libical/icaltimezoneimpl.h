@@ -19,6 +19,8 @@
 #ifndef ICALTIMEZONEIMPL_H
 #define ICALTIMEZONEIMPL_H
 
+#include <stdint.h>
+
 struct _icaltimezone
 {
     char *tzid;
@@ -57,6 +59,11 @@ struct _icaltimezone
        expanded timezone changes data is shared between calendar
        components. */
 
+    int start_year;
+    /**< The first year covered by the expanded changes data. Changes
+       before this year are collapsed into a single baseline entry; a
+       lookup for an earlier year re-expands with a wider window. */
+
     int end_year;
     /**< This is the last year for which we have expanded the data to.
        If we need to calculate a date past this we need to expand the
@@ -66,6 +73,20 @@ struct _icaltimezone
     /**< A dynamically-allocated array of time zone changes, sorted by the
        time of the change in local time. So we can do fast binary-searches
        to convert from local time to UTC. */
+
+    int64_t *change_keys;
+    /**< A parallel array with one packed, sortable time key per entry
+       of changes. The binary search probes these 8-byte keys instead of
+       pulling the full icaltimezonechange structs through the cache.
+       May be NULL, in which case the search falls back to comparing the
+       structs. */
+
+    size_t last_local_change;
+    size_t last_utc_change;
+    /**< Index into changes of the change that answered the previous
+       local-to-UTC resp. UTC-to-local offset lookup. Conversions in a
+       batch tend to fall in the same DST interval, so the cached change
+       is validated and reused before binary-searching again. */
 };
 
 #endif /*ICALTIMEZONE_IMPL */
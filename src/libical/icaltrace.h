@@ -0,0 +1,116 @@
+/*======================================================================
+ FILE: icaltrace.h
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+======================================================================*/
+
+/**
+ * @file icaltrace.h
+ * @brief Lightweight tracepoints on the library's hot paths.
+ *
+ * Production flamegraphs only show function names; the tracepoints
+ * record how often the expensive boundaries are crossed — parsing,
+ * serialization, recurrence iteration, timezone loads, fileset
+ * commits — and how long each crossing took.
+ *
+ * The instrumentation is compiled out unless the library is built with
+ * `-DICAL_ENABLE_TRACE=true`, in which case it costs one clock read per
+ * boundary plus a counter bump, and fires USDT probes (where `sys/sdt.h`
+ * is available) and an optional per-process callback. The query
+ * functions below exist in every build; without the flag they simply
+ * report zero events.
+ *
+ * @since 3.1.0
+ */
+
+#ifndef ICALTRACE_H
+#define ICALTRACE_H
+
+#include "libical_ical_export.h"
+
+/** The instrumented boundaries. */
+typedef enum ical_trace_point
+{
+    ICAL_TRACE_PARSE_COMPONENT = 0,
+    ICAL_TRACE_SERIALIZE_COMPONENT,
+    ICAL_TRACE_RECUR_ITERATOR_NEW,
+    ICAL_TRACE_RECUR_ITERATOR_NEXT,
+    ICAL_TRACE_TIMEZONE_LOAD,
+    ICAL_TRACE_FILESET_COMMIT,
+    ICAL_TRACE_POINT_COUNT
+} ical_trace_point;
+
+/**
+ * @typedef ical_trace_fn
+ * @brief Called once per event with the tracepoint, the duration of the
+ * crossing in nanoseconds and the pointer given at registration.
+ *
+ * The callback runs on whichever thread crossed the boundary and must
+ * not call back into the traced paths.
+ */
+typedef void (*ical_trace_fn) (ical_trace_point point, long long duration_ns, void *user);
+
+/**
+ * @brief Installs the trace callback; pass `NULL` to remove it.
+ * @since 3.1.0
+ *
+ * Only one callback is held. In builds without ICAL_ENABLE_TRACE the
+ * callback is stored but never fires.
+ */
+LIBICAL_ICAL_EXPORT void ical_trace_set_callback(ical_trace_fn fn, void *user);
+
+/**
+ * @brief Returns a stable name for the tracepoint, e.g.
+ * "parse-component", suitable for labeling probe output.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT const char *ical_trace_point_name(ical_trace_point point);
+
+/**
+ * @brief Returns how many times the tracepoint fired since start or the
+ * last reset; always 0 in builds without ICAL_ENABLE_TRACE.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT unsigned long ical_trace_get_count(ical_trace_point point);
+
+/** @brief Resets all tracepoint counters to zero.
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT void ical_trace_reset_counts(void);
+
+/* The pieces below are what the library's own translation units use to
+   plant tracepoints; they are not meant to be called directly. When the
+   build flag is off the timer degrades to a dead local and the hit to a
+   cast, so instrumented functions cost nothing. */
+
+LIBICAL_ICAL_EXPORT long long ical_trace_clock(void);
+
+LIBICAL_ICAL_EXPORT void ical_trace_hit(ical_trace_point point, long long duration_ns);
+
+#if !defined(ICAL_ENABLE_TRACE)
+#define ICAL_ENABLE_TRACE 0
+#endif
+
+#if ICAL_ENABLE_TRACE == 1
+typedef long long ical_trace_timer;
+
+#define ical_trace_timer_start() ical_trace_clock()
+#define ical_trace_point_hit(point, timer) \
+    ical_trace_hit((point), ical_trace_clock() - (timer))
+#else
+typedef int ical_trace_timer;
+
+#define ical_trace_timer_start() 0
+#define ical_trace_point_hit(point, timer) ((void)(timer))
+#endif
+
+#endif /* !ICALTRACE_H */
@@ -26,6 +26,8 @@
 #include "icaltimezone.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include <limits.h>
 
 #if defined(sun) && defined(__SVR4)
@@ -157,6 +159,19 @@ static int decode(const void *ptr)
     }
 }
 
+static int64_t decode64(const void *ptr)
+{
+    const unsigned char *p = ptr;
+    int i;
+    int64_t result = *p & (1 << (CHAR_BIT - 1)) ? ~0 : 0;
+
+    for (i = 0; i < 8; i++) {
+        result = (result << 8) | *p++;
+    }
+
+    return result;
+}
+
 static char *zname_from_stridx(char *str, size_t idx)
 {
     size_t i;
@@ -692,3 +707,170 @@ icalcomponent *icaltzutil_fetch_timezone(const char *location)
 
     return tz_comp;
 }
+
+int icaltzutil_fetch_changes(const char *location,
+                             struct icaltzutil_change **changes, size_t *num_changes)
+{
+    tzinfo type_cnts;
+    size_t i, num_trans, num_types, num_chars, num_leaps, num_isstd, num_isgmt;
+    size_t size, trans_size;
+    const char *zonedir;
+    FILE *f = NULL;
+    char *full_path = NULL;
+    char *r_trans = NULL;
+    unsigned char *trans_idx = NULL;
+    char *r_types = NULL;
+    struct icaltzutil_change *result = NULL;
+    char header[5];
+    int prev_idx, idx;
+
+    icalerror_check_arg_rz((location != 0), "location");
+    icalerror_check_arg_rz((changes != 0), "changes");
+    icalerror_check_arg_rz((num_changes != 0), "num_changes");
+
+    *changes = NULL;
+    *num_changes = 0;
+
+    if (icaltimezone_get_builtin_tzdata()) {
+        return 0;
+    }
+
+    zonedir = icaltzutil_get_zone_directory();
+    if (!zonedir) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return 0;
+    }
+
+    size = strlen(zonedir) + strlen(location) + 2;
+    full_path = (char *)malloc(size);
+    if (full_path == NULL) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        goto error;
+    }
+    snprintf(full_path, size, "%s/%s", zonedir, location);
+    if ((f = fopen(full_path, "rb")) == 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        goto error;
+    }
+
+    EFREAD(header, 5, 1, f);
+    if (memcmp(header, "TZif", 4) != 0) {
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        goto error;
+    }
+
+    if (fseek(f, 20, SEEK_SET) != 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        goto error;
+    }
+    EFREAD(&type_cnts, 24, 1, f);
+
+    num_isgmt = (size_t)decode(type_cnts.ttisgmtcnt);
+    num_isstd = (size_t)decode(type_cnts.ttisstdcnt);
+    num_leaps = (size_t)decode(type_cnts.leapcnt);
+    num_trans = (size_t)decode(type_cnts.timecnt);
+    num_types = (size_t)decode(type_cnts.typecnt);
+    num_chars = (size_t)decode(type_cnts.charcnt);
+
+    if (header[4] >= '2') {
+        /* Version 2+ files carry the full 64-bit transition table after
+           the 32-bit one; skip the 32-bit block and its header and read
+           the counts of the 64-bit block. */
+        long skip = (long)(num_trans * 5 + num_types * 6 + num_chars +
+                           num_leaps * 8 + num_isstd + num_isgmt);
+
+        if (fseek(f, skip, SEEK_CUR) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            goto error;
+        }
+        EFREAD(header, 5, 1, f);
+        if (memcmp(header, "TZif", 4) != 0) {
+            icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+            goto error;
+        }
+        if (fseek(f, 15, SEEK_CUR) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            goto error;
+        }
+        EFREAD(&type_cnts, 24, 1, f);
+        num_trans = (size_t)decode(type_cnts.timecnt);
+        num_types = (size_t)decode(type_cnts.typecnt);
+        trans_size = 8;
+    } else {
+        trans_size = 4;
+    }
+
+    if (num_types == 0 || num_trans == 0) {
+        /* A fixed-offset zone has no transitions to report. */
+        goto error;
+    }
+
+    r_trans = (char *)malloc(num_trans * trans_size);
+    trans_idx = (unsigned char *)malloc(num_trans);
+    r_types = (char *)malloc(num_types * 6);
+    if (r_trans == NULL || trans_idx == NULL || r_types == NULL) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        goto error;
+    }
+    EFREAD(r_trans, trans_size, num_trans, f);
+    EFREAD(trans_idx, 1, num_trans, f);
+    EFREAD(r_types, 6, num_types, f);
+
+    for (i = 0; i < num_trans; i++) {
+        if (trans_idx[i] >= num_types) {
+            icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+            goto error;
+        }
+    }
+
+    result = (struct icaltzutil_change *)malloc(num_trans * sizeof(struct icaltzutil_change));
+    if (result == NULL) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        goto error;
+    }
+
+    /* Before the first transition the first type in the table applies. */
+    prev_idx = 0;
+    for (i = 0; i < num_trans; i++) {
+        int64_t when;
+
+        if (trans_size == 8) {
+            when = decode64(r_trans + i * 8);
+        } else {
+            when = decode(r_trans + i * 4);
+        }
+        if ((time_t)when != when) {
+            /* Transition not representable in this time_t; stop here. */
+            break;
+        }
+        idx = trans_idx[i];
+        result[i].transition = (time_t)when;
+        result[i].utc_offset = decode(r_types + idx * 6);
+        result[i].prev_utc_offset = decode(r_types + prev_idx * 6);
+        result[i].is_daylight = r_types[idx * 6 + 4] ? 1 : 0;
+        prev_idx = idx;
+    }
+    if (i == 0) {
+        goto error;
+    }
+
+    *changes = result;
+    *num_changes = i;
+    result = NULL;
+
+  error:
+    if (f)
+        fclose(f);
+    if (full_path)
+        free(full_path);
+    if (r_trans)
+        free(r_trans);
+    if (trans_idx)
+        free(trans_idx);
+    if (r_types)
+        free(r_types);
+    if (result)
+        free(result);
+
+    return *changes != NULL;
+}
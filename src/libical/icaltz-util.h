@@ -56,4 +56,33 @@ LIBICAL_ICAL_EXPORT void icaltzutil_set_zone_directory(const char *zonepath);
  */
 LIBICAL_ICAL_EXPORT icalcomponent *icaltzutil_fetch_timezone(const char *location);
 
+/**
+ * One UTC offset transition read straight from a TZif file.
+ * @since 3.1.0
+ */
+struct icaltzutil_change
+{
+    time_t transition;  /**< The UTC instant the new offset takes effect. */
+    int utc_offset;     /**< Offset to add to UTC after the transition, in seconds. */
+    int prev_utc_offset; /**< Offset in effect before the transition, in seconds. */
+    int is_daylight;    /**< Whether the new offset is daylight-saving time. */
+};
+
+/**
+ * Reads the transition table of the TZif file for @p location and
+ * returns it as an array of ::icaltzutil_change entries, without
+ * building or parsing any VTIMEZONE data. Version 2 and later files
+ * are read from their 64-bit transition block; version 1 files from
+ * the 32-bit one.
+ *
+ * @param location the zoneinfo location, e.g. "Europe/London"
+ * @param changes on success receives a malloc'd array the caller frees with free()
+ * @param num_changes on success receives the number of entries
+ * @return 1 on success, 0 on failure (also when builtin tzdata is in use)
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int icaltzutil_fetch_changes(const char *location,
+                                                 struct icaltzutil_change **changes,
+                                                 size_t *num_changes);
+
 #endif
@@ -0,0 +1,43 @@
+/*======================================================================
+ FILE: icaltzdata.h
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+
+ Declarations for the builtin timezone data compiled into the library
+ when ICAL_EMBED_TZDATA is enabled. The table itself is generated at
+ build time by scripts/mktzdata.pl from zones.tab and the zoneinfo
+ VTIMEZONE files.
+======================================================================*/
+
+#ifndef ICALTZDATA_H
+#define ICALTZDATA_H
+
+#include <stddef.h>
+
+struct ical_embedded_zone
+{
+    const char *location;
+    /**< The Olson city name, e.g. "Africa/Accra". */
+
+    double latitude;
+    double longitude;
+    /**< The coordinates of the city, in degrees, or 360 if unknown. */
+
+    const char *vtimezone;
+    /**< The full VCALENDAR text containing the zone's VTIMEZONE. */
+};
+
+/** Sorted by location, so it can be searched with bsearch(). */
+extern const struct ical_embedded_zone ical_embedded_zones[];
+extern const size_t ical_embedded_zones_count;
+
+#endif /* !ICALTZDATA_H */
@@ -25,6 +25,14 @@
 
 #include "icalvalue.h"
 #include "icalvalueimpl.h"
+#include "icalattachimpl.h"
+#include "icalproperty_p.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 #include "icalerror.h"
 #include "icalmemory.h"
 #include "icaltime.h"
@@ -42,7 +50,7 @@ LIBICAL_ICAL_EXPORT struct icalvalue_impl *icalvalue_new_impl(icalvalue_kind kin
     if (!icalvalue_kind_is_valid(kind))
         return NULL;
 
-    if ((v = (struct icalvalue_impl *)malloc(sizeof(struct icalvalue_impl))) == 0) {
+    if ((v = (struct icalvalue_impl *)icalmemory_pool_alloc(sizeof(struct icalvalue_impl))) == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
@@ -50,14 +58,69 @@ LIBICAL_ICAL_EXPORT struct icalvalue_impl *icalvalue_new_impl(icalvalue_kind kin
     strcpy(v->id, "val");
 
     v->kind = kind;
-    v->size = 0;
     v->parent = 0;
     v->x_value = 0;
+    v->resolved_time_valid = 0;
     memset(&(v->data), 0, sizeof(v->data));
 
     return v;
 }
 
+/* Heap copies of value strings carry a reference count ahead of the
+   characters, so clones share one copy and a private copy is
+   materialized only when a setter actually rewrites the value. The
+   count is not atomic: as elsewhere in the library, one icalvalue and
+   its clones may not be manipulated from several threads at once. */
+struct icalvalue_shared_string
+{
+    size_t refcount;
+};
+
+/**
+ * @private
+ */
+static struct icalvalue_shared_string *icalvalue_shared_string_header(const char *chars)
+{
+    return ((struct icalvalue_shared_string *)(void *)(char *)chars) - 1;
+}
+
+const char *icalvalue_strdup_value_string(struct icalvalue_impl *impl, const char *str)
+{
+    struct icalvalue_shared_string *hdr;
+    char *chars;
+    size_t len = strlen(str);
+
+    if (len < ICALVALUE_SMALL_STRING_SIZE) {
+        memcpy(impl->aux.small_string, str, len + 1);
+        return impl->aux.small_string;
+    }
+
+    hdr = (struct icalvalue_shared_string *)
+        icalmemory_new_buffer(sizeof(struct icalvalue_shared_string) + len + 1);
+    if (hdr == 0) {
+        return 0;
+    }
+
+    hdr->refcount = 1;
+    chars = (char *)(hdr + 1);
+    memcpy(chars, str, len + 1);
+
+    return chars;
+}
+
+void icalvalue_free_value_string(struct icalvalue_impl *impl)
+{
+    if (impl->data.v_string != 0 && impl->data.v_string != impl->aux.small_string) {
+        struct icalvalue_shared_string *hdr =
+            icalvalue_shared_string_header(impl->data.v_string);
+
+        if (--hdr->refcount == 0) {
+            icalmemory_free_buffer(hdr);
+        }
+    }
+    impl->data.v_string = 0;
+}
+
 icalvalue *icalvalue_new(icalvalue_kind kind)
 {
     return (icalvalue *) icalvalue_new_impl(kind);
@@ -75,7 +138,6 @@ icalvalue *icalvalue_clone(const icalvalue *old)
 
     strcpy(new->id, old->id);
     new->kind = old->kind;
-    new->size = old->size;
 
     switch (new->kind) {
     case ICAL_ATTACH_VALUE:
@@ -98,7 +160,14 @@ icalvalue *icalvalue_clone(const icalvalue *old)
     case ICAL_URI_VALUE:
         {
             if (old->data.v_string != 0) {
-                new->data.v_string = icalmemory_strdup(old->data.v_string);
+                if (old->data.v_string != old->aux.small_string) {
+                    /* Share the refcounted heap copy; a later set on
+                       either value materializes a private copy. */
+                    icalvalue_shared_string_header(old->data.v_string)->refcount++;
+                    new->data.v_string = old->data.v_string;
+                } else {
+                    new->data.v_string = icalvalue_strdup_value_string(new, old->data.v_string);
+                }
 
                 if (new->data.v_string == 0) {
                     new->parent = 0;
@@ -139,6 +208,19 @@ icalvalue *icalvalue_clone(const icalvalue *old)
             break;
         }
 
+    case ICAL_PERIODARRAY_VALUE:
+        {
+            if (old->data.v_periodarray.periods != 0) {
+                icalvalue_set_periodarray(new, old->data.v_periodarray);
+
+                if (new->data.v_periodarray.periods == 0) {
+                    icalvalue_free(new);
+                    return 0;
+                }
+            }
+            break;
+        }
+
     case ICAL_X_VALUE:
         {
             if (old->x_value != 0) {
@@ -174,7 +256,7 @@ icalvalue *icalvalue_new_clone(const icalvalue *old)
 static char *icalmemory_strdup_and_dequote(const char *str)
 {
     const char *p;
-    char *out = (char *)malloc(sizeof(char) * strlen(str) + 1);
+    char *out = (char *)icalmemory_new_buffer(sizeof(char) * strlen(str) + 1);
     char *pout;
     int wroteNull = 0;
 
@@ -261,14 +343,102 @@ static char *icalmemory_strdup_and_dequote(const char *str)
  * TSAFE-CHAR = %x20-21 / %x23-2B / %x2D-39 / %x3C-5B / %x5D-7E / NON-US-ASCII
  * As such, \t\r\b\f are not allowed, not even escaped
  */
+/* Returns a pointer to the first byte of [s,end) that the quoting
+   switch below has to look at - an escapable or trashed character -
+   or end if the whole range copies through unchanged. TAB is copied
+   literally, so it does not stop the scan. Vectorized where the
+   compiler advertises SSE2 or NEON, with the scalar loop as tail
+   handling and portable fallback. */
+static const char *scan_quotable(const char *s, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i vnl = _mm_set1_epi8('\n');
+    const __m128i vcr = _mm_set1_epi8('\r');
+    const __m128i vbs = _mm_set1_epi8('\b');
+    const __m128i vff = _mm_set1_epi8('\f');
+    const __m128i vsc = _mm_set1_epi8(';');
+    const __m128i vcm = _mm_set1_epi8(',');
+    const __m128i vbk = _mm_set1_epi8('\\');
+
+    while (s + 16 <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, vnl),
+                                      _mm_cmpeq_epi8(chunk, vcr)),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, vbs),
+                                      _mm_cmpeq_epi8(chunk, vff))),
+            _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, vsc),
+                                      _mm_cmpeq_epi8(chunk, vcm)),
+                         _mm_cmpeq_epi8(chunk, vbk)));
+        int mask = _mm_movemask_epi8(hits);
+
+        if (mask != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+            return s + __builtin_ctz((unsigned int)mask);
+#else
+            break;
+#endif
+        }
+        s += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t vnl = vdupq_n_u8('\n');
+    const uint8x16_t vcr = vdupq_n_u8('\r');
+    const uint8x16_t vbs = vdupq_n_u8('\b');
+    const uint8x16_t vff = vdupq_n_u8('\f');
+    const uint8x16_t vsc = vdupq_n_u8(';');
+    const uint8x16_t vcm = vdupq_n_u8(',');
+    const uint8x16_t vbk = vdupq_n_u8('\\');
+
+    while (s + 16 <= end) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)s);
+        uint8x16_t hits = vorrq_u8(
+            vorrq_u8(vorrq_u8(vceqq_u8(chunk, vnl), vceqq_u8(chunk, vcr)),
+                     vorrq_u8(vceqq_u8(chunk, vbs), vceqq_u8(chunk, vff))),
+            vorrq_u8(vorrq_u8(vceqq_u8(chunk, vsc), vceqq_u8(chunk, vcm)),
+                     vceqq_u8(chunk, vbk)));
+
+        if (vmaxvq_u8(hits) != 0) {
+            break;      /* the scalar loop below pins down the exact byte */
+        }
+        s += 16;
+    }
+#endif
+
+    while (s < end &&
+           *s != '\n' && *s != '\r' && *s != '\b' && *s != '\f' &&
+           *s != ';' && *s != ',' && *s != '\\') {
+        s++;
+    }
+
+    return s;
+}
+
+/* icalmemory_append_string() for a run of known length */
+static void append_run(char **buf, char **pos, size_t *buf_size, const char *run, size_t len)
+{
+    size_t data_len = (size_t)(*pos - *buf);
+
+    if (data_len + len + 1 >= *buf_size) {
+        *buf_size = (*buf_size) * 2 + data_len + len + 1;
+        *buf = (char *)icalmemory_resize_buffer(*buf, *buf_size);
+        *pos = *buf + data_len;
+    }
+
+    memcpy(*pos, run, len);
+    *pos += len;
+}
+
 static char *icalmemory_strdup_and_quote(const icalvalue *value, const char *unquoted_str)
 {
     char *str;
     char *str_p;
     const char *p;
+    const char *end;
     size_t buf_sz;
 
     buf_sz = strlen(unquoted_str) + 1;
+    end = unquoted_str + buf_sz - 1;
 
     str_p = str = (char *)icalmemory_new_buffer(buf_sz);
 
@@ -276,7 +446,17 @@ static char *icalmemory_strdup_and_quote(const icalvalue *value, const char *unq
         return 0;
     }
 
-    for (p = unquoted_str; *p != 0; p++) {
+    for (p = unquoted_str; *p != 0;) {
+
+        /* Bulk-copy the run up to the next character that needs the
+           switch; most TEXT payloads copy through in a few big runs */
+        const char *run_end = scan_quotable(p, end);
+
+        if (run_end > p) {
+            append_run(&str, &str_p, &buf_sz, p, (size_t)(run_end - p));
+            p = run_end;
+            continue;
+        }
 
         switch (*p) {
         case '\n':{
@@ -329,6 +509,8 @@ static char *icalmemory_strdup_and_quote(const icalvalue *value, const char *unq
                 icalmemory_append_char(&str, &str_p, &buf_sz, *p);
             }
         }
+
+        p++;
     }
 
     /* Assume the last character is not a '\0' and add one. We could
@@ -438,15 +620,143 @@ static void free_icalvalue_attach_data(char *data, void *user_data)
     free(data);
 }
 
+/* Specialized constructors for the hottest value kinds. They are
+   reached through the kind-indexed dispatch table below, so parsing a
+   DATE-TIME, TEXT, DURATION, INTEGER or PERIOD value skips the big
+   switch in icalvalue_new_from_string_with_error(); the switch keeps
+   equivalent cases that call the same functions, as the fallback for
+   a not-yet-populated table. */
+
+static icalvalue *icalvalue_parse_integer(icalvalue_kind kind, const char *str,
+                                          icalvalue_parse_error *error)
+{
+    _unused(kind);
+    _unused(error);
+    return icalvalue_new_integer(atoi(str));
+}
+
+static icalvalue *icalvalue_parse_text(icalvalue_kind kind, const char *str,
+                                       icalvalue_parse_error *error)
+{
+    char *dequoted_str = icalmemory_strdup_and_dequote(str);
+    icalvalue *value;
+
+    _unused(kind);
+    _unused(error);
+    value = icalvalue_new_text(dequoted_str);
+    icalmemory_free_buffer(dequoted_str);
+    return value;
+}
+
+static icalvalue *icalvalue_parse_time(icalvalue_kind kind, const char *str,
+                                       icalvalue_parse_error *error)
+{
+    struct icaltimetype tt;
+    struct icalvalue_impl *value;
+
+    tt = icaltime_from_string(str);
+    if (icaltime_is_null_time(tt)) {
+        if (error != 0) {
+            error->code = ICAL_MALFORMEDDATA_ERROR;
+            error->message = "could not parse as a date or date-time";
+        }
+        return 0;
+    }
+
+    value = icalvalue_new_impl(kind);
+    value->data.v_time = tt;
+    icalvalue_reset_kind(value);
+    return value;
+}
+
+static icalvalue *icalvalue_parse_duration(icalvalue_kind kind, const char *str,
+                                           icalvalue_parse_error *error)
+{
+    struct icaldurationtype dur = icaldurationtype_from_string(str);
+
+    _unused(kind);
+    if (icaldurationtype_is_bad_duration(dur)) {        /* failed to parse */
+        if (error != 0) {
+            error->code = ICAL_MALFORMEDDATA_ERROR;
+            error->message = "could not parse as a duration";
+        }
+        return 0;
+    }
+
+    return icalvalue_new_duration(dur);
+}
+
+static icalvalue *icalvalue_parse_period(icalvalue_kind kind, const char *str,
+                                         icalvalue_parse_error *error)
+{
+    struct icalperiodtype p;
+
+    _unused(kind);
+    p = icalperiodtype_from_string(str);
+    if (icalperiodtype_is_null_period(p)) {
+        if (error != 0) {
+            error->code = ICAL_MALFORMEDDATA_ERROR;
+            error->message = "could not parse as a period";
+        }
+        return 0;
+    }
+
+    return icalvalue_new_period(p);
+}
+
+typedef icalvalue *(*icalvalue_str_parser)(icalvalue_kind kind, const char *str,
+                                           icalvalue_parse_error *error);
+
+/** Dense table indexed by kind - ICAL_ANY_VALUE; a zero entry falls
+    back to the switch. Populated on first use with idempotent stores,
+    so a racing reader at worst takes the fallback. */
+#define ICALVALUE_PARSER_COUNT (ICAL_NO_VALUE - ICAL_ANY_VALUE + 1)
+static icalvalue_str_parser icalvalue_parsers[ICALVALUE_PARSER_COUNT];
+static int icalvalue_parsers_ready = 0;
+
+static void icalvalue_parsers_init(void)
+{
+    icalvalue_parsers[ICAL_INTEGER_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_integer;
+    icalvalue_parsers[ICAL_TEXT_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_text;
+    icalvalue_parsers[ICAL_DATE_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_time;
+    icalvalue_parsers[ICAL_DATETIME_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_time;
+    icalvalue_parsers[ICAL_DURATION_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_duration;
+    icalvalue_parsers[ICAL_PERIOD_VALUE - ICAL_ANY_VALUE] = icalvalue_parse_period;
+    icalvalue_parsers_ready = 1;
+}
+
 static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
-                                                       const char *str, icalproperty ** error)
+                                                       const char *str,
+                                                       icalvalue_parse_error *error)
 {
     struct icalvalue_impl *value = 0;
+    int parser_idx = (int)kind - ICAL_ANY_VALUE;
 
     icalerror_check_arg_rz(str != 0, "str");
 
     if (error != 0) {
-        *error = 0;
+        error->code = ICAL_NO_ERROR;
+        error->kind = kind;
+        error->message = 0;
+    }
+
+    if (parser_idx >= 0 && parser_idx < ICALVALUE_PARSER_COUNT) {
+        icalvalue_str_parser parse;
+
+        if (!icalvalue_parsers_ready) {
+            icalvalue_parsers_init();
+        }
+
+        parse = icalvalue_parsers[parser_idx];
+        if (parse != 0) {
+            value = (struct icalvalue_impl *)parse(kind, str, error);
+
+            if (error != 0 && error->code == ICAL_NO_ERROR && value == 0) {
+                error->code = ICAL_MALFORMEDDATA_ERROR;
+                error->message = "failed to parse value";
+            }
+            return value;
+        }
     }
 
     switch (kind) {
@@ -466,9 +776,19 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
 
     case ICAL_BINARY_VALUE:
         {
-            icalattach *attach;
+            icalattach *attach = 0;
+            size_t threshold = icalattach_get_spill_threshold();
+
+            /* Oversized inline content spills to a temp file so it does
+               not have to live in the component tree */
+            if (threshold > 0) {
+                size_t len = strlen(str);
 
-            attach = icalattach_new_from_data(strdup(str), free_icalvalue_attach_data, 0);
+                if (len >= threshold)
+                    attach = icalattach_new_spilled_from_data(str, len);
+            }
+            if (!attach)
+                attach = icalattach_new_from_data(strdup(str), free_icalvalue_attach_data, 0);
             if (!attach)
               break;
 
@@ -483,15 +803,8 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
             } else if (!strcmp(str, "FALSE")) {
                 value = icalvalue_new_boolean(0);
             } else if (error != 0) {
-                char temp[TMP_BUF_SIZE];
-                icalparameter *errParam;
-
-                snprintf(temp, sizeof(temp),
-                         "Could not parse %s as a %s property",
-                         str, icalvalue_kind_to_string(kind));
-                errParam = icalparameter_new_xlicerrortype(ICAL_XLICERRORTYPE_VALUEPARSEERROR);
-                *error = icalproperty_vanew_xlicerror(temp, errParam, 0);
-                icalparameter_free(errParam);
+                error->code = ICAL_MALFORMEDDATA_ERROR;
+                error->message = "BOOLEAN value is neither TRUE nor FALSE";
             }
             break;
         }
@@ -536,7 +849,7 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
         break;
 
     case ICAL_INTEGER_VALUE:
-        value = icalvalue_new_integer(atoi(str));
+        value = (struct icalvalue_impl *)icalvalue_parse_integer(kind, str, error);
         break;
 
     case ICAL_FLOAT_VALUE:
@@ -565,13 +878,8 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
         }
 
     case ICAL_TEXT_VALUE:
-        {
-            char *dequoted_str = icalmemory_strdup_and_dequote(str);
-
-            value = icalvalue_new_text(dequoted_str);
-            free(dequoted_str);
-            break;
-        }
+        value = (struct icalvalue_impl *)icalvalue_parse_text(kind, str, error);
+        break;
 
     case ICAL_STRING_VALUE:
         value = icalvalue_new_string(str);
@@ -619,15 +927,8 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
 
           geo_parsing_error:
             if (error != 0) {
-                char temp[TMP_BUF_SIZE];
-                icalparameter *errParam;
-
-                snprintf(temp, sizeof(temp),
-                         "Could not parse %s as a %s property",
-                         str, icalvalue_kind_to_string(kind));
-                errParam = icalparameter_new_xlicerrortype(ICAL_XLICERRORTYPE_VALUEPARSEERROR);
-                *error = icalproperty_vanew_xlicerror(temp, errParam, 0);
-                icalparameter_free(errParam);
+                error->code = ICAL_MALFORMEDDATA_ERROR;
+                error->message = "GEO value is not two ';'-separated doubles";
             }
         }
         break;
@@ -640,24 +941,14 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
             if (rt.freq != ICAL_NO_RECURRENCE) {
                 value = icalvalue_new_recur(rt);
             }
-            free(rt.rscale);
+            icalmemory_free_buffer(rt.rscale);
             break;
         }
 
     case ICAL_DATE_VALUE:
     case ICAL_DATETIME_VALUE:
-        {
-            struct icaltimetype tt;
-
-            tt = icaltime_from_string(str);
-            if (!icaltime_is_null_time(tt)) {
-                value = icalvalue_new_impl(kind);
-                value->data.v_time = tt;
-
-                icalvalue_reset_kind(value);
-            }
-            break;
-        }
+        value = (struct icalvalue_impl *)icalvalue_parse_time(kind, str, error);
+        break;
 
     case ICAL_DATETIMEPERIOD_VALUE:
         {
@@ -680,24 +971,68 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
         }
 
     case ICAL_DURATION_VALUE:
+        value = (struct icalvalue_impl *)icalvalue_parse_duration(kind, str, error);
+        break;
+
+    case ICAL_PERIOD_VALUE:
+        value = (struct icalvalue_impl *)icalvalue_parse_period(kind, str, error);
+        break;
+
+    case ICAL_PERIODARRAY_VALUE:
         {
-            struct icaldurationtype dur = icaldurationtype_from_string(str);
+            struct icalperiodarraytype pa = icalperiodarraytype_null_array();
+            const char *start = str;
+            size_t alloc = 0;
+            int bad = 0;
+
+            /* Comma-separated list of periods, per the RFC 5545 multi-value
+               syntax. An empty element or a malformed period fails the
+               whole value. */
+            for (;;) {
+                const char *comma = strchr(start, ',');
+                size_t len = comma ? (size_t)(comma - start) : strlen(start);
+                char temp[TMP_BUF_SIZE];
+                struct icalperiodtype p;
 
-            if (!icaldurationtype_is_bad_duration(dur)) {       /* failed to parse */
-                value = icalvalue_new_duration(dur);
-            }
+                if (len == 0 || len >= sizeof(temp)) {
+                    bad = 1;
+                    break;
+                }
 
-            break;
-        }
+                memcpy(temp, start, len);
+                temp[len] = '\0';
 
-    case ICAL_PERIOD_VALUE:
-        {
-            struct icalperiodtype p;
+                p = icalperiodtype_from_string(temp);
+                if (icalperiodtype_is_null_period(p)) {
+                    bad = 1;
+                    break;
+                }
 
-            p = icalperiodtype_from_string(str);
+                if (pa.num_periods == alloc) {
+                    struct icalperiodtype *block;
 
-            if (!icalperiodtype_is_null_period(p)) {
-                value = icalvalue_new_period(p);
+                    alloc = alloc == 0 ? 16 : alloc * 2;
+                    block = icalmemory_resize_buffer(pa.periods,
+                                                     alloc * sizeof(struct icalperiodtype));
+                    if (block == 0) {
+                        bad = 1;
+                        break;
+                    }
+                    pa.periods = block;
+                }
+                pa.periods[pa.num_periods++] = p;
+
+                if (comma == 0) {
+                    break;
+                }
+                start = comma + 1;
+            }
+
+            if (!bad && pa.num_periods > 0) {
+                value = icalvalue_new_periodarray(pa);
+            }
+            if (pa.periods != 0) {
+                icalmemory_free_buffer(pa.periods);
             }
             break;
         }
@@ -727,22 +1062,17 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
             char *dequoted_str = icalmemory_strdup_and_dequote(str);
 
             value = icalvalue_new_x(dequoted_str);
-            free(dequoted_str);
+            icalmemory_free_buffer(dequoted_str);
         }
         break;
 
     default:
         {
             char temp[TMP_BUF_SIZE];
-            icalparameter *errParam;
 
             if (error != 0) {
-
-                snprintf(temp, TMP_BUF_SIZE, "Unknown type for \'%s\'", str);
-
-                errParam = icalparameter_new_xlicerrortype(ICAL_XLICERRORTYPE_VALUEPARSEERROR);
-                *error = icalproperty_vanew_xlicerror(temp, errParam, 0);
-                icalparameter_free(errParam);
+                error->code = ICAL_BADARG_ERROR;
+                error->message = "unknown value type";
             }
 
             snprintf(temp, TMP_BUF_SIZE,
@@ -753,15 +1083,9 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
         }
     }
 
-    if (error != 0 && *error == 0 && value == 0) {
-        char temp[TMP_BUF_SIZE];
-        icalparameter *errParam;
-
-        snprintf(temp, TMP_BUF_SIZE, "Failed to parse value: \'%s\'", str);
-
-        errParam = icalparameter_new_xlicerrortype(ICAL_XLICERRORTYPE_VALUEPARSEERROR);
-        *error = icalproperty_vanew_xlicerror(temp, errParam, 0);
-        icalparameter_free(errParam);
+    if (error != 0 && error->code == ICAL_NO_ERROR && value == 0) {
+        error->code = ICAL_MALFORMEDDATA_ERROR;
+        error->message = "failed to parse value";
     }
 
     return value;
@@ -769,7 +1093,13 @@ static icalvalue *icalvalue_new_from_string_with_error(icalvalue_kind kind,
 
 icalvalue *icalvalue_new_from_string(icalvalue_kind kind, const char *str)
 {
-    return icalvalue_new_from_string_with_error(kind, str, (icalproperty **) 0);
+    return icalvalue_new_from_string_with_error(kind, str, (icalvalue_parse_error *)0);
+}
+
+icalvalue *icalvalue_new_from_string_with_desc(icalvalue_kind kind, const char *str,
+                                               icalvalue_parse_error *error)
+{
+    return icalvalue_new_from_string_with_error(kind, str, error);
 }
 
 void icalvalue_free(icalvalue *v)
@@ -781,7 +1111,7 @@ void icalvalue_free(icalvalue *v)
     }
 
     if (v->x_value != 0) {
-        free(v->x_value);
+        icalmemory_free_buffer(v->x_value);
     }
 
     switch (v->kind) {
@@ -800,21 +1130,26 @@ void icalvalue_free(icalvalue *v)
     case ICAL_STRING_VALUE:
     case ICAL_QUERY_VALUE:
         {
-            if (v->data.v_string != 0) {
-                free((void *)v->data.v_string);
-                v->data.v_string = 0;
-            }
+            icalvalue_free_value_string(v);
             break;
         }
     case ICAL_RECUR_VALUE:
         {
             if (v->data.v_recur != 0) {
-                free(v->data.v_recur->rscale);
-                free((void *)v->data.v_recur);
+                icalmemory_free_buffer(v->data.v_recur->rscale);
+                icalmemory_free_buffer((void *)v->data.v_recur);
                 v->data.v_recur = 0;
             }
             break;
         }
+    case ICAL_PERIODARRAY_VALUE:
+        {
+            if (v->data.v_periodarray.periods != 0) {
+                icalmemory_free_buffer(v->data.v_periodarray.periods);
+                v->data.v_periodarray = icalperiodarraytype_null_array();
+            }
+            break;
+        }
 
     default:
         {
@@ -823,11 +1158,10 @@ void icalvalue_free(icalvalue *v)
     }
 
     v->kind = ICAL_NO_VALUE;
-    v->size = 0;
     v->parent = 0;
     memset(&(v->data), 0, sizeof(v->data));
     v->id[0] = 'X';
-    free(v);
+    icalmemory_pool_free(v, sizeof(struct icalvalue_impl));
 }
 
 int icalvalue_is_valid(const icalvalue *value)
@@ -956,6 +1290,16 @@ static char *icalvalue_attach_as_ical_string_r(const icalvalue *value)
         str = icalmemory_new_buffer(strlen(url) + 1);
         strcpy(str, url);
         return str;
+    } else if (icalattach_get_is_file(a)) {
+        /* the encoded content is re-read from disk only for this
+           serialization and freed with the returned string */
+        str = icalattach_read_data_r(a);
+        if (str == 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            str = icalmemory_new_buffer(1);
+            str[0] = '\0';
+        }
+        return str;
     } else {
         const char *data = 0;
 
@@ -976,34 +1320,88 @@ static char *icalvalue_duration_as_ical_string_r(const icalvalue *value)
     return icaldurationtype_as_ical_string_r(data);
 }
 
+/* Date and time values are rendered on every DTSTART/DTEND/DTSTAMP, and
+   snprintf's format-string machinery dominates that path. Emit the
+   fixed-width digit fields through a two-digit pair table instead. */
+static const char digit_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/* Writes v (0-99) as exactly two digits and returns the advanced cursor */
+static char *append_digit_pair(char *p, int v)
+{
+    memcpy(p, &digit_pairs[v * 2], 2);
+    return p + 2;
+}
+
 static void print_time_to_string(char *str, const struct icaltimetype *data)
 {       /* this function is a candidate for a library-wide external function
            except it isn't used any place outside of icalvalue.c.
            see print_date_to_string() and print_datetime_to_string in icalvalue.h */
-    char temp[20];
+    char *p = str;
 
     str[0] = '\0';
 
     if (data != 0) {
+        if (data->hour < 0 || data->hour > 99 ||
+            data->minute < 0 || data->minute > 99 ||
+            data->second < 0 || data->second > 99) {
+            /* out-of-range fields take the old printf path so malformed
+               times still render the way they used to */
+            char temp[20];
+
+            if (icaltime_is_utc(*data)) {
+                snprintf(temp, sizeof(temp), "%02d%02d%02dZ",
+                         data->hour, data->minute, data->second);
+                strncat(str, temp, 7);
+            } else {
+                snprintf(temp, sizeof(temp), "%02d%02d%02d",
+                         data->hour, data->minute, data->second);
+                strncat(str, temp, 6);
+            }
+            return;
+        }
+
+        p = append_digit_pair(p, data->hour);
+        p = append_digit_pair(p, data->minute);
+        p = append_digit_pair(p, data->second);
         if (icaltime_is_utc(*data)) {
-            snprintf(temp, sizeof(temp), "%02d%02d%02dZ", data->hour, data->minute, data->second);
-            strncat(str, temp, 7);
-        } else {
-            snprintf(temp, sizeof(temp), "%02d%02d%02d", data->hour, data->minute, data->second);
-            strncat(str, temp, 6);
+            *p++ = 'Z';
         }
+        *p = '\0';
     }
 }
 
 void print_date_to_string(char *str, const struct icaltimetype *data)
 {
-    char temp[20];
+    char *p = str;
 
     str[0] = '\0';
 
     if (data != 0) {
-        snprintf(temp, sizeof(temp), "%04d%02d%02d", data->year, data->month, data->day);
-        strncat(str, temp, 8);
+        if (data->year < 0 || data->year > 9999 ||
+            data->month < 0 || data->month > 99 ||
+            data->day < 0 || data->day > 99) {
+            char temp[20];
+
+            snprintf(temp, sizeof(temp), "%04d%02d%02d", data->year, data->month, data->day);
+            strncat(str, temp, 8);
+            return;
+        }
+
+        p = append_digit_pair(p, data->year / 100);
+        p = append_digit_pair(p, data->year % 100);
+        p = append_digit_pair(p, data->month);
+        p = append_digit_pair(p, data->day);
+        *p = '\0';
     }
 }
 
@@ -1025,17 +1423,15 @@ static char *icalvalue_date_as_ical_string_r(const icalvalue *value)
 
 void print_datetime_to_string(char *str, const struct icaltimetype *data)
 {
-    char temp[20];
-
     str[0] = '\0';
 
     if (data != 0) {
         print_date_to_string(str, data);
         if (!data->is_date) {
-            strncat(str, "T", 19);
-            temp[0] = '\0';
-            print_time_to_string(temp, data);
-            strncat(str, temp, 19);
+            char *p = str + strlen(str);
+
+            *p++ = 'T';
+            print_time_to_string(p, data);
         }
     }
 }
@@ -1139,6 +1535,34 @@ static char *icalvalue_period_as_ical_string_r(const icalvalue *value)
     return icalperiodtype_as_ical_string_r(data);
 }
 
+static char *icalvalue_periodarray_as_ical_string_r(const icalvalue *value)
+{
+    struct icalperiodarraytype data;
+    size_t buf_size = 256;
+    char *buf;
+    char *buf_ptr;
+    size_t i;
+
+    icalerror_check_arg_rz((value != 0), "value");
+    data = icalvalue_get_periodarray(value);
+
+    buf = (char *)icalmemory_new_buffer(buf_size);
+    buf_ptr = buf;
+    *buf_ptr = '\0';
+
+    for (i = 0; i < data.num_periods; i++) {
+        char *period = icalperiodtype_as_ical_string_r(data.periods[i]);
+
+        if (i > 0) {
+            icalmemory_append_char(&buf, &buf_ptr, &buf_size, ',');
+        }
+        icalmemory_append_string(&buf, &buf_ptr, &buf_size, period);
+        icalmemory_free_buffer(period);
+    }
+
+    return buf;
+}
+
 static char *icalvalue_trigger_as_ical_string_r(const icalvalue *value)
 {
     struct icaltriggertype data;
@@ -1205,6 +1629,8 @@ char *icalvalue_as_ical_string_r(const icalvalue *value)
 
     case ICAL_PERIOD_VALUE:
         return icalvalue_period_as_ical_string_r(value);
+    case ICAL_PERIODARRAY_VALUE:
+        return icalvalue_periodarray_as_ical_string_r(value);
     case ICAL_DATETIMEPERIOD_VALUE:
         return icalvalue_datetimeperiod_as_ical_string_r(value);
 
@@ -1393,8 +1819,8 @@ icalparameter_xliccomparetype icalvalue_compare(const icalvalue *a, const icalva
             temp1 = icalvalue_as_ical_string_r(a);
             temp2 = icalvalue_as_ical_string_r(b);
             r = strcmp(temp1, temp2);
-            free(temp1);
-            free(temp2);
+            icalmemory_free_buffer(temp1);
+            icalmemory_free_buffer(temp2);
 
             if (r > 0) {
                 return ICAL_XLICCOMPARETYPE_GREATER;
@@ -1458,6 +1884,12 @@ icalparameter_xliccomparetype icalvalue_compare(const icalvalue *a, const icalva
 
 void icalvalue_reset_kind(icalvalue *value)
 {
+    /* Every value setter funnels through here, so this is where a
+       mutated value drops its owning property's cached rendering and
+       its own cached resolved time */
+    icalproperty_cache_invalidate(value->parent);
+    value->resolved_time_valid = 0;
+
     if ((value->kind == ICAL_DATETIME_VALUE || value->kind == ICAL_DATE_VALUE) &&
         !icaltime_is_null_time(value->data.v_time)) {
 
@@ -1481,6 +1913,33 @@ icalproperty *icalvalue_get_parent(icalvalue *value)
     return value->parent;
 }
 
+int icalvalue_datetime_cache_get(const struct icalvalue_impl *impl, struct icaltimetype *t)
+{
+    if (impl == 0 || !impl->resolved_time_valid) {
+        return 0;
+    }
+
+    *t = impl->aux.resolved_time;
+    return 1;
+}
+
+void icalvalue_datetime_cache_set(struct icalvalue_impl *impl, struct icaltimetype t)
+{
+    if (impl == 0) {
+        return;
+    }
+
+    impl->aux.resolved_time = t;
+    impl->resolved_time_valid = 1;
+}
+
+void icalvalue_datetime_cache_clear(struct icalvalue_impl *impl)
+{
+    if (impl != 0) {
+        impl->resolved_time_valid = 0;
+    }
+}
+
 int icalvalue_encode_ical_string(const char *szText, char *szEncText, int nMaxBufferLen)
 {
     char *ptr;
@@ -1500,12 +1959,12 @@ int icalvalue_encode_ical_string(const char *szText, char *szEncText, int nMaxBu
 
     if ((int)strlen(ptr) >= nMaxBufferLen) {
         icalvalue_free(value);
-        free(ptr);
+        icalmemory_free_buffer(ptr);
         return 0;
     }
 
     strcpy(szEncText, ptr);
-    free(ptr);
+    icalmemory_free_buffer(ptr);
 
     icalvalue_free((icalvalue *) value);
 
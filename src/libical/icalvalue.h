@@ -21,6 +21,7 @@
 
 #include "libical_deprecated.h"
 #include "libical_ical_export.h"
+#include "icalerror.h"  /* for icalerrorenum in icalvalue_parse_error */
 #include "icalvalueimpl.h"
 
 /** @file icalvalue.h */
@@ -39,6 +40,37 @@ LIBICAL_ICAL_EXPORT icalvalue *icalvalue_clone(const icalvalue *value);
 
 LIBICAL_ICAL_EXPORT icalvalue *icalvalue_new_from_string(icalvalue_kind kind, const char *str);
 
+/**
+ * @brief Describes why a value string failed to parse, without any
+ * allocation.
+ * @since 3.1.0
+ *
+ * @c message always points at a static string and must not be freed.
+ * The caller that wants an X-LIC-ERROR property in the component can
+ * still build one from the descriptor; validation loops that only
+ * reject the line pay nothing.
+ */
+typedef struct icalvalue_parse_error
+{
+    icalerrorenum code;         /**< ::ICAL_NO_ERROR when parsing succeeded */
+    icalvalue_kind kind;        /**< the value kind that was requested */
+    const char *message;        /**< static description of the failure, or NULL */
+} icalvalue_parse_error;
+
+/**
+ * @brief Parses @p str as a value of @p kind, describing any failure
+ * in @p error instead of allocating an error property.
+ * @return The new value, or NULL when @p str could not be parsed.
+ * @since 3.1.0
+ *
+ * Identical to icalvalue_new_from_string() except that on failure the
+ * descriptor is filled in with a static error code and message, so
+ * rejecting malformed input allocates nothing. @p error may be NULL.
+ */
+LIBICAL_ICAL_EXPORT icalvalue *icalvalue_new_from_string_with_desc(icalvalue_kind kind,
+                                                                   const char *str,
+                                                                   icalvalue_parse_error *error);
+
 LIBICAL_ICAL_EXPORT void icalvalue_free(icalvalue *value);
 
 LIBICAL_ICAL_EXPORT int icalvalue_is_valid(const icalvalue *value);
@@ -50,6 +50,26 @@ ICalValue &ICalValue::operator=(const ICalValue &v)
     return *this;
 }
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+ICalValue::ICalValue(ICalValue &&v) noexcept : imp(v.imp)
+{
+    v.imp = NULL;
+}
+
+ICalValue &ICalValue::operator=(ICalValue &&v) noexcept
+{
+    if (this != &v) {
+        if (imp != NULL) {
+            icalvalue_free(imp);
+        }
+        imp = v.imp;
+        v.imp = NULL;
+    }
+
+    return *this;
+}
+#endif
+
 void ICalValue::detach()
 {
     imp = NULL;
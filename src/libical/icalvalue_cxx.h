@@ -38,6 +38,12 @@ public:
     ICalValue();
     ICalValue(const ICalValue &);
     ICalValue &operator=(const ICalValue &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    /* Moves steal the underlying icalvalue instead of cloning it,
+       leaving the source detached (as after detach()). */
+    ICalValue(ICalValue &&) noexcept;
+    ICalValue &operator=(ICalValue &&) noexcept;
+#endif
     ~ICalValue();
 
     explicit ICalValue(icalvalue *);
@@ -24,12 +24,20 @@
 
 #include "icalproperty.h"
 
+/** Strings shorter than this (including the terminator) are stored
+    inline in the value impl instead of a separate heap copy. Sized to
+    the icaltimetype that shares its storage, so the inline buffer is
+    free of charge. */
+#define ICALVALUE_SMALL_STRING_SIZE 40
+
 struct icalvalue_impl
 {
     icalvalue_kind kind;        /*this is the kind that is visible from the outside */
 
     char id[5];
-    int size;
+    char resolved_time_valid;
+    /**< Nonzero while aux.resolved_time holds a cached resolution.
+       Mutating the value or the owning property clears it. */
     icalproperty *parent;
     char *x_value;
 
@@ -56,6 +64,10 @@ struct icalvalue_impl
         struct icalperiodtype v_period;
         /*struct icalperiodtype v_datetimeperiod; *//* use v_time/v_period */
 
+        /* The periods block is owned by the value; see the PERIODARRAY
+           cases in icalvalue.c */
+        struct icalperiodarraytype v_periodarray;
+
         struct icalgeotype v_geo;
 
         struct icaltimetype v_time;
@@ -87,6 +99,45 @@ struct icalvalue_impl
          */
 
     } data;
+
+    /* The inline string buffer belongs to the string kinds and the
+       resolved-time cache to the date-time kinds, so the two can never
+       be live at once and share storage. */
+    union aux
+    {
+        char small_string[ICALVALUE_SMALL_STRING_SIZE];
+        /**< Inline storage for short string values; data.v_string points
+           here instead of at a heap copy when the string fits. Use
+           icalvalue_strdup_value_string() and icalvalue_free_value_string()
+           to manage data.v_string so the two cases stay consistent. */
+
+        struct icaltimetype resolved_time;
+        /**< Lazily cached copy of data.v_time with its TZID resolved to an
+           attached zone, filled in by
+           icalproperty_get_datetime_with_component(). Only meaningful
+           while resolved_time_valid is nonzero. */
+    } aux;
 };
 
+/** Stores a copy of @p str in the impl, inline when it fits, and
+    returns the pointer to assign to data.v_string (NULL on allocation
+    failure). Does not release the previous string. */
+LIBICAL_ICAL_EXPORT const char *icalvalue_strdup_value_string(struct icalvalue_impl *impl,
+                                                              const char *str);
+
+/** Releases data.v_string if it is a heap copy and zeroes it. */
+LIBICAL_ICAL_EXPORT void icalvalue_free_value_string(struct icalvalue_impl *impl);
+
+/** Copies the cached resolved time into @p t and returns nonzero, or
+    returns 0 when @p value holds no cached resolution. */
+LIBICAL_ICAL_EXPORT int icalvalue_datetime_cache_get(const struct icalvalue_impl *impl,
+                                                     struct icaltimetype *t);
+
+/** Records @p t as the value's resolved time. */
+LIBICAL_ICAL_EXPORT void icalvalue_datetime_cache_set(struct icalvalue_impl *impl,
+                                                      struct icaltimetype t);
+
+/** Forgets any cached resolved time. */
+LIBICAL_ICAL_EXPORT void icalvalue_datetime_cache_clear(struct icalvalue_impl *impl);
+
 #endif
@@ -21,17 +21,20 @@
 #endif
 
 #include "pvl.h"
+#include "icalmemory.h"
 
 #include <assert.h>
 #include <errno.h>
 #include <stdlib.h>
 
+#if defined(PVL_DEBUG)
 /**
  * Globals incremented for each call to pvl_new_element(); each list gets a unique id.
  */
 
 static int pvl_elem_count = 0;
 static int pvl_list_count = 0;
+#endif
 
 /**
   struct pvl_list_t
@@ -44,7 +47,9 @@ static int pvl_list_count = 0;
 
 typedef struct pvl_list_t
 {
+#if defined(PVL_DEBUG)
     int MAGIC;                          /**< Magic Identifier */
+#endif
     struct pvl_elem_t *head;            /**< Head of list */
     struct pvl_elem_t *tail;            /**< Tail of list */
     int count;                          /**< Number of items in the list */
@@ -61,13 +66,15 @@ pvl_list pvl_newlist()
 {
     struct pvl_list_t *L;
 
-    if ((L = (struct pvl_list_t *)malloc(sizeof(struct pvl_list_t))) == 0) {
+    if ((L = (struct pvl_list_t *)icalmemory_pool_alloc(sizeof(struct pvl_list_t))) == 0) {
         errno = ENOMEM;
         return 0;
     }
 
+#if defined(PVL_DEBUG)
     L->MAGIC = pvl_list_count;
     pvl_list_count++;
+#endif
     L->head = 0;
     L->tail = 0;
     L->count = 0;
@@ -82,7 +89,7 @@ void pvl_free(pvl_list l)
 
     pvl_clear(l);
 
-    free(L);
+    icalmemory_pool_free(L, sizeof(struct pvl_list_t));
 }
 
 /**
@@ -104,12 +111,14 @@ pvl_elem pvl_new_element(void *d, pvl_elem next, pvl_elem prior)
 {
     struct pvl_elem_t *E;
 
-    if ((E = (struct pvl_elem_t *)malloc(sizeof(struct pvl_elem_t))) == 0) {
+    if ((E = (struct pvl_elem_t *)icalmemory_pool_alloc(sizeof(struct pvl_elem_t))) == 0) {
         errno = ENOMEM;
         return 0;
     }
 
+#if defined(PVL_DEBUG)
     E->MAGIC = pvl_elem_count++;
+#endif
     E->d = d;
     E->next = next;
     E->prior = prior;
@@ -362,7 +371,7 @@ void *pvl_remove(pvl_list L, pvl_elem E)
     E->next = 0;
     E->d = 0;
 
-    free(E);
+    icalmemory_pool_free(E, sizeof(struct pvl_elem_t));
 
     return data;
 }
@@ -27,12 +27,16 @@ typedef struct pvl_elem_t *pvl_elem;
 /**
  * This type is private. Always use pvl_elem instead. The struct would
  * not even appear in this header except to make code in the USE_MACROS
- * blocks work
+ * blocks work. The MAGIC member exists only when PVL_DEBUG is defined;
+ * every property, parameter and component list in the library is built
+ * on pvl, so the element stays minimal in normal builds.
  */
 
 typedef struct pvl_elem_t
 {
+#if defined(PVL_DEBUG)
     int MAGIC;                          /**< Magic Identifier */
+#endif
     void *d;                            /**< Pointer to data user is storing */
     struct pvl_elem_t *next;            /**< Next element */
     struct pvl_elem_t *prior;           /**< Prior element */
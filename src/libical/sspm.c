@@ -39,6 +39,12 @@
 #include <ctype.h>
 #include <stdlib.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #define TMP_BUF_SIZE 1024
 
 enum line_type
@@ -75,6 +81,8 @@ struct mime_impl
     char *(*get_string) (char *s, size_t size, void *data);
     void *get_string_data;
     char temp[TMP_BUF_SIZE];
+    char *line;     /* last line returned by get_string; usually temp, but
+                       buffer-backed generators may return their own storage */
     enum mime_state state;
 };
 
@@ -584,6 +592,8 @@ static char *sspm_get_next_line(struct mime_impl *impl)
 
     if (s == 0) {
         impl->state = END_OF_INPUT;
+    } else {
+        impl->line = s;
     }
     return s;
 }
@@ -793,6 +803,10 @@ static void sspm_make_part(struct mime_impl *impl,
                 }
                 free(boundary);
             }
+        } else if (action.add_line == sspm_default_add_line) {
+            /* No consumer for this part's body, so scan for the
+               boundary without buffering or decoding the content */
+            continue;
         } else {
             char *data = 0;
             char *rtrn = 0;
@@ -849,7 +863,7 @@ static void *sspm_make_multipart_part(struct mime_impl *impl, struct sspm_header
             impl->parts[impl->part_no].header.minor = SSPM_NO_MINOR_TYPE;
         }
 
-    } while (get_line_type(impl->temp) != TERMINATING_BOUNDARY && impl->state != END_OF_INPUT);
+    } while (get_line_type(impl->line) != TERMINATING_BOUNDARY && impl->state != END_OF_INPUT);
 
     impl->level--;
 
@@ -876,7 +890,7 @@ static void *sspm_make_multipart_subpart(struct mime_impl *impl, struct sspm_hea
 
     /* Step 1: Read the opening boundary */
 
-    if (get_line_type(impl->temp) != BOUNDARY) {
+    if (get_line_type(impl->line) != BOUNDARY) {
         while ((line = sspm_get_next_line(impl)) != 0) {
             if (sspm_is_mime_boundary(line)) {
 
@@ -946,9 +960,9 @@ static void *sspm_make_multipart_subpart(struct mime_impl *impl, struct sspm_hea
         /* now get all of the sub-parts */
         part = sspm_make_multipart_part(impl, child_header);
 
-        if (get_line_type(impl->temp) != TERMINATING_BOUNDARY) {
+        if (get_line_type(impl->line) != TERMINATING_BOUNDARY) {
 
-            sspm_set_error(child_header, SSPM_NO_BOUNDARY_ERROR, impl->temp);
+            sspm_set_error(child_header, SSPM_NO_BOUNDARY_ERROR, impl->line);
             return 0;
         }
 
@@ -993,6 +1007,7 @@ int sspm_parse_mime(struct sspm_part *parts,
     impl.actions = actions;
     impl.get_string = get_string;
     impl.get_string_data = get_string_data;
+    impl.line = impl.temp;
 
     /* Read the header of the message. This will be the email header,
        unless first_header is specified. But ( HACK) that var is not
@@ -1068,8 +1083,62 @@ The code is heavily modified by Eric Busboom.
 
 ***********************************************************************/
 
+const char *decode_quoted_printable_run(const char *s, const char *end)
+{
+#if defined(__SSE2__)
+    const __m128i veq = _mm_set1_epi8('=');
+    const __m128i vcr = _mm_set1_epi8('\r');
+    const __m128i vlf = _mm_set1_epi8('\n');
+    const __m128i vnul = _mm_setzero_si128();
+
+    while (s + 16 <= end) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)s);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, veq), _mm_cmpeq_epi8(chunk, vnul)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, vcr), _mm_cmpeq_epi8(chunk, vlf)));
+        int mask = _mm_movemask_epi8(hits);
+
+        if (mask != 0) {
+#if defined(__GNUC__) || defined(__clang__)
+            return s + __builtin_ctz((unsigned int)mask);
+#else
+            while ((mask & 1) == 0) {
+                mask >>= 1;
+                s++;
+            }
+            return s;
+#endif
+        }
+        s += 16;
+    }
+#elif defined(__aarch64__)
+    const uint8x16_t veq = vdupq_n_u8('=');
+    const uint8x16_t vcr = vdupq_n_u8('\r');
+    const uint8x16_t vlf = vdupq_n_u8('\n');
+    const uint8x16_t vnul = vdupq_n_u8(0);
+
+    while (s + 16 <= end) {
+        uint8x16_t chunk = vld1q_u8((const uint8_t *)s);
+        uint8x16_t hits = vorrq_u8(vorrq_u8(vceqq_u8(chunk, veq), vceqq_u8(chunk, vnul)),
+                                   vorrq_u8(vceqq_u8(chunk, vcr), vceqq_u8(chunk, vlf)));
+
+        if (vmaxvq_u8(hits) != 0) {
+            break;      /* the scalar loop below pins down the exact byte */
+        }
+        s += 16;
+    }
+#endif
+
+    while (s < end && *s != '=' && *s != '\r' && *s != '\n' && *s != '\0') {
+        s++;
+    }
+
+    return s;
+}
+
 char *decode_quoted_printable(char *dest, char *src, size_t *size)
 {
+    const char *input_end = src + strlen(src);
     int cc;
     size_t i = 0;
 
@@ -1100,13 +1169,32 @@ char *decode_quoted_printable(char *dest, char *src, size_t *size)
 
             *dest = cc;
 
-        } else {
+            dest++;
+            src++;
+            i++;
+        } else if (*src == '\n' || *src == '\r') {
             *dest = *src;
-        }
 
-        dest++;
-        src++;
-        i++;
+            dest++;
+            src++;
+            i++;
+        } else {
+            /* Bulk-copy the clean run up to the next escape, line
+               break or end; clean bytes map to output one to one */
+            const char *limit = input_end;
+            size_t run;
+
+            if (src + (*size - i) < limit) {
+                limit = src + (*size - i);
+            }
+
+            run = (size_t)(decode_quoted_printable_run(src, limit) - src);
+            memcpy(dest, src, run);
+
+            dest += run;
+            src += run;
+            i += run;
+        }
     }
 
     *dest = '\0';
@@ -1115,6 +1203,88 @@ char *decode_quoted_printable(char *dest, char *src, size_t *size)
     return (dest);
 }
 
+/*
+ * Decodes a 16-character block of pure alphabet characters to 12 output
+ * bytes. Returns 1 on success, 0 when the block holds anything else
+ * (padding, whitespace, an invalid byte) and the scalar loop must take
+ * over. This is the inner loop when decoding multi-MB base64 bodies, so
+ * the classification and 6-bit translation are vectorized where the
+ * compiler advertises SSE2 or NEON; without either this helper reports
+ * failure and everything goes through the scalar path.
+ */
+static int decode_base64_block(char *dest, const char *src)
+{
+    unsigned char vals[16];
+    int k;
+
+#if defined(__SSE2__)
+    const __m128i c = _mm_loadu_si128((const __m128i *)src);
+    /* Signed compares are safe: base64 alphabet is all below 0x80 */
+    const __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), c));
+    const __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('z' + 1), c));
+    const __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                        _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), c));
+    const __m128i plus = _mm_cmpeq_epi8(c, _mm_set1_epi8('+'));
+    const __m128i slash = _mm_cmpeq_epi8(c, _mm_set1_epi8('/'));
+    __m128i any, off;
+
+    any = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(plus, slash)));
+    if (_mm_movemask_epi8(any) != 0xFFFF) {
+        return 0;
+    }
+
+    /* The classes are disjoint, so the per-class offsets can be OR'd
+       together: 'A'-> 0, 'a'-> 26, '0'-> 52, '+'-> 62, '/'-> 63 */
+    off = _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(-65)),
+                     _mm_and_si128(lower, _mm_set1_epi8(-71))),
+        _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(4)),
+                     _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(19)),
+                                  _mm_and_si128(slash, _mm_set1_epi8(16)))));
+
+    _mm_storeu_si128((__m128i *) vals, _mm_add_epi8(c, off));
+#elif defined(__aarch64__)
+    const uint8x16_t c = vld1q_u8((const uint8_t *)src);
+    const uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+    const uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+    const uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+    const uint8x16_t plus = vceqq_u8(c, vdupq_n_u8('+'));
+    const uint8x16_t slash = vceqq_u8(c, vdupq_n_u8('/'));
+    uint8x16_t any, off;
+
+    any = vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(plus, slash)));
+    if (vminvq_u8(any) != 0xFF) {
+        return 0;
+    }
+
+    off = vorrq_u8(
+        vorrq_u8(vandq_u8(upper, vdupq_n_u8((uint8_t)-65)),
+                 vandq_u8(lower, vdupq_n_u8((uint8_t)-71))),
+        vorrq_u8(vandq_u8(digit, vdupq_n_u8(4)),
+                 vorrq_u8(vandq_u8(plus, vdupq_n_u8(19)), vandq_u8(slash, vdupq_n_u8(16)))));
+
+    vst1q_u8(vals, vaddq_u8(c, off));
+#else
+    _unused(vals);
+    _unused(k);
+    _unused(src);
+    _unused(dest);
+    return 0;
+#endif
+
+#if defined(__SSE2__) || defined(__aarch64__)
+    for (k = 0; k < 16; k += 4) {
+        *dest++ = (char)((vals[k] << 2) | (vals[k + 1] >> 4));
+        *dest++ = (char)(((vals[k + 1] & 0x0F) << 4) | (vals[k + 2] >> 2));
+        *dest++ = (char)(((vals[k + 2] & 0x03) << 6) | vals[k + 3]);
+    }
+
+    return 1;
+#endif
+}
+
 char *decode_base64(char *dest, char *src, size_t *size)
 {
     int cc = 0;
@@ -1123,6 +1293,17 @@ char *decode_base64(char *dest, char *src, size_t *size)
     int valid_data = 0;
     size_t size_out = 0;
 
+    /* Take whole 16-character blocks vectorized; fall through to the
+       scalar loop at the first block holding padding, whitespace or an
+       invalid character, and for the tail */
+    while ((size_t)p + 16 <= *size && decode_base64_block(dest, src)) {
+        dest += 12;
+        src += 16;
+        p += 16;
+        size_out += 16;
+        valid_data = 1;
+    }
+
     while (*src && p < (int)*size && (cc != -1)) {
 
         /* convert a character into the Base64 alphabet */
@@ -1565,3 +1746,374 @@ int sspm_write_mime(struct sspm_part *parts, size_t num_parts,
 
     return 0;
 }
+
+/***********************************************************************
+
+ Streaming MIME writer. Produces the same bytes as sspm_write_mime(),
+ but hands them to a caller-supplied sink in bounded chunks instead of
+ accumulating the whole message, so encoding a large attachment can
+ overlap with the socket writes that drain it.
+
+**********************************************************************/
+
+#define SSPM_STREAM_CHUNK_SIZE 4096
+
+struct sspm_stream
+{
+    sspm_write_fn write_fn;
+    void *sink;
+    char chunk[SSPM_STREAM_CHUNK_SIZE];
+    size_t len;
+    int error;
+};
+
+static int sspm_stream_flush(struct sspm_stream *stream)
+{
+    if (stream->error == 0 && stream->len > 0) {
+        if ((*stream->write_fn)(stream->sink, stream->chunk, stream->len) != 0) {
+            stream->error = 1;
+        }
+        stream->len = 0;
+    }
+
+    return stream->error;
+}
+
+static void sspm_stream_write(struct sspm_stream *stream, const char *data, size_t size)
+{
+    if (stream->error != 0) {
+        return;
+    }
+
+    if (stream->len + size > sizeof(stream->chunk)) {
+        if (sspm_stream_flush(stream) != 0) {
+            return;
+        }
+
+        /* Anything larger than the chunk goes to the sink directly */
+        if (size > sizeof(stream->chunk)) {
+            if ((*stream->write_fn)(stream->sink, data, size) != 0) {
+                stream->error = 1;
+            }
+            return;
+        }
+    }
+
+    memcpy(stream->chunk + stream->len, data, size);
+    stream->len += size;
+}
+
+static void sspm_stream_put_string(struct sspm_stream *stream, const char *string)
+{
+    sspm_stream_write(stream, string, strlen(string));
+}
+
+static void sspm_stream_put_char(struct sspm_stream *stream, char ch)
+{
+    sspm_stream_write(stream, &ch, 1);
+}
+
+static void sspm_stream_put_hex(struct sspm_stream *stream, char ch)
+{
+    char tmp[4];
+
+    snprintf(tmp, sizeof(tmp), "=%02X", (unsigned int)ch);
+
+    sspm_stream_put_string(stream, tmp);
+}
+
+/*
+ * Encodes one 1- to 3-byte quantum to four output characters,
+ * '='-padded like sspm_write_base64()
+ */
+static void encode_base64_quantum(char *dest, const unsigned char *src, size_t n)
+{
+    dest[0] = BaseTable[src[0] >> 2];
+    dest[1] = BaseTable[((src[0] & 0x03) << 4) | (n > 1 ? (src[1] >> 4) : 0)];
+    dest[2] = (n > 1) ? BaseTable[((src[1] & 0x0F) << 2) | (n > 2 ? (src[2] >> 6) : 0)] : '=';
+    dest[3] = (n > 2) ? BaseTable[src[2] & 0x3F] : '=';
+}
+
+/*
+ * Encodes a 12-byte block to 16 output characters: the counterpart of
+ * decode_base64_block(). The 6-bit gather is scalar, but the value-to-
+ * alphabet translation -- the same disjoint range classification the
+ * decoder uses, with the offsets reversed -- is vectorized where the
+ * compiler advertises SSE2 or NEON and falls back to the table lookup
+ * otherwise.
+ */
+static void encode_base64_block(char *dest, const unsigned char *src)
+{
+    unsigned char vals[16];
+    int k, j;
+
+    for (k = 0, j = 0; k < 16; k += 4, j += 3) {
+        vals[k] = src[j] >> 2;
+        vals[k + 1] = (unsigned char)(((src[j] & 0x03) << 4) | (src[j + 1] >> 4));
+        vals[k + 2] = (unsigned char)(((src[j + 1] & 0x0F) << 2) | (src[j + 2] >> 6));
+        vals[k + 3] = src[j + 2] & 0x3F;
+    }
+
+#if defined(__SSE2__)
+    {
+        const __m128i v = _mm_loadu_si128((const __m128i *)vals);
+        /* 0-25 -> 'A', 26-51 -> 'a', 52-61 -> '0', 62 -> '+', 63 -> '/' */
+        const __m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), v);
+        const __m128i lower = _mm_andnot_si128(upper, _mm_cmpgt_epi8(_mm_set1_epi8(52), v));
+        const __m128i plus = _mm_cmpeq_epi8(v, _mm_set1_epi8(62));
+        const __m128i slash = _mm_cmpeq_epi8(v, _mm_set1_epi8(63));
+        const __m128i digit =
+            _mm_andnot_si128(_mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(plus, slash)),
+                             _mm_set1_epi8(-1));
+        __m128i off;
+
+        off = _mm_or_si128(
+            _mm_or_si128(_mm_and_si128(upper, _mm_set1_epi8(65)),
+                         _mm_and_si128(lower, _mm_set1_epi8(71))),
+            _mm_or_si128(_mm_and_si128(digit, _mm_set1_epi8(-4)),
+                         _mm_or_si128(_mm_and_si128(plus, _mm_set1_epi8(-19)),
+                                      _mm_and_si128(slash, _mm_set1_epi8(-16)))));
+
+        _mm_storeu_si128((__m128i *) dest, _mm_add_epi8(v, off));
+    }
+#elif defined(__aarch64__)
+    {
+        const uint8x16_t v = vld1q_u8(vals);
+        const uint8x16_t upper = vcltq_u8(v, vdupq_n_u8(26));
+        const uint8x16_t lower = vbicq_u8(vcltq_u8(v, vdupq_n_u8(52)), upper);
+        const uint8x16_t plus = vceqq_u8(v, vdupq_n_u8(62));
+        const uint8x16_t slash = vceqq_u8(v, vdupq_n_u8(63));
+        const uint8x16_t digit =
+            vmvnq_u8(vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(plus, slash)));
+        uint8x16_t off;
+
+        off = vorrq_u8(
+            vorrq_u8(vandq_u8(upper, vdupq_n_u8(65)), vandq_u8(lower, vdupq_n_u8(71))),
+            vorrq_u8(vandq_u8(digit, vdupq_n_u8((uint8_t)-4)),
+                     vorrq_u8(vandq_u8(plus, vdupq_n_u8((uint8_t)-19)),
+                              vandq_u8(slash, vdupq_n_u8((uint8_t)-16)))));
+
+        vst1q_u8((uint8_t *)dest, vaddq_u8(v, off));
+    }
+#else
+    for (k = 0; k < 16; k++) {
+        dest[k] = BaseTable[vals[k]];
+    }
+#endif
+}
+
+/* Base64 with the same 72-character lines as sspm_encode_base64(), but
+   honoring data_size (the buffer encoder stops at the first NUL) and
+   emitting through the stream in whole blocks */
+static void sspm_stream_encode_base64(struct sspm_stream *stream, const char *data, size_t size)
+{
+    const unsigned char *src = (const unsigned char *)data;
+    char out[16];
+    size_t pos = 0;
+    int lpos = 0;
+
+    while (size - pos >= 3) {
+
+        if (size - pos >= 12 && lpos + 16 <= 72) {
+            encode_base64_block(out, src + pos);
+            sspm_stream_write(stream, out, 16);
+            pos += 12;
+            lpos += 16;
+        } else {
+            encode_base64_quantum(out, src + pos, 3);
+            sspm_stream_write(stream, out, 4);
+            pos += 3;
+            lpos += 4;
+        }
+
+        /* The buffer encoder only breaks a line when more output
+           follows, so a message never ends with a bare newline */
+        if (lpos == 72 && pos < size) {
+            sspm_stream_put_char(stream, '\n');
+            lpos = 0;
+        }
+    }
+
+    if (size - pos > 0) {
+        encode_base64_quantum(out, src + pos, size - pos);
+        sspm_stream_write(stream, out, 4);
+    }
+}
+
+static void sspm_stream_encode_quoted_printable(struct sspm_stream *stream, const char *data)
+{
+    const char *p;
+    int lpos = 0;
+
+    for (p = data; *p != 0; p++) {
+
+        if (sspm_is_printable(*p)) {
+            sspm_stream_put_char(stream, *p);
+            lpos++;
+        } else if (*p == '\t' || *p == ' ') {
+            char n = *(p + 1);
+
+            if (n == '\n' || n == '\r') {
+                sspm_stream_put_hex(stream, *p);
+                lpos += 3;
+            } else {
+                sspm_stream_put_char(stream, *p);
+                lpos++;
+            }
+
+        } else if (*p == '\n' || *p == '\r') {
+            sspm_stream_put_char(stream, *p);
+
+            lpos = 0;
+
+        } else {
+            sspm_stream_put_hex(stream, *p);
+            lpos += 3;
+        }
+
+        if (lpos > 72) {
+            lpos = 0;
+            sspm_stream_put_string(stream, "=\n");
+        }
+    }
+}
+
+static void sspm_stream_write_header(struct sspm_stream *stream, struct sspm_header *header)
+{
+    int i;
+    char temp[TMP_BUF_SIZE];
+    const char *major;
+    const char *minor;
+
+    major = sspm_major_type_string(header->major);
+    minor = sspm_minor_type_string(header->minor);
+
+    if (header->minor == SSPM_UNKNOWN_MINOR_TYPE) {
+        assert(header->minor_text != 0);
+        minor = header->minor_text;
+    }
+
+    snprintf(temp, sizeof(temp), "Content-Type: %s/%s", major, minor);
+
+    sspm_stream_put_string(stream, temp);
+
+    if (header->boundary != 0) {
+        snprintf(temp, sizeof(temp), ";boundary=\"%s\"", header->boundary);
+        sspm_stream_put_string(stream, temp);
+    }
+
+    if (header->content_type_params != 0) {
+        for (i = 0; *(header->content_type_params[i]) != 0; i++) {
+            sspm_stream_put_char(stream, ';');
+            sspm_stream_put_string(stream, header->content_type_params[i]);
+        }
+    }
+
+    sspm_stream_put_char(stream, '\n');
+
+    sspm_stream_put_char(stream, '\n');
+}
+
+static void sspm_stream_write_part(struct sspm_stream *stream,
+                                   struct sspm_part *part, int *part_num)
+{
+    _unused(part_num);
+
+    sspm_stream_write_header(stream, &(part->header));
+
+    if (part->data == 0) {
+        return;
+    }
+
+    if (part->header.encoding == SSPM_BASE64_ENCODING) {
+        assert(part->data_size != 0);
+        sspm_stream_encode_base64(stream, part->data, part->data_size);
+    } else if (part->header.encoding == SSPM_QUOTED_PRINTABLE_ENCODING) {
+        sspm_stream_encode_quoted_printable(stream, part->data);
+    } else {
+        sspm_stream_put_string(stream, part->data);
+    }
+
+    sspm_stream_put_string(stream, "\n\n");
+}
+
+static void sspm_stream_write_multipart_part(struct sspm_stream *stream,
+                                             struct sspm_part *parts, int *part_num)
+{
+    int parent_level, level;
+    struct sspm_header *header = &(parts[*part_num].header);
+
+    sspm_stream_write_header(stream, header);
+
+    parent_level = parts[*part_num].level;
+
+    (*part_num)++;
+
+    level = parts[*part_num].level;
+
+    while (parts[*part_num].header.major != SSPM_NO_MAJOR_TYPE && level == parent_level + 1) {
+
+        assert(header->boundary != NULL);
+        sspm_stream_put_string(stream, header->boundary);
+        sspm_stream_put_char(stream, '\n');
+
+        if (parts[*part_num].header.major == SSPM_MULTIPART_MAJOR_TYPE) {
+            sspm_stream_write_multipart_part(stream, parts, part_num);
+        } else {
+            sspm_stream_write_part(stream, &(parts[*part_num]), part_num);
+        }
+
+        (*part_num)++;
+        level = parts[*part_num].level;
+    }
+
+    sspm_stream_put_string(stream, "\n\n--");
+    sspm_stream_put_string(stream, header->boundary);
+    sspm_stream_put_string(stream, "\n");
+
+    (*part_num)--;      /* undo last, spurious, increment */
+}
+
+int sspm_write_mime_stream(struct sspm_part *parts, size_t num_parts,
+                           const char *header, sspm_write_fn write_fn, void *sink)
+{
+    struct sspm_stream stream;
+    int part_num = 0;
+    size_t slen;
+
+    _unused(num_parts);
+
+    if (write_fn == 0) {
+        return -1;
+    }
+
+    stream.write_fn = write_fn;
+    stream.sink = sink;
+    stream.len = 0;
+    stream.error = 0;
+
+    if (header != 0) {
+        sspm_stream_put_string(&stream, header);
+
+        slen = strlen(header);
+        if (slen > 0 && header[slen - 1] != '\n') {
+            sspm_stream_put_char(&stream, '\n');
+        }
+    }
+
+    sspm_stream_put_string(&stream, "Mime-Version: 1.0\n");
+
+    while (parts[part_num].header.major != SSPM_NO_MAJOR_TYPE) {
+        if (parts[part_num].header.major == SSPM_MULTIPART_MAJOR_TYPE) {
+            sspm_stream_write_multipart_part(&stream, parts, &part_num);
+        } else {
+            sspm_stream_write_part(&stream, &(parts[part_num]), &part_num);
+        }
+
+        part_num++;
+    }
+
+    (void)sspm_stream_flush(&stream);
+
+    return stream.error ? -1 : 0;
+}
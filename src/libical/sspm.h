@@ -133,9 +133,44 @@ LIBICAL_ICAL_EXPORT void sspm_free_parts(struct sspm_part *parts, size_t max_par
 
 LIBICAL_ICAL_EXPORT char *decode_quoted_printable(char *dest, char *src, size_t *size);
 
+/**
+ * Returns a pointer to the first byte in [s,end) that quoted-printable
+ * decoding must handle specially -- '=', CR, LF or NUL -- or @p end if
+ * the range is one clean run. The scan is vectorized where SSE2 or
+ * NEON is available; decoders (sspm and the vCard lexer) bulk-copy the
+ * run it delimits instead of switching per byte.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT const char *decode_quoted_printable_run(const char *s, const char *end);
+
 LIBICAL_ICAL_EXPORT char *decode_base64(char *dest, char *src, size_t *size);
 
 LIBICAL_ICAL_EXPORT int sspm_write_mime(struct sspm_part *parts, size_t num_parts,
                                         char **output_string, const char *header);
 
+/**
+ * Sink callback for sspm_write_mime_stream(). Receives successive
+ * chunks of the rendered message; returns 0 to continue or nonzero to
+ * abort the write.
+ *
+ * @since 3.1.0
+ */
+typedef int (*sspm_write_fn) (void *sink, const char *data, size_t size);
+
+/**
+ * Streaming counterpart of sspm_write_mime(): renders the same bytes,
+ * but delivers them to @p write_fn in bounded chunks instead of
+ * assembling the whole message in memory, so base64 encoding of a
+ * large attachment overlaps with whatever drains the sink. Base64
+ * bodies are encoded from part->data_size bytes, making binary
+ * attachment data safe to stream. Returns 0 on success, -1 when the
+ * sink reports failure.
+ *
+ * @since 3.1.0
+ */
+LIBICAL_ICAL_EXPORT int sspm_write_mime_stream(struct sspm_part *parts, size_t num_parts,
+                                               const char *header,
+                                               sspm_write_fn write_fn, void *sink);
+
 #endif /* ICAL_SSPM_H */
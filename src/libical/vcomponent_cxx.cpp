@@ -61,6 +61,26 @@ VComponent &VComponent::operator=(const VComponent &v)
     return *this;
 }
 
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+VComponent::VComponent(VComponent &&v) noexcept : imp(v.imp)
+{
+    v.imp = NULL;
+}
+
+VComponent &VComponent::operator=(VComponent &&v) noexcept
+{
+    if (this != &v) {
+        if (imp != NULL) {
+            icalcomponent_free(imp);
+        }
+        imp = v.imp;
+        v.imp = NULL;
+    }
+
+    return *this;
+}
+#endif
+
 void VComponent::detach()
 {
     imp = NULL;
@@ -331,6 +351,16 @@ VComponent *VComponent::current(icalcompiter *i)
     return reinterpret_cast<VComponent *>(icalcompiter_deref(i));
 }
 
+ICalPropertyRange VComponent::properties(const icalproperty_kind &kind)
+{
+    return ICalPropertyRange(imp, kind);
+}
+
+VComponentRange VComponent::components(const icalcomponent_kind &kind)
+{
+    return VComponentRange(imp, kind);
+}
+
 /* Working with embedded error properties */
 int VComponent::count_errors()
 {
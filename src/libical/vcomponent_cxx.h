@@ -29,6 +29,8 @@ extern "C"
 #include "icalcomponent.h"
 }
 
+#include <cstddef>
+#include <iterator>
 #include <string>
 
 namespace LibICal
@@ -36,6 +38,191 @@ namespace LibICal
 
 class ICalProperty;
 
+/**
+ * @class ICalPropertyIterator
+ * @brief STL-style forward iterator over the properties of a component.
+ *
+ * Wraps ::icalpropiter, so the cursor lives in the iterator itself
+ * rather than in the component: several loops can walk the same
+ * component at once, including frozen components shared between
+ * threads. Dereferencing yields the raw icalproperty handle, which
+ * remains owned by the component.
+ *
+ * Usually obtained from VComponent::properties().
+ *
+ * @since 3.1.0
+ */
+class LIBICAL_ICAL_EXPORT ICalPropertyIterator
+{
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef icalproperty *value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type *pointer;
+    typedef icalproperty *reference;
+
+    /// Constructs the past-the-end iterator.
+    ICalPropertyIterator() : impl()
+    {
+        impl.kind = ICAL_NO_PROPERTY;
+        impl.iter = 0;
+    }
+
+    explicit ICalPropertyIterator(const icalpropiter &i) : impl(i)
+    {
+    }
+
+    icalproperty *operator*() const
+    {
+        icalpropiter copy = impl;
+        return icalpropiter_deref(&copy);
+    }
+
+    ICalPropertyIterator &operator++()
+    {
+        (void)icalpropiter_next(&impl);
+        return *this;
+    }
+
+    ICalPropertyIterator operator++(int)
+    {
+        ICalPropertyIterator prev(*this);
+        (void)icalpropiter_next(&impl);
+        return prev;
+    }
+
+    bool operator==(const ICalPropertyIterator &rhs) const
+    {
+        return impl.iter == rhs.impl.iter;
+    }
+
+    bool operator!=(const ICalPropertyIterator &rhs) const
+    {
+        return impl.iter != rhs.impl.iter;
+    }
+
+private:
+    icalpropiter impl;
+};
+
+/**
+ * @class VComponentIterator
+ * @brief STL-style forward iterator over the subcomponents of a
+ * component, wrapping ::icalcompiter the same way
+ * ICalPropertyIterator wraps ::icalpropiter.
+ *
+ * @since 3.1.0
+ */
+class LIBICAL_ICAL_EXPORT VComponentIterator
+{
+public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef icalcomponent *value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef const value_type *pointer;
+    typedef icalcomponent *reference;
+
+    /// Constructs the past-the-end iterator.
+    VComponentIterator() : impl()
+    {
+        impl.kind = ICAL_NO_COMPONENT;
+        impl.iter = 0;
+    }
+
+    explicit VComponentIterator(const icalcompiter &i) : impl(i)
+    {
+    }
+
+    icalcomponent *operator*() const
+    {
+        icalcompiter copy = impl;
+        return icalcompiter_deref(&copy);
+    }
+
+    VComponentIterator &operator++()
+    {
+        (void)icalcompiter_next(&impl);
+        return *this;
+    }
+
+    VComponentIterator operator++(int)
+    {
+        VComponentIterator prev(*this);
+        (void)icalcompiter_next(&impl);
+        return prev;
+    }
+
+    bool operator==(const VComponentIterator &rhs) const
+    {
+        return impl.iter == rhs.impl.iter;
+    }
+
+    bool operator!=(const VComponentIterator &rhs) const
+    {
+        return impl.iter != rhs.impl.iter;
+    }
+
+private:
+    icalcompiter impl;
+};
+
+/**
+ * @class ICalPropertyRange
+ * @brief The range returned by VComponent::properties(); usable in a
+ * range-based for loop or with std:: algorithms.
+ *
+ * @since 3.1.0
+ */
+class LIBICAL_ICAL_EXPORT ICalPropertyRange
+{
+public:
+    ICalPropertyRange(icalcomponent *c, icalproperty_kind kind) : c(c), kind(kind)
+    {
+    }
+
+    ICalPropertyIterator begin() const
+    {
+        return ICalPropertyIterator(icalcomponent_begin_property(c, kind));
+    }
+
+    ICalPropertyIterator end() const
+    {
+        return ICalPropertyIterator();
+    }
+
+private:
+    icalcomponent *c;
+    icalproperty_kind kind;
+};
+
+/**
+ * @class VComponentRange
+ * @brief The range returned by VComponent::components().
+ *
+ * @since 3.1.0
+ */
+class LIBICAL_ICAL_EXPORT VComponentRange
+{
+public:
+    VComponentRange(icalcomponent *c, icalcomponent_kind kind) : c(c), kind(kind)
+    {
+    }
+
+    VComponentIterator begin() const
+    {
+        return VComponentIterator(icalcomponent_begin_component(c, kind));
+    }
+
+    VComponentIterator end() const
+    {
+        return VComponentIterator();
+    }
+
+private:
+    icalcomponent *c;
+    icalcomponent_kind kind;
+};
+
 /**
  * @class VComponent
  * @brief A class wrapping the libical icalcomponent functions
@@ -50,6 +237,12 @@ public:
     VComponent();
     VComponent(const VComponent &);
     VComponent &operator=(const VComponent &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    /* Moves steal the underlying icalcomponent instead of cloning it,
+       leaving the source detached (as after detach()). */
+    VComponent(VComponent &&) noexcept;
+    VComponent &operator=(VComponent &&) noexcept;
+#endif
     virtual ~VComponent();
 
     explicit VComponent(icalcomponent *v);
@@ -116,6 +309,23 @@ public:
     VComponent *prev(icalcompiter *i);
     VComponent *current(icalcompiter *i);
 
+    /**
+     * Range over this component's properties of @p kind, for
+     * range-based for loops and std:: algorithms. The elements are raw
+     * icalproperty handles still owned by the component; the cursor
+     * lives in the iterator, so loops are reentrant and do not disturb
+     * get_first_property()/get_next_property().
+     * @since 3.1.0
+     */
+    ICalPropertyRange properties(const icalproperty_kind &kind = ICAL_ANY_PROPERTY);
+
+    /**
+     * Range over this component's subcomponents of @p kind; the
+     * component keeps ownership of the elements.
+     * @since 3.1.0
+     */
+    VComponentRange components(const icalcomponent_kind &kind = ICAL_ANY_COMPONENT);
+
     /// Working with embedded error properties
     int count_errors();
 
@@ -227,6 +437,10 @@ public:
     VCalendar();
     VCalendar(const VCalendar &);
     VCalendar &operator=(const VCalendar &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VCalendar(VCalendar &&) noexcept = default;
+    VCalendar &operator=(VCalendar &&) noexcept = default;
+#endif
     ~VCalendar();
 
     explicit VCalendar(icalcomponent *v);
@@ -239,6 +453,10 @@ public:
     VEvent();
     VEvent(const VEvent &);
     VEvent &operator=(const VEvent &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VEvent(VEvent &&) noexcept = default;
+    VEvent &operator=(VEvent &&) noexcept = default;
+#endif
     ~VEvent();
 
     explicit VEvent(icalcomponent *v);
@@ -251,6 +469,10 @@ public:
     VToDo();
     VToDo(const VToDo &);
     VToDo &operator=(const VToDo &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VToDo(VToDo &&) noexcept = default;
+    VToDo &operator=(VToDo &&) noexcept = default;
+#endif
     ~VToDo();
 
     explicit VToDo(icalcomponent *v);
@@ -263,6 +485,10 @@ public:
     VAgenda();
     VAgenda(const VAgenda &);
     VAgenda &operator=(const VAgenda &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VAgenda(VAgenda &&) noexcept = default;
+    VAgenda &operator=(VAgenda &&) noexcept = default;
+#endif
     ~VAgenda();
 
     explicit VAgenda(icalcomponent *v);
@@ -275,6 +501,10 @@ public:
     VQuery();
     VQuery(const VQuery &);
     VQuery &operator=(const VQuery &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VQuery(VQuery &&) noexcept = default;
+    VQuery &operator=(VQuery &&) noexcept = default;
+#endif
     ~VQuery();
 
     explicit VQuery(icalcomponent *v);
@@ -287,6 +517,10 @@ public:
     VJournal();
     VJournal(const VJournal &);
     VJournal &operator=(const VJournal &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VJournal(VJournal &&) noexcept = default;
+    VJournal &operator=(VJournal &&) noexcept = default;
+#endif
     ~VJournal();
 
     explicit VJournal(icalcomponent *v);
@@ -299,6 +533,10 @@ public:
     VAlarm();
     VAlarm(const VAlarm &);
     VAlarm &operator=(const VAlarm &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VAlarm(VAlarm &&) noexcept = default;
+    VAlarm &operator=(VAlarm &&) noexcept = default;
+#endif
     ~VAlarm();
 
     explicit VAlarm(icalcomponent *v);
@@ -318,6 +556,10 @@ public:
     VFreeBusy();
     VFreeBusy(const VFreeBusy &);
     VFreeBusy &operator=(const VFreeBusy &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VFreeBusy(VFreeBusy &&) noexcept = default;
+    VFreeBusy &operator=(VFreeBusy &&) noexcept = default;
+#endif
     ~VFreeBusy();
 
     explicit VFreeBusy(icalcomponent *v);
@@ -330,6 +572,10 @@ public:
     VTimezone();
     VTimezone(const VTimezone &);
     VTimezone &operator=(const VTimezone &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    VTimezone(VTimezone &&) noexcept = default;
+    VTimezone &operator=(VTimezone &&) noexcept = default;
+#endif
     ~VTimezone();
 
     explicit VTimezone(icalcomponent *v);
@@ -342,6 +588,10 @@ public:
     XStandard();
     XStandard(const XStandard &);
     XStandard &operator=(const XStandard &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    XStandard(XStandard &&) noexcept = default;
+    XStandard &operator=(XStandard &&) noexcept = default;
+#endif
     ~XStandard();
 
     explicit XStandard(icalcomponent *v);
@@ -354,6 +604,10 @@ public:
     XDaylight();
     XDaylight(const XDaylight &);
     XDaylight &operator=(const XDaylight &);
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+    XDaylight(XDaylight &&) noexcept = default;
+    XDaylight &operator=(XDaylight &&) noexcept = default;
+#endif
     ~XDaylight();
 
     explicit XDaylight(icalcomponent *v);
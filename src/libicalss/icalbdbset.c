@@ -31,8 +31,22 @@
 
 #define MAX_RETRY 5
 
+/** Index key for records a DTSTART range scan must always visit: no
+    DTSTART, an RRULE, or an unparseable value. Sorts before any
+    timestamp key. */
+#define ICALBDBSET_RANGE_WILDCARD "0"
+
+/** Starting size of the bulk retrieval buffer. Must be a multiple of
+    1024 and no smaller than the database page size; each cursor call
+    returns as many records as fit in it. */
+#define ICALBDBSET_BULK_BUFSIZE (256 * 1024)
+
 static int _compare_ids(const char *compid, const char *matchid);
 static int _compare_keys(DB *dbp, const DBT *a, const DBT *b);
+static int _extract_uid(DB *sdbp, const DBT *pkey, const DBT *pdata, DBT *skey);
+static int _extract_dtstart(DB *sdbp, const DBT *pkey, const DBT *pdata, DBT *skey);
+static void icalbdbset_range_close(icalbdbset *bset);
+static icalcomponent *icalbdbset_range_next(icalbdbset *bset);
 
 /** Default options used when NULL is passed to icalset_new() **/
 static icalbdbset_options icalbdbset_options_default =
@@ -151,7 +165,11 @@ DB_ENV *icalbdbset_get_env(void)
  *  assume data is a string.
  */
 
-/* This populates a cluster with the entire contents of a database */
+/* This populates a cluster with the entire contents of a database.
+   Records are fetched through a bulk retrieval buffer; each cursor
+   call returns as many key/data pairs as fit in the buffer, so the
+   scan pays for a handful of cursor operations instead of one per
+   record. */
 static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (const DBT *dbt))
 {
     DB *dbp;
@@ -160,8 +178,8 @@ static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (
     char *str;
     int ret = EINVAL;
     char keystore[256];
-    char datastore[1024];
-    char *more_mem = NULL;
+    char *bulk_buf = NULL;
+    u_int32_t bulk_size = ICALBDBSET_BULK_BUFSIZE;
     DB_TXN *tid;
 
     _unused(pfunc);
@@ -179,6 +197,11 @@ static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (
         return ICAL_FILE_ERROR;
     }
 
+    if ((bulk_buf = malloc(bulk_size)) == NULL) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_INTERNAL_ERROR;
+    }
+
     bset->cluster = icalcomponent_new(ICAL_XROOT_COMPONENT);
 
     if (ICAL_DB_ENV->txn_begin(ICAL_DB_ENV, NULL, &tid, 0) != 0) {
@@ -196,21 +219,30 @@ static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (
     key.ulen = (u_int32_t) sizeof(keystore);
 
     data.flags = DB_DBT_USERMEM;
-    data.data = datastore;
-    data.ulen = (u_int32_t) sizeof(datastore);
+    data.data = bulk_buf;
+    data.ulen = bulk_size;
 
-    /* fetch the key/data pair */
+    /* fetch buffers full of key/data pairs */
     while (1) {
-        ret = dbcp->c_get(dbcp, &key, &data, DB_NEXT);
+        ret = dbcp->c_get(dbcp, &key, &data, DB_MULTIPLE_KEY | DB_NEXT);
         if (ret == DB_NOTFOUND) {
             break;
-        } else if (ret == ENOMEM) {
-            if (more_mem) {
-                free(more_mem);
+        } else if (ret == ENOMEM
+#if defined(DB_BUFFER_SMALL)
+                   || ret == DB_BUFFER_SMALL
+#endif
+            ) {
+            /* a single record is larger than the buffer; double it,
+               keeping the multiple-of-1024 requirement */
+            char *bigger;
+
+            bulk_size = bulk_size * 2;
+            if ((bigger = realloc(bulk_buf, bulk_size)) == NULL) {
+                goto err2;
             }
-            more_mem = malloc(data.ulen + 1024);
-            data.data = more_mem;
-            data.ulen = data.ulen + 1024;
+            bulk_buf = bigger;
+            data.data = bulk_buf;
+            data.ulen = bulk_size;
         } else if (ret == DB_LOCK_DEADLOCK) {
             /*char *foo = db_strerror(ret); */
             abort();    /* should retry in case of DB_LOCK_DEADLOCK */
@@ -220,28 +252,40 @@ static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (
             dbp->err(dbp, ret, "cursor");
             abort();
         } else {
-            icalcomponent *cl;
+            void *p;
+            void *retkey, *retdata;
+            size_t retklen, retdlen;
 
-            /* this prevents an array read bounds error */
-            if ((str = (char *)calloc(data.size + 1, sizeof(char))) == NULL) {
-                goto err2;
-            }
-            memcpy(str, (char *)data.data, data.size);
+            DB_MULTIPLE_INIT(p, &data);
+            while (1) {
+                icalcomponent *cl;
 
-            cl = icalparser_parse_string(str);
+                DB_MULTIPLE_KEY_NEXT(p, &data, retkey, retklen, retdata, retdlen);
+                if (p == NULL) {
+                    break;
+                }
+                _unused(retkey);
+                _unused(retklen);
 
-            icalcomponent_add_component(bset->cluster, cl);
-            free(str);
+                /* this prevents an array read bounds error */
+                if ((str = (char *)calloc(retdlen + 1, sizeof(char))) == NULL) {
+                    goto err2;
+                }
+                memcpy(str, (char *)retdata, retdlen);
+
+                cl = icalparser_parse_string(str);
+
+                icalcomponent_add_component(bset->cluster, cl);
+                free(str);
+            }
         }
     }
     if (ret != DB_NOTFOUND) {
         goto err2;
     }
 
-    if (more_mem) {
-        free(more_mem);
-        more_mem = NULL;
-    }
+    free(bulk_buf);
+    bulk_buf = NULL;
 
     if (dbcp->c_close(dbcp) != 0) {
         abort();        /* should retry in case of DB_LOCK_DEADLOCK */
@@ -254,19 +298,176 @@ static icalerrorenum icalbdbset_read_database(icalbdbset *bset, char *(*pfunc) (
     return ICAL_NO_ERROR;
 
   err2:
-    if (more_mem) {
-        free(more_mem);
+    if (bulk_buf) {
+        free(bulk_buf);
     }
     dbcp->c_close(dbcp);
     abort();    /* should retry in case of DB_LOCK_DEADLOCK */
     return ICAL_INTERNAL_ERROR;
 
   err1:
+    free(bulk_buf);
     dbp->err(dbp, ret, "cursor index");
     abort();
     return ICAL_FILE_ERROR;
 }
 
+/* Finds the value of the named property in serialized component text
+   without parsing it. Matches at line starts only and stops at the
+   first hit; parameters on the line are skipped. */
+static int _find_property_value(const char *text, size_t len, const char *prop,
+                                const char **value, size_t *vlen)
+{
+    size_t plen = strlen(prop);
+    const char *p = text;
+    const char *end = text + len;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+
+        if (eol == NULL) {
+            eol = end;
+        }
+
+        if ((size_t)(eol - p) > plen && strncmp(p, prop, plen) == 0 &&
+            (p[plen] == ':' || p[plen] == ';')) {
+            const char *colon = memchr(p, ':', (size_t)(eol - p));
+
+            if (colon != NULL) {
+                *value = colon + 1;
+                *vlen = (size_t)(eol - colon) - 1;
+                while (*vlen > 0 &&
+                       ((*value)[*vlen - 1] == '\r' || (*value)[*vlen - 1] == '\n')) {
+                    (*vlen)--;
+                }
+                return 1;
+            }
+        }
+        p = eol + 1;
+    }
+
+    return 0;
+}
+
+/* Hands a malloc'd secondary key back to Berkeley DB */
+static int _set_skey(DBT *skey, const char *key, size_t len)
+{
+    char *copy;
+
+    if ((copy = malloc(len)) == NULL) {
+        return DB_DONOTINDEX;
+    }
+    memcpy(copy, key, len);
+
+    memset(skey, 0, sizeof(DBT));
+    skey->data = copy;
+    skey->size = (u_int32_t) len;
+    skey->flags = DB_DBT_APPMALLOC;
+
+    return 0;
+}
+
+/** Secondary key extractor: the UID of the stored component. Berkeley
+    DB calls this on every primary put and delete, so the index stays
+    in step with the primary without any bookkeeping here. */
+static int _extract_uid(DB *sdbp, const DBT *pkey, const DBT *pdata, DBT *skey)
+{
+    const char *value;
+    size_t vlen;
+
+    _unused(sdbp);
+    _unused(pkey);
+
+    if (!_find_property_value((const char *)pdata->data, pdata->size, "UID", &value, &vlen) ||
+        vlen == 0) {
+        return DB_DONOTINDEX;
+    }
+
+    return _set_skey(skey, value, vlen);
+}
+
+/** Secondary key extractor: the DTSTART of the stored component,
+    re-rendered in fixed-width form so the btree sorts chronologically.
+    Recurring components get the wildcard key, since their occurrences
+    are not pinned to the stored DTSTART. */
+static int _extract_dtstart(DB *sdbp, const DBT *pkey, const DBT *pdata, DBT *skey)
+{
+    struct icaltimetype t = icaltime_null_time();
+    icalcomponent *c, *inner;
+    const char *key = ICALBDBSET_RANGE_WILDCARD;
+    char *str;
+
+    _unused(sdbp);
+    _unused(pkey);
+
+    if ((str = (char *)calloc(pdata->size + 1, sizeof(char))) == NULL) {
+        return DB_DONOTINDEX;
+    }
+    memcpy(str, (char *)pdata->data, pdata->size);
+
+    if ((c = icalparser_parse_string(str)) != 0) {
+        inner = icalcomponent_get_first_real_component(c);
+
+        if (inner != 0 &&
+            icalcomponent_get_first_property(inner, ICAL_RRULE_PROPERTY) == 0) {
+            icalproperty *dtstart =
+                icalcomponent_get_first_property(inner, ICAL_DTSTART_PROPERTY);
+
+            if (dtstart != 0) {
+                t = icalproperty_get_dtstart(dtstart);
+            }
+        }
+        icalcomponent_free(c);
+    }
+    free(str);
+
+    if (!icaltime_is_null_time(t)) {
+        key = icaltime_as_ical_string(t);
+    }
+
+    return _set_skey(skey, key, strlen(key));
+}
+
+/** Opens a secondary index sub-database and associates it with the
+    primary, so Berkeley DB maintains it on every put and delete.
+    DB_CREATE on the associate builds the index from existing primary
+    records the first time it is opened. */
+static DB *icalbdbset_open_index(DB *dbp, const char *path, const char *sub_database,
+                                 int (*callback) (DB *, const DBT *, const DBT *, DBT *))
+{
+    int ret;
+    DB *sdbp = NULL;
+
+    if ((ret = db_create(&sdbp, ICAL_DB_ENV, 0)) != 0) {
+        ICAL_DB_ENV->err(ICAL_DB_ENV, ret, "secondary index: %s", sub_database);
+        return NULL;
+    }
+
+    if ((ret = sdbp->set_flags(sdbp, (u_int32_t) (DB_DUP | DB_DUPSORT))) != 0) {
+        ICAL_DB_ENV->err(ICAL_DB_ENV, ret, "set_flags error for secondary index: %s",
+                         sub_database);
+        sdbp->close(sdbp, 0);
+        return NULL;
+    }
+
+    ret = sdbp->open(sdbp, NULL, path, sub_database, DB_BTREE,
+                     (u_int32_t) (DB_CREATE | DB_THREAD), 0644);
+    if (ret != 0) {
+        ICAL_DB_ENV->err(ICAL_DB_ENV, ret, "failed to open secondary index: %s", sub_database);
+        sdbp->close(sdbp, 0);
+        return NULL;
+    }
+
+    if ((ret = dbp->associate(dbp, NULL, sdbp, callback, DB_CREATE)) != 0) {
+        ICAL_DB_ENV->err(ICAL_DB_ENV, ret, "failed to associate secondary index: %s",
+                         sub_database);
+        sdbp->close(sdbp, 0);
+        return NULL;
+    }
+
+    return sdbp;
+}
+
 icalset *icalbdbset_init(icalset *set, const char *dsn, void *options_in)
 {
     icalbdbset *bset = (icalbdbset *) set;
@@ -306,6 +507,18 @@ icalset *icalbdbset_init(icalset *set, const char *dsn, void *options_in)
     bset->gauge = 0;
     bset->cluster = 0;
 
+    /* Secondary indexes are best-effort: without them, fetch and
+       range selects fall back to scanning the cluster. */
+    {
+        char indexname[256];
+
+        snprintf(indexname, sizeof(indexname), "%s.uididx", subdb_name);
+        bset->uid_sdbp = icalbdbset_open_index(cal_db, set->dsn, indexname, _extract_uid);
+
+        snprintf(indexname, sizeof(indexname), "%s.dtstartidx", subdb_name);
+        bset->dtstart_sdbp = icalbdbset_open_index(cal_db, set->dsn, indexname, _extract_dtstart);
+    }
+
     if (icalbdbset_read_database(bset, options->pfunc) != ICAL_NO_ERROR) {
         return NULL;
     }
@@ -471,6 +684,19 @@ void icalbdbset_free(icalset *set)
         bset->sindex = 0;
     }
 
+    icalbdbset_range_close(bset);
+
+    /* secondaries close before the primary they are associated with */
+    if (bset->uid_sdbp) {
+        (void)bset->uid_sdbp->close(bset->uid_sdbp, 0);
+        bset->uid_sdbp = NULL;
+    }
+
+    if (bset->dtstart_sdbp) {
+        (void)bset->dtstart_sdbp->close(bset->dtstart_sdbp, 0);
+        bset->dtstart_sdbp = NULL;
+    }
+
     if (bset->dbp && (bset->dbp->close(bset->dbp, 0) != 0)) {
         /* ?? */
     }
@@ -665,6 +891,80 @@ int icalbdbset_put(DB *dbp, DBT *key, DBT *data, u_int32_t access_method)
     }
 }
 
+/** Writes a batch of key/data pairs under a single transaction.
+    Equivalent to calling icalbdbset_put() once per pair, but pays for
+    one txn_begin/commit for the whole batch instead of one per
+    record. A deadlock anywhere in the batch aborts and retries the
+    whole transaction, so the batch lands atomically or not at all. */
+
+int icalbdbset_put_batch(DB *dbp, DBT *keys, DBT *datas, int count)
+{
+    int ret = 0;
+    DB_TXN *tid = NULL;
+    int retry = 0;
+    int done = 0;
+    int deadlocked;
+    int i;
+
+    while ((retry < MAX_RETRY) && !done) {
+
+        if ((ret = ICAL_DB_ENV->txn_begin(ICAL_DB_ENV, NULL, &tid, 0)) != 0) {
+            if (ret == DB_LOCK_DEADLOCK) {
+                retry++;
+                continue;
+            } else {
+                /*char *foo = db_strerror(ret); */
+                abort();
+            }
+        }
+
+        deadlocked = 0;
+        for (i = 0; i < count && !deadlocked; i++) {
+
+            if ((ret = dbp->put(dbp, tid, &keys[i], &datas[i], 0)) != 0) {
+                if (ret == DB_LOCK_DEADLOCK) {
+                    deadlocked = 1;
+                } else {
+                    char *strError = db_strerror(ret);
+
+                    icalerror_warn("icalbdbset_put_batch failed: ");
+                    icalerror_warn(strError);
+                    tid->abort(tid);
+                    return ICAL_FILE_ERROR;
+                }
+            }
+        }
+
+        if (deadlocked) {
+            tid->abort(tid);
+            retry++;
+            continue;
+        }
+
+        if ((ret = tid->commit(tid, 0)) != 0) {
+            if (ret == DB_LOCK_DEADLOCK) {
+                tid->abort(tid);
+                retry++;
+                continue;
+            } else {
+                /*char *foo = db_strerror(ret); */
+                abort();
+            }
+        }
+
+        done = 1;       /* all is well */
+    }
+
+    if (!done) {
+        if (tid != NULL) {
+            tid->abort(tid);
+        }
+        return ICAL_FILE_ERROR;
+    } else {
+        return ICAL_NO_ERROR;
+    }
+}
+
 int icalbdbset_get(DB *dbp, DB_TXN *tid, DBT *key, DBT *data, u_int32_t flags)
 {
     return dbp->get(dbp, tid, key, data, flags);
@@ -984,6 +1284,7 @@ icalerrorenum icalbdbset_select(icalset *set, icalgauge *gauge)
     icalerror_check_arg_re(gauge != 0, "gauge", ICAL_BADARG_ERROR);
 
     bset->gauge = gauge;
+    icalbdbset_range_close(bset);
 
     return ICAL_NO_ERROR;
 }
@@ -997,6 +1298,7 @@ void icalbdbset_clear(icalset *set)
     icalerror_check_arg_rv((bset != 0), "bset");
 
     bset->gauge = 0;
+    icalbdbset_range_close(bset);
 }
 
 icalcomponent *icalbdbset_fetch(icalset *set, icalcomponent_kind kind, const char *uid)
@@ -1006,6 +1308,24 @@ icalcomponent *icalbdbset_fetch(icalset *set, icalcomponent_kind kind, const cha
 
     icalerror_check_arg_rz((bset != 0), "bset");
 
+    /* A probe on the UID index settles misses without walking the
+       cluster. Uncommitted changes are not in the index yet, and
+       VAGENDAs key on RELCALID, so both fall through to the scan. */
+    if (bset->uid_sdbp != 0 && bset->changed == 0 && uid != 0 &&
+        kind != ICAL_VAGENDA_COMPONENT) {
+        DBT key, data;
+
+        memset(&key, 0, sizeof(DBT));
+        memset(&data, 0, sizeof(DBT));
+        key.data = (char *)uid;
+        key.size = (u_int32_t) strlen(uid);
+        data.flags = DB_DBT_PARTIAL;    /* existence only; skip the data */
+
+        if (bset->uid_sdbp->get(bset->uid_sdbp, NULL, &key, &data, 0) == DB_NOTFOUND) {
+            return 0;
+        }
+    }
+
     for (i = icalcomponent_begin_component(bset->cluster, kind);
          icalcompiter_deref(&i) != 0; icalcompiter_next(&i)) {
 
@@ -1040,12 +1360,26 @@ icalcomponent *icalbdbset_fetch(icalset *set, icalcomponent_kind kind, const cha
     return 0;
 }
 
-int icalbdbset_has_uid(icalset *store, const char *uid)
+int icalbdbset_has_uid(icalset *set, const char *uid)
 {
-    _unused(store);
-    _unused(uid);
-    assert(0);  /* HACK, not implemented */
-    return 0;
+    icalbdbset *bset = (icalbdbset *) set;
+
+    icalerror_check_arg_rz((bset != 0), "bset");
+    icalerror_check_arg_rz((uid != 0), "uid");
+
+    if (bset->uid_sdbp != 0 && bset->changed == 0) {
+        DBT key, data;
+
+        memset(&key, 0, sizeof(DBT));
+        memset(&data, 0, sizeof(DBT));
+        key.data = (char *)uid;
+        key.size = (u_int32_t) strlen(uid);
+        data.flags = DB_DBT_PARTIAL;    /* existence only; skip the data */
+
+        return bset->uid_sdbp->get(bset->uid_sdbp, NULL, &key, &data, 0) == 0;
+    }
+
+    return icalbdbset_fetch(set, ICAL_ANY_COMPONENT, uid) != 0;
 }
 
 /******* support routines for icalbdbset_fetch_match *********/
@@ -1209,13 +1543,175 @@ icalcomponent *icalbdbset_get_current_component(icalset *set)
     return icalcomponent_get_current_component(bset->cluster);
 }
 
+static void icalbdbset_range_close(icalbdbset *bset)
+{
+    if (bset->range_dbcp != 0) {
+        (void)bset->range_dbcp->c_close(bset->range_dbcp);
+        bset->range_dbcp = 0;
+    }
+    bset->range_phase = 0;
+}
+
+/** Maps a primary key from the index back to the in-memory instance
+    that the iteration contract hands out. */
+static icalcomponent *icalbdbset_cluster_by_uid(icalbdbset *bset, const char *uid)
+{
+    icalcompiter i;
+
+    for (i = icalcomponent_begin_component(bset->cluster, ICAL_ANY_COMPONENT);
+         icalcompiter_deref(&i) != 0; icalcompiter_next(&i)) {
+
+        icalcomponent *this = icalcompiter_deref(&i);
+        icalproperty *p = icalcomponent_get_first_property(this, ICAL_UID_PROPERTY);
+        const char *this_uid = NULL;
+
+        if (p != NULL) {
+            this_uid = icalproperty_get_uid(p);
+        } else {
+            p = icalcomponent_get_first_property(this, ICAL_RELCALID_PROPERTY);
+            if (p != NULL) {
+                this_uid = icalproperty_get_relcalid(p);
+            }
+        }
+
+        if (this_uid != NULL && strcmp(uid, this_uid) == 0) {
+            return this;
+        }
+    }
+
+    return 0;
+}
+
+/** Advances the DTSTART-index cursor to the next component passing the
+    gauge. The wildcard region — components a range scan cannot prune —
+    is visited first, then the cursor seeks to the lower bound and
+    walks until the upper bound, so out-of-range records are never
+    touched. Phases: 1/2 first/next in the wildcard region, 3/4
+    first/next in the bounded region, 0 done. */
+static icalcomponent *icalbdbset_range_next(icalbdbset *bset)
+{
+    DBT key, pkey, data;
+    char keystore[64];
+    char uidstore[256];
+
+    while (bset->range_phase != 0) {
+        u_int32_t flags = DB_NEXT;
+        int ret;
+        icalcomponent *c;
+
+        memset(&key, 0, sizeof(DBT));
+        memset(&pkey, 0, sizeof(DBT));
+        memset(&data, 0, sizeof(DBT));
+
+        key.flags = DB_DBT_USERMEM;
+        key.data = keystore;
+        key.ulen = (u_int32_t) sizeof(keystore);
+        pkey.flags = DB_DBT_USERMEM;
+        pkey.data = uidstore;
+        pkey.ulen = (u_int32_t) sizeof(uidstore);
+        data.flags = DB_DBT_PARTIAL;    /* the cluster already holds the parsed component */
+
+        if (bset->range_phase == 1) {
+            flags = DB_FIRST;
+        } else if (bset->range_phase == 3) {
+            if (bset->range_lo[0] == '\0') {
+                flags = DB_FIRST;
+            } else {
+                key.size = (u_int32_t) strlen(bset->range_lo);
+                memcpy(keystore, bset->range_lo, key.size);
+                flags = DB_SET_RANGE;
+            }
+        }
+
+        ret = bset->range_dbcp->c_pget(bset->range_dbcp, &key, &pkey, &data, flags);
+
+        if (ret != 0) {
+            if (ret == DB_NOTFOUND && bset->range_phase <= 2) {
+                /* wildcard region exhausted; seek to the lower bound */
+                bset->range_phase = 3;
+                continue;
+            }
+            icalbdbset_range_close(bset);
+            return 0;
+        }
+
+        if (key.size >= sizeof(keystore) || pkey.size >= sizeof(uidstore)) {
+            /* oversized key; not one of ours */
+            bset->range_phase = (bset->range_phase <= 2) ? 2 : 4;
+            continue;
+        }
+        keystore[key.size] = '\0';
+        uidstore[pkey.size] = '\0';
+
+        if (bset->range_phase <= 2) {
+            if (keystore[0] != ICALBDBSET_RANGE_WILDCARD[0]) {
+                /* past the wildcard region; seek to the lower bound */
+                bset->range_phase = 3;
+                continue;
+            }
+            bset->range_phase = 2;
+        } else {
+            bset->range_phase = 4;
+            /* compare the wall-clock prefix, so a trailing Z does not
+               order a UTC key after a floating bound */
+            if (bset->range_hi[0] != '\0' && strncmp(keystore, bset->range_hi, 15) > 0) {
+                /* sorted, so everything after this is out of range too */
+                icalbdbset_range_close(bset);
+                return 0;
+            }
+        }
+
+        c = icalbdbset_cluster_by_uid(bset, uidstore);
+        if (c != 0 && (bset->gauge == 0 || icalgauge_compare(bset->gauge, c) == 1)) {
+            return c;
+        }
+    }
+
+    return 0;
+}
+
 icalcomponent *icalbdbset_get_first_component(icalset *set)
 {
     icalbdbset *bset = (icalbdbset *) set;
     icalcomponent *c = 0;
+    struct icaltimetype lo, hi;
 
     icalerror_check_arg_rz((bset != 0), "bset");
 
+    /* If the gauge pins DTSTART to a range, drive the scan from the
+       DTSTART index so out-of-range components are never tested.
+       Uncommitted changes are not in the index yet, so fall back to
+       the full scan until the next commit. */
+    icalbdbset_range_close(bset);
+    if (bset->gauge != 0 && bset->dtstart_sdbp != 0 && bset->changed == 0 &&
+        icalgauge_get_dtstart_range(bset->gauge, &lo, &hi)) {
+
+        if (bset->dtstart_sdbp->cursor(bset->dtstart_sdbp, NULL, &bset->range_dbcp, 0) == 0) {
+            if (icaltime_is_null_time(lo)) {
+                /* unbounded below: one pass from the front covers the
+                   wildcard region too */
+                bset->range_lo[0] = '\0';
+                bset->range_phase = 3;
+            } else {
+                strncpy(bset->range_lo, icaltime_as_ical_string(lo),
+                        sizeof(bset->range_lo) - 1);
+                bset->range_lo[sizeof(bset->range_lo) - 1] = '\0';
+                bset->range_phase = 1;
+            }
+
+            if (icaltime_is_null_time(hi)) {
+                bset->range_hi[0] = '\0';
+            } else {
+                strncpy(bset->range_hi, icaltime_as_ical_string(hi),
+                        sizeof(bset->range_hi) - 1);
+                bset->range_hi[sizeof(bset->range_hi) - 1] = '\0';
+            }
+
+            return icalbdbset_range_next(bset);
+        }
+        bset->range_dbcp = 0;
+    }
+
     do {
         if (c == 0) {
             c = icalcomponent_get_first_component(bset->cluster, ICAL_ANY_COMPONENT);
@@ -1577,6 +2073,10 @@ icalcomponent *icalbdbset_get_next_component(icalset *set)
 
     icalerror_check_arg_rz((bset != 0), "bset");
 
+    if (bset->range_phase != 0) {
+        return icalbdbset_range_next(bset);
+    }
+
     do {
         c = icalcomponent_get_next_component(bset->cluster, ICAL_ANY_COMPONENT);
         if (c != 0 && (bset->gauge == 0 || icalgauge_compare(bset->gauge, c) == 1)) {
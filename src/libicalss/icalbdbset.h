@@ -81,6 +81,12 @@ LIBICAL_ICALSS_EXPORT int icalbdbset_delete(DB *dbp, DBT *key);
 
 LIBICAL_ICALSS_EXPORT int icalbdbset_put(DB *dbp, DBT *key, DBT *data, u_int32_t access_method);
 
+/** Writes @p count key/data pairs under one transaction instead of
+    one transaction per icalbdbset_put() call. The batch commits
+    atomically; a deadlock retries the whole batch.
+    @since 3.1.0 */
+LIBICAL_ICALSS_EXPORT int icalbdbset_put_batch(DB *dbp, DBT *keys, DBT *datas, int count);
+
 LIBICAL_ICALSS_EXPORT int icalbdbset_get(DB *dbp, DB_TXN *tid, DBT *key, DBT *data,
                                          u_int32_t flags);
 
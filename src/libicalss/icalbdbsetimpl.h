@@ -40,6 +40,13 @@ struct icalbdbset_impl
     DB *dbp;
     DB *sdbp;
     DBC *dbcp;
+
+    DB *uid_sdbp;       /**< UID secondary index, or 0 */
+    DB *dtstart_sdbp;   /**< DTSTART secondary index, or 0 */
+    DBC *range_dbcp;    /**< cursor over the DTSTART index during a range select, or 0 */
+    int range_phase;    /**< stage of the index-driven range iteration, 0 when inactive */
+    char range_lo[64];  /**< inclusive lower bound key, empty when unbounded */
+    char range_hi[64];  /**< inclusive upper bound key, empty when unbounded */
 };
 
 #endif
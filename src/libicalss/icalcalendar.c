@@ -29,6 +29,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 #define BOOKED_DIR "booked"
 #define INCOMING_FILE "incoming.ics"
 #define PROP_FILE "properties.ics"
@@ -197,11 +201,11 @@ icalset *icalcalendar_get_incoming(icalcalendar *impl)
     strncat(path, INCOMING_FILE, MAXPATHLEN - strlen(path) - 1);
     path[MAXPATHLEN - 1] = '\0';
 
-    if (impl->properties == 0) {
-        impl->properties = icalfileset_new(path);
+    if (impl->incoming == 0) {
+        impl->incoming = icalfileset_new(path);
     }
 
-    return impl->properties;
+    return impl->incoming;
 }
 
 icalset *icalcalendar_get_properties(icalcalendar *impl)
@@ -241,3 +245,84 @@ icalset *icalcalendar_get_freebusy(icalcalendar *impl)
 
     return impl->freebusy;
 }
+
+struct icalcalendar_preload_job
+{
+    icalcalendar *cal;
+    icalset *(*get) (icalcalendar *cal);
+    icalset *result;
+};
+
+static void *icalcalendar_preload_run(void *data)
+{
+    struct icalcalendar_preload_job *job = data;
+
+    job->result = (*job->get) (job->cal);
+
+    return 0;
+}
+
+int icalcalendar_preload(icalcalendar *impl, int members)
+{
+    struct icalcalendar_preload_job jobs[4];
+    int n_jobs = 0;
+    int warmed = 0;
+    int i;
+
+    icalerror_check_arg_rx((impl != 0), "impl", -1);
+
+    if (members & ICALCALENDAR_PRELOAD_BOOKED) {
+        jobs[n_jobs++].get = icalcalendar_get_booked;
+    }
+    if (members & ICALCALENDAR_PRELOAD_INCOMING) {
+        jobs[n_jobs++].get = icalcalendar_get_incoming;
+    }
+    if (members & ICALCALENDAR_PRELOAD_PROPERTIES) {
+        jobs[n_jobs++].get = icalcalendar_get_properties;
+    }
+    if (members & ICALCALENDAR_PRELOAD_FREEBUSY) {
+        jobs[n_jobs++].get = icalcalendar_get_freebusy;
+    }
+
+    for (i = 0; i < n_jobs; i++) {
+        jobs[i].cal = impl;
+        jobs[i].result = 0;
+    }
+
+    /* Each getter opens and caches a different member set, so the jobs
+       never touch the same field and can run side by side. */
+#if defined(HAVE_PTHREAD)
+    if (n_jobs > 1) {
+        pthread_t threads[4];
+        int n_threads = 0;
+
+        for (i = 1; i < n_jobs; i++) {
+            if (pthread_create(&threads[n_threads], 0, icalcalendar_preload_run, &jobs[i]) == 0) {
+                n_threads++;
+            } else {
+                icalcalendar_preload_run(&jobs[i]);
+            }
+        }
+
+        icalcalendar_preload_run(&jobs[0]);
+
+        for (i = 0; i < n_threads; i++) {
+            pthread_join(threads[i], 0);
+        }
+    } else if (n_jobs == 1) {
+        icalcalendar_preload_run(&jobs[0]);
+    }
+#else
+    for (i = 0; i < n_jobs; i++) {
+        icalcalendar_preload_run(&jobs[i]);
+    }
+#endif
+
+    for (i = 0; i < n_jobs; i++) {
+        if (jobs[i].result != 0) {
+            warmed++;
+        }
+    }
+
+    return warmed;
+}
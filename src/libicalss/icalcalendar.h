@@ -56,4 +56,30 @@ LIBICAL_ICALSS_EXPORT icalset *icalcalendar_get_properties(icalcalendar *calenda
 
 LIBICAL_ICALSS_EXPORT icalset *icalcalendar_get_freebusy(icalcalendar *calendar);
 
+/** Selects which member sets icalcalendar_preload() warms. */
+typedef enum icalcalendar_preload_members
+{
+    ICALCALENDAR_PRELOAD_BOOKED = 1,
+    ICALCALENDAR_PRELOAD_INCOMING = 2,
+    ICALCALENDAR_PRELOAD_PROPERTIES = 4,
+    ICALCALENDAR_PRELOAD_FREEBUSY = 8,
+    ICALCALENDAR_PRELOAD_ALL = 15
+} icalcalendar_preload_members;
+
+/**
+ * @brief Opens and parses the selected member sets ahead of first use,
+ * side by side on one thread per member where threads are available.
+ * @param members a bitwise OR of icalcalendar_preload_members values.
+ * @return the number of member sets that are now warm, or -1 on error.
+ * @since 3.1.0
+ *
+ * The calendar opens its booked, incoming, properties and freebusy
+ * sets lazily, so the first access to each pays the full open-and-parse
+ * latency. Calling this right after icalcalendar_new() moves that cost
+ * off the request path; warmed sets stay pinned in the calendar until
+ * icalcalendar_free(), exactly as if they had been touched through the
+ * getters.
+ */
+LIBICAL_ICALSS_EXPORT int icalcalendar_preload(icalcalendar *calendar, int members);
+
 #endif /* !ICALCALENDAR_H */
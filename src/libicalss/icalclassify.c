@@ -22,19 +22,23 @@
 
 #include "icalclassify.h"
 #include "icalmemory.h"
+#include "icalvalue.h"
 
 #include <ctype.h>
 #include <stdlib.h>
 
+/* The string members borrow their storage from the component the parts
+   were extracted from; they are valid only as long as the component is,
+   and there is nothing to free. */
 struct icalclassify_parts
 {
     icalcomponent *c;
     icalcomponent_kind inner_kind;
     icalproperty_method method;
-    char *organizer;
+    const char *organizer;
     icalparameter_partstat reply_partstat;
-    char *reply_attendee;
-    char *uid;
+    const char *reply_attendee;
+    const char *uid;
     int sequence;
     struct icaltimetype dtstamp;
     struct icaltimetype recurrence_id;
@@ -103,22 +107,34 @@ icalcomponent *icalclassify_find_overlaps(icalset *set, icalcomponent *comp)
     }
 }
 
+/** Compares two strings without regard to case, so that attendee
+    addresses can be matched without making lowercased copies of them
+    first. */
+static int icalclassify_strieq(const char *a, const char *b)
+{
+    for (; *a != 0 && *b != 0; a++, b++) {
+        if (tolower((int)*a) != tolower((int)*b)) {
+            return 0;
+        }
+    }
+
+    return *a == *b;
+}
+
 icalproperty *icalclassify_find_attendee(icalcomponent *c, const char *attendee)
 {
     icalproperty *p;
     icalcomponent *inner;
-    char *lattendee;
-    char *upn;
+    const char *upn;
 
     if (attendee == 0) {
         return 0;
     }
 
-    lattendee = icalclassify_lowercase(attendee);
-    upn = strchr(lattendee, ':');
+    upn = strchr(attendee, ':');
 
     if (upn == 0) {
-        upn = lattendee;
+        upn = attendee;
     } else {
         upn++;  /* skip the ";" */
     }
@@ -128,8 +144,8 @@ icalproperty *icalclassify_find_attendee(icalcomponent *c, const char *attendee)
     for (p = icalcomponent_get_first_property(inner, ICAL_ATTENDEE_PROPERTY);
          p != 0;
          p = icalcomponent_get_next_property(inner, ICAL_ATTENDEE_PROPERTY)) {
-        char *this_upn;
-        char *this_attendee = icalclassify_lowercase(icalproperty_get_attendee(p));
+        const char *this_upn;
+        const char *this_attendee = icalproperty_get_attendee(p);
 
         if (!this_attendee)
             continue;
@@ -137,44 +153,19 @@ icalproperty *icalclassify_find_attendee(icalcomponent *c, const char *attendee)
         this_upn = strchr(this_attendee, ':');
 
         if (this_upn == 0) {
-            free(this_attendee);
             continue;
         } else {
             this_upn++;
         }
 
-        if (strcmp(this_upn, upn) == 0) {
-            free(lattendee);
-            free(this_attendee);
+        if (icalclassify_strieq(this_upn, upn)) {
             return p;
         }
-
-        free(this_attendee);
     }
-    free(lattendee);
 
     return 0;
 }
 
-void icalssutil_free_parts(struct icalclassify_parts *parts)
-{
-    if (parts == 0) {
-        return;
-    }
-
-    if (parts->organizer != 0) {
-        free(parts->organizer);
-    }
-
-    if (parts->uid != 0) {
-        free(parts->uid);
-    }
-
-    if (parts->reply_attendee) {
-        free(parts->reply_attendee);
-    }
-}
-
 void icalssutil_get_parts(icalcomponent *c, struct icalclassify_parts *parts)
 {
     icalproperty *p;
@@ -203,11 +194,7 @@ void icalssutil_get_parts(icalcomponent *c, struct icalclassify_parts *parts)
 
     p = icalcomponent_get_first_property(inner, ICAL_ORGANIZER_PROPERTY);
     if (p != 0) {
-        const char *p_organizer = icalproperty_get_organizer(p);
-
-        if (p_organizer != 0) {
-            parts->organizer = strdup(p_organizer);
-        }
+        parts->organizer = icalproperty_get_organizer(p);
     }
 
     p = icalcomponent_get_first_property(inner, ICAL_SEQUENCE_PROPERTY);
@@ -217,11 +204,7 @@ void icalssutil_get_parts(icalcomponent *c, struct icalclassify_parts *parts)
 
     p = icalcomponent_get_first_property(inner, ICAL_UID_PROPERTY);
     if (p != 0) {
-        const char *p_uid = icalproperty_get_uid(p);
-
-        if (p_uid != 0) {
-            parts->uid = strdup(p_uid);
-        }
+        parts->uid = icalproperty_get_uid(p);
     }
 
     p = icalcomponent_get_first_property(inner, ICAL_RECURRENCEID_PROPERTY);
@@ -240,25 +223,67 @@ void icalssutil_get_parts(icalcomponent *c, struct icalclassify_parts *parts)
         p = icalcomponent_get_first_property(inner, ICAL_ATTENDEE_PROPERTY);
 
         if (p != 0) {
-            const char *attendee = 0;
-
             param = icalproperty_get_first_parameter(p, ICAL_PARTSTAT_PARAMETER);
 
             if (param != 0) {
                 parts->reply_partstat = icalparameter_get_partstat(param);
             }
-            attendee = icalproperty_get_attendee(p);
-            if (attendee)
-                parts->reply_attendee = strdup(attendee);
+            parts->reply_attendee = icalproperty_get_attendee(p);
+        }
+    }
+}
+
+/** Returns nonzero if @p p1 and @p p2 do not have identical content.
+    Time-valued properties carrying at most a TZID parameter -- the
+    common shape for DTSTART and DTEND -- are compared in place; every
+    other shape falls back to comparing the serialized text. */
+static int icalssutil_property_differs(icalproperty *p1, icalproperty *p2)
+{
+    icalvalue *v1 = icalproperty_get_value(p1);
+    icalvalue *v2 = icalproperty_get_value(p2);
+    char *temp1, *temp2;
+    int cmp;
+
+    if (v1 != 0 && v2 != 0 && icalvalue_isa(v1) == icalvalue_isa(v2) &&
+        (icalvalue_isa(v1) == ICAL_DATETIME_VALUE || icalvalue_isa(v1) == ICAL_DATE_VALUE)) {
+        icalparameter *param1 = icalproperty_get_first_parameter(p1, ICAL_TZID_PARAMETER);
+        icalparameter *param2 = icalproperty_get_first_parameter(p2, ICAL_TZID_PARAMETER);
+
+        if (icalproperty_count_parameters(p1) == (param1 != 0 ? 1 : 0) &&
+            icalproperty_count_parameters(p2) == (param2 != 0 ? 1 : 0)) {
+            struct icaltimetype t1 = icalvalue_get_datetime(v1);
+            struct icaltimetype t2 = icalvalue_get_datetime(v2);
+
+            if ((param1 != 0) ^ (param2 != 0)) {
+                return 1;
+            }
+
+            if (param1 != 0 &&
+                strcmp(icalparameter_get_tzid(param1), icalparameter_get_tzid(param2)) != 0) {
+                return 1;
+            }
+
+            if (icaltime_is_utc(t1) != icaltime_is_utc(t2)) {
+                return 1;
+            }
+
+            return icaltime_compare(t1, t2) != 0;
         }
     }
+
+    temp1 = icalproperty_as_ical_string_r(p1);
+    temp2 = icalproperty_as_ical_string_r(p2);
+    cmp = strcmp(temp1, temp2);
+    free(temp1);
+    free(temp2);
+
+    return cmp != 0;
 }
 
 int icalssutil_is_rescheduled(icalcomponent *a, icalcomponent *b)
 {
     icalproperty *p1, *p2;
     icalcomponent *i1, *i2;
-    char *temp1, *temp2;
     int i;
 
     icalproperty_kind kind_array[] = {
@@ -277,8 +302,6 @@ int icalssutil_is_rescheduled(icalcomponent *a, icalcomponent *b)
     i2 = icalcomponent_get_first_real_component(b);
 
     for (i = 0; kind_array[i] != ICAL_NO_PROPERTY; i++) {
-        int cmp;
-
         p1 = icalcomponent_get_first_property(i1, kind_array[i]);
         p2 = icalcomponent_get_first_property(i2, kind_array[i]);
 
@@ -289,13 +312,7 @@ int icalssutil_is_rescheduled(icalcomponent *a, icalcomponent *b)
         } else if (!p1 && !p2)
             continue;
 
-        temp1 = icalproperty_as_ical_string_r(p1);
-        temp2 = icalproperty_as_ical_string_r(p2);
-        cmp = strcmp(temp1, temp2);
-        free(temp1);
-        free(temp2);
-
-        if (p1 && cmp != 0) {
+        if (icalssutil_property_differs(p1, p2)) {
             return 1;
         }
     }
@@ -668,22 +685,19 @@ icalproperty_xlicclass icalclassify(icalcomponent *c, icalcomponent *match, cons
         if (comp_parts.sequence < match_parts.sequence &&
             icaltime_compare(comp_parts.dtstamp, match_parts.dtstamp) > 0) {
             /* comp has a smaller sequence and a later DTSTAMP */
-            class = ICAL_XLICCLASS_MISSEQUENCED;
-            goto CLEANUP;
+            return ICAL_XLICCLASS_MISSEQUENCED;
         }
 
         if ((comp_parts.sequence < match_parts.sequence) ||
             (comp_parts.sequence == match_parts.sequence &&
              icaltime_compare(comp_parts.dtstamp, match_parts.dtstamp) <= 0)) {
-            class = ICAL_XLICCLASS_OBSOLETE;
-            goto CLEANUP;
+            return ICAL_XLICCLASS_OBSOLETE;
         }
     }
 
     p = icalcomponent_get_first_property(c, ICAL_METHOD_PROPERTY);
     if (p == 0) {
-        class = ICAL_XLICCLASS_UNKNOWN;
-        goto CLEANUP;
+        return ICAL_XLICCLASS_UNKNOWN;
     }
     method = icalproperty_get_method(p);
 
@@ -696,9 +710,5 @@ icalproperty_xlicclass icalclassify(icalcomponent *c, icalcomponent *match, cons
         }
     }
 
-  CLEANUP:
-    icalssutil_free_parts(&comp_parts);
-    icalssutil_free_parts(&match_parts);
-
     return class;
 }
@@ -33,8 +33,11 @@
 
 #include "icalcluster.h"
 #include "icalclusterimpl.h"
+#include "icalvalue.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 static icalcluster *icalcluster_new_impl(void)
 {
@@ -218,3 +221,365 @@ icalcomponent *icalcluster_get_next_component(icalcluster *impl)
 
     return icalcomponent_get_next_component(impl->data, ICAL_ANY_COMPONENT);
 }
+
+/* The binary cache format. The file is a fixed header followed by one
+   tagged record per component, property and parameter; values and
+   parameters are stored as their iCalendar strings together with their
+   kind, so loading rebuilds the tree through the value and parameter
+   constructors and never touches the text parser. Integers are written
+   in little-endian byte order regardless of host. */
+
+#define ICALCLUSTER_BINARY_MAGIC "bICL"
+#define ICALCLUSTER_BINARY_VERSION 1
+
+/* Record tags */
+#define ICALCLUSTER_BIN_END 0
+#define ICALCLUSTER_BIN_COMPONENT 1
+#define ICALCLUSTER_BIN_PROPERTY 2
+#define ICALCLUSTER_BIN_PARAMETER 3
+
+/** Upper bound on a stored string, to catch corrupt length fields
+    before they turn into huge allocations */
+#define ICALCLUSTER_BIN_MAX_STRING (1 << 24)
+
+static int icalcluster_bin_put_u8(FILE *f, unsigned char v)
+{
+    return fputc(v, f) != EOF;
+}
+
+static int icalcluster_bin_put_u32(FILE *f, unsigned long v)
+{
+    return fputc((int)(v & 0xff), f) != EOF &&
+        fputc((int)((v >> 8) & 0xff), f) != EOF &&
+        fputc((int)((v >> 16) & 0xff), f) != EOF && fputc((int)((v >> 24) & 0xff), f) != EOF;
+}
+
+static int icalcluster_bin_put_string(FILE *f, const char *s)
+{
+    size_t len = (s != 0) ? strlen(s) : 0;
+
+    if (!icalcluster_bin_put_u32(f, (unsigned long)len)) {
+        return 0;
+    }
+
+    return len == 0 || fwrite(s, 1, len, f) == len;
+}
+
+static int icalcluster_bin_write_property(FILE *f, icalproperty *prop)
+{
+    icalproperty_kind pkind = icalproperty_isa(prop);
+    const char *xname = (pkind == ICAL_X_PROPERTY) ? icalproperty_get_x_name(prop) : 0;
+    icalvalue *value = icalproperty_get_value(prop);
+    icalparameter *param;
+
+    if (!icalcluster_bin_put_u8(f, ICALCLUSTER_BIN_PROPERTY) ||
+        !icalcluster_bin_put_u32(f, (unsigned long)pkind) ||
+        !icalcluster_bin_put_string(f, xname)) {
+        return 0;
+    }
+
+    if (value != 0) {
+        char *str = icalvalue_as_ical_string_r(value);
+        int ok;
+
+        ok = icalcluster_bin_put_u8(f, 1) &&
+            icalcluster_bin_put_u32(f, (unsigned long)icalvalue_isa(value)) &&
+            icalcluster_bin_put_string(f, (str != 0) ? str : "");
+        if (str != 0) {
+            free(str);
+        }
+        if (!ok) {
+            return 0;
+        }
+    } else if (!icalcluster_bin_put_u8(f, 0)) {
+        return 0;
+    }
+
+    for (param = icalproperty_get_first_parameter(prop, ICAL_ANY_PARAMETER);
+         param != 0; param = icalproperty_get_next_parameter(prop, ICAL_ANY_PARAMETER)) {
+        char *str = icalparameter_as_ical_string_r(param);
+        int ok;
+
+        ok = icalcluster_bin_put_u8(f, ICALCLUSTER_BIN_PARAMETER) &&
+            icalcluster_bin_put_string(f, (str != 0) ? str : "");
+        if (str != 0) {
+            free(str);
+        }
+        if (!ok) {
+            return 0;
+        }
+    }
+
+    return icalcluster_bin_put_u8(f, ICALCLUSTER_BIN_END);
+}
+
+static int icalcluster_bin_write_component(FILE *f, icalcomponent *comp)
+{
+    icalcomponent_kind kind = icalcomponent_isa(comp);
+    icalproperty *prop;
+    icalcomponent *sub;
+
+    /* X component names have no public accessor, so such trees cannot
+       round-trip; the caller falls back to the text format */
+    if (kind == ICAL_X_COMPONENT || kind == ICAL_NO_COMPONENT) {
+        return 0;
+    }
+
+    if (!icalcluster_bin_put_u8(f, ICALCLUSTER_BIN_COMPONENT) ||
+        !icalcluster_bin_put_u32(f, (unsigned long)kind)) {
+        return 0;
+    }
+
+    for (prop = icalcomponent_get_first_property(comp, ICAL_ANY_PROPERTY);
+         prop != 0; prop = icalcomponent_get_next_property(comp, ICAL_ANY_PROPERTY)) {
+        if (!icalcluster_bin_write_property(f, prop)) {
+            return 0;
+        }
+    }
+
+    for (sub = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         sub != 0; sub = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        if (!icalcluster_bin_write_component(f, sub)) {
+            return 0;
+        }
+    }
+
+    return icalcluster_bin_put_u8(f, ICALCLUSTER_BIN_END);
+}
+
+icalerrorenum icalcluster_commit_binary(icalcluster *impl, const char *path)
+{
+    FILE *f;
+    int ok;
+
+    icalerror_check_arg_re((impl != 0), "cluster", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((path != 0), "path", ICAL_BADARG_ERROR);
+
+    if ((f = fopen(path, "wb")) == 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    ok = fwrite(ICALCLUSTER_BINARY_MAGIC, 1, 4, f) == 4 &&
+        icalcluster_bin_put_u32(f, ICALCLUSTER_BINARY_VERSION) &&
+        icalcluster_bin_write_component(f, impl->data);
+
+    if (fclose(f) != 0) {
+        ok = 0;
+    }
+
+    if (!ok) {
+        /* Never leave a truncated cache behind */
+        (void)remove(path);
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    impl->changed = 0;
+
+    return ICAL_NO_ERROR;
+}
+
+static int icalcluster_bin_get_u8(FILE *f, unsigned char *v)
+{
+    int c = fgetc(f);
+
+    if (c == EOF) {
+        return 0;
+    }
+    *v = (unsigned char)c;
+
+    return 1;
+}
+
+static int icalcluster_bin_get_u32(FILE *f, unsigned long *v)
+{
+    unsigned char b[4];
+
+    if (fread(b, 1, 4, f) != 4) {
+        return 0;
+    }
+    *v = (unsigned long)b[0] | ((unsigned long)b[1] << 8) |
+        ((unsigned long)b[2] << 16) | ((unsigned long)b[3] << 24);
+
+    return 1;
+}
+
+static char *icalcluster_bin_get_string(FILE *f)
+{
+    unsigned long len;
+    char *s;
+
+    if (!icalcluster_bin_get_u32(f, &len) || len > ICALCLUSTER_BIN_MAX_STRING) {
+        return 0;
+    }
+
+    if ((s = malloc((size_t)len + 1)) == 0) {
+        return 0;
+    }
+
+    if (len != 0 && fread(s, 1, (size_t)len, f) != (size_t)len) {
+        free(s);
+        return 0;
+    }
+    s[len] = '\0';
+
+    return s;
+}
+
+static icalproperty *icalcluster_bin_read_property(FILE *f)
+{
+    unsigned long pkind, vkind;
+    unsigned char has_value, tag;
+    char *xname;
+    icalproperty *prop;
+
+    if (!icalcluster_bin_get_u32(f, &pkind) ||
+        !icalproperty_kind_is_valid((icalproperty_kind) pkind) ||
+        (xname = icalcluster_bin_get_string(f)) == 0) {
+        return 0;
+    }
+
+    if ((prop = icalproperty_new((icalproperty_kind) pkind)) == 0) {
+        free(xname);
+        return 0;
+    }
+
+    if (*xname != '\0') {
+        icalproperty_set_x_name(prop, xname);
+    }
+    free(xname);
+
+    if (!icalcluster_bin_get_u8(f, &has_value)) {
+        goto error;
+    }
+
+    if (has_value) {
+        char *str;
+        icalvalue *value;
+
+        if (!icalcluster_bin_get_u32(f, &vkind) ||
+            !icalvalue_kind_is_valid((icalvalue_kind) vkind) ||
+            (str = icalcluster_bin_get_string(f)) == 0) {
+            goto error;
+        }
+
+        value = icalvalue_new_from_string((icalvalue_kind) vkind, str);
+        free(str);
+        if (value == 0) {
+            goto error;
+        }
+        icalproperty_set_value(prop, value);
+    }
+
+    for (;;) {
+        char *str;
+        icalparameter *param;
+
+        if (!icalcluster_bin_get_u8(f, &tag)) {
+            goto error;
+        }
+        if (tag == ICALCLUSTER_BIN_END) {
+            return prop;
+        }
+        if (tag != ICALCLUSTER_BIN_PARAMETER || (str = icalcluster_bin_get_string(f)) == 0) {
+            goto error;
+        }
+
+        param = icalparameter_new_from_string(str);
+        free(str);
+        if (param == 0) {
+            goto error;
+        }
+        icalproperty_add_parameter(prop, param);
+    }
+
+  error:
+    icalproperty_free(prop);
+    return 0;
+}
+
+static icalcomponent *icalcluster_bin_read_component(FILE *f, icalcomponent_kind kind)
+{
+    icalcomponent *comp;
+    unsigned char tag;
+
+    if (!icalcomponent_kind_is_valid(kind) || (comp = icalcomponent_new(kind)) == 0) {
+        return 0;
+    }
+
+    for (;;) {
+        if (!icalcluster_bin_get_u8(f, &tag)) {
+            break;
+        }
+
+        if (tag == ICALCLUSTER_BIN_END) {
+            return comp;
+        } else if (tag == ICALCLUSTER_BIN_PROPERTY) {
+            icalproperty *prop = icalcluster_bin_read_property(f);
+
+            if (prop == 0) {
+                break;
+            }
+            icalcomponent_add_property(comp, prop);
+        } else if (tag == ICALCLUSTER_BIN_COMPONENT) {
+            unsigned long ckind;
+            icalcomponent *sub;
+
+            if (!icalcluster_bin_get_u32(f, &ckind) ||
+                (sub = icalcluster_bin_read_component(f, (icalcomponent_kind) ckind)) == 0) {
+                break;
+            }
+            icalcomponent_add_component(comp, sub);
+        } else {
+            break;
+        }
+    }
+
+    icalcomponent_free(comp);
+    return 0;
+}
+
+icalcluster *icalcluster_load_binary(const char *path)
+{
+    FILE *f;
+    char magic[4];
+    unsigned long version, kind;
+    unsigned char tag;
+    icalcomponent *data = 0;
+    struct icalcluster_impl *impl;
+
+    icalerror_check_arg_rz((path != 0), "path");
+
+    if ((f = fopen(path, "rb")) == 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return 0;
+    }
+
+    if (fread(magic, 1, 4, f) == 4 &&
+        memcmp(magic, ICALCLUSTER_BINARY_MAGIC, 4) == 0 &&
+        icalcluster_bin_get_u32(f, &version) &&
+        version == ICALCLUSTER_BINARY_VERSION &&
+        icalcluster_bin_get_u8(f, &tag) &&
+        tag == ICALCLUSTER_BIN_COMPONENT && icalcluster_bin_get_u32(f, &kind)) {
+        data = icalcluster_bin_read_component(f, (icalcomponent_kind) kind);
+    }
+
+    fclose(f);
+
+    if (data == 0) {
+        icalerror_set_errno(ICAL_MALFORMEDDATA_ERROR);
+        return 0;
+    }
+
+    if ((impl = icalcluster_new_impl()) == 0) {
+        icalcomponent_free(data);
+        return 0;
+    }
+
+    impl->key = strdup(path);
+    impl->data = data;
+    impl->changed = 0;
+
+    return impl;
+}
@@ -62,6 +62,38 @@ LIBICAL_ICALSS_EXPORT icalcomponent *icalcluster_get_first_component(icalcluster
 
 LIBICAL_ICALSS_EXPORT icalcomponent *icalcluster_get_next_component(icalcluster *cluster);
 
+/**
+ * @brief Writes the cluster to @p path in the binary cache format.
+ * @return ::ICAL_NO_ERROR on success, ::ICAL_FILE_ERROR if the file
+ * cannot be written or the tree contains an experimental (X-) component,
+ * which the format cannot represent.
+ * @since 3.1.0
+ *
+ * The binary format is a versioned stream of tagged records, one per
+ * component, property and parameter, with property values stored
+ * alongside their value kind. Loading it rebuilds the component tree
+ * without going through the text parser, which is the dominant cost of
+ * reopening a large cluster. The file is a cache, not an interchange
+ * format: integers are written in a fixed byte order but no provision
+ * is made for reading caches produced by other libical versions — a
+ * version mismatch simply makes icalcluster_load_binary() fail, and the
+ * caller regenerates the cache from the ICS text.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalcluster_commit_binary(icalcluster *cluster,
+                                                              const char *path);
+
+/**
+ * @brief Loads a cluster previously written by icalcluster_commit_binary().
+ * @return A new cluster whose key is @p path, or NULL — with icalerrno
+ * set to ::ICAL_FILE_ERROR or ::ICAL_MALFORMEDDATA_ERROR — if the file
+ * is missing, truncated, corrupt or of a different format version.
+ * @since 3.1.0
+ *
+ * A NULL return is not fatal; it means the cache cannot be used and the
+ * ICS text should be parsed instead.
+ */
+LIBICAL_ICALSS_EXPORT icalcluster *icalcluster_load_binary(const char *path);
+
 /**
  * @copydoc icalcluster_new()
  * @deprecated use icalcluster_clone() instead
@@ -27,6 +27,7 @@
 #include "icaldirset.h"
 #include "icaldirsetimpl.h"
 #include "icalfileset.h"
+#include "icalthreadpool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -39,9 +40,22 @@
 #include <sys/utsname.h>
 #endif
 
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 /** Default options used when NULL is passed to icalset_new() **/
 static icaldirset_options icaldirset_options_default = { O_RDWR | O_CREAT };
 
+/** Name of the persistent UID index sidecar inside the store directory */
+#define ICALDIRSET_INDEX_NAME ".icalindex"
+
+static void icaldirset_index_load(icaldirset *dset);
+static void icaldirset_index_save(icaldirset *dset);
+static void icaldirset_index_set(icaldirset *dset, const char *uid, const char *cluster);
+static void icaldirset_index_remove(icaldirset *dset, const char *uid);
+static struct icaldirset_uid_entry *icaldirset_index_find(icaldirset *dset, const char *uid);
+
 const char *icaldirset_path(icalset *set)
 {
     icaldirset *dset = (icaldirset *) set;
@@ -69,9 +83,285 @@ icalerrorenum icaldirset_commit(icalset *set)
     (void)fileset->commit(fileset);
     fileset->free(fileset);
 
+    icaldirset_index_save(dset);
+
     return ICAL_NO_ERROR;
 }
 
+/* The persistent UID index. Each line of the sidecar file maps a UID to
+   the name of the cluster file holding its component, so a fetch opens
+   one cluster instead of walking them month by month. The index is a
+   hint, not a source of truth: a stale or missing entry makes fetch
+   fall back to the cluster walk and repair the entry, so a sidecar
+   written by an older version (or deleted by hand) only costs speed. */
+
+static size_t icaldirset_index_hash(const char *uid)
+{
+    size_t hash = 5381;
+
+    while (*uid) {
+        hash = hash * 33 + (size_t)(unsigned char)*uid++;
+    }
+
+    return hash % ICALDIRSET_INDEX_BUCKETS;
+}
+
+/** Loads the sidecar into the in-memory hash the first time the index
+    is consulted. A missing sidecar just leaves the index empty; it is
+    then warmed incrementally by adds and successful fetches. */
+static void icaldirset_index_load(icaldirset *dset)
+{
+    char path[MAXPATHLEN];
+    char line[MAXPATHLEN * 2];
+    FILE *f;
+
+    if (dset->uid_index != 0) {
+        return;
+    }
+
+    dset->uid_index =
+        calloc(ICALDIRSET_INDEX_BUCKETS, sizeof(struct icaldirset_uid_entry *));
+    if (dset->uid_index == 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dset->dir, ICALDIRSET_INDEX_NAME);
+
+    f = fopen(path, "r");
+    if (f == 0) {
+        return;
+    }
+
+    while (fgets(line, (int)sizeof(line), f) != 0) {
+        char *sep = strchr(line, '\t');
+        char *eol;
+
+        if (sep == 0) {
+            continue;
+        }
+        *sep = '\0';
+
+        eol = strpbrk(sep + 1, "\r\n");
+        if (eol != 0) {
+            *eol = '\0';
+        }
+
+        icaldirset_index_set(dset, line, sep + 1);
+    }
+
+    fclose(f);
+
+    /* The in-memory index now matches the sidecar */
+    dset->uid_index_dirty = 0;
+}
+
+/** Writes the in-memory index back to the sidecar if it has changed. */
+static void icaldirset_index_save(icaldirset *dset)
+{
+    char path[MAXPATHLEN];
+    FILE *f;
+    size_t bucket;
+
+    if (dset->uid_index == 0 || dset->uid_index_dirty == 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", dset->dir, ICALDIRSET_INDEX_NAME);
+
+    f = fopen(path, "w");
+    if (f == 0) {
+        return;
+    }
+
+    for (bucket = 0; bucket < ICALDIRSET_INDEX_BUCKETS; bucket++) {
+        struct icaldirset_uid_entry *entry;
+
+        for (entry = dset->uid_index[bucket]; entry != 0; entry = entry->next) {
+            fprintf(f, "%s\t%s\n", entry->uid, entry->cluster);
+        }
+    }
+
+    fclose(f);
+    dset->uid_index_dirty = 0;
+}
+
+static struct icaldirset_uid_entry *icaldirset_index_find(icaldirset *dset, const char *uid)
+{
+    struct icaldirset_uid_entry *entry;
+
+    if (dset->uid_index == 0) {
+        return 0;
+    }
+
+    for (entry = dset->uid_index[icaldirset_index_hash(uid)]; entry != 0; entry = entry->next) {
+        if (strcmp(entry->uid, uid) == 0) {
+            return entry;
+        }
+    }
+
+    return 0;
+}
+
+static void icaldirset_index_set(icaldirset *dset, const char *uid, const char *cluster)
+{
+    struct icaldirset_uid_entry *entry;
+    char *cluster_copy;
+
+    if (dset->uid_index == 0) {
+        return;
+    }
+
+    cluster_copy = strdup(cluster);
+    if (cluster_copy == 0) {
+        return;
+    }
+
+    entry = icaldirset_index_find(dset, uid);
+    if (entry != 0) {
+        free(entry->cluster);
+        entry->cluster = cluster_copy;
+        dset->uid_index_dirty = 1;
+        return;
+    }
+
+    entry = malloc(sizeof(struct icaldirset_uid_entry));
+    if (entry == 0) {
+        free(cluster_copy);
+        return;
+    }
+
+    entry->uid = strdup(uid);
+    if (entry->uid == 0) {
+        free(cluster_copy);
+        free(entry);
+        return;
+    }
+
+    entry->cluster = cluster_copy;
+    entry->next = dset->uid_index[icaldirset_index_hash(uid)];
+    dset->uid_index[icaldirset_index_hash(uid)] = entry;
+    dset->uid_index_dirty = 1;
+}
+
+static void icaldirset_index_remove(icaldirset *dset, const char *uid)
+{
+    struct icaldirset_uid_entry **link;
+
+    if (dset->uid_index == 0) {
+        return;
+    }
+
+    for (link = &dset->uid_index[icaldirset_index_hash(uid)]; *link != 0;
+         link = &(*link)->next) {
+
+        if (strcmp((*link)->uid, uid) == 0) {
+            struct icaldirset_uid_entry *entry = *link;
+
+            *link = entry->next;
+            free(entry->uid);
+            free(entry->cluster);
+            free(entry);
+            dset->uid_index_dirty = 1;
+            return;
+        }
+    }
+}
+
+static void icaldirset_index_free(icaldirset *dset)
+{
+    size_t bucket;
+
+    if (dset->uid_index == 0) {
+        return;
+    }
+
+    for (bucket = 0; bucket < ICALDIRSET_INDEX_BUCKETS; bucket++) {
+        struct icaldirset_uid_entry *entry = dset->uid_index[bucket];
+
+        while (entry != 0) {
+            struct icaldirset_uid_entry *next = entry->next;
+
+            free(entry->uid);
+            free(entry->cluster);
+            free(entry);
+            entry = next;
+        }
+    }
+
+    free(dset->uid_index);
+    dset->uid_index = 0;
+}
+
+/** Returns the cluster file name within the store directory, given the
+    full key of a cluster. */
+static const char *icaldirset_cluster_name(const char *key)
+{
+    const char *slash = strrchr(key, '/');
+
+    return (slash != 0) ? slash + 1 : key;
+}
+
+/** Returns the UID a fetch would match for this component: the UID of
+    the first real inner component when there is one, else the UID on
+    the component itself. */
+static const char *icaldirset_component_uid(icalcomponent *comp)
+{
+    icalcomponent *inner = icalcomponent_get_first_real_component(comp);
+    icalproperty *p = 0;
+
+    if (inner != 0) {
+        p = icalcomponent_get_first_property(inner, ICAL_UID_PROPERTY);
+    }
+    if (p == 0) {
+        p = icalcomponent_get_first_property(comp, ICAL_UID_PROPERTY);
+    }
+
+    return (p != 0) ? icalproperty_get_uid(p) : 0;
+}
+
+/** Returns false only when the cluster file named @p name — a YYYYMM
+    month, as written by icaldirset_component_cluster() — cannot hold a
+    component whose clustering date falls in [@p start, @p end]. Names
+    that do not parse as month clusters are never pruned. */
+static int icaldirset_cluster_in_range(const char *name,
+                                       struct icaltimetype start, struct icaltimetype end)
+{
+    int year = 0, month = 0;
+    char trailing;
+
+    if (sscanf(name, "%4d%2d%c", &year, &month, &trailing) != 2 || month < 1 || month > 12) {
+        return 1;
+    }
+
+    if (!icaltime_is_null_time(start) &&
+        year * 12 + month < start.year * 12 + start.month) {
+        return 0;
+    }
+
+    if (!icaltime_is_null_time(end) && year * 12 + month > end.year * 12 + end.month) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/** Advances @p iter past clusters the selected gauge's DTSTART range
+    can never match. Returns @p iter unchanged when no range is known. */
+static pvl_elem icaldirset_skip_pruned(icaldirset *dset, pvl_elem iter)
+{
+    if (dset->gauge_has_range == 0) {
+        return iter;
+    }
+
+    while (iter != 0 &&
+           !icaldirset_cluster_in_range((char *)pvl_data(iter),
+                                        dset->gauge_start, dset->gauge_end)) {
+        iter = pvl_next(iter);
+    }
+
+    return iter;
+}
+
 static void icaldirset_lock(const char *dir)
 {
     _unused(dir);
@@ -106,8 +396,10 @@ static icalerrorenum icaldirset_read_directory(icaldirset *dset)
     /* load all of the cluster names in the directory list */
     for (de = readdir(dp); de != 0; de = readdir(dp)) {
 
-        /* Remove known directory names  '.' and '..' */
-        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) {
+        /* Remove known directory names  '.' and '..', and the UID
+           index sidecar, which is not a cluster */
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0 ||
+            strcmp(de->d_name, ICALDIRSET_INDEX_NAME) == 0) {
             continue;
         }
 
@@ -130,8 +422,10 @@ static icalerrorenum icaldirset_read_directory(icaldirset *dset)
 
         /* load all of the cluster names in the directory list */
         do {
-            /* Remove known directory names  '.' and '..' */
-            if (strcmp(c_file.name, ".") == 0 || strcmp(c_file.name, "..") == 0) {
+            /* Remove known directory names  '.' and '..', and the UID
+               index sidecar, which is not a cluster */
+            if (strcmp(c_file.name, ".") == 0 || strcmp(c_file.name, "..") == 0 ||
+                strcmp(c_file.name, ICALDIRSET_INDEX_NAME) == 0) {
                 continue;
             }
 
@@ -176,6 +470,11 @@ icalset *icaldirset_init(icalset *set, const char *dir, void *options_in)
     dset->gauge = 0;
     dset->first_component = 0;
     dset->cluster = 0;
+    dset->uid_index = 0;
+    dset->uid_index_dirty = 0;
+    dset->gauge_has_range = 0;
+    dset->gauge_start = icaltime_null_time();
+    dset->gauge_end = icaltime_null_time();
 
     return set;
 }
@@ -208,6 +507,9 @@ void icaldirset_free(icalset *s)
     icaldirset *dset = (icaldirset *) s;
     char *str;
 
+    icaldirset_index_save(dset);
+    icaldirset_index_free(dset);
+
     icaldirset_unlock(dset->dir);
 
     if (dset->dir != 0) {
@@ -245,7 +547,7 @@ static icalerrorenum icaldirset_next_cluster(icaldirset *dset)
         icalerror_set_errno(ICAL_INTERNAL_ERROR);
         return ICAL_INTERNAL_ERROR;
     }
-    dset->directory_iterator = pvl_next(dset->directory_iterator);
+    dset->directory_iterator = icaldirset_skip_pruned(dset, pvl_next(dset->directory_iterator));
 
     if (dset->directory_iterator == 0) {
         /* There are no more clusters */
@@ -294,29 +596,23 @@ static void icaldirset_add_uid(icalcomponent *comp)
     }
 }
 
-icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
+/** Determines which monthly cluster @p comp belongs in, keyed by its
+    DTSTART (or, failing that, DTSTAMP). Keying on the event time, not
+    the creation time, lets a select with a DTSTART range skip whole
+    clusters: every component a range clause could match lives in its
+    DTSTART month. This is a HACK */
+static icalerrorenum icaldirset_component_cluster(icaldirset *dset, icalcomponent *comp,
+                                                  char *clustername, size_t size)
 {
-    char clustername[MAXPATHLEN] = { 0 };
     icalproperty *dt = 0;
     icalvalue *v;
     struct icaltimetype tm;
-    icalerrorenum error = ICAL_NO_ERROR;
     icalcomponent *inner;
-    icaldirset *dset;
-
-    icalerror_check_arg_rz((set != 0), "set");
-    icalerror_check_arg_rz((comp != 0), "comp");
-
-    dset = (icaldirset *) set;
-
-    icaldirset_add_uid(comp);
-
-    /* Determine which cluster this object belongs in. This is a HACK */
 
     for (inner = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
          inner != 0; inner = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
 
-        dt = icalcomponent_get_first_property(inner, ICAL_DTSTAMP_PROPERTY);
+        dt = icalcomponent_get_first_property(inner, ICAL_DTSTART_PROPERTY);
 
         if (dt != 0) {
             break;
@@ -327,7 +623,7 @@ icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
         for (inner = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
              inner != 0; inner = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
 
-            dt = icalcomponent_get_first_property(inner, ICAL_DTSTART_PROPERTY);
+            dt = icalcomponent_get_first_property(inner, ICAL_DTSTAMP_PROPERTY);
 
             if (dt != 0) {
                 break;
@@ -336,7 +632,7 @@ icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
     }
 
     if (dt == 0) {
-        icalerror_warn("The component does not have a DTSTAMP or DTSTART property, "
+        icalerror_warn("The component does not have a DTSTART or DTSTAMP property, "
                        "so it cannot be added to the store");
         icalerror_set_errno(ICAL_BADARG_ERROR);
         return ICAL_BADARG_ERROR;
@@ -345,7 +641,28 @@ icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
     v = icalproperty_get_value(dt);
     tm = icalvalue_get_datetime(v);
 
-    snprintf(clustername, MAXPATHLEN, "%s/%04d%02d", dset->dir, tm.year, tm.month);
+    snprintf(clustername, size, "%s/%04d%02d", dset->dir, tm.year, tm.month);
+
+    return ICAL_NO_ERROR;
+}
+
+icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
+{
+    char clustername[MAXPATHLEN] = { 0 };
+    icalerrorenum error = ICAL_NO_ERROR;
+    icaldirset *dset;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((comp != 0), "comp");
+
+    dset = (icaldirset *) set;
+
+    icaldirset_add_uid(comp);
+
+    error = icaldirset_component_cluster(dset, comp, clustername, sizeof(clustername));
+    if (error != ICAL_NO_ERROR) {
+        return error;
+    }
 
     /* Load the cluster and insert the object */
     if (dset->cluster != 0 && strcmp(clustername, icalcluster_key(dset->cluster)) != 0) {
@@ -371,9 +688,154 @@ icalerrorenum icaldirset_add_component(icalset *set, icalcomponent *comp)
 
     /* icalcluster_mark(impl->cluster); */
 
+    /* Record where the component lives so a fetch can go straight to
+       this cluster */
+    {
+        const char *comp_uid = icaldirset_component_uid(comp);
+
+        if (comp_uid != 0) {
+            icaldirset_index_load(dset);
+            icaldirset_index_set(dset, comp_uid, icaldirset_cluster_name(clustername));
+        }
+    }
+
     return ICAL_NO_ERROR;
 }
 
+/** Commits one loaded cluster back to its file, the same way
+    icaldirset_commit() writes the set's current cluster. */
+static void icaldirset_commit_cluster(icalcluster *cluster)
+{
+    icalset *fileset;
+    icalfileset_options options = icalfileset_options_default;
+
+    options.cluster = cluster;
+
+    fileset = icalset_new(ICAL_FILE_SET, icalcluster_key(cluster), &options);
+
+    if (fileset != 0) {
+        (void)fileset->commit(fileset);
+        fileset->free(fileset);
+    }
+}
+
+icalerrorenum icaldirset_add_components(icalset *set, icalcomponent **comps, int count)
+{
+    icaldirset *dset;
+    char **names;
+    int i, j;
+    icalerrorenum error = ICAL_NO_ERROR;
+
+    icalerror_check_arg_re((set != 0), "set", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((comps != 0), "comps", ICAL_BADARG_ERROR);
+
+    dset = (icaldirset *) set;
+
+    if (count <= 0) {
+        return ICAL_NO_ERROR;
+    }
+
+    names = calloc((size_t)count, sizeof(char *));
+    if (names == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
+    }
+
+    /* Resolve every target cluster up front, so a component that
+       cannot be placed fails the batch before anything is written */
+    for (i = 0; i < count; i++) {
+        char clustername[MAXPATHLEN] = { 0 };
+
+        if (comps[i] == 0) {
+            icalerror_warn("comps[i] is NULL");
+            error = ICAL_BADARG_ERROR;
+        } else {
+            icaldirset_add_uid(comps[i]);
+            error = icaldirset_component_cluster(dset, comps[i], clustername,
+                                                 sizeof(clustername));
+        }
+
+        if (error == ICAL_NO_ERROR) {
+            names[i] = strdup(clustername);
+            if (names[i] == 0) {
+                error = ICAL_NEWFAILED_ERROR;
+            }
+        }
+
+        if (error != ICAL_NO_ERROR) {
+            for (j = 0; j < i; j++) {
+                free(names[j]);
+            }
+            free(names);
+            icalerror_set_errno(error);
+            return error;
+        }
+    }
+
+    icaldirset_index_load(dset);
+
+    /* Group by target cluster: load each cluster once, insert every
+       component bound for it, and commit it once, instead of cycling
+       the cluster through load/insert/commit per component */
+    for (i = 0; i < count; i++) {
+        if (names[i] == 0) {
+            continue;
+        }
+
+        if (dset->cluster != 0 && strcmp(names[i], icalcluster_key(dset->cluster)) != 0) {
+            icalcluster_free(dset->cluster);
+            dset->cluster = 0;
+        }
+
+        if (dset->cluster == 0) {
+            dset->cluster = icalfileset_produce_icalcluster(names[i]);
+
+            if (dset->cluster == 0) {
+                error = icalerrno;
+                break;
+            }
+        }
+
+        for (j = i; j < count; j++) {
+            if (names[j] == 0 || strcmp(names[j], names[i]) != 0) {
+                continue;
+            }
+
+            (void)icalcluster_add_component(dset->cluster, comps[j]);
+
+            {
+                const char *comp_uid = icaldirset_component_uid(comps[j]);
+
+                if (comp_uid != 0) {
+                    icaldirset_index_set(dset, comp_uid, icaldirset_cluster_name(names[j]));
+                }
+            }
+
+            if (j != i) {
+                free(names[j]);
+                names[j] = 0;
+            }
+        }
+
+        icaldirset_commit_cluster(dset->cluster);
+
+        free(names[i]);
+        names[i] = 0;
+    }
+
+    for (i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+
+    icaldirset_index_save(dset);
+
+    if (error != ICAL_NO_ERROR) {
+        icalerror_set_errno(error);
+    }
+    return error;
+}
+
 /**
    Remove a component in the current cluster. HACK. This routine is a
    "friend" of icalfileset, and breaks its encapsulation. It was
@@ -413,6 +875,15 @@ icalerrorenum icaldirset_remove_component(icalset *set, icalcomponent *comp)
         return ICAL_USAGE_ERROR;
     }
 
+    {
+        const char *comp_uid = icaldirset_component_uid(comp);
+
+        if (comp_uid != 0) {
+            icaldirset_index_load(dset);
+            icaldirset_index_remove(dset, comp_uid);
+        }
+    }
+
     (void)icalcluster_remove_component(dset->cluster, comp);
 
     /* icalcluster_mark(impl->cluster); */
@@ -461,6 +932,7 @@ icalcomponent *icaldirset_fetch(icalset *set, icalcomponent_kind kind, const cha
     icalgauge *gauge;
     icalgauge *old_gauge;
     icalcomponent *c;
+    struct icaldirset_uid_entry *entry;
     char sql[256];
 
     _unused(kind);
@@ -468,17 +940,70 @@ icalcomponent *icaldirset_fetch(icalset *set, icalcomponent_kind kind, const cha
     icalerror_check_arg_rz((set != 0), "set");
     icalerror_check_arg_rz((uid != 0), "uid");
 
-    snprintf(sql, 256, "SELECT * FROM VEVENT WHERE UID = \"%s\"", uid);
+    /* The gauge grammar quotes strings with single quotes; the double
+       quotes used here previously made every fetch fail to parse */
+    snprintf(sql, 256, "SELECT * FROM VEVENT WHERE UID = '%s'", uid);
 
     gauge = icalgauge_new_from_sql(sql, 0);
     dset = (icaldirset *) set;
+
+    /* Try the persistent index first, opening only the named cluster
+       instead of walking the store month by month. */
+    icaldirset_index_load(dset);
+    entry = icaldirset_index_find(dset, uid);
+
+    if (entry != 0 && gauge != 0) {
+        char path[MAXPATHLEN];
+
+        snprintf(path, sizeof(path), "%s/%s", dset->dir, entry->cluster);
+
+        if (dset->cluster != 0 && strcmp(path, icalcluster_key(dset->cluster)) != 0) {
+            icalcluster_free(dset->cluster);
+            dset->cluster = 0;
+        }
+        if (dset->cluster == 0) {
+            dset->cluster = icalfileset_produce_icalcluster(path);
+        }
+
+        if (dset->cluster != 0) {
+            for (c = icalcluster_get_first_component(dset->cluster);
+                 c != 0; c = icalcluster_get_next_component(dset->cluster)) {
+
+                if (icalgauge_compare(gauge, c) == 1) {
+                    icalgauge_free(gauge);
+                    return c;
+                }
+            }
+        }
+
+        /* The entry was stale; drop it and fall back to the walk */
+        icaldirset_index_remove(dset, uid);
+    }
+
     old_gauge = dset->gauge;
     dset->gauge = gauge;
 
-    c = icaldirset_get_first_component(set);
+    /* The UID gauge has no DTSTART range; do not prune the walk with
+       the bounds of a previously selected gauge */
+    {
+        int old_has_range = dset->gauge_has_range;
+
+        dset->gauge_has_range = 0;
+
+        c = icaldirset_get_first_component(set);
+
+        dset->gauge_has_range = old_has_range;
+    }
 
     dset->gauge = old_gauge;
 
+    /* A successful walk tells us where the component lives; repair the
+       index so the next fetch takes the fast path */
+    if (c != 0 && dset->cluster != 0) {
+        icaldirset_index_set(dset, uid,
+                             icaldirset_cluster_name(icalcluster_key(dset->cluster)));
+    }
+
     if (gauge) {
         icalgauge_free(gauge);
     }
@@ -511,6 +1036,15 @@ icalerrorenum icaldirset_select(icalset *set, icalgauge *gauge)
     dset = (icaldirset *) set;
     dset->gauge = gauge;
 
+    /* If the gauge bounds DTSTART, remember the bounds so the walk can
+       skip whole month clusters instead of scanning them. The bounds
+       are only a pre-filter; surviving clusters still run every
+       component through the gauge. */
+    dset->gauge_start = icaltime_null_time();
+    dset->gauge_end = icaltime_null_time();
+    dset->gauge_has_range =
+        icalgauge_get_dtstart_range(gauge, &dset->gauge_start, &dset->gauge_end);
+
     return ICAL_NO_ERROR;
 }
 
@@ -562,7 +1096,7 @@ icalcomponent *icaldirset_get_first_component(icalset *set)
         return 0;
     }
 
-    dset->directory_iterator = pvl_head(dset->directory);
+    dset->directory_iterator = icaldirset_skip_pruned(dset, pvl_head(dset->directory));
 
     if (dset->directory_iterator == 0) {
         icalerror_set_errno(error);
@@ -647,14 +1181,458 @@ icalcomponent *icaldirset_get_next_component(icalset *set)
         if (dset->cluster == 0 || error != ICAL_NO_ERROR) {
             /* No more clusters */
             return 0;
+        }
+
+        /* Loop around so the new cluster's components are run through
+           the gauge too, instead of its first one escaping the test */
+        (void)icalcluster_get_first_component(dset->cluster);
+    }
+
+    return 0;   /* Should never get here */
+}
+
+/* The streaming cursor. It keeps a private copy of the cluster name
+   list and scans one cluster at a time, freeing each as it moves on,
+   so memory stays bounded by the largest cluster no matter how big the
+   store is. With readahead, the next cluster is read and parsed on a
+   short-lived background thread while the caller consumes the current
+   one; the thread is always joined before its result is touched. */
+
+struct icaldirset_cursor
+{
+    icaldirset *dset;           /* not owned */
+    icalgauge *gauge;           /* not owned; NULL matches everything */
+    pvl_list names;             /* owned copy of the cluster file names */
+    pvl_elem name_iter;         /* next cluster to load */
+    icalcluster *cluster;       /* cluster being scanned, owned */
+    int first;                  /* cluster iteration not started yet */
+    int readahead;
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    int prefetch_active;
+    pthread_t prefetch_thread;
+    char *prefetch_path;        /* path the thread is loading */
+    icalcluster *prefetch_result;       /* set by the thread, read after join */
+#endif
+};
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+
+static void *icaldirset_cursor_prefetch_run(void *arg)
+{
+    struct icaldirset_cursor *cursor = arg;
+
+    cursor->prefetch_result = icalfileset_produce_icalcluster(cursor->prefetch_path);
+
+    return 0;
+}
+
+static void icaldirset_cursor_prefetch_start(struct icaldirset_cursor *cursor, const char *path)
+{
+    if (cursor->readahead == 0 || cursor->prefetch_active) {
+        return;
+    }
+
+    cursor->prefetch_result = 0;
+    cursor->prefetch_path = strdup(path);
+    if (cursor->prefetch_path == 0) {
+        return;
+    }
+
+    if (pthread_create(&cursor->prefetch_thread, 0,
+                       icaldirset_cursor_prefetch_run, cursor) == 0) {
+        cursor->prefetch_active = 1;
+    } else {
+        free(cursor->prefetch_path);
+        cursor->prefetch_path = 0;
+    }
+}
+
+/** Joins the prefetch thread; returns its cluster if it loaded @p path,
+    otherwise discards the result. NULL @p path just discards. */
+static icalcluster *icaldirset_cursor_prefetch_take(struct icaldirset_cursor *cursor,
+                                                    const char *path)
+{
+    icalcluster *cluster = 0;
+
+    if (!cursor->prefetch_active) {
+        return 0;
+    }
+
+    pthread_join(cursor->prefetch_thread, 0);
+    cursor->prefetch_active = 0;
+
+    if (path != 0 && cursor->prefetch_path != 0 && strcmp(cursor->prefetch_path, path) == 0) {
+        cluster = cursor->prefetch_result;
+    } else if (cursor->prefetch_result != 0) {
+        icalcluster_free(cursor->prefetch_result);
+    }
+
+    cursor->prefetch_result = 0;
+    free(cursor->prefetch_path);
+    cursor->prefetch_path = 0;
+
+    return cluster;
+}
+
+#endif /* HAVE_PTHREAD && !_WIN32 */
+
+icaldirset_cursor *icaldirset_cursor_new(icalset *set, icalgauge *gauge, int readahead)
+{
+    struct icaldirset_cursor *cursor;
+    icaldirset *dset;
+    pvl_elem e;
+    int has_range = 0;
+    struct icaltimetype range_start = icaltime_null_time();
+    struct icaltimetype range_end = icaltime_null_time();
+
+    icalerror_check_arg_rz((set != 0), "set");
+    dset = (icaldirset *) set;
+
+    if (icaldirset_read_directory(dset) != ICAL_NO_ERROR) {
+        return 0;
+    }
+
+    if ((cursor = (struct icaldirset_cursor *)malloc(sizeof(struct icaldirset_cursor))) == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+    memset(cursor, 0, sizeof(struct icaldirset_cursor));
+
+    cursor->dset = dset;
+    cursor->gauge = gauge;
+    cursor->readahead = readahead;
+    cursor->names = pvl_newlist();
+
+    if (gauge != 0) {
+        has_range = icalgauge_get_dtstart_range(gauge, &range_start, &range_end);
+    }
+
+    /* Copy the names so the cursor survives the set re-reading its
+       directory mid-scan, leaving out clusters the gauge's DTSTART
+       range can never match */
+    for (e = pvl_head(dset->directory); e != 0; e = pvl_next(e)) {
+        char *name;
+
+        if (has_range &&
+            !icaldirset_cluster_in_range((char *)pvl_data(e), range_start, range_end)) {
+            continue;
+        }
+
+        name = strdup((char *)pvl_data(e));
+        if (name != 0) {
+            pvl_push(cursor->names, name);
+        }
+    }
+
+    cursor->name_iter = pvl_head(cursor->names);
+
+    return cursor;
+}
+
+icalcomponent *icaldirset_cursor_next(icaldirset_cursor *cursor)
+{
+    icalerror_check_arg_rz((cursor != 0), "cursor");
+
+    for (;;) {
+        icalcomponent *c;
+
+        if (cursor->cluster == 0) {
+            char path[MAXPATHLEN];
+
+            if (cursor->name_iter == 0) {
+                return 0;
+            }
+
+            snprintf(path, sizeof(path), "%s/%s",
+                     cursor->dset->dir, (char *)pvl_data(cursor->name_iter));
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+            cursor->cluster = icaldirset_cursor_prefetch_take(cursor, path);
+#endif
+            if (cursor->cluster == 0) {
+                cursor->cluster = icalfileset_produce_icalcluster(path);
+            }
+
+            cursor->name_iter = pvl_next(cursor->name_iter);
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+            /* Overlap the next cluster's read and parse with this one's scan */
+            if (cursor->name_iter != 0 && cursor->cluster != 0) {
+                char next_path[MAXPATHLEN];
+
+                snprintf(next_path, sizeof(next_path), "%s/%s",
+                         cursor->dset->dir, (char *)pvl_data(cursor->name_iter));
+                icaldirset_cursor_prefetch_start(cursor, next_path);
+            }
+#endif
+            if (cursor->cluster == 0) {
+                /* Unreadable cluster; move on to the next one */
+                continue;
+            }
+
+            cursor->first = 1;
+        }
+
+        if (cursor->first) {
+            c = icalcluster_get_first_component(cursor->cluster);
+            cursor->first = 0;
         } else {
-            c = icalcluster_get_first_component(dset->cluster);
+            c = icalcluster_get_next_component(cursor->cluster);
+        }
 
-            return c;
+        for (; c != 0; c = icalcluster_get_next_component(cursor->cluster)) {
+            if (cursor->gauge == 0) {
+                return icalcomponent_clone(c);
+            }
+
+            if (icalgauge_compare(cursor->gauge, c) == 1) {
+                /* Hand back only the selected properties; with a
+                   narrow select list this is most of the win of the
+                   streaming scan */
+                return icalgauge_project(cursor->gauge, c);
+            }
+        }
+
+        /* Scanned out; release this cluster before loading the next */
+        icalcluster_free(cursor->cluster);
+        cursor->cluster = 0;
+    }
+}
+
+void icaldirset_cursor_free(icaldirset_cursor *cursor)
+{
+    char *name;
+
+    icalerror_check_arg_rv((cursor != 0), "cursor");
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    (void)icaldirset_cursor_prefetch_take(cursor, 0);
+#endif
+
+    if (cursor->cluster != 0) {
+        icalcluster_free(cursor->cluster);
+        cursor->cluster = 0;
+    }
+
+    if (cursor->names != 0) {
+        while ((name = pvl_pop(cursor->names)) != 0) {
+            free(name);
         }
+        pvl_free(cursor->names);
+        cursor->names = 0;
     }
 
-    return 0;   /* Should never get here */
+    free(cursor);
+}
+
+/* Shared state for the parallel scan workers. Each worker claims the
+   next unscanned cluster index under the lock and fills its private
+   slot in results, so the only cross-thread traffic is the counter. */
+struct icaldirset_pscan
+{
+    const char *dir;
+    icalgauge *gauge;           /* not owned; NULL matches everything */
+    char **names;               /* cluster file names, in directory order */
+    int n_names;
+    int next;                   /* next unclaimed cluster index */
+    icalcomponent **results;    /* per-cluster XROOT of matching clones */
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    pthread_mutex_t lock;
+#endif
+};
+
+/** Loads one cluster, gauges its components and stores clones of the
+    matches in the cluster's result slot. */
+static void icaldirset_pscan_cluster(struct icaldirset_pscan *scan, int i)
+{
+    char path[MAXPATHLEN];
+    icalcluster *cluster;
+    icalcomponent *c;
+
+    snprintf(path, sizeof(path), "%s/%s", scan->dir, scan->names[i]);
+
+    cluster = icalfileset_produce_icalcluster(path);
+    if (cluster == 0) {
+        /* Unreadable cluster; skip it, as the sequential scan does */
+        return;
+    }
+
+    for (c = icalcluster_get_first_component(cluster);
+         c != 0; c = icalcluster_get_next_component(cluster)) {
+        if (scan->gauge == 0 || icalgauge_compare(scan->gauge, c) == 1) {
+            if (scan->results[i] == 0) {
+                scan->results[i] = icalcomponent_new(ICAL_XROOT_COMPONENT);
+            }
+            if (scan->results[i] != 0) {
+                icalcomponent_add_component(scan->results[i], icalcomponent_clone(c));
+            }
+        }
+    }
+
+    icalcluster_free(cluster);
+}
+
+static void icaldirset_pscan_task(void *ctx, size_t i)
+{
+    icaldirset_pscan_cluster((struct icaldirset_pscan *)ctx, (int)i);
+}
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+
+static void *icaldirset_pscan_run(void *arg)
+{
+    struct icaldirset_pscan *scan = arg;
+
+    for (;;) {
+        int i;
+
+        pthread_mutex_lock(&scan->lock);
+        i = scan->next++;
+        pthread_mutex_unlock(&scan->lock);
+
+        if (i >= scan->n_names) {
+            break;
+        }
+
+        icaldirset_pscan_cluster(scan, i);
+    }
+
+    return 0;
+}
+
+#endif /* HAVE_PTHREAD && !_WIN32 */
+
+icalcomponent *icaldirset_query_parallel(icalset *set, icalgauge *gauge, int nworkers)
+{
+    icaldirset *dset;
+    struct icaldirset_pscan scan;
+    icalcomponent *out;
+    pvl_elem e;
+    int i;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    dset = (icaldirset *) set;
+
+    if (icaldirset_read_directory(dset) != ICAL_NO_ERROR) {
+        return 0;
+    }
+
+    memset(&scan, 0, sizeof(scan));
+    scan.dir = dset->dir;
+    scan.gauge = gauge;
+    scan.n_names = pvl_count(dset->directory);
+
+    out = icalcomponent_new(ICAL_XROOT_COMPONENT);
+    if (out == 0 || scan.n_names == 0) {
+        return out;
+    }
+
+    scan.names = malloc((size_t)scan.n_names * sizeof(char *));
+    scan.results = calloc((size_t)scan.n_names, sizeof(icalcomponent *));
+    if (scan.names == 0 || scan.results == 0) {
+        free(scan.names);
+        free(scan.results);
+        icalcomponent_free(out);
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    /* Copy the names so the scan survives the set re-reading its
+       directory, and so the slots keep directory order; clusters the
+       gauge's DTSTART range can never match are not worth a worker */
+    {
+        int has_range = 0;
+        struct icaltimetype range_start = icaltime_null_time();
+        struct icaltimetype range_end = icaltime_null_time();
+
+        if (gauge != 0) {
+            has_range = icalgauge_get_dtstart_range(gauge, &range_start, &range_end);
+        }
+
+        i = 0;
+        for (e = pvl_head(dset->directory); e != 0 && i < scan.n_names; e = pvl_next(e)) {
+            char *name;
+
+            if (has_range &&
+                !icaldirset_cluster_in_range((char *)pvl_data(e), range_start, range_end)) {
+                continue;
+            }
+
+            name = strdup((char *)pvl_data(e));
+            if (name != 0) {
+                scan.names[i++] = name;
+            }
+        }
+        scan.n_names = i;
+    }
+
+    if (nworkers > scan.n_names) {
+        nworkers = scan.n_names;
+    }
+
+    if (nworkers > 1 && ical_threadpool_get_default() != 0) {
+        /* Scan on the shared pool instead of spawning per-query threads */
+        (void)ical_threadpool_run_batch(ical_threadpool_get_default(),
+                                        icaldirset_pscan_task, &scan,
+                                        (size_t)scan.n_names);
+    } else
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    if (nworkers > 1) {
+        pthread_t *threads = malloc((size_t)(nworkers - 1) * sizeof(pthread_t));
+        int started = 0;
+
+        pthread_mutex_init(&scan.lock, 0);
+
+        if (threads != 0) {
+            for (i = 0; i < nworkers - 1; i++) {
+                if (pthread_create(&threads[started], 0, icaldirset_pscan_run, &scan) == 0) {
+                    started++;
+                }
+            }
+        }
+
+        /* The caller's thread is a worker too */
+        (void)icaldirset_pscan_run(&scan);
+
+        for (i = 0; i < started; i++) {
+            pthread_join(threads[i], 0);
+        }
+
+        free(threads);
+        pthread_mutex_destroy(&scan.lock);
+    } else {
+        for (i = 0; i < scan.n_names; i++) {
+            icaldirset_pscan_cluster(&scan, i);
+        }
+    }
+#else
+    {
+        for (i = 0; i < scan.n_names; i++) {
+            icaldirset_pscan_cluster(&scan, i);
+        }
+    }
+#endif
+
+    /* Merge per-cluster results in directory order */
+    for (i = 0; i < scan.n_names; i++) {
+        if (scan.results[i] != 0) {
+            icalcomponent *c;
+
+            while ((c = icalcomponent_get_first_component(scan.results[i],
+                                                          ICAL_ANY_COMPONENT)) != 0) {
+                icalcomponent_remove_component(scan.results[i], c);
+                icalcomponent_add_component(out, c);
+            }
+            icalcomponent_free(scan.results[i]);
+        }
+        free(scan.names[i]);
+    }
+
+    free(scan.names);
+    free(scan.results);
+
+    return out;
 }
 
 icalsetiter icaldirset_begin_component(icalset *set, icalcomponent_kind kind, icalgauge *gauge,
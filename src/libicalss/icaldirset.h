@@ -80,15 +80,105 @@ LIBICAL_ICALSS_EXPORT icalerrorenum icaldirset_commit(icalset *set);
   component must have a DSTAMP property
 */
 LIBICAL_ICALSS_EXPORT icalerrorenum icaldirset_add_component(icalset *store, icalcomponent *comp);
+
+/**
+ * @brief Adds @p count components in one pass, grouped by target
+ * cluster.
+ * @since 3.1.0
+ *
+ * icaldirset_add_component() resolves, loads and (after a commit)
+ * rewrites the monthly cluster once per component, so a bulk import
+ * whose components alternate between months cycles every cluster
+ * through load and commit over and over. This groups the batch by
+ * target cluster, loads each cluster once, inserts everything bound
+ * for it and commits it once, leaving the UID index sidecar updated
+ * at the end. Each component has the same requirements as
+ * icaldirset_add_component(); a component without a DTSTAMP or
+ * DTSTART fails the whole batch before anything is written.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icaldirset_add_components(icalset *store,
+                                                              icalcomponent **comps, int count);
+
 LIBICAL_ICALSS_EXPORT icalerrorenum icaldirset_remove_component(icalset *store,
                                                                 icalcomponent *comp);
 
 LIBICAL_ICALSS_EXPORT int icaldirset_count_components(icalset *store, icalcomponent_kind kind);
 
 /* Restricts the component returned by icaldirset_first, _next to those
-   that pass the gauge. _clear removes the gauge. */
+   that pass the gauge. _clear removes the gauge.
+
+   When the gauge bounds DTSTART (see icalgauge_get_dtstart_range()),
+   the walk skips month clusters outside the bounds entirely, so a
+   query limited to a week reads one cluster of a year-wide store.
+   Cluster placement keys on DTSTART, so every component a range
+   clause could match lives in its DTSTART month. */
 LIBICAL_ICALSS_EXPORT icalerrorenum icaldirset_select(icalset *store, icalgauge *gauge);
 
+/**
+ * @brief A streaming cursor over the matching components of a store.
+ * @since 3.1.0
+ *
+ * Unlike icaldirset_get_first/next_component, a cursor holds at most
+ * one cluster in memory at a time (two with readahead), so a reporting
+ * job can scan a store much larger than RAM. Matching components are
+ * returned as clones owned by the caller; each cluster is freed as the
+ * scan leaves it. The cursor keeps its own iteration state and does
+ * not disturb the set's current cluster or gauge.
+ */
+typedef struct icaldirset_cursor icaldirset_cursor;
+
+/**
+ * @brief Opens a cursor over @p set, returning components that pass
+ * @p gauge (all components if NULL).
+ * @param readahead if nonzero, the next cluster is loaded and parsed
+ * on a background thread while the caller consumes the current one.
+ * At most one cluster is prefetched ahead; on platforms without
+ * threads the scan simply loads clusters synchronously.
+ * @since 3.1.0
+ *
+ * The gauge remains owned by the caller and must stay alive for the
+ * lifetime of the cursor.
+ */
+LIBICAL_ICALSS_EXPORT icaldirset_cursor *icaldirset_cursor_new(icalset *set,
+                                                               icalgauge *gauge, int readahead);
+
+/**
+ * @brief Returns a clone of the next matching component, or NULL at
+ * the end of the store.
+ * @since 3.1.0
+ *
+ * The caller owns the returned component and frees it with
+ * icalcomponent_free(); the original stays with its cluster, which the
+ * cursor releases as it moves on. When the gauge selects specific
+ * properties rather than "*", the clone is projected down to them —
+ * see icalgauge_project().
+ */
+LIBICAL_ICALSS_EXPORT icalcomponent *icaldirset_cursor_next(icaldirset_cursor *cursor);
+
+/**
+ * @brief Frees the cursor and any cluster or prefetch it still holds.
+ * @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT void icaldirset_cursor_free(icaldirset_cursor *cursor);
+
+/**
+ * @brief Scans every cluster of the store in parallel and returns the
+ * components that pass @p gauge (all components if NULL).
+ * @param nworkers how many threads share the scan; the caller's thread
+ * is one of them. With 1, or on platforms without threads, the scan is
+ * sequential.
+ * @return an XROOT component holding clones of the matches in store
+ * order, owned by the caller; NULL on error.
+ * @since 3.1.0
+ *
+ * The store's one-cluster-per-month layout is a natural sharding:
+ * each worker claims the next unscanned cluster, loads and gauges it
+ * privately, and the per-cluster results are merged in order at the
+ * end, so a query spanning many months scales across cores.
+ */
+LIBICAL_ICALSS_EXPORT icalcomponent *icaldirset_query_parallel(icalset *set,
+                                                               icalgauge *gauge, int nworkers);
+
 LIBICAL_ICALSS_EXPORT void icaldirset_clear(icalset *store);
 
 /* Gets a component by uid */
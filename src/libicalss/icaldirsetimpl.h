@@ -27,6 +27,18 @@
 /* This definition is in its own file so it can be kept out of the
    main header file, but used by "friend classes" like icalset*/
 
+/** Number of chains in the in-memory UID index */
+#define ICALDIRSET_INDEX_BUCKETS 256
+
+/** One UID -> cluster mapping, chained per hash bucket and persisted
+    in the sidecar index file next to the store directory */
+struct icaldirset_uid_entry
+{
+    char *uid;                  /**< UID of a stored component */
+    char *cluster;              /**< name of the cluster file holding it */
+    struct icaldirset_uid_entry *next;
+};
+
 struct icaldirset_impl
 {
     icalset super;              /**< parent class */
@@ -37,6 +49,13 @@ struct icaldirset_impl
     int first_component;        /**< ??? */
     pvl_list directory;         /**< ??? */
     pvl_elem directory_iterator;/**< ??? */
+
+    struct icaldirset_uid_entry **uid_index; /**< hash buckets, or 0 before load */
+    int uid_index_dirty;        /**< set when the index differs from the sidecar */
+
+    int gauge_has_range;        /**< the selected gauge bounds DTSTART */
+    struct icaltimetype gauge_start; /**< lower DTSTART bound, or null time */
+    struct icaltimetype gauge_end;   /**< upper DTSTART bound, or null time */
 };
 
 #endif
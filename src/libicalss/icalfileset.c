@@ -25,18 +25,46 @@
 
 #include "icalfileset.h"
 #include "icalfilesetimpl.h"
+#include "icalmemory.h"
 #include "icalparser.h"
+#include "icaltrace.h"
 #include "icalvalue.h"
 
 #include <errno.h>
 #include <stdlib.h>
 
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+
+#if defined(HAVE_ZLIB)
+#include <zlib.h>
+#endif
+
 #if defined(_WIN32_WCE)
 #include <winbase.h>
 #endif
 
 /** Default options used when NULL is passed to icalset_new() **/
-icalfileset_options icalfileset_options_default = { O_RDWR | O_CREAT, 0644, 0, NULL };
+icalfileset_options icalfileset_options_default = { O_RDWR | O_CREAT, 0644, 0, NULL, 0, 0, 0, 0 };
+
+/* Journal record framing. An add record is the header line followed by
+   the serialized component; a remove record is a single line carrying
+   the UID of the component to drop. */
+#define ICALFILESET_JNL_ADD_HDR "X-LIC-JNL:ADD\r\n"
+#define ICALFILESET_JNL_REMOVE_HDR "X-LIC-JNL:REMOVE;"
+
+/* Compact once this many records have accumulated in the journal. */
+#define ICALFILESET_JOURNAL_COMPACT_LIMIT 64
+
+/* A compressed cluster file is this header line — carrying the inflated
+   size, so loading can allocate in one go — followed by a single
+   deflate frame holding the whole serialized cluster. */
+#define ICALFILESET_ZHDR "X-LIC-ZCLUSTER:"
 
 static int _compare_ids(const char *compid, const char *matchid);
 
@@ -44,6 +72,24 @@ static int icalfileset_lock(icalfileset *set);
 static int icalfileset_unlock(icalfileset *set);
 static icalerrorenum icalfileset_read_file(icalfileset *set, int mode);
 static long icalfileset_filesize(icalfileset *set);
+static icalerrorenum icalfileset_journal_open(icalfileset *set);
+static icalerrorenum icalfileset_journal_replay(icalfileset *set);
+static icalerrorenum icalfileset_journal_replay_from(icalfileset *set, long offset);
+static void icalfileset_sync_stamp(icalfileset *set);
+static icalerrorenum icalfileset_reload_full(icalfileset *set);
+static icalerrorenum icalfileset_journal_append(icalfileset *set);
+static void icalfileset_journal_clear_pending(icalfileset *set);
+static void icalfileset_journal_note_add(icalfileset *set, icalcomponent *child);
+static void icalfileset_journal_note_remove(icalfileset *set, icalcomponent *child);
+static icalerrorenum icalfileset_map_and_index(icalfileset *set, size_t filesize);
+static icalerrorenum icalfileset_index_buffer(icalfileset *set, char *base, size_t len, int owned);
+static icalerrorenum icalfileset_load_compressed(icalfileset *set, size_t filesize);
+static void icalfileset_lazy_ensure_all(icalfileset *set);
+static void icalfileset_lazy_release(icalfileset *set);
+static void icalfileset_clean_snapshot_take(icalfileset *set);
+static void icalfileset_clean_snapshot_free(icalfileset *set);
+static int icalfileset_is_clean(icalfileset *set);
+static void icalfileset_journal_downgrade(icalfileset *set);
 
 icalset *icalfileset_new(const char *path)
 {
@@ -68,6 +114,45 @@ icalset *icalfileset_new_writer(const char *path)
     return icalset_new(ICAL_FILE_SET, path, &writer_options);
 }
 
+icalset *icalfileset_new_lazy_reader(const char *path)
+{
+    icalfileset_options lazy_options = icalfileset_options_default;
+
+    lazy_options.flags = O_RDONLY;
+    lazy_options.lazy_load = 1;
+
+    return icalset_new(ICAL_FILE_SET, path, &lazy_options);
+}
+
+icalset *icalfileset_snapshot_open(const char *name)
+{
+    icalfileset_options snapshot_options = icalfileset_options_default;
+
+    snapshot_options.flags = O_RDONLY;
+    snapshot_options.lazy_load = 1;
+    snapshot_options.snapshot = 1;
+
+    return icalset_new(ICAL_FILE_SET, name, &snapshot_options);
+}
+
+icalset *icalfileset_new_journaled(const char *path)
+{
+    icalfileset_options journal_options = icalfileset_options_default;
+
+    journal_options.journaled = 1;
+
+    return icalset_new(ICAL_FILE_SET, path, &journal_options);
+}
+
+icalset *icalfileset_new_compressed(const char *path)
+{
+    icalfileset_options compressed_options = icalfileset_options_default;
+
+    compressed_options.compressed = 1;
+
+    return icalset_new(ICAL_FILE_SET, path, &compressed_options);
+}
+
 icalset *icalfileset_init(icalset *set, const char *path, void *options_in)
 {
     icalfileset_options *options = (options_in) ? options_in : &icalfileset_options_default;
@@ -75,6 +160,7 @@ icalset *icalfileset_init(icalset *set, const char *path, void *options_in)
     int flags;
     int mode;
     long cluster_file_size;
+    int compressed_on_disk = 0;
 
     icalerror_clear_errno();
     icalerror_check_arg_rz((path != 0), "path");
@@ -82,30 +168,91 @@ icalset *icalfileset_init(icalset *set, const char *path, void *options_in)
 
     fset->path = strdup(path);
     fset->options = *options;
+    fset->journal_fd = -1;
 
     flags = options->flags;
     mode = options->mode;
 
-    cluster_file_size = icalfileset_filesize(fset);
+    if (options->snapshot) {
+#if defined(HAVE_SYS_MMAN_H) && !defined(_WIN32)
+        struct stat sbuf;
 
-    if (cluster_file_size < 0) {
-        icalfileset_free(set);
-        return 0;
-    }
+        /* The path names a POSIX shared memory object, not a file. The
+           segment is immutable once published, so there is nothing to
+           lock. */
+        fset->fd = shm_open(fset->path, O_RDONLY, 0);
 
-    fset->fd = open(fset->path, flags, mode);
+        if (fset->fd < 0 || fstat(fset->fd, &sbuf) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            icalfileset_free(set);
+            return 0;
+        }
 
-    if (fset->fd < 0) {
-        icalerror_set_errno(ICAL_FILE_ERROR);
+        cluster_file_size = (long)sbuf.st_size;
+#else
+        icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
         icalfileset_free(set);
         return 0;
+#endif
+    } else {
+        cluster_file_size = icalfileset_filesize(fset);
+
+        if (cluster_file_size < 0) {
+            icalfileset_free(set);
+            return 0;
+        }
+
+        fset->fd = open(fset->path, flags, mode);
+
+        if (fset->fd < 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            icalfileset_free(set);
+            return 0;
+        }
+
+        (void)icalfileset_lock(fset);
     }
 
-    (void)icalfileset_lock(fset);
+    fset->compressed = options->compressed;
 
     if (cluster_file_size > 0) {
+        int loaded = 0;
+
+        /* Compression is detected from the file header, so it is
+           transparent to the caller's options; the compressed option
+           only decides how the next commit writes the file. */
+        if (!options->snapshot && (size_t)cluster_file_size > sizeof(ICALFILESET_ZHDR)) {
+            char zhdr[sizeof(ICALFILESET_ZHDR) - 1];
+
+            if (read(fset->fd, zhdr, sizeof(zhdr)) == (ssize_t)sizeof(zhdr) &&
+                strncmp(zhdr, ICALFILESET_ZHDR, sizeof(zhdr)) == 0) {
+                compressed_on_disk = 1;
+                fset->compressed = 1;
+            }
+
+            if (lseek(fset->fd, 0, SEEK_SET) < 0) {
+                icalerror_set_errno(ICAL_FILE_ERROR);
+                icalfileset_free(set);
+                return 0;
+            }
+        }
 
-        if (icalfileset_read_file(fset, mode) != ICAL_NO_ERROR) {
+        if (compressed_on_disk) {
+            if (icalfileset_load_compressed(fset, (size_t)cluster_file_size) != ICAL_NO_ERROR) {
+                icalfileset_free(set);
+                return 0;
+            }
+            loaded = 1;
+        }
+
+        if (!loaded && options->lazy_load) {
+            loaded =
+                (icalfileset_map_and_index(fset, (size_t)cluster_file_size) == ICAL_NO_ERROR);
+        }
+
+        /* Without a mapping (or when the boundary scan balked), fall
+           back to parsing the whole file up front. */
+        if (!loaded && icalfileset_read_file(fset, mode) != ICAL_NO_ERROR) {
             icalfileset_free(set);
             return 0;
         }
@@ -120,75 +267,214 @@ icalset *icalfileset_init(icalset *set, const char *path, void *options_in)
         fset->cluster = icalcomponent_new(ICAL_XROOT_COMPONENT);
     }
 
+    if (options->journaled) {
+        /* Journal replay edits the cluster directly, so it needs the
+           full set in memory. */
+        icalfileset_lazy_ensure_all(fset);
+
+        if (icalfileset_journal_open(fset) != ICAL_NO_ERROR) {
+            icalfileset_free(set);
+            return 0;
+        }
+    }
+
+    /* What was just loaded is what the disk holds; record it so a
+       commit with no real changes can be skipped. (When the set was
+       seeded from a cluster, or the file is due a compression format
+       change, memory and disk already disagree.) */
+    if (fset->changed == 0 && fset->compressed == compressed_on_disk) {
+        icalfileset_clean_snapshot_take(fset);
+    }
+
+    icalfileset_sync_stamp(fset);
+
     return set;
 }
 
-icalcluster *icalfileset_produce_icalcluster(const char *path)
+/** Records the byte range and first UID of each top-level component in
+    @p base without parsing anything, and adopts the buffer as the lazy
+    backing store. The cluster starts out empty; ranges are parsed on
+    demand. @p owned marks heap buffers (an inflated cluster) as opposed
+    to mappings. */
+static icalerrorenum icalfileset_index_buffer(icalfileset *set, char *base, size_t len, int owned)
 {
-    icalset *fileset;
-    icalcluster *ret;
+    const char *p, *end;
+    int depth = 0;
+    size_t start = 0;
+    char *uid = 0;
+    char *map = base;
+    size_t filesize = len;
+
+    set->lazy_ranges = icalarray_new_contiguous(sizeof(struct icalfileset_range), 64);
+    if (set->lazy_ranges == 0) {
+        return ICAL_ALLOCATION_ERROR;
+    }
 
-    int errstate = icalerror_get_errors_are_fatal();
+    end = map + filesize;
+    for (p = map; p < end;) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        const char *line_end = (eol != 0) ? eol + 1 : end;
 
-    icalerror_set_errors_are_fatal(0);
+        if ((size_t)(end - p) >= 6 && strncmp(p, "BEGIN:", 6) == 0) {
+            if (depth == 0) {
+                start = (size_t)(p - map);
+            }
+            depth++;
+        } else if ((size_t)(end - p) >= 4 && strncmp(p, "END:", 4) == 0) {
+            depth--;
+            if (depth == 0) {
+                struct icalfileset_range range;
+
+                range.start = start;
+                range.length = (size_t)(line_end - map) - start;
+                range.uid = uid;
+                range.materialized = 0;
+                icalarray_append(set->lazy_ranges, &range);
+                uid = 0;
+            } else if (depth < 0) {
+                break;
+            }
+        } else if (depth > 0 && uid == 0 &&
+                   (size_t)(end - p) >= 4 && strncmp(p, "UID", 3) == 0 &&
+                   (p[3] == ':' || p[3] == ';')) {
+            const char *colon = memchr(p, ':', (size_t)(line_end - p));
+
+            if (colon != 0) {
+                const char *value = colon + 1;
+                const char *value_end = line_end;
+
+                while (value_end > value &&
+                       (value_end[-1] == '\n' || value_end[-1] == '\r')) {
+                    value_end--;
+                }
 
-    fileset = icalfileset_new_reader(path);
+                uid = malloc((size_t)(value_end - value) + 1);
+                if (uid != 0) {
+                    memcpy(uid, value, (size_t)(value_end - value));
+                    uid[value_end - value] = '\0';
+                }
+            }
+        }
 
-    if (fileset == 0 || icalerrno == ICAL_FILE_ERROR) {
-        /* file does not exist */
-        ret = icalcluster_new(path, NULL);
-    } else {
-        ret = icalcluster_new(path, ((icalfileset *) fileset)->cluster);
-        icalfileset_free(fileset);
+        p = line_end;
     }
 
-    icalerror_set_errors_are_fatal(errstate);
-    icalerror_set_errno(ICAL_NO_ERROR);
-    return ret;
+    if (depth != 0) {
+        /* Unbalanced BEGIN/END; let the caller do a full parse. */
+        if (uid != 0) {
+            free(uid);
+        }
+        set->map_owned = 0;
+        icalfileset_lazy_release(set);
+        return ICAL_PARSE_ERROR;
+    }
+
+    set->map_base = map;
+    set->map_len = filesize;
+    set->map_owned = owned;
+    set->lazy_unmaterialized = set->lazy_ranges->num_elements;
+    set->cluster = icalcomponent_new(ICAL_XROOT_COMPONENT);
+
+    return ICAL_NO_ERROR;
 }
 
-static char *icalfileset_read_from_file(char *s, size_t size, void *d)
+/** Maps the cluster file and indexes the mapping. */
+static icalerrorenum icalfileset_map_and_index(icalfileset *set, size_t filesize)
 {
-    char *p = s;
-    icalfileset *set = d;
+#if defined(HAVE_SYS_MMAN_H)
+    char *map;
+    icalerrorenum error;
 
-    /* Simulate fgets -- read single characters and stop at '\n' */
+    map = mmap(0, filesize, PROT_READ, MAP_PRIVATE, set->fd, 0);
+    if (map == MAP_FAILED) {
+        return ICAL_FILE_ERROR;
+    }
 
-    for (p = s; p < s + size - 1; p++) {
+    error = icalfileset_index_buffer(set, map, filesize, 0);
+    if (error != ICAL_NO_ERROR) {
+        (void)munmap(map, filesize);
+    }
 
-        if (read(set->fd, p, 1) != 1 || *p == '\n') {
-            p++;
-            break;
-        }
+    return error;
+#else
+    _unused(set);
+    _unused(filesize);
+    return ICAL_FILE_ERROR;
+#endif
+}
+
+/** Reads a compressed cluster file, inflates it and either indexes the
+    inflated bytes (lazy mode) or parses them into the cluster. */
+static icalerrorenum icalfileset_load_compressed(icalfileset *set, size_t filesize)
+{
+#if defined(HAVE_ZLIB)
+    char *raw;
+    char *text;
+    const char *eol;
+    const Bytef *frame;
+    size_t header_len, got;
+    uLongf inflated_len;
+
+    raw = malloc(filesize);
+    if (raw == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
     }
 
-    *p = '\0';
+    for (got = 0; got < filesize;) {
+        ssize_t n = read(set->fd, raw + got, filesize - got);
 
-    if (*s == 0) {
-        return 0;
-    } else {
-        return s;
+        if (n <= 0) {
+            free(raw);
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return ICAL_FILE_ERROR;
+        }
+        got += (size_t)n;
     }
-}
 
-icalerrorenum icalfileset_read_file(icalfileset *set, int mode)
-{
-    icalparser *parser;
+    /* The header line carries the inflated size */
+    eol = memchr(raw, '\n', filesize);
+    if (eol == 0) {
+        free(raw);
+        icalerror_set_errno(ICAL_PARSE_ERROR);
+        return ICAL_PARSE_ERROR;
+    }
+    header_len = (size_t)(eol - raw) + 1;
+    inflated_len = (uLongf) strtoul(raw + sizeof(ICALFILESET_ZHDR) - 1, 0, 10);
+    frame = (const Bytef *)(raw + header_len);
+
+    text = malloc((size_t)inflated_len + 1);
+    if (text == 0) {
+        free(raw);
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
+    }
 
-    _unused(mode);
+    if (uncompress((Bytef *) text, &inflated_len, frame,
+                   (uLong)(filesize - header_len)) != Z_OK) {
+        free(text);
+        free(raw);
+        icalerror_set_errno(ICAL_PARSE_ERROR);
+        return ICAL_PARSE_ERROR;
+    }
+    text[inflated_len] = '\0';
+    free(raw);
 
-    parser = icalparser_new();
+    /* In lazy mode the boundary index runs over the inflated bytes,
+       which the set adopts in place of a mapping. */
+    if (set->options.lazy_load &&
+        icalfileset_index_buffer(set, text, (size_t)inflated_len, 1) == ICAL_NO_ERROR) {
+        return ICAL_NO_ERROR;
+    }
 
-    icalparser_set_gen_data(parser, set);
-    set->cluster = icalparser_parse(parser, icalfileset_read_from_file);
-    icalparser_free(parser);
+    set->cluster = icalparser_parse_string(text);
+    free(text);
 
     if (set->cluster == 0 || icalerrno != ICAL_NO_ERROR) {
         icalerror_set_errno(ICAL_PARSE_ERROR);
-        /*return ICAL_PARSE_ERROR; */
     }
 
-    if (icalcomponent_isa(set->cluster) != ICAL_XROOT_COMPONENT) {
+    if (set->cluster != 0 && icalcomponent_isa(set->cluster) != ICAL_XROOT_COMPONENT) {
         /* The parser got a single component, so it did not put it in
            an XROOT. */
         icalcomponent *cl = set->cluster;
@@ -198,235 +484,1600 @@ icalerrorenum icalfileset_read_file(icalfileset *set, int mode)
     }
 
     return ICAL_NO_ERROR;
+#else
+    _unused(set);
+    _unused(filesize);
+    icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
+    return ICAL_UNIMPLEMENTED_ERROR;
+#endif
 }
 
-long icalfileset_filesize(icalfileset *fset)
+/** Parses one indexed byte range and adds the result to the cluster. */
+static void icalfileset_lazy_materialize(icalfileset *set, struct icalfileset_range *range)
+{
+    char *text;
+    icalcomponent *c;
+
+    if (range->materialized) {
+        return;
+    }
+    range->materialized = 1;
+    set->lazy_unmaterialized--;
+
+    text = malloc(range->length + 1);
+    if (text == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return;
+    }
+    memcpy(text, set->map_base + range->start, range->length);
+    text[range->length] = '\0';
+
+    c = icalparser_parse_string(text);
+    free(text);
+
+    if (c != 0) {
+        icalcomponent_add_component(set->cluster, c);
+    }
+}
+
+/** Materializes every remaining range, for operations that need the
+    whole set (iteration, counting, committing). */
+static void icalfileset_lazy_ensure_all(icalfileset *set)
+{
+    size_t i;
+
+    if (set->lazy_ranges == 0 || set->lazy_unmaterialized == 0) {
+        return;
+    }
+
+    for (i = 0; i < set->lazy_ranges->num_elements; i++) {
+        icalfileset_lazy_materialize(set, icalarray_element_at(set->lazy_ranges, i));
+    }
+}
+
+static void icalfileset_lazy_release(icalfileset *set)
+{
+    if (set->lazy_ranges != 0) {
+        size_t i;
+
+        for (i = 0; i < set->lazy_ranges->num_elements; i++) {
+            struct icalfileset_range *range = icalarray_element_at(set->lazy_ranges, i);
+
+            if (range->uid != 0) {
+                free(range->uid);
+            }
+        }
+        icalarray_free(set->lazy_ranges);
+        set->lazy_ranges = 0;
+    }
+
+    if (set->map_base != 0 && set->map_owned) {
+        free(set->map_base);
+        set->map_base = 0;
+        set->map_len = 0;
+        set->map_owned = 0;
+    }
+#if defined(HAVE_SYS_MMAN_H)
+    if (set->map_base != 0) {
+        (void)munmap(set->map_base, set->map_len);
+        set->map_base = 0;
+        set->map_len = 0;
+    }
+#endif
+
+    set->lazy_unmaterialized = 0;
+}
+
+/** Returns the UID identifying a stored component, checking the
+    component itself first and then its first real inner component. */
+static const char *icalfileset_component_uid(icalcomponent *comp)
+{
+    icalproperty *p = icalcomponent_get_first_property(comp, ICAL_UID_PROPERTY);
+
+    if (p == 0) {
+        icalcomponent *inner = icalcomponent_get_first_real_component(comp);
+
+        if (inner != 0) {
+            p = icalcomponent_get_first_property(inner, ICAL_UID_PROPERTY);
+        }
+    }
+
+    return (p != 0) ? icalproperty_get_uid(p) : 0;
+}
+
+static void icalfileset_clean_snapshot_free(icalfileset *set)
+{
+    if (set->clean_snapshot != 0) {
+        size_t i;
+
+        for (i = 0; i < set->clean_snapshot->num_elements; i++) {
+            struct icalfileset_clean_entry *entry =
+                icalarray_element_at(set->clean_snapshot, i);
+
+            if (entry->uid != 0) {
+                free(entry->uid);
+            }
+        }
+        icalarray_free(set->clean_snapshot);
+        set->clean_snapshot = 0;
+    }
+
+    set->clean_valid = 0;
+}
+
+/** Records the content generation of the cluster and of each top-level
+    component, establishing "what the disk holds". A later commit
+    compares against this to skip the write entirely or, for journaled
+    sets, to journal only the components that were edited. */
+static void icalfileset_clean_snapshot_take(icalfileset *set)
+{
+    icalcomponent *c;
+
+    icalfileset_clean_snapshot_free(set);
+
+    if (set->lazy_unmaterialized != 0) {
+        /* Materializing would mutate the cluster under the snapshot. */
+        return;
+    }
+
+    set->clean_snapshot = icalarray_new_contiguous(sizeof(struct icalfileset_clean_entry), 64);
+    if (set->clean_snapshot == 0) {
+        return;
+    }
+
+    for (c = icalcomponent_get_first_component(set->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(set->cluster, ICAL_ANY_COMPONENT)) {
+        struct icalfileset_clean_entry entry;
+
+        entry.comp = c;
+        entry.generation = icalcomponent_content_generation(c);
+        entry.uid = 0;
+
+        if (set->options.journaled) {
+            const char *uid = icalfileset_component_uid(c);
+
+            if (uid != 0) {
+                entry.uid = strdup(uid);
+            }
+        }
+
+        icalarray_append(set->clean_snapshot, &entry);
+    }
+
+    set->clean_generation = icalcomponent_content_generation(set->cluster);
+    set->clean_valid = 1;
+}
+
+/** Whether the cluster still matches the snapshot taken at the last
+    commit. The cluster's own content generation covers every add,
+    remove and in-place edit below it, so this is a constant-time
+    check. */
+static int icalfileset_is_clean(icalfileset *set)
+{
+    return set->clean_valid &&
+        set->journal_pending == 0 &&
+        icalcomponent_content_generation(set->cluster) == set->clean_generation;
+}
+
+/** Records the on-disk identity — size and mtime of the cluster file,
+    replayed length of the journal — that the in-memory set now
+    matches. icalfileset_is_stale() compares the current files against
+    this stamp to detect modifications by other processes. */
+static void icalfileset_sync_stamp(icalfileset *set)
 {
     struct stat sbuf;
 
-    if (stat(fset->path, &sbuf) != 0) {
+    set->sync_cluster_size = 0;
+    set->sync_cluster_mtime = 0;
+    set->sync_journal_size = 0;
 
-        /* A file by the given name does not exist, or there was
-           another error */
-        if (errno == ENOENT) {
-            /* It was because the file does not exist */
-            return 0;
-        } else {
-            /* It was because of another error */
-            icalerror_set_errno(ICAL_FILE_ERROR);
-            return -1;
+    if (!set->options.snapshot && stat(set->path, &sbuf) == 0) {
+        set->sync_cluster_size = (long)sbuf.st_size;
+        set->sync_cluster_mtime = sbuf.st_mtime;
+    }
+
+    if (set->journal_fd > 0 && fstat(set->journal_fd, &sbuf) == 0) {
+        set->sync_journal_size = (long)sbuf.st_size;
+    }
+}
+
+static icalerrorenum icalfileset_journal_open(icalfileset *set)
+{
+    char *jpath;
+    size_t jpath_size = strlen(set->path) + sizeof(".jnl");
+
+    jpath = malloc(jpath_size);
+    if (jpath == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
+    }
+    snprintf(jpath, jpath_size, "%s.jnl", set->path);
+
+    set->journal_fd = open(jpath, O_RDWR | O_CREAT, set->options.mode);
+    free(jpath);
+
+    if (set->journal_fd < 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    return icalfileset_journal_replay(set);
+}
+
+/** Removes (and frees) the first component in the cluster whose UID
+    matches, for replaying a journal remove record. */
+static void icalfileset_journal_remove_uid(icalfileset *set, const char *uid)
+{
+    icalcomponent *c;
+
+    for (c = icalcomponent_get_first_component(set->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(set->cluster, ICAL_ANY_COMPONENT)) {
+
+        const char *this_uid = icalfileset_component_uid(c);
+
+        if (this_uid != 0 && strcmp(this_uid, uid) == 0) {
+            icalcomponent_remove_component(set->cluster, c);
+            icalcomponent_free(c);
+            return;
+        }
+    }
+}
+
+/** Applies the records in the journal file, starting at the given byte
+    offset, to the in-memory cluster. The set still matches what is on
+    disk afterwards, so this does not mark it as changed. Replaying
+    from a non-zero offset is how icalfileset_refresh() picks up only
+    the records another process appended. */
+static icalerrorenum icalfileset_journal_replay_from(icalfileset *set, long offset)
+{
+    struct stat sbuf;
+    char *buf, *p, *end;
+    size_t len;
+    ssize_t rd;
+
+    if (fstat(set->journal_fd, &sbuf) != 0 || (long)sbuf.st_size <= offset) {
+        return ICAL_NO_ERROR;
+    }
+
+    len = (size_t)((long)sbuf.st_size - offset);
+
+    buf = malloc(len + 1);
+    if (buf == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
+    }
+
+    if (lseek(set->journal_fd, (off_t) offset, SEEK_SET) < 0) {
+        free(buf);
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    rd = read(set->journal_fd, buf, len);
+    if (rd != (ssize_t)len) {
+        free(buf);
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+    buf[rd] = '\0';
+    end = buf + rd;
+
+    p = buf;
+    while (p < end) {
+
+        if (strncmp(p, ICALFILESET_JNL_REMOVE_HDR,
+                    sizeof(ICALFILESET_JNL_REMOVE_HDR) - 1) == 0) {
+
+            char *uid = p + sizeof(ICALFILESET_JNL_REMOVE_HDR) - 1;
+            char *eol = strpbrk(uid, "\r\n");
+
+            if (eol != 0) {
+                *eol = '\0';
+                p = eol + 1;
+                while (p < end && (*p == '\r' || *p == '\n')) {
+                    p++;
+                }
+            } else {
+                p = end;
+            }
+
+            icalfileset_journal_remove_uid(set, uid);
+            set->journal_records++;
+
+        } else if (strncmp(p, ICALFILESET_JNL_ADD_HDR,
+                           sizeof(ICALFILESET_JNL_ADD_HDR) - 1) == 0) {
+
+            char *body = p + sizeof(ICALFILESET_JNL_ADD_HDR) - 1;
+            char *next = strstr(body, "\nX-LIC-JNL:");
+            char saved = '\0';
+            icalcomponent *c;
+
+            if (next != 0) {
+                next++; /* keep the newline with this record */
+                saved = *next;
+                *next = '\0';
+            }
+
+            c = icalparser_parse_string(body);
+
+            if (next != 0) {
+                *next = saved;
+                p = next;
+            } else {
+                p = end;
+            }
+
+            if (c != 0) {
+                if (icalcomponent_isa(c) == ICAL_XROOT_COMPONENT) {
+                    icalcomponent *inner;
+
+                    while ((inner =
+                           icalcomponent_get_first_component(c, ICAL_ANY_COMPONENT)) != 0) {
+                        icalcomponent_remove_component(c, inner);
+                        icalcomponent_add_component(set->cluster, inner);
+                    }
+                    icalcomponent_free(c);
+                } else {
+                    icalcomponent_add_component(set->cluster, c);
+                }
+            }
+            set->journal_records++;
+
+        } else {
+            /* Unrecognized record; the journal is damaged. Keep what has
+               been replayed and have the next commit rewrite everything. */
+            set->journal_full_rewrite = 1;
+            set->changed = 1;
+            break;
+        }
+    }
+
+    free(buf);
+    return ICAL_NO_ERROR;
+}
+
+static icalerrorenum icalfileset_journal_replay(icalfileset *set)
+{
+    return icalfileset_journal_replay_from(set, 0);
+}
+
+static void icalfileset_journal_clear_pending(icalfileset *set)
+{
+    struct icalfileset_journal_op *op = set->journal_pending;
+
+    while (op != 0) {
+        struct icalfileset_journal_op *next = op->next;
+
+        if (op->uid != 0) {
+            free(op->uid);
+        }
+        free(op);
+        op = next;
+    }
+
+    set->journal_pending = 0;
+}
+
+/** Appends an op to the pending list, preserving commit order. */
+static void icalfileset_journal_push(icalfileset *set, struct icalfileset_journal_op *op)
+{
+    struct icalfileset_journal_op **tail = &set->journal_pending;
+
+    while (*tail != 0) {
+        tail = &(*tail)->next;
+    }
+    *tail = op;
+}
+
+static void icalfileset_journal_note_add(icalfileset *set, icalcomponent *child)
+{
+    struct icalfileset_journal_op *op;
+
+    if (set->options.journaled == 0) {
+        return;
+    }
+
+    op = malloc(sizeof(struct icalfileset_journal_op));
+    if (op == 0) {
+        set->journal_full_rewrite = 1;
+        return;
+    }
+
+    op->opcode = ICALFILESET_JNL_ADD;
+    op->uid = 0;
+    op->comp = child;
+    op->next = 0;
+
+    icalfileset_journal_push(set, op);
+}
+
+static void icalfileset_journal_note_remove(icalfileset *set, icalcomponent *child)
+{
+    struct icalfileset_journal_op *op, **opp;
+    const char *uid;
+
+    if (set->options.journaled == 0) {
+        return;
+    }
+
+    /* An add that has not been committed yet cancels out entirely. */
+    for (opp = &set->journal_pending; *opp != 0; opp = &(*opp)->next) {
+        if ((*opp)->opcode == ICALFILESET_JNL_ADD && (*opp)->comp == child) {
+            op = *opp;
+            *opp = op->next;
+            free(op);
+            return;
+        }
+    }
+
+    uid = icalfileset_component_uid(child);
+    if (uid == 0) {
+        /* No identity to record; fall back to a full rewrite. */
+        set->journal_full_rewrite = 1;
+        return;
+    }
+
+    op = malloc(sizeof(struct icalfileset_journal_op));
+    if (op == 0) {
+        set->journal_full_rewrite = 1;
+        return;
+    }
+
+    op->opcode = ICALFILESET_JNL_REMOVE;
+    op->uid = strdup(uid);
+    op->comp = 0;
+    op->next = 0;
+
+    if (op->uid == 0) {
+        free(op);
+        set->journal_full_rewrite = 1;
+        return;
+    }
+
+    icalfileset_journal_push(set, op);
+}
+
+/** Appends the pending ops as records at the end of the journal file.
+    The cluster file itself is not touched. */
+static icalerrorenum icalfileset_journal_append(icalfileset *set)
+{
+    struct icalfileset_journal_op *op;
+
+    if (lseek(set->journal_fd, 0, SEEK_END) < 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    for (op = set->journal_pending; op != 0; op = op->next) {
+
+        if (op->opcode == ICALFILESET_JNL_ADD) {
+            if (write(set->journal_fd, ICALFILESET_JNL_ADD_HDR,
+                      sizeof(ICALFILESET_JNL_ADD_HDR) - 1) < 0 ||
+                icalcomponent_write_fd(op->comp, set->journal_fd) < 0) {
+                icalerror_set_errno(ICAL_FILE_ERROR);
+                return ICAL_FILE_ERROR;
+            }
+        } else {
+            if (write(set->journal_fd, ICALFILESET_JNL_REMOVE_HDR,
+                      sizeof(ICALFILESET_JNL_REMOVE_HDR) - 1) < 0 ||
+                write(set->journal_fd, op->uid, strlen(op->uid)) < 0 ||
+                write(set->journal_fd, "\r\n", 2) < 0) {
+                icalerror_set_errno(ICAL_FILE_ERROR);
+                return ICAL_FILE_ERROR;
+            }
+        }
+
+        set->journal_records++;
+    }
+
+    icalfileset_journal_clear_pending(set);
+    set->changed = 0;
+
+    return ICAL_NO_ERROR;
+}
+
+static size_t icalfileset_journal_pending_count(icalfileset *set)
+{
+    struct icalfileset_journal_op *op;
+    size_t count = 0;
+
+    for (op = set->journal_pending; op != 0; op = op->next) {
+        count++;
+    }
+
+    return count;
+}
+
+/** An in-place edit announced with icalfileset_mark() forces a
+    journaled commit into a full compacting rewrite, because the journal
+    records only adds and removes. With the snapshot from the last
+    commit still valid, the edit can be expressed as records after all:
+    a remove of the identity the component had on disk followed by an
+    add of its current contents. Walks the cluster against the snapshot
+    in order; any structural difference means something other than an
+    in-place edit happened, and the full rewrite stands. */
+static void icalfileset_journal_downgrade(icalfileset *set)
+{
+    icalcomponent *c;
+    size_t i = 0;
+
+    for (c = icalcomponent_get_first_component(set->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(set->cluster, ICAL_ANY_COMPONENT)) {
+        struct icalfileset_clean_entry *entry;
+        struct icalfileset_journal_op *rm, *add;
+
+        if (i >= set->clean_snapshot->num_elements) {
+            return;
+        }
+
+        entry = icalarray_element_at(set->clean_snapshot, i);
+        i++;
+
+        if (entry->comp != c) {
+            /* Membership changed in a way the pending ops do not cover */
+            return;
+        }
+
+        if (icalcomponent_content_generation(c) == entry->generation) {
+            continue;
+        }
+
+        if (entry->uid == 0) {
+            /* No identity was recorded; there is nothing to remove by */
+            return;
+        }
+
+        rm = malloc(sizeof(struct icalfileset_journal_op));
+        add = malloc(sizeof(struct icalfileset_journal_op));
+        if (rm == 0 || add == 0) {
+            free(rm);
+            free(add);
+            return;
+        }
+
+        rm->opcode = ICALFILESET_JNL_REMOVE;
+        rm->uid = strdup(entry->uid);
+        rm->comp = 0;
+        rm->next = 0;
+
+        if (rm->uid == 0) {
+            free(rm);
+            free(add);
+            return;
+        }
+
+        add->opcode = ICALFILESET_JNL_ADD;
+        add->uid = 0;
+        add->comp = c;
+        add->next = 0;
+
+        icalfileset_journal_push(set, rm);
+        icalfileset_journal_push(set, add);
+    }
+
+    if (i != set->clean_snapshot->num_elements) {
+        return;
+    }
+
+    set->journal_full_rewrite = 0;
+}
+
+icalcluster *icalfileset_produce_icalcluster(const char *path)
+{
+    icalset *fileset;
+    icalcluster *ret;
+
+    int errstate = icalerror_get_errors_are_fatal();
+
+    icalerror_set_errors_are_fatal(0);
+
+    fileset = icalfileset_new_reader(path);
+
+    if (fileset == 0 || icalerrno == ICAL_FILE_ERROR) {
+        /* file does not exist */
+        ret = icalcluster_new(path, NULL);
+    } else {
+        ret = icalcluster_new(path, ((icalfileset *) fileset)->cluster);
+        icalfileset_free(fileset);
+    }
+
+    icalerror_set_errors_are_fatal(errstate);
+    icalerror_set_errno(ICAL_NO_ERROR);
+    return ret;
+}
+
+static char *icalfileset_read_from_file(char *s, size_t size, void *d)
+{
+    char *p = s;
+    icalfileset *set = d;
+
+    /* Simulate fgets -- read single characters and stop at '\n' */
+
+    for (p = s; p < s + size - 1; p++) {
+
+        if (read(set->fd, p, 1) != 1 || *p == '\n') {
+            p++;
+            break;
+        }
+    }
+
+    *p = '\0';
+
+    if (*s == 0) {
+        return 0;
+    } else {
+        return s;
+    }
+}
+
+icalerrorenum icalfileset_read_file(icalfileset *set, int mode)
+{
+    icalparser *parser;
+
+    _unused(mode);
+
+    parser = icalparser_new();
+
+    icalparser_set_gen_data(parser, set);
+    set->cluster = icalparser_parse(parser, icalfileset_read_from_file);
+    icalparser_free(parser);
+
+    if (set->cluster == 0 || icalerrno != ICAL_NO_ERROR) {
+        icalerror_set_errno(ICAL_PARSE_ERROR);
+        /*return ICAL_PARSE_ERROR; */
+    }
+
+    if (icalcomponent_isa(set->cluster) != ICAL_XROOT_COMPONENT) {
+        /* The parser got a single component, so it did not put it in
+           an XROOT. */
+        icalcomponent *cl = set->cluster;
+
+        set->cluster = icalcomponent_new(ICAL_XROOT_COMPONENT);
+        icalcomponent_add_component(set->cluster, cl);
+    }
+
+    return ICAL_NO_ERROR;
+}
+
+long icalfileset_filesize(icalfileset *fset)
+{
+    struct stat sbuf;
+
+    if (stat(fset->path, &sbuf) != 0) {
+
+        /* A file by the given name does not exist, or there was
+           another error */
+        if (errno == ENOENT) {
+            /* It was because the file does not exist */
+            return 0;
+        } else {
+            /* It was because of another error */
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return -1;
+        }
+    } else {
+        /* A file by the given name exists, but is it a regular file? */
+
+        if (!S_ISREG(sbuf.st_mode)) {
+            /* Nope, not a regular file */
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return -1;
+        } else {
+            /* Let's assume that it is a file of the right type */
+            return (long)sbuf.st_size;
+        }
+    }
+
+    /*return -1; not reached */
+}
+
+void icalfileset_free(icalset *set)
+{
+    icalfileset *fset;
+
+    icalerror_check_arg_rv((set != 0), "set");
+
+    fset = (icalfileset *) set;
+
+    if (fset->cluster != 0) {
+        (void)icalfileset_commit(set);
+        icalcomponent_free(fset->cluster);
+        fset->cluster = 0;
+    }
+
+    if (fset->gauge != 0) {
+        icalgauge_free(fset->gauge);
+        fset->gauge = 0;
+    }
+
+    if (fset->fd > 0) {
+        (void)icalfileset_unlock(fset);
+        close(fset->fd);
+        fset->fd = -1;
+    }
+
+    if (fset->journal_fd > 0) {
+        close(fset->journal_fd);
+        fset->journal_fd = -1;
+    }
+
+    icalfileset_journal_clear_pending(fset);
+    icalfileset_clean_snapshot_free(fset);
+    icalfileset_lazy_release(fset);
+
+    if (fset->time_index != 0) {
+        icalarray_free(fset->time_index);
+        fset->time_index = 0;
+    }
+
+    if (fset->path != 0) {
+        free(fset->path);
+        fset->path = 0;
+    }
+}
+
+const char *icalfileset_path(icalset *set)
+{
+    icalerror_check_arg_rz((set != 0), "set");
+
+    return ((icalfileset *) set)->path;
+}
+
+int icalfileset_lock(icalfileset *set)
+{
+#if !defined(_WIN32)
+    struct flock lock;
+    int rtrn;
+
+    icalerror_check_arg_rz((set->fd > 0), "set->fd");
+    errno = 0;
+
+    /* Sets opened read-only take a shared lock, so any number of
+       readers can work on the same file at once; only writable opens
+       exclude each other (and all readers). */
+    if ((set->options.flags & O_ACCMODE) == O_RDONLY) {
+        lock.l_type = F_RDLCK;
+    } else {
+        lock.l_type = F_WRLCK;
+    }
+    lock.l_start = 0;   /* byte offset relative to l_whence */
+    lock.l_whence = SEEK_SET;   /* SEEK_SET, SEEK_CUR, SEEK_END */
+    lock.l_len = 0;     /* #bytes (0 means to EOF) */
+
+    rtrn = fcntl(set->fd, F_SETLKW, &lock);
+
+    return rtrn;
+#else
+    _unused(set);
+    return 0;
+#endif
+}
+
+int icalfileset_unlock(icalfileset *set)
+{
+#if !defined(_WIN32)
+    struct flock lock;
+
+    icalerror_check_arg_rz((set->fd > 0), "set->fd");
+
+    lock.l_type = F_UNLCK;      /* F_RDLCK, F_WRLCK, F_UNLCK */
+    lock.l_start = 0;   /* byte offset relative to l_whence */
+    lock.l_whence = SEEK_SET;   /* SEEK_SET, SEEK_CUR, SEEK_END */
+    lock.l_len = 0;     /* #bytes (0 means to EOF) */
+
+    return (fcntl(set->fd, F_SETLK, &lock));
+#else
+    _unused(set);
+    return 0;
+#endif
+}
+
+#if !defined(_WIN32)
+static char *shell_quote(const char *s)
+{
+    char *result;
+    char *p;
+
+    p = result = malloc(strlen(s) * 5 + 1);
+    while (*s) {
+        if (*s == '\'') {
+            *p++ = '\'';
+            *p++ = '"';
+            *p++ = *s++;
+            *p++ = '"';
+            *p++ = '\'';
+        } else {
+            *p++ = *s++;
+        }
+    }
+    *p = '\0';
+    return result;
+}
+
+#endif
+
+#if defined(HAVE_ZLIB)
+/** Serializes the cluster, deflates it into a single frame and writes
+    the header line plus frame at the current file offset. */
+static icalerrorenum icalfileset_write_compressed(icalfileset *fset, size_t *write_size)
+{
+    icalcomponent *c;
+    char *buf, *buf_ptr;
+    size_t buf_size;
+    uLongf frame_len;
+    Bytef *frame;
+    char header[sizeof(ICALFILESET_ZHDR) + 32];
+    int hlen;
+    icalerrorenum error = ICAL_NO_ERROR;
+
+    buf_size = 8192;
+    buf = icalmemory_new_buffer(buf_size);
+    if (buf == 0) {
+        return ICAL_NEWFAILED_ERROR;
+    }
+    buf_ptr = buf;
+    *buf_ptr = '\0';
+
+    for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
+        char *str = icalcomponent_as_ical_string_r(c);
+
+        if (str != 0) {
+            icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
+            icalmemory_free_buffer(str);
+        }
+    }
+
+    frame_len = compressBound((uLong)(buf_ptr - buf));
+    frame = malloc(frame_len);
+    if (frame == 0) {
+        icalmemory_free_buffer(buf);
+        return ICAL_NEWFAILED_ERROR;
+    }
+
+    if (compress2(frame, &frame_len, (const Bytef *)buf, (uLong)(buf_ptr - buf),
+                  Z_DEFAULT_COMPRESSION) != Z_OK) {
+        error = ICAL_INTERNAL_ERROR;
+    } else {
+        hlen = snprintf(header, sizeof(header), ICALFILESET_ZHDR "%lu\r\n",
+                        (unsigned long)(buf_ptr - buf));
+
+        if (write(fset->fd, header, (size_t)hlen) != (ssize_t)hlen ||
+            write(fset->fd, frame, (size_t)frame_len) != (ssize_t)frame_len) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            error = ICAL_FILE_ERROR;
+        } else {
+            *write_size = (size_t)hlen + (size_t)frame_len;
+        }
+    }
+
+    free(frame);
+    icalmemory_free_buffer(buf);
+
+    return error;
+}
+#endif
+
+static icalerrorenum icalfileset_commit_impl(icalset *set)
+{
+    char tmp[MAXPATHLEN];
+    icalcomponent *c;
+    size_t write_size = 0;
+    icalfileset *fset = (icalfileset *) set;
+
+#if defined(_WIN32_WCE)
+    wchar_t *wtmp = 0;
+    PROCESS_INFORMATION pi;
+#endif
+
+    icalerror_check_arg_re((fset != 0), "set", ICAL_BADARG_ERROR);
+
+    icalerror_check_arg_re((fset->fd > 0), "set->fd is invalid", ICAL_INTERNAL_ERROR);
+
+    /* An asynchronous commit may still be queued against the same
+       inode; let it land before writing, or the two would interleave */
+    if (fset->async_pending) {
+        (void)icalfileset_flush_async();
+        fset->async_pending = 0;
+    }
+
+    if (fset->changed == 0) {
+        return ICAL_NO_ERROR;
+    }
+
+    /* mark() was called, but the content generations say nothing under
+       the cluster actually moved; the disk already matches. */
+    if (icalfileset_is_clean(fset)) {
+        fset->changed = 0;
+        fset->journal_full_rewrite = 0;
+        return ICAL_NO_ERROR;
+    }
+
+    /* A rewrite emits the in-memory cluster, so any components still
+       only indexed in the mapping have to be parsed first. */
+    icalfileset_lazy_ensure_all(fset);
+
+    /* An in-place edit forces a full rewrite by default; try to turn
+       the edited components into remove+add records first, so the
+       commit stays proportional to the change. */
+    if (fset->options.journaled && fset->journal_fd > 0 &&
+        fset->journal_full_rewrite && fset->clean_valid) {
+        icalfileset_journal_downgrade(fset);
+    }
+
+    /* In journaled mode, append the pending ops instead of rewriting the
+       cluster file, unless a change cannot be expressed as records or
+       the journal has grown past the garbage threshold — then fall
+       through to a compacting full rewrite. */
+    if (fset->options.journaled && fset->journal_fd > 0 &&
+        fset->journal_full_rewrite == 0 && fset->journal_pending != 0 &&
+        fset->journal_records + icalfileset_journal_pending_count(fset) <=
+        ICALFILESET_JOURNAL_COMPACT_LIMIT) {
+        icalerrorenum jerror = icalfileset_journal_append(fset);
+
+        if (jerror == ICAL_NO_ERROR) {
+            icalfileset_clean_snapshot_take(fset);
+            icalfileset_sync_stamp(fset);
+        }
+        return jerror;
+    }
+
+    if (fset->options.safe_saves == 1) {
+#if !defined(_WIN32)
+        char *quoted_file = shell_quote(fset->path);
+
+        snprintf(tmp, MAXPATHLEN, "cp '%s' '%s.bak'", fset->path, fset->path);
+        free(quoted_file);
+#else
+        snprintf(tmp, MAXPATHLEN, "copy %s %s.bak", fset->path, fset->path);
+#endif
+
+#if !defined(_WIN32_WCE)
+        if (system(tmp) < 0) {
+#else
+
+        wtmp = wce_mbtowc(tmp);
+
+        if (CreateProcess(wtmp, L"", NULL, NULL, FALSE, 0, NULL, NULL, NULL, &pi)) {
+#endif
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return ICAL_FILE_ERROR;
+        }
+    }
+#if defined(_WIN32_WCE)
+    free(wtmp);
+#endif
+
+    if (lseek(fset->fd, 0, SEEK_SET) < 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    if (fset->compressed) {
+#if defined(HAVE_ZLIB)
+        icalerrorenum error = icalfileset_write_compressed(fset, &write_size);
+
+        if (error != ICAL_NO_ERROR) {
+            return error;
+        }
+#else
+        /* zlib was not built in; write the cluster as plain text */
+        fset->compressed = 0;
+#endif
+    }
+
+    if (!fset->compressed) {
+        for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
+             c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
+            /* Gathers the rendered property fragments straight to the
+               descriptor instead of assembling a temporary string */
+            long sz = icalcomponent_write_fd(c, fset->fd);
+
+            if (sz < 0) {
+                perror("write");
+                icalerror_set_errno(ICAL_FILE_ERROR);
+                return ICAL_FILE_ERROR;
+            }
+
+            write_size += (size_t)sz;
+        }
+    }
+
+    fset->changed = 0;
+
+#if !defined(_WIN32)
+    if (ftruncate(fset->fd, (off_t) write_size) < 0) {
+        return ICAL_FILE_ERROR;
+    }
+#else
+#if !defined(_WIN32_WCE)
+    chsize(fset->fd, tell(fset->fd));
+#else
+    SetEndOfFile(fset->fd);
+#endif
+#endif
+
+    /* The cluster file now holds the complete set; drop the journal. */
+    if (fset->options.journaled && fset->journal_fd > 0) {
+#if !defined(_WIN32)
+        if (ftruncate(fset->journal_fd, 0) == 0) {
+            (void)lseek(fset->journal_fd, 0, SEEK_SET);
+        }
+#else
+#if !defined(_WIN32_WCE)
+        chsize(fset->journal_fd, 0);
+#endif
+#endif
+        fset->journal_records = 0;
+        fset->journal_full_rewrite = 0;
+        icalfileset_journal_clear_pending(fset);
+    }
+
+    icalfileset_clean_snapshot_take(fset);
+    icalfileset_sync_stamp(fset);
+
+    return ICAL_NO_ERROR;
+}
+
+icalerrorenum icalfileset_commit(icalset *set)
+{
+    icalerrorenum error;
+    ical_trace_timer trace_t = ical_trace_timer_start();
+
+    error = icalfileset_commit_impl(set);
+
+    ical_trace_point_hit(ICAL_TRACE_FILESET_COMMIT, trace_t);
+
+    return error;
+}
+
+/** Discards the in-memory state and reloads the set from disk, the
+    same way icalfileset_init() loads it. The descriptor is reopened
+    because the file may have been replaced, leaving the old one aimed
+    at a dead inode. */
+static icalerrorenum icalfileset_reload_full(icalfileset *set)
+{
+    long cluster_file_size;
+    int compressed_on_disk = 0;
+    int loaded = 0;
+
+    /* Drop everything derived from the old on-disk state */
+    if (set->cluster != 0) {
+        icalcomponent_free(set->cluster);
+        set->cluster = 0;
+    }
+    icalfileset_clean_snapshot_free(set);
+    icalfileset_lazy_release(set);
+    if (set->time_index != 0) {
+        icalarray_free(set->time_index);
+        set->time_index = 0;
+    }
+    set->time_index_dirty = 1;
+
+    if (set->fd > 0) {
+        (void)icalfileset_unlock(set);
+        close(set->fd);
+    }
+
+    set->fd = open(set->path, set->options.flags, set->options.mode);
+    if (set->fd < 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+    (void)icalfileset_lock(set);
+
+    cluster_file_size = icalfileset_filesize(set);
+    if (cluster_file_size < 0) {
+        return ICAL_FILE_ERROR;
+    }
+
+    set->compressed = set->options.compressed;
+
+    if (cluster_file_size > 0) {
+        if ((size_t)cluster_file_size > sizeof(ICALFILESET_ZHDR)) {
+            char zhdr[sizeof(ICALFILESET_ZHDR) - 1];
+
+            if (read(set->fd, zhdr, sizeof(zhdr)) == (ssize_t)sizeof(zhdr) &&
+                strncmp(zhdr, ICALFILESET_ZHDR, sizeof(zhdr)) == 0) {
+                compressed_on_disk = 1;
+                set->compressed = 1;
+            }
+
+            if (lseek(set->fd, 0, SEEK_SET) < 0) {
+                icalerror_set_errno(ICAL_FILE_ERROR);
+                return ICAL_FILE_ERROR;
+            }
+        }
+
+        if (compressed_on_disk) {
+            if (icalfileset_load_compressed(set, (size_t)cluster_file_size) != ICAL_NO_ERROR) {
+                return ICAL_FILE_ERROR;
+            }
+            loaded = 1;
+        }
+
+        if (!loaded && set->options.lazy_load) {
+            loaded =
+                (icalfileset_map_and_index(set, (size_t)cluster_file_size) == ICAL_NO_ERROR);
+        }
+
+        if (!loaded && icalfileset_read_file(set, set->options.mode) != ICAL_NO_ERROR) {
+            return ICAL_FILE_ERROR;
+        }
+    }
+
+    if (set->cluster == 0) {
+        set->cluster = icalcomponent_new(ICAL_XROOT_COMPONENT);
+    }
+
+    if (set->options.journaled && set->journal_fd > 0) {
+        icalerrorenum error;
+
+        icalfileset_lazy_ensure_all(set);
+        set->journal_records = 0;
+        error = icalfileset_journal_replay(set);
+        if (error != ICAL_NO_ERROR) {
+            return error;
+        }
+    }
+
+    if (set->changed == 0 && set->compressed == compressed_on_disk) {
+        icalfileset_clean_snapshot_take(set);
+    }
+
+    icalfileset_sync_stamp(set);
+
+    return ICAL_NO_ERROR;
+}
+
+int icalfileset_is_stale(icalset *set)
+{
+    icalfileset *fset = (icalfileset *) set;
+    struct stat sbuf;
+
+    icalerror_check_arg_re((fset != 0), "set", -1);
+
+    if (fset->options.snapshot) {
+        /* Published snapshots are immutable */
+        return 0;
+    }
+
+    if (stat(fset->path, &sbuf) != 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return -1;
+    }
+
+    if ((long)sbuf.st_size != fset->sync_cluster_size ||
+        sbuf.st_mtime != fset->sync_cluster_mtime) {
+        return 1;
+    }
+
+    if (fset->journal_fd > 0) {
+        if (fstat(fset->journal_fd, &sbuf) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return -1;
+        }
+
+        if ((long)sbuf.st_size != fset->sync_journal_size) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+icalerrorenum icalfileset_refresh(icalset *set)
+{
+    icalfileset *fset = (icalfileset *) set;
+    struct stat sbuf;
+    int cluster_unchanged;
+
+    icalerror_check_arg_re((fset != 0), "set", ICAL_BADARG_ERROR);
+
+    if (fset->options.snapshot) {
+        return ICAL_NO_ERROR;
+    }
+
+    /* Let our own queued write land first, so it is not mistaken for
+       another process's change */
+    if (fset->async_pending) {
+        (void)icalfileset_flush_async();
+        fset->async_pending = 0;
+    }
+
+    /* Uncommitted local changes cannot be reconciled with the new disk
+       state; the caller has to commit (or abandon the set) first. */
+    if (fset->changed != 0 || fset->journal_pending != 0 ||
+        (fset->clean_valid && !icalfileset_is_clean(fset))) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return ICAL_USAGE_ERROR;
+    }
+
+    if (stat(fset->path, &sbuf) != 0) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
+
+    cluster_unchanged = ((long)sbuf.st_size == fset->sync_cluster_size &&
+                         sbuf.st_mtime == fset->sync_cluster_mtime);
+
+    if (cluster_unchanged && fset->journal_fd > 0) {
+        struct stat jbuf;
+
+        if (fstat(fset->journal_fd, &jbuf) != 0) {
+            icalerror_set_errno(ICAL_FILE_ERROR);
+            return ICAL_FILE_ERROR;
+        }
+
+        if ((long)jbuf.st_size == fset->sync_journal_size) {
+            return ICAL_NO_ERROR;
+        }
+
+        /* Append-only fast path: the cluster file is untouched and the
+           journal has only grown, so replaying just the new bytes
+           brings the set up to date at a cost proportional to the
+           delta. A shorter journal means another process compacted it,
+           which only a full reload can absorb. */
+        if ((long)jbuf.st_size > fset->sync_journal_size) {
+            icalerrorenum error =
+                icalfileset_journal_replay_from(fset, fset->sync_journal_size);
+
+            if (error != ICAL_NO_ERROR) {
+                return error;
+            }
+
+            fset->time_index_dirty = 1;
+
+            if (fset->changed == 0) {
+                icalfileset_clean_snapshot_take(fset);
+            }
+            icalfileset_sync_stamp(fset);
+
+            return ICAL_NO_ERROR;
+        }
+    } else if (cluster_unchanged) {
+        return ICAL_NO_ERROR;
+    }
+
+    return icalfileset_reload_full(fset);
+}
+
+/* The asynchronous commit pipeline. A single shared writer thread takes
+   serialized snapshots off a bounded queue and performs the write,
+   truncate and fsync that otherwise dominate commit latency. Each job
+   carries a dup of the set's descriptor, so it stays valid (and keeps
+   writing to the same inode, preserving file locks) even if the set is
+   freed while the job is still queued. */
+
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+
+#define ICALFILESET_ASYNC_QUEUE_MAX 16
+
+struct icalfileset_async_job
+{
+    int fd;                     /* dup of the set's descriptor; the job owns it */
+    char *data;
+    size_t len;
+    struct icalfileset_async_job *next;
+};
+
+static pthread_mutex_t async_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_wake = PTHREAD_COND_INITIALIZER;    /* writer: work queued */
+static pthread_cond_t async_drain = PTHREAD_COND_INITIALIZER;   /* callers: space/idle */
+static struct icalfileset_async_job *async_head = 0;
+static struct icalfileset_async_job *async_tail = 0;
+static size_t async_queue_len = 0;
+static int async_thread_started = 0;
+static int async_writer_busy = 0;
+static icalerrorenum async_error = ICAL_NO_ERROR;
+
+static void *icalfileset_async_writer(void *arg)
+{
+    _unused(arg);
+
+    pthread_mutex_lock(&async_mutex);
+    for (;;) {
+        struct icalfileset_async_job *job;
+        int failed = 0;
+        size_t off = 0;
+
+        while (async_head == 0) {
+            pthread_cond_wait(&async_wake, &async_mutex);
         }
-    } else {
-        /* A file by the given name exists, but is it a regular file? */
 
-        if (!S_ISREG(sbuf.st_mode)) {
-            /* Nope, not a regular file */
-            icalerror_set_errno(ICAL_FILE_ERROR);
-            return -1;
-        } else {
-            /* Let's assume that it is a file of the right type */
-            return (long)sbuf.st_size;
+        job = async_head;
+        async_head = job->next;
+        if (async_head == 0) {
+            async_tail = 0;
+        }
+        async_queue_len--;
+        async_writer_busy = 1;
+        pthread_cond_broadcast(&async_drain);
+        pthread_mutex_unlock(&async_mutex);
+
+        if (lseek(job->fd, 0, SEEK_SET) < 0) {
+            failed = 1;
+        }
+        while (!failed && off < job->len) {
+            ssize_t wr = write(job->fd, job->data + off, job->len - off);
+
+            if (wr < 0) {
+                failed = 1;
+            } else {
+                off += (size_t)wr;
+            }
         }
+        if (!failed && ftruncate(job->fd, (off_t) job->len) < 0) {
+            failed = 1;
+        }
+        if (!failed && fsync(job->fd) < 0) {
+            failed = 1;
+        }
+
+        close(job->fd);
+        icalmemory_free_buffer(job->data);
+        free(job);
+
+        pthread_mutex_lock(&async_mutex);
+        if (failed && async_error == ICAL_NO_ERROR) {
+            async_error = ICAL_FILE_ERROR;
+        }
+        async_writer_busy = 0;
+        pthread_cond_broadcast(&async_drain);
     }
 
-    /*return -1; not reached */
+    return 0;
 }
 
-void icalfileset_free(icalset *set)
+#endif /* HAVE_PTHREAD && !_WIN32 */
+
+icalerrorenum icalfileset_commit_async(icalset *set)
 {
-    icalfileset *fset;
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    icalfileset *fset = (icalfileset *) set;
+    struct icalfileset_async_job *job;
+    icalcomponent *c;
+    char *buf, *buf_ptr;
+    size_t buf_size;
+    int dupfd;
 
-    icalerror_check_arg_rv((set != 0), "set");
+    icalerror_check_arg_re((fset != 0), "set", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((fset->fd > 0), "set->fd is invalid", ICAL_INTERNAL_ERROR);
 
-    fset = (icalfileset *) set;
+    if (fset->changed == 0) {
+        return ICAL_NO_ERROR;
+    }
 
-    if (fset->cluster != 0) {
-        (void)icalfileset_commit(set);
-        icalcomponent_free(fset->cluster);
-        fset->cluster = 0;
+    if (icalfileset_is_clean(fset)) {
+        fset->changed = 0;
+        return ICAL_NO_ERROR;
     }
 
-    if (fset->gauge != 0) {
-        icalgauge_free(fset->gauge);
-        fset->gauge = 0;
+    /* Journaled commits are already proportional to the change, and
+       their record framing does not suit whole-file snapshots.
+       Compressed clusters deflate at commit, which the writer thread's
+       plain byte jobs do not carry. */
+    if (fset->options.journaled || fset->compressed) {
+        return icalfileset_commit(set);
     }
 
-    if (fset->fd > 0) {
-        (void)icalfileset_unlock(fset);
-        close(fset->fd);
-        fset->fd = -1;
+    icalfileset_lazy_ensure_all(fset);
+
+    /* Snapshot the serialization here, in the calling thread; only the
+       disk traffic moves to the writer */
+    buf_size = 8192;
+    buf = icalmemory_new_buffer(buf_size);
+    if (buf == 0) {
+        return ICAL_NEWFAILED_ERROR;
     }
+    buf_ptr = buf;
+    *buf_ptr = '\0';
 
-    if (fset->path != 0) {
-        free(fset->path);
-        fset->path = 0;
+    for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
+        char *str = icalcomponent_as_ical_string_r(c);
+
+        if (str != 0) {
+            icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
+            icalmemory_free_buffer(str);
+        }
     }
-}
 
-const char *icalfileset_path(icalset *set)
-{
-    icalerror_check_arg_rz((set != 0), "set");
+    job = malloc(sizeof(struct icalfileset_async_job));
+    dupfd = (job != 0) ? dup(fset->fd) : -1;
 
-    return ((icalfileset *) set)->path;
-}
+    if (job == 0 || dupfd < 0) {
+        /* Cannot queue; fall back to the synchronous path */
+        if (job != 0) {
+            free(job);
+        }
+        icalmemory_free_buffer(buf);
+        return icalfileset_commit(set);
+    }
 
-int icalfileset_lock(icalfileset *set)
-{
-#if !defined(_WIN32)
-    struct flock lock;
-    int rtrn;
+    job->fd = dupfd;
+    job->data = buf;
+    job->len = (size_t)(buf_ptr - buf);
+    job->next = 0;
 
-    icalerror_check_arg_rz((set->fd > 0), "set->fd");
-    errno = 0;
-    lock.l_type = F_WRLCK;      /* F_RDLCK, F_WRLCK, F_UNLCK */
-    lock.l_start = 0;   /* byte offset relative to l_whence */
-    lock.l_whence = SEEK_SET;   /* SEEK_SET, SEEK_CUR, SEEK_END */
-    lock.l_len = 0;     /* #bytes (0 means to EOF) */
+    pthread_mutex_lock(&async_mutex);
 
-    rtrn = fcntl(set->fd, F_SETLKW, &lock);
+    if (!async_thread_started) {
+        pthread_t tid;
 
-    return rtrn;
-#else
-    _unused(set);
-    return 0;
-#endif
-}
+        if (pthread_create(&tid, 0, icalfileset_async_writer, 0) != 0) {
+            pthread_mutex_unlock(&async_mutex);
+            close(dupfd);
+            free(job);
+            icalmemory_free_buffer(buf);
+            return icalfileset_commit(set);
+        }
+        pthread_detach(tid);
+        async_thread_started = 1;
+    }
 
-int icalfileset_unlock(icalfileset *set)
-{
-#if !defined(_WIN32)
-    struct flock lock;
+    while (async_queue_len >= ICALFILESET_ASYNC_QUEUE_MAX) {
+        pthread_cond_wait(&async_drain, &async_mutex);
+    }
 
-    icalerror_check_arg_rz((set->fd > 0), "set->fd");
+    if (async_tail != 0) {
+        async_tail->next = job;
+    } else {
+        async_head = job;
+    }
+    async_tail = job;
+    async_queue_len++;
 
-    lock.l_type = F_WRLCK;      /* F_RDLCK, F_WRLCK, F_UNLCK */
-    lock.l_start = 0;   /* byte offset relative to l_whence */
-    lock.l_whence = SEEK_SET;   /* SEEK_SET, SEEK_CUR, SEEK_END */
-    lock.l_len = 0;     /* #bytes (0 means to EOF) */
+    pthread_cond_signal(&async_wake);
+    pthread_mutex_unlock(&async_mutex);
+
+    fset->changed = 0;
+    fset->async_pending = 1;
+    icalfileset_clean_snapshot_take(fset);
 
-    return (fcntl(set->fd, F_UNLCK, &lock));
+    return ICAL_NO_ERROR;
 #else
-    _unused(set);
-    return 0;
+    return icalfileset_commit(set);
 #endif
 }
 
-#if !defined(_WIN32)
-static char *shell_quote(const char *s)
+icalerrorenum icalfileset_flush_async(void)
 {
-    char *result;
-    char *p;
+#if defined(HAVE_PTHREAD) && !defined(_WIN32)
+    icalerrorenum error;
 
-    p = result = malloc(strlen(s) * 5 + 1);
-    while (*s) {
-        if (*s == '\'') {
-            *p++ = '\'';
-            *p++ = '"';
-            *p++ = *s++;
-            *p++ = '"';
-            *p++ = '\'';
-        } else {
-            *p++ = *s++;
-        }
+    pthread_mutex_lock(&async_mutex);
+    while (async_head != 0 || async_writer_busy) {
+        pthread_cond_wait(&async_drain, &async_mutex);
     }
-    *p = '\0';
-    return result;
-}
+    error = async_error;
+    async_error = ICAL_NO_ERROR;
+    pthread_mutex_unlock(&async_mutex);
 
+    return error;
+#else
+    return ICAL_NO_ERROR;
 #endif
+}
 
-icalerrorenum icalfileset_commit(icalset *set)
+icalerrorenum icalfileset_snapshot_publish(icalset *set, const char *name)
 {
-    char tmp[MAXPATHLEN];
-    char *str;
-    icalcomponent *c;
-    size_t write_size = 0;
+#if defined(HAVE_SYS_MMAN_H) && !defined(_WIN32)
     icalfileset *fset = (icalfileset *) set;
-
-#if defined(_WIN32_WCE)
-    wchar_t *wtmp = 0;
-    PROCESS_INFORMATION pi;
-#endif
+    icalcomponent *c;
+    char *buf, *buf_ptr;
+    const char *p;
+    size_t buf_size, len;
+    int fd;
 
     icalerror_check_arg_re((fset != 0), "set", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((name != 0), "name", ICAL_BADARG_ERROR);
 
-    icalerror_check_arg_re((fset->fd > 0), "set->fd is invalid", ICAL_INTERNAL_ERROR);
+    icalfileset_lazy_ensure_all(fset);
 
-    if (fset->changed == 0) {
-        return ICAL_NO_ERROR;
+    buf_size = 8192;
+    buf = icalmemory_new_buffer(buf_size);
+    if (buf == 0) {
+        return ICAL_NEWFAILED_ERROR;
     }
+    buf_ptr = buf;
+    *buf_ptr = '\0';
 
-    if (fset->options.safe_saves == 1) {
-#if !defined(_WIN32)
-        char *quoted_file = shell_quote(fset->path);
-
-        snprintf(tmp, MAXPATHLEN, "cp '%s' '%s.bak'", fset->path, fset->path);
-        free(quoted_file);
-#else
-        snprintf(tmp, MAXPATHLEN, "copy %s %s.bak", fset->path, fset->path);
-#endif
-
-#if !defined(_WIN32_WCE)
-        if (system(tmp) < 0) {
-#else
-
-        wtmp = wce_mbtowc(tmp);
+    for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
+        char *str = icalcomponent_as_ical_string_r(c);
 
-        if (CreateProcess(wtmp, L"", NULL, NULL, FALSE, 0, NULL, NULL, NULL, &pi)) {
-#endif
-            icalerror_set_errno(ICAL_FILE_ERROR);
-            return ICAL_FILE_ERROR;
+        if (str != 0) {
+            icalmemory_append_string(&buf, &buf_ptr, &buf_size, str);
+            icalmemory_free_buffer(str);
         }
     }
-#if defined(_WIN32_WCE)
-    free(wtmp);
-#endif
 
-    if (lseek(fset->fd, 0, SEEK_SET) < 0) {
+    len = (size_t)(buf_ptr - buf);
+
+    /* O_TRUNC replaces any previous snapshot under the same name */
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        icalmemory_free_buffer(buf);
         icalerror_set_errno(ICAL_FILE_ERROR);
         return ICAL_FILE_ERROR;
     }
 
-    for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
-         c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
-        IO_SSIZE_T sz;
-
-        str = icalcomponent_as_ical_string_r(c);
+    p = buf;
+    while (len > 0) {
+        ssize_t wrote = write(fd, p, len);
 
-        sz = write(fset->fd, str, (IO_SIZE_T) strlen(str));
-        if (sz != (IO_SSIZE_T) strlen(str)) {
-            perror("write");
-            icalerror_set_errno(ICAL_FILE_ERROR);
-            free(str);
-            return ICAL_FILE_ERROR;
+        if (wrote <= 0) {
+            break;
         }
-
-        free(str);
-        write_size += sz;
+        p += wrote;
+        len -= (size_t)wrote;
     }
 
-    fset->changed = 0;
+    icalmemory_free_buffer(buf);
 
-#if !defined(_WIN32)
-    if (ftruncate(fset->fd, (off_t) write_size) < 0) {
+    if (close(fd) != 0 || len != 0) {
+        /* Do not leave a half-written snapshot behind */
+        (void)shm_unlink(name);
+        icalerror_set_errno(ICAL_FILE_ERROR);
         return ICAL_FILE_ERROR;
     }
+
+    return ICAL_NO_ERROR;
 #else
-#if !defined(_WIN32_WCE)
-    chsize(fset->fd, tell(fset->fd));
-#else
-    SetEndOfFile(fset->fd);
-#endif
+    _unused(set);
+    _unused(name);
+    icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
+    return ICAL_UNIMPLEMENTED_ERROR;
 #endif
+}
+
+icalerrorenum icalfileset_snapshot_remove(const char *name)
+{
+#if defined(HAVE_SYS_MMAN_H) && !defined(_WIN32)
+    icalerror_check_arg_re((name != 0), "name", ICAL_BADARG_ERROR);
+
+    if (shm_unlink(name) != 0 && errno != ENOENT) {
+        icalerror_set_errno(ICAL_FILE_ERROR);
+        return ICAL_FILE_ERROR;
+    }
 
     return ICAL_NO_ERROR;
+#else
+    _unused(name);
+    icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
+    return ICAL_UNIMPLEMENTED_ERROR;
+#endif
+}
+
+icalerrorenum icalfileset_compact(icalset *set)
+{
+    icalfileset *fset = (icalfileset *) set;
+
+    icalerror_check_arg_re((fset != 0), "set", ICAL_BADARG_ERROR);
+
+    fset->journal_full_rewrite = 1;
+    fset->changed = 1;
+    /* The point of compacting is the rewrite itself; do not let the
+       clean check skip it. */
+    fset->clean_valid = 0;
+
+    return icalfileset_commit(set);
 }
 
 void icalfileset_mark(icalset *set)
 {
+    icalfileset *fset;
+
     icalerror_check_arg_rv((set != 0), "set");
 
-    ((icalfileset *) set)->changed = 1;
+    fset = (icalfileset *) set;
+    fset->changed = 1;
+    fset->time_index_dirty = 1;
+
+    /* An external mark means components may have been edited in place,
+       which the journal cannot express; force a compacting commit. */
+    fset->journal_full_rewrite = 1;
 }
 
 icalcomponent *icalfileset_get_component(icalset *set)
@@ -436,6 +2087,7 @@ icalcomponent *icalfileset_get_component(icalset *set)
     icalerror_check_arg_rz((set != 0), "set");
 
     fset = (icalfileset *) set;
+    icalfileset_lazy_ensure_all(fset);
     return fset->cluster;
 }
 
@@ -451,7 +2103,9 @@ icalerrorenum icalfileset_add_component(icalset *set, icalcomponent *child)
     fset = (icalfileset *) set;
     icalcomponent_add_component(fset->cluster, child);
 
-    icalfileset_mark(set);
+    icalfileset_journal_note_add(fset, child);
+    fset->changed = 1;
+    fset->time_index_dirty = 1;
 
     return ICAL_NO_ERROR;
 }
@@ -466,7 +2120,9 @@ icalerrorenum icalfileset_remove_component(icalset *set, icalcomponent *child)
     fset = (icalfileset *) set;
     icalcomponent_remove_component(fset->cluster, child);
 
-    icalfileset_mark(set);
+    icalfileset_journal_note_remove(fset, child);
+    fset->changed = 1;
+    fset->time_index_dirty = 1;
 
     return ICAL_NO_ERROR;
 }
@@ -481,6 +2137,7 @@ int icalfileset_count_components(icalset *set, icalcomponent_kind kind)
     }
 
     fset = (icalfileset *) set;
+    icalfileset_lazy_ensure_all(fset);
     return icalcomponent_count_components(fset->cluster, kind);
 }
 
@@ -492,6 +2149,7 @@ icalerrorenum icalfileset_select(icalset *set, icalgauge *gauge)
 
     fset = (icalfileset *) set;
     fset->gauge = gauge;
+    fset->time_iter_range = 0;
 
     return ICAL_NO_ERROR;
 }
@@ -504,6 +2162,7 @@ void icalfileset_clear(icalset *set)
 
     fset = (icalfileset *) set;
     fset->gauge = 0;
+    fset->time_iter_range = 0;
 }
 
 icalcomponent *icalfileset_fetch(icalset *set, icalcomponent_kind kind, const char *uid)
@@ -516,6 +2175,34 @@ icalcomponent *icalfileset_fetch(icalset *set, icalcomponent_kind kind, const ch
     icalerror_check_arg_rz(set != 0, "set");
     fset = (icalfileset *) set;
 
+    /* In lazy mode, try the UID hints recorded by the boundary scan so
+       only the matching component has to be parsed. A range without a
+       hint (e.g. a folded UID line) cannot be ruled out that way, so
+       fall back to materializing everything. */
+    if (fset->lazy_ranges != 0 && fset->lazy_unmaterialized > 0 && uid != 0) {
+        size_t n;
+        int all_hinted = 1;
+
+        for (n = 0; n < fset->lazy_ranges->num_elements; n++) {
+            struct icalfileset_range *range = icalarray_element_at(fset->lazy_ranges, n);
+
+            if (range->materialized) {
+                continue;
+            }
+            if (range->uid == 0) {
+                all_hinted = 0;
+            } else if (strcmp(range->uid, uid) == 0) {
+                icalfileset_lazy_materialize(fset, range);
+                all_hinted = 1;
+                break;
+            }
+        }
+
+        if (!all_hinted) {
+            icalfileset_lazy_ensure_all(fset);
+        }
+    }
+
     for (i = icalcomponent_begin_component(fset->cluster, ICAL_ANY_COMPONENT);
          icalcompiter_deref(&i) != 0; icalcompiter_next(&i)) {
 
@@ -638,6 +2325,8 @@ icalcomponent *icalfileset_fetch_match(icalset *set, icalcomponent *comp)
 
     struct icalfileset_id comp_id, match_id;
 
+    icalfileset_lazy_ensure_all(fset);
+
     comp_id = icalfileset_get_id(comp);
 
     for (i = icalcomponent_begin_component(fset->cluster, ICAL_ANY_COMPONENT);
@@ -673,6 +2362,101 @@ icalerrorenum icalfileset_modify(icalset *set, icalcomponent *old, icalcomponent
     return ICAL_NO_ERROR;
 }
 
+/* The sorted DTSTART index. When the selected gauge constrains DTSTART
+   to a range (icalgauge_get_dtstart_range), iteration walks this index
+   instead of the cluster: wildcard entries — components with no DTSTART
+   or with a recurrence rule — sort to the front and are always tested,
+   dated entries below the lower bound are skipped without running the
+   gauge, and the scan stops at the first entry past the upper bound.
+   The index only prunes; every candidate still goes through
+   icalgauge_compare(). */
+
+static int icalfileset_time_entry_compare(const void *a, const void *b)
+{
+    const struct icalfileset_time_entry *ea = a;
+    const struct icalfileset_time_entry *eb = b;
+
+    if (ea->wildcard || eb->wildcard) {
+        return eb->wildcard - ea->wildcard;
+    }
+
+    return icaltime_compare(ea->start, eb->start);
+}
+
+static icalerrorenum icalfileset_time_index_build(icalfileset *fset)
+{
+    icalcomponent *c;
+
+    if (fset->time_index != 0 && !fset->time_index_dirty) {
+        return ICAL_NO_ERROR;
+    }
+
+    if (fset->time_index != 0) {
+        icalarray_free(fset->time_index);
+    }
+
+    fset->time_index = icalarray_new_contiguous(sizeof(struct icalfileset_time_entry), 32);
+    if (fset->time_index == 0) {
+        return ICAL_NEWFAILED_ERROR;
+    }
+
+    for (c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
+         c != 0; c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT)) {
+        struct icalfileset_time_entry entry;
+        icalcomponent *inner = icalcomponent_get_first_real_component(c);
+        icalproperty *dtstart = 0;
+
+        if (inner == 0) {
+            inner = c;
+        }
+
+        dtstart = icalcomponent_get_first_property(inner, ICAL_DTSTART_PROPERTY);
+
+        entry.comp = c;
+        entry.wildcard = (dtstart == 0) ||
+            (icalcomponent_get_first_property(inner, ICAL_RRULE_PROPERTY) != 0);
+        entry.start = entry.wildcard ? icaltime_null_time() : icalproperty_get_dtstart(dtstart);
+
+        icalarray_append(fset->time_index, &entry);
+    }
+
+    icalarray_sort(fset->time_index, icalfileset_time_entry_compare);
+    fset->time_index_dirty = 0;
+
+    return ICAL_NO_ERROR;
+}
+
+/** Advances the index-driven iteration to the next component that
+    passes the gauge, or returns 0 at the end of the range */
+static icalcomponent *icalfileset_time_index_next(icalfileset *fset)
+{
+    while (fset->time_iter_pos < fset->time_index->num_elements) {
+        struct icalfileset_time_entry *entry =
+            icalarray_element_at(fset->time_index, fset->time_iter_pos);
+
+        fset->time_iter_pos++;
+
+        if (!entry->wildcard) {
+            if (!icaltime_is_null_time(fset->time_lo) &&
+                icaltime_compare(entry->start, fset->time_lo) < 0) {
+                continue;
+            }
+            if (!icaltime_is_null_time(fset->time_hi) &&
+                icaltime_compare(entry->start, fset->time_hi) > 0) {
+                /* Sorted, so everything after this is out of range too */
+                break;
+            }
+        }
+
+        if (icalgauge_compare(fset->gauge, entry->comp) == 1) {
+            return entry->comp;
+        }
+    }
+
+    fset->time_iter_pos = fset->time_index->num_elements;
+    return 0;
+}
+
 /* Iterate through components */
 icalcomponent *icalfileset_get_current_component(icalset *set)
 {
@@ -681,6 +2465,7 @@ icalcomponent *icalfileset_get_current_component(icalset *set)
     icalerror_check_arg_rz((set != 0), "set");
 
     fset = (icalfileset *) set;
+    icalfileset_lazy_ensure_all(fset);
     return icalcomponent_get_current_component(fset->cluster);
 }
 
@@ -692,6 +2477,20 @@ icalcomponent *icalfileset_get_first_component(icalset *set)
     icalerror_check_arg_rz((set != 0), "set");
     fset = (icalfileset *) set;
 
+    icalfileset_lazy_ensure_all(fset);
+
+    /* If the gauge pins DTSTART to a range, drive the scan from the
+       sorted index so out-of-range components are never tested */
+    fset->time_iter_range = 0;
+    if (fset->gauge != 0 &&
+        icalgauge_get_dtstart_range(fset->gauge, &fset->time_lo, &fset->time_hi)) {
+        if (icalfileset_time_index_build(fset) == ICAL_NO_ERROR) {
+            fset->time_iter_range = 1;
+            fset->time_iter_pos = 0;
+            return icalfileset_time_index_next(fset);
+        }
+    }
+
     do {
         if (c == 0) {
             c = icalcomponent_get_first_component(fset->cluster, ICAL_ANY_COMPONENT);
@@ -716,6 +2515,10 @@ icalcomponent *icalfileset_get_next_component(icalset *set)
     icalerror_check_arg_rz((set != 0), "set");
     fset = (icalfileset *) set;
 
+    if (fset->time_iter_range) {
+        return icalfileset_time_index_next(fset);
+    }
+
     do {
         c = icalcomponent_get_next_component(fset->cluster, ICAL_ANY_COMPONENT);
 
@@ -777,6 +2580,7 @@ icalsetiter icalfileset_begin_component(icalset *set, icalcomponent_kind kind, i
     itr.gauge = gauge;
 
     fset = (icalfileset *) set;
+    icalfileset_lazy_ensure_all(fset);
     citr = icalcomponent_begin_component(fset->cluster, kind);
     comp = icalcompiter_deref(&citr);
 
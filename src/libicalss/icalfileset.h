@@ -34,6 +34,60 @@ LIBICAL_ICALSS_EXPORT icalset *icalfileset_new_reader(const char *path);
 
 LIBICAL_ICALSS_EXPORT icalset *icalfileset_new_writer(const char *path);
 
+/**
+ * @brief Opens a fileset whose commits append to a journal file.
+ * @since 3.1.0
+ *
+ * A plain icalfileset_commit() rewrites the whole cluster file, so the
+ * cost of a commit grows with the size of the set rather than the size
+ * of the change. In journaled mode, component adds and removes are
+ * appended as records to a journal file next to the cluster
+ * (`<path>.jnl`) and replayed when the set is opened, making commit
+ * cost proportional to the change. Once the journal accumulates enough
+ * records — or when a change cannot be expressed as a record, such as
+ * an in-place edit announced with icalfileset_mark() — the next commit
+ * compacts: it rewrites the cluster file and truncates the journal.
+ */
+LIBICAL_ICALSS_EXPORT icalset *icalfileset_new_journaled(const char *path);
+
+/**
+ * @brief Opens a fileset whose cluster file is kept compressed on disk.
+ * @since 3.1.0
+ *
+ * Cluster files are mostly repetitive text, so archived sets compress
+ * very well. In compressed mode a commit deflates the serialized
+ * cluster into a single frame behind a small header line and writes
+ * that instead of the plain text, typically shrinking the file several
+ * fold and cutting cold-load I/O by the same factor. Opening inflates
+ * the frame back into memory first, so everything above the load is
+ * unchanged — including lazy opens, whose boundary index runs over the
+ * inflated bytes. Compression is detected from the file header, so a
+ * plain open of a compressed file (and the first compressed open of a
+ * plain file) also works.
+ *
+ * Requires zlib; without it, opening a compressed file fails with
+ * ::ICAL_UNIMPLEMENTED_ERROR and the compressed flag is ignored on
+ * commit.
+ */
+LIBICAL_ICALSS_EXPORT icalset *icalfileset_new_compressed(const char *path);
+
+/**
+ * @brief Opens a read-only fileset that maps the cluster file and
+ * parses components on demand.
+ * @since 3.1.0
+ *
+ * A plain open parses the whole cluster file up front even when only
+ * one component is wanted. In lazy mode the file is memory-mapped and a
+ * single line scan records the byte range (and, when present, the UID)
+ * of each top-level component; opening a large set costs the index scan
+ * rather than a full parse. icalfileset_fetch() then materializes just
+ * the matching component, while operations that need the whole set —
+ * iteration, counting, committing — materialize the remaining
+ * components first. Where memory mapping is not available the open
+ * falls back to the ordinary full parse.
+ */
+LIBICAL_ICALSS_EXPORT icalset *icalfileset_new_lazy_reader(const char *path);
+
 LIBICAL_ICALSS_EXPORT icalset *icalfileset_init(icalset *set, const char *dsn, void *options);
 
 LIBICAL_ICALSS_EXPORT icalcluster *icalfileset_produce_icalcluster(const char *path);
@@ -48,6 +102,120 @@ LIBICAL_ICALSS_EXPORT void icalfileset_mark(icalset *set);
 
 LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_commit(icalset *set);
 
+/**
+ * @brief Rewrites the cluster file from the in-memory set and truncates
+ * the journal.
+ * @since 3.1.0
+ *
+ * Journaled sets compact automatically once the journal passes its
+ * garbage threshold; this forces the compaction immediately, e.g. from
+ * a maintenance task running at a quiet time. For sets opened without
+ * journaling this is equivalent to marking the set changed and
+ * committing it.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_compact(icalset *set);
+
+/**
+ * @brief Commits the set without blocking on the disk write.
+ * @since 3.1.0
+ *
+ * Serializes the cluster in the calling thread — the cheap part — and
+ * hands the write, truncate and fsync to a shared background writer
+ * thread, so request threads are not held up by disk latency. Jobs are
+ * processed in submission order through a bounded queue; when the queue
+ * is full the call blocks until the writer catches up. Write errors are
+ * reported by the next icalfileset_flush_async() rather than here.
+ *
+ * On platforms without threads, and for journaled sets (whose commits
+ * are already proportional to the change), this simply performs a
+ * synchronous icalfileset_commit().
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_commit_async(icalset *set);
+
+/**
+ * @brief Waits until every queued asynchronous commit has reached disk.
+ * @return The first error encountered by the background writer since
+ * the last flush, or ::ICAL_NO_ERROR.
+ * @since 3.1.0
+ *
+ * This is the barrier matching icalfileset_commit_async(): call it
+ * before depending on the file contents, e.g. at a checkpoint or before
+ * process exit. Synchronous commits and icalfileset_free() issue it
+ * automatically when an asynchronous commit is still pending for the
+ * set.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_flush_async(void);
+
+/**
+ * @brief Returns 1 if another process has modified the set's files
+ * since they were last loaded or committed, 0 if they are unchanged,
+ * -1 on error.
+ * @since 3.1.0
+ *
+ * Detection compares the cluster file's size and mtime (and the
+ * journal's length, for journaled sets) against the values recorded
+ * when memory and disk last agreed, so the check is two stat calls.
+ * A rewrite within one mtime granule that leaves the size identical
+ * can go undetected; processes sharing a set through this interface
+ * should not rely on sub-second turnarounds.
+ */
+LIBICAL_ICALSS_EXPORT int icalfileset_is_stale(icalset *set);
+
+/**
+ * @brief Brings the in-memory set up to date with changes written by
+ * another process.
+ * @since 3.1.0
+ *
+ * For a journaled set whose cluster file is untouched and whose
+ * journal has only grown — the append-only common case — just the new
+ * journal bytes are read and replayed, so the refresh costs
+ * proportional to the delta. Any other change (a compaction, a
+ * rewrite, a replaced file) falls back to a full reload through the
+ * same loading paths as opening the set. When nothing changed on disk
+ * this is two stat calls and returns immediately.
+ *
+ * The set must not have uncommitted local changes: refreshing would
+ * have to discard them, so ::ICAL_USAGE_ERROR is returned instead and
+ * the set is left untouched. Components obtained from the set before
+ * a refresh that reloads may be freed by it; re-fetch after refreshing.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_refresh(icalset *set);
+
+/**
+ * @brief Publishes the set's serialized contents as a POSIX shared
+ * memory object named @p name (e.g. "/mycal-snapshot").
+ * @since 3.1.0
+ *
+ * Workers then open the snapshot with icalfileset_snapshot_open(); the
+ * mapped bytes exist once in physical memory no matter how many
+ * processes map them, instead of each worker parsing its own private
+ * copy of the file. Publishing again under the same name replaces the
+ * previous snapshot. Returns ::ICAL_UNIMPLEMENTED_ERROR where POSIX
+ * shared memory is not available.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_snapshot_publish(icalset *set, const char *name);
+
+/**
+ * @brief Opens a read-only fileset over a shared memory snapshot made
+ * by icalfileset_snapshot_publish().
+ * @since 3.1.0
+ *
+ * The segment is mapped and indexed like a lazy fileset: components
+ * are parsed on demand, so a worker that touches a handful of
+ * components pays heap only for those, while the snapshot bytes stay
+ * in shared pages. The set is read-only; it does not take the cluster
+ * file lock and must not be committed.
+ */
+LIBICAL_ICALSS_EXPORT icalset *icalfileset_snapshot_open(const char *name);
+
+/**
+ * @brief Removes a published snapshot. Shared memory objects persist
+ * until unlinked; call this when the snapshot is retired. Existing
+ * mappings stay valid until their sets are freed.
+ * @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_snapshot_remove(const char *name);
+
 LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_add_component(icalset *set, icalcomponent *child);
 
 LIBICAL_ICALSS_EXPORT icalerrorenum icalfileset_remove_component(icalset *set,
@@ -117,6 +285,10 @@ typedef struct icalfileset_options
     int mode;                 /**< file mode */
     int safe_saves;           /**< to lock or not */
     icalcluster *cluster;     /**< use this cluster to initialize data */
+    int journaled;            /**< append commits to a journal instead of rewriting @since 3.1.0 */
+    int lazy_load;            /**< mmap the cluster and parse components on demand @since 3.1.0 */
+    int snapshot;             /**< the path names a shared memory snapshot @since 3.1.0 */
+    int compressed;           /**< keep the cluster file compressed on disk @since 3.1.0 */
 } icalfileset_options;
 
 extern icalfileset_options icalfileset_options_default;
@@ -23,6 +23,52 @@
 #define ICALFILESETIMPL_H
 
 #include "icalfileset.h"
+#include "icalarray.h"
+
+/** Opcodes for pending journal operations */
+#define ICALFILESET_JNL_ADD 1
+#define ICALFILESET_JNL_REMOVE 2
+
+/** A component add or remove recorded between commits, to be appended
+    to the journal file by the next icalfileset_commit() */
+struct icalfileset_journal_op
+{
+    int opcode;                 /**< ICALFILESET_JNL_ADD or ICALFILESET_JNL_REMOVE */
+    char *uid;                  /**< identity of the removed component, for remove ops */
+    icalcomponent *comp;        /**< the added component, owned by the cluster, for add ops */
+    struct icalfileset_journal_op *next;
+};
+
+/** One top-level component in the sorted DTSTART index used to prune
+    gauge scans with a time-range where clause. Entries whose start
+    cannot be pinned down — no DTSTART, or a recurrence rule — sort to
+    the front and are always candidates. */
+struct icalfileset_time_entry
+{
+    struct icaltimetype start;  /**< DTSTART of the real inner component */
+    int wildcard;               /**< always a candidate; start is meaningless */
+    icalcomponent *comp;        /**< the top-level cluster child */
+};
+
+/** One top-level component with the content generation (and recorded
+    identity) it had the last time the cluster and the disk agreed,
+    so a commit can tell which components were edited in place */
+struct icalfileset_clean_entry
+{
+    icalcomponent *comp;        /**< the top-level cluster child */
+    unsigned int generation;    /**< its content generation at the snapshot */
+    char *uid;                  /**< its UID at the snapshot (journaled sets only), or 0 */
+};
+
+/** The byte range of one top-level component in the mapped cluster
+    file, recorded by the boundary scan at open in lazy mode */
+struct icalfileset_range
+{
+    size_t start;               /**< offset of the BEGIN: line */
+    size_t length;              /**< bytes up to and including the END: line */
+    char *uid;                  /**< first UID seen in the range, or 0 */
+    int materialized;           /**< set once the range has been parsed */
+};
 
 struct icalfileset_impl
 {
@@ -34,6 +80,36 @@ struct icalfileset_impl
     icalgauge *gauge;           /**< gauge for filtering out data */
     int changed;                /**< boolean flag, 1 if data has changed */
     int fd;                     /**< file descriptor */
+
+    int journal_fd;             /**< descriptor of the journal file, or -1 */
+    size_t journal_records;     /**< records in the journal since the last compaction */
+    int journal_full_rewrite;   /**< set when a change cannot be expressed as a record */
+    struct icalfileset_journal_op *journal_pending; /**< ops not yet appended */
+
+    int async_pending;          /**< an async commit may still be in the write queue */
+
+    icalarray *clean_snapshot;  /**< icalfileset_clean_entry per child at the last commit, or 0 */
+    unsigned int clean_generation; /**< the cluster's content generation at the last commit */
+    int clean_valid;            /**< clean_generation/clean_snapshot describe the on-disk state */
+
+    icalarray *time_index;      /**< icalfileset_time_entry sorted by start, or 0 */
+    int time_index_dirty;       /**< set whenever the cluster membership changes */
+    int time_iter_range;        /**< current iteration is driven by the index */
+    size_t time_iter_pos;       /**< next index entry to consider */
+    struct icaltimetype time_lo;/**< inclusive lower bound, or null time */
+    struct icaltimetype time_hi;/**< inclusive upper bound, or null time */
+
+    int compressed;             /**< the cluster file is compressed on disk */
+
+    long sync_cluster_size;     /**< cluster file size the in-memory set reflects */
+    time_t sync_cluster_mtime;  /**< cluster file mtime the in-memory set reflects */
+    long sync_journal_size;     /**< journal bytes already replayed or written */
+
+    char *map_base;             /**< mapped cluster file in lazy mode, or 0 */
+    size_t map_len;             /**< length of the mapping */
+    int map_owned;              /**< map_base is a heap buffer (inflated cluster), not a mapping */
+    icalarray *lazy_ranges;     /**< icalfileset_range per top-level component */
+    size_t lazy_unmaterialized; /**< ranges not yet parsed into the cluster */
 };
 
 #endif
@@ -29,6 +29,11 @@
 #include "icalvalue.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
 
 extern int ssparse(void);
 extern char *input_buffer;
@@ -36,6 +41,88 @@ extern char *input_buffer_p;
 
 struct icalgauge_impl *icalss_yy_gauge;
 
+/* The generated lexer and parser keep their state in globals
+   (input_buffer, icalss_yy_gauge, the yacc stacks), so only one parse
+   can be in flight at a time. This lock scopes that window to the
+   ssparse() call; everything after the parse works on the private
+   impl, so concurrent callers only serialize on the parse itself. */
+#if defined(HAVE_PTHREAD)
+static pthread_mutex_t icalgauge_parse_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+/**
+ * Compiles the parsed where list into a flat clause array with the
+ * comparison values pre-parsed into icalvalues. icalgauge_compare()
+ * runs against this program, so the per-component cost of a SELECT
+ * scan is the comparisons themselves — the string-to-value conversion
+ * happens once here instead of once per tested component, and dates
+ * are compared as times rather than strings. Errors in the clause
+ * values therefore also surface at construction, not during the scan.
+ */
+static icalerrorenum icalgauge_compile(struct icalgauge_impl *impl)
+{
+    pvl_elem e;
+    int i = 0;
+    int count = pvl_count(impl->where);
+
+    if (count == 0) {
+        return ICAL_NO_ERROR;
+    }
+
+    impl->program = (struct icalgauge_clause *)malloc((size_t)count *
+                                                      sizeof(struct icalgauge_clause));
+    if (impl->program == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return ICAL_NEWFAILED_ERROR;
+    }
+
+    for (e = pvl_head(impl->where); e != 0; e = pvl_next(e)) {
+        struct icalgauge_where *w = pvl_data(e);
+        struct icalgauge_clause *clause = &impl->program[i];
+        icalvalue_kind vk;
+
+        if (!w || w->prop == ICAL_NO_PROPERTY || w->value == 0) {
+            icalerror_set_errno(ICAL_INTERNAL_ERROR);
+            return ICAL_INTERNAL_ERROR;
+        }
+
+        vk = icalenum_property_kind_to_value_kind(w->prop);
+
+        if (vk == ICAL_NO_VALUE) {
+            icalerror_set_errno(ICAL_INTERNAL_ERROR);
+            return ICAL_INTERNAL_ERROR;
+        }
+
+        clause->logic = w->logic;
+        clause->comp = w->comp;
+        clause->prop = w->prop;
+        clause->compare = w->compare;
+        clause->param = -1;
+        clause->bound = 0;
+
+        if (w->compare == ICALGAUGECOMPARE_ISNULL || w->compare == ICALGAUGECOMPARE_ISNOTNULL) {
+            clause->value = icalvalue_new(vk);
+        } else if (strcmp(w->value, "?") == 0) {
+            /* A bind placeholder: reserve the slot with an empty value
+               of the right kind; icalgauge_bind_time() and friends fill
+               it in before the gauge is used */
+            clause->param = impl->num_params++;
+            clause->value = icalvalue_new(vk);
+        } else {
+            clause->value = icalvalue_new_from_string(vk, w->value);
+        }
+
+        if (clause->value == 0) {
+            /* Keep error set by icalvalue_new_from_string */
+            return ICAL_INTERNAL_ERROR;
+        }
+
+        impl->program_len = ++i;
+    }
+
+    return ICAL_NO_ERROR;
+}
+
 icalgauge *icalgauge_new_from_sql(const char *sql, int expand)
 {
     struct icalgauge_impl *impl;
@@ -50,13 +137,26 @@ icalgauge *icalgauge_new_from_sql(const char *sql, int expand)
     impl->from = pvl_newlist();
     impl->where = pvl_newlist();
     impl->expand = expand;
+    impl->program = 0;
+    impl->program_len = 0;
+    impl->num_params = 0;
+
+#if defined(HAVE_PTHREAD)
+    pthread_mutex_lock(&icalgauge_parse_mutex);
+#endif
 
     icalss_yy_gauge = impl;
     input_buffer = input_buffer_p = (char *)sql;
 
     r = ssparse();
 
-    if (r == 0) {
+    icalss_yy_gauge = 0;
+
+#if defined(HAVE_PTHREAD)
+    pthread_mutex_unlock(&icalgauge_parse_mutex);
+#endif
+
+    if (r == 0 && icalgauge_compile(impl) == ICAL_NO_ERROR) {
         return impl;
     } else {
         icalgauge_free(impl);
@@ -64,6 +164,69 @@ icalgauge *icalgauge_new_from_sql(const char *sql, int expand)
     }
 }
 
+icalgauge *icalgauge_prepare(const char *sql, int expand)
+{
+    return icalgauge_new_from_sql(sql, expand);
+}
+
+int icalgauge_num_params(icalgauge *gauge)
+{
+    icalerror_check_arg_re((gauge != 0), "gauge", -1);
+
+    return gauge->num_params;
+}
+
+/** Finds the compiled clause that carries the given placeholder index */
+static struct icalgauge_clause *icalgauge_find_param(icalgauge *gauge, int param)
+{
+    int i;
+
+    for (i = 0; i < gauge->program_len; i++) {
+        if (gauge->program[i].param == param) {
+            return &gauge->program[i];
+        }
+    }
+
+    return 0;
+}
+
+icalerrorenum icalgauge_bind_string(icalgauge *gauge, int param, const char *str)
+{
+    struct icalgauge_clause *clause;
+    icalvalue_kind vk;
+    icalvalue *value;
+
+    icalerror_check_arg_re((gauge != 0), "gauge", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((str != 0), "str", ICAL_BADARG_ERROR);
+
+    clause = icalgauge_find_param(gauge, param);
+    if (clause == 0) {
+        icalerror_set_errno(ICAL_BADARG_ERROR);
+        return ICAL_BADARG_ERROR;
+    }
+
+    vk = icalenum_property_kind_to_value_kind(clause->prop);
+
+    value = icalvalue_new_from_string(vk, str);
+    if (value == 0) {
+        /* Keep error set by icalvalue_new_from_string */
+        return ICAL_MALFORMEDDATA_ERROR;
+    }
+
+    icalvalue_free(clause->value);
+    clause->value = value;
+    clause->bound = 1;
+
+    return ICAL_NO_ERROR;
+}
+
+icalerrorenum icalgauge_bind_time(icalgauge *gauge, int param, struct icaltimetype t)
+{
+    icalerror_check_arg_re((gauge != 0), "gauge", ICAL_BADARG_ERROR);
+
+    return icalgauge_bind_string(gauge, param, icaltime_as_ical_string(t));
+}
+
 int icalgauge_get_expand(icalgauge *gauge)
 {
     icalerror_check_arg_rz((gauge != 0), "gauge");
@@ -109,6 +272,19 @@ void icalgauge_free(icalgauge *gauge)
         gauge->from = 0;
     }
 
+    if (gauge->program) {
+        int i;
+
+        for (i = 0; i < gauge->program_len; i++) {
+            if (gauge->program[i].value != 0) {
+                icalvalue_free(gauge->program[i].value);
+            }
+        }
+        free(gauge->program);
+        gauge->program = 0;
+        gauge->program_len = 0;
+    }
+
     free(gauge);
 }
 
@@ -263,6 +439,7 @@ int icalgauge_compare(icalgauge *gauge, icalcomponent *comp)
     int local_pass = 0;
     int last_clause = 1, this_clause = 1;
     pvl_elem e;
+    int i;
     icalcomponent_kind kind;
     icalproperty *rrule;
     int compare_recur = 0;
@@ -303,39 +480,21 @@ int icalgauge_compare(icalgauge *gauge, icalcomponent *comp)
         return 0;
     }
 
-    /**** Check each where clause against the component ****/
-    for (e = pvl_head(gauge->where); e != 0; e = pvl_next(e)) {
-        struct icalgauge_where *w = pvl_data(e);
+    /**** Check each compiled where clause against the component.
+          The property kinds and comparison values were resolved by
+          icalgauge_compile(), so nothing is allocated here. ****/
+    for (i = 0; i < gauge->program_len; i++) {
+        struct icalgauge_clause *w = &gauge->program[i];
         icalcomponent *sub_comp;
-        icalvalue *v;
         icalproperty *prop;
-        icalvalue_kind vk;
-
-        if (!w || w->prop == ICAL_NO_PROPERTY || w->value == 0) {
-            icalerror_set_errno(ICAL_INTERNAL_ERROR);
-            return 0;
-        }
-
-        /* First, create a value from the gauge */
-        vk = icalenum_property_kind_to_value_kind(w->prop);
 
-        if (vk == ICAL_NO_VALUE) {
-            icalerror_set_errno(ICAL_INTERNAL_ERROR);
+        /* A placeholder with no bound value cannot be evaluated */
+        if (w->param >= 0 && !w->bound) {
+            icalerror_set_errno(ICAL_USAGE_ERROR);
             return 0;
         }
 
-        if (w->compare == ICALGAUGECOMPARE_ISNULL || w->compare == ICALGAUGECOMPARE_ISNOTNULL) {
-            v = icalvalue_new(vk);
-        } else {
-            v = icalvalue_new_from_string(vk, w->value);
-        }
-
-        if (v == 0) {
-            /* Keep error set by icalvalue_from-string */
-            return 0;
-        }
-
-        /* Now find the corresponding property in the component,
+        /* Find the corresponding property in the component,
            descending into a sub-component if necessary */
 
         if (w->comp == ICAL_NO_COMPONENT) {
@@ -343,7 +502,6 @@ int icalgauge_compare(icalgauge *gauge, icalcomponent *comp)
         } else {
             sub_comp = icalcomponent_get_first_component(inner, w->comp);
             if (sub_comp == 0) {
-                icalvalue_free(v);
                 return 0;
             }
         }
@@ -387,7 +545,7 @@ int icalgauge_compare(icalgauge *gauge, icalcomponent *comp)
             }
 
             /* coverity[mixed_enums] */
-            relation = (icalgaugecompare) icalvalue_compare(prop_value, v);
+            relation = (icalgaugecompare) icalvalue_compare(prop_value, w->value);
 
             if (relation == w->compare) {
                 local_pass++;
@@ -419,14 +577,185 @@ int icalgauge_compare(icalgauge *gauge, icalcomponent *comp)
         } else {
             last_clause = this_clause;
         }
-
-        icalvalue_free(v);
-
     }/**** check next one in where clause ****/
 
     return last_clause;
 }
 
+/** Reads the time out of a compiled clause value, accepting the value
+    kinds a DTSTART comparison can parse to */
+static struct icaltimetype icalgauge_clause_time(icalvalue *value)
+{
+    switch (icalvalue_isa(value)) {
+    case ICAL_DATETIME_VALUE:
+        return icalvalue_get_datetime(value);
+    case ICAL_DATETIMEDATE_VALUE:
+        return icalvalue_get_datetimedate(value);
+    case ICAL_DATE_VALUE:
+        return icalvalue_get_date(value);
+    default:
+        return icaltime_null_time();
+    }
+}
+
+int icalgauge_get_dtstart_range(icalgauge *gauge,
+                                struct icaltimetype *start, struct icaltimetype *end)
+{
+    struct icaltimetype lo = icaltime_null_time();
+    struct icaltimetype hi = icaltime_null_time();
+    int i;
+
+    icalerror_check_arg_rz((gauge != 0), "gauge");
+    icalerror_check_arg_rz((start != 0), "start");
+    icalerror_check_arg_rz((end != 0), "end");
+
+    for (i = 0; i < gauge->program_len; i++) {
+        struct icalgauge_clause *w = &gauge->program[i];
+        struct icaltimetype t;
+
+        /* An OR anywhere means a component outside the range could
+           still pass through the other branch, so no pruning */
+        if (i > 0 && w->logic != ICALGAUGELOGIC_AND) {
+            return 0;
+        }
+
+        if (w->prop != ICAL_DTSTART_PROPERTY || w->comp != ICAL_NO_COMPONENT) {
+            continue;
+        }
+
+        t = icalgauge_clause_time(w->value);
+        if (icaltime_is_null_time(t)) {
+            continue;
+        }
+
+        switch (w->compare) {
+        case ICALGAUGECOMPARE_GREATER:
+        case ICALGAUGECOMPARE_GREATEREQUAL:
+            if (icaltime_is_null_time(lo) || icaltime_compare(t, lo) > 0) {
+                lo = t;
+            }
+            break;
+        case ICALGAUGECOMPARE_LESS:
+        case ICALGAUGECOMPARE_LESSEQUAL:
+            if (icaltime_is_null_time(hi) || icaltime_compare(t, hi) < 0) {
+                hi = t;
+            }
+            break;
+        case ICALGAUGECOMPARE_EQUAL:
+            if (icaltime_is_null_time(lo) || icaltime_compare(t, lo) > 0) {
+                lo = t;
+            }
+            if (icaltime_is_null_time(hi) || icaltime_compare(t, hi) < 0) {
+                hi = t;
+            }
+            break;
+        default:
+            /* Not a range constraint; contributes no bound */
+            break;
+        }
+    }
+
+    if (icaltime_is_null_time(lo) && icaltime_is_null_time(hi)) {
+        return 0;
+    }
+
+    *start = lo;
+    *end = hi;
+
+    return 1;
+}
+
+/** Returns true when the select list names @p pkind for components of
+    kind @p ckind */
+static int icalgauge_select_matches(icalgauge *gauge,
+                                    icalcomponent_kind ckind, icalproperty_kind pkind)
+{
+    pvl_elem e;
+
+    for (e = pvl_head(gauge->select); e != 0; e = pvl_next(e)) {
+        struct icalgauge_where *w = pvl_data(e);
+
+        if (w->comp != ICAL_NO_COMPONENT && w->comp != ICAL_ANY_COMPONENT &&
+            w->comp != ckind) {
+            continue;
+        }
+
+        if (w->prop == ICAL_ANY_PROPERTY || w->prop == pkind) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int icalgauge_has_projection(icalgauge *gauge)
+{
+    pvl_elem e;
+
+    icalerror_check_arg_rz((gauge != 0), "gauge");
+
+    if (pvl_head(gauge->select) == 0) {
+        return 0;
+    }
+
+    /* An unqualified '*' keeps every property of every component, so
+       there is nothing to strip */
+    for (e = pvl_head(gauge->select); e != 0; e = pvl_next(e)) {
+        struct icalgauge_where *w = pvl_data(e);
+
+        if (w->prop == ICAL_ANY_PROPERTY &&
+            (w->comp == ICAL_NO_COMPONENT || w->comp == ICAL_ANY_COMPONENT)) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/** Builds the skeleton copy of @p comp, keeping only the properties
+    the select list asks for and recursing into subcomponents */
+static icalcomponent *icalgauge_project_component(icalgauge *gauge, icalcomponent *comp)
+{
+    icalcomponent_kind ckind = icalcomponent_isa(comp);
+    icalcomponent *proj, *inner;
+    icalproperty *p;
+
+    if ((proj = icalcomponent_new(ckind)) == 0) {
+        return 0;
+    }
+
+    for (p = icalcomponent_get_first_property(comp, ICAL_ANY_PROPERTY);
+         p != 0;
+         p = icalcomponent_get_next_property(comp, ICAL_ANY_PROPERTY)) {
+        if (icalgauge_select_matches(gauge, ckind, icalproperty_isa(p))) {
+            icalcomponent_add_property(proj, icalproperty_clone(p));
+        }
+    }
+
+    for (inner = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         inner != 0;
+         inner = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        icalcomponent *iproj = icalgauge_project_component(gauge, inner);
+
+        if (iproj != 0) {
+            icalcomponent_add_component(proj, iproj);
+        }
+    }
+
+    return proj;
+}
+
+icalcomponent *icalgauge_project(icalgauge *gauge, icalcomponent *comp)
+{
+    icalerror_check_arg_rz((comp != 0), "comp");
+
+    if (gauge == 0 || !icalgauge_has_projection(gauge)) {
+        return icalcomponent_clone(comp);
+    }
+
+    return icalgauge_project_component(gauge, comp);
+}
+
 void icalgauge_dump(icalgauge *gauge)
 {
     pvl_elem p;
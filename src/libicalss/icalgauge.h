@@ -24,6 +24,7 @@
 
 #include "libical_icalss_export.h"
 #include "icalcomponent.h"
+#include "icalerror.h"
 
 /** @file icalgauge.h
  *  @brief Routines implementing a filter for ical components
@@ -33,6 +34,59 @@ typedef struct icalgauge_impl icalgauge;
 
 LIBICAL_ICALSS_EXPORT icalgauge *icalgauge_new_from_sql(const char *sql, int expand);
 
+/** @brief Compiles a gauge with bind placeholders.
+ * @since 3.1.0
+ *
+ * Like icalgauge_new_from_sql(), but intended for queries written with
+ * '?' placeholders in value position, e.g.
+ * "SELECT * FROM VEVENT WHERE DTSTART > ?". The query is lexed,
+ * parsed and compiled once; each placeholder becomes a parameter slot,
+ * numbered from 0 in the order they appear in the where clause. Bind
+ * values with icalgauge_bind_time() or icalgauge_bind_string() and
+ * reuse the gauge across executions — rebinding does not recompile.
+ * A gauge with unbound placeholders matches nothing and sets
+ * ICAL_USAGE_ERROR when compared.
+ */
+LIBICAL_ICALSS_EXPORT icalgauge *icalgauge_prepare(const char *sql, int expand);
+
+/** @brief Returns the number of bind placeholders in a gauge, or -1 if
+ * @p gauge is NULL.
+ * @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT int icalgauge_num_params(icalgauge *gauge);
+
+/** @brief Binds a time value to a placeholder.
+ *
+ * @param gauge  A gauge from icalgauge_prepare().
+ * @param param  The placeholder index, starting at 0.
+ * @param t      The time to compare against.
+ *
+ * @return ICAL_NO_ERROR on success, ICAL_BADARG_ERROR if the index
+ *         does not name a placeholder.
+ * @since 3.1.0
+ *
+ * The value is parsed into the compiled clause in place, so binding a
+ * new time for the next execution costs one value conversion, not a
+ * reparse of the query.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalgauge_bind_time(icalgauge *gauge, int param,
+                                                        struct icaltimetype t);
+
+/** @brief Binds a string value to a placeholder.
+ *
+ * @param gauge  A gauge from icalgauge_prepare().
+ * @param param  The placeholder index, starting at 0.
+ * @param str    The value, in iCalendar text form for the compared
+ *               property's value kind.
+ *
+ * @return ICAL_NO_ERROR on success, ICAL_BADARG_ERROR if the index
+ *         does not name a placeholder, ICAL_MALFORMEDDATA_ERROR if the
+ *         string does not parse as the property's value kind.
+ * @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalgauge_bind_string(icalgauge *gauge, int param,
+                                                          const char *str);
+
 /**
  * Returns the expand value for the specified icalgauge.
  * If @p gauge is NULL a value of -1 is returned.
@@ -55,4 +109,44 @@ LIBICAL_ICALSS_EXPORT void icalgauge_dump(icalgauge *gauge);
  */
 LIBICAL_ICALSS_EXPORT int icalgauge_compare(icalgauge *g, icalcomponent *comp);
 
+/**
+ * @brief Extracts the DTSTART range constraint from a gauge, if it has
+ * one that is safe to use for index pruning.
+ * @return 1 if at least one bound was found, 0 otherwise.
+ * @since 3.1.0
+ *
+ * Returns inclusive bounds derived from DTSTART comparisons in the
+ * where clause: @p start from > and >= (null time if unbounded below),
+ * @p end from < and <= (null time if unbounded above), both from =.
+ * Strict comparisons are widened to inclusive ones, so a set index may
+ * use the bounds only as a pre-filter — components inside the range
+ * must still be run through icalgauge_compare(). Fails when the where
+ * clause contains an OR, since a component outside the range could
+ * then still match through the other branch.
+ */
+LIBICAL_ICALSS_EXPORT int icalgauge_get_dtstart_range(icalgauge *gauge,
+                                                      struct icaltimetype *start,
+                                                      struct icaltimetype *end);
+
+/** @brief Returns true if the gauge's select list narrows the result
+ * to specific properties.
+ * @since 3.1.0
+ *
+ * A gauge created from "SELECT * ..." keeps whole components and
+ * returns 0 here; "SELECT DTSTART,SUMMARY ..." returns 1.
+ */
+LIBICAL_ICALSS_EXPORT int icalgauge_has_projection(icalgauge *gauge);
+
+/** @brief Returns a newly allocated copy of @p comp restricted to the
+ * properties in the gauge's select list.
+ * @since 3.1.0
+ *
+ * The copy keeps the component structure — the wrapper and each
+ * subcomponent are still present — but each level carries only the
+ * properties the select list names for a component of its kind. When
+ * the gauge selects all properties (or @p gauge is NULL), this is a
+ * plain icalcomponent_clone(). The caller owns the returned component.
+ */
+LIBICAL_ICALSS_EXPORT icalcomponent *icalgauge_project(icalgauge *gauge, icalcomponent *comp);
+
 #endif /* ICALGAUGE_H */
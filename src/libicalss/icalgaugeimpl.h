@@ -51,12 +51,31 @@ struct icalgauge_where
     char *value;
 };
 
+/** One where clause compiled into its evaluated form: the comparison
+    value is parsed into an icalvalue once at gauge construction, so
+    dates compare as times and icalgauge_compare() allocates nothing
+    per tested component */
+struct icalgauge_clause
+{
+    icalgaugelogic logic;
+    icalcomponent_kind comp;
+    icalproperty_kind prop;
+    icalgaugecompare compare;
+    icalvalue *value;
+    int param;           /**< bind placeholder index, or -1 for a literal */
+    int bound;           /**< true once a placeholder has a bound value */
+};
+
 struct icalgauge_impl
 {
     pvl_list select;     /**< Of icalgaugecompare, using only prop and comp fields*/
     pvl_list from;       /**< List of component_kinds, as integers */
     pvl_list where;      /**< List of icalgaugecompare */
     int expand;
+
+    struct icalgauge_clause *program;   /**< where clauses compiled by icalgauge_compile() */
+    int program_len;     /**< number of clauses in program */
+    int num_params;      /**< number of bind placeholders in program */
 };
 
 #endif
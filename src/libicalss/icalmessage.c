@@ -21,6 +21,7 @@
 #endif
 
 #include "icalmessage.h"
+#include "icalclassify.h"
 #include "icalerror.h"
 #include "icalmemory.h"
 #include "icalversion.h"        /* for ICAL_PACKAGE, ICAL_VERSION */
@@ -59,7 +60,17 @@ static icalproperty *icalmessage_find_attendee(icalcomponent *comp, const char *
 {
     icalcomponent *inner = icalmessage_get_inner(comp);
     icalproperty *p, *attendee = 0;
-    char *luser = lowercase(user);
+    char *luser;
+
+    /* A full calendar address resolves through the attendee index in
+       one lookup; the substring scan below remains for callers that
+       pass a bare user name. */
+    attendee = icalcomponent_get_attendee(inner, user);
+    if (attendee != 0) {
+        return attendee;
+    }
+
+    luser = lowercase(user);
 
     for (p = icalcomponent_get_first_property(inner, ICAL_ATTENDEE_PROPERTY);
          p != 0;
@@ -315,3 +326,120 @@ icalcomponent *icalmessage_new_error_reply(icalcomponent *c,
 
     return reply;
 }
+
+struct icalmessage_uid_entry
+{
+    const char *uid;
+    icalcomponent *comp;
+};
+
+static int icalmessage_compare_uid_entry(const void *a, const void *b)
+{
+    return strcmp(((const struct icalmessage_uid_entry *)a)->uid,
+                  ((const struct icalmessage_uid_entry *)b)->uid);
+}
+
+int icalmessage_process_batch(icalcomponent **messages, int count,
+                              icalset *set, const char *user,
+                              icalparameter_partstat partstat,
+                              icalmessage_pipeline_result *results)
+{
+    struct icalmessage_uid_entry *index;
+    size_t index_space = 16;
+    int n_index = 0;
+    int n_replies = 0;
+    icalcomponent *c;
+    int i;
+
+    icalerror_check_arg_rx((messages != 0), "messages", -1);
+    icalerror_check_arg_rx((set != 0), "set", -1);
+    icalerror_check_arg_rx((results != 0), "results", -1);
+
+    /* Index the set by UID once, so that resolving each message's
+       match is a binary search instead of a scan of the whole set. */
+
+    index = icalmemory_new_buffer(index_space * sizeof(struct icalmessage_uid_entry));
+    if (index == 0) {
+        return -1;
+    }
+
+    for (c = icalset_get_first_component(set); c != 0; c = icalset_get_next_component(set)) {
+        const char *uid = icalcomponent_get_uid(c);
+
+        if (uid == 0) {
+            continue;
+        }
+
+        if ((size_t) n_index == index_space) {
+            index_space *= 2;
+            index = icalmemory_resize_buffer(
+                index, index_space * sizeof(struct icalmessage_uid_entry));
+            if (index == 0) {
+                return -1;
+            }
+        }
+
+        index[n_index].uid = uid;
+        index[n_index].comp = c;
+        n_index++;
+    }
+
+    if (n_index > 1) {
+        qsort(index, (size_t) n_index, sizeof(struct icalmessage_uid_entry),
+              icalmessage_compare_uid_entry);
+    }
+
+    for (i = 0; i < count; i++) {
+        icalmessage_pipeline_result *r = &results[i];
+        const char *uid;
+
+        r->message = messages[i];
+        r->xlicclass = ICAL_XLICCLASS_NONE;
+        r->match = 0;
+        r->reply = 0;
+
+        if (messages[i] == 0) {
+            continue;
+        }
+
+        uid = icalcomponent_get_uid(messages[i]);
+
+        if (uid != 0 && n_index > 0) {
+            struct icalmessage_uid_entry key, *hit;
+
+            key.uid = uid;
+            key.comp = 0;
+            hit = bsearch(&key, index, (size_t) n_index,
+                          sizeof(struct icalmessage_uid_entry), icalmessage_compare_uid_entry);
+
+            if (hit != 0) {
+                r->match = hit->comp;
+            }
+        }
+
+        r->xlicclass = icalclassify(messages[i], r->match, user);
+
+        switch (r->xlicclass) {
+        case ICAL_XLICCLASS_REQUESTNEW:
+        case ICAL_XLICCLASS_REQUESTUPDATE:
+        case ICAL_XLICCLASS_REQUESTRESCHEDULE:
+            if (partstat == ICAL_PARTSTAT_ACCEPTED) {
+                r->reply = icalmessage_new_accept_reply(messages[i], user, 0);
+            } else if (partstat == ICAL_PARTSTAT_DECLINED) {
+                r->reply = icalmessage_new_decline_reply(messages[i], user, 0);
+            }
+
+            if (r->reply != 0) {
+                n_replies++;
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    icalmemory_free_buffer(index);
+
+    return n_replies;
+}
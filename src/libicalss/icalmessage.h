@@ -21,6 +21,7 @@
 
 #include "libical_icalss_export.h"
 #include "icalcomponent.h"
+#include "icalset.h"
 
 LIBICAL_ICALSS_EXPORT icalcomponent *icalmessage_new_accept_reply(icalcomponent *c,
                                                                   const char *user,
@@ -47,4 +48,44 @@ LIBICAL_ICALSS_EXPORT icalcomponent *icalmessage_new_error_reply(icalcomponent *
                                                                  const char *debug,
                                                                  icalrequeststatus rs);
 
+/**
+ * @brief The outcome of one message of a batch run through
+ * icalmessage_process_batch().
+ * @since 3.1.0
+ *
+ * @p message and @p match are borrowed references -- the message stays
+ * with the caller's input array and the match stays with the target
+ * set. @p reply, when non-NULL, is a newly built component owned by
+ * the caller.
+ */
+typedef struct icalmessage_pipeline_result
+{
+    icalcomponent *message;           /**< the incoming message */
+    icalproperty_xlicclass xlicclass; /**< how icalclassify() categorized it */
+    icalcomponent *match;             /**< component in the set with the same UID, or NULL */
+    icalcomponent *reply;             /**< generated REPLY on behalf of the user, or NULL */
+} icalmessage_pipeline_result;
+
+/**
+ * @brief Classifies a batch of incoming iTIP messages against one
+ * target set and builds replies in bulk.
+ * @param messages an array of @p count iTIP messages; NULL entries are
+ * skipped.
+ * @param set the set the messages are arriving into. It is indexed by
+ * UID once, so match resolution costs a binary search per message
+ * rather than a scan of the set.
+ * @param user the calendar address the replies are sent on behalf of.
+ * @param partstat ICAL_PARTSTAT_ACCEPTED or ICAL_PARTSTAT_DECLINED to
+ * answer REQUEST-class messages accordingly; ICAL_PARTSTAT_NONE to
+ * classify and resolve matches without building any replies.
+ * @param results caller-provided array of @p count entries, filled in
+ * message order.
+ * @return the number of replies built, or -1 on error.
+ * @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT int icalmessage_process_batch(icalcomponent **messages, int count,
+                                                    icalset *set, const char *user,
+                                                    icalparameter_partstat partstat,
+                                                    icalmessage_pipeline_result *results);
+
 #endif /* ICALMESSAGE_H */
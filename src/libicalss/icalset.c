@@ -42,6 +42,9 @@
 #include "icalbdbsetimpl.h"
 #endif
 
+#include "icalmemory.h"
+#include "icaltimezone.h"
+
 #include <errno.h>
 #include <stdlib.h>
 
@@ -75,7 +78,9 @@ static icalset icalset_dirset_init = {
     icaldirset_get_next_component,
     icaldirset_begin_component,
     icaldirsetiter_to_next,
-    icaldirsetiter_to_prior
+    icaldirsetiter_to_prior,
+    0,
+    NULL
 };
 
 static icalset icalset_fileset_init = {
@@ -101,6 +106,8 @@ static icalset icalset_fileset_init = {
     icalfileset_get_next_component,
     icalfileset_begin_component,
     icalfilesetiter_to_next,
+    NULL,
+    0,
     NULL
 };
 
@@ -128,6 +135,8 @@ static icalset icalset_bdbset_init = {
     icalbdbset_get_next_component,
     icalbdbset_begin_component,
     icalbdbsetiter_to_next,
+    NULL,
+    0,
     NULL
 };
 #endif
@@ -237,6 +246,70 @@ int icalset_register_class(icalset *set)
 
 #endif
 
+#if !defined(_DLOPEN_TEST)
+
+/* Registered backend classes: prototypes whose kind, size and
+   operations are copied into every set icalset_new() constructs for
+   that kind. Registration is a startup-time operation; the list is
+   not locked. */
+static pvl_list icalset_registered_classes = 0;
+
+static icalset *icalset_find_registered(icalset_kind kind)
+{
+    pvl_elem e;
+
+    if (icalset_registered_classes == 0) {
+        return 0;
+    }
+
+    for (e = pvl_head(icalset_registered_classes); e != 0; e = pvl_next(e)) {
+        icalset *proto = (icalset *)pvl_data(e);
+
+        if (proto->kind == kind) {
+            return proto;
+        }
+    }
+
+    return 0;
+}
+
+int icalset_register_class(icalset *set)
+{
+    pvl_elem e;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((set->init != 0), "set->init");
+    icalerror_check_arg_rz((set->size >= sizeof(icalset)), "set->size");
+
+    /* The built-in kinds always dispatch to their own implementations */
+    if (set->kind < ICAL_USER_SET) {
+        icalerror_set_errno(ICAL_USAGE_ERROR);
+        return 0;
+    }
+
+    if (icalset_registered_classes == 0) {
+        icalset_registered_classes = pvl_newlist();
+        if (icalset_registered_classes == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+    }
+
+    /* Re-registering a kind replaces the earlier class */
+    for (e = pvl_head(icalset_registered_classes); e != 0; e = pvl_next(e)) {
+        if (((icalset *)pvl_data(e))->kind == set->kind) {
+            (void)pvl_remove(icalset_registered_classes, e);
+            break;
+        }
+    }
+
+    pvl_push(icalset_registered_classes, set);
+
+    return 1;
+}
+
+#endif /* !_DLOPEN_TEST */
+
 icalset *icalset_new(icalset_kind kind, const char *dsn, void *options)
 {
     icalset *data = NULL;
@@ -318,10 +391,28 @@ icalset *icalset_new(icalset_kind kind, const char *dsn, void *options)
     }
 #endif
 
-    default:
-        icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
-        /** unimplemented **/
-        return (NULL);
+    default: {
+        /* Not a built-in kind; look for a registered backend class */
+        icalset *proto = icalset_find_registered(kind);
+
+        if (proto == 0) {
+            icalerror_set_errno(ICAL_UNIMPLEMENTED_ERROR);
+            /** unimplemented **/
+            return (NULL);
+        }
+
+        data = (icalset *)malloc(proto->size);
+        if (data == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            errno = ENOMEM;
+            return 0;
+        }
+
+        /* The first member of the derived struct must be an icalset */
+        memset(data, 0, proto->size);
+        memcpy(data, proto, sizeof(icalset));
+        break;
+    }
     }
 
     data->kind = kind;
@@ -366,10 +457,202 @@ icalset *icalset_new_dir_reader(const char *path)
     return icaldirset_new_reader(path);
 }
 
+/* Query result cache. One entry per distinct query string; an entry
+   is valid as long as the set's generation counter has not moved
+   since it was filled, so re-running a query against an unchanged set
+   is a list lookup instead of a scan. */
+
+struct icalset_query_cache_entry
+{
+    char *sql;
+    int generation;     /* set->generation when the entry was filled */
+    char **uids;        /* NULL-terminated list of matching UIDs */
+    int n_uids;
+};
+
+static void icalset_query_cache_entry_clear(struct icalset_query_cache_entry *entry)
+{
+    int i;
+
+    if (entry->uids != 0) {
+        for (i = 0; i < entry->n_uids; i++) {
+            free(entry->uids[i]);
+        }
+        free(entry->uids);
+        entry->uids = 0;
+    }
+    entry->n_uids = 0;
+}
+
+static void icalset_query_cache_free(icalset *set)
+{
+    struct icalset_query_cache_entry *entry;
+
+    if (set->query_cache == 0) {
+        return;
+    }
+
+    while ((entry = pvl_pop(set->query_cache)) != 0) {
+        icalset_query_cache_entry_clear(entry);
+        free(entry->sql);
+        free(entry);
+    }
+
+    pvl_free(set->query_cache);
+    set->query_cache = 0;
+}
+
+/** Runs the query against the set, filling the entry's UID list.
+    Returns 1 on success. */
+static int icalset_query_cache_entry_fill(icalset *set, struct icalset_query_cache_entry *entry)
+{
+    icalgauge *gauge;
+    icalcomponent *c;
+    pvl_list matches;
+    char *uid;
+    int i;
+
+    gauge = icalgauge_new_from_sql(entry->sql, 0);
+    if (gauge == 0) {
+        return 0;
+    }
+
+    matches = pvl_newlist();
+
+    for (c = icalset_get_first_component(set); c != 0; c = icalset_get_next_component(set)) {
+        const char *this_uid;
+
+        if (icalgauge_compare(gauge, c) != 1) {
+            continue;
+        }
+
+        this_uid = icalcomponent_get_uid(c);
+        if (this_uid != 0 && (uid = strdup(this_uid)) != 0) {
+            pvl_push(matches, uid);
+        }
+    }
+
+    icalgauge_free(gauge);
+
+    icalset_query_cache_entry_clear(entry);
+
+    entry->n_uids = pvl_count(matches);
+    entry->uids = malloc(((size_t)entry->n_uids + 1) * sizeof(char *));
+    if (entry->uids == 0) {
+        while ((uid = pvl_pop(matches)) != 0) {
+            free(uid);
+        }
+        pvl_free(matches);
+        entry->n_uids = 0;
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    /* pvl_pop returns from the tail; fill back-to-front to keep set order */
+    for (i = entry->n_uids - 1; i >= 0; i--) {
+        entry->uids[i] = pvl_pop(matches);
+    }
+    entry->uids[entry->n_uids] = 0;
+    pvl_free(matches);
+
+    entry->generation = set->generation;
+
+    return 1;
+}
+
+/** Deep-copies an entry's UID list for the caller. */
+static char **icalset_query_cache_entry_copy(const struct icalset_query_cache_entry *entry)
+{
+    char **uids;
+    int i;
+
+    uids = malloc(((size_t)entry->n_uids + 1) * sizeof(char *));
+    if (uids == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    for (i = 0; i < entry->n_uids; i++) {
+        uids[i] = strdup(entry->uids[i]);
+    }
+    uids[entry->n_uids] = 0;
+
+    return uids;
+}
+
+char **icalset_query_uids(icalset *set, const char *sql, int *count)
+{
+    struct icalset_query_cache_entry *entry = 0;
+    pvl_elem e;
+
+    icalerror_check_arg_rz((set != 0), "set");
+    icalerror_check_arg_rz((sql != 0), "sql");
+
+    if (set->query_cache == 0) {
+        set->query_cache = pvl_newlist();
+    }
+
+    for (e = pvl_head(set->query_cache); e != 0; e = pvl_next(e)) {
+        struct icalset_query_cache_entry *this = pvl_data(e);
+
+        if (strcmp(this->sql, sql) == 0) {
+            entry = this;
+            break;
+        }
+    }
+
+    if (entry == 0) {
+        entry = malloc(sizeof(struct icalset_query_cache_entry));
+        if (entry == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            return 0;
+        }
+        memset(entry, 0, sizeof(struct icalset_query_cache_entry));
+        entry->sql = strdup(sql);
+        entry->generation = set->generation - 1;        /* force a fill */
+        pvl_push(set->query_cache, entry);
+    }
+
+    if (entry->generation != set->generation || entry->uids == 0) {
+        if (!icalset_query_cache_entry_fill(set, entry)) {
+            return 0;
+        }
+    }
+
+    if (count != 0) {
+        *count = entry->n_uids;
+    }
+
+    return icalset_query_cache_entry_copy(entry);
+}
+
+void icalset_free_query_result(char **uids)
+{
+    char **u;
+
+    if (uids == 0) {
+        return;
+    }
+
+    for (u = uids; *u != 0; u++) {
+        free(*u);
+    }
+    free(uids);
+}
+
+int icalset_get_generation(icalset *set)
+{
+    icalerror_check_arg_re((set != 0), "set", -1);
+
+    return set->generation;
+}
+
 /* Functions for built-in methods */
 
 void icalset_free(icalset *set)
 {
+    icalset_query_cache_free(set);
+
     if (set->free) {
         set->free(set);
     }
@@ -388,6 +671,7 @@ const char *icalset_path(icalset *set)
 
 void icalset_mark(icalset *set)
 {
+    set->generation++;
     set->mark(set);
 }
 
@@ -398,11 +682,13 @@ icalerrorenum icalset_commit(icalset *set)
 
 icalerrorenum icalset_add_component(icalset *set, icalcomponent *comp)
 {
+    set->generation++;
     return set->add_component(set, comp);
 }
 
 icalerrorenum icalset_remove_component(icalset *set, icalcomponent *comp)
 {
+    set->generation++;
     return set->remove_component(set, comp);
 }
 
@@ -438,6 +724,7 @@ int icalset_has_uid(icalset *set, const char *uid)
 
 icalerrorenum icalset_modify(icalset *set, icalcomponent *old, icalcomponent *new)
 {
+    set->generation++;
     return set->modify(set, old, new);
 }
 
@@ -456,6 +743,29 @@ icalcomponent *icalset_get_next_component(icalset *set)
     return set->get_next_component(set);
 }
 
+icalerrorenum icalset_export(icalset *set, icalgauge *gauge, int fd)
+{
+    icalcomponent *c;
+
+    icalerror_check_arg_re((set != 0), "set", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((fd >= 0), "fd", ICAL_BADARG_ERROR);
+
+    /* Each match is handed straight to the descriptor by the streaming
+       serializer, so the export never assembles the result set - or
+       even one whole component's text - in memory. */
+    for (c = icalset_get_first_component(set); c != 0; c = icalset_get_next_component(set)) {
+        if (gauge != 0 && icalgauge_compare(gauge, c) != 1) {
+            continue;
+        }
+
+        if (icalcomponent_write_fd(c, fd) < 0) {
+            return ICAL_FILE_ERROR;
+        }
+    }
+
+    return ICAL_NO_ERROR;
+}
+
 icalsetiter icalsetiter_null = { {ICAL_NO_COMPONENT, 0}
 , 0, 0, 0, 0 };
 
@@ -513,3 +823,142 @@ icalcomponent *icalsetiter_to_prior(icalset *set, icalsetiter *i)
 {
     return set->icalsetiter_to_prior(set, i);
 }
+
+/* True if the component has an occurrence overlapping the window. A
+   component with no recurrence rules is decided from its single span;
+   recurring ones go through the occurrence cache, so repeated queries
+   over unchanged components skip the expansion. */
+static int icalset_time_range_matches(icalcomponent *comp,
+                                      struct icaltimetype start, struct icaltimetype end,
+                                      icaltime_span *limit)
+{
+    icalarray *spans;
+    int matches;
+
+    if (icalcomponent_get_first_property(comp, ICAL_RRULE_PROPERTY) == 0 &&
+        icalcomponent_get_first_property(comp, ICAL_RDATE_PROPERTY) == 0) {
+        icaltime_span span = icalcomponent_get_span(comp);
+
+        if (span.start == 0 && span.end == 0) {
+            return 0;
+        }
+        return icaltime_span_overlaps(&span, limit);
+    }
+
+    spans = icalcomponent_get_occurrences_cached(comp, start, end);
+    if (spans == 0) {
+        return 0;
+    }
+    matches = spans->num_elements != 0;
+    icalarray_free(spans);
+    return matches;
+}
+
+/* Appends a copy of uid unless it is already present. Returns 0 on
+   allocation failure. */
+static int icalset_time_range_add_uid(icalarray *uids, const char *uid)
+{
+    size_t i;
+    char *copy;
+
+    for (i = 0; i < uids->num_elements; i++) {
+        if (strcmp(*(char **)icalarray_element_at(uids, i), uid) == 0) {
+            return 1;
+        }
+    }
+
+    copy = icalmemory_strdup(uid);
+    if (copy == 0) {
+        return 0;
+    }
+    icalarray_append(uids, &copy);
+    return 1;
+}
+
+/* Tests one calendar component (or the inner components of a
+   VCALENDAR) against the window, collecting matching UIDs. */
+static int icalset_time_range_visit(icalcomponent *comp,
+                                    struct icaltimetype start, struct icaltimetype end,
+                                    icaltime_span *limit, icalarray *uids)
+{
+    icalproperty *uid_prop;
+    const char *uid;
+
+    if (icalcomponent_isa(comp) == ICAL_VCALENDAR_COMPONENT ||
+        icalcomponent_isa(comp) == ICAL_XROOT_COMPONENT) {
+        icalcomponent *inner;
+
+        for (inner = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+             inner != 0;
+             inner = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+            if (!icalset_time_range_visit(inner, start, end, limit, uids)) {
+                return 0;
+            }
+        }
+        return 1;
+    }
+
+    if (icalcomponent_isa(comp) == ICAL_VTIMEZONE_COMPONENT) {
+        return 1;
+    }
+
+    uid_prop = icalcomponent_get_first_property(comp, ICAL_UID_PROPERTY);
+    if (uid_prop == 0) {
+        return 1;
+    }
+    uid = icalproperty_get_uid(uid_prop);
+    if (uid == 0) {
+        return 1;
+    }
+
+    if (!icalset_time_range_matches(comp, start, end, limit)) {
+        return 1;
+    }
+
+    return icalset_time_range_add_uid(uids, uid);
+}
+
+icalarray *icalset_time_range_query(icalset *set,
+                                    struct icaltimetype start, struct icaltimetype end)
+{
+    icalarray *uids;
+    icalcomponent *comp;
+    icaltime_span limit;
+
+    icalerror_check_arg_rz((set != 0), "set");
+
+    uids = icalarray_new(sizeof(char *), 16);
+    if (uids == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    limit.start = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+    limit.end = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
+    limit.is_busy = 0;
+
+    for (comp = icalset_get_first_component(set);
+         comp != 0; comp = icalset_get_next_component(set)) {
+        if (!icalset_time_range_visit(comp, start, end, &limit, uids)) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            icalset_time_range_query_free(uids);
+            return 0;
+        }
+    }
+
+    return uids;
+}
+
+void icalset_time_range_query_free(icalarray *uids)
+{
+    size_t i;
+
+    if (uids == 0) {
+        return;
+    }
+
+    for (i = 0; i < uids->num_elements; i++) {
+        icalmemory_free_buffer(*(char **)icalarray_element_at(uids, i));
+    }
+    icalarray_free(uids);
+}
@@ -45,7 +45,9 @@ typedef enum icalset_kind
 {
     ICAL_FILE_SET,
     ICAL_DIR_SET,
-    ICAL_BDB_SET
+    ICAL_BDB_SET,
+    ICAL_USER_SET = 16  /**< first kind value available to registered
+                             backend classes @since 3.1.0 */
 } icalset_kind;
 
 typedef struct icalsetiter
@@ -84,9 +86,27 @@ struct icalset_impl
                                            const char *tzid);
     icalcomponent *(*icalsetiter_to_next) (icalset *set, icalsetiter *i);
     icalcomponent *(*icalsetiter_to_prior) (icalset *set, icalsetiter *i);
+    int generation;       /**< bumped by every mutation through the dispatch layer @since 3.1.0 */
+    pvl_list query_cache; /**< cached query results, managed in icalset.c @since 3.1.0 */
 };
 
-/** @brief Registers a new derived class */
+/** @brief Registers a new derived class so icalset_new() can construct
+ * it. Returns 1 on success, 0 on failure.
+ *
+ * @p set is a prototype: its kind, size and operation pointers are
+ * copied into every instance icalset_new() creates for that kind, so
+ * it must outlive the library's use of the class (a static is usual).
+ * The kind must be ICAL_USER_SET or greater — the built-in kinds
+ * always dispatch to their own implementations — and the size must
+ * cover a struct whose first member is the icalset. Registering a
+ * kind again replaces the earlier class. An operation left NULL makes
+ * the corresponding icalset_*() call invalid for that class.
+ *
+ * The registry is not locked; register every class before other
+ * threads start constructing sets.
+ * @since 3.1.0 (declared earlier, but only implemented in an
+ * experimental dlopen build)
+ */
 LIBICAL_ICALSS_EXPORT int icalset_register_class(icalset *set);
 
 /** @brief Generic icalset constructor
@@ -142,6 +162,50 @@ LIBICAL_ICALSS_EXPORT int icalset_has_uid(icalset *set, const char *uid);
 
 LIBICAL_ICALSS_EXPORT icalcomponent *icalset_fetch_match(icalset *set, icalcomponent *c);
 
+/**
+ * @brief Runs a gauge SQL query and returns the UIDs of the matching
+ * components, caching the result against the set's generation counter.
+ * @param count if non-NULL, receives the number of UIDs returned.
+ * @return a NULL-terminated list of UID strings owned by the caller;
+ * free it with icalset_free_query_result(). NULL on error.
+ * @since 3.1.0
+ *
+ * The set's generation counter is bumped by every mutation made
+ * through the dispatch layer — icalset_add_component(),
+ * icalset_remove_component(), icalset_modify() and icalset_mark().
+ * Re-running a query while the counter is unchanged returns the
+ * cached UID list without scanning or re-parsing the query; the first
+ * run after a change re-scans and refreshes the cache. Mutations made
+ * through a derived class directly do not move the counter, so mixed
+ * access should call icalset_mark() after such changes.
+ */
+LIBICAL_ICALSS_EXPORT char **icalset_query_uids(icalset *set, const char *sql, int *count);
+
+/** @brief Frees a UID list returned by icalset_query_uids().
+ *  @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT void icalset_free_query_result(char **uids);
+
+/** @brief Returns the set's mutation generation counter, or -1 if
+ *  @p set is NULL.
+ *  @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT int icalset_get_generation(icalset *set);
+
+/**
+ * @brief Streams the components that pass @p gauge (all components if
+ * NULL) to an open, writable file descriptor.
+ * @return ICAL_NO_ERROR on success, ICAL_FILE_ERROR when a write
+ * fails.
+ * @since 3.1.0
+ *
+ * Matches go through icalcomponent_write_fd(), which hands rendered
+ * fragments straight to the descriptor, so an export of an arbitrarily
+ * large set runs in constant memory instead of materializing every
+ * matching component's text first.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalset_export(icalset *set, icalgauge *gauge, int fd);
+
 /** Modifies components according to the MODIFY method of CAP. Works on
    the currently selected components. */
 LIBICAL_ICALSS_EXPORT icalerrorenum icalset_modify(icalset *set,
@@ -175,4 +239,28 @@ LIBICAL_ICALSS_EXPORT icalcomponent *icalsetiter_to_next(icalset *set, icalsetit
 
 LIBICAL_ICALSS_EXPORT icalcomponent *icalsetiter_to_prior(icalset *set, icalsetiter *i);
 
+/** @brief Returns the UIDs of the components in @p set with an
+ *  occurrence between @p start and @p end, implementing the CalDAV
+ *  time-range match.
+ *
+ *  Components without recurrence rules are tested against their single
+ *  span; recurring ones are expanded through the per-component
+ *  occurrence cache, so repeating the query (as CalDAV REPORTs do) does
+ *  not re-expand unchanged rules. Each matching UID is reported once.
+ *
+ *  @return A new icalarray of char* elements owned by the caller, to be
+ *  released with icalset_time_range_query_free(), or NULL on error.
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT icalarray *icalset_time_range_query(icalset *set,
+                                                          struct icaltimetype start,
+                                                          struct icaltimetype end);
+
+/** @brief Frees a UID list returned by icalset_time_range_query().
+ *
+ *  @since 3.1.0
+ */
+LIBICAL_ICALSS_EXPORT void icalset_time_range_query_free(icalarray *uids);
+
 #endif /* !ICALSET_H */
@@ -21,41 +21,167 @@
 #endif
 
 #include "icalspanlist.h"
+#include "icalarray.h"
+#include "icalmemory.h"
 #include "icaltimezone.h"
+#include "icalvalue.h"
 
 #include <stdlib.h>
 
+/** One entry in the span array: the span itself plus the largest end
+    time of any span at or before it in start order. Busy spans from
+    different events may overlap, so a plain binary search on start
+    times cannot find every overlap; the running maximum is monotone,
+    which lets icalspanlist_query_range() binary-search for the first
+    entry that could reach into a range. */
+struct icalspanlist_span
+{
+    struct icaltime_span span;
+    time_t max_end;
+};
+
 struct icalspanlist_impl
 {
-    pvl_list spans;             /**< list of icaltime_span data **/
+    icalarray *spans;           /**< icalspanlist_span, sorted by start time **/
     struct icaltimetype start;  /**< start time of span **/
     struct icaltimetype end;    /**< end time of span **/
 };
 
 /** @brief Internal comparison function for two spans
  *
- *  @param  a   a spanlist.
- *  @param  b   another spanlist.
+ *  @param  a   a span entry.
+ *  @param  b   another span entry.
  *
  *  @return     -1, 0, 1 depending on the comparison of the start times.
  *
- * Used to insert spans into the tree in sorted order.
+ * Used to sort the span array by start time.
  */
 
-static int compare_span(void *a, void *b)
+static int compare_span(const void *a, const void *b)
 {
-    struct icaltime_span *span_a = (struct icaltime_span *)a;
-    struct icaltime_span *span_b = (struct icaltime_span *)b;
+    const struct icalspanlist_span *span_a = a;
+    const struct icalspanlist_span *span_b = b;
 
-    if (span_a->start == span_b->start) {
+    if (span_a->span.start == span_b->span.start) {
         return 0;
-    } else if (span_a->start < span_b->start) {
+    } else if (span_a->span.start < span_b->span.start) {
         return -1;
-    } else {    /*if(span_a->start > span->b.start) */
+    } else {    /*if(span_a->span.start > span_b->span.start) */
         return 1;
     }
 }
 
+/** @brief Appends a span to the (unsorted) span array */
+static void icalspanlist_append(icalspanlist *sl, const struct icaltime_span *span)
+{
+    struct icalspanlist_span entry;
+
+    entry.span = *span;
+    entry.max_end = 0;
+
+    icalarray_append(sl->spans, &entry);
+}
+
+/** @brief Sorts the span array and computes the running maximum end
+ *  times.
+ *
+ *  Must be called after the last append and before any query.
+ */
+static void icalspanlist_finalize(icalspanlist *sl)
+{
+    size_t i;
+    time_t max_end = 0;
+
+    icalarray_sort(sl->spans, compare_span);
+
+    for (i = 0; i < sl->spans->num_elements; i++) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+
+        if (i == 0 || entry->span.end > max_end) {
+            max_end = entry->span.end;
+        }
+        entry->max_end = max_end;
+    }
+}
+
+/** @brief Recomputes the free spans and re-sorts the array.
+ *
+ *  Drops every free entry, refills the gaps between the (possibly
+ *  changed) busy spans over the list's window, re-adds the open-ended
+ *  tail span for a null end time, and finalizes. Used after the busy
+ *  spans have been modified, by construction as well as by the
+ *  incremental add/remove functions.
+ */
+static void icalspanlist_refresh(icalspanlist *sl)
+{
+    struct icaltime_span range;
+    size_t i, busy_count;
+
+    /* Drop the free entries; they are derived from the busy ones */
+    for (i = 0; i < sl->spans->num_elements;) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+
+        if (entry->span.is_busy == 0) {
+            icalarray_remove_element_at(sl->spans, i);
+        } else {
+            i++;
+        }
+    }
+
+    icalarray_sort(sl->spans, compare_span);
+
+    range.start = icaltime_as_timet(sl->start);
+    range.end = icaltime_as_timet(sl->end);
+
+    /* Fill in the free time spans. Loop through the busy spans; if the
+       start of the range is not within the span, create a free entry
+       that runs from the start of the range to the start of the
+       span. The free entries are appended behind the busy ones and
+       sorted into place by the finalize below. */
+
+    busy_count = sl->spans->num_elements;
+
+    for (i = 0; i < busy_count; i++) {
+        /* Re-fetch each iteration; appending may move the array */
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+        struct icaltime_span busy = entry->span;
+
+        if (range.start < busy.start) {
+            struct icaltime_span freetime;
+
+            freetime.start = range.start;
+            freetime.end = busy.start;
+            freetime.is_busy = 0;
+
+            icalspanlist_append(sl, &freetime);
+        }
+
+        range.start = busy.end;
+    }
+
+    icalarray_sort(sl->spans, compare_span);
+
+    /* If the end of the range is null, then assume that everything
+       after the last item in the calendar is open and add a span
+       that indicates this */
+
+    if (icaltime_is_null_time(sl->end) && sl->spans->num_elements != 0) {
+        struct icalspanlist_span *last_entry =
+            icalarray_element_at(sl->spans, sl->spans->num_elements - 1);
+        struct icaltime_span freetime;
+
+        freetime.is_busy = 0;
+        freetime.start = last_entry->span.end;
+        freetime.end = freetime.start;
+
+        /* Its start is not before any other start, so the array stays
+           sorted */
+        icalspanlist_append(sl, &freetime);
+    }
+
+    icalspanlist_finalize(sl);
+}
+
 /** @brief callback function for collecting spanlists of a
  *         series of events.
  *
@@ -69,7 +195,6 @@ static int compare_span(void *a, void *b)
 
 static void icalspanlist_new_callback(icalcomponent *comp, struct icaltime_span *span, void *data)
 {
-    icaltime_span *s;
     icalspanlist *sl = (icalspanlist *) data;
 
     _unused(comp);
@@ -77,36 +202,28 @@ static void icalspanlist_new_callback(icalcomponent *comp, struct icaltime_span
     if (span->is_busy == 0)
         return;
 
-    if ((s = (icaltime_span *) malloc(sizeof(icaltime_span))) == 0) {
-        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-        return;
-    }
-
-  /* copy span data into allocated memory.. **/
-    *s = *span;
-    pvl_insert_ordered(sl->spans, compare_span, (void *)s);
+    icalspanlist_append(sl, span);
 }
 
 icalspanlist *icalspanlist_new(icalset *set, struct icaltimetype start, struct icaltimetype end)
 {
-    struct icaltime_span range;
-    pvl_elem itr;
     icalcomponent *c, *inner;
     icalcomponent_kind kind, inner_kind;
     icalspanlist *sl;
-    struct icaltime_span *freetime;
 
     if ((sl = (struct icalspanlist_impl *)malloc(sizeof(struct icalspanlist_impl))) == 0) {
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
 
-    sl->spans = pvl_newlist();
+    sl->spans = icalarray_new_contiguous(sizeof(struct icalspanlist_span), 64);
     sl->start = start;
     sl->end = end;
 
-    range.start = icaltime_as_timet(start);
-    range.end = icaltime_as_timet(end);
+    if (sl->spans == 0) {
+        free(sl);
+        return 0;
+    }
 
     /* Gets a list of spans of busy time from the events in the set
        and order the spans based on the start time */
@@ -131,93 +248,144 @@ icalspanlist *icalspanlist_new(icalset *set, struct icaltimetype start, struct i
         icalcomponent_foreach_recurrence(c, start, end, icalspanlist_new_callback, (void *)sl);
     }
 
-    /* Now Fill in the free time spans. loop through the spans. if the
-       start of the range is not within the span, create a free entry
-       that runs from the start of the range to the start of the
-       span. */
+    /* Derive the free spans between the busy ones and sort */
+    icalspanlist_refresh(sl);
 
-    for (itr = pvl_head(sl->spans); itr != 0; itr = pvl_next(itr)) {
-        struct icaltime_span *s = (struct icaltime_span *)pvl_data(itr);
+    return sl;
+}
 
-        if (!s)
-            continue;
+/** @brief callback function for deleting the spans of one event.
+ *
+ *  @param   comp  A valid icalcomponent.
+ *  @param   span  The span to delete from data.
+ *  @param   data  The actual spanlist to delete from
+ *
+ *  Removes one busy entry matching the span from the (sorted) span
+ *  array. The array is sorted by start time, so a binary search finds
+ *  the group of entries sharing the span's start; removals preserve
+ *  the order, leaving the sort key valid for the next occurrence.
+ */
 
-        if ((freetime = (struct icaltime_span *)malloc(sizeof(struct icaltime_span))) == 0) {
-            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-            icalspanlist_free(sl);
-            return 0;
-        }
+static void icalspanlist_remove_callback(icalcomponent *comp,
+                                         struct icaltime_span *span, void *data)
+{
+    icalspanlist *sl = (icalspanlist *) data;
+    size_t lo, hi, i;
 
-        if (range.start < s->start) {
-            freetime->start = range.start;
-            freetime->end = s->start;
+    _unused(comp);
 
-            freetime->is_busy = 0;
+    if (span->is_busy == 0)
+        return;
+
+    /* Lower bound on the start time */
+    lo = 0;
+    hi = sl->spans->num_elements;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, mid);
 
-            pvl_insert_ordered(sl->spans, compare_span, (void *)freetime);
+        if (entry->span.start < span->start) {
+            lo = mid + 1;
         } else {
-            free(freetime);
+            hi = mid;
+        }
+    }
+
+    for (i = lo; i < sl->spans->num_elements; i++) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+
+        if (entry->span.start > span->start) {
+            break;
         }
 
-        range.start = s->end;
+        if (entry->span.is_busy == 1 && entry->span.end == span->end) {
+            icalarray_remove_element_at(sl->spans, i);
+            return;
+        }
     }
+}
 
-    /* If the end of the range is null, then assume that everything
-       after the last item in the calendar is open and add a span
-       that indicates this */
+icalerrorenum icalspanlist_add_component(icalspanlist *sl, icalcomponent *comp)
+{
+    icalcomponent *inner;
+    icalcomponent_kind kind, inner_kind;
 
-    if (icaltime_is_null_time(end)) {
-        struct icaltime_span *last_span;
+    icalerror_check_arg_re((sl != 0), "sl", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((comp != 0), "comp", ICAL_BADARG_ERROR);
 
-        last_span = (struct icaltime_span *)pvl_data(pvl_tail(sl->spans));
+    kind = icalcomponent_isa(comp);
+    inner = icalcomponent_get_inner(comp);
 
-        if (last_span != 0) {
+    if (!inner)
+        return ICAL_BADARG_ERROR;
 
-            if ((freetime = (struct icaltime_span *)malloc(sizeof(struct icaltime_span))) == 0) {
-                icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-                icalspanlist_free(sl);
-                return 0;
-            }
+    inner_kind = icalcomponent_isa(inner);
 
-            freetime->is_busy = 0;
-            freetime->start = last_span->end;
-            freetime->end = freetime->start;
-            pvl_insert_ordered(sl->spans, compare_span, (void *)freetime);
-        }
-    }
+    if (kind != ICAL_VEVENT_COMPONENT && inner_kind != ICAL_VEVENT_COMPONENT)
+        return ICAL_BADARG_ERROR;
 
-    return sl;
+    icalerror_clear_errno();
+
+    icalcomponent_foreach_recurrence(comp, sl->start, sl->end,
+                                     icalspanlist_new_callback, (void *)sl);
+
+    icalspanlist_refresh(sl);
+
+    return ICAL_NO_ERROR;
 }
 
-void icalspanlist_free(icalspanlist *s)
+icalerrorenum icalspanlist_remove_component(icalspanlist *sl, icalcomponent *comp)
 {
-    struct icaltime_span *span;
+    icalcomponent *inner;
+    icalcomponent_kind kind, inner_kind;
+
+    icalerror_check_arg_re((sl != 0), "sl", ICAL_BADARG_ERROR);
+    icalerror_check_arg_re((comp != 0), "comp", ICAL_BADARG_ERROR);
+
+    kind = icalcomponent_isa(comp);
+    inner = icalcomponent_get_inner(comp);
+
+    if (!inner)
+        return ICAL_BADARG_ERROR;
+
+    inner_kind = icalcomponent_isa(inner);
+
+    if (kind != ICAL_VEVENT_COMPONENT && inner_kind != ICAL_VEVENT_COMPONENT)
+        return ICAL_BADARG_ERROR;
+
+    icalerror_clear_errno();
+
+    icalcomponent_foreach_recurrence(comp, sl->start, sl->end,
+                                     icalspanlist_remove_callback, (void *)sl);
+
+    icalspanlist_refresh(sl);
 
+    return ICAL_NO_ERROR;
+}
+
+void icalspanlist_free(icalspanlist *s)
+{
     if (s == NULL)
         return;
 
-    while ((span = pvl_pop(s->spans)) != 0) {
-        free(span);
+    if (s->spans != 0) {
+        icalarray_free(s->spans);
+        s->spans = 0;
     }
 
-    pvl_free(s->spans);
-
-    s->spans = 0;
-
     free(s);
 }
 
 void icalspanlist_dump(icalspanlist *sl)
 {
-    int i = 0;
-    pvl_elem itr;
-
-    for (itr = pvl_head(sl->spans); itr != 0; itr = pvl_next(itr)) {
-        struct icaltime_span *s = (struct icaltime_span *)pvl_data(itr);
-        if (s) {
-            printf("#%02d %d start: %s", ++i, s->is_busy, ctime(&s->start));
-            printf("      end  : %s", ctime(&s->end));
-        }
+    size_t i;
+
+    for (i = 0; i < sl->spans->num_elements; i++) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+        struct icaltime_span *s = &entry->span;
+
+        printf("#%02d %d start: %s", (int)(i + 1), s->is_busy, ctime(&s->start));
+        printf("      end  : %s", ctime(&s->end));
     }
 }
 
@@ -225,7 +393,7 @@ icalcomponent *icalspanlist_make_busy_list(icalspanlist *sl);
 
 struct icalperiodtype icalspanlist_next_free_time(icalspanlist *sl, struct icaltimetype t)
 {
-    pvl_elem itr;
+    size_t i;
     struct icalperiodtype period;
     struct icaltime_span *s;
 
@@ -234,14 +402,13 @@ struct icalperiodtype icalspanlist_next_free_time(icalspanlist *sl, struct icalt
     period.start = icaltime_null_time();
     period.end = icaltime_null_time();
 
-    itr = pvl_head(sl->spans);
-    s = (struct icaltime_span *)pvl_data(itr);
-
-    if (s == 0) {
+    if (sl->spans->num_elements == 0) {
         /* No elements in span */
         return period;
     }
 
+    s = &((struct icalspanlist_span *)icalarray_element_at(sl->spans, 0))->span;
+
     /* Is the reference time before the first span? If so, assume
        that the reference time is free */
     if (rangett < s->start) {
@@ -260,11 +427,8 @@ struct icalperiodtype icalspanlist_next_free_time(icalspanlist *sl, struct icalt
 
     /* Otherwise, find the first free span that contains the
        reference time. */
-    for (itr = pvl_head(sl->spans); itr != 0; itr = pvl_next(itr)) {
-        s = (struct icaltime_span *)pvl_data(itr);
-
-        if (!s)
-            continue;
+    for (i = 0; i < sl->spans->num_elements; i++) {
+        s = &((struct icalspanlist_span *)icalarray_element_at(sl->spans, i))->span;
 
         if (s->is_busy == 0 && s->start >= rangett && (rangett < s->end || s->end == s->start)) {
 
@@ -286,9 +450,112 @@ struct icalperiodtype icalspanlist_next_free_time(icalspanlist *sl, struct icalt
     return period;
 }
 
+/** @brief Counts the busy spans overlapping [range_start, range_end)
+ *         given as time_t values.
+ *
+ *  Shared by icalspanlist_query_range() and the batch query so that
+ *  batch callers pay the icaltimetype conversion only once per range.
+ */
+static int icalspanlist_query_range_timet(icalspanlist *sl, time_t range_start, time_t range_end)
+{
+    size_t lo, hi, i;
+    int count = 0;
+
+    /* Binary search for the first entry whose running maximum end
+       reaches past the range start; nothing before it can overlap */
+    lo = 0;
+    hi = sl->spans->num_elements;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, mid);
+
+        if (entry->max_end > range_start) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    /* Scan forward; once a span starts at or past the range end, so
+       does everything after it */
+    for (i = lo; i < sl->spans->num_elements; i++) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+
+        if (entry->span.start >= range_end) {
+            break;
+        }
+
+        if (entry->span.is_busy == 1 && entry->span.end > range_start) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+int icalspanlist_query_range(icalspanlist *sl,
+                             struct icaltimetype start, struct icaltimetype end)
+{
+    time_t range_start, range_end;
+
+    icalerror_check_arg_re((sl != 0), "spanlist", -1);
+
+    range_start = icaltime_as_timet_with_zone(start, icaltimezone_get_utc_timezone());
+    range_end = icaltime_as_timet_with_zone(end, icaltimezone_get_utc_timezone());
+
+    return icalspanlist_query_range_timet(sl, range_start, range_end);
+}
+
+int icalspanlist_query_spans(icalspanlist *sl,
+                             const struct icaltime_span *ranges, int num_ranges, int *counts)
+{
+    int i;
+
+    icalerror_check_arg_re((sl != 0), "spanlist", -1);
+    icalerror_check_arg_re((ranges != 0), "ranges", -1);
+    icalerror_check_arg_re((counts != 0), "counts", -1);
+
+    for (i = 0; i < num_ranges; i++) {
+        counts[i] = icalspanlist_query_range_timet(sl, ranges[i].start, ranges[i].end);
+    }
+
+    return 0;
+}
+
+struct icaltime_span *icalspanlist_get_spans_array(icalspanlist *sl, int *count)
+{
+    struct icaltime_span *spans;
+    size_t i;
+
+    icalerror_check_arg_rz((sl != 0), "spanlist");
+    icalerror_check_arg_rz((count != 0), "count");
+
+    *count = 0;
+
+    if (sl->spans->num_elements == 0) {
+        return 0;
+    }
+
+    spans = icalmemory_new_buffer(sl->spans->num_elements * sizeof(struct icaltime_span));
+    if (spans == 0) {
+        icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+        return 0;
+    }
+
+    for (i = 0; i < sl->spans->num_elements; i++) {
+        struct icalspanlist_span *entry = icalarray_element_at(sl->spans, i);
+
+        spans[i] = entry->span;
+    }
+
+    *count = (int)sl->spans->num_elements;
+
+    return spans;
+}
+
 int *icalspanlist_as_freebusy_matrix(icalspanlist *sl, int delta_t)
 {
-    pvl_elem itr;
+    size_t n;
     time_t spanduration_secs;
     int *matrix;
     time_t matrix_slots;
@@ -328,10 +595,11 @@ int *icalspanlist_as_freebusy_matrix(icalspanlist *sl, int delta_t)
 
     /* loop through each span and mark the slots in the array */
 
-    for (itr = pvl_head(sl->spans); itr != 0; itr = pvl_next(itr)) {
-        struct icaltime_span *s = (struct icaltime_span *)pvl_data(itr);
+    for (n = 0; n < sl->spans->num_elements; n++) {
+        struct icaltime_span *s =
+            &((struct icalspanlist_span *)icalarray_element_at(sl->spans, n))->span;
 
-        if (s && s->is_busy == 1) {
+        if (s->is_busy == 1) {
             time_t offset_start = s->start / delta_t - sl_start / delta_t;
             time_t offset_end = (s->end - 1) / delta_t - sl_start / delta_t + 1;
             time_t i;
@@ -353,9 +621,10 @@ icalcomponent *icalspanlist_as_vfreebusy(icalspanlist *sl,
     icalcomponent *comp;
     icalproperty *p;
     struct icaltimetype atime = icaltime_from_timet_with_zone(time(0), 0, NULL);
-    pvl_elem itr;
+    size_t i;
     icaltimezone *utc_zone;
     icalparameter *param;
+    struct icalperiodarraytype pa;
 
     if (!attendee) {
         icalerror_set_errno(ICAL_USAGE_ERROR);
@@ -375,24 +644,55 @@ icalcomponent *icalspanlist_as_vfreebusy(icalspanlist *sl,
     }
     icalcomponent_add_property(comp, icalproperty_new_attendee(attendee));
 
-    /* now add the freebusy sections.. */
+    /* now add the freebusy section: all busy spans are packed into a
+       single multi-valued FREEBUSY property (RFC 5545 comma syntax),
+       so a large response is one property plus one period array rather
+       than one property tree per span. */
 
-    for (itr = pvl_head(sl->spans); itr != 0; itr = pvl_next(itr)) {
-        struct icalperiodtype period;
-        struct icaltime_span *s = (struct icaltime_span *)pvl_data(itr);
-
-        if (s && s->is_busy == 1) {
+    pa = icalperiodarraytype_null_array();
+    for (i = 0; i < sl->spans->num_elements; i++) {
+        struct icaltime_span *s =
+            &((struct icalspanlist_span *)icalarray_element_at(sl->spans, i))->span;
 
-            period.start = icaltime_from_timet_with_zone(s->start, 0, utc_zone);
-            period.end = icaltime_from_timet_with_zone(s->end, 0, utc_zone);
-            period.duration = icaldurationtype_null_duration();
+        if (s->is_busy == 1) {
+            pa.num_periods++;
+        }
+    }
 
-            p = icalproperty_new_freebusy(period);
-            param = icalparameter_new_fbtype(ICAL_FBTYPE_BUSY);
-            icalproperty_add_parameter(p, param);
+    if (pa.num_periods > 0) {
+        struct icalperiodtype *block;
 
-            icalcomponent_add_property(comp, p);
+        block = malloc(pa.num_periods * sizeof(struct icalperiodtype));
+        if (block == 0) {
+            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
+            icalcomponent_free(comp);
+            return 0;
+        }
+        pa.periods = block;
+        pa.num_periods = 0;
+
+        for (i = 0; i < sl->spans->num_elements; i++) {
+            struct icaltime_span *s =
+                &((struct icalspanlist_span *)icalarray_element_at(sl->spans, i))->span;
+
+            if (s->is_busy == 1) {
+                block[pa.num_periods].start =
+                    icaltime_from_timet_with_zone(s->start, 0, utc_zone);
+                block[pa.num_periods].end =
+                    icaltime_from_timet_with_zone(s->end, 0, utc_zone);
+                block[pa.num_periods].duration = icaldurationtype_null_duration();
+                pa.num_periods++;
+            }
         }
+
+        p = icalproperty_new(ICAL_FREEBUSY_PROPERTY);
+        icalproperty_set_value(p, icalvalue_new_periodarray(pa));
+        param = icalparameter_new_fbtype(ICAL_FBTYPE_BUSY);
+        icalproperty_add_parameter(p, param);
+
+        icalcomponent_add_property(comp, p);
+
+        free(block);
     }
 
     return comp;
@@ -414,22 +714,24 @@ icalspanlist *icalspanlist_from_vfreebusy(icalcomponent *comp)
         icalerror_set_errno(ICAL_NEWFAILED_ERROR);
         return 0;
     }
-    sl->spans = pvl_newlist();
+    sl->spans = icalarray_new_contiguous(sizeof(struct icalspanlist_span), 64);
+    sl->start = icaltime_null_time();
+    sl->end = icaltime_null_time();
+
+    if (sl->spans == 0) {
+        free(sl);
+        return 0;
+    }
 
     /* cycle through each FREEBUSY property, adding to the spanlist */
     for (prop = icalcomponent_get_first_property(inner, ICAL_FREEBUSY_PROPERTY);
          prop != NULL;
          prop = icalcomponent_get_next_property(inner, ICAL_FREEBUSY_PROPERTY)) {
-        icaltime_span *s = (icaltime_span *) malloc(sizeof(icaltime_span));
+        struct icaltime_span s;
         icalparameter *param;
         struct icalperiodtype period;
         icalparameter_fbtype fbtype;
-
-        if (s == 0) {
-            icalerror_set_errno(ICAL_NEWFAILED_ERROR);
-            icalspanlist_free(sl);
-            return 0;
-        }
+        icalvalue *value;
 
         param = icalproperty_get_first_parameter(prop, ICAL_FBTYPE_PARAMETER);
         fbtype = (param) ? icalparameter_get_fbtype(param) : ICAL_FBTYPE_BUSY;
@@ -438,18 +740,36 @@ icalspanlist *icalspanlist_from_vfreebusy(icalcomponent *comp)
         case ICAL_FBTYPE_FREE:
         case ICAL_FBTYPE_NONE:
         case ICAL_FBTYPE_X:
-            s->is_busy = 1;
+            s.is_busy = 1;
             break;
         default:
-            s->is_busy = 0;
+            s.is_busy = 0;
         }
 
-        period = icalproperty_get_freebusy(prop);
-        s->start = icaltime_as_timet_with_zone(period.start, icaltimezone_get_utc_timezone());
-        s->end = icaltime_as_timet_with_zone(period.end, icaltimezone_get_utc_timezone());
+        value = icalproperty_get_value(prop);
+        if (value && icalvalue_isa(value) == ICAL_PERIODARRAY_VALUE) {
+            /* one packed property carrying every period */
+            struct icalperiodarraytype pa = icalvalue_get_periodarray(value);
+            size_t i;
+
+            for (i = 0; i < pa.num_periods; i++) {
+                s.start = icaltime_as_timet_with_zone(pa.periods[i].start,
+                                                      icaltimezone_get_utc_timezone());
+                s.end = icaltime_as_timet_with_zone(pa.periods[i].end,
+                                                    icaltimezone_get_utc_timezone());
+                icalspanlist_append(sl, &s);
+            }
+        } else {
+            period = icalproperty_get_freebusy(prop);
+            s.start = icaltime_as_timet_with_zone(period.start, icaltimezone_get_utc_timezone());
+            s.end = icaltime_as_timet_with_zone(period.end, icaltimezone_get_utc_timezone());
 
-        pvl_insert_ordered(sl->spans, compare_span, (void *)s);
+            icalspanlist_append(sl, &s);
+        }
     }
+
+    icalspanlist_finalize(sl);
+
   /** @todo calculate start/end limits.. fill in holes? **/
     return sl;
 }
@@ -61,6 +61,100 @@ LIBICAL_ICALSS_EXPORT void icalspanlist_free(icalspanlist *spl);
 LIBICAL_ICALSS_EXPORT struct icalperiodtype icalspanlist_next_free_time(icalspanlist *sl,
                                                                         struct icaltimetype t);
 
+/** @brief Adds the busy spans of one component to a spanlist.
+ *
+ *  @param  sl    The spanlist to update.
+ *  @param  comp  A VEVENT, or a component containing one.
+ *
+ *  @return ICAL_NO_ERROR on success, ICAL_BADARG_ERROR if the
+ *          component is not an event.
+ *  @since 3.1.0
+ *
+ *  Expands only the given component's recurrences over the spanlist's
+ *  time window and merges the resulting busy spans in, re-deriving the
+ *  free spans. Together with icalspanlist_remove_component() this lets
+ *  a cached spanlist track a single event edit without rebuilding from
+ *  the whole set via icalspanlist_new().
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalspanlist_add_component(icalspanlist *sl,
+                                                               icalcomponent *comp);
+
+/** @brief Removes the busy spans of one component from a spanlist.
+ *
+ *  @param  sl    The spanlist to update.
+ *  @param  comp  A VEVENT, or a component containing one.
+ *
+ *  @return ICAL_NO_ERROR on success, ICAL_BADARG_ERROR if the
+ *          component is not an event.
+ *  @since 3.1.0
+ *
+ *  Expands the component's recurrences over the spanlist's window and
+ *  deletes one matching busy span per occurrence, then re-derives the
+ *  free spans. The component must describe the same occurrences it had
+ *  when it was added; pass the old version before an edit, then add
+ *  the new one. If another event contributed an identical span, one of
+ *  the two entries is removed, which leaves the busy count correct.
+ */
+LIBICAL_ICALSS_EXPORT icalerrorenum icalspanlist_remove_component(icalspanlist *sl,
+                                                                  icalcomponent *comp);
+
+/** @brief Counts the busy spans that overlap a time range.
+ *
+ *  @param  sl     The spanlist to query.
+ *  @param  start  Start of the range, in UTC.
+ *  @param  end    End of the range (exclusive), in UTC.
+ *
+ *  @return The number of busy spans overlapping the range, or -1
+ *          if @p sl is NULL. Zero means the range is conflict-free.
+ *  @since 3.1.0
+ *
+ *  The spans are kept in a contiguous array sorted by start time and
+ *  augmented with a running maximum end time, so the query binary
+ *  searches for the first span that can reach into the range and then
+ *  scans only until the spans start past its end — a bulk conflict
+ *  check over a large list does not walk the whole list per query.
+ */
+LIBICAL_ICALSS_EXPORT int icalspanlist_query_range(icalspanlist *sl,
+                                                   struct icaltimetype start,
+                                                   struct icaltimetype end);
+
+/** @brief Counts the busy spans that overlap each of several ranges.
+ *
+ *  @param  sl          The spanlist to query.
+ *  @param  ranges      An array of candidate ranges, as UTC epoch
+ *                      spans with exclusive ends.
+ *  @param  num_ranges  The number of entries in @p ranges.
+ *  @param  counts      Receives one overlap count per range, in order.
+ *
+ *  @return 0 on success, or -1 if any argument is NULL.
+ *  @since 3.1.0
+ *
+ *  Each range is answered with the same binary search as
+ *  icalspanlist_query_range(), so checking a batch of candidate slots
+ *  costs one call rather than one call (and one icaltimetype
+ *  conversion) per slot.
+ */
+LIBICAL_ICALSS_EXPORT int icalspanlist_query_spans(icalspanlist *sl,
+                                                   const struct icaltime_span *ranges,
+                                                   int num_ranges, int *counts);
+
+/** @brief Returns the spanlist's spans as a contiguous array.
+ *
+ *  @param  sl     The spanlist.
+ *  @param  count  Receives the number of spans returned.
+ *
+ *  @return A newly allocated array of the spans in start order, both
+ *          busy and free, or NULL if the list is empty or on error.
+ *          Free the array with icalmemory_free_buffer().
+ *  @since 3.1.0
+ *
+ *  The spans are copied straight out of the internal packed array, so
+ *  retrieving the whole timeline is a single allocation and copy
+ *  rather than a walk with one call per span.
+ */
+LIBICAL_ICALSS_EXPORT struct icaltime_span *icalspanlist_get_spans_array(icalspanlist *sl,
+                                                                         int *count);
+
 /** @brief (Debug) print out spanlist to STDOUT.
  *  @param sl A valid icalspanlist.
  */
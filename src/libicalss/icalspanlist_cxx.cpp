@@ -21,6 +21,10 @@
 #include "icalspanlist_cxx.h"
 #include "vcomponent_cxx.h"
 
+extern "C" {
+#include "icalmemory.h"
+}
+
 #include <cstdlib> // for free()
 
 using namespace LibICal;
@@ -140,3 +144,57 @@ std::vector<int> ICalSpanList::as_vector(int delta_t)
     free(matrix);
     return event_vec;
 }
+
+/**
+ * @brief Returns every span in the list as one contiguous vector.
+ *
+ * The spans come back in start order, busy and free alike, copied out
+ * of the underlying packed array in a single call.
+ *
+ * @see icalspanlist_get_spans_array()
+ */
+
+std::vector<struct icaltime_span> ICalSpanList::get_spans()
+{
+    struct icaltime_span *spans;
+    int count = 0;
+    std::vector<struct icaltime_span> span_vec;
+
+    spans = icalspanlist_get_spans_array(data, &count);
+
+    if (spans != NULL) {
+        span_vec.assign(spans, spans + count);
+        icalmemory_free_buffer(spans);
+    } else if (icalerrno != ICAL_NO_ERROR) {
+        throw icalerrno;
+    }
+
+    return span_vec;
+}
+
+/**
+ * @brief Returns the busy overlap count for each candidate range.
+ *
+ * @param ranges   Candidate ranges as UTC epoch spans with exclusive
+ *                 ends.
+ *
+ * Answers every candidate in one call into the library instead of one
+ * call per conflict check.
+ *
+ * @see icalspanlist_query_spans()
+ */
+
+std::vector<int> ICalSpanList::query_spans(const std::vector<struct icaltime_span> &ranges)
+{
+    std::vector<int> counts(ranges.size(), 0);
+
+    if (ranges.empty()) {
+        return counts;
+    }
+
+    if (icalspanlist_query_spans(data, &ranges[0], (int)ranges.size(), &counts[0]) < 0) {
+        throw icalerrno;
+    }
+
+    return counts;
+}
@@ -75,6 +75,14 @@ public:
     /** Returns a vector of the number of events over delta t */
     std::vector < int >as_vector(int delta_t);
 
+    /** Returns all spans, busy and free, as one contiguous vector in
+        start order */
+    std::vector < struct icaltime_span >get_spans();
+
+    /** Returns the busy-span overlap count for each candidate range
+        in one call */
+    std::vector < int >query_spans(const std::vector < struct icaltime_span > &ranges);
+
     /** Dumps the spanlist to STDOUT */
     void dump();
 
@@ -38,7 +38,9 @@
 #endif
 
 #include "icalvcal.h"
+#include "vcc.h"
 #include "icalerror.h"
+#include "icalmemory.h"
 #include "icalvalue.h"
 #include "icaltimezone.h"
 #include "icalversion.h"        /* for ICAL_PACKAGE */
@@ -207,6 +209,70 @@ icalcomponent *icalvcal_convert(VObject *object)
     return icalvcal_convert_with_defaults(object, NULL);
 }
 
+struct icalvcal_stream_data
+{
+    icalcomponent *root;
+    int count;
+    icalvcal_defaults *defaults;
+};
+
+/* Converts one top-level object the moment the parser finishes it, then
+   frees its VObject tree, so only a single object's tree is ever live. */
+static void icalvcal_convert_emitted_object(VObject *object, void *d)
+{
+    struct icalvcal_stream_data *data = (struct icalvcal_stream_data *)d;
+    icalcomponent *c;
+
+    c = icalvcal_convert_with_defaults(object, data->defaults);
+    cleanVObject(object);
+
+    if (c == 0) {
+        return;
+    }
+
+    if (data->count == 1) {
+        /* A second calendar: wrap the results in an XROOT */
+        icalcomponent *container = icalcomponent_new(ICAL_XROOT_COMPONENT);
+
+        icalcomponent_add_component(container, data->root);
+        data->root = container;
+    }
+
+    if (data->count == 0) {
+        data->root = c;
+    } else {
+        icalcomponent_add_component(data->root, c);
+    }
+    data->count++;
+}
+
+icalcomponent *icalvcal_convert_string_with_defaults(const char *str, size_t len,
+                                                     icalvcal_defaults *defaults)
+{
+    struct icalvcal_stream_data data;
+
+    icalerror_check_arg_rz((str != 0), "str");
+
+    data.root = 0;
+    data.count = 0;
+    data.defaults = defaults;
+
+    if (Parse_MIME_WithHandler(str, (unsigned long)len,
+                               icalvcal_convert_emitted_object, &data) == 0) {
+        if (data.root != 0) {
+            icalcomponent_free(data.root);
+        }
+        return 0;
+    }
+
+    return data.root;
+}
+
+icalcomponent *icalvcal_convert_string(const char *str, size_t len)
+{
+    return icalvcal_convert_string_with_defaults(str, len, NULL);
+}
+
 /* comp() is useful for most components, but alarm, daylight and
  * timezone are different. In vcal, they are properties, and in ical,
  * they are components. Although because of the way that vcal treats
@@ -1604,6 +1670,132 @@ static void icalvcal_traverse_objects(VObject *object,
     }
 }
 
+/***********************************************************************
+ * Direct iCal -> vCalendar emission.
+ *
+ * The export path used to require building an intermediate VObject
+ * tree and writing it through writeMemVObject()'s per-character
+ * appends. For the property subset whose text representation is the
+ * same in both formats (the dc_prop set above, read in reverse) the
+ * vCalendar text can be emitted straight from the icalcomponent into
+ * a string builder.
+ **********************************************************************/
+
+/* Returns the vCalendar name for a property, or 0 when the property
+   has no same-text vCalendar representation and must be skipped.
+   VERSION is always 0: the writer emits VERSION:1.0 itself. */
+static const char *icalvcal_vcal_property_name(icalproperty *prop)
+{
+    switch (icalproperty_isa(prop)) {
+    case ICAL_VERSION_PROPERTY:
+        return 0;
+
+    case ICAL_CREATED_PROPERTY:
+        /* vCalendar spells this DCREATED */
+        return "DCREATED";
+
+    case ICAL_RRULE_PROPERTY:
+    case ICAL_EXRULE_PROPERTY:
+        /* vCalendar recurrence grammar ("W1 MO #10") differs from the
+           iCalendar one; emitting the iCal text would be wrong */
+        return 0;
+
+    default:
+        return icalproperty_get_property_name(prop);
+    }
+}
+
+static void icalvcal_write_property(icalmemory_strbuf *sb, icalproperty *prop)
+{
+    const char *name = icalvcal_vcal_property_name(prop);
+    const char *value;
+    icalparameter *param;
+
+    if (name == 0) {
+        return;
+    }
+
+    icalmemory_strbuf_append_string(sb, name);
+
+    for (param = icalproperty_get_first_parameter(prop, ICAL_ANY_PARAMETER);
+         param != 0;
+         param = icalproperty_get_next_parameter(prop, ICAL_ANY_PARAMETER)) {
+        icalmemory_strbuf_append_char(sb, ';');
+        icalmemory_strbuf_append_string(sb, icalparameter_as_ical_string(param));
+    }
+
+    icalmemory_strbuf_append_char(sb, ':');
+
+    value = icalproperty_get_value_as_string(prop);
+    if (value != 0) {
+        icalmemory_strbuf_append_string(sb, value);
+    }
+
+    icalmemory_strbuf_append(sb, "\r\n", 2);
+}
+
+static void icalvcal_write_component(icalmemory_strbuf *sb, icalcomponent *comp)
+{
+    icalcomponent_kind ckind = icalcomponent_isa(comp);
+    const char *cname = icalcomponent_kind_to_string(ckind);
+    icalproperty *prop;
+    icalcomponent *child;
+
+    icalmemory_strbuf_append_string(sb, "BEGIN:");
+    icalmemory_strbuf_append_string(sb, cname);
+    icalmemory_strbuf_append(sb, "\r\n", 2);
+
+    if (ckind == ICAL_VCALENDAR_COMPONENT) {
+        icalmemory_strbuf_append_string(sb, "VERSION:1.0\r\n");
+    }
+
+    for (prop = icalcomponent_get_first_property(comp, ICAL_ANY_PROPERTY);
+         prop != 0;
+         prop = icalcomponent_get_next_property(comp, ICAL_ANY_PROPERTY)) {
+        icalvcal_write_property(sb, prop);
+    }
+
+    for (child = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         child != 0;
+         child = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        icalcomponent_kind kind = icalcomponent_isa(child);
+
+        /* vCalendar only nests events and todos */
+        if (kind == ICAL_VEVENT_COMPONENT || kind == ICAL_VTODO_COMPONENT) {
+            icalvcal_write_component(sb, child);
+        }
+    }
+
+    icalmemory_strbuf_append_string(sb, "END:");
+    icalmemory_strbuf_append_string(sb, cname);
+    icalmemory_strbuf_append(sb, "\r\n", 2);
+}
+
+char *icalvcal_as_vcal_string_r(icalcomponent *comp)
+{
+    icalmemory_strbuf sb;
+    icalcomponent *child;
+    size_t estimate;
+
+    icalerror_check_arg_rz((comp != 0), "comp");
+
+    /* Size the builder from the property counts so typical exports
+       never reallocate: one average folded line per property plus the
+       BEGIN/END framing per component */
+    estimate = 64 + 80 * (size_t)icalcomponent_count_properties(comp, ICAL_ANY_PROPERTY);
+    for (child = icalcomponent_get_first_component(comp, ICAL_ANY_COMPONENT);
+         child != 0;
+         child = icalcomponent_get_next_component(comp, ICAL_ANY_COMPONENT)) {
+        estimate += 64 + 80 * (size_t)icalcomponent_count_properties(child, ICAL_ANY_PROPERTY);
+    }
+
+    icalmemory_strbuf_init(&sb, estimate);
+
+    icalvcal_write_component(&sb, comp);
+
+    return icalmemory_strbuf_detach(&sb);
+}
+
 #if 0
 switch (vObjectValueType(object)) {
 case VCVT_USTRINGZ:
@@ -41,4 +41,27 @@ LIBICAL_VCAL_EXPORT icalcomponent *icalvcal_convert(VObject *object);
 LIBICAL_VCAL_EXPORT icalcomponent *icalvcal_convert_with_defaults(VObject *object,
                                                                   icalvcal_defaults * defaults);
 
+/* Fused parse-and-convert over vCalendar data held in memory. Each
+   top-level object is converted the moment the parser finishes it and
+   its VObject tree is freed before the next object is read, so peak
+   memory is one object's tree rather than the whole input's. A single
+   calendar converts to its component as with icalvcal_convert();
+   several are returned inside an XROOT component. Returns NULL on a
+   parse failure or if the input holds no convertible object. */
+
+LIBICAL_VCAL_EXPORT icalcomponent *icalvcal_convert_string(const char *str, size_t len);
+
+LIBICAL_VCAL_EXPORT icalcomponent *icalvcal_convert_string_with_defaults(const char *str,
+                                                                         size_t len,
+                                                                         icalvcal_defaults *
+                                                                         defaults);
+
+/* The reverse direction: emits a VCALENDAR component as vCalendar 1.0
+   text (CRLF lines, VERSION:1.0) straight from the icalcomponent,
+   without building an intermediate VObject tree. Properties whose text
+   representation differs between the formats (RRULE/EXRULE) are
+   omitted; CREATED is written as DCREATED. The caller owns the
+   returned string and must free it with icalmemory_free_buffer(). */
+LIBICAL_VCAL_EXPORT char *icalvcal_as_vcal_string_r(icalcomponent *comp);
+
 #endif /* !ICALVCAL_H */
@@ -53,6 +53,16 @@ extern "C"
 
     LIBICAL_VCAL_EXPORT VObject *Parse_MIME(const char *input, unsigned long len);
 
+    typedef void (*MimeObjectHandler) (VObject *object, void *userData);
+
+/* Streaming variant of Parse_MIME. Each completed top-level object is
+   handed to the handler as soon as the parser reduces it, instead of
+   accumulating on the returned list, so only one object's tree is live
+   at a time. The handler owns the object and should release it with
+   cleanVObject(). Returns 1 on a clean parse, 0 if errors occurred. */
+    LIBICAL_VCAL_EXPORT int Parse_MIME_WithHandler(const char *input, unsigned long len,
+                                                   MimeObjectHandler handler, void *userData);
+
     LIBICAL_VCAL_EXPORT VObject *Parse_MIME_FromFileName(const char *fname);
 
 /* NOTE regarding Parse_MIME_FromFile
@@ -130,12 +130,22 @@ DFARS 252.227-7013 or 48 CFR 52.227-19, as applicable.
 
 
 /****  Global Variables  ****/
-int mime_lineNum, mime_numErrors; /* yyerror() can use these */
-static VObject* vObjList;
-static VObject *curProp;
-static VObject *curObj;
-static VObject* ObjStack[MAXLEVEL];
-static int ObjStackTop;
+/* All of the parser's working state is thread-local (see vobject.h)
+   so each thread can run its own Parse_MIME* call concurrently. If
+   vcc.c is ever regenerated, the generated parser's own state
+   (yychar, yylval, yystack, ...) must be marked VCAL_THREAD_LOCAL by
+   hand as well. */
+VCAL_THREAD_LOCAL int mime_lineNum, mime_numErrors; /* yyerror() can use these */
+static VCAL_THREAD_LOCAL VObject* vObjList;
+static VCAL_THREAD_LOCAL VObject *curProp;
+static VCAL_THREAD_LOCAL VObject *curObj;
+static VCAL_THREAD_LOCAL VObject* ObjStack[MAXLEVEL];
+static VCAL_THREAD_LOCAL int ObjStackTop;
+
+/* When set, completed top-level objects are handed to this handler as
+   they are reduced, instead of accumulating on vObjList. */
+static VCAL_THREAD_LOCAL MimeObjectHandler mimeObjectHandler;
+static VCAL_THREAD_LOCAL void* mimeObjectHandlerData;
 
 
 /* A helpful utility for the rest of the app. */
@@ -189,6 +199,7 @@ static void mime_error_(const char *s);
 static VObject* Parse_MIMEHelper(void);
 static VObject* popVObject(void);
 static int pushVObject(const char *prop);
+static void emitVObject(VObject *o);
 
 %}
 
@@ -227,10 +238,10 @@ mime: vobjects
         ;
 
 vobjects: vobject
-        { addList(&vObjList, $1); curObj = 0; }
+        { emitVObject($1); curObj = 0; }
         vobjects
         | vobject
-                { addList(&vObjList, $1); curObj = 0; }
+                { emitVObject($1); curObj = 0; }
         ;
 
 vobject: vcard
@@ -447,7 +458,7 @@ static void enterValues(const char *value)
                 snprintf(p2,i,"%s;%s",p1,value);
                 deleteStr(p1);
                 p3 = (wchar_t *) vObjectUStringZValue(curProp);
-                free(p3);
+                deleteStr((char *)p3);
                 setVObjectUStringZValue_(curProp,fakeUnicode(p2,0));
                 free(p2);
             } else {
@@ -490,7 +501,7 @@ static void enterAttr(const char *s1, const char *s2)
 #define MAX_LEX_MODE_STACK_SIZE 10
 #define LEXMODE() (lexBuf.lexModeStack[lexBuf.lexModeStackTop])
 
-struct LexBuf {
+static VCAL_THREAD_LOCAL struct LexBuf {
         /* input */
 #ifdef INCLUDEMFC
     CFile *inputFile;
@@ -1134,12 +1145,34 @@ static VObject* Parse_MIMEHelper()
     return vObjList;
     }
 
+static void emitVObject(VObject *o)
+    {
+    if (mimeObjectHandler)
+        mimeObjectHandler(o, mimeObjectHandlerData);
+    else
+        addList(&vObjList, o);
+    }
+
 VObject* Parse_MIME(const char *input, unsigned long len)
     {
     initLex(input, len, 0);
     return Parse_MIMEHelper();
     }
 
+int Parse_MIME_WithHandler(const char *input, unsigned long len,
+        MimeObjectHandler handler, void *userData)
+    {
+    initLex(input, len, 0);
+    mimeObjectHandler = handler;
+    mimeObjectHandlerData = userData;
+    /* with a handler installed Parse_MIMEHelper accumulates nothing,
+       so success is a clean parse rather than a non-empty list */
+    (void)Parse_MIMEHelper();
+    mimeObjectHandler = 0;
+    mimeObjectHandlerData = 0;
+    return mime_numErrors == 0;
+    }
+
 
 #ifdef INCLUDEMFC
 
@@ -47,6 +47,9 @@ DFARS 252.227-7013 or 48 CFR 52.227-19, as applicable.
 #endif
 
 #include "vobject.h"
+#include "icalmemory.h"
+
+#include <ctype.h>
 
 #define NAME_OF(o)                      o->id
 #define VALUE_TYPE(o)                   o->valType
@@ -70,6 +73,7 @@ struct VObject {
     VObject *next;
     const char *id;
     VObject *prop;
+    struct ChildIndex *idx;     /* lazy name index, see isAPropertyOf */
     unsigned short valType;
     ValueItem val;
     };
@@ -82,7 +86,7 @@ struct StrItem {
     unsigned int refCnt;
     };
 
-const char** fieldedProp;
+VCAL_THREAD_LOCAL const char **fieldedProp;
 
 
 
@@ -94,14 +98,20 @@ const char** fieldedProp;
         deleteStr
         newStrItem
         deleteStrItem
+
+   They allocate through icalmemory so an installed thread arena
+   (icalmemory_set_arena) backs the whole VObject tree; without an
+   arena they behave exactly like malloc/free. Free the tree with
+   cleanVObject before releasing the arena.
    ----------------------------------------------------------------------*/
 
 static VObject* newVObject_(const char *id)
 {
-    VObject *p = (VObject*)malloc(sizeof(VObject));
+    VObject *p = (VObject*)icalmemory_new_buffer(sizeof(VObject));
     p->next = 0;
     p->id = id;
     p->prop = 0;
+    p->idx = 0;
     VALUE_TYPE(p) = 0;
     ANY_VALUE_OF(p) = 0;
     return p;
@@ -118,7 +128,9 @@ void deleteVObject(VObject *p)
         return;
     if (p->id)
         unUseStr(p->id);
-    free(p);
+    if (p->idx)
+        icalmemory_free_buffer(p->idx);
+    icalmemory_free_buffer(p);
 }
 
 char* dupStr(const char *s, size_t size)
@@ -127,7 +139,7 @@ char* dupStr(const char *s, size_t size)
     if  (size == 0) {
         size = strlen(s);
         }
-    t = (char*)malloc(size+1);
+    t = (char*)icalmemory_new_buffer(size+1);
     if (t) {
         memcpy(t,s,size);
         t[size] = 0;
@@ -141,13 +153,13 @@ char* dupStr(const char *s, size_t size)
 void deleteStr(const char *p)
 {
     if (p)
-        free((void*)p);
+        icalmemory_free_buffer((void*)p);
 }
 
 
 static StrItem* newStrItem(const char *s, StrItem *next)
 {
-    StrItem *p = (StrItem*)malloc(sizeof(StrItem));
+    StrItem *p = (StrItem*)icalmemory_new_buffer(sizeof(StrItem));
     p->next = next;
     p->s = s;
     p->refCnt = 1;
@@ -157,7 +169,7 @@ static StrItem* newStrItem(const char *s, StrItem *next)
 static void deleteStrItem(StrItem *p)
 {
     if (p)
-        free((void*)p);
+        icalmemory_free_buffer((void*)p);
 }
 
 
@@ -289,6 +301,13 @@ VObject* addVObjectProp(VObject *o, VObject *p)
     */
 
     VObject *tail = o->prop;
+
+    if (o->idx) {
+        /* the child list is changing; drop the stale name index */
+        icalmemory_free_buffer(o->idx);
+        o->idx = 0;
+        }
+
     if (tail) {
         p->next = tail->next;
         o->prop = tail->next = p;
@@ -376,16 +395,91 @@ VObject* nextVObject(VObjectIterator *i)
     else return (VObject*)0;
 }
 
+/* Lazily-built name index over a VObject's children. isAPropertyOf
+   builds it once a lookup has to walk CHILD_INDEX_THRESHOLD or more
+   children, and addVObjectProp drops it whenever the list changes, so
+   field lookup on large records (50+ field contact cards) stops
+   growing with the number of fields. Names hash case-insensitively;
+   a probe still confirms with strcasecmp. */
+#define CHILD_INDEX_THRESHOLD 16
+
+typedef struct ChildIndex {
+    unsigned int size;          /* power of two */
+    VObject *slots[1];
+    } ChildIndex;
+
+static unsigned int hashName(const char *s)
+{
+    unsigned int h = 0;
+    int i;
+    for (i = 0; s[i]; i++) {
+        h = h*31 + (unsigned int)tolower((unsigned char)s[i]);
+        }
+    return h;
+}
+
+static void buildChildIndex(VObject *o, unsigned int count)
+{
+    ChildIndex *idx;
+    unsigned int size = CHILD_INDEX_THRESHOLD;
+    VObjectIterator it;
+
+    while (size < count * 2)
+        size <<= 1;
+
+    idx = (ChildIndex*)icalmemory_new_buffer(
+        sizeof(ChildIndex) + (size - 1) * sizeof(VObject*));
+    if (idx == 0)
+        return;
+    idx->size = size;
+    memset(idx->slots, 0, size * sizeof(VObject*));
+
+    initPropIterator(&it,o);
+    while (moreIteration(&it)) {
+        VObject *each = nextVObject(&it);
+        unsigned int slot = hashName(each->id) & (size - 1);
+        while (idx->slots[slot]) {
+            if (!strcasecmp(idx->slots[slot]->id, each->id))
+                break;          /* keep the first child with this name */
+            slot = (slot + 1) & (size - 1);
+            }
+        if (idx->slots[slot] == 0)
+            idx->slots[slot] = each;
+        }
+    o->idx = idx;
+}
+
 VObject* isAPropertyOf(VObject *o, const char *id)
 {
     VObjectIterator i;
+    VObject *match = 0;
+    unsigned int seen = 0;
+
+    if (o->idx) {
+        unsigned int slot = hashName(id) & (o->idx->size - 1);
+        while (o->idx->slots[slot]) {
+            if (!strcasecmp(id, o->idx->slots[slot]->id))
+                return o->idx->slots[slot];
+            slot = (slot + 1) & (o->idx->size - 1);
+            }
+        return (VObject*)0;
+        }
+
     initPropIterator(&i,o);
     while (moreIteration(&i)) {
         VObject *each = nextVObject(&i);
-        if (!strcasecmp(id,each->id))
-            return each;
+        if (match == 0 && !strcasecmp(id,each->id)) {
+            if (seen < CHILD_INDEX_THRESHOLD)
+                return each;    /* short scan; not worth indexing */
+            match = each;
+            }
+        seen++;
         }
-    return (VObject*)0;
+
+    if (seen >= CHILD_INDEX_THRESHOLD)
+        buildChildIndex(o, seen);
+
+    return match;
 }
 
 VObject* addGroup(VObject *o, const char *g)
@@ -597,8 +691,8 @@ void cleanVObject(VObject *o)
         case VCVT_USTRINGZ:
         case VCVT_STRINGZ:
         case VCVT_RAW:
-                /* assume they are all allocated by malloc. */
-            free((char*)STRINGZ_VALUE_OF(o));
+                /* values are all allocated through icalmemory. */
+            icalmemory_free_buffer((char*)STRINGZ_VALUE_OF(o));
             break;
         case VCVT_VOBJECT:
             cleanVObject(VOBJECT_VALUE_OF(o));
@@ -622,7 +716,7 @@ void cleanVObjects(VObject *list)
 
 #define STRTBLSIZE 255
 
-static StrItem *strTbl[STRTBLSIZE];
+static VCAL_THREAD_LOCAL StrItem *strTbl[STRTBLSIZE];
 
 static unsigned int hashStr(const char *s)
 {
@@ -1085,12 +1179,48 @@ static void appendcOFile(OFile *fp, char c)
         appendcOFile_(fp,c);
 }
 
+/* Bulk form of appendcOFile_: one fwrite or memcpy per run instead of
+   a call per character */
+static void appendnOFile_(OFile *fp, const char *s, size_t n)
+{
+    if (fp->fail) return;
+    if (n == 0) return;
+    if (fp->fp) {
+        fwrite(s,1,n,fp->fp);
+        }
+    else {
+stuff:
+        if (fp->len+(int)n < fp->limit) {
+            memcpy(fp->s+fp->len,s,n);
+            fp->len += (int)n;
+            return;
+            }
+        else if (fp->alloc) {
+            fp->limit = fp->limit + OFILE_REALLOC_SIZE;
+            if (OFILE_REALLOC_SIZE <= (int)n) fp->limit += (int)n;
+            fp->s = realloc(fp->s,(size_t)fp->limit);
+            if (fp->s) goto stuff;
+            }
+        if (fp->alloc)
+            free(fp->s);
+        fp->s = 0;
+        fp->fail = 1;
+        }
+}
+
 static void appendsOFile(OFile *fp, const char *s)
 {
-    size_t i, slen;
-    slen  = strlen(s);
-    for (i=0; i<slen; i++) {
-        appendcOFile(fp,s[i]);
+    /* Copy whole newline-free runs at once; only the newlines need the
+       per-character <CR><LF> translation */
+    while (*s) {
+        const char *nl = strchr(s,'\n');
+        if (nl == 0) {
+            appendnOFile_(fp,s,strlen(s));
+            break;
+            }
+        appendnOFile_(fp,s,(size_t)(nl-s));
+        appendcOFile(fp,'\n');
+        s = nl+1;
         }
 }
 
@@ -1419,7 +1549,7 @@ wchar_t* fakeUnicode(const char *ps, size_t *bytes)
     wchar_t *r, *pw;
     size_t len = strlen(ps)+1;
 
-    pw = r = (wchar_t*)malloc(sizeof(wchar_t)*len);
+    pw = r = (wchar_t*)icalmemory_new_buffer(sizeof(wchar_t)*len);
     if (bytes)
         *bytes = len * sizeof(wchar_t);
 
@@ -1458,7 +1588,7 @@ char* fakeCString(const wchar_t *u)
         return NULL;
 
     len = (size_t)(uStrLen(u) + 1);
-    t = s = (char*)malloc(len);
+    t = s = (char*)icalmemory_new_buffer(len);
     while (*u) {
         if (*u == (wchar_t)0x2028)
             *t = '\n';
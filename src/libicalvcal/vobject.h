@@ -73,6 +73,22 @@ which accompanied this distribution.
 #include <stdlib.h>
 #include <stdio.h>
 
+/* The parser and builder keep their working state in thread-local
+   variables, so each thread may run its own Parse_MIME* call
+   concurrently. On toolchains without any thread-local support the
+   state falls back to plain globals and parsing is single-threaded,
+   as it always was. */
+#if defined(__GNUC__) || defined(__clang__)
+#define VCAL_THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) && \
+    !defined(__STDC_NO_THREADS__)
+#define VCAL_THREAD_LOCAL _Thread_local
+#elif defined(_MSC_VER)
+#define VCAL_THREAD_LOCAL __declspec(thread)
+#else
+#define VCAL_THREAD_LOCAL
+#endif
+
 #if defined(__CPLUSPLUS__) || defined(__cplusplus)
 extern "C"
 {
@@ -332,7 +348,7 @@ extern "C"
 #define VCVT_VOBJECT    6
     /* if the VObject has value set by setVObjectVObjectValue. */
 
-    extern const char **fieldedProp;
+    extern VCAL_THREAD_LOCAL const char **fieldedProp;
 
 /* NOTE regarding printVObject and writeVObject
 
@@ -0,0 +1,295 @@
+/*======================================================================
+ FILE: icalbench.c
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+
+ Parser and serializer throughput benchmark. Runs
+ icalparser_parse_string() and icalcomponent_as_ical_string_r() over
+ every .ics file in a corpus directory (TEST_DATADIR by default) plus a
+ large synthetic calendar, and reports lines/sec, components/sec, MB/sec,
+ allocations per component and peak RSS so parser and serializer
+ regressions can be quantified between releases.
+
+ Usage: icalbench [corpus-directory] [seconds-per-corpus]
+======================================================================*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "libical/ical.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+
+#define SYNTHETIC_EVENTS 20000
+#define DEFAULT_SECONDS_PER_CORPUS 2.0
+
+struct corpus
+{
+    char *data;
+    size_t size;
+    long lines;
+};
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+static long peak_rss_kb(void)
+{
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+    /* ru_maxrss is in kilobytes on Linux and bytes on macOS */
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+static long count_lines(const char *data)
+{
+    long lines = 0;
+
+    for (; *data != '\0'; data++) {
+        if (*data == '\n') {
+            lines++;
+        }
+    }
+
+    return lines;
+}
+
+static int read_file(const char *path, struct corpus *corpus)
+{
+    FILE *f;
+    long size;
+
+    if ((f = fopen(path, "rb")) == 0) {
+        fprintf(stderr, "icalbench: cannot open %s\n", path);
+        return -1;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+
+    corpus->data = (char *)malloc((size_t)size + 1);
+    if (corpus->data == 0 || fread(corpus->data, 1, (size_t)size, f) != (size_t)size) {
+        free(corpus->data);
+        corpus->data = 0;
+        fclose(f);
+        return -1;
+    }
+
+    fclose(f);
+    corpus->data[size] = '\0';
+    corpus->size = (size_t)size;
+    corpus->lines = count_lines(corpus->data);
+
+    return 0;
+}
+
+/* One large calendar with many small events, approximating a loaded
+   production dataset better than the small test-data files do */
+static void build_synthetic(struct corpus *corpus)
+{
+    char *buf, *pos;
+    size_t buf_size = 1024;
+    char temp[256];
+    int i;
+
+    buf = icalmemory_new_buffer(buf_size);
+    pos = buf;
+    *pos = '\0';
+
+    icalmemory_append_string(&buf, &pos, &buf_size, "BEGIN:VCALENDAR\r\nVERSION:2.0\r\n");
+
+    for (i = 0; i < SYNTHETIC_EVENTS; i++) {
+        snprintf(temp, sizeof(temp),
+                 "BEGIN:VEVENT\r\n"
+                 "UID:bench-%d@example.com\r\n"
+                 "DTSTAMP:20250101T000000Z\r\n"
+                 "DTSTART;TZID=America/New_York:20250101T%02d%02d00\r\n"
+                 "DTEND;TZID=America/New_York:20250101T%02d%02d00\r\n"
+                 "SUMMARY:Benchmark event %d\r\n"
+                 "END:VEVENT\r\n",
+                 i, i % 24, i % 60, (i + 1) % 24, i % 60, i);
+        icalmemory_append_string(&buf, &pos, &buf_size, temp);
+    }
+
+    icalmemory_append_string(&buf, &pos, &buf_size, "END:VCALENDAR\r\n");
+
+    corpus->data = buf;
+    corpus->size = (size_t)(pos - buf);
+    corpus->lines = count_lines(buf);
+}
+
+static long count_components(icalcomponent *c)
+{
+    icalcomponent *inner;
+    long count = 1;
+
+    for (inner = icalcomponent_get_first_component(c, ICAL_ANY_COMPONENT);
+         inner != 0; inner = icalcomponent_get_next_component(c, ICAL_ANY_COMPONENT)) {
+        count += count_components(inner);
+    }
+
+    return count;
+}
+
+/* Parses the corpus repeatedly for at least min_seconds and prints one
+   result row */
+static void bench_corpus(const char *name, const struct corpus *corpus, double min_seconds)
+{
+    double start, elapsed;
+    long iterations = 0;
+    long components = 0;
+
+    start = now_seconds();
+    do {
+        icalcomponent *c = icalparser_parse_string(corpus->data);
+
+        if (c != 0) {
+            if (iterations == 0) {
+                components = count_components(c);
+            }
+            icalcomponent_free(c);
+        }
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+
+    printf("%-28s %8ld iters %12.0f lines/sec %10.1f comps/sec %10.2f MB/sec\n",
+           name, iterations,
+           (double)corpus->lines * (double)iterations / elapsed,
+           (double)components * (double)iterations / elapsed,
+           (double)corpus->size * (double)iterations / elapsed / (1024.0 * 1024.0));
+}
+
+/* Serializes the parsed corpus repeatedly for at least min_seconds and
+   prints one result row, including allocator traffic per component from
+   the icalmemory counters */
+static void bench_serialize(const char *name, const struct corpus *corpus, double min_seconds)
+{
+    struct icalmemory_stats before, after;
+    icalcomponent *c;
+    double start, elapsed;
+    double bytes = 0;
+    long iterations = 0;
+    long components;
+
+    c = icalparser_parse_string(corpus->data);
+    if (c == 0) {
+        return;
+    }
+    components = count_components(c);
+
+    icalmemory_get_stats(&before);
+    start = now_seconds();
+    do {
+        char *str = icalcomponent_as_ical_string_r(c);
+
+        if (str != 0) {
+            bytes += (double)strlen(str);
+            icalmemory_free_buffer(str);
+        }
+        iterations++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < min_seconds);
+    icalmemory_get_stats(&after);
+
+    printf("%-28s %8ld iters %37.2f MB/sec %7.1f allocs/comp\n",
+           name, iterations,
+           bytes / elapsed / (1024.0 * 1024.0),
+           (double)((after.allocs - before.allocs) + (after.reallocs - before.reallocs)) /
+               ((double)components * (double)iterations));
+
+    icalcomponent_free(c);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *datadir = TEST_DATADIR;
+    double min_seconds = DEFAULT_SECONDS_PER_CORPUS;
+    struct corpus corpus;
+    DIR *dir;
+    struct dirent *entry;
+    char path[2048];
+    int files = 0;
+
+    if (argc > 1) {
+        datadir = argv[1];
+    }
+    if (argc > 2) {
+        min_seconds = atof(argv[2]);
+        if (min_seconds <= 0) {
+            fprintf(stderr, "usage: %s [corpus-directory] [seconds-per-corpus]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* The error logs from intentionally malformed corpus files are not
+       interesting here */
+    icalerror_set_errors_are_fatal(0);
+    icalerrno = ICAL_NO_ERROR;
+
+    if ((dir = opendir(datadir)) == 0) {
+        fprintf(stderr, "icalbench: cannot open corpus directory %s\n", datadir);
+        return 1;
+    }
+
+    printf("Corpus: %s, %.1f seconds per file\n\n", datadir, min_seconds);
+
+    while ((entry = readdir(dir)) != 0) {
+        size_t len = strlen(entry->d_name);
+
+        if (len < 4 || strcmp(entry->d_name + len - 4, ".ics") != 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", datadir, entry->d_name);
+        if (read_file(path, &corpus) != 0) {
+            continue;
+        }
+
+        bench_corpus(entry->d_name, &corpus, min_seconds);
+        bench_serialize(entry->d_name, &corpus, min_seconds);
+        free(corpus.data);
+        files++;
+    }
+
+    closedir(dir);
+
+    build_synthetic(&corpus);
+    bench_corpus("synthetic-20k-events", &corpus, min_seconds);
+    bench_serialize("synthetic-20k-events", &corpus, min_seconds);
+    icalmemory_free_buffer(corpus.data);
+
+    printf("\n%d corpus files, peak RSS %ld KB\n", files, peak_rss_kb());
+
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*======================================================================
+ FILE: icalgen.c
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+
+ Deterministic synthetic calendar generator. Produces parameterized
+ calendars — event count, recurring fraction, EXDATE density, attendee
+ counts, timezone mix from the builtin zoneinfo table — from a fixed
+ seed, so the benchmark harness and capacity tests can regenerate
+ identical datasets instead of shipping multi-GB fixtures. Events are
+ built with icalcomponent_vanew and the derived property constructors,
+ then serialized and freed one at a time so output size is not bounded
+ by memory.
+
+ Usage: icalgen [-n events] [-r recurring%] [-x exdate%] [-a attendees]
+                [-z timezones] [-s seed] [-o file]
+======================================================================*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "libical/ical.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct gen_params
+{
+    long n_events;      /* -n: total number of VEVENTs */
+    int pct_recurring;  /* -r: percent of events carrying an RRULE */
+    int pct_exdate;     /* -x: percent of recurring events with EXDATEs */
+    int n_attendees;    /* -a: attendees per event */
+    int n_zones;        /* -z: distinct timezones to cycle through (0 = UTC) */
+    unsigned long seed; /* -s: PRNG seed */
+};
+
+/* Local PRNG so identical seeds give identical calendars on every
+   platform; rand() makes no such promise */
+static unsigned long gen_rand_state = 1;
+
+static unsigned long gen_rand(void)
+{
+    gen_rand_state = gen_rand_state * 6364136223846793005UL + 1442695040888963407UL;
+    return (gen_rand_state >> 33);
+}
+
+static const char *gen_summaries[] = {
+    "Team sync", "Project review", "One on one", "Design discussion",
+    "Planning", "Retrospective", "Customer call", "Interview",
+};
+
+#define GEN_NUM_SUMMARIES (sizeof(gen_summaries) / sizeof(gen_summaries[0]))
+
+/* The zones actually used, in cycling order, chosen deterministically
+   from the builtin zoneinfo table */
+static icaltimezone **gen_pick_zones(int n_zones)
+{
+    icalarray *builtin = icaltimezone_get_builtin_timezones();
+    icaltimezone **zones;
+    size_t count;
+    int i;
+
+    if (n_zones <= 0 || builtin == 0 || (count = builtin->num_elements) == 0) {
+        return 0;
+    }
+
+    zones = (icaltimezone **) malloc((size_t)n_zones * sizeof(icaltimezone *));
+    if (zones == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < n_zones; i++) {
+        /* spread picks across the table rather than clustering at the top */
+        size_t index = ((size_t)i * 7919) % count;
+
+        zones[i] = (icaltimezone *) icalarray_element_at(builtin, index);
+    }
+
+    return zones;
+}
+
+static icalcomponent *gen_event(const struct gen_params *params, long index,
+                                icaltimezone **zones)
+{
+    icalcomponent *event;
+    struct icaltimetype dtstart, dtend;
+    char uid[64];
+    icaltimezone *zone = 0;
+    int i;
+
+    if (zones != 0) {
+        zone = zones[index % params->n_zones];
+    }
+
+    if (zone == 0) {
+        dtstart = icaltime_from_string("20250101T090000Z");
+    } else {
+        dtstart = icaltime_from_string("20250101T090000");
+        dtstart.zone = zone;
+    }
+    icaltime_adjust(&dtstart, (int)(gen_rand() % 365), (int)(gen_rand() % 10), 0, 0);
+    dtend = dtstart;
+    icaltime_adjust(&dtend, 0, 1, 0, 0);
+
+    snprintf(uid, sizeof(uid), "icalgen-%lu-%ld@example.com", params->seed, index);
+
+    event = icalcomponent_vanew(
+        ICAL_VEVENT_COMPONENT,
+        icalproperty_new_uid(uid),
+        icalproperty_new_dtstamp(icaltime_from_string("20250101T000000Z")),
+        icalproperty_new_summary(gen_summaries[gen_rand() % GEN_NUM_SUMMARIES]),
+        (void *)0);
+
+    if (zone != 0) {
+        icalcomponent_add_property(
+            event,
+            icalproperty_vanew_dtstart(
+                dtstart,
+                icalparameter_new_tzid(icaltimezone_get_tzid(zone)), (void *)0));
+        icalcomponent_add_property(
+            event,
+            icalproperty_vanew_dtend(
+                dtend, icalparameter_new_tzid(icaltimezone_get_tzid(zone)), (void *)0));
+    } else {
+        icalcomponent_add_property(event, icalproperty_new_dtstart(dtstart));
+        icalcomponent_add_property(event, icalproperty_new_dtend(dtend));
+    }
+
+    if ((int)(gen_rand() % 100) < params->pct_recurring) {
+        struct icalrecurrencetype rrule =
+            icalrecurrencetype_from_string("FREQ=WEEKLY;COUNT=52");
+
+        icalcomponent_add_property(event, icalproperty_new_rrule(rrule));
+
+        if ((int)(gen_rand() % 100) < params->pct_exdate) {
+            struct icaltimetype exdate = dtstart;
+
+            icaltime_adjust(&exdate, 7 * (int)(1 + gen_rand() % 51), 0, 0, 0);
+            icalcomponent_add_property(event, icalproperty_new_exdate(exdate));
+        }
+    }
+
+    for (i = 0; i < params->n_attendees; i++) {
+        char mailto[64], cn[32];
+
+        snprintf(mailto, sizeof(mailto), "mailto:attendee-%lu@example.com", gen_rand() % 1000);
+        snprintf(cn, sizeof(cn), "Attendee %d", i);
+
+        icalcomponent_add_property(
+            event,
+            icalproperty_vanew_attendee(
+                mailto,
+                icalparameter_new_cn(cn),
+                icalparameter_new_role(ICAL_ROLE_REQPARTICIPANT), (void *)0));
+    }
+
+    return event;
+}
+
+static int gen_calendar(const struct gen_params *params, FILE *out)
+{
+    icaltimezone **zones = gen_pick_zones(params->n_zones);
+    long index;
+    int i;
+
+    fputs("BEGIN:VCALENDAR\r\n"
+          "VERSION:2.0\r\n"
+          "PRODID:-//libical//NONSGML icalgen//EN\r\n", out);
+
+    /* One VTIMEZONE per zone in the mix, ahead of the events */
+    for (i = 0; zones != 0 && i < params->n_zones; i++) {
+        icalcomponent *vtz = icaltimezone_get_component(zones[i]);
+
+        if (vtz != 0) {
+            char *str = icalcomponent_as_ical_string_r(vtz);
+
+            fputs(str, out);
+            icalmemory_free_buffer(str);
+        }
+    }
+
+    for (index = 0; index < params->n_events; index++) {
+        icalcomponent *event = gen_event(params, index, zones);
+        char *str = icalcomponent_as_ical_string_r(event);
+
+        fputs(str, out);
+        icalmemory_free_buffer(str);
+        icalcomponent_free(event);
+    }
+
+    fputs("END:VCALENDAR\r\n", out);
+    free(zones);
+
+    return ferror(out) ? -1 : 0;
+}
+
+static void usage(const char *progname)
+{
+    fprintf(stderr,
+            "usage: %s [-n events] [-r recurring%%] [-x exdate%%] [-a attendees]\n"
+            "          [-z timezones] [-s seed] [-o file]\n", progname);
+}
+
+int main(int argc, char *argv[])
+{
+    struct gen_params params;
+    const char *outfile = 0;
+    FILE *out = stdout;
+    int arg, failed;
+
+    params.n_events = 100;
+    params.pct_recurring = 20;
+    params.pct_exdate = 10;
+    params.n_attendees = 0;
+    params.n_zones = 0;
+    params.seed = 1;
+
+    for (arg = 1; arg + 1 < argc; arg += 2) {
+        if (strcmp(argv[arg], "-n") == 0) {
+            params.n_events = atol(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-r") == 0) {
+            params.pct_recurring = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-x") == 0) {
+            params.pct_exdate = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-a") == 0) {
+            params.n_attendees = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-z") == 0) {
+            params.n_zones = atoi(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            params.seed = (unsigned long)atol(argv[arg + 1]);
+        } else if (strcmp(argv[arg], "-o") == 0) {
+            outfile = argv[arg + 1];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (arg != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    if (outfile != 0 && (out = fopen(outfile, "wb")) == 0) {
+        fprintf(stderr, "icalgen: cannot open %s for writing\n", outfile);
+        return 1;
+    }
+
+#if defined(TEST_ZONEDIR)
+    set_zone_directory(TEST_ZONEDIR);
+#endif
+
+    gen_rand_state = params.seed;
+    failed = gen_calendar(&params, out) != 0;
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return failed;
+}
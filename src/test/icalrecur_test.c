@@ -26,6 +26,11 @@
 
 #include <libical/ical.h>
 #include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/time.h>
+#endif
 
 #if defined(HAVE_LIBICU)
 #include <unicode/ucal.h>
@@ -569,6 +574,96 @@ const struct recur rscale[] = {
     {NULL, NULL, NULL}
 };
 
+#if !defined(_WIN32)
+
+/* Benchmark rules, one per RRULE category we care about; each is
+   expanded over a 10-year span */
+static const struct recur bench_rules[] = {
+    {"20150101T090000Z", "FREQ=DAILY", NULL},
+    {"20150101T090000Z", "FREQ=DAILY;BYHOUR=9,12,15", NULL},
+    {"20150105T090000Z", "FREQ=WEEKLY;BYDAY=MO,TU,WE,TH,FR", NULL},
+    {"20150113T090000Z", "FREQ=MONTHLY;BYDAY=2TU", NULL},
+    {"20150130T090000Z", "FREQ=MONTHLY;BYDAY=MO,TU,WE,TH,FR;BYSETPOS=-1", NULL},
+    {"20150308T090000Z", "FREQ=YEARLY;BYMONTH=3;BYDAY=2SU", NULL},
+    {"20150101T090000Z", "FREQ=YEARLY;BYYEARDAY=1,100,200", NULL},
+    {NULL, NULL, NULL}
+};
+
+static double now_seconds(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, 0);
+    return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* Times iterator construction and per-occurrence cost for each rule
+   category so regressions in the by-filter chain show up as numbers */
+static int run_benchmark(double seconds_per_rule)
+{
+    const struct recur *r;
+
+    printf("%-44s %14s %14s %10s\n",
+           "RRULE", "ns/construct", "ns/occurrence", "occ/10y");
+
+    for (r = bench_rules; r->rrule; r++) {
+        struct icalrecurrencetype rrule = icalrecurrencetype_from_string(r->rrule);
+        struct icaltimetype dtstart = icaltime_from_string(r->dtstart);
+        struct icaltimetype end = dtstart;
+        double start_time, elapsed, construct_seconds;
+        long constructions = 0, expansions = 0, occurrences = 0;
+        icalrecur_iterator *ritr;
+
+        end.year += 10;
+
+        /* Phase 1: iterator construction alone */
+        start_time = now_seconds();
+        do {
+            ritr = icalrecur_iterator_new(rrule, dtstart);
+            icalrecur_iterator_free(ritr);
+            constructions++;
+            elapsed = now_seconds() - start_time;
+        } while (elapsed < seconds_per_rule / 2);
+        construct_seconds = elapsed / (double)constructions;
+
+        /* Phase 2: full expansion of the 10-year span */
+        start_time = now_seconds();
+        do {
+            struct icaltimetype next;
+
+            ritr = icalrecur_iterator_new(rrule, dtstart);
+            if (!ritr) {
+                fprintf(stderr, "cannot build iterator for %s\n", r->rrule);
+                return 1;
+            }
+            icalrecur_iterator_set_end(ritr, end);
+
+            for (next = icalrecur_iterator_next(ritr);
+                 !icaltime_is_null_time(next);
+                 next = icalrecur_iterator_next(ritr)) {
+                occurrences++;
+            }
+
+            icalrecur_iterator_free(ritr);
+            expansions++;
+            elapsed = now_seconds() - start_time;
+        } while (elapsed < seconds_per_rule / 2);
+
+        printf("%-44s %14.0f %14.1f %10ld\n",
+               r->rrule,
+               construct_seconds * 1e9,
+               (elapsed - construct_seconds * (double)expansions) * 1e9 /
+                   (double)occurrences,
+               occurrences / expansions);
+
+        free(rrule.rscale);
+    }
+
+    return 0;
+}
+
+#endif
+
 int main(int argc, char *argv[])
 {
     int opt;
@@ -583,7 +678,7 @@ int main(int argc, char *argv[])
         return (1);
     }
 
-    while ((opt = getopt(argc, argv, "rv")) != EOF) {
+    while ((opt = getopt(argc, argv, "rvb")) != EOF) {
         switch (opt) {
         case 'r':      /* Do RSCALE tests */
             r = rscale;
@@ -593,8 +688,14 @@ int main(int argc, char *argv[])
             verbose = 1;
             break;
 
+#if !defined(_WIN32)
+        case 'b':      /* Benchmark the iterator instead of testing it */
+            fclose(fp);
+            return run_benchmark((argc > optind) ? atof(argv[optind]) : 1.0);
+#endif
+
         default:
-            fprintf(stderr, "usage: %s [-r]\n", argv[0]);
+            fprintf(stderr, "usage: %s [-r] [-b [seconds-per-rule]]\n", argv[0]);
             fclose(fp);
             return (1);
             break;
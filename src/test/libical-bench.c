@@ -0,0 +1,406 @@
+/*======================================================================
+ FILE: libical-bench.c
+
+ This library is free software; you can redistribute it and/or modify
+ it under the terms of either:
+
+    The LGPL as published by the Free Software Foundation, version
+    2.1, available at: https://www.gnu.org/licenses/lgpl-2.1.html
+
+ Or:
+
+    The Mozilla Public License Version 2.0. You may obtain a copy of
+    the License at https://www.mozilla.org/MPL/
+
+ Library-wide benchmark harness. Where icalbench measures raw parser and
+ serializer throughput over a corpus directory, this runs a registry of
+ micro- and macro-benchmarks across the library — parse, serialize,
+ recurrence expansion, timezone conversion, spanlist queries and fileset
+ commits — against stable inputs from test-data/, and reports ns/op and
+ allocations/op (from the icalmemory counters) per benchmark.
+
+ Usage: libical-bench [--json|--csv] [seconds-per-benchmark]
+
+ The default output is a human-readable table; --json and --csv emit the
+ same numbers machine-readably for tracking across revisions.
+======================================================================*/
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "libical/ical.h"
+#include "libicalss/icalss.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define BENCH_FILESET_PATH "libical-bench-fileset.ics"
+#define BENCH_SPAN_EVENTS 100
+#define DEFAULT_SECONDS_PER_BENCH 1.0
+#define MAX_ITERS (1L << 24)
+
+struct bench_ctx
+{
+    char *corpus;               /* calendar.ics, for the parse benchmark */
+    icalcomponent *parsed;      /* pre-parsed corpus, for serialization */
+    struct icalrecurrencetype rrule;
+    struct icaltimetype dtstart;
+    struct icaltimetype convert_time;
+    icaltimezone *convert_zone;
+    icalset *fileset;           /* populated fileset for spanlist/commit */
+};
+
+struct bench_case
+{
+    const char *name;
+    void (*fn) (struct bench_ctx *ctx, long iters);
+};
+
+struct bench_result
+{
+    const char *name;
+    long iters;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+static long long now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static char *read_corpus(const char *path)
+{
+    FILE *f;
+    long size;
+    char *data;
+
+    if ((f = fopen(path, "rb")) == 0) {
+        fprintf(stderr, "libical-bench: cannot open %s\n", path);
+        return 0;
+    }
+
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) < 0 || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return 0;
+    }
+
+    data = (char *)malloc((size_t)size + 1);
+    if (data == 0 || fread(data, 1, (size_t)size, f) != (size_t)size) {
+        free(data);
+        fclose(f);
+        return 0;
+    }
+
+    fclose(f);
+    data[size] = '\0';
+
+    return data;
+}
+
+/* ---- the registry ---- */
+
+static void bench_parse(struct bench_ctx *ctx, long iters)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        icalcomponent *c = icalparser_parse_string(ctx->corpus);
+
+        if (c != 0) {
+            icalcomponent_free(c);
+        }
+    }
+}
+
+static void bench_serialize(struct bench_ctx *ctx, long iters)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        char *str = icalcomponent_as_ical_string_r(ctx->parsed);
+
+        if (str != 0) {
+            icalmemory_free_buffer(str);
+        }
+    }
+}
+
+/* One op is a full expansion of the rule, not a single occurrence */
+static void bench_recur(struct bench_ctx *ctx, long iters)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        icalrecur_iterator *ritr = icalrecur_iterator_new(ctx->rrule, ctx->dtstart);
+        struct icaltimetype next;
+
+        if (ritr == 0) {
+            continue;
+        }
+
+        for (next = icalrecur_iterator_next(ritr);
+             !icaltime_is_null_time(next); next = icalrecur_iterator_next(ritr)) {
+            ;
+        }
+
+        icalrecur_iterator_free(ritr);
+    }
+}
+
+static void bench_timezone_convert(struct bench_ctx *ctx, long iters)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        (void)icaltime_convert_to_zone(ctx->convert_time, ctx->convert_zone);
+    }
+}
+
+static void bench_spanlist_query(struct bench_ctx *ctx, long iters)
+{
+    struct icaltimetype start = icaltime_from_string("20250101T000000Z");
+    struct icaltimetype end = icaltime_from_string("20260101T000000Z");
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        icalspanlist *sl = icalspanlist_new(ctx->fileset, start, end);
+
+        if (sl != 0) {
+            icalspanlist_free(sl);
+        }
+    }
+}
+
+static void bench_fileset_commit(struct bench_ctx *ctx, long iters)
+{
+    long i;
+
+    for (i = 0; i < iters; i++) {
+        icalfileset_mark(ctx->fileset);
+        (void)icalfileset_commit(ctx->fileset);
+    }
+}
+
+static const struct bench_case bench_registry[] = {
+    {"parse", bench_parse},
+    {"serialize", bench_serialize},
+    {"recur-expand-year", bench_recur},
+    {"timezone-convert", bench_timezone_convert},
+    {"spanlist-query", bench_spanlist_query},
+    {"fileset-commit", bench_fileset_commit},
+};
+
+#define BENCH_COUNT (sizeof(bench_registry) / sizeof(bench_registry[0]))
+
+/* Grows the iteration count until the benchmark runs long enough for a
+   stable reading, then reports the final batch */
+static void bench_run_one(const struct bench_case *bc, struct bench_ctx *ctx,
+                          double min_seconds, struct bench_result *result)
+{
+    struct icalmemory_stats before, after;
+    long long min_ns = (long long)(min_seconds * 1e9);
+    long long elapsed = 0;
+    long iters = 1;
+
+    for (;;) {
+        long long t0;
+
+        icalmemory_get_stats(&before);
+        t0 = now_ns();
+        (*bc->fn) (ctx, iters);
+        elapsed = now_ns() - t0;
+        icalmemory_get_stats(&after);
+
+        if (elapsed >= min_ns || iters >= MAX_ITERS) {
+            break;
+        }
+
+        if (elapsed <= 0 || elapsed < min_ns / 8) {
+            iters *= 8;
+        } else {
+            iters *= 2;
+        }
+    }
+
+    result->name = bc->name;
+    result->iters = iters;
+    result->ns_per_op = (double)elapsed / (double)iters;
+    result->allocs_per_op =
+        (double)((after.allocs - before.allocs) + (after.reallocs - before.reallocs)) /
+        (double)iters;
+}
+
+/* ---- fixture setup ---- */
+
+static icalset *bench_make_fileset(void)
+{
+    icalset *set;
+    int i;
+
+    unlink(BENCH_FILESET_PATH);
+    set = icalfileset_new(BENCH_FILESET_PATH);
+    if (set == 0) {
+        return 0;
+    }
+
+    for (i = 0; i < BENCH_SPAN_EVENTS; i++) {
+        char buf[256];
+        icalcomponent *c;
+
+        snprintf(buf, sizeof(buf),
+                 "BEGIN:VCALENDAR\nBEGIN:VEVENT\n"
+                 "UID:bench-span-%d\n"
+                 "DTSTART:202501%02dT%02d0000Z\n"
+                 "DTEND:202501%02dT%02d0000Z\n"
+                 "END:VEVENT\nEND:VCALENDAR\n",
+                 i, (i % 28) + 1, i % 23, (i % 28) + 1, (i % 23) + 1);
+
+        c = icalparser_parse_string(buf);
+        if (c != 0) {
+            (void)icalfileset_add_component(set, c);
+        }
+    }
+
+    (void)icalfileset_commit(set);
+
+    return set;
+}
+
+static int bench_ctx_init(struct bench_ctx *ctx)
+{
+    char path[2048];
+
+    memset(ctx, 0, sizeof(*ctx));
+
+    snprintf(path, sizeof(path), "%s/calendar.ics", TEST_DATADIR);
+    ctx->corpus = read_corpus(path);
+    if (ctx->corpus == 0) {
+        return -1;
+    }
+
+    ctx->parsed = icalparser_parse_string(ctx->corpus);
+    if (ctx->parsed == 0) {
+        return -1;
+    }
+
+    ctx->rrule = icalrecurrencetype_from_string("FREQ=DAILY;COUNT=365");
+    ctx->dtstart = icaltime_from_string("20250101T090000Z");
+
+    ctx->convert_time = icaltime_from_string("20250701T120000Z");
+    ctx->convert_zone = icaltimezone_get_builtin_timezone("America/New_York");
+
+    ctx->fileset = bench_make_fileset();
+    if (ctx->fileset == 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+static void bench_ctx_done(struct bench_ctx *ctx)
+{
+    if (ctx->fileset != 0) {
+        icalset_free(ctx->fileset);
+    }
+    if (ctx->parsed != 0) {
+        icalcomponent_free(ctx->parsed);
+    }
+    free(ctx->corpus);
+    unlink(BENCH_FILESET_PATH);
+}
+
+/* ---- output ---- */
+
+enum bench_format
+{
+    BENCH_FORMAT_TABLE,
+    BENCH_FORMAT_JSON,
+    BENCH_FORMAT_CSV
+};
+
+static void bench_print(const struct bench_result *results, size_t count,
+                        enum bench_format format)
+{
+    size_t i;
+
+    switch (format) {
+    case BENCH_FORMAT_JSON:
+        printf("[\n");
+        for (i = 0; i < count; i++) {
+            printf("  {\"name\": \"%s\", \"iters\": %ld, "
+                   "\"ns_per_op\": %.1f, \"allocs_per_op\": %.2f}%s\n",
+                   results[i].name, results[i].iters,
+                   results[i].ns_per_op, results[i].allocs_per_op,
+                   (i + 1 < count) ? "," : "");
+        }
+        printf("]\n");
+        break;
+
+    case BENCH_FORMAT_CSV:
+        printf("name,iters,ns_per_op,allocs_per_op\n");
+        for (i = 0; i < count; i++) {
+            printf("%s,%ld,%.1f,%.2f\n",
+                   results[i].name, results[i].iters,
+                   results[i].ns_per_op, results[i].allocs_per_op);
+        }
+        break;
+
+    default:
+        printf("%-24s %10s %14s %14s\n", "benchmark", "iters", "ns/op", "allocs/op");
+        for (i = 0; i < count; i++) {
+            printf("%-24s %10ld %14.1f %14.2f\n",
+                   results[i].name, results[i].iters,
+                   results[i].ns_per_op, results[i].allocs_per_op);
+        }
+        break;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct bench_ctx ctx;
+    struct bench_result results[BENCH_COUNT];
+    enum bench_format format = BENCH_FORMAT_TABLE;
+    double min_seconds = DEFAULT_SECONDS_PER_BENCH;
+    size_t i;
+    int arg;
+
+    for (arg = 1; arg < argc; arg++) {
+        if (strcmp(argv[arg], "--json") == 0) {
+            format = BENCH_FORMAT_JSON;
+        } else if (strcmp(argv[arg], "--csv") == 0) {
+            format = BENCH_FORMAT_CSV;
+        } else if (atof(argv[arg]) > 0) {
+            min_seconds = atof(argv[arg]);
+        } else {
+            fprintf(stderr, "usage: %s [--json|--csv] [seconds-per-benchmark]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    icalerror_set_errors_are_fatal(0);
+    icalerrno = ICAL_NO_ERROR;
+
+    if (bench_ctx_init(&ctx) != 0) {
+        fprintf(stderr, "libical-bench: fixture setup failed\n");
+        bench_ctx_done(&ctx);
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_COUNT; i++) {
+        bench_run_one(&bench_registry[i], &ctx, min_seconds, &results[i]);
+    }
+
+    bench_ctx_done(&ctx);
+    bench_print(results, BENCH_COUNT, format);
+
+    return 0;
+}
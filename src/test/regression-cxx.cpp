@@ -165,6 +165,21 @@ void test_cxx(void)
     delete vAgenda;
     delete cal;
 
+    // STL-style iteration over subcomponents and properties
+    int ncomps = 0;
+    int nprops = 0;
+    VComponentRange comps = ic.components(ICAL_VEVENT_COMPONENT);
+    for (VComponentIterator ci = comps.begin(); ci != comps.end(); ++ci) {
+        ncomps++;
+        ICalPropertyRange props(*ci, ICAL_ANY_PROPERTY);
+        for (ICalPropertyIterator pi = props.begin(); pi != props.end(); ++pi) {
+            ok("Range iteration dereferences a property", (*pi != 0));
+            nprops++;
+        }
+    }
+    int_is("Range iteration sees the VEVENT", ncomps, 1);
+    int_is("Range iteration sees its properties", nprops, 4);
+
     int caughtException = 0;
     try {
         VComponent v = VComponent(string("HFHFHFHF"));
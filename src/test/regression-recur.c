@@ -86,7 +86,7 @@ void test_recur_file()
     time_t tt;
     const char *file;
     int num_recurs_found = 0;
-    icalfileset_options options = { O_RDONLY, 0644, 0, NULL };
+    icalfileset_options options = { O_RDONLY, 0644, 0, NULL, 0, 0, 0, 0 };
 
     icalerror_set_error_state(ICAL_PARSE_ERROR, ICAL_ERROR_NONFATAL);
 
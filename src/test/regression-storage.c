@@ -30,6 +30,17 @@
 #include "libicalss/icalss.h"
 
 #include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(_WIN32)
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
 
 #define OUTPUT_FILE "filesetout.ics"
 
@@ -758,3 +769,153 @@ void test_dirset_extended(void)
     icalset_free(s);
     icalset_free(cluster);
 }
+
+/* ---- storage scaling report (regression -m <n>) ----
+ *
+ * Not a pass/fail test: reports time per storage operation and heap
+ * growth (from the icalmemory counters, plus peak RSS where getrusage
+ * exists) at a configurable set size, replacing the scaling curves we
+ * used to produce by hand before capacity changes. */
+
+#define SCALING_FILESET "scaling-fileset.ics"
+#define SCALING_DIRSET "scaling-dirset"
+
+static double storage_elapsed(clock_t start)
+{
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/* A clone of str2 with a unique UID, so sets index the components
+   individually */
+static icalcomponent *storage_make_component(int index)
+{
+    icalcomponent *c = icalparser_parse_string(str2);
+    icalcomponent *inner;
+    icalproperty *p;
+    char uid[64];
+
+    assert(c != 0);
+    inner = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+    assert(inner != 0);
+
+    snprintf(uid, sizeof(uid), "scaling-%d@regression", index);
+    p = icalcomponent_get_first_property(inner, ICAL_UID_PROPERTY);
+    icalproperty_set_uid(p, uid);
+
+    return c;
+}
+
+static void storage_report_phase(const char *operation, double seconds)
+{
+    struct icalmemory_stats stats;
+
+    icalmemory_get_stats(&stats);
+    printf("%-24s %10.3fs %14lu %16lu\n", operation, seconds,
+           (unsigned long)stats.max_live_blocks, (unsigned long)stats.bytes_allocated);
+    fflush(stdout);
+}
+
+void storage_scaling_report(int n_components)
+{
+    icalset *set;
+    icalcomponent *c;
+    clock_t t0;
+    int i, count;
+
+    printf("storage scaling report: %d components\n", n_components);
+    printf("%-24s %11s %14s %16s\n", "operation", "seconds", "peak-blocks", "bytes-alloc");
+
+    /* fileset */
+    (void)remove(SCALING_FILESET);
+    icalmemory_reset_stats();
+
+    t0 = clock();
+    set = icalfileset_new(SCALING_FILESET);
+    assert(set != 0);
+    for (i = 0; i < n_components; i++) {
+        (void)icalfileset_add_component(set, storage_make_component(i));
+    }
+    storage_report_phase("fileset add", storage_elapsed(t0));
+
+    t0 = clock();
+    (void)icalfileset_commit(set);
+    storage_report_phase("fileset commit", storage_elapsed(t0));
+
+    t0 = clock();
+    icalset_free(set);
+    storage_report_phase("fileset close", storage_elapsed(t0));
+
+    t0 = clock();
+    set = icalfileset_new(SCALING_FILESET);
+    assert(set != 0);
+    count = 0;
+    for (c = icalfileset_get_first_component(set);
+         c != 0; c = icalfileset_get_next_component(set)) {
+        count++;
+    }
+    storage_report_phase("fileset reopen+scan", storage_elapsed(t0));
+    if (count != n_components) {
+        printf("fileset scan found %d of %d components\n", count, n_components);
+    }
+    icalset_free(set);
+    (void)remove(SCALING_FILESET);
+
+    /* dirset */
+#if defined(_WIN32)
+    (void)_mkdir(SCALING_DIRSET);
+#else
+    (void)mkdir(SCALING_DIRSET, 0755);
+#endif
+    icalmemory_reset_stats();
+
+    t0 = clock();
+    set = icaldirset_new(SCALING_DIRSET);
+    assert(set != 0);
+    for (i = 0; i < n_components; i++) {
+        (void)icaldirset_add_component(set, storage_make_component(i));
+    }
+    storage_report_phase("dirset add", storage_elapsed(t0));
+
+    t0 = clock();
+    (void)icaldirset_commit(set);
+    storage_report_phase("dirset commit", storage_elapsed(t0));
+
+    t0 = clock();
+    icalset_free(set);
+    storage_report_phase("dirset close", storage_elapsed(t0));
+
+    t0 = clock();
+    set = icaldirset_new(SCALING_DIRSET);
+    assert(set != 0);
+    count = 0;
+    for (c = icaldirset_get_first_component(set);
+         c != 0; c = icaldirset_get_next_component(set)) {
+        count++;
+    }
+    storage_report_phase("dirset reopen+scan", storage_elapsed(t0));
+    if (count != n_components) {
+        printf("dirset scan found %d of %d components\n", count, n_components);
+    }
+
+    icalset_free(set);
+
+    /* Every generated component carries the same DTSTAMP, so the whole
+       set lives in one cluster file */
+    (void)remove(SCALING_DIRSET "/199803");
+    (void)remove(SCALING_DIRSET "/.icalindex");
+#if defined(_WIN32)
+    (void)_rmdir(SCALING_DIRSET);
+#else
+    (void)rmdir(SCALING_DIRSET);
+#endif
+
+#if !defined(_WIN32)
+    {
+        struct rusage usage;
+
+        if (getrusage(RUSAGE_SELF, &usage) == 0) {
+            printf("%-24s %10ldkB\n", "peak RSS", usage.ru_maxrss);
+        }
+    }
+#endif
+}
@@ -36,6 +36,20 @@
 #include <assert.h>
 #include <stdlib.h>
 
+#if defined(HAVE_UNISTD_H)
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#endif
+#if defined(HAVE_FORK) && defined(HAVE_WAITPID)
+#include <sys/wait.h>
+#endif
+#if defined(HAVE_PTHREAD)
+#include <pthread.h>
+#endif
+
 #define TESTS_TZID_PREFIX "/softwarestudio.org/tests/"
 
 /* For GNU libc, strcmp appears to be a macro, so using strcmp in
@@ -280,9 +294,55 @@ void test_values()
     v = icalvalue_new_from_string(ICAL_REQUESTSTATUS_VALUE, "Gonk");
     ok("illegal requeststatus value", (v == 0));
 
+    {
+        icalvalue_parse_error verr;
+
+        v = icalvalue_new_from_string_with_desc(ICAL_GEO_VALUE, "Gonk", &verr);
+        ok("illegal geo value with descriptor", (v == 0));
+        ok("descriptor carries an error code", (verr.code != ICAL_NO_ERROR));
+        ok("descriptor message is set", (verr.message != 0));
+
+        v = icalvalue_new_from_string_with_desc(ICAL_BOOLEAN_VALUE, "TRUE", &verr);
+        ok("valid value leaves descriptor clean", (v != 0 && verr.code == ICAL_NO_ERROR));
+        icalvalue_free(v);
+    }
+
     icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_DEFAULT);
 }
 
+void test_deferred_errors()
+{
+    icalvalue *v;
+    int drained = 0;
+
+    icalerror_set_deferred(1);
+    ok("deferred mode entered", (icalerror_get_deferred() == 1));
+
+    /* While deferred, bad values are collected instead of dispatched */
+    v = icalvalue_new_from_string(ICAL_RECUR_VALUE, "D2 #0");
+    ok("illegal recur value while deferred", (v == 0));
+    v = icalvalue_new_from_string(ICAL_TRIGGER_VALUE, "Gonk");
+    ok("illegal trigger value while deferred", (v == 0));
+
+    ok("both errors collected", (icalerror_deferred_count() >= 2));
+
+    icalerror_set_deferred(0);
+    ok("deferred mode left", (icalerror_get_deferred() == 0));
+
+    while (icalerror_deferred_pop() != ICAL_NO_ERROR) {
+        drained++;
+    }
+    ok("drain returns the collected errors", (drained >= 2));
+    ok("drained buffer is empty", (icalerror_deferred_count() == 0));
+
+    /* Entering again discards anything left over */
+    icalerror_set_deferred(1);
+    int_is("fresh batch starts empty", icalerror_deferred_count(), 0);
+    icalerror_set_deferred(0);
+
+    icalerror_clear_errno();
+}
+
 void test_properties()
 {
     icalproperty *prop;
@@ -434,6 +494,103 @@ void test_icaltime_compare_utc_zone()
     int_is("a < b", icaltime_compare(a, b), -1);
 }
 
+void test_icaltime_sortkey()
+{
+    struct icaltimetype times[5];
+    size_t i;
+
+    /* Deliberately out of order: a later datetime, a date, midnight of
+       that date, a time in a zone east of UTC, and an earlier datetime. */
+    times[0] = icaltime_from_string("20170130T103000Z");
+    times[1] = icaltime_from_string("20170130");
+    times[2] = icaltime_from_string("20170130T000000Z");
+    times[3] = icaltime_from_string("20170130T103000");
+    times[3].zone = icaltimezone_get_builtin_timezone("Europe/Berlin");
+    times[4] = icaltime_from_string("20170129T235959Z");
+
+    /* The packed keys must order the same way as icaltime_compare(). */
+    for (i = 0; i < 5; i++) {
+        size_t j;
+
+        for (j = 0; j < 5; j++) {
+            int cmp = icaltime_compare(times[i], times[j]);
+            int64_t ki = icaltime_as_sortkey(times[i]);
+            int64_t kj = icaltime_as_sortkey(times[j]);
+
+            int_is("sortkey orders like icaltime_compare",
+                   (ki > kj) - (ki < kj), cmp);
+        }
+    }
+
+    icaltime_sort_array(times, 5);
+
+    for (i = 1; i < 5; i++) {
+        ok("sorted ascending", icaltime_compare(times[i - 1], times[i]) <= 0);
+    }
+
+    /* A DATE sorts just before a DATE-TIME at midnight of the same day. */
+    ok("date before midnight datetime",
+       icaltime_as_sortkey(icaltime_from_string("20170130")) <
+       icaltime_as_sortkey(icaltime_from_string("20170130T000000Z")));
+}
+
+void test_component_by_uid()
+{
+    icalcomponent *cal, *event1, *event2, *event3;
+
+    cal = icalcomponent_new(ICAL_VCALENDAR_COMPONENT);
+    event1 = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                 icalproperty_new_uid("uid-one"), (void *)0);
+    event2 = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                 icalproperty_new_uid("uid-two"), (void *)0);
+    event3 = icalcomponent_new(ICAL_VEVENT_COMPONENT);        /* no UID */
+
+    icalcomponent_add_component(cal, event1);
+    icalcomponent_add_component(cal, event2);
+    icalcomponent_add_component(cal, event3);
+
+    ok("finds first uid", icalcomponent_get_component_by_uid(cal, "uid-one") == event1);
+    ok("finds second uid", icalcomponent_get_component_by_uid(cal, "uid-two") == event2);
+    ok("missing uid returns NULL", icalcomponent_get_component_by_uid(cal, "uid-none") == 0);
+
+    /* Mutating the child list must invalidate the index. */
+    icalcomponent_remove_component(cal, event2);
+    ok("removed uid no longer found", icalcomponent_get_component_by_uid(cal, "uid-two") == 0);
+    ok("remaining uid still found", icalcomponent_get_component_by_uid(cal, "uid-one") == event1);
+
+    icalcomponent_free(event2);
+    icalcomponent_free(cal);
+}
+
+void test_attendee_index()
+{
+    icalcomponent *c;
+    icalproperty *p;
+    char addr[80];
+    int i;
+
+    c = icalcomponent_new(ICAL_VEVENT_COMPONENT);
+    for (i = 0; i < 50; i++) {
+        snprintf(addr, sizeof(addr), "mailto:user%d@example.com", i);
+        icalcomponent_add_property(c, icalproperty_new_attendee(addr));
+    }
+
+    p = icalcomponent_get_attendee(c, "mailto:user42@example.com");
+    ok("finds attendee by exact address", (p != 0));
+    p = icalcomponent_get_attendee(c, "USER7@EXAMPLE.COM");
+    ok("lookup ignores case and the mailto: scheme",
+       (p != 0 && strcmp(icalproperty_get_attendee(p), "mailto:user7@example.com") == 0));
+    ok("missing attendee returns NULL",
+       (icalcomponent_get_attendee(c, "nobody@example.com") == 0));
+
+    /* Mutating the property list must invalidate the index. */
+    icalcomponent_add_property(c, icalproperty_new_attendee("mailto:late@example.com"));
+    ok("index follows property mutations",
+       (icalcomponent_get_attendee(c, "late@example.com") != 0));
+
+    icalcomponent_free(c);
+}
+
 void test_parameters()
 {
     icalparameter *p;
@@ -489,6 +646,18 @@ void test_parameters()
         ok("test parameter enums",
            (icalparameter_string_to_enum(icalparameter_enum_to_string(enums[i])) == enums[i]));
     }
+
+    /* The render cache: repeated serializations agree, quoting still
+       kicks in past the fast path, and a setter drops the cache. */
+    p = icalparameter_new_cn("Big Cheese, Esq.");
+    str_is("comma still forces quoting",
+           icalparameter_as_ical_string(p), "CN=\"Big Cheese, Esq.\"");
+    str_is("second render matches the first",
+           icalparameter_as_ical_string(p), "CN=\"Big Cheese, Esq.\"");
+    icalparameter_set_cn(p, "Plain Name");
+    str_is("setter invalidates the cached rendering",
+           icalparameter_as_ical_string(p), "CN=Plain Name");
+    icalparameter_free(p);
 }
 
 const char *good_child =
@@ -561,6 +730,141 @@ void test_components()
 	icalerror_set_errors_are_fatal(estate);
 }
 
+void test_component_freeze()
+{
+    icalcomponent *c, *event, *extra, *clone;
+    icalproperty *p;
+    icalpropiter pit;
+    int count;
+    int estate;
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalproperty_new_version("2.0"),
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_uid("freeze-uid-1"),
+                                icalproperty_new_summary("Frozen event"),
+                                icalproperty_new_comment("First comment"),
+                                icalproperty_new_comment("Second comment"),
+                                0),
+            0);
+
+    ok("component starts out unfrozen", !icalcomponent_is_frozen(c));
+
+    icalcomponent_freeze(c);
+
+    event = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+
+    ok("component is frozen", icalcomponent_is_frozen(c));
+    ok("freeze recursed into the child", icalcomponent_is_frozen(event));
+
+    /* Mutation is refused with ICAL_USAGE_ERROR and the tree is
+       unchanged. */
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+
+    icalerror_clear_errno();
+    p = icalproperty_new_summary("Should be refused");
+    icalcomponent_add_property(event, p);
+    ok("add_property on a frozen tree sets ICAL_USAGE_ERROR", icalerrno == ICAL_USAGE_ERROR);
+    icalproperty_free(p);
+    int_is("property count is unchanged",
+           icalcomponent_count_properties(event, ICAL_SUMMARY_PROPERTY), 1);
+
+    icalerror_clear_errno();
+    extra = icalcomponent_new(ICAL_VEVENT_COMPONENT);
+    icalcomponent_add_component(c, extra);
+    ok("add_component on a frozen tree sets ICAL_USAGE_ERROR", icalerrno == ICAL_USAGE_ERROR);
+    icalcomponent_free(extra);
+    int_is("child count is unchanged",
+           icalcomponent_count_components(c, ICAL_VEVENT_COMPONENT), 1);
+
+    icalerror_clear_errno();
+    icalcomponent_remove_component(c, event);
+    ok("remove_component on a frozen tree sets ICAL_USAGE_ERROR", icalerrno == ICAL_USAGE_ERROR);
+
+    icalerror_set_errors_are_fatal(estate);
+
+    /* The UID index was resolved by the freeze. */
+    ok("uid lookup works on the frozen tree",
+       icalcomponent_get_component_by_uid(c, "freeze-uid-1") == event);
+
+    /* The external iterator reads the frozen component without touching
+       its internal cursor. */
+    pit = icalcomponent_begin_property(event, ICAL_COMMENT_PROPERTY);
+    count = 0;
+    for (p = icalpropiter_deref(&pit); p != 0; p = icalpropiter_next(&pit)) {
+        count++;
+    }
+    int_is("external property iterator sees both comments", count, 2);
+
+    clone = icalcomponent_clone(c);
+    ok("a clone of a frozen tree is unfrozen", !icalcomponent_is_frozen(clone));
+
+    icalcomponent_free(clone);
+    icalcomponent_free(c);
+}
+
+void test_extract_columns()
+{
+    icalcomponent *c;
+    struct icaltimetype starts[4];
+    const char *uids[4];
+    const char *summaries[4];
+    icalextract_column columns[3];
+    int rows;
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalproperty_new_version("2.0"),
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_uid("extract-uid-1"),
+                                icalproperty_new_dtstart(icaltime_from_string("20260301T090000Z")),
+                                icalproperty_new_summary("First event"),
+                                0),
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_uid("extract-uid-2"),
+                                icalproperty_new_dtstart(icaltime_from_string("20260302T090000Z")),
+                                0),
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_summary("No uid or dtstart here"),
+                                0),
+            0);
+
+    columns[0].prop_kind = ICAL_DTSTART_PROPERTY;
+    columns[0].value_kind = ICAL_DATETIME_VALUE;
+    columns[0].values = starts;
+
+    columns[1].prop_kind = ICAL_UID_PROPERTY;
+    columns[1].value_kind = ICAL_TEXT_VALUE;
+    columns[1].values = uids;
+
+    columns[2].prop_kind = ICAL_SUMMARY_PROPERTY;
+    columns[2].value_kind = ICAL_TEXT_VALUE;
+    columns[2].values = summaries;
+
+    rows = icalcomponent_extract_columns(c, ICAL_VEVENT_COMPONENT, columns, 3, 4);
+
+    int_is("one row per VEVENT", rows, 3);
+    str_is("first uid", uids[0], "extract-uid-1");
+    str_is("second uid", uids[1], "extract-uid-2");
+    ok("third row has no uid", uids[2] == 0);
+    str_is("first dtstart",
+           icaltime_as_ical_string(starts[0]), "20260301T090000Z");
+    str_is("second dtstart",
+           icaltime_as_ical_string(starts[1]), "20260302T090000Z");
+    ok("third dtstart is null time", icaltime_is_null_time(starts[2]));
+    str_is("first summary", summaries[0], "First event");
+    ok("second row has no summary", summaries[1] == 0);
+    str_is("third summary", summaries[2], "No uid or dtstart here");
+
+    /* max_rows caps the traversal. */
+    rows = icalcomponent_extract_columns(c, ICAL_VEVENT_COMPONENT, columns, 3, 2);
+    int_is("max_rows stops the extraction", rows, 2);
+
+    icalcomponent_free(c);
+}
+
 static void test_component_foreach_callback(icalcomponent *comp, struct icaltime_span *span, void *data)
 {
     int *foundExpected;
@@ -907,6 +1211,170 @@ void test_memory()
     }
 }
 
+static size_t alloc_count_delta(const struct icalmemory_stats *before,
+                                const struct icalmemory_stats *after)
+{
+    return (after->allocs - before->allocs) + (after->reallocs - before->reallocs);
+}
+
+void test_allocation_counts()
+{
+    /* Allocation budgets for canonical operations. These ceilings are
+       the measured counts with headroom; when a change pushes one of
+       them over, either the regression gets fixed or the new cost is
+       acknowledged by raising the budget here. */
+    static const char event_str[] =
+        "BEGIN:VEVENT\n"
+        "UID:alloc-budget@example.com\n"
+        "DTSTAMP:20250101T000000Z\n"
+        "DTSTART:20250101T090000Z\n"
+        "DTEND:20250101T100000Z\n"
+        "SUMMARY:Allocation budget probe\n"
+        "RRULE:FREQ=DAILY;COUNT=100\n"
+        "END:VEVENT\n";
+
+    struct icalmemory_stats before, after;
+    icalcomponent *c;
+    icalproperty *rrule_prop;
+    struct icalrecurrencetype recur;
+    struct icaltimetype dtstart, next;
+    icalrecur_iterator *ritr;
+    char *str;
+    size_t parse_allocs, serialize_allocs, recur_allocs;
+    int occurrences = 0;
+
+    /* Warm up the static caches (tmp buffer ring, recurrence tables) so
+       the deltas below cover only the operations themselves */
+    c = icalparser_parse_string(event_str);
+    str = icalcomponent_as_ical_string_r(c);
+    icalmemory_free_buffer(str);
+    dtstart = icalcomponent_get_dtstart(c);
+    recur = icalproperty_get_rrule(icalcomponent_get_first_property(c, ICAL_RRULE_PROPERTY));
+    ritr = icalrecur_iterator_new(recur, dtstart);
+    (void)icalrecur_iterator_next(ritr);
+    icalrecur_iterator_free(ritr);
+    icalcomponent_free(c);
+
+    icalmemory_get_stats(&before);
+    c = icalparser_parse_string(event_str);
+    icalmemory_get_stats(&after);
+    parse_allocs = alloc_count_delta(&before, &after);
+
+    icalmemory_get_stats(&before);
+    str = icalcomponent_as_ical_string_r(c);
+    icalmemory_get_stats(&after);
+    serialize_allocs = alloc_count_delta(&before, &after);
+    icalmemory_free_buffer(str);
+
+    dtstart = icalcomponent_get_dtstart(c);
+    rrule_prop = icalcomponent_get_first_property(c, ICAL_RRULE_PROPERTY);
+    recur = icalproperty_get_rrule(rrule_prop);
+
+    icalmemory_get_stats(&before);
+    ritr = icalrecur_iterator_new(recur, dtstart);
+    for (next = icalrecur_iterator_next(ritr);
+         !icaltime_is_null_time(next); next = icalrecur_iterator_next(ritr)) {
+        occurrences++;
+    }
+    icalrecur_iterator_free(ritr);
+    icalmemory_get_stats(&after);
+    recur_allocs = alloc_count_delta(&before, &after);
+
+    icalcomponent_free(c);
+
+    if (VERBOSE) {
+        printf("parse: %lu allocs, serialize: %lu allocs, "
+               "expand %d occurrences: %lu allocs\n",
+               (unsigned long)parse_allocs, (unsigned long)serialize_allocs,
+               occurrences, (unsigned long)recur_allocs);
+    }
+
+    int_is("100 occurrences expanded", occurrences, 100);
+    ok("parsing one VEVENT stays within its allocation budget", (parse_allocs <= 80));
+    ok("serializing one VEVENT stays within its allocation budget",
+       (serialize_allocs <= 32));
+    ok("expanding 100 occurrences stays within its allocation budget",
+       (recur_allocs <= 16));
+}
+
+void test_arena()
+{
+    static const char test_icalcomp_str[] =
+        "BEGIN:VCALENDAR\n"
+        "BEGIN:VEVENT\n"
+        "UID:12345678@example.com\n"
+        "DTSTART:20180220T020000Z\n"
+        "SUMMARY:An event\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+
+    icalmemory_arena *arena;
+    icalparser *parser;
+    icalcomponent *c;
+    icalcomponent *event;
+    const char *pos;
+    char *line;
+    char *p1, *p2;
+
+    /* Basic slab behavior: small allocations, an oversized allocation,
+       and duplication */
+    arena = icalmemory_arena_new(128);
+
+    p1 = icalmemory_arena_alloc(arena, 40);
+    p2 = icalmemory_arena_alloc(arena, 40);
+    ok("arena allocations are distinct", (p1 != 0 && p2 != 0 && p1 != p2));
+
+    p1 = icalmemory_arena_alloc(arena, 1000);
+    ok("oversized arena allocation succeeds", (p1 != 0));
+
+    p2 = icalmemory_arena_strdup(arena, "hello");
+    str_is("arena strdup", p2, "hello");
+
+    icalmemory_arena_clear(arena);
+
+    p1 = icalmemory_arena_alloc(arena, 40);
+    ok("arena is usable after clear", (p1 != 0));
+
+    icalmemory_arena_free(arena);
+
+    /* Parse a component into an arena and release the whole tree at
+       once */
+    arena = icalmemory_arena_new(0);
+    parser = icalparser_new();
+    icalparser_set_arena(parser, arena);
+
+    /* Feed the parser line by line, as a streaming consumer would */
+    c = 0;
+    pos = test_icalcomp_str;
+    while (*pos != '\0' && c == 0) {
+        const char *eol = strchr(pos, '\n');
+        size_t len = (size_t)(eol - pos);
+
+        line = malloc(len + 1);
+        memcpy(line, pos, len);
+        line[len] = '\0';
+
+        c = icalparser_add_line(parser, line);
+
+        free(line);
+        pos = eol + 1;
+    }
+
+    ok("arena parse returned a component", (c != 0));
+    assert(c != 0);
+
+    event = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+    ok("arena component has a VEVENT", (event != 0));
+    assert(event != 0);
+
+    str_is("arena component UID", icalcomponent_get_uid(event), "12345678@example.com");
+
+    icalparser_free(parser);
+
+    /* The tree is discarded wholesale; no icalcomponent_free() */
+    icalmemory_arena_free(arena);
+}
+
 void test_dirset()
 {
     icalcomponent *c;
@@ -1027,79 +1495,598 @@ void test_dirset()
     icalset_free(cluster);
 }
 
-void test_compare()
+void test_dirset_index(void)
 {
-    icalvalue *v1, *v2;
-
-    v1 = icalvalue_new_caladdress("cap://value/1");
-    v2 = icalvalue_clone(v1);
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *c;
+    struct icaltimetype tm;
+    struct stat sbuf;
+    int i;
+    char uid[80];
+
+    (void)mkdir("store-index", 0755);
+
+    s = icaldirset_new("store-index");
+    ok("opening 'store-index' dirset", s != NULL);
+    assert(s != 0);
+
+    /* Spread components over several monthly clusters */
+    for (i = 0; i < 6; i++) {
+        tm = icaltime_from_string("20240101T120000Z");
+        tm.month = i + 1;
+        snprintf(uid, sizeof(uid), "dirset-index-uid-%d", i);
+
+        c = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstamp(tm),
+                                    icalproperty_new_dtstart(tm), (void *)0),
+                (void *)0);
+
+        ok("adding component to indexed dirset",
+           icaldirset_add_component(s, c) == ICAL_NO_ERROR);
+        (void)icaldirset_commit(s);
+    }
 
-    ok("compare value and clone", (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_EQUAL));
+    icalset_free(s);
 
-    icalvalue_free(v1);
-    icalvalue_free(v2);
+    ok("UID index sidecar was written", stat("store-index/.icalindex", &sbuf) == 0);
 
-    v1 = icalvalue_new_caladdress("A");
-    v2 = icalvalue_new_caladdress("B");
+    /* A fresh open fetches through the sidecar */
+    s = icaldirset_new("store-index");
+    assert(s != 0);
+    c = icaldirset_fetch(s, ICAL_VEVENT_COMPONENT, "dirset-index-uid-3");
+    ok("indexed fetch finds the component", (c != NULL));
+    ok("indexed fetch found the right component",
+       (c != NULL) && strcmp(icalcomponent_get_uid(c), "dirset-index-uid-3") == 0);
+    icalset_free(s);
 
-    ok("test compare of A and B results in LESS",
-       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_LESS));
+    /* Without the sidecar, fetch falls back to the cluster walk and
+       rebuilds the entry it used */
+    unlink("store-index/.icalindex");
+    s = icaldirset_new("store-index");
+    assert(s != 0);
+    c = icaldirset_fetch(s, ICAL_VEVENT_COMPONENT, "dirset-index-uid-5");
+    ok("fallback fetch finds the component", (c != NULL));
+    icalset_free(s);
 
-    ok("test compare of B and A results in GREATER",
-       (icalvalue_compare(v2, v1) == ICAL_XLICCOMPARETYPE_GREATER));
+    ok("fallback fetch repaired the sidecar",
+       stat("store-index/.icalindex", &sbuf) == 0 && sbuf.st_size > 0);
+#endif
+}
 
-    icalvalue_free(v1);
-    icalvalue_free(v2);
+void test_dirset_cursor(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *c;
+    icaldirset_cursor *cursor;
+    icalgauge *g;
+    struct icaltimetype tm;
+    int i;
+    int count;
+    char uid[80];
 
-    v1 = icalvalue_new_caladdress("B");
-    v2 = icalvalue_new_caladdress("A");
+    (void)mkdir("store-cursor", 0755);
 
-    ok("test compare of caladdress A and B results in GREATER",
-       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_GREATER));
+    /* Start from an empty store even if a previous run left one behind */
+    for (i = 0; i < 6; i++) {
+        snprintf(uid, sizeof(uid), "store-cursor/2024%02d", i + 1);
+        unlink(uid);
+    }
+    unlink("store-cursor/.icalindex");
+
+    s = icaldirset_new("store-cursor");
+    assert(s != 0);
+    for (i = 0; i < 6; i++) {
+        tm = icaltime_from_string("20240101T120000Z");
+        tm.month = i + 1;
+        snprintf(uid, sizeof(uid), "dirset-cursor-uid-%d", i);
+
+        c = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstamp(tm),
+                                    icalproperty_new_dtstart(tm), (void *)0),
+                (void *)0);
+
+        (void)icaldirset_add_component(s, c);
+        (void)icaldirset_commit(s);
+    }
+    icalset_free(s);
 
-    icalvalue_free(v1);
-    icalvalue_free(v2);
+    /* An ungauged cursor with prefetch streams the whole store */
+    s = icaldirset_new_reader("store-cursor");
+    assert(s != 0);
+    cursor = icaldirset_cursor_new(s, 0, 1);
+    ok("icaldirset_cursor_new()", (cursor != NULL));
+    assert(cursor != 0);
+    count = 0;
+    while ((c = icaldirset_cursor_next(cursor)) != 0) {
+        count++;
+        icalcomponent_free(c);  /* cursor returns clones */
+    }
+    int_is("cursor streams every component", count, 6);
+    icaldirset_cursor_free(cursor);
 
-    v1 = icalvalue_new_integer(5);
-    v2 = icalvalue_new_integer(5);
+    /* A gauged cursor only returns matches */
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20240215T000000Z'", 0);
+    assert(g != 0);
+    cursor = icaldirset_cursor_new(s, g, 0);
+    assert(cursor != 0);
+    count = 0;
+    while ((c = icaldirset_cursor_next(cursor)) != 0) {
+        count++;
+        icalcomponent_free(c);
+    }
+    int_is("gauged cursor filters the stream", count, 4);
+    icaldirset_cursor_free(cursor);
+    icalgauge_free(g);
+    icalset_free(s);
+#endif
+}
 
-    ok("test compare of 5 and 5 results in EQUAL",
-       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_EQUAL));
+void test_dirset_bulk_add(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *c;
+    icalcomponent *batch[8];
+    struct icaltimetype tm;
+    int i;
+    int count;
+    char uid[80];
 
-    icalvalue_free(v1);
-    icalvalue_free(v2);
+    (void)mkdir("store-bulk", 0755);
 
-    v1 = icalvalue_new_integer(5);
-    v2 = icalvalue_new_integer(10);
+    /* Start from an empty store even if a previous run left one behind */
+    for (i = 0; i < 4; i++) {
+        snprintf(uid, sizeof(uid), "store-bulk/2024%02d", i + 1);
+        unlink(uid);
+    }
+    unlink("store-bulk/.icalindex");
+
+    s = icaldirset_new("store-bulk");
+    assert(s != 0);
+
+    /* Alternate between months, the worst case for one-at-a-time adds */
+    for (i = 0; i < 8; i++) {
+        tm = icaltime_from_string("20240101T120000Z");
+        tm.month = (i % 4) + 1;
+        snprintf(uid, sizeof(uid), "dirset-bulk-uid-%d", i);
+
+        batch[i] = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstamp(tm),
+                                    icalproperty_new_dtstart(tm), (void *)0),
+                (void *)0);
+    }
 
-    ok("test compare of 5 and 10 results in LESS",
-       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_LESS));
+    ok("icaldirset_add_components()",
+       icaldirset_add_components(s, batch, 8) == ICAL_NO_ERROR);
+    icalset_free(s);
 
-    ok("test compare of 10 and 5 results in GREATER",
-       (icalvalue_compare(v2, v1) == ICAL_XLICCOMPARETYPE_GREATER));
+    /* The batch landed in its clusters and is visible to a fresh open */
+    s = icaldirset_new("store-bulk");
+    assert(s != 0);
+    count = 0;
+    for (c = icaldirset_get_first_component(s); c != 0; c = icaldirset_get_next_component(s)) {
+        count++;
+    }
+    int_is("bulk add wrote every component", count, 8);
 
-    icalvalue_free(v1);
-    icalvalue_free(v2);
+    c = icaldirset_fetch(s, ICAL_VEVENT_COMPONENT, "dirset-bulk-uid-6");
+    ok("bulk add indexed the components", (c != NULL));
+    icalset_free(s);
+#endif
 }
 
-void test_restriction()
+void test_dirset_prune(void)
 {
-    icalcomponent *comp;
-    struct icaltimetype atime = icaltime_from_timet_with_zone(time(0), 0, NULL);
-    int valid;
+#if defined(HAVE_UNLINK)
+    icalset *s, *decoy;
+    icalcomponent *c;
+    icalgauge *g;
+    icaldirset_cursor *cursor;
+    struct icaltimetype tm;
+    int i;
+    int count;
+    char uid[80];
 
-    struct icaldatetimeperiodtype rtime;
+    (void)mkdir("store-prune", 0755);
 
-    rtime.period.start = icaltime_from_timet_with_zone(time(0), 0, NULL);
-    rtime.period.end = icaltime_from_timet_with_zone(time(0), 0, NULL);
-    rtime.period.end.hour++;
-    rtime.time = icaltime_null_time();
+    /* Start from an empty store even if a previous run left one behind */
+    for (i = 0; i < 6; i++) {
+        snprintf(uid, sizeof(uid), "store-prune/2024%02d", i + 1);
+        unlink(uid);
+    }
+    unlink("store-prune/202312");
+    unlink("store-prune/.icalindex");
+
+    s = icaldirset_new("store-prune");
+    assert(s != 0);
+    for (i = 0; i < 6; i++) {
+        tm = icaltime_from_string("20240101T120000Z");
+        tm.month = i + 1;
+        snprintf(uid, sizeof(uid), "dirset-prune-uid-%d", i);
+
+        c = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstamp(tm),
+                                    icalproperty_new_dtstart(tm), (void *)0),
+                (void *)0);
+
+        (void)icaldirset_add_component(s, c);
+        (void)icaldirset_commit(s);
+    }
+    icalset_free(s);
 
-    comp =
+    /* Plant an in-range component in an out-of-range month cluster.
+       The store's layout keys clusters on DTSTART, so this cluster is
+       out of layout; a pruned walk proves it never opens the file */
+    decoy = icalfileset_new("store-prune/202312");
+    assert(decoy != 0);
+    (void)icalfileset_add_component(
+        decoy,
         icalcomponent_vanew(
             ICAL_VCALENDAR_COMPONENT,
-            icalproperty_new_version("2.0"),
-            icalproperty_new_prodid("-//RDU Software//NONSGML HandCal//EN"),
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_uid("dirset-prune-decoy"),
+                                icalproperty_new_dtstart(
+                                    icaltime_from_string("20240315T120000Z")),
+                                (void *)0),
+            (void *)0));
+    icalset_free(decoy);
+
+    /* A range-bounded select reads only the March and April clusters */
+    s = icaldirset_new_reader("store-prune");
+    assert(s != 0);
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20240215T000000Z' "
+                               "AND DTSTART < '20240501T000000Z'", 0);
+    assert(g != 0);
+
+    (void)icaldirset_select(s, g);
+    count = 0;
+    for (c = icaldirset_get_first_component(s); c != 0; c = icaldirset_get_next_component(s)) {
+        ok("pruned walk never opens the decoy cluster",
+           (strcmp(icalcomponent_get_uid(icalcomponent_get_first_real_component(c)),
+                   "dirset-prune-decoy") != 0));
+        count++;
+    }
+    int_is("pruned walk finds the in-range components", count, 2);
+    icalset_free(s);        /* frees the selected gauge */
+
+    /* The streaming cursor prunes its cluster list the same way */
+    s = icaldirset_new_reader("store-prune");
+    assert(s != 0);
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20240215T000000Z' "
+                               "AND DTSTART < '20240501T000000Z'", 0);
+    assert(g != 0);
+    cursor = icaldirset_cursor_new(s, g, 0);
+    assert(cursor != 0);
+    count = 0;
+    while ((c = icaldirset_cursor_next(cursor)) != 0) {
+        count++;
+        icalcomponent_free(c);
+    }
+    int_is("pruned cursor agrees", count, 2);
+    icaldirset_cursor_free(cursor);
+    icalgauge_free(g);
+    icalset_free(s);
+#endif
+}
+
+/* A minimal RAM-resident icalset class used to exercise backend
+   registration: components live in an XROOT and never touch disk. */
+struct ramset
+{
+    icalset super;
+    icalcomponent *root;
+};
+
+static icalset *ramset_init(icalset *set, const char *dsn, void *options)
+{
+    struct ramset *r = (struct ramset *)set;
+
+    _unused(dsn);
+    _unused(options);
+
+    r->root = icalcomponent_new(ICAL_XROOT_COMPONENT);
+
+    return (r->root != 0) ? set : 0;
+}
+
+static void ramset_free(icalset *set)
+{
+    struct ramset *r = (struct ramset *)set;
+
+    if (r->root != 0) {
+        icalcomponent_free(r->root);
+        r->root = 0;
+    }
+}
+
+static icalerrorenum ramset_add(icalset *set, icalcomponent *comp)
+{
+    icalcomponent_add_component(((struct ramset *)set)->root, comp);
+    return ICAL_NO_ERROR;
+}
+
+static icalcomponent *ramset_first(icalset *set)
+{
+    return icalcomponent_get_first_component(((struct ramset *)set)->root,
+                                             ICAL_ANY_COMPONENT);
+}
+
+static icalcomponent *ramset_next(icalset *set)
+{
+    return icalcomponent_get_next_component(((struct ramset *)set)->root,
+                                            ICAL_ANY_COMPONENT);
+}
+
+static icalcomponent *ramset_fetch(icalset *set, icalcomponent_kind kind, const char *uid)
+{
+    icalcomponent *c;
+
+    _unused(kind);
+
+    for (c = ramset_first(set); c != 0; c = ramset_next(set)) {
+        const char *this_uid =
+            icalcomponent_get_uid(icalcomponent_get_first_real_component(c));
+
+        if (this_uid != 0 && strcmp(this_uid, uid) == 0) {
+            return c;
+        }
+    }
+
+    return 0;
+}
+
+static icalset ramset_class = {
+    ICAL_USER_SET,
+    sizeof(struct ramset),
+    NULL,       /* dsn */
+    ramset_init,
+    ramset_free,
+    0,          /* path */
+    0,          /* mark */
+    0,          /* commit */
+    ramset_add,
+    0,          /* remove_component */
+    0,          /* count_components */
+    0,          /* select */
+    0,          /* clear */
+    ramset_fetch,
+    0,          /* fetch_match */
+    0,          /* has_uid */
+    0,          /* modify */
+    0,          /* get_current_component */
+    ramset_first,
+    ramset_next,
+    0,          /* icalset_begin_component */
+    0,          /* icalsetiter_to_next */
+    0,          /* icalsetiter_to_prior */
+    0,          /* generation */
+    NULL        /* query_cache */
+};
+
+void test_set_register(void)
+{
+    icalset *s;
+    icalcomponent *c;
+    icalset bad;
+    int count;
+    int i;
+    int estate;
+    char uid[80];
+
+    estate = icalerror_get_errors_are_fatal();
+
+    /* Built-in kinds always dispatch to their own implementations;
+       the refusal raises ICAL_USAGE_ERROR */
+    bad = ramset_class;
+    bad.kind = ICAL_FILE_SET;
+    icalerror_clear_errno();
+    icalerror_set_errors_are_fatal(0);
+    ok("registering a built-in kind fails", (icalset_register_class(&bad) == 0));
+    icalerror_set_errors_are_fatal(estate);
+
+    ok("registering the RAM class", (icalset_register_class(&ramset_class) == 1));
+
+    /* A kind nobody registered still fails cleanly */
+    icalerror_clear_errno();
+    icalerror_set_errors_are_fatal(0);
+    s = icalset_new((icalset_kind)(ICAL_USER_SET + 1), "nowhere", 0);
+    ok("unregistered kind is unimplemented",
+       (s == 0 && icalerrno == ICAL_UNIMPLEMENTED_ERROR));
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+
+    /* The registered class constructs and answers the generic calls */
+    s = icalset_new(ICAL_USER_SET, "ram", 0);
+    ok("constructing a registered class", (s != 0));
+    assert(s != 0);
+
+    for (i = 0; i < 3; i++) {
+        snprintf(uid, sizeof(uid), "ramset-uid-%d", i);
+        c = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstart(
+                                        icaltime_from_string("20250601T090000Z")),
+                                    (void *)0),
+                (void *)0);
+        int_is("adding through the dispatch layer",
+               icalset_add_component(s, c), ICAL_NO_ERROR);
+    }
+
+    count = 0;
+    for (c = icalset_get_first_component(s); c != 0; c = icalset_get_next_component(s)) {
+        count++;
+    }
+    int_is("iteration sees every component", count, 3);
+
+    c = icalset_fetch(s, "ramset-uid-1");
+    ok("fetch dispatches to the class", (c != NULL));
+    ok("fetch misses cleanly", (icalset_fetch(s, "ramset-uid-9") == NULL));
+
+    icalset_free(s);
+}
+
+void test_dirset_parallel(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *c, *results;
+    icalgauge *g;
+    struct icaltimetype tm;
+    int i;
+    char uid[80];
+
+    (void)mkdir("store-parallel", 0755);
+
+    /* Start from an empty store even if a previous run left one behind */
+    for (i = 0; i < 6; i++) {
+        snprintf(uid, sizeof(uid), "store-parallel/2024%02d", i + 1);
+        unlink(uid);
+    }
+    unlink("store-parallel/.icalindex");
+
+    s = icaldirset_new("store-parallel");
+    assert(s != 0);
+    for (i = 0; i < 6; i++) {
+        tm = icaltime_from_string("20240101T120000Z");
+        tm.month = i + 1;
+        snprintf(uid, sizeof(uid), "dirset-parallel-uid-%d", i);
+
+        c = icalcomponent_vanew(
+                ICAL_VCALENDAR_COMPONENT,
+                icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                    icalproperty_new_uid(uid),
+                                    icalproperty_new_dtstamp(tm),
+                                    icalproperty_new_dtstart(tm), (void *)0),
+                (void *)0);
+
+        (void)icaldirset_add_component(s, c);
+        (void)icaldirset_commit(s);
+    }
+    icalset_free(s);
+
+    /* An ungauged parallel scan returns the whole store */
+    s = icaldirset_new_reader("store-parallel");
+    assert(s != 0);
+    results = icaldirset_query_parallel(s, 0, 4);
+    ok("icaldirset_query_parallel()", (results != NULL));
+    assert(results != 0);
+    int_is("parallel scan returns every component",
+           icalcomponent_count_components(results, ICAL_VCALENDAR_COMPONENT), 6);
+    icalcomponent_free(results);
+
+    /* A gauged scan only returns matches, still in store order */
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20240215T000000Z'", 0);
+    assert(g != 0);
+    results = icaldirset_query_parallel(s, g, 4);
+    assert(results != 0);
+    int_is("gauged parallel scan filters",
+           icalcomponent_count_components(results, ICAL_VCALENDAR_COMPONENT), 4);
+
+    c = icalcomponent_get_first_component(results, ICAL_VCALENDAR_COMPONENT);
+    ok("parallel results keep store order",
+       (c != NULL &&
+        strcmp(icalcomponent_get_uid(icalcomponent_get_first_real_component(c)),
+               "dirset-parallel-uid-2") == 0));
+
+    icalcomponent_free(results);
+    icalgauge_free(g);
+    icalset_free(s);
+#endif
+}
+
+void test_compare()
+{
+    icalvalue *v1, *v2;
+
+    v1 = icalvalue_new_caladdress("cap://value/1");
+    v2 = icalvalue_clone(v1);
+
+    ok("compare value and clone", (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_EQUAL));
+
+    icalvalue_free(v1);
+    icalvalue_free(v2);
+
+    v1 = icalvalue_new_caladdress("A");
+    v2 = icalvalue_new_caladdress("B");
+
+    ok("test compare of A and B results in LESS",
+       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_LESS));
+
+    ok("test compare of B and A results in GREATER",
+       (icalvalue_compare(v2, v1) == ICAL_XLICCOMPARETYPE_GREATER));
+
+    icalvalue_free(v1);
+    icalvalue_free(v2);
+
+    v1 = icalvalue_new_caladdress("B");
+    v2 = icalvalue_new_caladdress("A");
+
+    ok("test compare of caladdress A and B results in GREATER",
+       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_GREATER));
+
+    icalvalue_free(v1);
+    icalvalue_free(v2);
+
+    v1 = icalvalue_new_integer(5);
+    v2 = icalvalue_new_integer(5);
+
+    ok("test compare of 5 and 5 results in EQUAL",
+       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_EQUAL));
+
+    icalvalue_free(v1);
+    icalvalue_free(v2);
+
+    v1 = icalvalue_new_integer(5);
+    v2 = icalvalue_new_integer(10);
+
+    ok("test compare of 5 and 10 results in LESS",
+       (icalvalue_compare(v1, v2) == ICAL_XLICCOMPARETYPE_LESS));
+
+    ok("test compare of 10 and 5 results in GREATER",
+       (icalvalue_compare(v2, v1) == ICAL_XLICCOMPARETYPE_GREATER));
+
+    icalvalue_free(v1);
+    icalvalue_free(v2);
+}
+
+void test_restriction()
+{
+    icalcomponent *comp;
+    struct icaltimetype atime = icaltime_from_timet_with_zone(time(0), 0, NULL);
+    int valid;
+
+    struct icaldatetimeperiodtype rtime;
+
+    rtime.period.start = icaltime_from_timet_with_zone(time(0), 0, NULL);
+    rtime.period.end = icaltime_from_timet_with_zone(time(0), 0, NULL);
+    rtime.period.end.hour++;
+    rtime.time = icaltime_null_time();
+
+    comp =
+        icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalproperty_new_version("2.0"),
+            icalproperty_new_prodid("-//RDU Software//NONSGML HandCal//EN"),
             icalproperty_new_method(ICAL_METHOD_REQUEST),
             icalcomponent_vanew(
                 ICAL_VTIMEZONE_COMPONENT,
@@ -1156,6 +2143,115 @@ void test_restriction()
     icalcomponent_free(comp);
 }
 
+void test_restriction_incremental()
+{
+    icalcomponent *comp, *event;
+    icalproperty *status;
+    struct icaltimetype atime = icaltime_from_timet_with_zone(time(0), 0, NULL);
+    int errors;
+
+    comp =
+        icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalproperty_new_version("2.0"),
+            icalproperty_new_prodid("-//RDU Software//NONSGML HandCal//EN"),
+            icalproperty_new_method(ICAL_METHOD_REQUEST),
+            icalcomponent_vanew(
+                ICAL_VEVENT_COMPONENT,
+                icalproperty_new_dtstamp(atime),
+                icalproperty_new_dtstart(atime),
+                icalproperty_new_uid("incremental-uid-1"),
+                icalproperty_new_organizer("mailto:mrbig@host.com"),
+                icalproperty_new_attendee("mailto:employee-A@host.com"),
+                icalproperty_new_summary("XYZ Project Review"),
+                icalproperty_new_status(ICAL_STATUS_CONFIRMED),
+                (void *)0),
+            (void *)0);
+
+    event = icalcomponent_get_first_component(comp, ICAL_VEVENT_COMPONENT);
+    status = icalcomponent_get_first_property(event, ICAL_STATUS_PROPERTY);
+
+    int_is("incremental check passes", icalrestriction_check_incremental(comp), 1);
+    int_is("repeated check still passes", icalrestriction_check_incremental(comp), 1);
+
+    /* An in-place mutation of an attached property must be noticed:
+       DRAFT is not a valid STATUS for a REQUEST. */
+    icalproperty_set_status(status, ICAL_STATUS_DRAFT);
+    int_is("in-place mutation is re-validated", icalrestriction_check_incremental(comp), 0);
+
+    errors = icalcomponent_count_errors(event);
+    ok("the failed check annotated the component", errors > 0);
+
+    /* Unchanged since the failure: the cached result is reused and no
+       duplicate X-LIC-ERROR properties pile up. */
+    int_is("cached failure is returned", icalrestriction_check_incremental(comp), 0);
+    int_is("a cache hit adds no duplicate errors", icalcomponent_count_errors(event), errors);
+
+    icalcomponent_strip_errors(event);
+    icalproperty_set_status(status, ICAL_STATUS_CONFIRMED);
+    int_is("the fixed component re-validates", icalrestriction_check_incremental(comp), 1);
+
+    icalcomponent_free(comp);
+}
+
+void test_restriction_parallel()
+{
+    icalcomponent *comp, *event;
+    icalproperty *status;
+    struct icaltimetype atime = icaltime_from_timet_with_zone(time(0), 0, NULL);
+    ical_threadpool *pool;
+    char uid[64];
+    int i;
+
+    comp = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalproperty_new_version("2.0"),
+        icalproperty_new_prodid("-//RDU Software//NONSGML HandCal//EN"),
+        icalproperty_new_method(ICAL_METHOD_REQUEST),
+        (void *)0);
+
+    for (i = 0; i < 40; i++) {
+        snprintf(uid, sizeof(uid), "parallel-uid-%d", i);
+        event = icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_dtstamp(atime),
+            icalproperty_new_dtstart(atime),
+            icalproperty_new_uid(uid),
+            icalproperty_new_organizer("mailto:mrbig@host.com"),
+            icalproperty_new_attendee("mailto:employee-A@host.com"),
+            icalproperty_new_summary("XYZ Project Review"),
+            icalproperty_new_status(ICAL_STATUS_CONFIRMED),
+            (void *)0);
+        icalcomponent_add_component(comp, event);
+    }
+
+    pool = ical_threadpool_new(2);
+    ok("created a pool for parallel validation", (pool != 0));
+    ical_threadpool_set_default(pool);
+
+    int_is("pooled check of a valid calendar passes", icalrestriction_check(comp), 1);
+
+    /* Break one child in the middle of the batch: DRAFT is not a
+       valid STATUS for a REQUEST. */
+    event = icalcomponent_get_first_component(comp, ICAL_VEVENT_COMPONENT);
+    for (i = 0; i < 20; i++) {
+        event = icalcomponent_get_next_component(comp, ICAL_VEVENT_COMPONENT);
+    }
+    status = icalcomponent_get_first_property(event, ICAL_STATUS_PROPERTY);
+    icalproperty_set_status(status, ICAL_STATUS_DRAFT);
+
+    int_is("pooled check catches the one bad child", icalrestriction_check(comp), 0);
+    ok("the bad child was annotated", icalcomponent_count_errors(event) > 0);
+
+    ical_threadpool_set_default(0);
+    ical_threadpool_free(pool);
+
+    /* The sequential path agrees with the pooled one */
+    int_is("sequential check agrees", icalrestriction_check(comp), 0);
+
+    icalcomponent_free(comp);
+}
+
 void test_calendar()
 {
     icalcomponent *comp;
@@ -1209,6 +2305,30 @@ void test_calendar()
     ok("icalcalendar test", (1));
 }
 
+void test_calendar_preload(void)
+{
+    icalcalendar *calendar;
+    icalset *booked;
+    int warmed;
+
+    (void)mkdir("calendar-preload", 0755);
+    (void)mkdir("calendar-preload/booked", 0755);
+
+    calendar = icalcalendar_new("calendar-preload");
+    assert(calendar != 0);
+
+    warmed = icalcalendar_preload(calendar, ICALCALENDAR_PRELOAD_ALL);
+    int_is("all member sets warmed", warmed, 4);
+
+    booked = icalcalendar_get_booked(calendar);
+    ok("booked set is open after preload", (booked != 0));
+    ok("getters return the pinned set", (booked == icalcalendar_get_booked(calendar)));
+    ok("incoming and properties are distinct sets",
+       (icalcalendar_get_incoming(calendar) != icalcalendar_get_properties(calendar)));
+
+    icalcalendar_free(calendar);
+}
+
 void test_increment(void);
 
 /* coverity[pass_by_value] */
@@ -1716,6 +2836,36 @@ void test_requeststat()
 	icalcomponent_free(c);
 }
 
+void test_dtstamp_now(void)
+{
+    icalcomponent *comps[3];
+    struct icaltimetype a, b;
+    int i;
+
+    /* Two reads inside the same process never go backwards, cached or
+       not */
+    a = icaltime_current_time_with_zone(icaltimezone_get_utc_timezone());
+    b = icaltime_current_time_with_zone(icaltimezone_get_utc_timezone());
+    ok("coarse clock does not go backwards", (icaltime_compare(a, b) <= 0));
+
+    for (i = 0; i < 3; i++) {
+        comps[i] = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                       icalproperty_new_uid("dtstamp-now-uid"), (void *)0);
+    }
+
+    icalcomponent_set_dtstamp_now(comps, 3);
+
+    ok("every component got a DTSTAMP",
+       (icalcomponent_get_first_property(comps[0], ICAL_DTSTAMP_PROPERTY) != 0));
+    ok("one clock read stamps the whole batch",
+       (icaltime_compare(icalcomponent_get_dtstamp(comps[0]),
+                         icalcomponent_get_dtstamp(comps[2])) == 0));
+
+    for (i = 0; i < 3; i++) {
+        icalcomponent_free(comps[i]);
+    }
+}
+
 void test_dtstart()
 {
     struct icaltimetype tt, tt2;
@@ -2219,6 +3369,57 @@ void test_iterators()
     icalcomponent_free(c);
 }
 
+void test_external_iterators()
+{
+    icalcomponent *c;
+    icalproperty *p, *q;
+    icalparameter *param;
+    icalpropiter pi, pj;
+    icalparamiter mi;
+    int pairs = 0;
+    int cns = 0;
+
+    c = icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_comment("one"),
+            icalproperty_new_comment("two"),
+            icalproperty_vanew_comment("three",
+                icalparameter_new_cn("A Common Name 1"),
+                icalparameter_new_cn("A Common Name 2"),
+                icalparameter_new_language("en"), (void *)0),
+            (void *)0);
+
+    /* Two property loops over the same component at once; the internal
+       get_first/get_next iterator would have them corrupt each other. */
+    for (pi = icalcomponent_begin_property(c, ICAL_COMMENT_PROPERTY);
+         (p = icalpropiter_deref(&pi)) != 0; icalpropiter_next(&pi)) {
+
+        for (pj = icalcomponent_begin_property(c, ICAL_COMMENT_PROPERTY);
+             (q = icalpropiter_deref(&pj)) != 0; icalpropiter_next(&pj)) {
+            pairs++;
+        }
+    }
+
+    int_is("nested external property loops visit all pairs", pairs, 9);
+
+    /* Walk one property's parameters by kind. */
+    pi = icalcomponent_begin_property(c, ICAL_COMMENT_PROPERTY);
+    (void)icalpropiter_next(&pi);
+    (void)icalpropiter_next(&pi);
+    p = icalpropiter_deref(&pi);
+
+    for (mi = icalproperty_begin_parameter(p, ICAL_CN_PARAMETER);
+         (param = icalparamiter_deref(&mi)) != 0; icalparamiter_next(&mi)) {
+        cns++;
+    }
+
+    int_is("external parameter iterator sees both CN parameters", cns, 2);
+    ok("kind filter skips the LANGUAGE parameter",
+       icalpropiter_deref(&pi) != 0 && cns == icalproperty_count_parameters(p) - 1);
+
+    icalcomponent_free(c);
+}
+
 void test_time()
 {
     const char *zones[6] =
@@ -2275,7 +3476,7 @@ void test_overlaps()
 
     time_t hh = 1800;   /* one half hour */
 
-    icalfileset_options options = { O_RDONLY, 0644, 0, NULL };
+    icalfileset_options options = { O_RDONLY, 0644, 0, NULL, 0, 0, 0, 0 };
     set = icalset_new(ICAL_FILE_SET, TEST_DATADIR "/overlaps.ics", &options);
 
     c = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
@@ -2344,7 +3545,7 @@ void test_overlaps()
 void test_fblist()
 {
     icalspanlist *sl, *new_sl;
-    icalfileset_options options = { O_RDONLY, 0644, 0, NULL };
+    icalfileset_options options = { O_RDONLY, 0644, 0, NULL, 0, 0, 0, 0 };
     icalset *set = icalset_new(ICAL_FILE_SET, TEST_DATADIR "/spanlist.ics", &options);
     struct icalperiodtype period;
     icalcomponent *comp, *fbcomp;
@@ -2380,10 +3581,94 @@ void test_fblist()
     str_is("Next Free time end   19980102T010000", icaltime_as_ical_string(period.end),
            "19980102T010000");
 
-    if (VERBOSE) {
-		fbcomp = icalspanlist_as_vfreebusy(sl, "a@foo.com", "b@foo.com");
-        printf("%s\n", icalcomponent_as_ical_string(fbcomp));
-		icalcomponent_free(fbcomp);
+    int_is("query range inside a busy span",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980101T003000Z"),
+                                    icaltime_from_string("19980101T004500Z")), 1);
+
+    int_is("query range over a free gap",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980101T010000Z"),
+                                    icaltime_from_string("19980102T010000Z")), 0);
+
+    int_is("query range spanning several busy spans",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980102T120000Z"),
+                                    icaltime_from_string("19980104T120000Z")), 3);
+
+    /* Incrementally add and remove one event without rebuilding */
+    comp = icalcomponent_vanew(
+        ICAL_VEVENT_COMPONENT,
+        icalproperty_new_dtstart(icaltime_from_string("19980107T100000Z")),
+        icalproperty_new_dtend(icaltime_from_string("19980107T110000Z")),
+        (void *)0);
+
+    int_is("incremental add succeeds",
+           icalspanlist_add_component(sl, comp), ICAL_NO_ERROR);
+
+    int_is("added span shows up busy",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980107T090000Z"),
+                                    icaltime_from_string("19980107T120000Z")), 1);
+
+    int_is("incremental remove succeeds",
+           icalspanlist_remove_component(sl, comp), ICAL_NO_ERROR);
+
+    int_is("removed span is free again",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980107T090000Z"),
+                                    icaltime_from_string("19980107T120000Z")), 0);
+
+    int_is("original spans survive the edit",
+           icalspanlist_query_range(sl,
+                                    icaltime_from_string("19980101T003000Z"),
+                                    icaltime_from_string("19980101T004500Z")), 1);
+
+    icalcomponent_free(comp);
+
+    {
+        struct icaltime_span *spans;
+        struct icaltime_span ranges[3];
+        int counts[3] = { -1, -1, -1 };
+        int nspans = 0;
+        int sorted = 1;
+        icaltimezone *utc = icaltimezone_get_utc_timezone();
+
+        spans = icalspanlist_get_spans_array(sl, &nspans);
+        ok("bulk span array is returned", (spans != NULL && nspans > 0));
+        if (spans != NULL) {
+            for (i = 1; i < nspans; i++) {
+                if (spans[i].start < spans[i - 1].start) {
+                    sorted = 0;
+                }
+            }
+            ok("bulk span array is in start order", sorted);
+            icalmemory_free_buffer(spans);
+        }
+
+        ranges[0].start =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980101T003000Z"), utc);
+        ranges[0].end =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980101T004500Z"), utc);
+        ranges[1].start =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980101T010000Z"), utc);
+        ranges[1].end =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980102T010000Z"), utc);
+        ranges[2].start =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980102T120000Z"), utc);
+        ranges[2].end =
+            icaltime_as_timet_with_zone(icaltime_from_string("19980104T120000Z"), utc);
+
+        int_is("batch query succeeds", icalspanlist_query_spans(sl, ranges, 3, counts), 0);
+        int_is("batch count inside a busy span", counts[0], 1);
+        int_is("batch count over a free gap", counts[1], 0);
+        int_is("batch count spanning several busy spans", counts[2], 3);
+    }
+
+    if (VERBOSE) {
+		fbcomp = icalspanlist_as_vfreebusy(sl, "a@foo.com", "b@foo.com");
+        printf("%s\n", icalcomponent_as_ical_string(fbcomp));
+		icalcomponent_free(fbcomp);
     }
 
     foo = icalspanlist_as_freebusy_matrix(sl, 3600);
@@ -2476,6 +3761,101 @@ void test_fblist()
     icalset_free(set);
 }
 
+void test_periodarray()
+{
+    struct icalperiodtype periods[3];
+    struct icalperiodarraytype pa;
+    icalvalue *value, *reparsed;
+    icalcomponent *fb, *fb2, *fb3;
+    icalproperty *prop;
+    icalspanlist *sl;
+    char *str;
+    const char *prop_str;
+    const char *c;
+    int i, count;
+
+    periods[0] = icalperiodtype_from_string("20260101T100000Z/20260101T110000Z");
+    periods[1] = icalperiodtype_from_string("20260102T100000Z/20260102T110000Z");
+    periods[2] = icalperiodtype_from_string("20260103T100000Z/20260103T110000Z");
+
+    pa.periods = periods;
+    pa.num_periods = 3;
+
+    value = icalvalue_new_periodarray(pa);
+    str = icalvalue_as_ical_string_r(value);
+
+    str_is("periodarray serializes comma-separated", str,
+           "20260101T100000Z/20260101T110000Z,"
+           "20260102T100000Z/20260102T110000Z,"
+           "20260103T100000Z/20260103T110000Z");
+
+    reparsed = icalvalue_new_from_string(ICAL_PERIODARRAY_VALUE, str);
+    ok("periodarray parses back from string",
+       (reparsed != 0 && icalvalue_get_periodarray(reparsed).num_periods == 3));
+    ok("reparsed first period matches",
+       (reparsed != 0 &&
+        icaltime_compare(icalvalue_get_periodarray(reparsed).periods[0].start,
+                         periods[0].start) == 0));
+
+    icalmemory_free_buffer(str);
+    icalvalue_free(value);
+    if (reparsed)
+        icalvalue_free(reparsed);
+
+    /* One FREEBUSY property carrying all three periods. FBTYPE=FREE is
+       what icalspanlist_from_vfreebusy counts as busy. */
+    fb = icalcomponent_new_vfreebusy();
+    prop = icalproperty_new(ICAL_FREEBUSY_PROPERTY);
+    icalproperty_set_value(prop, icalvalue_new_periodarray(pa));
+    icalproperty_add_parameter(prop, icalparameter_new_fbtype(ICAL_FBTYPE_FREE));
+    icalcomponent_add_property(fb, prop);
+
+    prop_str = icalproperty_as_ical_string(prop);
+    ok("packed FREEBUSY emits no VALUE parameter",
+       (strstr(prop_str, "VALUE=") == 0));
+
+    sl = icalspanlist_from_vfreebusy(fb);
+    ok("spanlist from packed VFREEBUSY", (sl != 0));
+
+    fb2 = icalspanlist_as_vfreebusy(sl, "a@foo.com", "b@foo.com");
+    ok("VFREEBUSY from spanlist", (fb2 != 0));
+
+    count = 0;
+    for (prop = icalcomponent_get_first_property(fb2, ICAL_FREEBUSY_PROPERTY);
+         prop != 0;
+         prop = icalcomponent_get_next_property(fb2, ICAL_FREEBUSY_PROPERTY)) {
+        count++;
+    }
+    int_is("busy spans packed into a single property", count, 1);
+
+    prop = icalcomponent_get_first_property(fb2, ICAL_FREEBUSY_PROPERTY);
+    prop_str = (prop != 0) ? icalproperty_as_ical_string(prop) : "";
+    i = 0;
+    for (c = prop_str; *c != '\0'; c++) {
+        if (*c == ',')
+            i++;
+    }
+    int_is("packed property holds three periods", i, 2);
+
+    /* the wire format is plain RFC 5545 comma syntax, so a reparse
+       splits it back into one property per period */
+    str = icalcomponent_as_ical_string_r(fb2);
+    fb3 = icalcomponent_new_from_string(str);
+    count = 0;
+    for (prop = icalcomponent_get_first_property(fb3, ICAL_FREEBUSY_PROPERTY);
+         prop != 0;
+         prop = icalcomponent_get_next_property(fb3, ICAL_FREEBUSY_PROPERTY)) {
+        count++;
+    }
+    int_is("reparsed component splits the periods", count, 3);
+
+    icalmemory_free_buffer(str);
+    icalspanlist_free(sl);
+    icalcomponent_free(fb);
+    icalcomponent_free(fb2);
+    icalcomponent_free(fb3);
+}
+
 void test_convenience()
 {
     icalcomponent *c;
@@ -2714,6 +4094,28 @@ void test_recur_parser()
 }
 
 
+void test_daynum_conversion(void)
+{
+    long dn;
+    int y, m, d, failed = 0;
+
+    int_is("1970-01-01 is day 0", (int)icaltime_date_to_daynum(1970, 1, 1), 0);
+    int_is("2000-03-01 day number", (int)icaltime_date_to_daynum(2000, 3, 1), 11017);
+    int_is("1969-12-31 is day -1", (int)icaltime_date_to_daynum(1969, 12, 31), -1);
+
+    icaltime_daynum_to_date(11017, &y, &m, &d);
+    ok("day 11017 converts back to 2000-03-01", (y == 2000 && m == 3 && d == 1));
+
+    /* Round trip across four centuries, covering the 100/400-year
+       leap rules on both sides of the epoch. */
+    for (dn = -73049; dn <= 73049; dn += 13) {
+        icaltime_daynum_to_date(dn, &y, &m, &d);
+        if (icaltime_date_to_daynum(y, m, d) != dn)
+            failed++;
+    }
+    int_is("daynum round trips", failed, 0);
+}
+
 static int test_juldat_caldat_instance(long year, int month, int day) {
 
     struct icaltimetype t;
@@ -2980,429 +4382,3002 @@ void test_x()
     icalcomponent_free(icalcomp);
 }
 
-void test_gauge_sql()
+struct parse_stream_stats
 {
-    icalgauge *g;
-    const char *str;
-
-    str =
-        "SELECT DTSTART,DTEND,COMMENT FROM VEVENT,VTODO WHERE VEVENT.SUMMARY = 'Bongoa' AND SEQUENCE < 5";
-
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != NULL));
-    if (VERBOSE)
-        icalgauge_dump(g);
-
-    icalgauge_free(g);
+    int begins;
+    int ends;
+    int props;
+    char uid[80];
+};
 
-    str =
-        "SELECT * FROM VEVENT,VTODO WHERE VEVENT.SUMMARY = 'Bongoa' AND SEQUENCE < 5 OR METHOD != 'CREATE'";
+static int parse_stream_cb(const icalparser_event *event, void *d)
+{
+    struct parse_stream_stats *stats = (struct parse_stream_stats *)d;
+
+    switch (event->type) {
+    case ICALPARSER_EVENT_BEGIN_COMPONENT:
+        stats->begins++;
+        break;
+    case ICALPARSER_EVENT_END_COMPONENT:
+        stats->ends++;
+        break;
+    case ICALPARSER_EVENT_PROPERTY:
+        stats->props++;
+        if (event->name_length == 3 && strncmp(event->name, "UID", 3) == 0 &&
+            event->value_length < sizeof(stats->uid)) {
+            memcpy(stats->uid, event->value, event->value_length);
+            stats->uid[event->value_length] = '\0';
+        }
+        break;
+    }
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != NULL));
-    if (VERBOSE)
-        icalgauge_dump(g);
+    return 0;
+}
 
-    icalgauge_free(g);
+static int parse_stream_abort_cb(const icalparser_event *event, void *d)
+{
+    int *count = (int *)d;
 
-    str = "SELECT * FROM VEVENT WHERE SUMMARY == 'BA301'";
+    _unused(event);
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != NULL));
-    if (VERBOSE)
-        icalgauge_dump(g);
+    return ++(*count) == 2;
+}
 
-    icalgauge_free(g);
+void test_parse_stream()
+{
+    static const char test_icalcomp_str[] =
+        "BEGIN:VCALENDAR\r\n"
+        "BEGIN:VEVENT\r\n"
+        "UID:12345678@example.com\r\n"
+        "DTSTART;TZID=America/New_York:20180220T020000\r\n"
+        "SUMMARY:A folded\r\n"
+        "  summary\r\n"
+        "END:VEVENT\r\n"
+        "END:VCALENDAR\r\n";
 
-    str = "SELECT * FROM VEVENT WHERE SUMMARY == 'BA301'";
+    struct parse_stream_stats stats;
+    int count = 0;
+    int r;
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != NULL));
-    if (VERBOSE)
-        icalgauge_dump(g);
+    memset(&stats, 0, sizeof(stats));
 
-    icalgauge_free(g);
+    r = icalparser_parse_stream(test_icalcomp_str, strlen(test_icalcomp_str),
+                                parse_stream_cb, &stats);
 
-    str = "SELECT * FROM VEVENT WHERE LOCATION == '104 Forum'";
+    int_is("icalparser_parse_stream()", r, 0);
+    int_is("two BEGINs", stats.begins, 2);
+    int_is("two ENDs", stats.ends, 2);
+    int_is("three properties", stats.props, 3);
+    str_is("UID slice", stats.uid, "12345678@example.com");
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != NULL));
-    if (VERBOSE)
-        icalgauge_dump(g);
+    r = icalparser_parse_stream(test_icalcomp_str, strlen(test_icalcomp_str),
+                                parse_stream_abort_cb, &count);
 
-    icalgauge_free(g);
+    ok("callback can stop the parse", (r != 0 && count == 2));
 }
 
-void test_gauge_compare()
+void test_parse_batch()
 {
-    icalgauge *g;
-    icalcomponent *c;
-    const char *str;
-
-    /* Equality */
+    static const char *calendars[3] = {
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:batch-1\nEND:VEVENT\nEND:VCALENDAR\n",
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:batch-2\nEND:VEVENT\nEND:VCALENDAR\n",
+        "not a calendar at all"
+    };
 
-    c = icalcomponent_vanew(
-            ICAL_VCALENDAR_COMPONENT,
-            icalcomponent_vanew(
-                ICAL_VEVENT_COMPONENT,
-                icalproperty_new_dtstart(icaltime_from_string("20000101T000002")), 0),
-            (void *)0);
+    icalcomponent *components[3];
+    int r, i;
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART = '20000101T000002'";
-    g = icalgauge_new_from_sql(str, 0);
+    r = icalparser_parse_batch(calendars, 3, 2, components);
 
-    ok(str, (c != 0 && g != 0));
-    assert(c != 0);
-    assert(g != 0);
+    int_is("icalparser_parse_batch()", r, 0);
+    ok("first result parsed", (components[0] != 0));
+    ok("second result parsed", (components[1] != 0));
 
-    int_is("compare", icalgauge_compare(g, c), 1);
+    for (i = 0; i < 2; i++) {
+        icalcomponent *event;
 
-	if (g != NULL)
-		icalgauge_free(g);
+        assert(components[i] != 0);
+        event = icalcomponent_get_first_component(components[i], ICAL_VEVENT_COMPONENT);
+        ok("batch result is in input order", (event != 0 && icalcomponent_get_uid(event) != 0 &&
+                                              (int)(icalcomponent_get_uid(event)[6] - '1') == i));
+    }
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART = '20000101T000001'";
-    g = icalgauge_new_from_sql(str, 0);
+    ok("garbage input yields NULL", (components[2] == 0));
 
-    ok(str, (g != 0));
+    for (i = 0; i < 3; i++) {
+        if (components[i] != 0) {
+            icalcomponent_free(components[i]);
+        }
+    }
+}
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 0);
+static void test_threadpool_count_task(void *ctx, size_t i)
+{
+    int *slots = (int *)ctx;
 
-    icalgauge_free(g);
+    slots[i]++;
+}
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART != '20000101T000003'";
-    g = icalgauge_new_from_sql(str, 0);
+void test_threadpool()
+{
+    static const char *calendars[2] = {
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:pool-1\nEND:VEVENT\nEND:VCALENDAR\n",
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:pool-2\nEND:VEVENT\nEND:VCALENDAR\n"
+    };
 
-    ok(str, (c != 0 && g != 0));
+    ical_threadpool *pool;
+    icalcomponent *components[2];
+    int slots[50];
+    int all_once = 1;
+    int i;
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 1);
+    pool = ical_threadpool_new(2);
+    ok("created a pool with two workers", (pool != 0));
 
-	if (g != NULL)
-		icalgauge_free(g);
+    if (pool == 0) {
+        return;
+    }
 
-    /* Less than */
+    memset(slots, 0, sizeof(slots));
+    int_is("batch of 50 tasks runs to completion",
+           ical_threadpool_run_batch(pool, test_threadpool_count_task, slots, 50), 0);
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART < '20000101T000003'";
-    g = icalgauge_new_from_sql(str, 0);
+    for (i = 0; i < 50; i++) {
+        if (slots[i] != 1) {
+            all_once = 0;
+        }
+    }
+    ok("every task ran exactly once", all_once);
 
-    ok(str, (c != 0 && g != 0));
+    /* A second batch reuses the same workers */
+    memset(slots, 0, sizeof(slots));
+    (void)ical_threadpool_run_batch(pool, test_threadpool_count_task, slots, 7);
+    int_is("pool survives a second, smaller batch", slots[6], 1);
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 1);
+    /* With the pool installed as default, batch parsing runs on it */
+    ical_threadpool_set_default(pool);
+    ok("default pool is installed", (ical_threadpool_get_default() == pool));
 
-	if (g != NULL)
-		icalgauge_free(g);
+    int_is("icalparser_parse_batch() on the pool",
+           icalparser_parse_batch(calendars, 2, 4, components), 0);
+    ok("pooled batch parse produced both components",
+       (components[0] != 0 && components[1] != 0));
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART < '20000101T000002'";
-    g = icalgauge_new_from_sql(str, 0);
+    for (i = 0; i < 2; i++) {
+        if (components[i] != 0) {
+            icalcomponent_free(components[i]);
+        }
+    }
 
-    ok(str, (g != 0));
+    ical_threadpool_set_default(0);
+    ical_threadpool_free(pool);
+}
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 0);
+static void test_trace_callback(ical_trace_point point, long long duration_ns, void *user)
+{
+    _unused(point);
+    _unused(duration_ns);
 
-    icalgauge_free(g);
+    (*(int *)user)++;
+}
 
-    /* Greater than */
+void test_trace()
+{
+    icalcomponent *c;
+    unsigned long parses;
+    int events = 0;
+    int named = 1;
+    int i;
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000001'";
-    g = icalgauge_new_from_sql(str, 0);
+    for (i = 0; i < ICAL_TRACE_POINT_COUNT; i++) {
+        if (ical_trace_point_name((ical_trace_point) i) == 0) {
+            named = 0;
+        }
+    }
+    ok("every tracepoint has a name", named);
+    ok("out-of-range tracepoint has no name",
+       (ical_trace_point_name(ICAL_TRACE_POINT_COUNT) == 0));
+
+    ical_trace_reset_counts();
+    ical_trace_set_callback(test_trace_callback, &events);
+
+    c = icalparser_parse_string("BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:trace-1\n"
+                                "END:VEVENT\nEND:VCALENDAR\n");
+    ok("parse under tracing succeeded", (c != 0));
+    (void)icalcomponent_as_ical_string(c);
+
+    parses = ical_trace_get_count(ICAL_TRACE_PARSE_COMPONENT);
+
+#if ICAL_ENABLE_TRACE == 1
+    ok("parse tracepoint fired", (parses >= 1));
+    ok("serialize tracepoint fired",
+       (ical_trace_get_count(ICAL_TRACE_SERIALIZE_COMPONENT) >= 1));
+    ok("the callback saw the events", (events > 0));
+    ical_trace_reset_counts();
+    int_is("counters reset to zero",
+           (int)ical_trace_get_count(ICAL_TRACE_PARSE_COMPONENT), 0);
+#else
+    ok("tracepoints are compiled out", (parses == 0 && events == 0));
+#endif
 
-    ok(str, (g != 0));
+    ical_trace_set_callback(0, 0);
+    if (c != 0) {
+        icalcomponent_free(c);
+    }
+}
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 1);
+struct mime_string_cursor
+{
+    const char *pos;
+};
 
-	if (g != NULL)
-		icalgauge_free(g);
+static char *mime_string_line_generator(char *out, size_t buf_size, void *d)
+{
+    struct mime_string_cursor *cursor = (struct mime_string_cursor *)d;
+    const char *eol;
+    size_t len;
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000002'";
-    g = icalgauge_new_from_sql(str, 0);
+    if (*cursor->pos == '\0') {
+        return 0;
+    }
 
-    ok(str, (g != 0));
+    eol = strchr(cursor->pos, '\n');
+    if (eol == 0) {
+        eol = cursor->pos + strlen(cursor->pos) - 1;
+    }
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 0);
+    len = (size_t)(eol - cursor->pos) + 1;
+    if (len >= buf_size) {
+        len = buf_size - 1;
+    }
 
-    icalgauge_free(g);
+    memcpy(out, cursor->pos, len);
+    out[len] = '\0';
+    cursor->pos += len;
 
-    /* Greater than or Equal to */
+    return out;
+}
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART >= '20000101T000002'";
-    g = icalgauge_new_from_sql(str, 0);
+void test_mime_streaming()
+{
+    static const char message[] =
+        "To: alice@example.com\n"
+        "From: bob@example.com\n"
+        "Mime-Version: 1.0\n"
+        "Content-Type: multipart/mixed; boundary=outer\n"
+        "\n"
+        "--outer\n"
+        "Content-Type: text/plain\n"
+        "\n"
+        "Please find the invitation attached.\n"
+        "--outer\n"
+        "Content-Type: application/octet-stream\n"
+        "\n"
+        "not-actually-binary-attachment-data\n"
+        "more-attachment-data\n"
+        "--outer\n"
+        "Content-Type: text/calendar\n"
+        "\n"
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "PRODID:-//ACME//NONSGML Intake//EN\n"
+        "BEGIN:VEVENT\n"
+        "UID:mime-streaming-1@example.com\n"
+        "DTSTAMP:20250101T000000Z\n"
+        "DTSTART:20250102T090000Z\n"
+        "SUMMARY:Streamed invitation\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n"
+        "--outer--\n";
+
+    static const char no_calendar[] =
+        "Mime-Version: 1.0\n"
+        "Content-Type: multipart/mixed; boundary=outer\n"
+        "\n"
+        "--outer\n"
+        "Content-Type: text/plain\n"
+        "\n"
+        "No invitation here.\n"
+        "--outer--\n";
+
+    struct mime_string_cursor cursor;
+    icalcomponent *c, *event;
+    char *buf;
+
+    cursor.pos = message;
+    c = icalmime_parse_calendar(mime_string_line_generator, &cursor);
+
+    ok("streaming parse found the calendar part", (c != 0));
+    assert(c != 0);
+    ok("the part parsed to a VCALENDAR", (icalcomponent_isa(c) == ICAL_VCALENDAR_COMPONENT));
 
-    ok(str, (g != 0));
+    event = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+    ok("the calendar holds the event", (event != 0));
+    if (event != 0) {
+        str_is("event summary survived the intake path",
+               icalcomponent_get_summary(event), "Streamed invitation");
+    }
+    icalcomponent_free(c);
 
-    int_is("compare", icalgauge_compare(g, c), 1);
+    cursor.pos = no_calendar;
+    c = icalmime_parse_calendar(mime_string_line_generator, &cursor);
+    ok("a message without a calendar part yields NULL", (c == 0));
+    if (c != 0) {
+        icalcomponent_free(c);
+    }
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* The zero-copy entry point parses the same message from a
+       caller-owned buffer and leaves it untouched afterwards */
+    buf = icalmemory_strdup(message);
+    c = icalmime_parse_buffer(buf, strlen(buf));
+
+    ok("buffer parse found the calendar part", (c != 0));
+    if (c != 0) {
+        ok("buffer parse produced a VCALENDAR",
+           (icalcomponent_isa(c) == ICAL_VCALENDAR_COMPONENT));
+        event = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+        if (event != 0) {
+            str_is("event summary survived the buffer path",
+                   icalcomponent_get_summary(event), "Streamed invitation");
+        }
+        icalcomponent_free(c);
+    }
+    ok("the caller's buffer was restored after the parse",
+       (memcmp(buf, message, sizeof(message) - 1) == 0));
+    icalmemory_free_buffer(buf);
+}
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART >= '20000101T000003'";
-    g = icalgauge_new_from_sql(str, 0);
+void test_base64_decode()
+{
+    /* Long enough to cover several 16-character blocks plus a scalar
+       tail with padding */
+    static const char plain[] =
+        "The quick brown fox jumps over the lazy dog. 0123456789 "
+        "~!@#$%^&*()_+ The quick brown fox";
+    static const char encoded[] =
+        "VGhlIHF1aWNrIGJyb3duIGZveCBqdW1wcyBvdmVyIHRoZSBsYXp5IGRvZy4gMDEyMzQ1"
+        "Njc4OSB+IUAjJCVeJiooKV8rIFRoZSBxdWljayBicm93biBmb3g=";
+    char out[256];
+    size_t size;
+
+    size = strlen(encoded);
+    (void)decode_base64(out, (char *)encoded, &size);
+    out[size] = '\0';
+    int_is("decoded length", (int)size, (int)strlen(plain));
+    str_is("block-decoded content round-trips", out, plain);
+
+    size = 8;
+    (void)decode_base64(out, (char *)"Zm9vYmFy", &size);
+    out[size] = '\0';
+    str_is("short input takes the scalar path", out, "foobar");
+}
 
-    ok(str, (g != 0));
+void test_expand_range()
+{
+    struct icalrecurrencetype rrule;
+    struct icaltimetype dtstart, start, end;
+    struct icaltimetype occ[32];
+    size_t n;
+
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY");
+    dtstart = icaltime_from_string("20250101T090000Z");
+    start = icaltime_from_string("20250105T000000Z");
+    end = icaltime_from_string("20250110T000000Z");
+
+    n = icalrecur_expand_range(rrule, dtstart, start, end, occ, 32);
+    int_is("daily rule yields five occurrences in window", (int)n, 5);
+    if (n == 5) {
+        str_is("first occurrence", ictt_as_string(occ[0]), "2025-01-05 09:00:00 Z UTC");
+        str_is("last occurrence", ictt_as_string(occ[4]), "2025-01-09 09:00:00 Z UTC");
+    }
 
-    int_is("compare", icalgauge_compare(g, c), 0);
+    /* COUNT rules cannot seek, so the window is applied by filtering */
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;COUNT=6");
+    n = icalrecur_expand_range(rrule, dtstart, start, end, occ, 32);
+    int_is("COUNT rule filtered against window", (int)n, 2);
 
-    icalgauge_free(g);
+    /* Truncation by the caller's array size */
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY");
+    n = icalrecur_expand_range(rrule, dtstart, start, end, occ, 3);
+    int_is("output truncated at max", (int)n, 3);
 
-    /* Less than or Equal to */
+    /* The analytic estimator bounds the same expansions */
+    int_is("estimate for plain daily rule", (int)
+           icalrecurrencetype_estimate_count(rrule, dtstart, start, end), 6);
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART <= '20000101T000002'";
-    g = icalgauge_new_from_sql(str, 0);
+    rrule = icalrecurrencetype_from_string("FREQ=WEEKLY;BYDAY=MO,TU,WE,TH,FR");
+    ok("weekly BYDAY estimate is an upper bound",
+       (icalrecurrencetype_estimate_count(rrule, dtstart, start, end) >= 4));
 
-    ok(str, (g != 0));
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;COUNT=3");
+    int_is("COUNT caps the estimate", (int)
+           icalrecurrencetype_estimate_count(rrule, dtstart, start, end), 3);
 
-    assert(g != 0);
-    int_is("compare", icalgauge_compare(g, c), 1);
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY");
+    ok("unbounded rule reported as unbounded",
+       (icalrecurrencetype_estimate_count(rrule, dtstart, start,
+                                          icaltime_null_time()) == (size_t)-1));
+}
 
-	if (g != NULL)
-		icalgauge_free(g);
+static void foreach_batch_cb(icalcomponent *comp, struct icaltime_span *span, void *data)
+{
+    _unused(comp);
+    _unused(span);
+    (*(int *)data)++;
+}
 
-	str = "SELECT * FROM VEVENT WHERE DTSTART <= '20000101T000001'";
-    g = icalgauge_new_from_sql(str, 0);
+void test_last_before()
+{
+    struct icalrecurrencetype rrule;
+    struct icaltimetype dtstart, t, last;
+
+    /* A decade-old weekly meeting: reverse seek instead of a forward walk */
+    rrule = icalrecurrencetype_from_string("FREQ=WEEKLY");
+    dtstart = icaltime_from_string("20150106T100000Z");
+    t = icaltime_from_string("20250820T000000Z");
+
+    last = icalrecur_last_occurrence_before(rrule, dtstart, t);
+    str_is("weekly occurrence before query",
+           ictt_as_string(last), "2025-08-19 10:00:00 Z UTC");
+
+    /* An occurrence exactly at t is not 'before' it */
+    t = icaltime_from_string("20250819T100000Z");
+    last = icalrecur_last_occurrence_before(rrule, dtstart, t);
+    str_is("exact match excluded",
+           ictt_as_string(last), "2025-08-12 10:00:00 Z UTC");
+
+    /* COUNT rules walk forward and stop at the rule's end */
+    rrule = icalrecurrencetype_from_string("FREQ=WEEKLY;COUNT=3");
+    t = icaltime_from_string("20250820T000000Z");
+    last = icalrecur_last_occurrence_before(rrule, dtstart, t);
+    str_is("COUNT rule last occurrence",
+           ictt_as_string(last), "2015-01-20 10:00:00 Z UTC");
+
+    /* Nothing precedes DTSTART */
+    t = icaltime_from_string("20140101T000000Z");
+    last = icalrecur_last_occurrence_before(rrule, dtstart, t);
+    ok("query before DTSTART yields null", icaltime_is_null_time(last));
+}
 
-    ok(str, (g != 0));
+void test_foreach_batch()
+{
+    icalcomponent *comps[4];
+    int counts[4] = { 0, 0, 0, 0 };
+    void *datas[4];
+    struct icaltimetype start, end;
+    int i;
 
-    int_is("compare", icalgauge_compare(g, c), 0);
+    for (i = 0; i < 4; i++) {
+        char ics[256];
+
+        snprintf(ics, sizeof(ics),
+                 "BEGIN:VEVENT\n"
+                 "UID:batch-%d\n"
+                 "DTSTART:20250101T%02d0000Z\n"
+                 "DTEND:20250101T%02d3000Z\n"
+                 "RRULE:FREQ=DAILY;COUNT=%d\n"
+                 "END:VEVENT\n", i, i + 8, i + 8, i + 2);
+        comps[i] = icalparser_parse_string(ics);
+        datas[i] = &counts[i];
+    }
 
-    icalgauge_free(g);
+    start = icaltime_from_string("20250101T000000Z");
+    end = icaltime_from_string("20250201T000000Z");
 
-    icalcomponent_free(c);
+    icalcomponent_foreach_recurrence_batch(comps, 4, start, end,
+                                           foreach_batch_cb, datas, 4);
 
-    /* Combinations */
+    for (i = 0; i < 4; i++) {
+        int_is("per-component occurrence count", counts[i], i + 2);
+        icalcomponent_free(comps[i]);
+    }
+}
 
-    c = icalcomponent_vanew(
-            ICAL_VCALENDAR_COMPONENT,
-            icalcomponent_vanew(
-                ICAL_VEVENT_COMPONENT,
-                icalproperty_new_dtstart(icaltime_from_string("20000102T000000")), 0),
-            (void *)0);
+void test_recur_resume()
+{
+    struct icalrecurrencetype rrule;
+    struct icaltimetype dtstart, next, expected;
+    icalrecur_iterator *ritr, *page2;
+    icalrecur_iterator_position pos;
+    int i;
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000103T000000'";
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;COUNT=10");
+    dtstart = icaltime_from_string("20250101T090000Z");
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    for (i = 0; i < 4; i++) {
+        (void)icalrecur_iterator_next(ritr);
+    }
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* A clone continues independently from the same position */
+    page2 = icalrecur_iterator_clone(ritr);
+    next = icalrecur_iterator_next(ritr);
+    expected = icalrecur_iterator_next(page2);
+    ok("clone yields the same next occurrence", (icaltime_compare(next, expected) == 0));
+    str_is("clone occurrence", ictt_as_string(expected), "2025-01-05 09:00:00 Z UTC");
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000102T000000'";
+    /* A position token resumes a fresh iterator, COUNT included */
+    pos = icalrecur_iterator_get_position(ritr);
+    icalrecur_iterator_free(ritr);
+    icalrecur_iterator_free(page2);
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 0);
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    ok("resume from token", icalrecur_iterator_set_position(ritr, pos));
 
-    icalgauge_free(g);
+    for (i = 0; !icaltime_is_null_time(icalrecur_iterator_next(ritr)); i++) {
+    }
+    int_is("resumed iterator honors COUNT", i, 5);
+    icalrecur_iterator_free(ritr);
+}
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' or DTSTART < '20000102T000000'";
+void test_recur_kernels()
+{
+    struct icalrecurrencetype rrule, daily_rule;
+    struct icaltimetype dtstart, next, check;
+    icalrecur_iterator *ritr, *ditr;
+    int i;
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    /* Plain DAILY with an interval takes the specialized kernel */
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;INTERVAL=3;COUNT=4");
+    dtstart = icaltime_from_string("20250101T090000Z");
+
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    str_is("daily kernel first", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-01 09:00:00 Z UTC");
+    str_is("daily kernel second", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-04 09:00:00 Z UTC");
+    str_is("daily kernel third", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-07 09:00:00 Z UTC");
+
+    /* Backing up works from the same iterator */
+    str_is("daily kernel prev", ictt_as_string(icalrecur_iterator_prev(ritr)),
+           "2025-01-04 09:00:00 Z UTC");
+    (void)icalrecur_iterator_next(ritr);
+    str_is("daily kernel fourth", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-10 09:00:00 Z UTC");
+    ok("daily kernel honors COUNT",
+       icaltime_is_null_time(icalrecur_iterator_next(ritr)));
+    icalrecur_iterator_free(ritr);
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* WEEKLY with a simple BYDAY list also takes a kernel; a DAILY
+       rule with the same BYDAY is contracting and therefore uses the
+       general engine, so the two must agree occurrence for occurrence */
+    rrule = icalrecurrencetype_from_string("FREQ=WEEKLY;BYDAY=MO,WE,FR");
+    daily_rule = icalrecurrencetype_from_string("FREQ=DAILY;BYDAY=MO,WE,FR");
+
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    ditr = icalrecur_iterator_new(daily_rule, dtstart);
+    for (i = 0; i < 10; i++) {
+        next = icalrecur_iterator_next(ritr);
+        check = icalrecur_iterator_next(ditr);
+        if (icaltime_compare(next, check) != 0) {
+            break;
+        }
+    }
+    int_is("weekly kernel matches general engine", i, 10);
+    icalrecur_iterator_free(ritr);
+    icalrecur_iterator_free(ditr);
+
+    /* Interval weeks are delimited by WKST */
+    rrule = icalrecurrencetype_from_string("FREQ=WEEKLY;INTERVAL=2;BYDAY=TU;WKST=SU");
+    dtstart = icaltime_from_string("20250107T090000Z"); /* a Tuesday */
+
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    str_is("weekly interval first", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-07 09:00:00 Z UTC");
+    str_is("weekly interval second", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-01-21 09:00:00 Z UTC");
+    str_is("weekly interval third", ictt_as_string(icalrecur_iterator_next(ritr)),
+           "2025-02-04 09:00:00 Z UTC");
+    icalrecur_iterator_free(ritr);
+}
 
-    icalcomponent_free(c);
+void test_recur_limits()
+{
+    struct icalrecurrencetype rrule;
+    struct icaltimetype dtstart, next;
+    icalrecur_iterator *ritr;
+    int i;
 
-    /* Combinations, non-cannonical component */
+    dtstart = icaltime_from_string("20250101T000000Z");
 
-    c = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
-                            icalproperty_new_dtstart(icaltime_from_string("20000102T000000")),
-                            (void *)0);
+    /* An unbounded SECONDLY rule stops at the occurrence budget */
+    rrule = icalrecurrencetype_from_string("FREQ=SECONDLY");
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    icalrecur_iterator_set_limits(ritr, 5, 0, 0);
+    for (i = 0; !icaltime_is_null_time(icalrecur_iterator_next(ritr)); i++) {
+    }
+    int_is("occurrence budget caps expansion", i, 5);
+    ok("occurrence budget reported", icalrecur_iterator_limit_exceeded(ritr));
+    icalrecur_iterator_free(ritr);
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000103T000000'";
+    /* A contracting rule burns candidates without producing much;
+       the candidate budget bounds that work */
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;BYMONTH=2");
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    icalrecur_iterator_set_limits(ritr, 0, 10, 0);
+    for (i = 0; !icaltime_is_null_time(icalrecur_iterator_next(ritr)); i++) {
+    }
+    ok("candidate budget caps expansion", (i < 10));
+    ok("candidate budget reported", icalrecur_iterator_limit_exceeded(ritr));
+    icalrecur_iterator_free(ritr);
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    /* A benign rule under a generous budget is unaffected */
+    rrule = icalrecurrencetype_from_string("FREQ=DAILY;COUNT=3");
+    ritr = icalrecur_iterator_new(rrule, dtstart);
+    icalrecur_iterator_set_limits(ritr, 100, 1000, 10);
+    for (i = 0; !icaltime_is_null_time(next = icalrecur_iterator_next(ritr)); i++) {
+    }
+    int_is("benign rule completes", i, 3);
+    ok("no limit reported", !icalrecur_iterator_limit_exceeded(ritr));
+    icalrecur_iterator_free(ritr);
+}
 
-	if (g != NULL)
-		icalgauge_free(g);
+void test_schedule_info()
+{
+    icalcomponent *cal;
+    struct icalcomponent_schedule_info info;
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000102T000000'";
+    /* DURATION-based event: DTEND is derived, as get_dtend() does */
+    cal = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("sched-info-1"),
+            icalproperty_new_dtstart(icaltime_from_string("20250301T090000Z")),
+            icalproperty_new_duration(icaldurationtype_from_string("PT90M")),
+            icalproperty_new_rrule(icalrecurrencetype_from_string("FREQ=WEEKLY")),
+            (void *)0),
+        (void *)0);
+    assert(cal != 0);
+
+    int_is("schedule info succeeds",
+           icalcomponent_get_schedule_info(cal, &info), ICAL_NO_ERROR);
+
+    ok("dtstart matches the getter",
+       (icaltime_compare(info.dtstart, icalcomponent_get_dtstart(cal)) == 0));
+    ok("dtend is derived from the duration",
+       (icaltime_compare(info.dtend, icalcomponent_get_dtend(cal)) == 0));
+    int_is("duration is the DURATION property",
+           icaldurationtype_as_int(info.duration), 90 * 60);
+    str_is("uid is borrowed from the component", info.uid, "sched-info-1");
+    ok("recurrence id is null when absent", icaltime_is_null_time(info.recurrenceid));
+    ok("RRULE marks the event recurring", (info.is_recurring == 1));
+
+    icalcomponent_free(cal);
+
+    /* DTEND-based event: the duration is derived instead */
+    cal = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("sched-info-2"),
+            icalproperty_new_dtstart(icaltime_from_string("20250301T090000Z")),
+            icalproperty_new_dtend(icaltime_from_string("20250301T100000Z")),
+            icalproperty_new_recurrenceid(icaltime_from_string("20250308T090000Z")),
+            (void *)0),
+        (void *)0);
+    assert(cal != 0);
+
+    int_is("schedule info succeeds again",
+           icalcomponent_get_schedule_info(cal, &info), ICAL_NO_ERROR);
+    int_is("duration is derived from DTEND", icaldurationtype_as_int(info.duration), 3600);
+    ok("recurrence id matches the getter",
+       (icaltime_compare(info.recurrenceid, icalcomponent_get_recurrenceid(cal)) == 0));
+    ok("no rule means not recurring", (info.is_recurring == 0));
+
+    icalcomponent_free(cal);
+}
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 0);
+void test_alarm_times()
+{
+    icalcomponent *cal, *event, *alarm;
+    icalproperty *trig;
+    icalarray *fires;
+    struct icalcomponent_alarm_time *at;
+    icaltimezone *utc = icaltimezone_get_utc_timezone();
+
+    cal = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        /* weekly event with a "15 minutes before" alarm */
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("alarm-1"),
+            icalproperty_new_dtstart(icaltime_from_string("20250301T090000Z")),
+            icalproperty_new_duration(icaldurationtype_from_string("PT1H")),
+            icalproperty_new_rrule(icalrecurrencetype_from_string("FREQ=WEEKLY")),
+            icalcomponent_vanew(
+                ICAL_VALARM_COMPONENT,
+                icalproperty_new_action(ICAL_ACTION_DISPLAY),
+                icalproperty_new_trigger(icaltriggertype_from_string("-PT15M")),
+                (void *)0),
+            (void *)0),
+        /* one-off event with an absolute trigger */
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("alarm-2"),
+            icalproperty_new_dtstart(icaltime_from_string("20250305T113000Z")),
+            icalproperty_new_dtend(icaltime_from_string("20250305T123000Z")),
+            icalcomponent_vanew(
+                ICAL_VALARM_COMPONENT,
+                icalproperty_new_action(ICAL_ACTION_DISPLAY),
+                icalproperty_new_trigger(icaltriggertype_from_string("20250305T120000Z")),
+                (void *)0),
+            (void *)0),
+        /* one-off event with a repeating alarm */
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("alarm-3"),
+            icalproperty_new_dtstart(icaltime_from_string("20250312T090000Z")),
+            icalproperty_new_dtend(icaltime_from_string("20250312T100000Z")),
+            icalcomponent_vanew(
+                ICAL_VALARM_COMPONENT,
+                icalproperty_new_action(ICAL_ACTION_DISPLAY),
+                icalproperty_new_trigger(icaltriggertype_from_string("-PT10M")),
+                icalproperty_new_repeat(1),
+                icalproperty_new_duration(icaldurationtype_from_string("PT5M")),
+                (void *)0),
+            (void *)0),
+        (void *)0);
+    assert(cal != 0);
+
+    /* add a RELATED=END "5 minutes before the end" alarm to a fourth event */
+    trig = icalproperty_new_trigger(icaltriggertype_from_string("-PT5M"));
+    icalproperty_add_parameter(trig, icalparameter_new_related(ICAL_RELATED_END));
+    alarm = icalcomponent_vanew(ICAL_VALARM_COMPONENT,
+                                icalproperty_new_action(ICAL_ACTION_DISPLAY), trig, (void *)0);
+    event = icalcomponent_vanew(
+        ICAL_VEVENT_COMPONENT,
+        icalproperty_new_uid("alarm-4"),
+        icalproperty_new_dtstart(icaltime_from_string("20250310T090000Z")),
+        icalproperty_new_dtend(icaltime_from_string("20250310T100000Z")),
+        alarm,
+        (void *)0);
+    icalcomponent_add_component(cal, event);
+
+    fires = icalcomponent_get_alarm_times(cal,
+                                          icaltime_from_string("20250301T000000Z"),
+                                          icaltime_from_string("20250315T000000Z"));
+    ok("alarm sweep returned an array", (fires != 0));
+    assert(fires != 0);
+
+    /* Mar 1 and Mar 8 08:45 from the weekly alarm, the absolute fire,
+       the RELATED=END fire, and the two fires of the repeating alarm;
+       the Mar 15 occurrence lies past the window */
+    int_is("six fires in the window", (int)fires->num_elements, 6);
+
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 0);
+    ok("first fire is 15 minutes before the first occurrence",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250301T084500Z"), utc)));
+    str_is("first fire belongs to the weekly event",
+           icalcomponent_get_uid(at->comp), "alarm-1");
+    ok("fire carries the VALARM",
+       (icalcomponent_isa(at->alarm) == ICAL_VALARM_COMPONENT));
+
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 1);
+    ok("absolute trigger fires at its own time",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250305T120000Z"), utc)));
+
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 2);
+    ok("weekly alarm fires again a week later",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250308T084500Z"), utc)));
+
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 3);
+    ok("RELATED=END resolves against the occurrence end",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250310T095500Z"), utc)));
+
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 4);
+    ok("repeating alarm fires at the trigger",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250312T085000Z"), utc)));
+    at = (struct icalcomponent_alarm_time *)icalarray_element_at(fires, 5);
+    ok("and once more after the repeat interval",
+       (at->trigger == icaltime_as_timet_with_zone(
+            icaltime_from_string("20250312T085500Z"), utc)));
+
+    icalarray_free(fires);
+
+    /* A narrower window answers from the occurrence cache */
+    fires = icalcomponent_get_alarm_times(cal,
+                                          icaltime_from_string("20250308T000000Z"),
+                                          icaltime_from_string("20250309T000000Z"));
+    assert(fires != 0);
+    int_is("narrow window sees one fire", (int)fires->num_elements, 1);
+    icalarray_free(fires);
+
+    icalcomponent_free(cal);
+}
 
-    icalgauge_free(g);
+void test_value_reuse()
+{
+    icalproperty *prop;
+    icalvalue *value;
+
+    /* DATE-TIME: repeated sets overwrite the same value impl */
+    prop = icalproperty_new_dtstart(icaltime_from_string("20250101T090000Z"));
+    value = icalproperty_get_value(prop);
+
+    icalproperty_set_dtstart(prop, icaltime_from_string("20250102T100000Z"));
+    ok("datetime setter reuses the value", (icalproperty_get_value(prop) == value));
+    str_is("rendering reflects the new time",
+           icalproperty_get_value_as_string(prop), "20250102T100000Z");
+
+    /* Flipping to a bare DATE reuses the impl and updates the kind */
+    icalproperty_set_dtstart(prop, icaltime_from_string("20250103"));
+    ok("value reused across the DATE flip", (icalproperty_get_value(prop) == value));
+    ok("kind follows the data",
+       (icalvalue_isa(icalproperty_get_value(prop)) == ICAL_DATE_VALUE));
+    icalproperty_free(prop);
 
-    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' or DTSTART < '20000102T000000'";
+    /* INTEGER */
+    prop = icalproperty_new_sequence(5);
+    value = icalproperty_get_value(prop);
+    icalproperty_set_sequence(prop, 6);
+    ok("integer setter reuses the value", (icalproperty_get_value(prop) == value));
+    int_is("sequence updated", icalproperty_get_sequence(prop), 6);
+    icalproperty_free(prop);
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    /* DURATION */
+    prop = icalproperty_new_duration(icaldurationtype_from_string("PT1H"));
+    value = icalproperty_get_value(prop);
+    icalproperty_set_duration(prop, icaldurationtype_from_string("PT2H"));
+    ok("duration setter reuses the value", (icalproperty_get_value(prop) == value));
+    int_is("duration updated",
+           icaldurationtype_as_int(icalproperty_get_duration(prop)), 7200);
+    icalproperty_free(prop);
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* Heap-backed kinds keep the replace path */
+    prop = icalproperty_new_summary("one");
+    icalproperty_set_summary(prop, "two");
+    str_is("text setter still replaces", icalproperty_get_summary(prop), "two");
+    icalproperty_free(prop);
+}
 
-    icalcomponent_free(c);
+void test_parameter_value()
+{
+    icalproperty *prop;
+    const char *v;
 
-    /* Complex comparisons */
+    prop = icalproperty_vanew_attendee(
+        "mailto:alice@example.com",
+        icalparameter_new_partstat(ICAL_PARTSTAT_ACCEPTED),
+        icalparameter_new_cn("Alice, Esq."),
+        (void *)0);
+    assert(prop != 0);
 
-    c = icalcomponent_vanew(
-            ICAL_VCALENDAR_COMPONENT,
-            icalproperty_new_method(ICAL_METHOD_REQUEST),
-            icalcomponent_vanew(
-                ICAL_VEVENT_COMPONENT,
-                icalproperty_new_dtstart(icaltime_from_string("20000101T000002")),
-                icalproperty_new_comment("foo"),
-                icalcomponent_vanew(
-                    ICAL_VALARM_COMPONENT,
-                    icalproperty_new_dtstart(icaltime_from_string("20000101T120000")),
-                    (void *)0),
-                (void *)0),
-            (void *)0);
+    /* Enumerated parameters come back as their static names */
+    str_is("enum parameter value",
+           icalproperty_get_parameter_value(prop, ICAL_PARTSTAT_PARAMETER), "ACCEPTED");
 
-    str = "SELECT * FROM VEVENT WHERE VALARM.DTSTART = '20000101T120000'";
+    /* String parameters come back raw, without the quoting the
+       serializer would add around the comma */
+    str_is("string parameter value",
+           icalproperty_get_parameter_value(prop, ICAL_CN_PARAMETER), "Alice, Esq.");
 
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    /* The lookup agrees with the rendering path */
+    v = icalproperty_get_parameter_as_string(prop, "PARTSTAT");
+    str_is("agrees with the rendered lookup",
+           icalproperty_get_parameter_value(prop, ICAL_PARTSTAT_PARAMETER), v);
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* A parameter the property does not carry */
+    ok("missing parameter is NULL",
+       (icalproperty_get_parameter_value(prop, ICAL_TZID_PARAMETER) == NULL));
 
-    str = "SELECT * FROM VEVENT WHERE COMMENT = 'foo'";
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    icalproperty_free(prop);
 
-	if (g != NULL)
-		icalgauge_free(g);
+    prop = icalproperty_new_dtstart(icaltime_from_string("20250601T090000"));
+    icalproperty_add_parameter(prop, icalparameter_new_tzid("Europe/Berlin"));
+    str_is("TZID without a render round trip",
+           icalproperty_get_parameter_value(prop, ICAL_TZID_PARAMETER), "Europe/Berlin");
+    icalproperty_free(prop);
+}
 
-    str = "SELECT * FROM VEVENT WHERE COMMENT = 'foo' AND  VALARM.DTSTART = '20000101T120000'";
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+void test_zones_dat()
+{
+#if !defined(ICAL_EMBED_TZDATA) && defined(USE_BUILTIN_TZDATA)
+    /* With embedded tzdata the builtin table never touches the zone
+       directory, so there is no sidecar path to exercise. Without
+       builtin tzdata the loader never engages either, and releasing
+       the zone tab here would strand the suite on the system zone
+       database; skip in both configurations. */
+
+    /* Mirrors the icalzonedat_* layout in icaltimezone.c */
+    struct {
+        char magic[4];
+        unsigned int version, count, pool_size;
+    } header;
+    struct {
+        double latitude, longitude;
+        unsigned int location, reserved;
+    } entry;
+    static const char pool[] = "Test/Alpha\0Test/Omega";
+    FILE *fp;
+    icaltimezone *zone;
+    icalarray *zones;
+    int estate;
+    int prev_tzdata = icaltimezone_get_builtin_tzdata();
+
+    (void)mkdir("zonesdat", 0755);
+
+    fp = fopen("zonesdat/zones.dat", "wb");
+    assert(fp != 0);
+
+    memcpy(header.magic, "ICZT", 4);
+    header.version = 1;
+    header.count = 2;
+    header.pool_size = sizeof(pool);
+    fwrite(&header, sizeof(header), 1, fp);
+
+    entry.latitude = 12.5;
+    entry.longitude = 101.25;
+    entry.location = 0;     /* Test/Alpha */
+    entry.reserved = 0;
+    fwrite(&entry, sizeof(entry), 1, fp);
+
+    entry.latitude = -33.75;
+    entry.longitude = -45.25;
+    entry.location = 11;    /* Test/Omega */
+    fwrite(&entry, sizeof(entry), 1, fp);
+
+    fwrite(pool, sizeof(pool), 1, fp);
+    fclose(fp);
+
+    /* A directory with only the sidecar: every zone the library finds
+       must have come from the binary table. The loader only engages
+       for builtin tzdata, so force that mode for the duration. */
+    icaltimezone_release_zone_tab();
+    icaltimezone_set_builtin_tzdata(1);
+    set_zone_directory("zonesdat");
+
+    zones = icaltimezone_get_builtin_timezones();
+    ok("sidecar table has both zones", (zones->num_elements == 2));
+
+    zone = icaltimezone_get_builtin_timezone("Test/Alpha");
+    ok("sidecar zone found by location", (zone != 0));
+    if (zone) {
+        double lat = icaltimezone_get_latitude(zone);
+
+        ok("sidecar latitude survives", (lat > 12.4999 && lat < 12.5001));
+    }
 
-	if (g != NULL)
-		icalgauge_free(g);
+    zone = icaltimezone_get_builtin_timezone("Test/Omega");
+    ok("second sidecar zone found", (zone != 0));
+    if (zone) {
+        double lon = icaltimezone_get_longitude(zone);
 
-    str = "SELECT * FROM VEVENT WHERE COMMENT = 'bar' AND  VALARM.DTSTART = '20000101T120000'";
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 0);
+        ok("negative longitude survives", (lon > -45.2501 && lon < -45.2499));
+    }
 
-    icalgauge_free(g);
+    /* A corrupt sidecar must be rejected, not half-loaded. The
+       fallback then fails to find zones.tab and raises
+       ICAL_INTERNAL_ERROR. */
+    fp = fopen("zonesdat/zones.dat", "wb");
+    assert(fp != 0);
+    fwrite("NOTZ", 4, 1, fp);
+    fclose(fp);
 
-    str = "SELECT * FROM VEVENT WHERE COMMENT = 'bar' or  VALARM.DTSTART = '20000101T120000'";
-    g = icalgauge_new_from_sql(str, 0);
-    ok(str, (g != 0));
-    int_is("compare", icalgauge_compare(g, c), 1);
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+    icaltimezone_release_zone_tab();
+    zones = icaltimezone_get_builtin_timezones();
+    ok("corrupt sidecar loads no zones", (zones->num_elements == 0));
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
 
-	if (g != NULL)
-		icalgauge_free(g);
+    /* Put the real builtin data and tzdata mode back for the rest of
+       the suite */
+    icaltimezone_release_zone_tab();
+    icaltimezone_set_builtin_tzdata(prev_tzdata);
+    set_zone_directory(TEST_ZONEDIR);
+    (void)unlink("zonesdat/zones.dat");
+    (void)rmdir("zonesdat");
 
-    icalcomponent_free(c);
+    zone = icaltimezone_get_builtin_timezone("America/New_York");
+    ok("builtin zones restored", (zone != 0));
+#endif
 }
 
-icalcomponent *make_component(int i)
+void test_component_span_cache()
 {
-    icalcomponent *c;
+    icalcomponent *cal, *event;
+    icaltime_span span, again;
+    icaltime_span *spans;
+    time_t expected;
+    int count;
+
+    cal = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("span-1"),
+            icalproperty_new_dtstart(icaltime_from_string("20250101T090000Z")),
+            icalproperty_new_dtend(icaltime_from_string("20250101T100000Z")),
+            (void *)0),
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("span-2"),
+            icalproperty_new_dtstart(icaltime_from_string("20250102T090000Z")),
+            icalproperty_new_dtend(icaltime_from_string("20250102T100000Z")),
+            (void *)0),
+        (void *)0);
+
+    event = icalcomponent_get_first_component(cal, ICAL_VEVENT_COMPONENT);
+
+    expected = icaltime_as_timet_with_zone(icaltime_from_string("20250101T090000Z"),
+                                           icaltimezone_get_utc_timezone());
+    span = icalcomponent_get_span(event);
+    ok("span start matches DTSTART", (span.start == expected));
+    ok("span covers one hour", (span.end - span.start == 3600));
+
+    /* The memoized result must match the first computation */
+    again = icalcomponent_get_span(event);
+    ok("cached span agrees", (again.start == span.start && again.end == span.end));
+
+    /* A property mutation invalidates the cache */
+    icalcomponent_set_dtstart(event, icaltime_from_string("20250101T093000Z"));
+    again = icalcomponent_get_span(event);
+    ok("mutation moves the cached span", (again.start == span.start + 1800));
+
+    /* Bulk variant packs both children in traversal order */
+    spans = icalcomponent_get_spans_array(cal, &count);
+    int_is("bulk span count", count, 2);
+    ok("bulk spans returned", (spans != 0));
+    if (spans != 0) {
+        ok("bulk first child span", (spans[0].start == again.start));
+        ok("bulk second child span", (spans[1].start == expected + 24 * 3600));
+        icalmemory_free_buffer(spans);
+    }
 
-    struct icaltimetype t = icaltime_from_string("20000101T120000Z");
+    icalcomponent_free(cal);
 
-    t.day += i;
+    /* No real children yields an empty result */
+    cal = icalcomponent_new(ICAL_VCALENDAR_COMPONENT);
+    spans = icalcomponent_get_spans_array(cal, &count);
+    ok("empty calendar yields no spans", (spans == 0 && count == 0));
+    icalcomponent_free(cal);
+}
 
-    (void)icaltime_normalize(t);
+struct mime_stream_sink
+{
+    char buf[16384];
+    size_t len;
+    int calls;
+    int fail;
+};
 
-    c = icalcomponent_vanew(ICAL_VCALENDAR_COMPONENT,
-                            icalproperty_new_method(ICAL_METHOD_REQUEST),
-                            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
-                                                icalproperty_new_dtstart(t), (void *)0), (void *)0);
+static int mime_stream_sink_write(void *sinkv, const char *data, size_t size)
+{
+    struct mime_stream_sink *sink = (struct mime_stream_sink *)sinkv;
 
-    assert(c != 0);
+    if (sink->fail) {
+        return -1;
+    }
 
-    return c;
+    if (sink->len + size >= sizeof(sink->buf)) {
+        return -1;
+    }
+
+    memcpy(sink->buf + sink->len, data, size);
+    sink->len += size;
+    sink->buf[sink->len] = '\0';
+    sink->calls++;
+
+    return 0;
 }
 
-void test_fileset()
+void test_mime_stream_writer()
 {
-#if defined(HAVE_UNLINK)
-    icalset *fs;
+    struct sspm_part parts[3];
+    struct mime_stream_sink sink;
+    char *buffered = 0;
+    char attachment[200];
+    int i;
+
+    /* A text part and a base64 part long enough to wrap lines */
+    for (i = 0; i < (int)sizeof(attachment) - 1; i++) {
+        attachment[i] = (char)('A' + (i % 23));
+    }
+    attachment[sizeof(attachment) - 1] = '\0';
+
+    memset(parts, 0, sizeof(parts));
+    parts[0].header.major = SSPM_TEXT_MAJOR_TYPE;
+    parts[0].header.minor = SSPM_CALENDAR_MINOR_TYPE;
+    parts[0].header.encoding = SSPM_NO_ENCODING;
+    parts[0].data = (void *)"BEGIN:VCALENDAR\nEND:VCALENDAR\n";
+    parts[1].header.major = SSPM_APPLICATION_MAJOR_TYPE;
+    parts[1].header.minor = SSPM_UNKNOWN_MINOR_TYPE;
+    parts[1].header.minor_text = (char *)"octet-stream";
+    parts[1].header.encoding = SSPM_BASE64_ENCODING;
+    parts[1].data = attachment;
+    parts[1].data_size = sizeof(attachment) - 1;
+    parts[2].header.major = SSPM_NO_MAJOR_TYPE;
+
+    (void)sspm_write_mime(parts, 3, &buffered, "To: alice@example.com");
+
+    memset(&sink, 0, sizeof(sink));
+    int_is("stream writer succeeds",
+           sspm_write_mime_stream(parts, 3, "To: alice@example.com",
+                                  mime_stream_sink_write, &sink), 0);
+
+    str_is("stream output matches buffered writer", sink.buf, buffered);
+
+    /* A failing sink aborts the write */
+    memset(&sink, 0, sizeof(sink));
+    sink.fail = 1;
+    int_is("failing sink reported",
+           sspm_write_mime_stream(parts, 3, 0, mime_stream_sink_write, &sink), -1);
+
+    free(buffered);
+}
+
+void test_parser_validation()
+{
+    icalparser *parser;
     icalcomponent *c;
+    size_t offset = 0;
+    char bad_line[64];
+
+    /* Clean ASCII and well-formed multibyte UTF-8 pass */
+    ok("ascii line is valid",
+       icalparser_validate_line("SUMMARY:Plain meeting", 21, &offset));
+    ok("multibyte utf-8 is valid",
+       icalparser_validate_line("SUMMARY:caf\xc3\xa9 \xe2\x82\xac \xf0\x9f\x8e\x89", 22, &offset));
+
+    /* Control characters and broken sequences are pinned to an offset */
+    ok("control character rejected",
+       !icalparser_validate_line("SUMMARY:bad\x01here", 16, &offset));
+    int_is("control character offset", (int)offset, 11);
+    ok("overlong sequence rejected",
+       !icalparser_validate_line("X:\xc0\xaf", 4, &offset));
+    int_is("overlong sequence offset", (int)offset, 2);
+    ok("truncated sequence rejected",
+       !icalparser_validate_line("X:ab\xe2\x82", 6, &offset));
+    ok("surrogate rejected",
+       !icalparser_validate_line("X:\xed\xa0\x80", 5, &offset));
+    ok("tab is a legal control",
+       icalparser_validate_line("X:a\tb", 5, &offset));
+
+    /* With validation enabled, a dirty line turns into a parse error */
+    strcpy(bad_line, "BEGIN:VCALENDAR\nSUMMARY:oops\x01\nEND:VCALENDAR\n");
+    parser = icalparser_new();
+    icalparser_set_input_validation(parser, 1);
+    int_is("validation flag readable", icalparser_get_input_validation(parser), 1);
+    c = icalparser_parse_string(bad_line);
+    if (c != 0) {
+        icalcomponent_free(c); /* plain parse: no validation by default */
+    }
+
+    strcpy(bad_line, "BEGIN:VCALENDAR");
+    c = icalparser_add_line(parser, bad_line);
+    ok("no component yet", (c == 0));
+    strcpy(bad_line, "SUMMARY:oops\x01");
+    c = icalparser_add_line(parser, bad_line);
+    ok("dirty line yields no component", (c == 0));
+    strcpy(bad_line, "END:VCALENDAR");
+    c = icalparser_add_line(parser, bad_line);
+    ok("calendar completed", (c != 0));
+    ok("violation recorded as error", (icalparser_get_error_count(parser) > 0));
+    if (c != 0) {
+        ok("X-LIC-ERROR notes the offset",
+           (strstr(icalcomponent_as_ical_string(c), "offset 12") != 0));
+        icalcomponent_free(c);
+    }
+    icalparser_free(parser);
+}
+
+void test_vcal_writer()
+{
+    icalcomponent *cal, *back;
+    char *vcal;
+
+    cal = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalproperty_new_prodid("-//Test//Writer//EN"),
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("vcal-writer-1"),
+            icalproperty_new_summary("Legacy export"),
+            icalproperty_new_dtstart(icaltime_from_string("20250105T120000Z")),
+            icalproperty_new_created(icaltime_from_string("20250101T000000Z")),
+            icalproperty_new_rrule(icalrecurrencetype_from_string("FREQ=DAILY;COUNT=3")),
+            (void *)0),
+        (void *)0);
+
+    vcal = icalvcal_as_vcal_string_r(cal);
+
+    ok("vcal writer produced output", (vcal != 0));
+    if (vcal != 0) {
+        ok("vcal framing", (strncmp(vcal, "BEGIN:VCALENDAR\r\nVERSION:1.0\r\n", 30) == 0));
+        ok("vcal contains the event", (strstr(vcal, "BEGIN:VEVENT\r\n") != 0));
+        ok("CREATED mapped to DCREATED", (strstr(vcal, "DCREATED:20250101T000000Z") != 0));
+        ok("RRULE omitted (grammar differs)", (strstr(vcal, "RRULE") == 0));
+
+        /* The emitted text must parse back through the vCal reader */
+        back = icalvcal_convert_string(vcal, strlen(vcal));
+        ok("vcal output parses back", (back != 0));
+        if (back != 0) {
+            icalcomponent *ev = icalcomponent_get_first_component(back, ICAL_VEVENT_COMPONENT);
+
+            ok("round-tripped event present", (ev != 0));
+            if (ev != 0) {
+                str_is("round-tripped summary", icalcomponent_get_summary(ev), "Legacy export");
+            }
+            icalcomponent_free(back);
+        }
+
+        icalmemory_free_buffer(vcal);
+    }
+
+    icalcomponent_free(cal);
+}
+
+void test_strbuf()
+{
+    icalmemory_strbuf sb;
+    char *str;
     int i;
-    int comp_count = 0;
-    const char *path = "test_fileset.ics";
-    icalgauge *g =
-        icalgauge_new_from_sql(
-			"SELECT * FROM VEVENT "
-            "WHERE DTSTART > '20000103T120000Z' AND "
-            "DTSTART <= '20000106T120000Z'",
-            0);
 
-    ok("icalgauge_new_from_sql()", (g != NULL));
+    icalmemory_strbuf_init(&sb, 8);
+    icalmemory_strbuf_append_string(&sb, "BEGIN");
+    icalmemory_strbuf_append_char(&sb, ':');
+    /* Known-length append of a fragment of a longer string */
+    icalmemory_strbuf_append(&sb, "VEVENT;junk", 6);
+    str_is("builder assembles appends in order", sb.buf, "BEGIN:VEVENT");
 
-    unlink(path);
+    /* Push the builder through several doublings */
+    for (i = 0; i < 1000; i++) {
+        icalmemory_strbuf_append(&sb, "0123456789", 10);
+    }
+    int_is("builder length after growth", (int)(sb.pos - sb.buf), 12 + 10000);
 
-    fs = icalfileset_new(path);
+    str = icalmemory_strbuf_detach(&sb);
+    ok("detach empties the builder", (sb.buf == 0 && sb.pos == 0 && sb.size == 0));
+    ok("detached string is intact", (strncmp(str, "BEGIN:VEVENT01234", 17) == 0));
+    icalmemory_free_buffer(str);
 
-    ok("icalfileset_new()", (fs != NULL));
-    assert(fs != 0);
+    /* free without detach must also be safe */
+    icalmemory_strbuf_init(&sb, 0);
+    icalmemory_strbuf_append_string(&sb, "x");
+    icalmemory_strbuf_free(&sb);
+}
 
-    for (i = 0; i != 10; i++) {
-        c = make_component(i);
-        (void)icalfileset_add_component(fs, c);
+void test_intern()
+{
+    icalparameter *tz1, *tz2;
+    icalproperty *x1, *x2;
+
+    icalmemory_set_interning(1);
+
+    tz1 = icalparameter_new_tzid("America/New_York");
+    tz2 = icalparameter_new_tzid("America/New_York");
+
+    ok("equal TZIDs share one allocation",
+       (icalparameter_get_tzid(tz1) == icalparameter_get_tzid(tz2)));
+
+    icalparameter_free(tz1);
+    str_is("released TZID leaves the other reference intact",
+           icalparameter_get_tzid(tz2), "America/New_York");
+    icalparameter_free(tz2);
+
+    x1 = icalproperty_new_x("one");
+    icalproperty_set_x_name(x1, "X-LIBICAL-INTERN");
+    x2 = icalproperty_new_x("two");
+    icalproperty_set_x_name(x2, "X-LIBICAL-INTERN");
+
+    ok("equal X-names share one allocation",
+       (icalproperty_get_x_name(x1) == icalproperty_get_x_name(x2)));
+
+    icalproperty_free(x1);
+    str_is("released X-name leaves the other reference intact",
+           icalproperty_get_x_name(x2), "X-LIBICAL-INTERN");
+
+    icalmemory_set_interning(0);
+
+    /* Strings interned while the pool was enabled must still release
+       cleanly after it is disabled */
+    icalproperty_free(x2);
+
+    tz1 = icalparameter_new_tzid("Europe/Berlin");
+    tz2 = icalparameter_new_tzid("Europe/Berlin");
+    ok("no sharing while interning is disabled",
+       (icalparameter_get_tzid(tz1) != icalparameter_get_tzid(tz2)));
+    icalparameter_free(tz1);
+    icalparameter_free(tz2);
+}
+
+static icalcomponent *parse_with_policy(const char *ics, icalparser_error_policy policy,
+                                         int *error_count, icalparser_state *state)
+{
+    icalparser *parser;
+    icalcomponent *result = 0;
+    char line[80];
+    const char *pos;
+
+    parser = icalparser_new();
+    icalparser_set_error_policy(parser, policy);
+
+    pos = ics;
+    while (*pos != '\0') {
+        const char *eol = strchr(pos, '\n');
+        icalcomponent *c;
+
+        assert(eol != 0 && (size_t)(eol - pos) < sizeof(line) - 2);
+        memcpy(line, pos, (size_t)(eol - pos + 1));
+        line[eol - pos + 1] = '\0';
+        c = icalparser_add_line(parser, line);
+        if (c != 0) {
+            result = c;
+        }
+        pos = eol + 1;
     }
 
-    (void)icalfileset_commit(fs);
+    *error_count = icalparser_get_error_count(parser);
+    *state = icalparser_get_state(parser);
+    icalparser_free(parser);
 
-    icalset_free(fs);
-    /** reopen fileset.ics **/
-    fs = icalfileset_new(path);
+    return result;
+}
 
-    if (VERBOSE)
-        printf("== No Selections \n");
+void test_parser_error_policy()
+{
+    /* The bare "JUNK" line has no property name and triggers a parse
+       error in every policy */
+    static const char dirty[] =
+        "BEGIN:VCALENDAR\nJUNK\nBEGIN:VEVENT\nUID:policy-1\nEND:VEVENT\nEND:VCALENDAR\n";
 
-    comp_count = 0;
-    for (c = icalfileset_get_first_component(fs); c != 0; c = icalfileset_get_next_component(fs)) {
-        struct icaltimetype t = icalcomponent_get_dtstart(c);
+    icalcomponent *comp;
+    int errors;
+    icalparser_state state;
+
+    comp = parse_with_policy(dirty, ICALPARSER_ERROR_POLICY_DEFAULT, &errors, &state);
+    ok("default policy returns a component", (comp != 0));
+    if (comp != 0) {
+        ok("default policy materializes X-LIC-ERROR", (icalcomponent_count_errors(comp) > 0));
+        icalcomponent_free(comp);
+    }
+    ok("default policy counts errors", (errors > 0));
 
-        comp_count++;
-        if (VERBOSE)
-            printf("%s\n", icaltime_as_ctime(t));
+    comp = parse_with_policy(dirty, ICALPARSER_ERROR_POLICY_COUNT, &errors, &state);
+    ok("counting policy returns a component", (comp != 0));
+    if (comp != 0) {
+        int_is("counting policy skips X-LIC-ERROR", icalcomponent_count_errors(comp), 0);
+        icalcomponent_free(comp);
     }
-    int_is("icalfileset get components", comp_count, 10);
+    ok("counting policy counts errors", (errors > 0));
 
-    (void)icalfileset_select(fs, g);
+    comp = parse_with_policy(dirty, ICALPARSER_ERROR_POLICY_ABORT, &errors, &state);
+    ok("abort policy discards the component", (comp == 0));
+    int_is("abort policy stops at the first error", errors, 1);
+    ok("abort policy leaves the parser in the error state", (state == ICALPARSER_ERROR));
+}
 
-    if (VERBOSE)
-        printf("\n== DTSTART > '20000103T120000Z' AND DTSTART <= '20000106T120000Z' \n");
+void test_parser_snapshot()
+{
+    static const char head[] =
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:snapshot-1\n";
+    static const char tail[] = "END:VEVENT\nEND:VCALENDAR\n";
+
+    icalparser *parser;
+    icalparser_snapshot *snapshot;
+    icalcomponent *first, *second;
+    char line[80];
+    const char *pos;
+    int round;
+
+    parser = icalparser_new();
+
+    pos = head;
+    while (*pos != '\0') {
+        const char *eol = strchr(pos, '\n');
+
+        assert(eol != 0 && (size_t)(eol - pos) < sizeof(line) - 2);
+        memcpy(line, pos, (size_t)(eol - pos + 1));
+        line[eol - pos + 1] = '\0';
+        (void)icalparser_add_line(parser, line);
+        pos = eol + 1;
+    }
 
-    comp_count = 0;
-    for (c = icalfileset_get_first_component(fs); c != 0; c = icalfileset_get_next_component(fs)) {
-        struct icaltimetype t = icalcomponent_get_dtstart(c);
+    /* Checkpoint mid-component, then finish parsing twice from the
+       same snapshot */
+    snapshot = icalparser_save_state(parser);
+    ok("icalparser_save_state()", (snapshot != 0));
 
-        comp_count++;
-        if (VERBOSE)
-            printf("%s\n", icaltime_as_ctime(t));
+    first = second = 0;
+    for (round = 0; round < 2; round++) {
+        icalcomponent *result = 0;
+
+        pos = tail;
+        while (*pos != '\0') {
+            const char *eol = strchr(pos, '\n');
+
+            assert(eol != 0 && (size_t)(eol - pos) < sizeof(line) - 2);
+            memcpy(line, pos, (size_t)(eol - pos + 1));
+            line[eol - pos + 1] = '\0';
+            result = icalparser_add_line(parser, line);
+            pos = eol + 1;
+        }
+
+        if (round == 0) {
+            first = result;
+            int_is("icalparser_restore_state()",
+                   icalparser_restore_state(parser, snapshot), 0);
+        } else {
+            second = result;
+        }
+    }
+
+    ok("component completed after snapshot", (first != 0));
+    ok("component completed after restore", (second != 0));
+
+    if (first != 0) {
+        icalcomponent *event =
+            icalcomponent_get_first_component(first, ICAL_VEVENT_COMPONENT);
+
+        ok("checkpointed UID survives",
+           (event != 0 && icalcomponent_get_uid(event) != 0 &&
+            strcmp(icalcomponent_get_uid(event), "snapshot-1") == 0));
+    }
+
+    if (second != 0 && first != 0) {
+        char *a = icalcomponent_as_ical_string_r(first);
+        char *b = icalcomponent_as_ical_string_r(second);
+
+        str_is("both parses are identical", a, b);
+        icalmemory_free_buffer(a);
+        icalmemory_free_buffer(b);
+    }
+
+    if (first != 0) {
+        icalcomponent_free(first);
+    }
+    if (second != 0) {
+        icalcomponent_free(second);
+    }
+
+    icalparser_snapshot_free(snapshot);
+    icalparser_free(parser);
+}
+
+void test_write_fd()
+{
+#if defined(HAVE_UNISTD_H)
+    static const char ics[] =
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:write-fd-1\n"
+        "SUMMARY:vectored write\nEND:VEVENT\nEND:VCALENDAR\n";
+
+    icalcomponent *comp;
+    char *expected;
+    char path[] = "writefdXXXXXX";
+    char buffer[1024];
+    long written;
+    ssize_t nread;
+    int fd;
+
+    comp = icalparser_parse_string(ics);
+    assert(comp != 0);
+    expected = icalcomponent_as_ical_string_r(comp);
+
+    fd = mkstemp(path);
+    assert(fd >= 0);
+
+    written = icalcomponent_write_fd(comp, fd);
+    int_is("icalcomponent_write_fd() byte count", (int)written, (int)strlen(expected));
+
+    ok("rewind temp file", (lseek(fd, 0, SEEK_SET) == 0));
+    nread = read(fd, buffer, sizeof(buffer) - 1);
+    if (nread < 0) {
+        nread = 0;
+    }
+    buffer[nread] = '\0';
+
+    str_is("written bytes match the string serializer", buffer, expected);
+
+    close(fd);
+    unlink(path);
+
+#if defined(NDEBUG)
+    /* icalerror_check_arg_re() asserts unconditionally in debug
+       builds, so the invalid-fd path can only be probed when
+       assertions are compiled out. */
+    ok("write to invalid fd fails", (icalcomponent_write_fd(comp, -1) < 0));
+#endif
+
+    icalmemory_free_buffer(expected);
+    icalcomponent_free(comp);
+#endif
+}
+
+struct serialize_sink_stats
+{
+    char buffer[4096];
+    size_t used;
+    size_t max_chunk;
+    int calls;
+    int abort_after;
+};
+
+static int serialize_sink_cb(const char *data, size_t size, void *d)
+{
+    struct serialize_sink_stats *stats = (struct serialize_sink_stats *)d;
+
+    stats->calls++;
+    if (stats->abort_after > 0 && stats->calls > stats->abort_after) {
+        return 1;
+    }
+    if (size > stats->max_chunk) {
+        stats->max_chunk = size;
+    }
+    if (stats->used + size < sizeof(stats->buffer)) {
+        memcpy(stats->buffer + stats->used, data, size);
+        stats->used += size;
+    }
+
+    return 0;
+}
+
+void test_serialize_stream()
+{
+    static const char ics[] =
+        "BEGIN:VCALENDAR\nBEGIN:VEVENT\nUID:serialize-1\n"
+        "SUMMARY:streamed\nEND:VEVENT\nEND:VCALENDAR\n";
+
+    struct serialize_sink_stats stats;
+    icalcomponent *comp;
+    char *expected;
+    int r;
+
+    comp = icalparser_parse_string(ics);
+    assert(comp != 0);
+    expected = icalcomponent_as_ical_string_r(comp);
+
+    memset(&stats, 0, sizeof(stats));
+    r = icalcomponent_serialize(comp, serialize_sink_cb, &stats);
+    stats.buffer[stats.used] = '\0';
+
+    int_is("icalcomponent_serialize()", r, 0);
+    str_is("streamed bytes match the string serializer", stats.buffer, expected);
+    ok("chunks are bounded", (stats.max_chunk <= 4096));
+
+    memset(&stats, 0, sizeof(stats));
+    stats.abort_after = 2;
+    int_is("sink can abort serialization",
+           icalcomponent_serialize(comp, serialize_sink_cb, &stats), 1);
+    int_is("no chunks after abort", stats.calls, 3);
+
+    icalmemory_free_buffer(expected);
+    icalcomponent_free(comp);
+}
+
+void test_property_render_cache()
+{
+    icalproperty *prop;
+    char *first, *second, *third;
+
+    prop = icalproperty_new_summary("cached");
+
+    first = icalproperty_as_ical_string_r(prop);
+    second = icalproperty_as_ical_string_r(prop);
+    str_is("repeated rendering matches", first, second);
+
+    /* Mutating through the value setter must drop the cache */
+    icalproperty_set_summary(prop, "changed");
+    third = icalproperty_as_ical_string_r(prop);
+    ok("value mutation invalidates the cache", (strstr(third, "changed") != 0));
+    icalmemory_free_buffer(third);
+
+    /* ...and so must parameter changes */
+    icalproperty_set_parameter(prop, icalparameter_new_language("en"));
+    third = icalproperty_as_ical_string_r(prop);
+    ok("parameter mutation invalidates the cache", (strstr(third, "LANGUAGE=en") != 0));
+
+    icalmemory_free_buffer(first);
+    icalmemory_free_buffer(second);
+    icalmemory_free_buffer(third);
+    icalproperty_free(prop);
+}
+
+void test_parse_file_mmap()
+{
+    icalcomponent *c;
+    int events = 0;
+    int estate;
+
+    c = icalparser_parse_file_mmap(TEST_DATADIR "/overlaps.ics");
+
+    ok("parse " TEST_DATADIR "/overlaps.ics via mmap", (c != 0));
+    assert(c != 0);
+
+    events = icalcomponent_count_components(c, ICAL_VEVENT_COMPONENT);
+    ok("mmap-parsed calendar has events", (events > 0));
+
+    icalcomponent_free(c);
+
+    /* A file that does not exist must fail cleanly */
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+    c = icalparser_parse_file_mmap(TEST_DATADIR "/no-such-file.ics");
+    ok("missing file returns NULL", (c == 0));
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+}
+
+void test_gauge_sql()
+{
+    icalgauge *g;
+    const char *str;
+
+    str =
+        "SELECT DTSTART,DTEND,COMMENT FROM VEVENT,VTODO WHERE VEVENT.SUMMARY = 'Bongoa' AND SEQUENCE < 5";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != NULL));
+    if (VERBOSE)
+        icalgauge_dump(g);
+
+    icalgauge_free(g);
+
+    str =
+        "SELECT * FROM VEVENT,VTODO WHERE VEVENT.SUMMARY = 'Bongoa' AND SEQUENCE < 5 OR METHOD != 'CREATE'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != NULL));
+    if (VERBOSE)
+        icalgauge_dump(g);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE SUMMARY == 'BA301'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != NULL));
+    if (VERBOSE)
+        icalgauge_dump(g);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE SUMMARY == 'BA301'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != NULL));
+    if (VERBOSE)
+        icalgauge_dump(g);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE LOCATION == '104 Forum'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != NULL));
+    if (VERBOSE)
+        icalgauge_dump(g);
+
+    icalgauge_free(g);
+}
+
+void test_gauge_dtstart_range()
+{
+    icalgauge *g;
+    struct icaltimetype start, end;
+
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20000103T120000Z' AND "
+                               "DTSTART <= '20000106T120000Z'", 0);
+    assert(g != 0);
+    ok("range extracted from AND query", (icalgauge_get_dtstart_range(g, &start, &end) == 1));
+    ok("lower bound is the > operand",
+       (icaltime_compare(start, icaltime_from_string("20000103T120000Z")) == 0));
+    ok("upper bound is the <= operand",
+       (icaltime_compare(end, icaltime_from_string("20000106T120000Z")) == 0));
+    icalgauge_free(g);
+
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT "
+                               "WHERE DTSTART > '20000103T120000Z' OR SUMMARY = 'x'", 0);
+    assert(g != 0);
+    ok("no range from OR query", (icalgauge_get_dtstart_range(g, &start, &end) == 0));
+    icalgauge_free(g);
+
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT WHERE SUMMARY = 'x'", 0);
+    assert(g != 0);
+    ok("no range without DTSTART clause", (icalgauge_get_dtstart_range(g, &start, &end) == 0));
+    icalgauge_free(g);
+}
+
+void test_gauge_prepare()
+{
+    icalgauge *g;
+    icalcomponent *c;
+    int estate;
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalcomponent_vanew(
+                ICAL_VEVENT_COMPONENT,
+                icalproperty_new_dtstart(icaltime_from_string("20240615T120000Z")),
+                icalproperty_new_summary("standup"),
+                (void *)0),
+            (void *)0);
+    assert(c != 0);
+
+    g = icalgauge_prepare("SELECT * FROM VEVENT WHERE DTSTART > ? AND DTSTART < ?", 0);
+    ok("prepare a gauge with placeholders", (g != 0));
+    assert(g != 0);
+
+    int_is("two placeholders counted", icalgauge_num_params(g), 2);
+
+    /* Comparing with an unbound placeholder raises ICAL_USAGE_ERROR */
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+    int_is("unbound gauge matches nothing", icalgauge_compare(g, c), 0);
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+
+    int_is("bind lower bound",
+           icalgauge_bind_time(g, 0, icaltime_from_string("20240601T000000Z")), ICAL_NO_ERROR);
+    int_is("bind upper bound",
+           icalgauge_bind_time(g, 1, icaltime_from_string("20240701T000000Z")), ICAL_NO_ERROR);
+    int_is("bound gauge matches inside the range", icalgauge_compare(g, c), 1);
+
+    /* Rebinding reuses the compiled gauge */
+    int_is("rebind lower bound",
+           icalgauge_bind_time(g, 0, icaltime_from_string("20240620T000000Z")), ICAL_NO_ERROR);
+    int_is("rebound gauge no longer matches", icalgauge_compare(g, c), 0);
+
+    icalerror_set_errors_are_fatal(0);
+    int_is("binding a bad index fails",
+           icalgauge_bind_time(g, 5, icaltime_from_string("20240601T000000Z")),
+           ICAL_BADARG_ERROR);
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+
+    icalgauge_free(g);
+
+    /* Placeholders bind strings too */
+    g = icalgauge_prepare("SELECT * FROM VEVENT WHERE SUMMARY = ?", 0);
+    assert(g != 0);
+    int_is("one placeholder counted", icalgauge_num_params(g), 1);
+    int_is("bind a string value", icalgauge_bind_string(g, 0, "standup"), ICAL_NO_ERROR);
+    int_is("string-bound gauge matches", icalgauge_compare(g, c), 1);
+
+    icalgauge_free(g);
+    icalcomponent_free(c);
+}
+
+void test_gauge_projection()
+{
+    icalgauge *g;
+    icalcomponent *c, *proj, *inner;
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                icalproperty_new_uid("gauge-projection-uid"),
+                                icalproperty_new_dtstart(
+                                    icaltime_from_string("20240101T120000Z")),
+                                icalproperty_new_summary("keep me"),
+                                icalproperty_new_description("four kilobytes of baggage"),
+                                (void *)0),
+            (void *)0);
+    assert(c != 0);
+
+    g = icalgauge_new_from_sql("SELECT DTSTART,SUMMARY FROM VEVENT", 0);
+    assert(g != 0);
+    ok("named property list is a projection", (icalgauge_has_projection(g) == 1));
+
+    proj = icalgauge_project(g, c);
+    assert(proj != 0);
+    ok("projection keeps the wrapper",
+       (icalcomponent_isa(proj) == ICAL_VCALENDAR_COMPONENT));
+    inner = icalcomponent_get_first_component(proj, ICAL_VEVENT_COMPONENT);
+    assert(inner != 0);
+    str_is("selected property survives", icalcomponent_get_summary(inner), "keep me");
+    ok("unselected property is stripped",
+       (icalcomponent_get_first_property(inner, ICAL_DESCRIPTION_PROPERTY) == 0));
+    icalcomponent_free(proj);
+    icalgauge_free(g);
+
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT", 0);
+    assert(g != 0);
+    ok("'*' is not a projection", (icalgauge_has_projection(g) == 0));
+    proj = icalgauge_project(g, c);
+    assert(proj != 0);
+    inner = icalcomponent_get_first_component(proj, ICAL_VEVENT_COMPONENT);
+    assert(inner != 0);
+    ok("'*' projects to a full clone",
+       (icalcomponent_get_first_property(inner, ICAL_DESCRIPTION_PROPERTY) != 0));
+    icalcomponent_free(proj);
+    icalgauge_free(g);
+
+    icalcomponent_free(c);
+}
+
+void test_gauge_compare()
+{
+    icalgauge *g;
+    icalcomponent *c;
+    const char *str;
+
+    /* Equality */
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalcomponent_vanew(
+                ICAL_VEVENT_COMPONENT,
+                icalproperty_new_dtstart(icaltime_from_string("20000101T000002")), 0),
+            (void *)0);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART = '20000101T000002'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (c != 0 && g != 0));
+    assert(c != 0);
+    assert(g != 0);
+
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART = '20000101T000001'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART != '20000101T000003'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (c != 0 && g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    /* Less than */
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART < '20000101T000003'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (c != 0 && g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART < '20000101T000002'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    /* Greater than */
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000001'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000002'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    /* Greater than or Equal to */
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART >= '20000101T000002'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART >= '20000101T000003'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    /* Less than or Equal to */
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART <= '20000101T000002'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    assert(g != 0);
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+	str = "SELECT * FROM VEVENT WHERE DTSTART <= '20000101T000001'";
+    g = icalgauge_new_from_sql(str, 0);
+
+    ok(str, (g != 0));
+
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    icalcomponent_free(c);
+
+    /* Combinations */
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalcomponent_vanew(
+                ICAL_VEVENT_COMPONENT,
+                icalproperty_new_dtstart(icaltime_from_string("20000102T000000")), 0),
+            (void *)0);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000103T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000102T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' or DTSTART < '20000102T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    icalcomponent_free(c);
+
+    /* Combinations, non-cannonical component */
+
+    c = icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                            icalproperty_new_dtstart(icaltime_from_string("20000102T000000")),
+                            (void *)0);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000103T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' and DTSTART < '20000102T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE DTSTART > '20000101T000000' or DTSTART < '20000102T000000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    icalcomponent_free(c);
+
+    /* Complex comparisons */
+
+    c = icalcomponent_vanew(
+            ICAL_VCALENDAR_COMPONENT,
+            icalproperty_new_method(ICAL_METHOD_REQUEST),
+            icalcomponent_vanew(
+                ICAL_VEVENT_COMPONENT,
+                icalproperty_new_dtstart(icaltime_from_string("20000101T000002")),
+                icalproperty_new_comment("foo"),
+                icalcomponent_vanew(
+                    ICAL_VALARM_COMPONENT,
+                    icalproperty_new_dtstart(icaltime_from_string("20000101T120000")),
+                    (void *)0),
+                (void *)0),
+            (void *)0);
+
+    str = "SELECT * FROM VEVENT WHERE VALARM.DTSTART = '20000101T120000'";
+
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE COMMENT = 'foo'";
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE COMMENT = 'foo' AND  VALARM.DTSTART = '20000101T120000'";
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE COMMENT = 'bar' AND  VALARM.DTSTART = '20000101T120000'";
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 0);
+
+    icalgauge_free(g);
+
+    str = "SELECT * FROM VEVENT WHERE COMMENT = 'bar' or  VALARM.DTSTART = '20000101T120000'";
+    g = icalgauge_new_from_sql(str, 0);
+    ok(str, (g != 0));
+    int_is("compare", icalgauge_compare(g, c), 1);
+
+	if (g != NULL)
+		icalgauge_free(g);
+
+    icalcomponent_free(c);
+}
+
+icalcomponent *make_component(int i)
+{
+    icalcomponent *c;
+
+    struct icaltimetype t = icaltime_from_string("20000101T120000Z");
+
+    t.day += i;
+
+    (void)icaltime_normalize(t);
+
+    c = icalcomponent_vanew(ICAL_VCALENDAR_COMPONENT,
+                            icalproperty_new_method(ICAL_METHOD_REQUEST),
+                            icalcomponent_vanew(ICAL_VEVENT_COMPONENT,
+                                                icalproperty_new_dtstart(t), (void *)0), (void *)0);
+
+    assert(c != 0);
+
+    return c;
+}
+
+void test_fileset()
+{
+#if defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c;
+    int i;
+    int comp_count = 0;
+    const char *path = "test_fileset.ics";
+    icalgauge *g =
+        icalgauge_new_from_sql(
+			"SELECT * FROM VEVENT "
+            "WHERE DTSTART > '20000103T120000Z' AND "
+            "DTSTART <= '20000106T120000Z'",
+            0);
+
+    ok("icalgauge_new_from_sql()", (g != NULL));
+
+    unlink(path);
+
+    fs = icalfileset_new(path);
+
+    ok("icalfileset_new()", (fs != NULL));
+    assert(fs != 0);
+
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        (void)icalfileset_add_component(fs, c);
+    }
+
+    (void)icalfileset_commit(fs);
+
+    icalset_free(fs);
+    /** reopen fileset.ics **/
+    fs = icalfileset_new(path);
+
+    if (VERBOSE)
+        printf("== No Selections \n");
+
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0; c = icalfileset_get_next_component(fs)) {
+        struct icaltimetype t = icalcomponent_get_dtstart(c);
+
+        comp_count++;
+        if (VERBOSE)
+            printf("%s\n", icaltime_as_ctime(t));
+    }
+    int_is("icalfileset get components", comp_count, 10);
+
+    (void)icalfileset_select(fs, g);
+
+    if (VERBOSE)
+        printf("\n== DTSTART > '20000103T120000Z' AND DTSTART <= '20000106T120000Z' \n");
+
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0; c = icalfileset_get_next_component(fs)) {
+        struct icaltimetype t = icalcomponent_get_dtstart(c);
+
+        comp_count++;
+        if (VERBOSE)
+            printf("%s\n", icaltime_as_ctime(t));
     }
     int_is("icalfileset get components with gauge", comp_count, 3);
 
-    icalset_free(fs);
+    icalset_free(fs);
+
+    /*icalgauge_free(g); */
+#endif
+}
+
+void test_fileset_journaled(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c;
+    int i;
+    int comp_count;
+    const char *path = "test_fileset_journaled.ics";
+    const char *jpath = "test_fileset_journaled.ics.jnl";
+    long cluster_size_before, cluster_size_after;
+    struct stat sbuf;
+    char uid[80];
+
+    unlink(path);
+    unlink(jpath);
+
+    /* Seed the cluster file with a conventional writer. */
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "journal-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+    (void)icalfileset_commit(fs);
+    icalset_free(fs);
+
+    cluster_size_before = (stat(path, &sbuf) == 0) ? (long)sbuf.st_size : -1;
+
+    /* A journaled commit appends records instead of rewriting the cluster. */
+    fs = icalfileset_new_journaled(path);
+    ok("icalfileset_new_journaled()", (fs != NULL));
+    assert(fs != 0);
+
+    c = make_component(10);
+    icalcomponent_set_uid(c, "journal-uid-10");
+    (void)icalfileset_add_component(fs, c);
+    c = icalfileset_get_first_component(fs);
+    (void)icalfileset_remove_component(fs, c);
+    icalcomponent_free(c);
+    (void)icalfileset_commit(fs);
+
+    cluster_size_after = (stat(path, &sbuf) == 0) ? (long)sbuf.st_size : -1;
+    ok("journaled commit leaves the cluster file untouched",
+       cluster_size_before == cluster_size_after);
+    ok("journaled commit wrote journal records",
+       stat(jpath, &sbuf) == 0 && sbuf.st_size > 0);
+    icalset_free(fs);
+
+    /* Reopening replays the journal over the cluster file. */
+    fs = icalfileset_new_journaled(path);
+    assert(fs != 0);
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("journal replay restores the set", comp_count, 10);
+
+    /* Compaction folds the journal back into the cluster file. */
+    (void)icalfileset_compact(fs);
+    ok("compaction truncates the journal", stat(jpath, &sbuf) == 0 && sbuf.st_size == 0);
+    icalset_free(fs);
+
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("compacted cluster holds the full set", comp_count, 10);
+    icalset_free(fs);
+
+    unlink(path);
+    unlink(jpath);
+#endif
+}
+
+void test_fileset_refresh(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *reader, *writer;
+    icalcomponent *c;
+    int i;
+    int comp_count;
+    int estate;
+    const char *path = "test_fileset_refresh.ics";
+    const char *jpath = "test_fileset_refresh.ics.jnl";
+    char uid[80];
+
+    unlink(path);
+    unlink(jpath);
+
+    /* Seed the cluster file. */
+    writer = icalfileset_new(path);
+    assert(writer != 0);
+    for (i = 0; i != 5; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "refresh-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(writer, c);
+    }
+    (void)icalfileset_commit(writer);
+    icalset_free(writer);
+
+    reader = icalfileset_new_journaled(path);
+    assert(reader != 0);
+    int_is("freshly opened set is not stale", icalfileset_is_stale(reader), 0);
+    int_is("refresh of an unchanged set is a no-op",
+           icalfileset_refresh(reader), ICAL_NO_ERROR);
+
+    /* A second open set appends a record to the shared journal. */
+    writer = icalfileset_new_journaled(path);
+    assert(writer != 0);
+    c = make_component(5);
+    icalcomponent_set_uid(c, "refresh-uid-5");
+    (void)icalfileset_add_component(writer, c);
+    (void)icalfileset_commit(writer);
+    icalset_free(writer);
+
+    int_is("journal growth makes the set stale", icalfileset_is_stale(reader), 1);
+    int_is("incremental refresh succeeds", icalfileset_refresh(reader), ICAL_NO_ERROR);
+    int_is("set is fresh after the refresh", icalfileset_is_stale(reader), 0);
+
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(reader); c != 0;
+         c = icalfileset_get_next_component(reader)) {
+        comp_count++;
+    }
+    int_is("refresh replayed the appended record", comp_count, 6);
+
+    /* A compaction rewrites the cluster file and truncates the journal,
+       which only a full reload can absorb. */
+    writer = icalfileset_new_journaled(path);
+    assert(writer != 0);
+    (void)icalfileset_compact(writer);
+    icalset_free(writer);
+
+    int_is("compaction makes the set stale", icalfileset_is_stale(reader), 1);
+    int_is("full-reload refresh succeeds", icalfileset_refresh(reader), ICAL_NO_ERROR);
+
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(reader); c != 0;
+         c = icalfileset_get_next_component(reader)) {
+        comp_count++;
+    }
+    int_is("reload matches the compacted cluster", comp_count, 6);
+
+    /* Refreshing over uncommitted local changes would discard them;
+       the refusal raises ICAL_USAGE_ERROR. */
+    c = make_component(7);
+    icalcomponent_set_uid(c, "refresh-uid-7");
+    (void)icalfileset_add_component(reader, c);
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+    int_is("refresh refuses uncommitted local changes",
+           icalfileset_refresh(reader), ICAL_USAGE_ERROR);
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+
+    icalset_free(reader);
+
+    unlink(path);
+    unlink(jpath);
+#endif
+}
+
+void test_fileset_lazy(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c;
+    int i;
+    int comp_count;
+    const char *path = "test_fileset_lazy.ics";
+    char uid[80];
+
+    unlink(path);
+
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "lazy-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+    (void)icalfileset_commit(fs);
+    icalset_free(fs);
+
+    fs = icalfileset_new_lazy_reader(path);
+    ok("icalfileset_new_lazy_reader()", (fs != NULL));
+    assert(fs != 0);
+
+    /* A fetch by UID should find the component via the index hints. */
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "lazy-uid-7");
+    ok("lazy fetch finds the component", (c != NULL));
+    ok("lazy fetch found the right component",
+       (c != NULL) && strcmp(icalcomponent_get_uid(c), "lazy-uid-7") == 0);
+
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "lazy-uid-none");
+    ok("lazy fetch misses an absent UID", (c == NULL));
+
+    /* Iteration materializes the remaining components. */
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("lazy reader sees the whole set", comp_count, 10);
+
+    icalset_free(fs);
+    unlink(path);
+#endif
+}
+
+void test_fileset_compressed(void)
+{
+#if defined(HAVE_ZLIB) && defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c;
+    int i;
+    int comp_count;
+    long plain_size, z_size;
+    const char *path = "test_fileset_compressed.ics";
+    char hdr[16];
+    FILE *f;
+    struct stat sbuf;
+    char uid[80];
+
+    unlink(path);
+
+    /* Baseline: the same components written uncompressed. */
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "z-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+    (void)icalfileset_commit(fs);
+    icalset_free(fs);
+    if (stat(path, &sbuf) != 0) {
+        assert(0);
+    }
+    plain_size = (long)sbuf.st_size;
+
+    /* A compressed open of the plain file converts it on commit. */
+    fs = icalfileset_new_compressed(path);
+    ok("icalfileset_new_compressed()", (fs != NULL));
+    assert(fs != 0);
+    icalfileset_mark(fs);
+    ok("compressed commit", (icalfileset_commit(fs) == ICAL_NO_ERROR));
+    icalset_free(fs);
+
+    f = fopen(path, "r");
+    assert(f != 0);
+    memset(hdr, 0, sizeof(hdr));
+    ok("cluster file carries the compression header",
+       (fread(hdr, 1, 15, f) == 15 && strncmp(hdr, "X-LIC-ZCLUSTER:", 15) == 0));
+    fclose(f);
+
+    if (stat(path, &sbuf) != 0) {
+        assert(0);
+    }
+    z_size = (long)sbuf.st_size;
+    ok("compressed cluster is smaller", (z_size < plain_size));
+    if (VERBOSE) {
+        printf("plain %ld bytes, compressed %ld bytes\n", plain_size, z_size);
+    }
+
+    /* Compression is detected from the header, so a plain reader sees
+       the set unchanged. */
+    fs = icalfileset_new_reader(path);
+    ok("plain reader opens the compressed cluster", (fs != NULL));
+    assert(fs != 0);
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("plain reader sees the whole set", comp_count, 10);
+    icalset_free(fs);
+
+    /* A lazy reader indexes the inflated bytes. */
+    fs = icalfileset_new_lazy_reader(path);
+    ok("lazy reader opens the compressed cluster", (fs != NULL));
+    assert(fs != 0);
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "z-uid-7");
+    ok("lazy fetch finds a component in the inflated index", (c != NULL));
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("lazy reader sees the whole set", comp_count, 10);
+    icalset_free(fs);
+
+    /* A plain writer keeps an already-compressed file compressed. */
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    icalfileset_mark(fs);
+    (void)icalfileset_commit(fs);
+    icalset_free(fs);
+
+    f = fopen(path, "r");
+    assert(f != 0);
+    memset(hdr, 0, sizeof(hdr));
+    ok("plain rewrite keeps the cluster compressed",
+       (fread(hdr, 1, 15, f) == 15 && strncmp(hdr, "X-LIC-ZCLUSTER:", 15) == 0));
+    fclose(f);
+
+    unlink(path);
+#endif
+}
+
+void test_fileset_dirty_tracking(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c, *inner;
+    icalproperty *p;
+    unsigned int gen;
+    int i;
+    int comp_count;
+    long journal_size_before, journal_size_after;
+    long cluster_size_before, cluster_size_after;
+    const char *path = "test_fileset_dirty.ics";
+    const char *jpath = "test_fileset_dirty.ics.jnl";
+    struct stat sbuf;
+    char uid[80];
+
+    /* A property edit deep in the tree moves the content generation of
+       every enclosing component. */
+    c = make_component(0);
+    gen = icalcomponent_content_generation(c);
+    inner = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+    p = icalcomponent_get_first_property(inner, ICAL_DTSTART_PROPERTY);
+    icalproperty_set_dtstart(p, icaltime_from_string("20000102T120000Z"));
+    ok("nested edit moves the root content generation",
+       icalcomponent_content_generation(c) != gen);
+    icalcomponent_free(c);
+
+    unlink(path);
+    unlink(jpath);
+
+    fs = icalfileset_new_journaled(path);
+    assert(fs != 0);
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "dirty-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+    (void)icalfileset_commit(fs);
+
+    if (stat(jpath, &sbuf) != 0) {
+        assert(0);
+    }
+    journal_size_before = (long)sbuf.st_size;
+
+    /* mark() without an actual change: the generations show the disk
+       already matches, so the commit writes nothing. */
+    icalfileset_mark(fs);
+    (void)icalfileset_commit(fs);
+    if (stat(jpath, &sbuf) != 0) {
+        assert(0);
+    }
+    ok("clean marked commit writes nothing", (long)sbuf.st_size == journal_size_before);
+
+    /* An in-place edit is downgraded to remove+add journal records
+       instead of forcing a cluster rewrite. */
+    cluster_size_before = (stat(path, &sbuf) == 0) ? (long)sbuf.st_size : -1;
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "dirty-uid-4");
+    assert(c != 0);
+    inner = icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT);
+    icalcomponent_add_property(inner, icalproperty_new_summary("edited in place"));
+    icalfileset_mark(fs);
+    (void)icalfileset_commit(fs);
+
+    cluster_size_after = (stat(path, &sbuf) == 0) ? (long)sbuf.st_size : -1;
+    ok("edited commit leaves the cluster file untouched",
+       cluster_size_before == cluster_size_after);
+    if (stat(jpath, &sbuf) != 0) {
+        assert(0);
+    }
+    journal_size_after = (long)sbuf.st_size;
+    ok("edited commit appended journal records", journal_size_after > journal_size_before);
+    icalset_free(fs);
+
+    /* Replay applies the edit without disturbing the rest of the set. */
+    fs = icalfileset_new_journaled(path);
+    assert(fs != 0);
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "dirty-uid-4");
+    inner = (c != 0) ? icalcomponent_get_first_component(c, ICAL_VEVENT_COMPONENT) : 0;
+    ok("replayed set carries the in-place edit",
+       inner != 0 && icalcomponent_get_summary(inner) != 0 &&
+       strcmp(icalcomponent_get_summary(inner), "edited in place") == 0);
+    comp_count = 0;
+    for (c = icalfileset_get_first_component(fs); c != 0;
+         c = icalfileset_get_next_component(fs)) {
+        comp_count++;
+    }
+    int_is("replayed set is complete", comp_count, 10);
+    icalset_free(fs);
+
+    unlink(path);
+    unlink(jpath);
+#endif
+}
+
+void test_cluster_binary(void)
+{
+#if defined(HAVE_UNLINK)
+    icalcluster *cluster, *loaded;
+    icalcomponent *c;
+    char *before, *after;
+    int i;
+    const char *path = "test_cluster_binary.bin";
+    char uid[80];
+
+    unlink(path);
+
+    c = make_component(0);
+    icalcomponent_set_uid(c, "cluster-bin-uid-0");
+    cluster = icalcluster_new("test-cluster", c);       /* takes ownership of c */
+    assert(cluster != 0);
+    for (i = 1; i != 5; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "cluster-bin-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalcluster_add_component(cluster, c);
+    }
+    before = icalcomponent_as_ical_string_r(icalcluster_get_component(cluster));
+
+    ok("icalcluster_commit_binary()", (icalcluster_commit_binary(cluster, path) == ICAL_NO_ERROR));
+    ok("binary commit clears the changed flag", (icalcluster_is_changed(cluster) == 0));
+
+    loaded = icalcluster_load_binary(path);
+    ok("icalcluster_load_binary()", (loaded != NULL));
+    assert(loaded != 0);
+    after = icalcomponent_as_ical_string_r(icalcluster_get_component(loaded));
+    ok("binary cache round-trips the component tree", (strcmp(before, after) == 0));
+    if (strcmp(before, after) != 0 && VERBOSE) {
+        printf("before:\n%s\nafter:\n%s\n", before, after);
+    }
+    free(before);
+    free(after);
+    icalcluster_free(loaded);
+    icalcluster_free(cluster);
+
+    /* A truncated cache must be rejected, not half-loaded. */
+    if (truncate(path, 20) != 0) {
+        assert(0);
+    }
+    icalerror_set_errors_are_fatal(0);
+    loaded = icalcluster_load_binary(path);
+    icalerror_set_errors_are_fatal(1);
+    ok("truncated binary cache is rejected", (loaded == NULL));
+
+    unlink(path);
+#endif
+}
+
+void test_fileset_async(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *fs;
+    icalcomponent *c;
+    int i;
+    const char *path = "test_fileset_async.ics";
+    char uid[80];
+
+    unlink(path);
+
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    for (i = 0; i != 10; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "async-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+
+    ok("icalfileset_commit_async()", (icalfileset_commit_async(fs) == ICAL_NO_ERROR));
+    ok("icalfileset_flush_async() reports no write error",
+       (icalfileset_flush_async() == ICAL_NO_ERROR));
+    icalset_free(fs);
+
+    /* The flushed file must read back like a synchronous commit. */
+    fs = icalfileset_new_reader(path);
+    assert(fs != 0);
+    int_is("async commit reached disk",
+           icalfileset_count_components(fs, ICAL_VCALENDAR_COMPONENT), 10);
+    c = icalfileset_fetch(fs, ICAL_VEVENT_COMPONENT, "async-uid-4");
+    ok("fetch after async commit", (c != NULL));
+    icalset_free(fs);
+    unlink(path);
+#endif
+}
+
+void test_fileset_snapshot(void)
+{
+#if defined(HAVE_SYS_MMAN_H) && !defined(_WIN32) && defined(HAVE_UNLINK)
+    icalset *fs, *snap;
+    icalcomponent *c;
+    int i;
+    const char *path = "test_fileset_snapshot.ics";
+    const char *shm_name = "/ical-regression-snapshot";
+    char uid[80];
+
+    unlink(path);
+    (void)icalfileset_snapshot_remove(shm_name);
+
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    for (i = 0; i != 5; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "snapshot-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalfileset_add_component(fs, c);
+    }
+
+    ok("icalfileset_snapshot_publish()",
+       (icalfileset_snapshot_publish(fs, shm_name) == ICAL_NO_ERROR));
+    icalset_free(fs);
+
+    /* A worker maps the snapshot read-only and sees the same set */
+    snap = icalfileset_snapshot_open(shm_name);
+    ok("icalfileset_snapshot_open()", (snap != NULL));
+    assert(snap != NULL);
+
+    c = icalfileset_fetch(snap, ICAL_VEVENT_COMPONENT, "snapshot-uid-2");
+    ok("fetch from snapshot", (c != NULL));
+    int_is("snapshot holds every component",
+           icalfileset_count_components(snap, ICAL_VCALENDAR_COMPONENT), 5);
+    icalset_free(snap);
+
+    ok("icalfileset_snapshot_remove()",
+       (icalfileset_snapshot_remove(shm_name) == ICAL_NO_ERROR));
+    unlink(path);
+#endif
+}
+
+void test_set_query_cache(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *c;
+    char **uids;
+    int count, gen, i;
+    const char *path = "test_set_qcache.ics";
+    const char *sql = "SELECT * FROM VEVENT WHERE DTSTART > '20000102T000000Z'";
+    char uid[80];
+
+    unlink(path);
+
+    s = icalset_new_file(path);
+    assert(s != 0);
+    for (i = 0; i < 4; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "qcache-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalset_add_component(s, c);
+    }
+
+    uids = icalset_query_uids(s, sql, &count);
+    ok("icalset_query_uids()", (uids != NULL));
+    assert(uids != 0);
+    int_is("query matches the later events", count, 3);
+    ok("query results keep set order", (count > 0 && strcmp(uids[0], "qcache-uid-1") == 0));
+    icalset_free_query_result(uids);
+
+    /* Re-running the same query against the unchanged set hits the cache */
+    gen = icalset_get_generation(s);
+    uids = icalset_query_uids(s, sql, &count);
+    int_is("cached re-run returns the same result", count, 3);
+    int_is("re-running does not move the generation", icalset_get_generation(s), gen);
+    icalset_free_query_result(uids);
+
+    /* A mutation bumps the generation and invalidates the entry */
+    c = make_component(4);
+    icalcomponent_set_uid(c, "qcache-uid-4");
+    (void)icalset_add_component(s, c);
+    ok("mutation bumps the generation", (icalset_get_generation(s) > gen));
+
+    uids = icalset_query_uids(s, sql, &count);
+    int_is("query refreshed after mutation", count, 4);
+    icalset_free_query_result(uids);
+
+    icalset_free(s);
+    unlink(path);
+#endif
+}
+
+void test_message_batch(void)
+{
+#if defined(HAVE_UNLINK)
+    icalset *s;
+    icalcomponent *store, *msgs[2];
+    icalmessage_pipeline_result results[2];
+    int n;
+    const char *path = "test_message_batch.ics";
+
+    unlink(path);
+
+    s = icalset_new_file(path);
+    assert(s != 0);
+
+    store = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("batch-uid-0"),
+            icalproperty_new_sequence(1),
+            icalproperty_new_dtstamp(icaltime_from_string("20231231T000000Z")),
+            icalproperty_new_organizer("mailto:org@example.com"),
+            icalproperty_new_attendee("mailto:user@example.com"),
+            (void *)0),
+        (void *)0);
+    (void)icalset_add_component(s, store);
+
+    /* An update to the stored event, and a request for a brand new one */
+    msgs[0] = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalproperty_new_method(ICAL_METHOD_REQUEST),
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("batch-uid-0"),
+            icalproperty_new_sequence(2),
+            icalproperty_new_dtstamp(icaltime_from_string("20240101T000000Z")),
+            icalproperty_new_organizer("mailto:org@example.com"),
+            icalproperty_new_attendee("mailto:user@example.com"),
+            (void *)0),
+        (void *)0);
+
+    msgs[1] = icalcomponent_vanew(
+        ICAL_VCALENDAR_COMPONENT,
+        icalproperty_new_method(ICAL_METHOD_REQUEST),
+        icalcomponent_vanew(
+            ICAL_VEVENT_COMPONENT,
+            icalproperty_new_uid("batch-uid-new"),
+            icalproperty_new_sequence(0),
+            icalproperty_new_dtstamp(icaltime_from_string("20240101T000000Z")),
+            icalproperty_new_organizer("mailto:org@example.com"),
+            icalproperty_new_attendee("mailto:user@example.com"),
+            (void *)0),
+        (void *)0);
+
+    n = icalmessage_process_batch(msgs, 2, s, "user@example.com",
+                                  ICAL_PARTSTAT_ACCEPTED, results);
+
+    int_is("two replies built", n, 2);
+    ok("update resolved its match", (results[0].match != 0));
+    int_is("update classified", (int)results[0].xlicclass, (int)ICAL_XLICCLASS_REQUESTUPDATE);
+    ok("new request has no match", (results[1].match == 0));
+    int_is("new request classified", (int)results[1].xlicclass, (int)ICAL_XLICCLASS_REQUESTNEW);
+
+    ok("replies were generated", (results[0].reply != 0 && results[1].reply != 0));
+    if (results[0].reply != 0) {
+        int_is("reply carries METHOD REPLY",
+               (int)icalcomponent_get_method(results[0].reply), (int)ICAL_METHOD_REPLY);
+        icalcomponent_free(results[0].reply);
+    }
+    if (results[1].reply != 0) {
+        icalcomponent_free(results[1].reply);
+    }
+
+    icalcomponent_free(msgs[0]);
+    icalcomponent_free(msgs[1]);
+    icalset_free(s);
+    unlink(path);
+#endif
+}
+
+void microsleep(int us)
+{       /*us is in microseconds */
+#if defined(HAVE_NANOSLEEP)
+    struct timespec ts;
+
+    ts.tv_sec = 0;
+    ts.tv_nsec = us * 1000;     /* convert from microseconds to nanoseconds */
+
+    nanosleep(&ts, NULL);
+#elif defined(HAVE_USLEEP)
+    usleep(us);
+#endif /*Windows Sleep is useless for microsleeping */
+}
+
+#if defined(HAVE_PTHREAD)
+static void *test_errno_thread_run(void *arg)
+{
+    icalerrno = ICAL_PARSE_ERROR;
+    *((int *)arg) = (icalerrno == ICAL_PARSE_ERROR);
+
+    return 0;
+}
+#endif
+
+void test_thread_local_errno(void)
+{
+#if defined(HAVE_PTHREAD)
+    pthread_t thread;
+    int seen = 0;
+
+    icalerror_clear_errno();
+
+    if (pthread_create(&thread, 0, test_errno_thread_run, &seen) == 0) {
+        pthread_join(thread, 0);
+
+        int_is("worker thread saw its own error", seen, 1);
+        int_is("worker error did not leak into this thread",
+               (int)icalerrno, (int)ICAL_NO_ERROR);
+    }
+#endif
+}
+
+void test_set_export(void)
+{
+#if defined(HAVE_UNLINK) && !defined(_WIN32)
+    icalset *s, *exported;
+    icalcomponent *c;
+    icalgauge *g;
+    int fd, i;
+    const char *path = "test_set_export_src.ics";
+    const char *outpath = "test_set_export_out.ics";
+    char uid[80];
+
+    unlink(path);
+    unlink(outpath);
+
+    s = icalset_new_file(path);
+    assert(s != 0);
+    for (i = 0; i < 4; i++) {
+        c = make_component(i);
+        snprintf(uid, sizeof(uid), "export-uid-%d", i);
+        icalcomponent_set_uid(c, uid);
+        (void)icalset_add_component(s, c);
+    }
+
+    g = icalgauge_new_from_sql("SELECT * FROM VEVENT WHERE DTSTART > '20000102T000000Z'", 0);
+    assert(g != 0);
+
+    fd = open(outpath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    assert(fd >= 0);
+    ok("icalset_export()", (icalset_export(s, g, fd) == ICAL_NO_ERROR));
+    close(fd);
+
+    icalgauge_free(g);
+    icalset_free(s);
+
+    /* The streamed bytes parse back into the filtered set */
+    exported = icalset_new_file_reader(outpath);
+    ok("exported stream parses", (exported != 0));
+    assert(exported != 0);
+    int_is("gauge filtered the export",
+           icalset_count_components(exported, ICAL_VCALENDAR_COMPONENT), 3);
+    icalset_free(exported);
+
+    unlink(path);
+    unlink(outpath);
+#endif
+}
+
+void test_fileset_shared_locks(void)
+{
+#if defined(HAVE_WAITPID) && defined(HAVE_FORK) && defined(HAVE_UNLINK) && !defined(_WIN32)
+    const char *path = "test_fileset_sharedlock.ics";
+    icalset *fs, *reader;
+    pid_t pid;
+    int status = 0;
+
+    unlink(path);
+
+    fs = icalfileset_new(path);
+    assert(fs != 0);
+    (void)icalfileset_add_component(fs, make_component(0));
+    (void)icalfileset_commit(fs);
+    icalset_free(fs);
+
+    /* Hold a reader open while another process probes the lock state */
+    reader = icalfileset_new_reader(path);
+    ok("open a reader on the set", (reader != 0));
+    assert(reader != 0);
+
+    pid = fork();
+    assert(pid >= 0);
 
-    /*icalgauge_free(g); */
-#endif
-}
+    if (pid == 0) {
+        /* child: a second shared lock must fit, an exclusive one must not */
+        struct flock probe;
+        int fd = open(path, O_RDONLY);
+        int rd_ok, wr_blocked;
 
-void microsleep(int us)
-{       /*us is in microseconds */
-#if defined(HAVE_NANOSLEEP)
-    struct timespec ts;
+        if (fd < 0) {
+            exit(2);
+        }
 
-    ts.tv_sec = 0;
-    ts.tv_nsec = us * 1000;     /* convert from microseconds to nanoseconds */
+        probe.l_type = F_RDLCK;
+        probe.l_start = 0;
+        probe.l_whence = SEEK_SET;
+        probe.l_len = 0;
+        (void)fcntl(fd, F_GETLK, &probe);
+        rd_ok = (probe.l_type == F_UNLCK);
+
+        probe.l_type = F_WRLCK;
+        probe.l_start = 0;
+        probe.l_whence = SEEK_SET;
+        probe.l_len = 0;
+        (void)fcntl(fd, F_GETLK, &probe);
+        wr_blocked = (probe.l_type != F_UNLCK);
+
+        close(fd);
+        exit((rd_ok && wr_blocked) ? 0 : 1);
+    }
 
-    nanosleep(&ts, NULL);
-#elif defined(HAVE_USLEEP)
-    usleep(us);
-#endif /*Windows Sleep is useless for microsleeping */
+    assert(waitpid(pid, &status, 0) == pid);
+    int_is("readers share, writers exclude",
+           (WIFEXITED(status) ? WEXITSTATUS(status) : -1), 0);
+
+    icalset_free(reader);
+    unlink(path);
+#endif
 }
 
 void test_file_locks()
@@ -3850,6 +7825,56 @@ void test_langbind()
             printf("%s\n", str);
     }
 
+    {
+        const char *batch = icallangbind_component_eval_string(inner, ":");
+
+        ok("batch eval returns a bracketed list",
+           (batch != 0 && batch[0] == '[' && batch[strlen(batch) - 1] == ']'));
+        ok("batch eval covers every property",
+           (batch != 0 && strstr(batch, "'ATTENDEE'") != 0 && strstr(batch, "'DURATION'") != 0));
+        if (VERBOSE && batch != 0)
+            printf("%s\n", batch);
+    }
+
+    {
+        icalproperty **props = icallangbind_get_properties_array(inner, "DTSTART");
+        int n = 0;
+
+        while (props != 0 && props[n] != 0)
+            n++;
+        int_is("bulk property fetch returns every DTSTART", n, 3);
+        if (props != 0)
+            icalmemory_free_buffer(props);
+    }
+
+    {
+        icalcomponent *cal = icalparser_parse_string(
+            "BEGIN:VCALENDAR\r\n"
+            "BEGIN:VEVENT\r\n"
+            "UID:col-1\r\n"
+            "SUMMARY:first\r\n"
+            "DTSTART:19700101T000010Z\r\n"
+            "DTEND:19700101T000020Z\r\n"
+            "END:VEVENT\r\n"
+            "BEGIN:VEVENT\r\n"
+            "UID:col-2\r\n"
+            "END:VEVENT\r\n"
+            "END:VCALENDAR\r\n");
+        struct icallangbind_event_columns *cols =
+            icallangbind_extract_event_columns(cal, "VEVENT");
+
+        int_is("column extract sees both events", cols->count, 2);
+        ok("times become epoch seconds in document order",
+           (cols->dtstart[0] == 10 && cols->dtend[0] == 20));
+        str_is("uid column points at the component's string", cols->uid[0], "col-1");
+        ok("absent properties yield 0/NULL entries",
+           (cols->dtstart[1] == 0 && cols->summary[1] == 0));
+        ok("every column is terminated", (cols->uid[2] == 0 && cols->dtstart[2] == 0));
+
+        icallangbind_event_columns_free(cols);
+        icalcomponent_free(cal);
+    }
+
     p = icalcomponent_get_first_property(inner, ICAL_ATTENDEE_PROPERTY);
 
     icalproperty_set_parameter_from_string(p, "CUTYPE", "INDIVIDUAL");
@@ -4207,6 +8232,63 @@ void test_attach_data()
     icalcomponent_free(ac);
 }
 
+void test_attach_spill()
+{
+    static const char test_icalcomp_str_attachwithencodingdata[] =
+        "BEGIN:VALARM\r\n" "ATTACH;VALUE=BINARY;ENCODING=BASE64:YQECAAACAWEK\r\n" "END:VALARM\r\n";
+
+    icalcomponent *ac;
+    icalproperty *ap;
+    icalattach *attach;
+    char *spilled_path = 0;
+    FILE *fp;
+
+    /* Every inline attachment at or above 4 bytes spills to disk */
+    icalattach_set_spill_threshold(4);
+
+    ac = icalcomponent_new_from_string(test_icalcomp_str_attachwithencodingdata);
+    ap = icalcomponent_get_first_property(ac, ICAL_ATTACH_PROPERTY);
+    attach = icalproperty_get_attach(ap);
+
+    ok("oversized attachment spilled to a file", (icalattach_get_is_file(attach)));
+    if (icalattach_get_is_file(attach)) {
+        char *content;
+
+        spilled_path = icalmemory_strdup(icalattach_get_filename(attach));
+        fp = fopen(spilled_path, "rb");
+        ok("the spill file exists while the attachment is live", (fp != 0));
+        if (fp != 0)
+            fclose(fp);
+
+        content = icalattach_read_data_r(attach);
+        str_is("the spill file holds the encoded content", content, "YQECAAACAWEK");
+        icalmemory_free_buffer(content);
+    }
+    str_is("serialization re-reads the spilled content",
+           icalcomponent_as_ical_string(ac), test_icalcomp_str_attachwithencodingdata);
+
+    icalcomponent_free(ac);
+
+    if (spilled_path != 0) {
+        fp = fopen(spilled_path, "rb");
+        ok("the temp file is removed with the last reference", (fp == 0));
+        if (fp != 0)
+            fclose(fp);
+        icalmemory_free_buffer(spilled_path);
+    }
+
+    icalattach_set_spill_threshold(0);
+
+    /* Below the threshold nothing changes */
+    icalattach_set_spill_threshold(1024);
+    ac = icalcomponent_new_from_string(test_icalcomp_str_attachwithencodingdata);
+    ap = icalcomponent_get_first_property(ac, ICAL_ATTACH_PROPERTY);
+    attach = icalproperty_get_attach(ap);
+    ok("small attachments stay inline", (!icalattach_get_is_file(attach)));
+    icalcomponent_free(ac);
+    icalattach_set_spill_threshold(0);
+}
+
 void test_vcal(void)
 {
     VObject *vcal;
@@ -4368,6 +8450,86 @@ void test_zoneinfo_stuff(void)
     str_is("icaltzutil_get_zone_directory", icaltzutil_get_zone_directory(), "foo");
 }
 
+void test_tzif_fetch_changes(void)
+{
+    struct icaltzutil_change *changes = NULL;
+    size_t i, num_changes = 0;
+    int prev_tzdata = icaltimezone_get_builtin_tzdata();
+    char prev_zonedir[256] = {0};
+    int got, ordered, linked;
+    int estate;
+    FILE *probe;
+
+    strncat(prev_zonedir, icaltzutil_get_zone_directory(), 255);
+
+    probe = fopen("/usr/share/zoneinfo/America/New_York", "rb");
+    if (!probe) {
+        ok("no system zoneinfo, skipping TZif tests", 1);
+        return;
+    }
+    fclose(probe);
+
+    icaltimezone_set_builtin_tzdata(0);
+    icaltzutil_set_zone_directory("/usr/share/zoneinfo");
+
+    got = icaltzutil_fetch_changes("America/New_York", &changes, &num_changes);
+    ok("icaltzutil_fetch_changes() succeeds", (got == 1 && num_changes > 0));
+
+    ordered = linked = (got == 1);
+    for (i = 1; got == 1 && i < num_changes; i++) {
+        if (changes[i].transition <= changes[i - 1].transition)
+            ordered = 0;
+        if (changes[i].prev_utc_offset != changes[i - 1].utc_offset)
+            linked = 0;
+    }
+    ok("transitions are strictly increasing", ordered);
+    ok("each change's previous offset matches its predecessor", linked);
+    if (got == 1) {
+        free(changes);
+    }
+
+    changes = NULL;
+    estate = icalerror_get_errors_are_fatal();
+    icalerror_set_errors_are_fatal(0);
+    got = icaltzutil_fetch_changes("Does/Not-Exist", &changes, &num_changes);
+    ok("missing zone fails cleanly", (got == 0 && changes == NULL));
+    icalerror_set_errors_are_fatal(estate);
+    icalerror_clear_errno();
+
+    icaltimezone_set_builtin_tzdata(1);
+    got = icaltzutil_fetch_changes("America/New_York", &changes, &num_changes);
+    ok("refused when builtin tzdata is in use", (got == 0 && changes == NULL));
+
+    icaltimezone_set_builtin_tzdata(prev_tzdata);
+    icaltzutil_set_zone_directory(prev_zonedir[0] ? prev_zonedir : NULL);
+}
+
+void test_demand_ranged_expansion(void)
+{
+    icaltimezone *zone = icaltimezone_get_builtin_timezone("America/New_York");
+    struct icaltimetype recent, historic, recent2;
+    int off_recent, off_historic, off_recent2;
+
+    ok("builtin America/New_York found", (zone != NULL));
+    if (!zone)
+        return;
+
+    /* The first lookup expands a window around the requested year only;
+       the later historic lookup must widen it and the offsets must not
+       depend on the order the windows were expanded in. */
+    recent = icaltime_from_string("20250715T120000Z");
+    off_recent = icaltimezone_get_utc_offset_of_utc_time(zone, &recent, 0);
+    int_is("EDT offset after recent-only expansion", off_recent, -4 * 3600);
+
+    historic = icaltime_from_string("19500115T120000Z");
+    off_historic = icaltimezone_get_utc_offset_of_utc_time(zone, &historic, 0);
+    int_is("EST offset after widening to 1950", off_historic, -5 * 3600);
+
+    recent2 = icaltime_from_string("20250115T120000Z");
+    off_recent2 = icaltimezone_get_utc_offset_of_utc_time(zone, &recent2, 0);
+    int_is("EST offset still correct after widening", off_recent2, -5 * 3600);
+}
+
 void test_tzid_with_utc_time(void)
 {
     const char *strcomp =
@@ -4700,6 +8862,49 @@ void test_icalarray_sort(void)
     icalarray_free(array);
 }
 
+void test_icalarray_contiguous(void)
+{
+    char presort[] = { "shreicnyjqpvozxmbt" };
+    char sorted1[] = { "bcehijmnopqrstvxyz" };
+    unsigned int i;
+
+    icalarray *array = icalarray_new_contiguous(1, 2);
+    icalarray *copy;
+
+    icalarray_reserve(array, sizeof(presort) - 1);
+    ok("icalarray_reserve allocates the requested capacity",
+       array->space_allocated >= sizeof(presort) - 1);
+    ok("icalarray_reserve does not add elements", array->num_elements == 0);
+
+    for (i = 0; i < sizeof(presort)-1; i++) {
+        icalarray_append(array, &presort[i]);
+    }
+
+    icalarray_sort(array, test_icalarray_sort_compare_char);
+
+    for (i = 0; i < sizeof(presort)-1; i++) {
+        char c = *((char*)icalarray_element_at(array, i));
+        ok("icalarray_sort on contiguous array - item sorted as expected", c == sorted1[i]);
+    }
+
+    ok("contiguous elements are adjacent in memory",
+       (char *)icalarray_element_at(array, 1) - (char *)icalarray_element_at(array, 0) == 1);
+
+    copy = icalarray_copy(array);
+    ok("icalarray_copy preserves element count", copy->num_elements == array->num_elements);
+    ok("icalarray_copy preserves elements",
+       memcmp(icalarray_element_at(copy, 0), icalarray_element_at(array, 0),
+              array->num_elements) == 0);
+    icalarray_free(copy);
+
+    icalarray_remove_element_at(array, 0);
+    ok("icalarray_remove_element_at shifts the tail down",
+       array->num_elements == sizeof(presort) - 2 &&
+       *((char*)icalarray_element_at(array, 0)) == sorted1[1]);
+
+    icalarray_free(array);
+}
+
 void test_icalcomponent_normalize(void)
 {
 	const char *calStr1 =
@@ -4777,6 +8982,534 @@ void test_icalcomponent_normalize(void)
 	str_is("Normalized components match", calStr1, calStr2);
 }
 
+void test_component_binary_roundtrip(void)
+{
+    const char *calStr =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "PRODID:-//ACME//NONSGML ACME Calendar//EN\n"
+        "METHOD:REQUEST\n"
+        "BEGIN:VEVENT\n"
+        "UID:binary-roundtrip@example.com\n"
+        "DTSTAMP:20250101T000000Z\n"
+        "DTSTART;TZID=America/New_York:20250301T120000\n"
+        "DURATION:PT1H30M\n"
+        "SUMMARY;LANGUAGE=en:Weekly meeting\\, room 4\n"
+        "ATTENDEE;ROLE=REQ-PARTICIPANT;PARTSTAT=ACCEPTED;CN=Alice:mailto:alice@example.com\n"
+        "EXDATE:20250308T120000Z,20250315T120000Z\n"
+        "RRULE:FREQ=WEEKLY;BYDAY=SA;COUNT=10\n"
+        "GEO:40.01;-74.02\n"
+        "TRANSP:OPAQUE\n"
+        "X-CUSTOM;X-FLAG=YES:some value\n"
+        "FREEBUSY:20250101T000000Z/20250101T010000Z\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+
+    icalcomponent *comp = icalcomponent_new_from_string(calStr);
+    icalcomponent *comp2;
+    char *bin, *str1, *str2;
+    size_t size = 0;
+
+    ok("parsed fixture", comp != 0);
+
+    bin = icalcomponent_to_binary(comp, &size);
+    ok("icalcomponent_to_binary returns a buffer", bin != 0 && size > 0);
+
+    comp2 = icalcomponent_from_binary(bin, size);
+    ok("icalcomponent_from_binary rebuilds the component", comp2 != 0);
+
+    str1 = icalcomponent_as_ical_string_r(comp);
+    str2 = icalcomponent_as_ical_string_r(comp2);
+
+    if (VERBOSE) {
+        printf("binary size %lu, text size %lu\n",
+               (unsigned long)size, (unsigned long)strlen(str1));
+    }
+
+    str_is("round-tripped component serializes identically", str1, str2);
+
+    icalmemory_free_buffer(str1);
+    icalmemory_free_buffer(str2);
+    icalcomponent_free(comp2);
+
+    /* A truncated buffer must be rejected, not crash */
+    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_NONFATAL);
+    comp2 = icalcomponent_from_binary(bin, size / 2);
+    icalerror_set_error_state(ICAL_MALFORMEDDATA_ERROR, ICAL_ERROR_DEFAULT);
+    ok("truncated buffer is rejected", comp2 == 0);
+    icalerror_clear_errno();
+
+    icalmemory_free_buffer(bin);
+    icalcomponent_free(comp);
+}
+
+void test_component_hash_equal(void)
+{
+    const char *str1 =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VEVENT\n"
+        "UID:hash@example.com\n"
+        "SUMMARY:Title\n"
+        "LOCATION:Room 1\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+    /* Same content, properties in a different order */
+    const char *str2 =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VEVENT\n"
+        "UID:hash@example.com\n"
+        "LOCATION:Room 1\n"
+        "SUMMARY:Title\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+
+    icalcomponent *a = icalcomponent_new_from_string(str1);
+    icalcomponent *b = icalcomponent_new_from_string(str2);
+    icalcomponent *ev;
+    unsigned long long ha;
+
+    ok("parsed fixtures", a != 0 && b != 0);
+
+    ha = icalcomponent_hash(a);
+    ok("hash is order-insensitive", ha == icalcomponent_hash(b));
+    ok("reordered components are equal", icalcomponent_equal(a, b));
+
+    ev = icalcomponent_get_first_component(a, ICAL_VEVENT_COMPONENT);
+    icalproperty_set_summary(icalcomponent_get_first_property(ev, ICAL_SUMMARY_PROPERTY),
+                             "Changed");
+    ok("nested mutation changes the hash", icalcomponent_hash(a) != ha);
+    ok("mutated component compares unequal", !icalcomponent_equal(a, b));
+
+    icalcomponent_free(a);
+    icalcomponent_free(b);
+}
+
+void test_set_time_range_query(void)
+{
+#if defined(HAVE_UNLINK)
+    const char *path = "test_timerange.ics";
+    icalset *fs;
+    icalarray *uids;
+    size_t i;
+    int found_one = 0, found_two = 0, found_three = 0;
+
+    unlink(path);
+    fs = icalfileset_new(path);
+    ok("created fileset", fs != 0);
+    assert(fs != 0);
+
+    (void)icalfileset_add_component(fs, icalcomponent_new_from_string(
+        "BEGIN:VEVENT\n"
+        "UID:range-one\n"
+        "DTSTART:20240110T100000Z\n"
+        "DTEND:20240110T110000Z\n"
+        "END:VEVENT\n"));
+    (void)icalfileset_add_component(fs, icalcomponent_new_from_string(
+        "BEGIN:VEVENT\n"
+        "UID:range-two\n"
+        "DTSTART:20230101T100000Z\n"
+        "DTEND:20230101T110000Z\n"
+        "RRULE:FREQ=MONTHLY;COUNT=24\n"
+        "END:VEVENT\n"));
+    (void)icalfileset_add_component(fs, icalcomponent_new_from_string(
+        "BEGIN:VEVENT\n"
+        "UID:range-three\n"
+        "DTSTART:20300101T100000Z\n"
+        "DTEND:20300101T110000Z\n"
+        "END:VEVENT\n"));
+
+    uids = icalset_time_range_query(fs,
+                                    icaltime_from_string("20240101T000000Z"),
+                                    icaltime_from_string("20240201T000000Z"));
+    ok("query returned a result", uids != 0);
+
+    for (i = 0; uids != 0 && i < uids->num_elements; i++) {
+        const char *uid = *(char **)icalarray_element_at(uids, i);
+
+        if (strcmp(uid, "range-one") == 0)
+            found_one = 1;
+        else if (strcmp(uid, "range-two") == 0)
+            found_two = 1;
+        else if (strcmp(uid, "range-three") == 0)
+            found_three = 1;
+    }
+    ok("single event in window matches", found_one);
+    ok("recurring event expanding into window matches", found_two);
+    ok("event outside window does not match", !found_three);
+
+    icalset_time_range_query_free(uids);
+    icalset_free(fs);
+    unlink(path);
+#endif
+}
+
+static void occurrences_cached_count_cb(icalcomponent *comp, struct icaltime_span *span,
+                                        void *data)
+{
+    _unused(comp);
+    _unused(span);
+
+    (*(int *)data)++;
+}
+
+void test_component_occurrences_cached(void)
+{
+    const char *str =
+        "BEGIN:VEVENT\n"
+        "UID:occ-cache@example.com\n"
+        "DTSTART:20240101T100000Z\n"
+        "DTEND:20240101T110000Z\n"
+        "RRULE:FREQ=DAILY;COUNT=30\n"
+        "EXDATE:20240105T100000Z\n"
+        "END:VEVENT\n";
+
+    icalcomponent *comp = icalcomponent_new_from_string(str);
+    struct icaltimetype wstart = icaltime_from_string("20240101T000000Z");
+    struct icaltimetype wend = icaltime_from_string("20240201T000000Z");
+    struct icaltimetype substart = icaltime_from_string("20240110T000000Z");
+    struct icaltimetype subend = icaltime_from_string("20240115T000000Z");
+    icalarray *spans;
+    icalproperty *rrule;
+    struct icalrecurrencetype recur;
+    int direct = 0;
+
+    ok("parsed fixture", comp != 0);
+
+    icalcomponent_foreach_recurrence(comp, wstart, wend, occurrences_cached_count_cb, &direct);
+    spans = icalcomponent_get_occurrences_cached(comp, wstart, wend);
+    int_is("cached expansion matches foreach_recurrence", (int)spans->num_elements, direct);
+    icalarray_free(spans);
+
+    /* A window inside the cached one is served from the cache; it must
+       still agree with a direct expansion. */
+    direct = 0;
+    icalcomponent_foreach_recurrence(comp, substart, subend, occurrences_cached_count_cb,
+                                     &direct);
+    spans = icalcomponent_get_occurrences_cached(comp, substart, subend);
+    int_is("cache hit matches foreach_recurrence", (int)spans->num_elements, direct);
+    icalarray_free(spans);
+
+    /* Editing the rule must invalidate the cache. */
+    rrule = icalcomponent_get_first_property(comp, ICAL_RRULE_PROPERTY);
+    recur = icalproperty_get_rrule(rrule);
+    recur.count = 10;
+    icalproperty_set_rrule(rrule, recur);
+    spans = icalcomponent_get_occurrences_cached(comp, wstart, wend);
+    int_is("rule edit invalidates the cache", (int)spans->num_elements, 9);
+    icalarray_free(spans);
+
+    icalcomponent_free(comp);
+}
+
+void test_time_span_set(void)
+{
+    icaltime_span_set *set = icaltime_span_set_new();
+    icaltime_span members[4];
+    int i, j, mismatches = 0;
+
+    ok("created span set", set != 0);
+
+    /* Busy spans, overlapping and degenerate ones included. */
+    members[0].start = 100;
+    members[0].end = 200;
+    members[1].start = 150;
+    members[1].end = 400;
+    members[2].start = 500;
+    members[2].end = 600;
+    members[3].start = 700;
+    members[3].end = 700;
+    for (i = 0; i < 4; i++) {
+        members[i].is_busy = 1;
+        ok("added span", icaltime_span_set_add(set, &members[i]));
+    }
+    int_is("set holds the spans", (int)icaltime_span_set_size(set), 4);
+
+    /* The batch queries must agree with the pairwise functions for
+       every candidate, degenerate candidates included. */
+    for (i = 0; i < 900; i += 5) {
+        icaltime_span q;
+        int want_overlap = 0, want_contains = 0;
+
+        q.start = i;
+        q.end = (i % 2) ? i : i + 23;
+        q.is_busy = 0;
+        for (j = 0; j < 4; j++) {
+            if (icaltime_span_overlaps(&q, &members[j]))
+                want_overlap = 1;
+            if (icaltime_span_contains(&q, &members[j]))
+                want_contains = 1;
+        }
+        if (icaltime_span_set_overlaps(set, &q) != want_overlap ||
+            icaltime_span_set_contains(set, &q) != want_contains) {
+            mismatches++;
+        }
+    }
+    int_is("batch queries match the pairwise functions", mismatches, 0);
+
+    icaltime_span_set_free(set);
+}
+
+void test_value_string_boundaries(void)
+{
+    /* Strings on either side of the inline-storage threshold must round
+       trip identically; the threshold itself is an implementation
+       detail, so probe a range of lengths. */
+    char buf[128];
+    int len;
+
+    for (len = 1; len < 80; len++) {
+        icalvalue *v;
+        const char *got;
+
+        memset(buf, 'a' + (len % 26), (size_t)len);
+        buf[len] = '\0';
+
+        v = icalvalue_new_text(buf);
+        got = icalvalue_get_text(v);
+        if (got == 0 || strcmp(got, buf) != 0) {
+            break;
+        }
+        icalvalue_free(v);
+    }
+    int_is("text values of every length round trip", len, 80);
+}
+
+void test_component_get_timezone(void)
+{
+    const char *str =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VTIMEZONE\n"
+        "TZID:Zone/Two\n"
+        "BEGIN:STANDARD\n"
+        "TZOFFSETFROM:+0200\n"
+        "TZOFFSETTO:+0100\n"
+        "DTSTART:19701025T020000\n"
+        "END:STANDARD\n"
+        "END:VTIMEZONE\n"
+        "BEGIN:VTIMEZONE\n"
+        "TZID:Zone/One\n"
+        "BEGIN:STANDARD\n"
+        "TZOFFSETFROM:+0100\n"
+        "TZOFFSETTO:+0000\n"
+        "DTSTART:19701025T020000\n"
+        "END:STANDARD\n"
+        "END:VTIMEZONE\n"
+        "END:VCALENDAR\n";
+    const char *zone3 =
+        "BEGIN:VTIMEZONE\n"
+        "TZID:Zone/Three\n"
+        "BEGIN:STANDARD\n"
+        "TZOFFSETFROM:+0300\n"
+        "TZOFFSETTO:+0200\n"
+        "DTSTART:19701025T020000\n"
+        "END:STANDARD\n"
+        "END:VTIMEZONE\n";
+
+    icalcomponent *comp = icalcomponent_new_from_string(str);
+    icaltimezone *zone;
+
+    ok("parsed fixture", comp != 0);
+
+    zone = icalcomponent_get_timezone(comp, "Zone/One");
+    ok("resolves first TZID", zone != 0 && strcmp(icaltimezone_get_tzid(zone), "Zone/One") == 0);
+    zone = icalcomponent_get_timezone(comp, "Zone/Two");
+    ok("resolves second TZID", zone != 0 && strcmp(icaltimezone_get_tzid(zone), "Zone/Two") == 0);
+    ok("unknown TZID resolves to NULL", icalcomponent_get_timezone(comp, "Zone/None") == 0);
+
+    /* A zone added after the first lookup must be found too. */
+    icalcomponent_add_component(comp, icalcomponent_new_from_string(zone3));
+    zone = icalcomponent_get_timezone(comp, "Zone/Three");
+    ok("resolves TZID added later",
+       zone != 0 && strcmp(icaltimezone_get_tzid(zone), "Zone/Three") == 0);
+
+    icalcomponent_free(comp);
+}
+
+void test_component_merge_vtimezones(void)
+{
+    /* One fixture template: the TZOFFSETTO makes zones the same or
+       genuinely different under an identical TZID. */
+    const char *fmt =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "PRODID:-//Test//Test//EN\n"
+        "BEGIN:VTIMEZONE\n"
+        "TZID:London\n"
+        "BEGIN:STANDARD\n"
+        "TZOFFSETFROM:+0100\n"
+        "TZOFFSETTO:%s\n"
+        "TZNAME:GMT\n"
+        "DTSTART:19701025T020000\n"
+        "END:STANDARD\n"
+        "END:VTIMEZONE\n"
+        "BEGIN:VEVENT\n"
+        "UID:%s\n"
+        "DTSTART;TZID=London:20240101T100000\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+
+    char buf[1024];
+    icalcomponent *target, *other;
+    char *text;
+
+    snprintf(buf, sizeof(buf), fmt, "+0000", "merge1@example.com");
+    target = icalcomponent_new_from_string(buf);
+    snprintf(buf, sizeof(buf), fmt, "+0000", "merge2@example.com");
+    other = icalcomponent_new_from_string(buf);
+    ok("parsed fixtures", target != 0 && other != 0);
+
+    /* An identical zone under the same TZID is deduplicated. */
+    icalcomponent_merge_component(target, other);
+    int_is("identical zone is deduplicated",
+           icalcomponent_count_components(target, ICAL_VTIMEZONE_COMPONENT), 1);
+
+    /* A different zone under the same TZID is renamed, moved over, and
+       the merged events' TZID references follow the rename. */
+    snprintf(buf, sizeof(buf), fmt, "+0030", "merge3@example.com");
+    other = icalcomponent_new_from_string(buf);
+    icalcomponent_merge_component(target, other);
+    int_is("conflicting zone is kept separately",
+           icalcomponent_count_components(target, ICAL_VTIMEZONE_COMPONENT), 2);
+
+    text = icalcomponent_as_ical_string_r(target);
+    ok("conflicting zone was renamed", strstr(text, "TZID:London1\r\n") != 0);
+    ok("references follow the rename", strstr(text, "TZID=London1:") != 0);
+    icalmemory_free_buffer(text);
+
+    /* Merging the conflicting zone again reuses the renamed copy. */
+    snprintf(buf, sizeof(buf), fmt, "+0030", "merge4@example.com");
+    other = icalcomponent_new_from_string(buf);
+    icalcomponent_merge_component(target, other);
+    int_is("renamed zone is reused on a later merge",
+           icalcomponent_count_components(target, ICAL_VTIMEZONE_COMPONENT), 2);
+
+    icalcomponent_free(target);
+}
+
+void test_component_diff_patch(void)
+{
+    const char *oldStr =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VEVENT\n"
+        "UID:diff@example.com\n"
+        "DTSTAMP:20250101T000000Z\n"
+        "SUMMARY:Old title\n"
+        "LOCATION:Room 1\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+    const char *newStr =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VEVENT\n"
+        "UID:diff@example.com\n"
+        "DTSTAMP:20250101T000000Z\n"
+        "SUMMARY:New title\n"
+        "DESCRIPTION:added\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+
+    icalcomponent *oldc = icalcomponent_new_from_string(oldStr);
+    icalcomponent *newc = icalcomponent_new_from_string(newStr);
+    icalcomponent *patch, *empty;
+    char *got, *want;
+    int rc;
+
+    ok("parsed fixtures", oldc != 0 && newc != 0);
+
+    patch = icalcomponent_diff(oldc, newc);
+    ok("icalcomponent_diff returns a patch", patch != 0);
+
+    if (VERBOSE) {
+        printf("patch:\n%s\n", icalcomponent_as_ical_string(patch));
+    }
+
+    rc = icalcomponent_apply_patch(oldc, patch);
+    int_is("icalcomponent_apply_patch succeeds", rc, 0);
+
+    got = icalcomponent_as_ical_string_r(oldc);
+    want = icalcomponent_as_ical_string_r(newc);
+    str_is("patched component matches the new one", got, want);
+    icalmemory_free_buffer(got);
+    icalmemory_free_buffer(want);
+
+    empty = icalcomponent_diff(newc, newc);
+    ok("identical components diff to an empty patch",
+       empty != 0 &&
+       icalcomponent_count_properties(empty, ICAL_ANY_PROPERTY) == 0 &&
+       icalcomponent_count_components(empty, ICAL_ANY_COMPONENT) == 0);
+
+    icalcomponent_free(patch);
+    icalcomponent_free(empty);
+    icalcomponent_free(oldc);
+    icalcomponent_free(newc);
+}
+
+struct jcal_sink_data
+{
+    char buf[4096];
+    size_t len;
+};
+
+static int jcal_test_sink(const char *data, size_t size, void *d)
+{
+    struct jcal_sink_data *out = (struct jcal_sink_data *)d;
+
+    if (out->len + size >= sizeof(out->buf)) {
+        return 1;
+    }
+    memcpy(out->buf + out->len, data, size);
+    out->len += size;
+    out->buf[out->len] = '\0';
+    return 0;
+}
+
+void test_component_as_jcal(void)
+{
+    const char *calStr =
+        "BEGIN:VCALENDAR\n"
+        "VERSION:2.0\n"
+        "BEGIN:VEVENT\n"
+        "UID:jcal@example.com\n"
+        "DTSTART;TZID=America/New_York:20250301T120000\n"
+        "SUMMARY;LANGUAGE=en:Hello\\, \"World\"\n"
+        "PERCENT-COMPLETE:42\n"
+        "RRULE:FREQ=WEEKLY;BYDAY=SA,SU\n"
+        "END:VEVENT\n"
+        "END:VCALENDAR\n";
+    const char *expected =
+        "[\"vcalendar\",["
+        "[\"version\",{},\"text\",\"2.0\"]"
+        "],[[\"vevent\",["
+        "[\"uid\",{},\"text\",\"jcal@example.com\"],"
+        "[\"dtstart\",{\"tzid\":\"America/New_York\"},\"date-time\",\"2025-03-01T12:00:00\"],"
+        "[\"summary\",{\"language\":\"en\"},\"text\",\"Hello, \\\"World\\\"\"],"
+        "[\"percent-complete\",{},\"integer\",42],"
+        "[\"rrule\",{},\"recur\",{\"freq\":\"WEEKLY\",\"byday\":[\"SA\",\"SU\"]}]"
+        "],[]]]]";
+
+    icalcomponent *comp = icalcomponent_new_from_string(calStr);
+    struct jcal_sink_data out;
+    int rc;
+
+    ok("parsed fixture", comp != 0);
+
+    out.len = 0;
+    out.buf[0] = '\0';
+    rc = icalcomponent_as_jcal(comp, jcal_test_sink, &out);
+    int_is("icalcomponent_as_jcal succeeds", rc, 0);
+    str_is("jCal output matches", out.buf, expected);
+
+    if (VERBOSE) {
+        printf("jCal: %s\n", out.buf);
+    }
+
+    icalcomponent_free(comp);
+}
+
 int main(int argc, char *argv[])
 {
 #if !defined(HAVE_UNISTD_H)
@@ -4791,6 +9524,7 @@ int main(int argc, char *argv[])
     int do_test = 0;
     int do_header = 0;
     int failed_count = 0;
+    int scaling_size = 0;
 
     set_zone_directory(TEST_ZONEDIR);
     icaltimezone_set_tzid_prefix(TESTS_TZID_PREFIX);
@@ -4798,7 +9532,7 @@ int main(int argc, char *argv[])
     test_start(0);
 
 #if defined(HAVE_GETOPT)
-    while ((c = getopt(argc, argv, "lvq")) != -1) {
+    while ((c = getopt(argc, argv, "lvqm:")) != -1) {
         switch (c) {
         case 'v':
         {
@@ -4815,6 +9549,12 @@ int main(int argc, char *argv[])
             do_header = 1;
 			break;
         }
+        case 'm':
+        {
+            /* storage scaling report mode; not a pass/fail run */
+            scaling_size = atoi(optarg);
+            break;
+        }
         case '?':
         {
             errflg++;
@@ -4831,13 +9571,20 @@ int main(int argc, char *argv[])
 
 #endif
 
+    if (scaling_size > 0) {
+        storage_scaling_report(scaling_size);
+        return 0;
+    }
+
     test_run("Test time parser functions", test_time_parser, do_test, do_header);
     test_run("Test time", test_time, do_test, do_header);
     test_run("Test calculation of DOY and WD", test_juldat_caldat, do_test, do_header);
+    test_run("Test day number conversion", test_daynum_conversion, do_test, do_header);
     test_run("Test day of Year", test_doy, do_test, do_header);
     test_run("Test duration", test_duration, do_test, do_header);
     test_run("Test period", test_period, do_test, do_header);
     test_run("Test DTSTART", test_dtstart, do_test, do_header);
+    test_run("Test DTSTAMP Now", test_dtstamp_now, do_test, do_header);
     test_run("Test day of year of week start", test_start_of_week, do_test, do_header);
     test_run("Test recur parser", test_recur_parser, do_test, do_header);
     test_run("Test recur", test_recur, do_test, do_header);
@@ -4847,14 +9594,38 @@ int main(int argc, char *argv[])
     test_run("Test parameter bug", test_recur_parameter_bug, do_test, do_header);
     test_run("Test Array Expansion", test_expand_recurrence, do_test, do_header);
     test_run("Test Free/Busy lists", test_fblist, do_test, do_header);
+    test_run("Test packed period arrays", test_periodarray, do_test, do_header);
     test_run("Test Overlaps", test_overlaps, do_test, do_header);
 
     test_run("Test Span", test_icalcomponent_get_span, do_test, do_header);
     test_run("Test Gauge SQL", test_gauge_sql, do_test, do_header);
+    test_run("Test Gauge DTSTART Range", test_gauge_dtstart_range, do_test, do_header);
+    test_run("Test Gauge Prepared Statements", test_gauge_prepare, do_test, do_header);
+    test_run("Test Gauge Projection", test_gauge_projection, do_test, do_header);
     test_run("Test Gauge Compare", test_gauge_compare, do_test, do_header);
     test_run("Test File Set", test_fileset, do_test, do_header);
+    test_run("Test set time-range query", test_set_time_range_query, do_test, do_header);
+    test_run("Test File Set (Journaled)", test_fileset_journaled, do_test, do_header);
+    test_run("Test File Set (Refresh)", test_fileset_refresh, do_test, do_header);
+    test_run("Test File Set (Lazy)", test_fileset_lazy, do_test, do_header);
+    test_run("Test File Set (Compressed)", test_fileset_compressed, do_test, do_header);
+    test_run("Test File Set (Dirty Tracking)", test_fileset_dirty_tracking, do_test, do_header);
+    test_run("Test File Set (Async)", test_fileset_async, do_test, do_header);
+    test_run("Test Cluster Binary Cache", test_cluster_binary, do_test, do_header);
+    test_run("Test File Set (Snapshot)", test_fileset_snapshot, do_test, do_header);
+    test_run("Test Set Query Cache", test_set_query_cache, do_test, do_header);
+    test_run("Test Message Batch Pipeline", test_message_batch, do_test, do_header);
+    test_run("Test File Set (Shared Locks)", test_fileset_shared_locks, do_test, do_header);
+    test_run("Test Set Export", test_set_export, do_test, do_header);
+    test_run("Test Thread Local icalerrno", test_thread_local_errno, do_test, do_header);
     test_run("Test File Set (Extended)", test_fileset_extended, do_test, do_header);
     test_run("Test Dir Set", test_dirset, do_test, do_header);
+    test_run("Test Dir Set UID Index", test_dirset_index, do_test, do_header);
+    test_run("Test Dir Set Cursor", test_dirset_cursor, do_test, do_header);
+    test_run("Test Dir Set Parallel Query", test_dirset_parallel, do_test, do_header);
+    test_run("Test Dir Set Cluster Pruning", test_dirset_prune, do_test, do_header);
+    test_run("Test Set Backend Registration", test_set_register, do_test, do_header);
+    test_run("Test Dir Set Bulk Add", test_dirset_bulk_add, do_test, do_header);
     test_run("Test Dir Set (Extended)", test_dirset_extended, do_test, do_header);
 
 /* test_file_locks is slow but should work ok -- uncomment to test it */
@@ -4862,9 +9633,23 @@ int main(int argc, char *argv[])
     test_run("Test X Props and Params", test_x, do_test, do_header);
     test_run("Test Trigger", test_trigger, do_test, do_header);
     test_run("Test Restriction", test_restriction, do_test, do_header);
+    test_run("Test Restriction incremental", test_restriction_incremental, do_test, do_header);
+    test_run("Test Restriction parallel", test_restriction_parallel, do_test, do_header);
     test_run("Test RDATE", test_rdate, do_test, do_header);
     test_run("Test language binding", test_langbind, do_test, do_header);
     test_run("Test property parser", test_property_parse, do_test, do_header);
+    test_run("Test streaming parser", test_parse_stream, do_test, do_header);
+    test_run("Test mmap file parser", test_parse_file_mmap, do_test, do_header);
+    test_run("Test fd serializer", test_write_fd, do_test, do_header);
+    test_run("Test streaming serializer", test_serialize_stream, do_test, do_header);
+    test_run("Test property render cache", test_property_render_cache, do_test, do_header);
+    test_run("Test batch parser", test_parse_batch, do_test, do_header);
+    test_run("Test thread pool", test_threadpool, do_test, do_header);
+    test_run("Test tracepoints", test_trace, do_test, do_header);
+    test_run("Test streaming MIME parse", test_mime_streaming, do_test, do_header);
+    test_run("Test base64 decode", test_base64_decode, do_test, do_header);
+    test_run("Test parser snapshots", test_parser_snapshot, do_test, do_header);
+    test_run("Test parser error policy", test_parser_error_policy, do_test, do_header);
     test_run("Test Action", test_action, do_test, do_header);
     test_run("Test Value Parameter", test_value_parameter, do_test, do_header);
     test_run("Test Empty Parameter", test_empty_parameter, do_test, do_header);
@@ -4873,15 +9658,19 @@ int main(int argc, char *argv[])
     test_run("Test request status", test_requeststat, do_test, do_header);
     test_run("Test UTC-OFFSET", test_utcoffset, do_test, do_header);
     test_run("Test Values", test_values, do_test, do_header);
+    test_run("Test Deferred Errors", test_deferred_errors, do_test, do_header);
     test_run("Test Parameters", test_parameters, do_test, do_header);
     test_run("Test Properties", test_properties, do_test, do_header);
     test_run("Test Components", test_components, do_test, do_header);
+    test_run("Test Component Freeze", test_component_freeze, do_test, do_header);
+    test_run("Test Columnar extraction", test_extract_columns, do_test, do_header);
     test_run("Test icalcomponent_foreach_recurrence", test_component_foreach, do_test, do_header);
     test_run("Test icalrecur_iterator_set_start with date", test_recur_iterator_set_start, do_test, do_header);
     test_run("Test weekly icalrecur_iterator on January 1", test_recur_iterator_on_jan_1, do_test, do_header);
     test_run("Test Convenience", test_convenience, do_test, do_header);
     test_run("Test classify ", test_classify, do_test, do_header);
     test_run("Test Iterators", test_iterators, do_test, do_header);
+    test_run("Test External Iterators", test_external_iterators, do_test, do_header);
     test_run("Test strings", test_strings, do_test, do_header);
     test_run("Test TZID escaping", test_tzid_escape, do_test, do_header);
     test_run("Test Compare", test_compare, do_test, do_header);
@@ -4890,15 +9679,39 @@ int main(int argc, char *argv[])
     test_run("Create Components with vaargs", create_new_component_with_va_args, do_test,
              do_header);
     test_run("Test Memory", test_memory, do_test, do_header);
+    test_run("Test Allocation Counts", test_allocation_counts, do_test, do_header);
+    test_run("Test Arena", test_arena, do_test, do_header);
+    test_run("Test string interning", test_intern, do_test, do_header);
+    test_run("Test string builder", test_strbuf, do_test, do_header);
+    test_run("Test bulk recurrence expansion", test_expand_range, do_test, do_header);
+    test_run("Test recurrence iterator resume", test_recur_resume, do_test, do_header);
+    test_run("Test recurrence iterator kernels", test_recur_kernels, do_test, do_header);
+    test_run("Test component span cache", test_component_span_cache, do_test, do_header);
+    test_run("Test component schedule info", test_schedule_info, do_test, do_header);
+    test_run("Test component alarm times", test_alarm_times, do_test, do_header);
+    test_run("Test in-place value mutation", test_value_reuse, do_test, do_header);
+    test_run("Test parameter value lookup", test_parameter_value, do_test, do_header);
+    test_run("Test binary zone table sidecar", test_zones_dat, do_test, do_header);
+    test_run("Test MIME stream writer", test_mime_stream_writer, do_test, do_header);
+    test_run("Test vCal direct writer", test_vcal_writer, do_test, do_header);
+    test_run("Test parser input validation", test_parser_validation, do_test, do_header);
+    test_run("Test recurrence iterator limits", test_recur_limits, do_test, do_header);
+    test_run("Test batch recurrence expansion", test_foreach_batch, do_test, do_header);
+    test_run("Test last occurrence before", test_last_before, do_test, do_header);
     test_run("Test Attachment", test_attach, do_test, do_header);
     test_run("Test CalDAV Attachment", test_attach_caldav, do_test, do_header);
     test_run("Test Attachment with URL", test_attach_url, do_test, do_header);
     test_run("Test Attachment with data", test_attach_data, do_test, do_header);
+    test_run("Test Attachment spill to disk", test_attach_spill, do_test, do_header);
     test_run("Test icalcalendar", test_calendar, do_test, do_header);
+    test_run("Test icalcalendar Preload", test_calendar_preload, do_test, do_header);
     test_run("Test Dirset", test_dirset, do_test, do_header);
     test_run("Test vCal to iCal conversion", test_vcal, do_test, do_header);
     test_run("Test UTF-8 Handling", test_utf8, do_test, do_header);
     test_run("Test icaltime_compare UTC and zone handling", test_icaltime_compare_utc_zone, do_test, do_header);
+    test_run("Test icaltime_as_sortkey ordering", test_icaltime_sortkey, do_test, do_header);
+    test_run("Test icalcomponent_get_component_by_uid", test_component_by_uid, do_test, do_header);
+    test_run("Test icalcomponent_get_attendee", test_attendee_index, do_test, do_header);
     test_run("Test exclusion of recurrences as per r961", test_recurrenceexcluded, do_test,
              do_header);
 #if ADD_TESTS_REQUIRING_INVESTIGATION
@@ -4910,6 +9723,8 @@ int main(int argc, char *argv[])
     test_run("Test comma in quoted value of x property", test_comma_in_quoted_value, do_test,
              do_header);
     test_run("Test setting/unsetting zoneinfo dir", test_zoneinfo_stuff, do_test, do_header);
+    test_run("Test TZif change loading", test_tzif_fetch_changes, do_test, do_header);
+    test_run("Test demand-ranged timezone expansion", test_demand_ranged_expansion, do_test, do_header);
     test_run("Test TZID with UTC time", test_tzid_with_utc_time, do_test, do_header);
     test_run("Test kind_to_string", test_kind_to_string, do_test, do_header);
     test_run("Test string_to_kind", test_string_to_kind, do_test, do_header);
@@ -4918,8 +9733,19 @@ int main(int argc, char *argv[])
     test_run("Test icalvalue_decode_ical_string", test_icalvalue_decode_ical_string, do_test, do_header);
 
     test_run("Test icalarray_sort", test_icalarray_sort, do_test, do_header);
+    test_run("Test icalarray contiguous mode", test_icalarray_contiguous, do_test, do_header);
 
     test_run("Test icalcomponent_normalize", test_icalcomponent_normalize, do_test, do_header);
+    test_run("Test component binary round trip", test_component_binary_roundtrip, do_test,
+             do_header);
+    test_run("Test jCal emitter", test_component_as_jcal, do_test, do_header);
+    test_run("Test component diff/patch", test_component_diff_patch, do_test, do_header);
+    test_run("Test component hash/equal", test_component_hash_equal, do_test, do_header);
+    test_run("Test VTIMEZONE merging", test_component_merge_vtimezones, do_test, do_header);
+    test_run("Test TZID resolution", test_component_get_timezone, do_test, do_header);
+    test_run("Test value string boundaries", test_value_string_boundaries, do_test, do_header);
+    test_run("Test time span sets", test_time_span_set, do_test, do_header);
+    test_run("Test cached occurrences", test_component_occurrences_cached, do_test, do_header);
 
     /** OPTIONAL TESTS go here... **/
 
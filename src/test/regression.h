@@ -50,6 +50,7 @@ extern "C"
     void test_fileset_extended(void);
     void test_dirset_extended(void);
     void test_bdbset(void);
+    void storage_scaling_report(int n_components);
 
 /* regression-utils.c */
     const char *ical_timet_string(const time_t t);
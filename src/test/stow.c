@@ -25,6 +25,7 @@
 #include "libicalss/icalss.h"
 
 #include <ctype.h>
+#include <dirent.h>
 #include <errno.h>
 #include <stdlib.h>
 
@@ -48,6 +49,7 @@ enum options
     INPUT_IS_ICAL,
     INPUT_FROM_STDIN,
     INPUT_FROM_FILE,
+    INPUT_FROM_MAILDIR,
     ERRORS_TO_STDOUT,
     ERRORS_TO_ORGANIZER
 };
@@ -61,6 +63,7 @@ struct options_struct
     char *input_file;
     char *calid;
     char *output_file;
+    char *maildir;
 };
 
 enum file_type
@@ -116,6 +119,9 @@ static void byebye(int code, struct options_struct *opt)
     if (opt->calid) {
         free(opt->calid);
     }
+    if (opt->maildir) {
+        free(opt->maildir);
+    }
     exit(code);
 }
 
@@ -476,6 +482,7 @@ void usage(const char *message)
     fprintf(stderr, "-e\tInput data is encapsulated in a MIME Message \n\
 -m\tInput is raw iCal \n\
 -i\tSpecify input file. Otherwise, input comes from stdin\n\
+-b\tBatch mode: drain the named maildir into the output fileset\n\
 -o\tSpecify file to save incoming message to\n\
 -d\tSpecify database to send data to\n\
 -u\tSet the calid to store the data to\n\
@@ -501,6 +508,7 @@ void get_options(int argc, char *argv[], struct options_struct *opt)
     opt->errors = ERRORS_TO_ORGANIZER;
     opt->calid = 0;
     opt->output_file = 0;
+    opt->maildir = 0;
 
     while ((c = getopt(argc, argv, "nemu:o:d:b:c:i:")) != -1) {
         switch (c) {
@@ -532,6 +540,16 @@ void get_options(int argc, char *argv[], struct options_struct *opt)
                 opt->storage = STORE_IN_FILE;
                 break;
             }
+        case 'b':{
+                /* Batch mode: drain every message in a maildir into
+                   one fileset open */
+                opt->input_source = INPUT_FROM_MAILDIR;
+                if (opt->maildir) {
+                    free(opt->maildir);
+                }
+                opt->maildir = strdup(optarg);
+                break;
+            }
         case 'd':{
                 /* Output goes to database */
                 fprintf(stderr, "%s: option -d is unimplemented\n", program_name);
@@ -722,26 +740,13 @@ char *read_stream(char *s, size_t size, void *d)
     return c;
 }
 
-icalcomponent *read_nonmime_component(struct options_struct *opt)
+icalcomponent *read_nonmime_component_from_stream(FILE *stream)
 {
-    FILE *stream;
     icalcomponent *comp;
     icalparser *parser = icalparser_new();
     icalerrorstate es = icalerror_get_error_state(ICAL_MALFORMEDDATA_ERROR);
     char *line;
 
-    if (opt->input_source == INPUT_FROM_FILE) {
-        stream = fopen(opt->input_file, "r");
-
-        if (stream == 0) {
-            perror("Can't open input file");
-            byebye(1, opt);
-        }
-
-    } else {
-        stream = stdin;
-    }
-
     assert(stream != 0);
     icalparser_set_gen_data(parser, stream);
 
@@ -759,11 +764,33 @@ icalcomponent *read_nonmime_component(struct options_struct *opt)
 
     } while (line != 0);
 
+    icalparser_free(parser);
+    return comp;
+}
+
+icalcomponent *read_nonmime_component(struct options_struct *opt)
+{
+    FILE *stream;
+    icalcomponent *comp;
+
+    if (opt->input_source == INPUT_FROM_FILE) {
+        stream = fopen(opt->input_file, "r");
+
+        if (stream == 0) {
+            perror("Can't open input file");
+            byebye(1, opt);
+        }
+
+    } else {
+        stream = stdin;
+    }
+
+    comp = read_nonmime_component_from_stream(stream);
+
     if (opt->input_source == INPUT_FROM_FILE) {
         fclose(stream);
     }
 
-    icalparser_free(parser);
     return comp;
 }
 
@@ -787,9 +814,33 @@ icalcomponent *find_vcalendar(icalcomponent *comp)
     return 0;
 }
 
-icalcomponent *read_mime_component(struct options_struct *opt)
+icalcomponent *read_mime_component_from_stream(FILE *stream)
 {
     icalcomponent *comp, *mimecomp;
+
+    assert(stream != 0);
+
+    mimecomp = icalmime_parse(read_stream, (void *)stream);
+
+    /* now find the iCal component embedded within the mime component;
+       find_vcalendar() unlinks it, so the rest of the MIME tree can go.
+       A long-running batch drain can't afford to leak it per message. */
+    comp = find_vcalendar(mimecomp);
+
+    if (mimecomp != 0) {
+        icalcomponent_free(mimecomp);
+    }
+
+    if (comp == 0) {
+        return 0;
+    }
+
+    return comp;
+}
+
+icalcomponent *read_mime_component(struct options_struct *opt)
+{
+    icalcomponent *comp;
     FILE *stream;
 
     if (opt->input_source == INPUT_FROM_FILE) {
@@ -804,15 +855,10 @@ icalcomponent *read_mime_component(struct options_struct *opt)
         stream = stdin;
     }
 
-    assert(stream != 0);
+    comp = read_mime_component_from_stream(stream);
 
-    mimecomp = icalmime_parse(read_stream, (void *)stream);
-
-    /* now find the iCal component embedded within the mime component */
-    comp = find_vcalendar(mimecomp);
-
-    if (comp == 0) {
-        return 0;
+    if (opt->input_source == INPUT_FROM_FILE) {
+        fclose(stream);
     }
 
     return comp;
@@ -831,6 +877,161 @@ icalcomponent *read_component(struct options_struct *opt)
     return (icalcomponent *)NULL;
 }
 
+/* Parses, checks and stores one message from an open stream into the
+   shared fileset. Returns 0 when the component was stored, -1 when the
+   message was rejected (a failure reply has been sent) and -2 when it
+   did not parse at all. */
+int process_message(FILE *stream, icalset *fs, struct options_struct *opt)
+{
+    icalcomponent *comp, *reply;
+    icalproperty *return_status;
+    char *component_error_str;
+    icalerrorenum error;
+
+    if (opt->input_type == INPUT_IS_MIME) {
+        comp = read_mime_component_from_stream(stream);
+    } else {
+        comp = read_nonmime_component_from_stream(stream);
+    }
+
+    if (comp == 0) {
+        return -2;
+    }
+
+    if ((component_error_str = check_component(comp, &return_status, opt)) != 0) {
+        reply = make_reply(comp, return_status, opt);
+
+        return_failure(reply, component_error_str, opt);
+        icalcomponent_free(reply);
+        icalcomponent_free(comp);
+        return -1;
+    }
+
+    error = icalfileset_add_component(fs, comp);
+
+    if (error != ICAL_NO_ERROR) {
+        fprintf(stderr, "%s: Failed to write incoming component: %s\n",
+                program_name, icalerror_strerror(icalerrno));
+        byebye(1, opt);
+    }
+
+    /* With a journaled set this appends one record, so a crash loses
+       at most the in-flight message */
+    error = icalfileset_commit(fs);
+
+    if (error != ICAL_NO_ERROR) {
+        fprintf(stderr, "%s: Failed to commit incoming cluster: %s\n",
+                program_name, icalerror_strerror(icalerrno));
+        byebye(1, opt);
+    }
+
+    return 0;
+}
+
+/* Drains a maildir into the output fileset: the set is opened once in
+   journaled mode, every message under new/ is parsed from its own
+   stream, and stored messages move to cur/ the way any maildir
+   consumer retires them. Running per-message processes paid a fileset
+   load and rewrite per email; this pays them once per drain. */
+void process_maildir(struct options_struct *opt)
+{
+    char newdir[MAXPATHLEN];
+    char curdir[MAXPATHLEN];
+    char from[MAXPATHLEN];
+    char to[MAXPATHLEN];
+    DIR *dir;
+    struct dirent *de;
+    FILE *stream;
+    icalset *fs;
+    int stored = 0, rejected = 0, unparsed = 0;
+
+    if (test_file(opt->maildir) != DIRECTORY) {
+        fprintf(stderr, "%s: maildir %s is not a directory\n", program_name, opt->maildir);
+        byebye(1, opt);
+    }
+
+    snprintf(newdir, MAXPATHLEN, "%s/new", opt->maildir);
+    snprintf(curdir, MAXPATHLEN, "%s/cur", opt->maildir);
+
+    if (test_file(newdir) != DIRECTORY) {
+        /* Not laid out as a maildir; drain the directory itself and
+           leave the messages where they are */
+        snprintf(newdir, MAXPATHLEN, "%s", opt->maildir);
+        curdir[0] = '\0';
+    } else if (test_file(curdir) == NO_FILE) {
+        if (mkdir(curdir, 0775) != 0) {
+            fprintf(stderr, "%s: Failed to create %s: %s\n",
+                    program_name, curdir, strerror(errno));
+            byebye(1, opt);
+        }
+    }
+
+    if ((dir = opendir(newdir)) == 0) {
+        fprintf(stderr, "%s: Failed to open %s: %s\n", program_name, newdir, strerror(errno));
+        byebye(1, opt);
+    }
+
+    fs = icalfileset_new_journaled(opt->output_file);
+
+    if (fs == 0) {
+        fprintf(stderr, "%s: Failed to get incoming component directory: %s\n",
+                program_name, icalerror_strerror(icalerrno));
+        closedir(dir);
+        byebye(1, opt);
+    }
+
+    while ((de = readdir(dir)) != 0) {
+        if (de->d_name[0] == '.') {
+            continue;
+        }
+
+        if (snprintf(from, MAXPATHLEN, "%s/%s", newdir, de->d_name) >= MAXPATHLEN) {
+            /* Path would not fit; leave the message alone */
+            unparsed++;
+            continue;
+        }
+
+        if (test_file(from) != REGULAR) {
+            continue;
+        }
+
+        stream = fopen(from, "r");
+
+        if (stream == 0) {
+            fprintf(stderr, "%s: Can't open %s: %s\n", program_name, from, strerror(errno));
+            unparsed++;
+            continue;
+        }
+
+        switch (process_message(stream, fs, opt)) {
+        case 0:
+            stored++;
+            if (curdir[0] != '\0') {
+                if (snprintf(to, MAXPATHLEN, "%s/%s:2,S", curdir, de->d_name) >= MAXPATHLEN ||
+                    rename(from, to) != 0) {
+                    fprintf(stderr, "%s: Failed to retire %s: %s\n",
+                            program_name, from, strerror(errno));
+                }
+            }
+            break;
+        case -1:
+            rejected++;
+            break;
+        default:
+            unparsed++;
+            break;
+        }
+
+        fclose(stream);
+    }
+
+    closedir(dir);
+    icalset_free(fs);
+
+    fprintf(stderr, "%s: stored %d, rejected %d, unparsable %d\n",
+            program_name, stored, rejected, unparsed);
+}
+
 int main(int argc, char *argv[])
 {
     char *options_error_str;
@@ -848,6 +1049,11 @@ int main(int argc, char *argv[])
         byebye(1, &opt);
     }
 
+    if (opt.input_source == INPUT_FROM_MAILDIR) {
+        process_maildir(&opt);
+        byebye(0, &opt);
+    }
+
     comp = read_component(&opt);
 
     /* If the component had any fatal errors, return an error message
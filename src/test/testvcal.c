@@ -25,8 +25,11 @@
 
 #include "libicalvcal/icalvcal.h"
 #include "libicalvcal/vcc.h"
+#include "libical/icalmemory.h"
 
 #include <assert.h>
+#include <stdio.h>
+#include <string.h>
 
 /* Given a vCal data file as its first argument, this program will
    print out an equivalent iCal component.
@@ -40,8 +43,12 @@
 int main(int argc, char *argv[])
 {
     VObject *vcal = 0;
-    icalcomponent *comp;
+    icalcomponent *comp, *streamed;
     const char *file;
+    static char buf[65536];
+    char *walked_str, *streamed_str;
+    size_t len;
+    FILE *fp;
 
     if (argc != 2) {
         file = TEST_DATADIR "/user-cal.vcf";
@@ -57,6 +64,30 @@ int main(int argc, char *argv[])
 
     printf("%s\n", icalcomponent_as_ical_string(comp));
 
+    /* The fused parse-and-convert path must produce the same component
+       as the parse-then-walk path above */
+    fp = fopen(file, "r");
+    assert(fp != 0);
+    len = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[len] = '\0';
+
+    streamed = icalvcal_convert_string(buf, len);
+    if (streamed == 0) {
+        fprintf(stderr, "fused conversion returned NULL\n");
+        return 1;
+    }
+
+    walked_str = icalcomponent_as_ical_string_r(comp);
+    streamed_str = icalcomponent_as_ical_string_r(streamed);
+    if (strcmp(walked_str, streamed_str) != 0) {
+        fprintf(stderr, "fused conversion disagrees with the tree walk\n");
+        return 1;
+    }
+    icalmemory_free_buffer(walked_str);
+    icalmemory_free_buffer(streamed_str);
+
+    icalcomponent_free(streamed);
     icalcomponent_free(comp);
     return 0;
 }